@@ -0,0 +1,397 @@
+#include "audio-archive.h"
+#include "flac-encoder.h"
+#include "plugin-support.h"
+#include "whisper-utils/vad-processing.h"
+
+#include <obs-module.h>
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <set>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// A segment waiting for the writer thread, its audio in a buffer of the pool
+struct archive_segment {
+	size_t buffer;
+	size_t frames;
+	const void *stream;
+	// a run of silence the next silence chunks of the stream are appended to
+	bool open;
+	std::string folder;
+	uint64_t max_bytes;
+	uint64_t start_ms;
+	uint64_t end_ms;
+	int vad_state;
+	DetectionResult result;
+	std::string text;
+	std::string language;
+};
+
+struct archive_file {
+	std::string name;
+	uint64_t size;
+};
+
+// The FLAC files of a folder, oldest first
+struct archive_folder {
+	std::deque<archive_file> files;
+	uint64_t bytes = 0;
+};
+
+// guards the pool and the queue
+std::mutex archive_mutex;
+std::condition_variable archive_cv;
+// wakes audio_archive_sync when the queue is written
+std::condition_variable archive_idle_cv;
+std::thread archive_thread;
+bool archive_stop = false;
+bool archive_writing = false;
+std::vector<std::vector<float>> pool;
+std::vector<size_t> free_buffers;
+std::deque<archive_segment> segments;
+uint64_t dropped_segments = 0;
+
+// only used by the writer thread
+std::map<std::string, archive_folder> folders;
+std::vector<uint8_t> encoded;
+
+const char *const INDEX_FILE_NAME = "index.jsonl";
+
+FILE *open_file(const std::filesystem::path &path, const char *mode)
+{
+#ifdef _WIN32
+	const std::wstring wide_mode(mode, mode + strlen(mode));
+	return _wfopen(path.wstring().c_str(), wide_mode.c_str());
+#else
+	return fopen(path.c_str(), mode);
+#endif
+}
+
+bool write_file(const std::filesystem::path &path, const char *mode, const void *data,
+		size_t size)
+{
+	FILE *file = open_file(path, mode);
+	if (file == nullptr) {
+		return false;
+	}
+	const bool written = fwrite(data, 1, size, file) == size;
+	return (fclose(file) == 0) && written;
+}
+
+const char *result_name(DetectionResult result)
+{
+	switch (result) {
+	case DETECTION_RESULT_SILENCE:
+		return "silence";
+	case DETECTION_RESULT_SPEECH:
+		return "speech";
+	case DETECTION_RESULT_SUPPRESSED:
+		return "suppressed";
+	case DETECTION_RESULT_NO_INFERENCE:
+		return "no_inference";
+	case DETECTION_RESULT_PARTIAL:
+		return "partial";
+	default:
+		return "unknown";
+	}
+}
+
+// The folder state, from the FLAC files already in it on first use
+archive_folder *get_folder(const std::string &folder)
+{
+	auto it = folders.find(folder);
+	if (it != folders.end()) {
+		return &it->second;
+	}
+	const std::filesystem::path path = std::filesystem::u8path(folder);
+	std::error_code ec;
+	std::filesystem::create_directories(path, ec);
+	if (!std::filesystem::is_directory(path, ec)) {
+		obs_log(LOG_ERROR, "Cannot create the audio archive folder %s", folder.c_str());
+		return nullptr;
+	}
+	archive_folder &entry = folders[folder];
+	for (std::filesystem::directory_iterator dir(path, ec), end; !ec && dir != end;
+	     dir.increment(ec)) {
+		std::error_code file_ec;
+		if (!dir->is_regular_file(file_ec) || dir->path().extension() != ".flac") {
+			continue;
+		}
+		const uint64_t size = dir->file_size(file_ec);
+		if (!file_ec) {
+			entry.files.push_back({dir->path().filename().u8string(), size});
+			entry.bytes += size;
+		}
+	}
+	// the names start with the zero padded start time
+	std::sort(entry.files.begin(), entry.files.end(),
+		  [](const archive_file &a, const archive_file &b) { return a.name < b.name; });
+	return &entry;
+}
+
+// Rewrite the index without the lines of the removed files
+void remove_index_lines(const std::filesystem::path &folder, const std::set<std::string> &removed)
+{
+	const std::filesystem::path index_path = folder / INDEX_FILE_NAME;
+	FILE *index = open_file(index_path, "rb");
+	if (index == nullptr) {
+		return;
+	}
+	std::string content;
+	char chunk[64 * 1024];
+	for (size_t n; (n = fread(chunk, 1, sizeof(chunk), index)) > 0;) {
+		content.append(chunk, n);
+	}
+	fclose(index);
+
+	std::string kept;
+	for (size_t begin = 0; begin < content.size();) {
+		size_t end = content.find('\n', begin);
+		end = (end == std::string::npos) ? content.size() : end + 1;
+		const std::string line = content.substr(begin, end - begin);
+		begin = end;
+		const nlohmann::json entry = nlohmann::json::parse(line, nullptr, false);
+		if (entry.is_object() && entry.contains("file") && entry["file"].is_string() &&
+		    removed.count(entry["file"].get<std::string>()) > 0) {
+			continue;
+		}
+		kept += line;
+	}
+	std::filesystem::path tmp_path = index_path;
+	tmp_path += ".tmp";
+	std::error_code ec;
+	if (!write_file(tmp_path, "wb", kept.data(), kept.size())) {
+		obs_log(LOG_ERROR, "Cannot write the audio archive index %s",
+			index_path.u8string().c_str());
+		std::filesystem::remove(tmp_path, ec);
+		return;
+	}
+	std::filesystem::rename(tmp_path, index_path, ec);
+	if (ec) {
+		obs_log(LOG_ERROR, "Cannot replace the audio archive index %s: %s",
+			index_path.u8string().c_str(), ec.message().c_str());
+	}
+}
+
+// Remove the oldest files while the folder is over its maximal size, keeping the newest one
+void prune_folder(const std::string &folder, archive_folder &entry, uint64_t max_bytes)
+{
+	if (entry.bytes <= max_bytes) {
+		return;
+	}
+	const uint64_t target = max_bytes / 100 * AUDIO_ARCHIVE_PRUNE_PERCENT;
+	const std::filesystem::path path = std::filesystem::u8path(folder);
+	std::set<std::string> removed;
+	while (entry.bytes > target && entry.files.size() > 1) {
+		const archive_file &oldest = entry.files.front();
+		std::error_code ec;
+		std::filesystem::remove(path / std::filesystem::u8path(oldest.name), ec);
+		if (ec) {
+			obs_log(LOG_WARNING, "Cannot remove the archived segment %s: %s",
+				oldest.name.c_str(), ec.message().c_str());
+		}
+		removed.insert(oldest.name);
+		entry.bytes -= oldest.size;
+		entry.files.pop_front();
+	}
+	remove_index_lines(path, removed);
+}
+
+void write_segment(const archive_segment &segment, const std::vector<float> &audio)
+{
+	archive_folder *entry = get_folder(segment.folder);
+	if (entry == nullptr) {
+		return;
+	}
+	const std::filesystem::path path = std::filesystem::u8path(segment.folder);
+	const char *kind = (segment.vad_state == VAD_STATE_IS_OFF) ? "silence" : "speech";
+	char name[64];
+	snprintf(name, sizeof(name), "%013llu-%s.flac", (unsigned long long)segment.start_ms, kind);
+	std::string file_name = name;
+	std::error_code ec;
+	// two streams archived to the same folder can start a segment in the same millisecond
+	for (int i = 1; std::filesystem::exists(path / file_name, ec); i++) {
+		snprintf(name, sizeof(name), "%013llu-%s-%d.flac",
+			 (unsigned long long)segment.start_ms, kind, i);
+		file_name = name;
+	}
+
+	flac_encode_mono16(audio.data(), segment.frames, WHISPER_SAMPLE_RATE, encoded);
+	if (!write_file(path / file_name, "wb", encoded.data(), encoded.size())) {
+		obs_log(LOG_ERROR, "Cannot write the archived segment %s in %s", file_name.c_str(),
+			segment.folder.c_str());
+		return;
+	}
+	entry->files.push_back({file_name, (uint64_t)encoded.size()});
+	entry->bytes += encoded.size();
+
+	nlohmann::json line;
+	line["file"] = file_name;
+	line["start_ms"] = segment.start_ms;
+	line["end_ms"] = segment.end_ms;
+	line["duration"] = (double)segment.frames / WHISPER_SAMPLE_RATE;
+	line["vad_state"] = kind;
+	line["result"] = result_name(segment.result);
+	line["text"] = segment.text;
+	line["language"] = segment.language;
+	const std::string text =
+		line.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace) + "\n";
+	if (!write_file(path / INDEX_FILE_NAME, "ab", text.data(), text.size())) {
+		obs_log(LOG_ERROR, "Cannot write the audio archive index in %s",
+			segment.folder.c_str());
+	}
+	prune_folder(segment.folder, *entry, segment.max_bytes);
+}
+
+// archive_mutex must be held
+std::deque<archive_segment>::iterator next_closed_segment()
+{
+	return std::find_if(segments.begin(), segments.end(),
+			    [](const archive_segment &segment) { return !segment.open; });
+}
+
+// archive_mutex must be held
+void close_silence_runs()
+{
+	for (archive_segment &segment : segments) {
+		segment.open = false;
+	}
+}
+
+void archive_loop()
+{
+	std::unique_lock<std::mutex> lock(archive_mutex);
+	while (true) {
+		archive_cv.wait(lock, [] {
+			return archive_stop || next_closed_segment() != segments.end();
+		});
+		if (archive_stop) {
+			close_silence_runs();
+		}
+		const auto next = next_closed_segment();
+		if (next == segments.end()) {
+			break;
+		}
+		const archive_segment segment = std::move(*next);
+		segments.erase(next);
+		archive_writing = true;
+		lock.unlock();
+		// the buffer is only used by this thread until it is returned to the pool
+		write_segment(segment, pool[segment.buffer]);
+		lock.lock();
+		archive_writing = false;
+		free_buffers.push_back(segment.buffer);
+		if (segments.empty()) {
+			archive_idle_cv.notify_all();
+		}
+	}
+	archive_idle_cv.notify_all();
+}
+
+} // namespace
+
+bool audio_archive_queue(const void *stream, const audio_archive_settings &settings,
+			 uint64_t start_timestamp_ms, const float *pcm32f_data, size_t frames,
+			 int vad_state, const DetectionResultWithText &result)
+{
+	if (settings.folder.empty() || frames == 0) {
+		return true;
+	}
+	const bool silence = vad_state == VAD_STATE_IS_OFF;
+	size_t buffer;
+	{
+		std::lock_guard<std::mutex> lock(archive_mutex);
+		if (pool.empty()) {
+			pool.resize(AUDIO_ARCHIVE_POOL_SIZE);
+			for (size_t i = 0; i < pool.size(); i++) {
+				pool[i].reserve(AUDIO_ARCHIVE_BUFFER_SAMPLES);
+				free_buffers.push_back(i);
+			}
+		}
+		// the last segment of the stream, when it is a run of silence still open
+		const auto last = std::find_if(segments.rbegin(), segments.rend(),
+					       [stream](const archive_segment &segment) {
+						       return segment.stream == stream;
+					       });
+		if (last != segments.rend() && last->open) {
+			if (silence && last->folder == settings.folder &&
+			    last->frames + frames <= AUDIO_ARCHIVE_SILENCE_MAX_SAMPLES) {
+				// the writer does not take an open run, it is appended to in place
+				std::vector<float> &audio = pool[last->buffer];
+				audio.insert(audio.end(), pcm32f_data, pcm32f_data + frames);
+				last->frames += frames;
+				last->end_ms = start_timestamp_ms + result.end_timestamp_ms;
+				return true;
+			}
+			last->open = false;
+			archive_cv.notify_one();
+		}
+		if (free_buffers.empty()) {
+			if (dropped_segments++ % 100 == 0) {
+				obs_log(LOG_WARNING,
+					"Audio archive is behind, %llu segments dropped so far",
+					(unsigned long long)dropped_segments);
+			}
+			return false;
+		}
+		buffer = free_buffers.back();
+		free_buffers.pop_back();
+		if (!archive_thread.joinable()) {
+			archive_stop = false;
+			archive_thread = std::thread(archive_loop);
+		}
+	}
+	// the buffer is taken from the pool, copied without holding the lock
+	pool[buffer].assign(pcm32f_data, pcm32f_data + frames);
+	archive_segment segment{buffer,
+				frames,
+				stream,
+				silence,
+				settings.folder,
+				settings.max_bytes,
+				start_timestamp_ms + result.start_timestamp_ms,
+				start_timestamp_ms + result.end_timestamp_ms,
+				vad_state,
+				result.result,
+				result.text,
+				result.language};
+	{
+		std::lock_guard<std::mutex> lock(archive_mutex);
+		segments.push_back(std::move(segment));
+	}
+	archive_cv.notify_one();
+	return true;
+}
+
+void audio_archive_sync()
+{
+	std::unique_lock<std::mutex> lock(archive_mutex);
+	close_silence_runs();
+	archive_cv.notify_all();
+	archive_idle_cv.wait(lock, [] {
+		return (segments.empty() && !archive_writing) || !archive_thread.joinable();
+	});
+}
+
+void shutdown_audio_archive(void)
+{
+	{
+		std::lock_guard<std::mutex> lock(archive_mutex);
+		archive_stop = true;
+	}
+	archive_cv.notify_all();
+	if (archive_thread.joinable()) {
+		archive_thread.join();
+	}
+}
@@ -0,0 +1,83 @@
+/**
+ * @file audio-archive.h
+ * @brief Background archive of the audio segments cut by the VAD, as FLAC files.
+ *
+ * The whisper threads copy the audio of each segment into a buffer of a preallocated pool and
+ * queue it; a single writer thread encodes it to a FLAC file in the archive folder and appends
+ * a line to the index.jsonl of the folder with the timestamps, the VAD state and the transcribed
+ * text. A segment is dropped when all the buffers of the pool are waiting, so the whisper
+ * threads never wait for the encoding. The consecutive silence chunks of a stream are merged
+ * into one segment of up to AUDIO_ARCHIVE_SILENCE_MAX_SAMPLES, which is written when the speech
+ * comes back. When the files of a folder exceed the maximal size of the
+ * archive, the oldest are removed with their index lines. The archive is read back by the
+ * re-transcription of the recordings, see recording-retranscription.h.
+ */
+#ifndef AUDIO_ARCHIVE_H
+#define AUDIO_ARCHIVE_H
+
+#ifdef __cplusplus
+#include "whisper-utils/whisper-processing.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// segments waiting for the writer thread, the next ones are dropped
+#define AUDIO_ARCHIVE_POOL_SIZE 8
+// capacity of each buffer of the pool, in samples (30 s at 16 kHz), grown for longer segments
+#define AUDIO_ARCHIVE_BUFFER_SAMPLES (30 * 16000)
+// default size of the files of an archive folder, in MB
+#define AUDIO_ARCHIVE_DEFAULT_MAX_MB 1024
+// the oldest files are removed until the archive is under this percentage of its maximal size
+#define AUDIO_ARCHIVE_PRUNE_PERCENT 90
+// the longest run of silence merged into one segment, in samples (30 s at 16 kHz)
+#define AUDIO_ARCHIVE_SILENCE_MAX_SAMPLES (30 * 16000)
+
+// The archive settings of a filter, replaced as a whole on update
+struct audio_archive_settings {
+	// UTF-8, empty when the archive is off
+	std::string folder;
+	// maximal size of the FLAC files of the folder
+	uint64_t max_bytes = 0;
+	// archive the silence between the segments
+	bool silence = false;
+};
+
+/**
+ * @brief Queue a segment for the archive.
+ *
+ * @param stream The stream of the segment, its silence chunks are merged.
+ * @param settings Archive folder, created if it does not exist, and its maximal size.
+ * @param start_timestamp_ms Wall clock time of the start of the stream, the result timestamps
+ * are offsets from it.
+ * @param pcm32f_data Audio of the segment, 16 kHz mono.
+ * @param frames Number of samples.
+ * @param vad_state VAD state of the segment.
+ * @param result Transcription of the segment, DETECTION_RESULT_SILENCE for the silence.
+ * @return false if the segment was dropped, the pool being full.
+ */
+bool audio_archive_queue(const void *stream, const audio_archive_settings &settings,
+			 uint64_t start_timestamp_ms, const float *pcm32f_data, size_t frames,
+			 int vad_state, const DetectionResultWithText &result);
+
+/**
+ * @brief Wait until the queued segments are written to the archive, with the runs of silence
+ * merged so far.
+ */
+void audio_archive_sync();
+
+extern "C" {
+#endif
+
+/**
+ * @brief Write the queued segments and stop the writer thread.
+ *
+ * Called on module unload.
+ */
+void shutdown_audio_archive(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // AUDIO_ARCHIVE_H
@@ -0,0 +1,510 @@
+#include "caption-server.h"
+#include "plugin-support.h"
+#include "transcription-filter-data.h"
+
+#include <obs-module.h>
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <utility>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+typedef SOCKET socket_t;
+#define close_socket closesocket
+#define SHUTDOWN_BOTH SD_BOTH
+#else
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int socket_t;
+#define INVALID_SOCKET (-1)
+#define close_socket close
+#define SHUTDOWN_BOTH SHUT_RDWR
+#endif
+
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL
+#else
+#define SEND_FLAGS 0
+#endif
+
+namespace {
+
+// how often the accepting thread checks for stop
+const int ACCEPT_POLL_MS = 200;
+const int REQUEST_TIMEOUT_MS = 5000;
+const size_t REQUEST_MAX_SIZE = 8192;
+
+typedef std::shared_ptr<const std::string> caption_event;
+
+struct caption_client {
+	socket_t socket;
+	// guarded by the mutex of the server
+	std::deque<caption_event> queue;
+	bool closed = false;
+	std::atomic<bool> done{false};
+	std::thread thread;
+};
+
+// Wait until the socket can be read, false on timeout or error
+bool wait_readable(socket_t socket, int timeout_ms)
+{
+	fd_set read_set;
+	FD_ZERO(&read_set);
+	FD_SET(socket, &read_set);
+	timeval timeout;
+	timeout.tv_sec = timeout_ms / 1000;
+	timeout.tv_usec = (timeout_ms % 1000) * 1000;
+	return select((int)socket + 1, &read_set, nullptr, nullptr, &timeout) > 0;
+}
+
+bool send_all(socket_t socket, const std::string &data)
+{
+	size_t sent = 0;
+	while (sent < data.size()) {
+		const int n = (int)send(socket, data.data() + sent, (int)(data.size() - sent),
+					SEND_FLAGS);
+		if (n <= 0) {
+			return false;
+		}
+		sent += (size_t)n;
+	}
+	return true;
+}
+
+std::string trim(const std::string &s)
+{
+	const size_t start = s.find_first_not_of(" \t");
+	if (start == std::string::npos) {
+		return "";
+	}
+	return s.substr(start, s.find_last_not_of(" \t") - start + 1);
+}
+
+// The value of the Origin header of the request, empty if there is none
+std::string request_origin(const std::string &request)
+{
+	size_t line_start = request.find("\r\n");
+	while (line_start != std::string::npos) {
+		line_start += 2;
+		const size_t line_end = request.find("\r\n", line_start);
+		if (line_end == std::string::npos || line_end == line_start) {
+			break;
+		}
+		const std::string line = request.substr(line_start, line_end - line_start);
+		const size_t colon = line.find(':');
+		if (colon != std::string::npos) {
+			std::string name = trim(line.substr(0, colon));
+			std::transform(name.begin(), name.end(), name.begin(),
+				       [](unsigned char c) { return (char)std::tolower(c); });
+			if (name == "origin") {
+				return trim(line.substr(colon + 1));
+			}
+		}
+		line_start = line_end;
+	}
+	return "";
+}
+
+// The origins of a setting, separated by commas or spaces, without a trailing slash
+std::set<std::string> parse_origins(const std::string &origins)
+{
+	std::set<std::string> parsed;
+	size_t start = 0;
+	while (start < origins.size()) {
+		const size_t end = origins.find_first_of(", \t\r\n", start);
+		std::string origin = origins.substr(start, end - start);
+		while (!origin.empty() && origin.back() == '/') {
+			origin.pop_back();
+		}
+		if (!origin.empty()) {
+			parsed.insert(origin);
+		}
+		if (end == std::string::npos) {
+			break;
+		}
+		start = end + 1;
+	}
+	return parsed;
+}
+
+// Read the request line and headers, and check that the captions are requested
+bool read_request(socket_t socket, std::string &origin)
+{
+	std::string request;
+	char buffer[1024];
+	while (request.find("\r\n\r\n") == std::string::npos) {
+		if (request.size() > REQUEST_MAX_SIZE ||
+		    !wait_readable(socket, REQUEST_TIMEOUT_MS)) {
+			return false;
+		}
+		const int n = (int)recv(socket, buffer, sizeof(buffer), 0);
+		if (n <= 0) {
+			return false;
+		}
+		request.append(buffer, (size_t)n);
+	}
+	// the query string is ignored
+	const size_t path_end = request.find_first_of(" ?", 4);
+	const std::string path =
+		request.compare(0, 4, "GET ") == 0 ? request.substr(4, path_end - 4) : "";
+	origin = request_origin(request);
+	return path == "/" || path == "/captions";
+}
+
+class CaptionServer {
+public:
+	explicit CaptionServer(int port_) : port(port_) {}
+	~CaptionServer() { stop(); }
+
+	bool start()
+	{
+		listen_socket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+		if (listen_socket == INVALID_SOCKET) {
+			obs_log(LOG_ERROR, "Caption server: cannot create the socket");
+			return false;
+		}
+		int reuse = 1;
+		setsockopt(listen_socket, SOL_SOCKET, SO_REUSEADDR, (const char *)&reuse,
+			   sizeof(reuse));
+		sockaddr_in address;
+		memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		// local only, the captions are not exposed to the network
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		address.sin_port = htons((uint16_t)port);
+		if (bind(listen_socket, (const sockaddr *)&address, sizeof(address)) != 0 ||
+		    listen(listen_socket, 16) != 0) {
+			obs_log(LOG_ERROR, "Caption server: cannot listen on port %d", port);
+			close_socket(listen_socket);
+			listen_socket = INVALID_SOCKET;
+			return false;
+		}
+		accept_thread = std::thread(&CaptionServer::accept_loop, this);
+		obs_log(LOG_INFO, "Caption server: listening on http://127.0.0.1:%d/captions",
+			port);
+		return true;
+	}
+
+	void stop()
+	{
+		if (listen_socket == INVALID_SOCKET) {
+			return;
+		}
+		stopping = true;
+		if (accept_thread.joinable()) {
+			accept_thread.join();
+		}
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (auto &client : clients) {
+				client->closed = true;
+				// unblocks a client thread blocked in send
+				shutdown(client->socket, SHUTDOWN_BOTH);
+			}
+		}
+		cv.notify_all();
+		for (auto &client : clients) {
+			client->thread.join();
+			close_socket(client->socket);
+		}
+		clients.clear();
+		close_socket(listen_socket);
+		listen_socket = INVALID_SOCKET;
+		obs_log(LOG_INFO, "Caption server: stopped on port %d", port);
+	}
+
+	void publish(const char *event, nlohmann::json data)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		if (clients.empty()) {
+			return;
+		}
+		const uint64_t seq = ++last_seq;
+		data["seq"] = seq;
+		// serialized once for all the clients
+		auto message = std::make_shared<const std::string>(
+			"id: " + std::to_string(seq) + "\nevent: " + event + "\ndata: " +
+			data.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace) +
+			"\n\n");
+		for (auto &client : clients) {
+			if (client->closed) {
+				continue;
+			}
+			if (client->queue.size() >= CAPTION_SERVER_MAX_QUEUED_EVENTS) {
+				obs_log(LOG_WARNING, "Caption server: dropping a slow client");
+				client->closed = true;
+				continue;
+			}
+			client->queue.push_back(message);
+		}
+		lock.unlock();
+		cv.notify_all();
+	}
+
+	void set_allowed_origins(std::set<std::string> origins)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		allowed_origins = std::move(origins);
+	}
+
+private:
+	bool origin_allowed(const std::string &origin)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return allowed_origins.count(origin) > 0;
+	}
+
+	void accept_loop()
+	{
+		while (!stopping) {
+			remove_done_clients();
+			if (!wait_readable(listen_socket, ACCEPT_POLL_MS)) {
+				continue;
+			}
+			const socket_t socket = accept(listen_socket, nullptr, nullptr);
+			if (socket == INVALID_SOCKET) {
+				continue;
+			}
+#ifdef SO_NOSIGPIPE
+			int no_sigpipe = 1;
+			setsockopt(socket, SOL_SOCKET, SO_NOSIGPIPE, &no_sigpipe,
+				   sizeof(no_sigpipe));
+#endif
+			auto client = std::make_shared<caption_client>();
+			client->socket = socket;
+			std::lock_guard<std::mutex> lock(mutex);
+			clients.push_back(client);
+			client->thread =
+				std::thread(&CaptionServer::client_loop, this, client.get());
+		}
+	}
+
+	void remove_done_clients()
+	{
+		std::list<std::shared_ptr<caption_client>> done;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for (auto it = clients.begin(); it != clients.end();) {
+				if ((*it)->done) {
+					done.push_back(*it);
+					it = clients.erase(it);
+				} else {
+					++it;
+				}
+			}
+		}
+		for (auto &client : done) {
+			client->thread.join();
+			close_socket(client->socket);
+		}
+	}
+
+	void client_loop(caption_client *client)
+	{
+		std::string origin;
+		if (!read_request(client->socket, origin)) {
+			send_all(client->socket, "HTTP/1.1 404 Not Found\r\n"
+						 "Content-Length: 0\r\n"
+						 "Connection: close\r\n\r\n");
+			client->done = true;
+			return;
+		}
+		if (!origin.empty() && !origin_allowed(origin)) {
+			// a web page the user did not allow would read the live transcript
+			obs_log(LOG_WARNING, "Caption server: rejected a request from origin %s",
+				origin.c_str());
+			send_all(client->socket, "HTTP/1.1 403 Forbidden\r\n"
+						 "Content-Length: 0\r\n"
+						 "Connection: close\r\n\r\n");
+			client->done = true;
+			return;
+		}
+		std::string response = "HTTP/1.1 200 OK\r\n"
+				       "Content-Type: text/event-stream\r\n"
+				       "Cache-Control: no-cache\r\n"
+				       "Connection: keep-alive\r\n";
+		if (!origin.empty()) {
+			// only an allowed page origin is given back, other clients need no CORS
+			response += "Access-Control-Allow-Origin: " + origin + "\r\n";
+			response += "Vary: Origin\r\n";
+		}
+		response += "\r\nretry: 1000\n\n";
+		bool connected = send_all(client->socket, response);
+		std::unique_lock<std::mutex> lock(mutex);
+		while (connected && !client->closed) {
+			if (client->queue.empty()) {
+				const auto keepalive =
+					std::chrono::seconds(CAPTION_SERVER_KEEPALIVE_SECONDS);
+				const bool woken = cv.wait_for(lock, keepalive, [client] {
+					return client->closed || !client->queue.empty();
+				});
+				if (!woken) {
+					lock.unlock();
+					connected = send_all(client->socket, ": keep-alive\n\n");
+					lock.lock();
+				}
+				continue;
+			}
+			const caption_event message = client->queue.front();
+			client->queue.pop_front();
+			lock.unlock();
+			connected = send_all(client->socket, *message);
+			lock.lock();
+		}
+		client->closed = true;
+		client->queue.clear();
+		client->done = true;
+	}
+
+	const int port;
+	socket_t listen_socket = INVALID_SOCKET;
+	std::atomic<bool> stopping{false};
+	std::thread accept_thread;
+	// guards the clients and their queues
+	std::mutex mutex;
+	// wakes the client threads on new events and on stop
+	std::condition_variable cv;
+	std::list<std::shared_ptr<caption_client>> clients;
+	uint64_t last_seq = 0;
+	std::set<std::string> allowed_origins;
+};
+
+// guards the servers and the subscriptions
+std::mutex servers_mutex;
+std::map<int, std::unique_ptr<CaptionServer>> servers;
+
+struct caption_subscription {
+	int port;
+	std::set<std::string> origins;
+};
+
+// port and allowed origins of each publishing filter
+std::map<transcription_filter_data *, caption_subscription> subscriptions;
+
+// servers_mutex must be held. Allow the origins of all the filters publishing on the port.
+void update_server_origins(int port)
+{
+	auto server = servers.find(port);
+	if (server == servers.end()) {
+		return;
+	}
+	std::set<std::string> origins;
+	for (const auto &subscription : subscriptions) {
+		if (subscription.second.port == port) {
+			origins.insert(subscription.second.origins.begin(),
+				       subscription.second.origins.end());
+		}
+	}
+	server->second->set_allowed_origins(std::move(origins));
+}
+
+// servers_mutex must be held. Returns the server if no filter uses it anymore.
+std::unique_ptr<CaptionServer> release_server(int port)
+{
+	for (const auto &subscription : subscriptions) {
+		if (subscription.second.port == port) {
+			update_server_origins(port);
+			return nullptr;
+		}
+	}
+	auto it = servers.find(port);
+	if (it == servers.end()) {
+		return nullptr;
+	}
+	std::unique_ptr<CaptionServer> server = std::move(it->second);
+	servers.erase(it);
+	return server;
+}
+
+} // namespace
+
+void caption_server_subscribe(struct transcription_filter_data *gf, int port,
+			      const std::string &allowed_origins)
+{
+#ifdef _WIN32
+	static std::once_flag winsock_init;
+	std::call_once(winsock_init, [] {
+		WSADATA wsa_data;
+		WSAStartup(MAKEWORD(2, 2), &wsa_data);
+	});
+#endif
+	std::unique_ptr<CaptionServer> unused;
+	{
+		std::lock_guard<std::mutex> lock(servers_mutex);
+		std::set<std::string> origins = parse_origins(allowed_origins);
+		auto subscription = subscriptions.find(gf);
+		if (subscription != subscriptions.end()) {
+			if (subscription->second.port == port) {
+				subscription->second.origins = std::move(origins);
+				update_server_origins(port);
+				return;
+			}
+			const int previous_port = subscription->second.port;
+			subscriptions.erase(subscription);
+			unused = release_server(previous_port);
+		}
+		if (servers.find(port) == servers.end()) {
+			auto server = std::make_unique<CaptionServer>(port);
+			if (!server->start()) {
+				return;
+			}
+			servers[port] = std::move(server);
+		}
+		subscriptions[gf] = {port, std::move(origins)};
+		update_server_origins(port);
+	}
+	// stopped without the lock, it waits for the server threads
+	unused.reset();
+}
+
+void caption_server_unsubscribe(struct transcription_filter_data *gf)
+{
+	std::unique_ptr<CaptionServer> unused;
+	{
+		std::lock_guard<std::mutex> lock(servers_mutex);
+		auto subscription = subscriptions.find(gf);
+		if (subscription == subscriptions.end()) {
+			return;
+		}
+		const int port = subscription->second.port;
+		subscriptions.erase(subscription);
+		unused = release_server(port);
+	}
+	unused.reset();
+}
+
+void caption_server_publish(struct transcription_filter_data *gf, const char *event,
+			    const char *type, const std::string &language,
+			    const std::string &text, bool partial)
+{
+	std::lock_guard<std::mutex> lock(servers_mutex);
+	auto subscription = subscriptions.find(gf);
+	if (subscription == subscriptions.end()) {
+		return;
+	}
+	const char *filter_name = gf->context != nullptr ? obs_source_get_name(gf->context) : "";
+	nlohmann::json data;
+	data["filter"] = filter_name != nullptr ? filter_name : "";
+	data["type"] = type;
+	data["language"] = language;
+	data["partial"] = partial;
+	data["text"] = text;
+	servers[subscription->second.port]->publish(event, std::move(data));
+}
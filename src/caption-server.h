@@ -0,0 +1,68 @@
+/**
+ * @file caption-server.h
+ * @brief Local Server-Sent Events endpoint pushing the captions to overlays.
+ *
+ * A server listens on 127.0.0.1 for each port the filters selected. A browser source or any
+ * other client connects with `new EventSource("http://127.0.0.1:<port>/captions")` and receives
+ * one event per caption:
+ *
+ *     id: <sequence number>
+ *     event: caption | buffered
+ *     data: {"seq": 1, "filter": "...", "type": "transcription", "language": "en",
+ *            "partial": false, "text": "..."}
+ *
+ * `caption` events are the sentences as they are output (transcription, translation,
+ * cloud_translation), partials included. `buffered` events are the lines rendered by the
+ * buffered output monitors. An event is serialized once and the same buffer is sent to all the
+ * clients, each by its own thread so a slow client does not delay the others; a client more
+ * than CAPTION_SERVER_MAX_QUEUED_EVENTS behind is disconnected.
+ *
+ * Any web page open in the browser of the user could connect to the loopback port, so the
+ * requests of pages are checked by their Origin header: only the origins the filters publishing
+ * on the port allow are served, and given back in Access-Control-Allow-Origin. The OBS browser
+ * sources showing a local file have the origin CAPTION_SERVER_DEFAULT_ORIGINS. Requests without
+ * an Origin header, from other programs, are served.
+ */
+#ifndef CAPTION_SERVER_H
+#define CAPTION_SERVER_H
+
+#include <string>
+
+#define CAPTION_SERVER_DEFAULT_PORT 8765
+#define CAPTION_SERVER_MAX_QUEUED_EVENTS 256
+// comment line sent to idle clients, so proxies and browsers keep the connection
+#define CAPTION_SERVER_KEEPALIVE_SECONDS 15
+// the origin of the local files in the OBS browser sources
+#define CAPTION_SERVER_DEFAULT_ORIGINS "http://absolute"
+
+struct transcription_filter_data;
+
+/**
+ * @brief Publish the captions of the filter on the server of the port, started if needed.
+ *
+ * A filter publishing on another port is moved to the new one.
+ *
+ * @param allowed_origins The origins of the pages allowed to read the captions, separated by
+ * commas or spaces. A server allows the origins of all the filters publishing on it.
+ */
+void caption_server_subscribe(struct transcription_filter_data *gf, int port,
+			      const std::string &allowed_origins);
+
+/**
+ * @brief Stop publishing the captions of the filter.
+ *
+ * The server is stopped when no filter publishes on it anymore.
+ */
+void caption_server_unsubscribe(struct transcription_filter_data *gf);
+
+/**
+ * @brief Push a caption of the filter to the clients, if the filter publishes.
+ *
+ * @param event "caption" or "buffered".
+ * @param type "transcription", "translation" or "cloud_translation".
+ */
+void caption_server_publish(struct transcription_filter_data *gf, const char *event,
+			    const char *type, const std::string &language,
+			    const std::string &text, bool partial);
+
+#endif // CAPTION_SERVER_H
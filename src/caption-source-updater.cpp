@@ -0,0 +1,191 @@
+#include "caption-source-updater.h"
+#include "plugin-support.h"
+#include "transcription-filter-data.h"
+
+#include <obs-module.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <thread>
+
+namespace {
+
+// The caption output of a filter to one text source
+struct caption_target {
+	transcription_filter_data *gf;
+	std::string source_name;
+	// only used by the updater thread
+	obs_weak_source_t *weak_source = nullptr;
+	std::string pending;
+	bool has_pending = false;
+	std::string written;
+	bool has_written = false;
+	std::chrono::steady_clock::time_point next_write;
+};
+
+// guards the targets and the updater state
+std::mutex updater_mutex;
+// wakes the updater on new captions, and stop_caption_updates when a write finished
+std::condition_variable updater_cv;
+std::thread updater_thread;
+bool updater_stop = false;
+std::list<caption_target> targets;
+// filter of the write in progress, nullptr if none
+transcription_filter_data *writing_filter = nullptr;
+
+// The source of the target, nullptr if there is no source of that name
+obs_source_t *get_target_source(caption_target &target)
+{
+	obs_source_t *source = obs_weak_source_get_source(target.weak_source);
+	if (source != nullptr) {
+		const char *name = obs_source_get_name(source);
+		if (name != nullptr && target.source_name == name) {
+			return source;
+		}
+		// renamed, the name now refers to another source
+		obs_source_release(source);
+	}
+	obs_weak_source_release(target.weak_source);
+	target.weak_source = nullptr;
+	source = obs_get_source_by_name(target.source_name.c_str());
+	if (source != nullptr) {
+		target.weak_source = obs_source_get_weak_source(source);
+	}
+	return source;
+}
+
+void write_caption(caption_target &target, const std::string &caption)
+{
+	obs_source_t *source = get_target_source(target);
+	if (source == nullptr) {
+		obs_log(target.gf->log_level, "text_source target is null");
+		return;
+	}
+	// only the text is changed, the other settings of the source are kept
+	obs_data_t *text_settings = obs_data_create();
+	obs_data_set_string(text_settings, "text", caption.c_str());
+	obs_source_update(source, text_settings);
+	obs_data_release(text_settings);
+	obs_source_release(source);
+}
+
+void updater_loop()
+{
+	std::unique_lock<std::mutex> lock(updater_mutex);
+	while (!updater_stop) {
+		const auto now = std::chrono::steady_clock::now();
+		caption_target *due = nullptr;
+		bool has_deadline = false;
+		std::chrono::steady_clock::time_point deadline;
+		for (auto &target : targets) {
+			if (!target.has_pending) {
+				continue;
+			}
+			if (target.next_write <= now) {
+				due = &target;
+				break;
+			}
+			if (!has_deadline || target.next_write < deadline) {
+				deadline = target.next_write;
+				has_deadline = true;
+			}
+		}
+
+		if (due == nullptr) {
+			if (has_deadline) {
+				updater_cv.wait_until(lock, deadline);
+			} else {
+				updater_cv.wait(lock);
+			}
+			continue;
+		}
+
+		due->has_pending = false;
+		if (due->has_written && due->pending == due->written) {
+			continue;
+		}
+		due->written.swap(due->pending);
+		due->has_written = true;
+		due->next_write =
+			now + std::chrono::microseconds(due->gf->caption_update_interval_us);
+		writing_filter = due->gf;
+		const std::string caption = due->written;
+		lock.unlock();
+		// the target is kept: stop_caption_updates waits for the write
+		write_caption(*due, caption);
+		lock.lock();
+		writing_filter = nullptr;
+		updater_cv.notify_all();
+	}
+}
+
+} // namespace
+
+void queue_caption_update(struct transcription_filter_data *gf,
+			  const std::string &target_source_name, const std::string &caption)
+{
+	if (target_source_name.empty()) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(updater_mutex);
+		if (!updater_thread.joinable()) {
+			updater_stop = false;
+			updater_thread = std::thread(updater_loop);
+		}
+		caption_target *target = nullptr;
+		for (auto &existing : targets) {
+			if (existing.gf == gf && existing.source_name == target_source_name) {
+				target = &existing;
+				break;
+			}
+		}
+		if (target == nullptr) {
+			targets.push_back({gf, target_source_name});
+			target = &targets.back();
+		}
+		target->pending = caption;
+		target->has_pending = true;
+	}
+	updater_cv.notify_all();
+}
+
+int64_t caption_update_interval_us(int max_rate)
+{
+	if (max_rate > 0) {
+		return 1000000 / max_rate;
+	}
+	struct obs_video_info ovi;
+	if (obs_get_video_info(&ovi) && ovi.fps_num > 0) {
+		return (int64_t)1000000 * ovi.fps_den / ovi.fps_num;
+	}
+	return 1000000 / CAPTION_UPDATE_DEFAULT_RATE;
+}
+
+void stop_caption_updates(struct transcription_filter_data *gf)
+{
+	std::unique_lock<std::mutex> lock(updater_mutex);
+	updater_cv.wait(lock, [gf] { return writing_filter != gf; });
+	for (auto it = targets.begin(); it != targets.end();) {
+		if (it->gf == gf) {
+			obs_weak_source_release(it->weak_source);
+			it = targets.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+void shutdown_caption_source_updater(void)
+{
+	{
+		std::lock_guard<std::mutex> lock(updater_mutex);
+		updater_stop = true;
+	}
+	updater_cv.notify_all();
+	if (updater_thread.joinable()) {
+		updater_thread.join();
+	}
+}
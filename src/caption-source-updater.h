@@ -0,0 +1,57 @@
+/**
+ * @file caption-source-updater.h
+ * @brief Coalesced updates of the text sources the captions are output to.
+ *
+ * With buffered output the caption changes for every token, and each update of a text source
+ * makes OBS render its text again. The latest caption of each filter and source is kept, and a
+ * single thread writes it at most once per update interval of the filter, by default once per
+ * video frame. A caption equal to the one last written is not written again. The sources are
+ * held by weak references and only looked up by name again when removed or renamed.
+ */
+#ifndef CAPTION_SOURCE_UPDATER_H
+#define CAPTION_SOURCE_UPDATER_H
+
+#ifdef __cplusplus
+#include <cstdint>
+#include <string>
+
+// update rate when the video frame rate is not known
+#define CAPTION_UPDATE_DEFAULT_RATE 30
+
+struct transcription_filter_data;
+
+/**
+ * @brief Queue a caption for the text source, replacing the one still waiting.
+ *
+ * Starts the updater thread on first use.
+ */
+void queue_caption_update(struct transcription_filter_data *gf,
+			  const std::string &target_source_name, const std::string &caption);
+
+/**
+ * @brief Minimal time between two updates of a text source, in microseconds.
+ *
+ * @param max_rate Maximal updates per second, 0 for the video frame rate.
+ */
+int64_t caption_update_interval_us(int max_rate);
+
+/**
+ * @brief Drop the queued captions of the filter and wait for its running update.
+ *
+ * Called on filter destroy, after the caption monitors are stopped.
+ */
+void stop_caption_updates(struct transcription_filter_data *gf);
+
+extern "C" {
+#endif
+
+/**
+ * @brief Stop the updater thread, called on module unload.
+ */
+void shutdown_caption_source_updater(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // CAPTION_SOURCE_UPDATER_H
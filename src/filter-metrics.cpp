@@ -0,0 +1,196 @@
+#include "filter-metrics.h"
+#include "plugin-support.h"
+#include "transcription-filter-data.h"
+
+#include <obs-module.h>
+
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+// guards the registered filters
+std::mutex filters_mutex;
+std::vector<transcription_filter_data *> filters;
+
+nlohmann::json stage_to_json(const stage_timings &timings, PipelineStage stage)
+{
+	const uint64_t count = timings.count[stage].load(std::memory_order_relaxed);
+	const double total_ms =
+		(double)timings.total_ns[stage].load(std::memory_order_relaxed) / 1e6;
+	return {{"count", count},
+		{"total_ms", total_ms},
+		{"mean_ms", count > 0 ? total_ms / (double)count : 0.0},
+		{"last_ms", (double)timings.last_ns[stage].load(std::memory_order_relaxed) / 1e6}};
+}
+
+// filters_mutex must be held, the filter is alive
+nlohmann::json filter_to_json(transcription_filter_data *gf)
+{
+	const filter_metrics &metrics = gf->metrics;
+	const stage_timings &timings = metrics.timings;
+	const char *name = gf->context != nullptr ? obs_source_get_name(gf->context) : nullptr;
+	const uint32_t sample_rate = std::max<uint32_t>(gf->sample_rate, 1);
+
+	size_t segment_queue_length = 0;
+	{
+		std::lock_guard<std::mutex> lock(gf->inference_queue_mutex);
+		segment_queue_length = gf->inference_queue.size();
+	}
+	size_t translation_queue_length = 0;
+	{
+		std::lock_guard<std::mutex> lock(gf->translation_queue_mutex);
+		translation_queue_length = gf->translation_queue.size();
+	}
+	const uint64_t dropped_frames = gf->input_buffer.dropped_frames();
+
+	nlohmann::json vad = stage_to_json(timings, PIPELINE_STAGE_VAD);
+	const uint64_t vad_windows = timings.units[PIPELINE_STAGE_VAD].load();
+	vad["ms_per_window"] =
+		vad_windows > 0 ? vad["total_ms"].get<double>() / (double)vad_windows : 0.0;
+	// share of the windows that did not run the model
+	vad["gated_ratio"] = vad_windows > 0 ? (double)metrics.vad_windows_gated.load() /
+						       (double)vad_windows
+					     : 0.0;
+	nlohmann::json whisper_full = stage_to_json(timings, PIPELINE_STAGE_WHISPER);
+	// time of the inference per time of audio
+	const uint64_t whisper_audio_ms = timings.units[PIPELINE_STAGE_WHISPER].load();
+	const double whisper_rtf =
+		whisper_audio_ms > 0
+			? whisper_full["total_ms"].get<double>() / (double)whisper_audio_ms
+			: 0.0;
+
+	const uint64_t cloud_requests = metrics.cloud_requests.load();
+	const double cloud_total_ms = (double)metrics.cloud_request_total_ns.load() / 1e6;
+	const uint64_t captions = metrics.captions.load();
+	return {{"filter", name != nullptr ? name : ""},
+		{"active", gf->active},
+		{"input_buffer_ms",
+		 (double)gf->input_buffer.frames_available() * 1000.0 / sample_rate},
+		{"dropped_frames", dropped_frames},
+		{"dropped_ms", (double)dropped_frames * 1000.0 / sample_rate},
+		{"segment_queue_length", segment_queue_length},
+		{"translation_queue_length", translation_queue_length},
+		{"resample", stage_to_json(timings, PIPELINE_STAGE_RESAMPLE)},
+		{"vad", vad},
+		{"whisper_full", whisper_full},
+		{"whisper_rtf", whisper_rtf},
+		{"translation", stage_to_json(timings, PIPELINE_STAGE_TRANSLATION)},
+		{"output", stage_to_json(timings, PIPELINE_STAGE_OUTPUT)},
+		{"cloud_request",
+		 {{"count", cloud_requests},
+		  {"total_ms", cloud_total_ms},
+		  {"mean_ms", cloud_requests > 0 ? cloud_total_ms / (double)cloud_requests : 0.0},
+		  {"last_ms", (double)metrics.cloud_request_last_ns.load() / 1e6}}},
+		{"cloud_errors", metrics.cloud_errors.load()},
+		{"partials_aborted", metrics.partials_aborted.load()},
+		{"overload_level", gf->overload.level()},
+		{"overload_rtf", gf->overload.rtf()},
+		{"caption_latency",
+		 {{"count", captions},
+		  {"mean_ms", captions > 0 ? (double)metrics.caption_latency_total_ms.load() /
+						     (double)captions
+					   : 0.0},
+		  {"last_ms", metrics.caption_latency_last_ms.load()},
+		  {"max_ms", metrics.caption_latency_max_ms.load()}}}};
+}
+
+// Callback of an obs-websocket vendor request, see obs-websocket-api.h
+typedef void (*vendor_request_callback)(obs_data_t *request_data, obs_data_t *response_data,
+					void *priv_data);
+struct vendor_request {
+	vendor_request_callback callback;
+	void *priv_data;
+};
+
+void get_metrics_request(obs_data_t *request_data, obs_data_t *response_data, void *)
+{
+	const char *filter_name = obs_data_get_string(request_data, "filter");
+	const nlohmann::json snapshot =
+		filter_metrics_snapshot(filter_name != nullptr ? filter_name : "");
+	obs_data_t *response = obs_data_create_from_json(snapshot.dump().c_str());
+	if (response != nullptr) {
+		obs_data_apply(response_data, response);
+		obs_data_release(response);
+	}
+}
+
+// The proc handler of the obs-websocket API, nullptr if obs-websocket is not loaded
+proc_handler_t *websocket_proc_handler()
+{
+	calldata_t cd;
+	calldata_init(&cd);
+	proc_handler_t *ph = nullptr;
+	if (proc_handler_call(obs_get_proc_handler(), "obs_websocket_api_get_ph", &cd)) {
+		ph = (proc_handler_t *)calldata_ptr(&cd, "ph");
+	}
+	calldata_free(&cd);
+	return ph;
+}
+
+} // namespace
+
+void filter_metrics_register(struct transcription_filter_data *gf)
+{
+	std::lock_guard<std::mutex> lock(filters_mutex);
+	if (std::find(filters.begin(), filters.end(), gf) == filters.end()) {
+		filters.push_back(gf);
+	}
+}
+
+void filter_metrics_unregister(struct transcription_filter_data *gf)
+{
+	std::lock_guard<std::mutex> lock(filters_mutex);
+	filters.erase(std::remove(filters.begin(), filters.end(), gf), filters.end());
+}
+
+nlohmann::json filter_metrics_snapshot(const std::string &filter_name)
+{
+	nlohmann::json json_filters = nlohmann::json::array();
+	std::lock_guard<std::mutex> lock(filters_mutex);
+	for (transcription_filter_data *gf : filters) {
+		nlohmann::json filter = filter_to_json(gf);
+		if (filter_name.empty() || filter["filter"] == filter_name) {
+			json_filters.push_back(std::move(filter));
+		}
+	}
+	return {{"filters", json_filters}};
+}
+
+extern "C" void init_filter_metrics_vendor(void)
+{
+	proc_handler_t *ph = websocket_proc_handler();
+	if (ph == nullptr) {
+		obs_log(LOG_INFO,
+			"obs-websocket is not available, the metrics requests are disabled");
+		return;
+	}
+	calldata_t cd;
+	calldata_init(&cd);
+	calldata_set_string(&cd, "name", "localvocal");
+	void *vendor = nullptr;
+	if (proc_handler_call(ph, "vendor_register", &cd)) {
+		vendor = calldata_ptr(&cd, "vendor");
+	}
+	calldata_free(&cd);
+	if (vendor == nullptr) {
+		obs_log(LOG_WARNING, "Cannot register the obs-websocket vendor");
+		return;
+	}
+
+	// copied by obs-websocket
+	vendor_request request = {get_metrics_request, nullptr};
+	calldata_init(&cd);
+	calldata_set_ptr(&cd, "vendor", vendor);
+	calldata_set_string(&cd, "type", "GetMetrics");
+	calldata_set_ptr(&cd, "callback", &request);
+	const bool registered = proc_handler_call(ph, "vendor_request_register", &cd) &&
+				calldata_bool(&cd, "success");
+	calldata_free(&cd);
+	if (!registered) {
+		obs_log(LOG_WARNING, "Cannot register the GetMetrics obs-websocket request");
+		return;
+	}
+	obs_log(LOG_INFO, "Registered the GetMetrics request of the obs-websocket vendor");
+}
@@ -0,0 +1,84 @@
+/**
+ * @file filter-metrics.h
+ * @brief Live performance metrics of the filters, for the metrics dock and obs-websocket.
+ *
+ * Each filter counts the work of its pipeline as it runs: the time of the stages (through
+ * gf->pipeline_timings), the cloud translation requests and the end-to-end latency of the
+ * captions, from the end of their audio to their output. A snapshot adds the state of the
+ * buffers and queues at the time it is taken. The snapshots are shown in the LocalVocal metrics
+ * dock and returned by the GetMetrics request of the "localvocal" obs-websocket vendor:
+ *
+ *     {"filters": [{"filter": "...", "input_buffer_ms": 20, "dropped_frames": 0,
+ *                   "segment_queue_length": 0, "vad": {...}, "whisper_full": {...},
+ *                   "whisper_rtf": 0.12, "translation": {...}, "cloud_request": {...},
+ *                   "cloud_errors": 0, "caption_latency": {...}}, ...]}
+ *
+ * The counters are totals since the filter was created, so a client computes rates from the
+ * difference of two snapshots.
+ */
+#ifndef FILTER_METRICS_H
+#define FILTER_METRICS_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+#include <nlohmann/json.hpp>
+
+#include "whisper-utils/stage-timings.h"
+
+struct transcription_filter_data;
+
+struct filter_metrics {
+	stage_timings timings;
+	std::atomic<uint64_t> cloud_requests{0};
+	std::atomic<uint64_t> cloud_errors{0};
+	std::atomic<uint64_t> cloud_request_total_ns{0};
+	std::atomic<uint64_t> cloud_request_last_ns{0};
+	std::atomic<uint64_t> captions{0};
+	std::atomic<uint64_t> caption_latency_total_ms{0};
+	std::atomic<uint64_t> caption_latency_last_ms{0};
+	std::atomic<uint64_t> caption_latency_max_ms{0};
+	// partial inferences aborted by a newer segment
+	std::atomic<uint64_t> partials_aborted{0};
+	// VAD windows the energy pre-gate kept from the model
+	std::atomic<uint64_t> vad_windows_gated{0};
+
+	void add_cloud_request(uint64_t ns, bool error)
+	{
+		cloud_requests.fetch_add(1, std::memory_order_relaxed);
+		cloud_errors.fetch_add(error ? 1 : 0, std::memory_order_relaxed);
+		cloud_request_total_ns.fetch_add(ns, std::memory_order_relaxed);
+		cloud_request_last_ns.store(ns, std::memory_order_relaxed);
+	}
+
+	void add_caption_latency(uint64_t ms)
+	{
+		captions.fetch_add(1, std::memory_order_relaxed);
+		caption_latency_total_ms.fetch_add(ms, std::memory_order_relaxed);
+		caption_latency_last_ms.store(ms, std::memory_order_relaxed);
+		uint64_t max = caption_latency_max_ms.load(std::memory_order_relaxed);
+		while (ms > max && !caption_latency_max_ms.compare_exchange_weak(
+					   max, ms, std::memory_order_relaxed)) {
+		}
+	}
+};
+
+/**
+ * @brief Make the metrics of the filter visible to the dock and obs-websocket.
+ */
+void filter_metrics_register(struct transcription_filter_data *gf);
+
+/**
+ * @brief Remove the filter, waiting for a snapshot that reads it to finish.
+ */
+void filter_metrics_unregister(struct transcription_filter_data *gf);
+
+/**
+ * @brief Snapshot of the metrics of the registered filters, or of the filter with that name.
+ *
+ * @return {"filters": [...]}, see the file comment.
+ */
+nlohmann::json filter_metrics_snapshot(const std::string &filter_name = "");
+
+#endif // FILTER_METRICS_H
@@ -0,0 +1,470 @@
+#include "flac-encoder.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+
+// fixed predictors of order 0 to 4 and partition orders 0 to 8
+constexpr int MAX_FIXED_ORDER = 4;
+constexpr int MAX_PARTITION_ORDER = 8;
+// parameter 15 is the escape code of the 4 bit Rice parameters
+constexpr uint32_t MAX_RICE_PARAMETER = 14;
+constexpr int BITS_PER_SAMPLE = 16;
+
+class bit_writer {
+public:
+	explicit bit_writer(std::vector<uint8_t> &out_) : out(out_) {}
+
+	// n <= 32 bits, most significant first
+	void put(uint32_t value, int n)
+	{
+		if (n == 0) {
+			return;
+		}
+		const uint64_t mask = (n == 32) ? 0xffffffffull : ((1ull << n) - 1);
+		acc = (acc << n) | (value & mask);
+		bits += n;
+		while (bits >= 8) {
+			bits -= 8;
+			out.push_back((uint8_t)(acc >> bits));
+		}
+	}
+
+	void put_signed(int32_t value, int n) { put((uint32_t)value, n); }
+
+	void put_rice(int32_t residual, uint32_t parameter)
+	{
+		const uint32_t folded = ((uint32_t)residual << 1) ^ (uint32_t)(residual >> 31);
+		for (uint32_t zeros = folded >> parameter; zeros > 0;) {
+			const uint32_t n = std::min<uint32_t>(zeros, 32);
+			put(0, (int)n);
+			zeros -= n;
+		}
+		put(1, 1);
+		put(folded, (int)parameter);
+	}
+
+	void align()
+	{
+		if (bits > 0) {
+			put(0, 8 - bits);
+		}
+	}
+
+private:
+	std::vector<uint8_t> &out;
+	uint64_t acc = 0;
+	int bits = 0;
+};
+
+class bit_reader {
+public:
+	bit_reader(const uint8_t *data_, size_t size_) : data(data_), size(size_) {}
+
+	// n <= 32 bits, false past the end of the data
+	bool get(int n, uint32_t &value)
+	{
+		if (n < 0 || bit + (size_t)n > size * 8) {
+			return false;
+		}
+		uint64_t v = 0;
+		for (int i = 0; i < n; i++, bit++) {
+			v = (v << 1) | ((data[bit >> 3] >> (7 - (bit & 7))) & 1);
+		}
+		value = (uint32_t)v;
+		return true;
+	}
+
+	bool get_signed(int n, int32_t &value)
+	{
+		uint32_t v;
+		if (!get(n, v)) {
+			return false;
+		}
+		const uint32_t sign = 1u << (n - 1);
+		value = (int32_t)((v ^ sign) - sign);
+		return true;
+	}
+
+	bool get_rice(uint32_t parameter, int32_t &residual)
+	{
+		uint32_t zeros = 0;
+		for (uint32_t b = 0; b == 0; zeros++) {
+			if (!get(1, b)) {
+				return false;
+			}
+		}
+		uint32_t low;
+		if (!get((int)parameter, low)) {
+			return false;
+		}
+		const uint32_t folded = ((zeros - 1) << parameter) | low;
+		residual = (int32_t)(folded >> 1) ^ -(int32_t)(folded & 1);
+		return true;
+	}
+
+	void align() { bit = (bit + 7) & ~(size_t)7; }
+	size_t byte_position() const { return bit >> 3; }
+
+private:
+	const uint8_t *data;
+	size_t size;
+	size_t bit = 0;
+};
+
+uint8_t crc8(const uint8_t *data, size_t size)
+{
+	uint8_t crc = 0;
+	for (size_t i = 0; i < size; i++) {
+		crc ^= data[i];
+		for (int b = 0; b < 8; b++) {
+			crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+		}
+	}
+	return crc;
+}
+
+uint16_t crc16(const uint8_t *data, size_t size)
+{
+	uint16_t crc = 0;
+	for (size_t i = 0; i < size; i++) {
+		crc ^= (uint16_t)(data[i] << 8);
+		for (int b = 0; b < 8; b++) {
+			crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x8005)
+					     : (uint16_t)(crc << 1);
+		}
+	}
+	return crc;
+}
+
+// the frame number in the extended UTF-8 coding of the frame header
+void put_utf8(bit_writer &writer, uint64_t value)
+{
+	if (value < 0x80) {
+		writer.put((uint32_t)value, 8);
+		return;
+	}
+	int continuation = 1;
+	while (continuation < 6 && value >= (1ull << (6 - continuation + 6 * continuation))) {
+		continuation++;
+	}
+	const int first_bits = 6 - continuation;
+	const uint32_t lead = (0xff00u >> (continuation + 1)) & 0xff;
+	writer.put(lead | ((uint32_t)(value >> (6 * continuation)) & ((1u << first_bits) - 1)), 8);
+	for (int i = continuation - 1; i >= 0; i--) {
+		writer.put(0x80 | (uint32_t)((value >> (6 * i)) & 0x3f), 8);
+	}
+}
+
+void fixed_residual(const int32_t *x, size_t n, int order, int32_t *residual)
+{
+	for (size_t i = (size_t)order; i < n; i++) {
+		switch (order) {
+		case 0:
+			residual[i] = x[i];
+			break;
+		case 1:
+			residual[i] = x[i] - x[i - 1];
+			break;
+		case 2:
+			residual[i] = x[i] - 2 * x[i - 1] + x[i - 2];
+			break;
+		case 3:
+			residual[i] = x[i] - 3 * x[i - 1] + 3 * x[i - 2] - x[i - 3];
+			break;
+		default:
+			residual[i] = x[i] - 4 * x[i - 1] + 6 * x[i - 2] - 4 * x[i - 3] + x[i - 4];
+		}
+	}
+}
+
+// The Rice parameter of a partition and its estimated size in bits, from the folded residuals
+uint64_t rice_partition_bits(uint64_t folded_sum, size_t n, uint32_t &parameter)
+{
+	uint64_t best = UINT64_MAX;
+	for (uint32_t k = 0; k <= MAX_RICE_PARAMETER; k++) {
+		const uint64_t bits = 4 + (uint64_t)n * (k + 1) + (folded_sum >> k);
+		if (bits < best) {
+			best = bits;
+			parameter = k;
+		}
+	}
+	return best;
+}
+
+// The partition order and Rice parameters of the residual of a block, and their estimated size
+struct residual_coding {
+	int order = 0;
+	uint32_t parameters[1 << MAX_PARTITION_ORDER] = {};
+	uint64_t bits = UINT64_MAX;
+};
+
+void choose_partitions(const int32_t *residual, size_t n, int predictor_order,
+		       residual_coding &coding)
+{
+	// the partition sums at the highest order the block size allows, merged for the lower ones
+	int max_order = 0;
+	while (max_order < MAX_PARTITION_ORDER && (n % (2u << max_order)) == 0 &&
+	       (n >> (max_order + 1)) > (size_t)predictor_order) {
+		max_order++;
+	}
+	uint64_t sums[1 << MAX_PARTITION_ORDER] = {};
+	const size_t finest = n >> max_order;
+	for (size_t p = 0; p < ((size_t)1 << max_order); p++) {
+		const size_t begin = (p == 0) ? (size_t)predictor_order : p * finest;
+		for (size_t i = begin; i < (p + 1) * finest; i++) {
+			sums[p] += ((uint32_t)residual[i] << 1) ^ (uint32_t)(residual[i] >> 31);
+		}
+	}
+	coding.bits = UINT64_MAX;
+	for (int order = max_order; order >= 0; order--) {
+		if (order < max_order) {
+			for (size_t p = 0; p < ((size_t)1 << order); p++) {
+				sums[p] = sums[2 * p] + sums[2 * p + 1];
+			}
+		}
+		const size_t partition = n >> order;
+		uint32_t parameters[1 << MAX_PARTITION_ORDER];
+		uint64_t bits = 2 + 4;
+		for (size_t p = 0; p < ((size_t)1 << order); p++) {
+			const size_t count = partition - (p == 0 ? (size_t)predictor_order : 0);
+			bits += rice_partition_bits(sums[p], count, parameters[p]);
+		}
+		if (bits < coding.bits) {
+			coding.bits = bits;
+			coding.order = order;
+			std::copy(parameters, parameters + ((size_t)1 << order), coding.parameters);
+		}
+	}
+}
+
+void write_subframe(bit_writer &writer, const int32_t *x, size_t n, int32_t *residual)
+{
+	if (std::all_of(x, x + n, [x](int32_t v) { return v == x[0]; })) {
+		writer.put(0, 8); // constant
+		writer.put_signed(x[0], BITS_PER_SAMPLE);
+		return;
+	}
+	int best_order = -1;
+	residual_coding best;
+	best.bits = (uint64_t)n * BITS_PER_SAMPLE;
+	residual_coding coding;
+	for (int order = 0; order <= MAX_FIXED_ORDER && (size_t)order < n; order++) {
+		fixed_residual(x, n, order, residual);
+		choose_partitions(residual, n, order, coding);
+		const uint64_t bits = (uint64_t)order * BITS_PER_SAMPLE + coding.bits;
+		if (bits < best.bits) {
+			best = coding;
+			best.bits = bits;
+			best_order = order;
+		}
+	}
+	if (best_order < 0) {
+		writer.put(1 << 1, 8); // verbatim
+		for (size_t i = 0; i < n; i++) {
+			writer.put_signed(x[i], BITS_PER_SAMPLE);
+		}
+		return;
+	}
+	writer.put((uint32_t)(0x08 | best_order) << 1, 8); // fixed, no wasted bits
+	for (int i = 0; i < best_order; i++) {
+		writer.put_signed(x[i], BITS_PER_SAMPLE);
+	}
+	fixed_residual(x, n, best_order, residual);
+	writer.put(0, 2); // Rice coding with 4 bit parameters
+	writer.put((uint32_t)best.order, 4);
+	const size_t partition = n >> best.order;
+	for (size_t p = 0; p < ((size_t)1 << best.order); p++) {
+		writer.put(best.parameters[p], 4);
+		const size_t begin = (p == 0) ? (size_t)best_order : p * partition;
+		for (size_t i = begin; i < (p + 1) * partition; i++) {
+			writer.put_rice(residual[i], best.parameters[p]);
+		}
+	}
+}
+
+} // namespace
+
+void flac_encode_mono16(const float *samples, size_t count, uint32_t sample_rate,
+			std::vector<uint8_t> &out)
+{
+	out.clear();
+	out.reserve(count + 64);
+	bit_writer writer(out);
+	const uint32_t block_size = count < FLAC_BLOCK_SIZE ? (uint32_t)std::max<size_t>(count, 16)
+							    : FLAC_BLOCK_SIZE;
+
+	writer.put(0x664c6143, 32); // "fLaC"
+	writer.put(0x80, 8);        // last metadata block, STREAMINFO
+	writer.put(34, 24);
+	writer.put(block_size, 16); // minimal and maximal block size
+	writer.put(block_size, 16);
+	writer.put(0, 24); // minimal and maximal frame size, unknown
+	writer.put(0, 24);
+	writer.put(sample_rate, 20);
+	writer.put(0, 3); // 1 channel
+	writer.put(BITS_PER_SAMPLE - 1, 5);
+	writer.put((uint32_t)((uint64_t)count >> 32) & 0xf, 4);
+	writer.put((uint32_t)count, 32);
+	for (int i = 0; i < 4; i++) {
+		writer.put(0, 32); // MD5, not computed
+	}
+
+	std::vector<int32_t> block(FLAC_BLOCK_SIZE);
+	std::vector<int32_t> residual(FLAC_BLOCK_SIZE);
+	uint64_t frame_number = 0;
+	for (size_t offset = 0; offset < count; offset += FLAC_BLOCK_SIZE, frame_number++) {
+		const size_t n = std::min<size_t>(FLAC_BLOCK_SIZE, count - offset);
+		for (size_t i = 0; i < n; i++) {
+			const float sample = std::clamp(samples[offset + i], -1.0f, 1.0f);
+			block[i] = (int32_t)std::lrint(sample * 32767.0f);
+		}
+
+		const size_t frame_start = out.size();
+		writer.put(0xfff8, 16); // sync code, fixed block size stream
+		writer.put(0x7, 4);     // block size - 1 in 16 bits after the frame number
+		writer.put(0x0, 4);     // sample rate of the STREAMINFO
+		writer.put(0x0, 4);     // mono
+		writer.put(0x4, 3);     // 16 bits per sample
+		writer.put(0, 1);
+		put_utf8(writer, frame_number);
+		writer.put((uint32_t)(n - 1), 16);
+		writer.put(crc8(out.data() + frame_start, out.size() - frame_start), 8);
+
+		write_subframe(writer, block.data(), n, residual.data());
+		writer.align();
+		writer.put(crc16(out.data() + frame_start, out.size() - frame_start), 16);
+	}
+}
+
+bool flac_decode_mono16(const uint8_t *data, size_t size, std::vector<float> &samples,
+			uint32_t &sample_rate)
+{
+	samples.clear();
+	bit_reader reader(data, size);
+	uint32_t v;
+	uint32_t header;
+	if (!reader.get(32, v) || v != 0x664c6143 || !reader.get(32, header) ||
+	    header != (0x80u << 24 | 34)) {
+		return false;
+	}
+	uint32_t channels;
+	uint32_t bits_per_sample;
+	uint32_t count_high;
+	uint32_t count_low;
+	if (!reader.get(32, v) || !reader.get(32, v) || !reader.get(16, v) ||
+	    !reader.get(20, sample_rate) || !reader.get(3, channels) ||
+	    !reader.get(5, bits_per_sample) || !reader.get(4, count_high) ||
+	    !reader.get(32, count_low) || channels != 0 || bits_per_sample != BITS_PER_SAMPLE - 1) {
+		return false;
+	}
+	const uint64_t count = ((uint64_t)count_high << 32) | count_low;
+	for (int i = 0; i < 4; i++) {
+		reader.get(32, v);
+	}
+	samples.reserve((size_t)count);
+
+	std::vector<int32_t> block;
+	while (samples.size() < count) {
+		const size_t frame_start = reader.byte_position();
+		uint32_t sync, block_code, rate_code, channel_code, size_code, reserved, lead;
+		if (!reader.get(16, sync) || sync != 0xfff8 || !reader.get(4, block_code) ||
+		    !reader.get(4, rate_code) || !reader.get(4, channel_code) ||
+		    !reader.get(3, size_code) || !reader.get(1, reserved) || block_code != 0x7 ||
+		    rate_code != 0 || channel_code != 0 || size_code != 0x4 ||
+		    !reader.get(8, lead)) {
+			return false;
+		}
+		// skip the continuation bytes of the frame number
+		for (uint32_t mask = 0x40; (lead & 0x80) && (lead & mask); mask >>= 1) {
+			reader.get(8, v);
+		}
+		uint32_t n_minus_1;
+		uint32_t crc;
+		if (!reader.get(16, n_minus_1) || !reader.get(8, crc) ||
+		    crc != crc8(data + frame_start, reader.byte_position() - 1 - frame_start)) {
+			return false;
+		}
+		const size_t n = (size_t)n_minus_1 + 1;
+		uint32_t subframe;
+		if (!reader.get(8, subframe) || (subframe & 0x81) != 0) {
+			return false;
+		}
+		const uint32_t type = subframe >> 1;
+		block.resize(n);
+		if (type == 0) {
+			int32_t value;
+			if (!reader.get_signed(BITS_PER_SAMPLE, value)) {
+				return false;
+			}
+			std::fill(block.begin(), block.end(), value);
+		} else if (type == 1) {
+			for (size_t i = 0; i < n; i++) {
+				if (!reader.get_signed(BITS_PER_SAMPLE, block[i])) {
+					return false;
+				}
+			}
+		} else if ((type & ~7u) == 0x08 && (type & 7) <= MAX_FIXED_ORDER &&
+			   (type & 7) < n) {
+			const int order = (int)(type & 7);
+			for (int i = 0; i < order; i++) {
+				if (!reader.get_signed(BITS_PER_SAMPLE, block[i])) {
+					return false;
+				}
+			}
+			uint32_t method, partition_order;
+			if (!reader.get(2, method) || method != 0 ||
+			    !reader.get(4, partition_order) ||
+			    (n % ((size_t)1 << partition_order)) != 0 ||
+			    (n >> partition_order) < (size_t)order) {
+				return false;
+			}
+			const size_t partition = n >> partition_order;
+			for (size_t p = 0; p < ((size_t)1 << partition_order); p++) {
+				uint32_t parameter;
+				if (!reader.get(4, parameter) || parameter > MAX_RICE_PARAMETER) {
+					return false;
+				}
+				const size_t begin = (p == 0) ? (size_t)order : p * partition;
+				for (size_t i = begin; i < (p + 1) * partition; i++) {
+					if (!reader.get_rice(parameter, block[i])) {
+						return false;
+					}
+				}
+			}
+			// the residuals are replaced by the samples in place
+			const int32_t *x = block.data();
+			for (size_t i = (size_t)order; i < n; i++) {
+				switch (order) {
+				case 0:
+					break;
+				case 1:
+					block[i] += x[i - 1];
+					break;
+				case 2:
+					block[i] += 2 * x[i - 1] - x[i - 2];
+					break;
+				case 3:
+					block[i] += 3 * x[i - 1] - 3 * x[i - 2] + x[i - 3];
+					break;
+				default:
+					block[i] += 4 * x[i - 1] - 6 * x[i - 2] + 4 * x[i - 3] -
+						    x[i - 4];
+				}
+			}
+		} else {
+			return false;
+		}
+		reader.align();
+		const size_t frame_end = reader.byte_position();
+		if (!reader.get(16, crc) ||
+		    crc != crc16(data + frame_start, frame_end - frame_start)) {
+			return false;
+		}
+		for (size_t i = 0; i < n && samples.size() < count; i++) {
+			samples.push_back((float)block[i] / 32767.0f);
+		}
+	}
+	return true;
+}
@@ -0,0 +1,44 @@
+/**
+ * @file flac-encoder.h
+ * @brief Minimal FLAC encoder and decoder for the mono 16 bit audio segments of the archive.
+ *
+ * Each block of FLAC_BLOCK_SIZE samples is written as a constant subframe when all its samples
+ * are equal (the silence padding), otherwise with the fixed predictor of order 0 to 4 and the
+ * Rice partition order that give the smallest estimate, or verbatim when none of them is
+ * smaller than the samples. The decoder reads back these streams, not the LPC subframes or
+ * stereo of other encoders.
+ */
+#ifndef FLAC_ENCODER_H
+#define FLAC_ENCODER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// samples of a FLAC frame, the last frame of a stream can be shorter
+#define FLAC_BLOCK_SIZE 4096
+
+/**
+ * @brief Encode mono samples to a FLAC stream, 16 bits per sample.
+ *
+ * @param samples Samples in [-1, 1], clipped to the range.
+ * @param count Number of samples.
+ * @param sample_rate Sample rate in Hz.
+ * @param out Filled with the FLAC stream, STREAMINFO included (the MD5 is not computed).
+ */
+void flac_encode_mono16(const float *samples, size_t count, uint32_t sample_rate,
+			std::vector<uint8_t> &out);
+
+/**
+ * @brief Decode a stream written by flac_encode_mono16.
+ *
+ * @param data FLAC stream.
+ * @param size Size of the stream in bytes.
+ * @param samples Filled with the samples in [-1, 1].
+ * @param sample_rate Set to the sample rate of the stream.
+ * @return false if the stream is invalid or uses features the encoder does not write.
+ */
+bool flac_decode_mono16(const uint8_t *data, size_t size, std::vector<float> &samples,
+			uint32_t &sample_rate);
+
+#endif // FLAC_ENCODER_H
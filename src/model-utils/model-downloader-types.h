@@ -38,5 +38,10 @@ struct ModelInfo {
 
 extern const std::map<std::string, ModelInfo> &models_info();
 extern const std::vector<ModelInfo> get_sorted_models_info(std::optional<ModelType> type_filter);
+// Add a model made on the machine, e.g. quantized after its download, listed with the models of
+// the directory from now on and in the next sessions
+extern void register_local_model(const ModelInfo &model_info);
+// Stop the background revalidation of the models directory, called on module unload
+extern "C" void shutdown_models_info(void);
 
 #endif /* MODEL_DOWNLOADER_TYPES_H */
@@ -3,20 +3,254 @@
 
 #include <obs-module.h>
 
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <deque>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <list>
+#include <memory>
 #include <sstream>
 
+#include "model-downloader.h"
+#include "model-index.h"
+#include "model-quantize.h"
 #include "sha256.h"
 
-size_t write_data(void *ptr, size_t size, size_t nmemb, FILE *stream)
+namespace {
+
+// the files larger than that are downloaded in chunks of that size, in parallel
+const curl_off_t DOWNLOAD_CHUNK_SIZE = 32 * 1024 * 1024;
+const int MAX_PARALLEL_TRANSFERS = 4;
+// attempts of a transfer, each one resumed from where the previous one stopped
+const int MAX_TRANSFER_ATTEMPTS = 5;
+// a transfer slower than 1 byte/s for that long is restarted
+const long STALLED_TRANSFER_SECONDS = 30;
+
+// A model file downloaded to <path>.part, renamed to <path> once its hash is checked
+struct download_file {
+	std::string url;
+	std::string sha256;
+	std::filesystem::path path;
+	std::filesystem::path part_path;
+	// the completed chunks of the .part file, to resume in another session
+	std::filesystem::path chunks_path;
+	// -1 if unknown
+	curl_off_t size = -1;
+	bool accepts_ranges = false;
+	std::vector<bool> chunk_done;
+	FILE *fp = nullptr;
+	// hash of the first `hashed` bytes, updated as they arrive in order
+	SHA256 hash;
+	curl_off_t hashed = 0;
+};
+
+// A transfer of a range of a file, the whole file if it is not chunked
+struct download_transfer {
+	download_file *file;
+	size_t chunk;
+	curl_off_t start;
+	// one past the last byte, -1 until the end of the file
+	curl_off_t end;
+	curl_off_t written = 0;
+	int attempts = 0;
+	curl_off_t *downloaded;
+	CURL *curl = nullptr;
+	char error[CURL_ERROR_SIZE] = {};
+};
+
+// Open the .part file, kept to be resumed or truncated
+FILE *open_part_file(const std::filesystem::path &path, bool resume)
 {
-	size_t written = fwrite(ptr, size, nmemb, stream);
-	return written;
+#ifdef _WIN32
+	return _wfopen(path.wstring().c_str(), resume ? L"r+b" : L"w+b");
+#else
+	return fopen(path.string().c_str(), resume ? "r+b" : "w+b");
+#endif
+}
+
+bool seek_file(FILE *fp, curl_off_t offset)
+{
+#ifdef _WIN32
+	return _fseeki64(fp, offset, SEEK_SET) == 0;
+#else
+	return fseeko(fp, (off_t)offset, SEEK_SET) == 0;
+#endif
+}
+
+size_t probe_header(char *buffer, size_t size, size_t nitems, void *userdata)
+{
+	std::string header(buffer, size * nitems);
+	std::transform(header.begin(), header.end(), header.begin(),
+		       [](unsigned char c) { return (char)std::tolower(c); });
+	if (header.rfind("accept-ranges:", 0) == 0 && header.find("bytes") != std::string::npos) {
+		*static_cast<bool *>(userdata) = true;
+	}
+	return size * nitems;
+}
+
+// Get the size of the file and whether the server serves ranges of it
+void probe_file(download_file &file)
+{
+	CURL *curl = curl_easy_init();
+	if (curl == nullptr) {
+		return;
+	}
+	curl_easy_setopt(curl, CURLOPT_URL, file.url.c_str());
+	curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+	curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+	curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, probe_header);
+	curl_easy_setopt(curl, CURLOPT_HEADERDATA, &file.accepts_ranges);
+	if (curl_easy_perform(curl) == CURLE_OK) {
+		curl_off_t length = -1;
+		curl_easy_getinfo(curl, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T, &length);
+		file.size = length;
+	}
+	curl_easy_cleanup(curl);
+	if (file.size <= 0) {
+		file.size = -1;
+		file.accepts_ranges = false;
+	}
+}
+
+// Read the completed chunks of a previous session, if they are for the same file and chunks
+void load_chunks(download_file &file, size_t num_chunks)
+{
+	file.chunk_done.assign(num_chunks, false);
+	std::ifstream chunks(file.chunks_path);
+	curl_off_t size = 0;
+	curl_off_t chunk_size = 0;
+	if (!(chunks >> size >> chunk_size) || size != file.size ||
+	    chunk_size != DOWNLOAD_CHUNK_SIZE || !std::filesystem::exists(file.part_path)) {
+		return;
+	}
+	size_t chunk;
+	while (chunks >> chunk) {
+		if (chunk < num_chunks) {
+			file.chunk_done[chunk] = true;
+		}
+	}
+}
+
+void save_chunk_done(download_file &file, size_t chunk)
+{
+	file.chunk_done[chunk] = true;
+	const bool exists = std::filesystem::exists(file.chunks_path);
+	std::ofstream chunks(file.chunks_path, std::ios::app);
+	if (!exists) {
+		chunks << file.size << " " << DOWNLOAD_CHUNK_SIZE << "\n";
+	}
+	chunks << chunk << "\n";
 }
 
-ModelDownloader::ModelDownloader(const ModelInfo &model_info,
+size_t write_transfer(char *data, size_t size, size_t nmemb, void *userdata)
+{
+	download_transfer *transfer = static_cast<download_transfer *>(userdata);
+	const size_t length = size * nmemb;
+	if (transfer->written == 0 && (transfer->start > 0 || transfer->end >= 0)) {
+		long response_code = 0;
+		curl_easy_getinfo(transfer->curl, CURLINFO_RESPONSE_CODE, &response_code);
+		if (response_code != 206) {
+			// the range was ignored, the whole file is sent
+			if (transfer->end >= 0) {
+				return 0;
+			}
+			*transfer->downloaded -= transfer->start;
+			transfer->start = 0;
+		}
+	}
+	download_file &file = *transfer->file;
+	const curl_off_t offset = transfer->start + transfer->written;
+	if (!seek_file(file.fp, offset) || fwrite(data, 1, length, file.fp) != length) {
+		return 0;
+	}
+	if (offset < file.hashed) {
+		// the file is written again from the beginning
+		file.hash.reset();
+		file.hashed = 0;
+	}
+	if (offset == file.hashed) {
+		file.hash.add(data, length);
+		file.hashed += (curl_off_t)length;
+	}
+	transfer->written += (curl_off_t)length;
+	*transfer->downloaded += (curl_off_t)length;
+	return length;
+}
+
+// Hash the bytes of the .part file up to `end` that were not hashed as they arrived: the chunks
+// completed out of order and the data of a previous session
+bool hash_part_file(download_file &file, curl_off_t end)
+{
+	if (file.hashed >= end) {
+		return true;
+	}
+	std::vector<char> buffer(1 << 20);
+	if (!seek_file(file.fp, file.hashed)) {
+		return false;
+	}
+	while (file.hashed < end) {
+		const size_t length =
+			(size_t)std::min((curl_off_t)buffer.size(), end - file.hashed);
+		if (fread(buffer.data(), 1, length, file.fp) != length) {
+			return false;
+		}
+		file.hash.add(buffer.data(), length);
+		file.hashed += (curl_off_t)length;
+	}
+	return true;
+}
+
+// Hash the completed chunks following the hashed bytes
+bool hash_completed_chunks(download_file &file)
+{
+	size_t chunk = (size_t)(file.hashed / DOWNLOAD_CHUNK_SIZE);
+	curl_off_t end = file.hashed;
+	while (chunk < file.chunk_done.size() && file.chunk_done[chunk]) {
+		end = std::min((curl_off_t)(chunk + 1) * DOWNLOAD_CHUNK_SIZE, file.size);
+		chunk++;
+	}
+	return hash_part_file(file, end);
+}
+
+void start_transfer(CURLM *multi, download_transfer &transfer)
+{
+	if (transfer.curl == nullptr) {
+		transfer.curl = curl_easy_init();
+	} else {
+		curl_easy_reset(transfer.curl);
+	}
+	CURL *curl = transfer.curl;
+	curl_easy_setopt(curl, CURLOPT_URL, transfer.file->url.c_str());
+	curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_transfer);
+	curl_easy_setopt(curl, CURLOPT_WRITEDATA, &transfer);
+	curl_easy_setopt(curl, CURLOPT_PRIVATE, &transfer);
+	curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, transfer.error);
+	curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+	curl_easy_setopt(curl, CURLOPT_FAILONERROR, 1L);
+	curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+	curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, STALLED_TRANSFER_SECONDS);
+	// resumed after the bytes written by the previous attempts
+	const curl_off_t from = transfer.start + transfer.written;
+	if (transfer.end >= 0) {
+		const std::string range =
+			std::to_string(from) + "-" + std::to_string(transfer.end - 1);
+		curl_easy_setopt(curl, CURLOPT_RANGE, range.c_str());
+	} else if (from > 0) {
+		curl_easy_setopt(curl, CURLOPT_RESUME_FROM_LARGE, from);
+	}
+	// the data of the new attempt is written after what is kept
+	transfer.start = from;
+	transfer.written = 0;
+	curl_multi_add_handle(multi, curl);
+}
+
+} // namespace
+
+ModelDownloader::ModelDownloader(const ModelInfo &model_info, int quantization,
 				 download_finished_callback_t download_finished_callback_,
 				 QWidget *parent)
 	: QDialog(parent),
@@ -46,13 +280,15 @@ ModelDownloader::ModelDownloader(const ModelInfo &model_info,
 	this->layout->addWidget(this->progress_bar);
 
 	this->download_thread = new QThread();
-	this->download_worker = new ModelDownloadWorker(model_info);
+	this->download_worker = new ModelDownloadWorker(model_info, quantization);
 	this->download_worker->moveToThread(this->download_thread);
 
 	connect(this->download_thread, &QThread::started, this->download_worker,
 		&ModelDownloadWorker::download_model);
 	connect(this->download_worker, &ModelDownloadWorker::download_progress, this,
 		&ModelDownloader::update_progress);
+	connect(this->download_worker, &ModelDownloadWorker::quantization_started, this,
+		&ModelDownloader::start_quantization);
 	connect(this->download_worker, &ModelDownloadWorker::download_finished, this,
 		&ModelDownloader::download_finished);
 	connect(this->download_worker, &ModelDownloadWorker::download_finished,
@@ -89,6 +325,13 @@ void ModelDownloader::update_progress(int progress)
 	this->progress_bar->setValue(progress);
 }
 
+void ModelDownloader::start_quantization()
+{
+	this->setWindowTitle("LocalVocal: Quantizing model...");
+	this->progress_bar->setValue(0);
+	this->progress_bar->setFormat("Quantizing %p%");
+}
+
 void ModelDownloader::download_finished(const std::string &path)
 {
 	// Call the callback with the path to the downloaded model
@@ -117,7 +360,11 @@ void ModelDownloader::show_error(const std::string &reason)
 	this->download_finished_callback(1, "");
 }
 
-ModelDownloadWorker::ModelDownloadWorker(const ModelInfo &model_info_) : model_info(model_info_) {}
+ModelDownloadWorker::ModelDownloadWorker(const ModelInfo &model_info_, int quantization_)
+	: model_info(model_info_),
+	  quantization(quantization_)
+{
+}
 
 std::string get_filename_from_url(const std::string &url)
 {
@@ -177,93 +424,298 @@ void ModelDownloadWorker::download_model()
 		}
 	}
 
-	CURL *curl = curl_easy_init();
-	if (curl) {
-		for (auto &model_download_file : this->model_info.files) {
-			obs_log(LOG_INFO, "Model URL: %s", model_download_file.url.c_str());
-
-			const std::string model_filename =
-				get_filename_from_url(model_download_file.url);
-			const std::string model_file_save_path =
-				(std::filesystem::path(model_local_config_path) / model_filename)
-					.string();
-			if (std::filesystem::exists(model_file_save_path)) {
-				obs_log(LOG_INFO, "Model file already exists: %s",
-					model_file_save_path.c_str());
-				continue;
-			}
+	// the files to download, with the ranges to transfer
+	std::list<download_file> files;
+	std::deque<std::unique_ptr<download_transfer>> transfers;
+	curl_off_t downloaded = 0;
+	curl_off_t total_size = 0;
+	for (auto &model_download_file : this->model_info.files) {
+		obs_log(LOG_INFO, "Model URL: %s", model_download_file.url.c_str());
+
+		const std::string model_filename = get_filename_from_url(model_download_file.url);
+		const std::filesystem::path model_file_save_path =
+			std::filesystem::path(model_local_config_path) / model_filename;
+		if (std::filesystem::exists(model_file_save_path)) {
+			obs_log(LOG_INFO, "Model file already exists: %s",
+				model_file_save_path.string().c_str());
+			continue;
+		}
 
-			FILE *fp = fopen(model_file_save_path.c_str(), "wb");
-			if (fp == nullptr) {
-				obs_log(LOG_ERROR, "Failed to open model file for writing %s.",
-					model_file_save_path.c_str());
-				emit download_error("Failed to open file.");
-				return;
+		files.emplace_back();
+		download_file &file = files.back();
+		file.url = model_download_file.url;
+		file.sha256 = model_download_file.sha256;
+		file.path = model_file_save_path;
+		file.part_path = model_file_save_path.string() + ".part";
+		file.chunks_path = model_file_save_path.string() + ".part.chunks";
+		probe_file(file);
+
+		std::error_code ec;
+		const curl_off_t part_size =
+			std::filesystem::exists(file.part_path, ec)
+				? (curl_off_t)std::filesystem::file_size(file.part_path, ec)
+				: 0;
+		const bool chunked = file.accepts_ranges && file.size > DOWNLOAD_CHUNK_SIZE;
+		if (chunked) {
+			const size_t num_chunks = (size_t)((file.size + DOWNLOAD_CHUNK_SIZE - 1) /
+							   DOWNLOAD_CHUNK_SIZE);
+			load_chunks(file, num_chunks);
+			for (size_t i = 0; i < num_chunks; i++) {
+				const curl_off_t start = (curl_off_t)i * DOWNLOAD_CHUNK_SIZE;
+				const curl_off_t end =
+					std::min(start + DOWNLOAD_CHUNK_SIZE, file.size);
+				if (file.chunk_done[i]) {
+					downloaded += end - start;
+					continue;
+				}
+				transfers.push_back(std::make_unique<download_transfer>(
+					download_transfer{&file, i, start, end}));
 			}
-			curl_easy_setopt(curl, CURLOPT_URL, model_download_file.url.c_str());
-			curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_data);
-			curl_easy_setopt(curl, CURLOPT_WRITEDATA, fp);
-			curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
-			curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION,
-					 ModelDownloadWorker::progress_callback);
-			curl_easy_setopt(curl, CURLOPT_XFERINFODATA, this);
-			// Follow redirects
-			curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
-			CURLcode res = curl_easy_perform(curl);
-			if (res != CURLE_OK) {
-				obs_log(LOG_ERROR, "Failed to download model file %s.",
-					model_filename.c_str());
-				emit download_error("Failed to download model file.");
+		} else {
+			// resume a single transfer from the end of the .part file
+			const curl_off_t start = file.accepts_ranges ? part_size : 0;
+			downloaded += start;
+			transfers.push_back(std::make_unique<download_transfer>(
+				download_transfer{&file, 0, start, -1}));
+		}
+		if (file.size > 0) {
+			total_size += file.size;
+		}
+		const bool resumed = chunked ? std::find(file.chunk_done.begin(),
+							 file.chunk_done.end(),
+							 true) != file.chunk_done.end()
+					     : file.accepts_ranges && part_size > 0;
+		if (resumed) {
+			obs_log(LOG_INFO, "Resuming the download of %s", model_filename.c_str());
+		} else {
+			std::filesystem::remove(file.chunks_path, ec);
+		}
+		file.fp = open_part_file(file.part_path, resumed);
+		if (file.fp == nullptr) {
+			obs_log(LOG_ERROR, "Failed to open model file for writing %s.",
+				file.part_path.string().c_str());
+			for (auto &opened : files) {
+				if (opened.fp != nullptr) {
+					fclose(opened.fp);
+				}
 			}
-			fclose(fp);
-
-			if (!valid_hash(model_file_save_path, model_download_file.sha256)) {
-				emit download_error("Downloaded model has invalid hash");
+			emit download_error("Failed to open file.");
+			return;
+		}
+		if (resumed) {
+			// the data of the previous session is hashed before it is followed
+			if (chunked) {
+				hash_completed_chunks(file);
+			} else {
+				hash_part_file(file, part_size);
 			}
 		}
-		curl_easy_cleanup(curl);
-		emit download_finished(model_local_config_path);
-	} else {
+	}
+	for (auto &transfer : transfers) {
+		transfer->downloaded = &downloaded;
+	}
+
+	CURLM *multi = curl_multi_init();
+	if (multi == nullptr) {
 		obs_log(LOG_ERROR, "Failed to initialize curl.");
+		for (auto &file : files) {
+			fclose(file.fp);
+		}
 		emit download_error("Failed to initialize curl.");
+		return;
 	}
+	// the transfers are run MAX_PARALLEL_TRANSFERS at a time, in the order of the files
+	std::deque<download_transfer *> pending;
+	for (auto &transfer : transfers) {
+		pending.push_back(transfer.get());
+	}
+	int active = 0;
+	int last_progress = -1;
+	std::string error;
+	while (error.empty() && (active > 0 || !pending.empty())) {
+		while (active < MAX_PARALLEL_TRANSFERS && !pending.empty()) {
+			start_transfer(multi, *pending.front());
+			pending.pop_front();
+			active++;
+		}
+		int running = 0;
+		curl_multi_perform(multi, &running);
+		int queued = 0;
+		while (CURLMsg *msg = curl_multi_info_read(multi, &queued)) {
+			if (msg->msg != CURLMSG_DONE) {
+				continue;
+			}
+			download_transfer *transfer = nullptr;
+			curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&transfer);
+			const CURLcode result = msg->data.result;
+			curl_multi_remove_handle(multi, msg->easy_handle);
+			active--;
+			download_file &file = *transfer->file;
+			if (result == CURLE_OK) {
+				if (transfer->end >= 0) {
+					save_chunk_done(file, transfer->chunk);
+					hash_completed_chunks(file);
+				}
+				continue;
+			}
+			obs_log(LOG_WARNING, "Transfer of %s (chunk %zu) failed: %s",
+				file.path.filename().string().c_str(), transfer->chunk,
+				transfer->error[0] != '\0' ? transfer->error
+							   : curl_easy_strerror(result));
+			if (++transfer->attempts >= MAX_TRANSFER_ATTEMPTS) {
+				obs_log(LOG_ERROR, "Failed to download model file %s.",
+					file.path.filename().string().c_str());
+				error = "Failed to download model file.";
+				break;
+			}
+			if (!file.accepts_ranges) {
+				// restarted from the beginning
+				downloaded -= transfer->start + transfer->written;
+				transfer->start = 0;
+				transfer->written = 0;
+				file.hash.reset();
+				file.hashed = 0;
+			}
+			pending.push_back(transfer);
+		}
+		if (total_size > 0) {
+			const int progress =
+				(int)(std::min(downloaded, total_size) * 100 / total_size);
+			if (progress != last_progress) {
+				last_progress = progress;
+				emit download_progress(progress);
+			}
+		}
+		if (error.empty() && active > 0) {
+			curl_multi_wait(multi, nullptr, 0, 1000, nullptr);
+		}
+	}
+	for (auto &transfer : transfers) {
+		if (transfer->curl != nullptr) {
+			curl_multi_remove_handle(multi, transfer->curl);
+			curl_easy_cleanup(transfer->curl);
+		}
+	}
+	curl_multi_cleanup(multi);
+	for (auto &file : files) {
+		if (error.empty()) {
+			// hashed as it was downloaded, except the chunks that are not hashed yet
+			std::error_code ec;
+			fflush(file.fp);
+			const curl_off_t size =
+				(curl_off_t)std::filesystem::file_size(file.part_path, ec);
+			if (ec || !hash_part_file(file, size)) {
+				obs_log(LOG_ERROR, "Failed to read model file %s.",
+					file.part_path.string().c_str());
+				error = "Failed to read model file.";
+			}
+		}
+		fclose(file.fp);
+	}
+	if (!error.empty()) {
+		// the .part files are kept, the next download resumes them
+		emit download_error(error);
+		return;
+	}
+
+	for (auto &file : files) {
+		const std::string calculated_hash = file.hash.getHash();
+		if (!check_hash(calculated_hash, file.sha256)) {
+			std::error_code ec;
+			std::filesystem::remove(file.part_path, ec);
+			std::filesystem::remove(file.chunks_path, ec);
+			emit download_error("Downloaded model has invalid hash");
+			return;
+		}
+		std::error_code ec;
+		std::filesystem::rename(file.part_path, file.path, ec);
+		if (ec) {
+			obs_log(LOG_ERROR, "Failed to rename %s: %s",
+				file.part_path.string().c_str(), ec.message().c_str());
+			emit download_error("Failed to save model file.");
+			return;
+		}
+		std::filesystem::remove(file.chunks_path, ec);
+		// the hash of the verified file is not computed again
+		model_index_set_sha256(file.path.string(), calculated_hash);
+	}
+	if (quantization != MODEL_QUANTIZATION_NONE &&
+	    model_info.type == MODEL_TYPE_TRANSCRIPTION) {
+		emit download_finished(
+			quantize_model(module_config_models_folder, model_local_config_path));
+		return;
+	}
+	emit download_finished(model_local_config_path);
 }
 
-int ModelDownloadWorker::progress_callback(void *clientp, curl_off_t dltotal, curl_off_t dlnow,
-					   curl_off_t, curl_off_t)
+// Quantize the downloaded whisper model and register the result as a local model. Returns the
+// folder of the quantized model, or the one of the downloaded model if it is not quantized.
+std::string ModelDownloadWorker::quantize_model(const std::filesystem::path &models_folder,
+						const std::string &model_folder)
 {
-	if (dltotal == 0) {
-		return 0; // Unknown progress
+	// the model may be the one in the data folder of the plugin
+	const std::string model_file = find_model_bin_file(model_info);
+	if (model_file.empty() || !model_file_can_be_quantized(model_file, quantization)) {
+		obs_log(LOG_INFO, "Model %s is not quantized to %s, it is not an f16 model",
+			model_info.friendly_name.c_str(),
+			model_quantization_suffix(quantization).c_str());
+		return model_folder;
+	}
+	ModelInfo quantized = quantized_model_info(model_info, quantization);
+	const std::filesystem::path quantized_folder = models_folder / quantized.local_folder_name;
+	const std::filesystem::path quantized_file =
+		quantized_folder / get_filename_from_url(quantized.files[0].url);
+	std::error_code ec;
+	std::filesystem::create_directories(quantized_folder, ec);
+
+	emit quantization_started();
+	obs_log(LOG_INFO, "Quantizing %s to %s", model_file.c_str(),
+		quantized_file.string().c_str());
+	const auto start = std::chrono::steady_clock::now();
+	const auto progress = [this](int percent) { emit download_progress(percent); };
+	if (!quantize_whisper_model_file(model_file, quantized_file.string(), quantization,
+					 progress)) {
+		// the f16 model is used instead
+		std::filesystem::remove_all(quantized_folder, ec);
+		return model_folder;
 	}
-	ModelDownloadWorker *worker = (ModelDownloadWorker *)clientp;
-	if (worker == nullptr) {
-		obs_log(LOG_ERROR, "Worker is null.");
-		return 1;
+	const double seconds =
+		std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	const double original_mb =
+		(double)std::filesystem::file_size(std::filesystem::u8path(model_file), ec) / 1e6;
+	const double quantized_mb = (double)std::filesystem::file_size(quantized_file, ec) / 1e6;
+	char description[256];
+	snprintf(description, sizeof(description),
+		 "%s quantized on this machine: %.0f MB instead of %.0f MB, in %.1f s (%.0f MB/s)",
+		 model_info.friendly_name.c_str(), quantized_mb, original_mb, seconds,
+		 seconds > 0 ? original_mb / seconds : 0.0);
+	obs_log(LOG_INFO, "%s", description);
+	quantized.extra.description = description;
+	register_local_model(quantized);
+	return quantized_folder.string();
+}
+
+bool ModelDownloadWorker::check_hash(const std::string &calculated_hash, const std::string &hash)
+{
+	if (hash == "") {
+		obs_log(LOG_WARNING, "No hash for model in config. Calculated hash: %s",
+			calculated_hash.c_str());
+		return true;
+	} else if (hash == calculated_hash) {
+		obs_log(LOG_INFO, "Model hash is valid");
+		return true;
+	} else {
+		obs_log(LOG_ERROR, "Model hash mismatch. Model hash: %s, calculated hash: %s",
+			hash.c_str(), calculated_hash.c_str());
+		return false;
 	}
-	int progress = (int)(dlnow * 100l / dltotal);
-	emit worker->download_progress(progress);
-	return 0;
 }
 
 bool ModelDownloadWorker::valid_hash(std::string path, std::string hash)
 {
 	obs_log(LOG_INFO, "Calculating hash for model %s", path.c_str());
 	try {
-		auto calculated_hash = sha256_sum(path.c_str());
-
-		if (hash == "") {
-			obs_log(LOG_WARNING, "No hash for model in config. Calculated hash: %s",
-				calculated_hash.c_str());
-			return true;
-		} else if (hash == calculated_hash) {
-			obs_log(LOG_INFO, "Model hash is valid");
-			return true;
-		} else {
-			obs_log(LOG_ERROR,
-				"Model hash mismatch. Model hash: %s, calculated hash: %s",
-				hash.c_str(), calculated_hash.c_str());
-			return false;
-		}
+		return check_hash(sha256_sum(path.c_str()), hash);
 	} catch (const std::exception &e) {
 		obs_log(LOG_ERROR, "Error calculating hash for model - ", e.what());
 		return false;
@@ -280,14 +732,14 @@ std::string ModelDownloadWorker::sha256_sum(const char *const path)
 		throw std::runtime_error(os.str());
 	}
 
-	constexpr const std::size_t buffer_size{1 << 12};
-	char buffer[buffer_size];
+	constexpr const std::size_t buffer_size{1 << 20};
+	std::vector<char> buffer(buffer_size);
 
 	SHA256 ctx;
 
 	while (fp.good()) {
-		fp.read(buffer, buffer_size);
-		ctx.add(buffer, fp.gcount());
+		fp.read(buffer.data(), buffer_size);
+		ctx.add(buffer.data(), fp.gcount());
 	}
 
 	auto hash = ctx.getHash();
@@ -4,6 +4,7 @@
 #include <QtWidgets>
 #include <QThread>
 
+#include <filesystem>
 #include <string>
 #include <functional>
 
@@ -14,7 +15,7 @@
 class ModelDownloadWorker : public QObject {
 	Q_OBJECT
 public:
-	ModelDownloadWorker(const ModelInfo &model_info_);
+	ModelDownloadWorker(const ModelInfo &model_info_, int quantization_);
 	~ModelDownloadWorker();
 
 public slots:
@@ -22,27 +23,32 @@ public slots:
 
 signals:
 	void download_progress(int progress);
+	void quantization_started();
 	void download_finished(const std::string &path);
 	void download_error(const std::string &reason);
 
 private:
-	static int progress_callback(void *clientp, curl_off_t dltotal, curl_off_t dlnow,
-				     curl_off_t ultotal, curl_off_t ulnow);
+	bool check_hash(const std::string &calculated_hash, const std::string &hash);
 	bool valid_hash(std::string path, std::string hash);
 	std::string sha256_sum(const char *const path);
+	std::string quantize_model(const std::filesystem::path &models_folder,
+				   const std::string &model_folder);
 	ModelInfo model_info;
+	// ModelQuantization applied to the downloaded model
+	int quantization;
 };
 
 class ModelDownloader : public QDialog {
 	Q_OBJECT
 public:
-	ModelDownloader(const ModelInfo &model_info,
+	ModelDownloader(const ModelInfo &model_info, int quantization,
 			download_finished_callback_t download_finished_callback,
 			QWidget *parent = nullptr);
 	~ModelDownloader();
 
 public slots:
 	void update_progress(int progress);
+	void start_quantization();
 	void download_finished(const std::string &path);
 	void show_error(const std::string &reason);
 
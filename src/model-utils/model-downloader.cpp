@@ -2,6 +2,7 @@
 #include "plugin-support.h"
 #include "model-downloader-ui.h"
 #include "model-find-utils.h"
+#include "model-index.h"
 
 #include <obs-module.h>
 #include <obs-frontend-api.h>
@@ -32,6 +33,15 @@ std::filesystem::path obs_config_stdfs_path(char *config_folder)
 	return config_folder_path;
 }
 
+void init_model_index(void)
+{
+	char *config_file = obs_module_config_path("models/model-index.json");
+	if (config_file == nullptr) {
+		return;
+	}
+	model_index_load(obs_config_stdfs_path(config_file));
+}
+
 std::optional<std::filesystem::path> model_path(const ModelInfo &model_info,
 						std::filesystem::path models_folder)
 {
@@ -104,11 +114,13 @@ std::string find_model_bin_file(const ModelInfo &model_info)
 }
 
 void download_model_with_ui_dialog(const ModelInfo &model_info,
-				   download_finished_callback_t download_finished_callback)
+				   download_finished_callback_t download_finished_callback,
+				   int quantization)
 {
 	// Start the model downloader UI
-	ModelDownloader *model_downloader = new ModelDownloader(
-		model_info, download_finished_callback, (QWidget *)obs_frontend_get_main_window());
+	ModelDownloader *model_downloader =
+		new ModelDownloader(model_info, quantization, download_finished_callback,
+				    (QWidget *)obs_frontend_get_main_window());
 	model_downloader->show();
 }
 
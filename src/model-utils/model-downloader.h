@@ -9,14 +9,24 @@
 
 #include "model-downloader-types.h"
 
+// Convert a path from obs_module_config_path (and free it)
+std::filesystem::path obs_config_stdfs_path(char *config_folder);
+// File name of a model file, as it is saved by the downloader
+std::string get_filename_from_url(const std::string &url);
+// Load the persisted index of the model folders, called on module load
+extern "C" void init_model_index(void);
+
 std::optional<std::filesystem::path> find_model_folder(const ModelInfo &model_info);
 std::string find_model_bin_file(const ModelInfo &model_info);
 void download_coreml_encoder_model_if_available(
 	const ModelInfo &model_info,
 	coreml_model_download_finished_callback_t download_finished_callback);
 
-// Start the model downloader UI dialog with a callback for when the download is finished
+// Start the model downloader UI dialog with a callback for when the download is finished. With a
+// ModelQuantization, the downloaded f16 whisper model is quantized and the callback gets the
+// folder of the quantized model.
 void download_model_with_ui_dialog(const ModelInfo &model_info,
-				   download_finished_callback_t download_finished_callback);
+				   download_finished_callback_t download_finished_callback,
+				   int quantization = 0);
 
 #endif // MODEL_DOWNLOADER_H
@@ -0,0 +1,343 @@
+#include "model-index.h"
+#include "plugin-support.h"
+
+#include <obs-module.h>
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <regex>
+#include <system_error>
+#include <vector>
+
+namespace {
+
+const uint32_t GGML_MAGIC = 0x67676d6c;
+// the type of the weights is ftype % GGML_QNT_VERSION_FACTOR
+const int32_t GGML_QNT_VERSION_FACTOR = 1000;
+// a folder modified that recently may change again within the resolution of its time
+const auto FOLDER_SETTLE_TIME = std::chrono::seconds(2);
+
+struct indexed_file {
+	std::string name;
+	bool directory = false;
+	uint64_t size = 0;
+	int64_t mtime = 0;
+	std::string sha256;
+	// "ggml", "coreml", "ct2", "spm" or "other"
+	std::string type;
+	// "f16", "q5_1", ... for the ggml models
+	std::string quantization;
+};
+
+struct indexed_folder {
+	// 0 if the folder is scanned again on the next lookup
+	int64_t mtime = 0;
+	// sorted by name
+	std::vector<indexed_file> files;
+};
+
+// guards the index
+std::mutex index_mutex;
+std::map<std::string, indexed_folder> folders;
+// empty if the index is not persisted
+std::filesystem::path index_file_path;
+
+int64_t file_time(const std::filesystem::file_time_type &time)
+{
+	return (int64_t)time.time_since_epoch().count();
+}
+
+std::string folder_key(const std::string &folder_path)
+{
+	std::filesystem::path path = std::filesystem::path(folder_path).lexically_normal();
+	if (!path.has_filename() && path.has_parent_path()) {
+		// "models/" and "models" are the same folder
+		path = path.parent_path();
+	}
+	return path.string();
+}
+
+const char *quantization_name(int32_t ftype)
+{
+	switch (ftype % GGML_QNT_VERSION_FACTOR) {
+	case 0:
+		return "f32";
+	case 1:
+		return "f16";
+	case 2:
+		return "q4_0";
+	case 3:
+		return "q4_1";
+	case 7:
+		return "q8_0";
+	case 8:
+		return "q5_0";
+	case 9:
+		return "q5_1";
+	case 10:
+		return "q2_k";
+	case 11:
+		return "q3_k";
+	case 12:
+		return "q4_k";
+	case 13:
+		return "q5_k";
+	case 14:
+		return "q6_k";
+	default:
+		return "";
+	}
+}
+
+void detect_type(const std::filesystem::path &path, indexed_file &file)
+{
+	const std::string extension = path.extension().string();
+	if (file.directory) {
+		file.type = extension == ".mlmodelc" ? "coreml" : "other";
+	} else if (extension == ".bin") {
+		whisper_model_header header;
+		if (read_whisper_model_header(path.u8string(), header)) {
+			file.type = "ggml";
+			file.quantization = quantization_name(header.ftype);
+		} else {
+			// the weights of a CTranslate2 model
+			file.type = file.name == "model.bin" ? "ct2" : "other";
+		}
+	} else if (extension == ".spm" || extension == ".model") {
+		file.type = "spm";
+	} else {
+		file.type = "other";
+	}
+}
+
+nlohmann::json index_to_json()
+{
+	nlohmann::json json_folders = nlohmann::json::object();
+	for (const auto &folder : folders) {
+		nlohmann::json json_files = nlohmann::json::array();
+		for (const auto &file : folder.second.files) {
+			json_files.push_back({{"name", file.name},
+					      {"directory", file.directory},
+					      {"size", file.size},
+					      {"mtime", file.mtime},
+					      {"sha256", file.sha256},
+					      {"type", file.type},
+					      {"quantization", file.quantization}});
+		}
+		json_folders[folder.first] = {{"mtime", folder.second.mtime},
+					      {"files", json_files}};
+	}
+	return {{"version", 1}, {"folders", json_folders}};
+}
+
+// index_mutex must be held
+void save_index()
+{
+	if (index_file_path.empty()) {
+		return;
+	}
+	std::error_code ec;
+	std::filesystem::create_directories(index_file_path.parent_path(), ec);
+	const std::filesystem::path temporary_path = index_file_path.string() + ".tmp";
+	{
+		std::ofstream file(temporary_path);
+		if (!file.is_open() || !(file << index_to_json().dump())) {
+			obs_log(LOG_WARNING, "Cannot write the model index");
+			return;
+		}
+	}
+	std::filesystem::rename(temporary_path, index_file_path, ec);
+	if (ec) {
+		obs_log(LOG_WARNING, "Cannot write the model index: %s", ec.message().c_str());
+	}
+}
+
+// Scan the folder, keeping the entries of the files that did not change
+void scan_folder(const std::filesystem::path &path, int64_t mtime,
+		 const std::filesystem::file_time_type &folder_time, indexed_folder &folder)
+{
+	std::map<std::string, indexed_file> previous;
+	for (auto &file : folder.files) {
+		previous[file.name] = std::move(file);
+	}
+	folder.files.clear();
+	std::error_code ec;
+	for (const auto &entry : std::filesystem::directory_iterator(path, ec)) {
+		indexed_file file;
+		file.name = entry.path().filename().string();
+		file.directory = entry.is_directory(ec);
+		file.size = file.directory ? 0 : (uint64_t)entry.file_size(ec);
+		file.mtime = file_time(entry.last_write_time(ec));
+		auto it = previous.find(file.name);
+		if (it != previous.end() && it->second.directory == file.directory &&
+		    it->second.size == file.size && it->second.mtime == file.mtime) {
+			folder.files.push_back(std::move(it->second));
+			continue;
+		}
+		detect_type(entry.path(), file);
+		folder.files.push_back(std::move(file));
+	}
+	std::sort(folder.files.begin(), folder.files.end(),
+		  [](const indexed_file &a, const indexed_file &b) { return a.name < b.name; });
+	const bool settled = std::filesystem::file_time_type::clock::now() - folder_time >=
+			     FOLDER_SETTLE_TIME;
+	folder.mtime = settled ? mtime : 0;
+}
+
+// The up to date entry of the folder, nullptr if it does not exist. index_mutex must be held.
+indexed_folder *get_folder(const std::string &folder_path)
+{
+	const std::string key = folder_key(folder_path);
+	std::error_code ec;
+	const std::filesystem::path path(key);
+	const auto folder_time = std::filesystem::last_write_time(path, ec);
+	if (ec || !std::filesystem::is_directory(path, ec)) {
+		if (folders.erase(key) > 0) {
+			save_index();
+		}
+		return nullptr;
+	}
+	const int64_t mtime = file_time(folder_time);
+	indexed_folder &folder = folders[key];
+	if (folder.mtime == 0 || folder.mtime != mtime) {
+		scan_folder(path, mtime, folder_time, folder);
+		save_index();
+	}
+	return &folder;
+}
+
+// The entry of the file if it did not change, nullptr else. index_mutex must be held.
+indexed_file *get_file(const std::string &file_path)
+{
+	const std::filesystem::path path(file_path);
+	indexed_folder *folder = get_folder(path.parent_path().string());
+	if (folder == nullptr) {
+		return nullptr;
+	}
+	const std::string name = path.filename().string();
+	for (auto &file : folder->files) {
+		if (file.name != name) {
+			continue;
+		}
+		// a file rewritten in place does not change the time of its folder
+		std::error_code ec;
+		const uint64_t size = (uint64_t)std::filesystem::file_size(path, ec);
+		const int64_t mtime = file_time(std::filesystem::last_write_time(path, ec));
+		if (ec || size != file.size || mtime != file.mtime) {
+			folder->mtime = 0;
+			return nullptr;
+		}
+		return &file;
+	}
+	return nullptr;
+}
+
+template<typename Match> std::string find_file(const std::string &folder_path, Match match)
+{
+	std::lock_guard<std::mutex> lock(index_mutex);
+	const indexed_folder *folder = get_folder(folder_path);
+	if (folder == nullptr) {
+		return "";
+	}
+	for (const auto &file : folder->files) {
+		if (match(file)) {
+			return (std::filesystem::path(folder_path) / file.name).string();
+		}
+	}
+	return "";
+}
+
+} // namespace
+
+bool read_whisper_model_header(const std::string &path, whisper_model_header &header)
+{
+#ifdef _WIN32
+	std::ifstream file(std::filesystem::u8path(path), std::ios::binary);
+#else
+	std::ifstream file(path, std::ios::binary);
+#endif
+	uint32_t magic = 0;
+	return file.read((char *)&magic, sizeof(magic)) && magic == GGML_MAGIC &&
+	       file.read((char *)&header, sizeof(header));
+}
+
+void model_index_load(const std::filesystem::path &index_file)
+{
+	std::lock_guard<std::mutex> lock(index_mutex);
+	index_file_path = index_file;
+	std::ifstream file(index_file);
+	if (!file.is_open()) {
+		return;
+	}
+	try {
+		const nlohmann::json json = nlohmann::json::parse(file);
+		if (json.value("version", 0) != 1) {
+			return;
+		}
+		for (const auto &json_folder : json.at("folders").items()) {
+			indexed_folder folder;
+			folder.mtime = json_folder.value().at("mtime").get<int64_t>();
+			for (const auto &json_file : json_folder.value().at("files")) {
+				indexed_file entry;
+				entry.name = json_file.at("name").get<std::string>();
+				entry.directory = json_file.at("directory").get<bool>();
+				entry.size = json_file.at("size").get<uint64_t>();
+				entry.mtime = json_file.at("mtime").get<int64_t>();
+				entry.sha256 = json_file.at("sha256").get<std::string>();
+				entry.type = json_file.at("type").get<std::string>();
+				entry.quantization =
+					json_file.at("quantization").get<std::string>();
+				folder.files.push_back(std::move(entry));
+			}
+			folders[json_folder.key()] = std::move(folder);
+		}
+		obs_log(LOG_INFO, "Loaded the model index: %d folders", (int)folders.size());
+	} catch (const std::exception &e) {
+		obs_log(LOG_WARNING, "Cannot read the model index: %s", e.what());
+		folders.clear();
+	}
+}
+
+std::string model_index_find_by_extension(const std::string &folder_path,
+					  const std::string &extension)
+{
+	return find_file(folder_path, [&extension](const indexed_file &file) {
+		return std::filesystem::path(file.name).extension() == extension;
+	});
+}
+
+std::string model_index_find_by_regex(const std::string &folder_path,
+				      const std::string &file_name_regex)
+{
+	const std::regex expression(file_name_regex);
+	return find_file(folder_path, [&expression](const indexed_file &file) {
+		return std::regex_match(file.name, expression);
+	});
+}
+
+std::string model_index_find_by_name(const std::string &folder_path, const std::string &file_name)
+{
+	return find_file(folder_path,
+			 [&file_name](const indexed_file &file) { return file.name == file_name; });
+}
+
+void model_index_set_sha256(const std::string &file_path, const std::string &sha256)
+{
+	std::lock_guard<std::mutex> lock(index_mutex);
+	indexed_file *file = get_file(file_path);
+	if (file != nullptr && file->sha256 != sha256) {
+		file->sha256 = sha256;
+		save_index();
+	}
+}
+
+std::string model_index_get_sha256(const std::string &file_path)
+{
+	std::lock_guard<std::mutex> lock(index_mutex);
+	const indexed_file *file = get_file(file_path);
+	return file != nullptr ? file->sha256 : "";
+}
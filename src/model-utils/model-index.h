@@ -0,0 +1,82 @@
+/**
+ * @file model-index.h
+ * @brief Index of the files of the installed model folders.
+ *
+ * The model files (whisper .bin, CoreML .mlmodelc, CTranslate2 models and their
+ * SentencePiece files) are resolved from the index instead of a directory scan. A folder is
+ * scanned the first time it is looked up, and again only when its modification time changed,
+ * i.e. when files were added, removed or renamed in it; the entries of the files that did not
+ * change are kept. Each entry records the size, modification time, detected type and
+ * quantization of the file, and its SHA-256 once it is known, e.g. verified by the downloader.
+ *
+ * The index is persisted with model_index_load() and saved when it changes. Without it, the
+ * index is kept in memory only.
+ */
+#ifndef MODEL_INDEX_H
+#define MODEL_INDEX_H
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+// Hyperparameters at the start of a ggml whisper model file, after the magic
+struct whisper_model_header {
+	int32_t n_vocab;
+	int32_t n_audio_ctx;
+	int32_t n_audio_state;
+	int32_t n_audio_head;
+	int32_t n_audio_layer;
+	int32_t n_text_ctx;
+	int32_t n_text_state;
+	int32_t n_text_head;
+	int32_t n_text_layer;
+	int32_t n_mels;
+	int32_t ftype;
+};
+
+/**
+ * @brief Read the header of a ggml whisper model file.
+ *
+ * @return false if the file is not a ggml model.
+ */
+bool read_whisper_model_header(const std::string &path, whisper_model_header &header);
+
+/**
+ * @brief Load the persisted index, which is then saved to that file when it changes.
+ */
+void model_index_load(const std::filesystem::path &index_file);
+
+/**
+ * @brief Path of the first file of the folder, by name, with the extension.
+ *
+ * @return The path, empty if there is none.
+ */
+std::string model_index_find_by_extension(const std::string &folder_path,
+					  const std::string &extension);
+
+/**
+ * @brief Path of the first file of the folder, by name, matching the regular expression.
+ *
+ * @return The path, empty if there is none.
+ */
+std::string model_index_find_by_regex(const std::string &folder_path,
+				      const std::string &file_name_regex);
+
+/**
+ * @brief Path of the file of the folder with that name.
+ *
+ * @return The path, empty if there is none.
+ */
+std::string model_index_find_by_name(const std::string &folder_path, const std::string &file_name);
+
+/**
+ * @brief Record the SHA-256 of the file, kept as long as the file does not change.
+ */
+void model_index_set_sha256(const std::string &file_path, const std::string &sha256);
+
+/**
+ * @brief The SHA-256 recorded for the file, empty if it is not known or the file changed.
+ */
+std::string model_index_get_sha256(const std::string &file_path);
+
+#endif // MODEL_INDEX_H
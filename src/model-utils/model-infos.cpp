@@ -1,64 +1,201 @@
+#include "model-downloader.h"
 #include "model-downloader-types.h"
 #include "plugin-support.h"
 
 #include <obs-module.h>
 
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <filesystem>
 #include <fstream>
+#include <list>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <optional>
 #include <sstream>
 #include <string>
+#include <system_error>
+#include <thread>
 
 #include <nlohmann/json.hpp>
 #include <curl/curl.h>
 
-static size_t WriteCallback(void *contents, size_t size, size_t nmemb, void *userp)
+namespace {
+
+const char *const MODELS_DIRECTORY_URL =
+	"https://raw.githubusercontent.com/locaal-ai/obs-localvocal/master/data/models/models_directory.json";
+
+typedef std::map<std::string, ModelInfo> models_info_map_t;
+
+// guards the versions and the revalidation thread
+std::mutex models_info_mutex;
+// every loaded directory is kept, so the references returned by models_info() stay valid
+std::list<std::unique_ptr<const models_info_map_t>> models_info_versions;
+std::atomic<const models_info_map_t *> current_models_info{nullptr};
+std::thread revalidation_thread;
+std::atomic<bool> revalidation_stop{false};
+
+// The validators of the cached directory, sent to revalidate it
+struct directory_validators {
+	std::string etag;
+	std::string last_modified;
+};
+
+size_t WriteCallback(void *contents, size_t size, size_t nmemb, void *userp)
 {
 	((std::string *)userp)->append((char *)contents, size * nmemb);
 	return size * nmemb;
 }
 
+size_t HeaderCallback(char *buffer, size_t size, size_t nitems, void *userp)
+{
+	directory_validators *validators = (directory_validators *)userp;
+	const std::string header(buffer, size * nitems);
+	const size_t colon = header.find(':');
+	if (colon != std::string::npos) {
+		std::string name = header.substr(0, colon);
+		std::transform(name.begin(), name.end(), name.begin(),
+			       [](unsigned char c) { return (char)std::tolower(c); });
+		const size_t value_start = header.find_first_not_of(" \t", colon + 1);
+		const size_t value_end = header.find_last_not_of(" \t\r\n");
+		std::string value;
+		if (value_start != std::string::npos && value_end >= value_start) {
+			value = header.substr(value_start, value_end - value_start + 1);
+		}
+		if (name == "etag") {
+			validators->etag = value;
+		} else if (name == "last-modified") {
+			validators->last_modified = value;
+		}
+	}
+	return size * nitems;
+}
+
+int AbortCallback(void *, curl_off_t, curl_off_t, curl_off_t, curl_off_t)
+{
+	// non-zero aborts the transfer on module unload
+	return revalidation_stop ? 1 : 0;
+}
+
+std::filesystem::path cached_directory_path()
+{
+	char *config_file = obs_module_config_path("models/models_directory.json");
+	if (config_file == nullptr) {
+		return {};
+	}
+	return obs_config_stdfs_path(config_file);
+}
+
+// The models made on the machine, see register_local_model
+std::filesystem::path local_models_path()
+{
+	char *config_file = obs_module_config_path("models/local_models.json");
+	if (config_file == nullptr) {
+		return {};
+	}
+	return obs_config_stdfs_path(config_file);
+}
+
+std::filesystem::path validators_path(const std::filesystem::path &directory_path)
+{
+	return directory_path.string() + ".meta";
+}
+
+bool read_file(const std::filesystem::path &path, std::string &content)
+{
+	std::ifstream file(path, std::ios::in | std::ios::binary);
+	if (path.empty() || !file.is_open()) {
+		return false;
+	}
+	std::ostringstream stream;
+	stream << file.rdbuf();
+	content = stream.str();
+	return true;
+}
+
+directory_validators read_validators(const std::filesystem::path &directory_path)
+{
+	directory_validators validators;
+	std::string content;
+	if (!read_file(validators_path(directory_path), content)) {
+		return validators;
+	}
+	try {
+		const nlohmann::json json = nlohmann::json::parse(content);
+		validators.etag = json.value("etag", "");
+		validators.last_modified = json.value("last_modified", "");
+	} catch (const std::exception &e) {
+		obs_log(LOG_WARNING, "Cannot read the models directory validators: %s", e.what());
+	}
+	return validators;
+}
+
+// Write the file to a temporary file renamed over it, so a reader never sees it partial
+bool write_file(const std::filesystem::path &path, const std::string &content)
+{
+	const std::filesystem::path temporary_path = path.string() + ".tmp";
+	{
+		std::ofstream file(temporary_path, std::ios::out | std::ios::binary);
+		if (!file.is_open() || !(file << content) || !file.flush()) {
+			return false;
+		}
+	}
+	std::error_code ec;
+	std::filesystem::rename(temporary_path, path, ec);
+	return !ec;
+}
+
 /**
- * @brief Downloads a JSON file from a specified GitHub URL.
+ * @brief Downloads the models directory JSON file from GitHub, if it changed.
  *
- * This function uses libcurl to download a JSON file from a GitHub repository.
- * The downloaded content is stored in the provided string reference.
+ * This function uses libcurl to download the JSON file from the GitHub repository. The
+ * validators of the cached copy are sent with If-None-Match / If-Modified-Since, and are
+ * replaced by the ones of the response.
  *
  * @param json_content A reference to a string where the downloaded JSON content will be stored.
- * @return true if the download was successful and the HTTP response code was 200, false otherwise.
- *
- * The function performs the following steps:
- * - Initializes a CURL session.
- * - Sets the URL to download the JSON from.
- * - Sets the callback function to write the downloaded data.
- * - Follows redirects and sets a timeout of 10 seconds.
- * - Performs the download operation.
- * - Checks for errors and logs them using obs_log.
- * - Cleans up the CURL session.
- * - Checks the HTTP response code to ensure it is 200 (OK).
+ * @param validators The validators of the cached copy, updated from the response.
+ * @param not_modified Set to true if the cached copy is up to date (HTTP 304).
+ * @return true if the HTTP response code was 200 or 304, false otherwise.
  */
-bool download_json_from_github(std::string &json_content)
+bool download_json_from_github(std::string &json_content, directory_validators &validators,
+			       bool &not_modified)
 {
 	CURL *curl;
 	CURLcode res;
 	std::string readBuffer;
 	long http_code = 0;
+	directory_validators response_validators;
+	struct curl_slist *headers = nullptr;
 
+	not_modified = false;
 	curl = curl_easy_init();
 	if (curl) {
-		curl_easy_setopt(
-			curl, CURLOPT_URL,
-			"https://raw.githubusercontent.com/locaal-ai/obs-localvocal/master/data/models/models_directory.json");
+		if (!validators.etag.empty()) {
+			headers = curl_slist_append(headers,
+						    ("If-None-Match: " + validators.etag).c_str());
+		}
+		if (!validators.last_modified.empty()) {
+			const std::string header = "If-Modified-Since: " + validators.last_modified;
+			headers = curl_slist_append(headers, header.c_str());
+		}
+		curl_easy_setopt(curl, CURLOPT_URL, MODELS_DIRECTORY_URL);
+		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
 		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, WriteCallback);
 		curl_easy_setopt(curl, CURLOPT_WRITEDATA, &readBuffer);
+		curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, HeaderCallback);
+		curl_easy_setopt(curl, CURLOPT_HEADERDATA, &response_validators);
+		curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, AbortCallback);
+		curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
 		curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L); // Follow redirects
-		curl_easy_setopt(curl, CURLOPT_TIMEOUT, 10L);       // Set a timeout (10 seconds)
+		curl_easy_setopt(curl, CURLOPT_TIMEOUT, 30L);       // Set a timeout (30 seconds)
 
 		res = curl_easy_perform(curl);
+		curl_slist_free_all(headers);
 
 		if (res != CURLE_OK) {
-			obs_log(LOG_ERROR, "Failed to download JSON from GitHub: %s",
+			obs_log(LOG_WARNING, "Failed to download JSON from GitHub: %s",
 				curl_easy_strerror(res));
 			curl_easy_cleanup(curl);
 			return false;
@@ -67,6 +204,10 @@ bool download_json_from_github(std::string &json_content)
 		curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
 		curl_easy_cleanup(curl);
 
+		if (http_code == 304) {
+			not_modified = true;
+			return true;
+		}
 		if (http_code != 200) {
 			obs_log(LOG_ERROR, "HTTP error: %ld", http_code);
 			return false;
@@ -77,9 +218,12 @@ bool download_json_from_github(std::string &json_content)
 	}
 
 	json_content = readBuffer;
+	validators = response_validators;
 	return true;
 }
 
+} // namespace
+
 /**
  * @brief Parses a JSON object to extract model information.
  *
@@ -188,53 +332,27 @@ std::optional<ModelInfo> parse_model_json(const nlohmann::json &model)
 }
 
 /**
- * @brief Loads model information from a JSON source.
+ * @brief Parses the models directory JSON into a map of model information.
  *
- * This function attempts to download a JSON file containing model information from GitHub.
- * If the download fails, it falls back to loading the JSON file from a local directory.
- * The JSON file is expected to contain an array of models under the key "models".
- * Each model's information is parsed and stored in a map with the model's friendly name as the key.
+ * The JSON is expected to contain an array of models under the key "models". Each model's
+ * information is parsed and stored in the map with the model's friendly name as the key.
  *
- * @return A map where the keys are model friendly names and the values are ModelInfo objects.
+ * @return false if the JSON is invalid.
  */
-std::map<std::string, ModelInfo> load_models_info()
+bool parse_models_directory(const std::string &json_content, models_info_map_t &models_info_map)
 {
-	std::map<std::string, ModelInfo> models_info_map;
 	nlohmann::json model_directory_json;
-
-	// Try to download from GitHub first
-	std::string github_json_content;
-	bool download_success = download_json_from_github(github_json_content);
-
-	if (download_success) {
-		obs_log(LOG_INFO, "Successfully downloaded models directory from GitHub");
-		std::istringstream json_stream(github_json_content);
-		json_stream >> model_directory_json;
-	} else {
-		// Fall back to local file
-		obs_log(LOG_INFO, "Falling back to local models directory file");
-		char *model_directory_json_file = obs_module_file("models/models_directory.json");
-		if (model_directory_json_file == nullptr) {
-			obs_log(LOG_ERROR, "Cannot find local model directory file");
-			return models_info_map;
-		}
-		obs_log(LOG_INFO, "Local model directory file: %s", model_directory_json_file);
-		std::string model_directory_file_str = std::string(model_directory_json_file);
-		bfree(model_directory_json_file);
-
-		std::ifstream model_directory_file(model_directory_file_str);
-		if (!model_directory_file.is_open()) {
-			obs_log(LOG_ERROR, "Failed to open local model directory file");
-			return models_info_map;
-		}
-
-		model_directory_file >> model_directory_json;
+	try {
+		model_directory_json = nlohmann::json::parse(json_content);
+	} catch (const std::exception &e) {
+		obs_log(LOG_ERROR, "Invalid models directory JSON: %s", e.what());
+		return false;
 	}
 
 	if (!model_directory_json.contains("models") ||
 	    !model_directory_json["models"].is_array()) {
 		obs_log(LOG_ERROR, "Invalid JSON structure: 'models' array not found");
-		return models_info_map;
+		return false;
 	}
 
 	for (const auto &model : model_directory_json["models"]) {
@@ -243,18 +361,209 @@ std::map<std::string, ModelInfo> load_models_info()
 			models_info_map[model_info_opt->friendly_name] = *model_info_opt;
 		}
 	}
+	return true;
+}
+
+nlohmann::json model_info_to_json(const ModelInfo &model_info)
+{
+	nlohmann::json files = nlohmann::json::array();
+	for (const auto &file : model_info.files) {
+		files.push_back({{"url", file.url}, {"sha256", file.sha256}});
+	}
+	const char *type = model_info.type == MODEL_TYPE_TRANSLATION ? "MODEL_TYPE_TRANSLATION"
+			   : model_info.type == MODEL_TYPE_TRANSCRIPTION_COREML
+				   ? "MODEL_TYPE_TRANSCRIPTION_COREML"
+				   : "MODEL_TYPE_TRANSCRIPTION";
+	return {{"friendly_name", model_info.friendly_name},
+		{"local_folder_name", model_info.local_folder_name},
+		{"type", type},
+		{"files", files},
+		{"extra",
+		 {{"language", model_info.extra.language},
+		  {"description", model_info.extra.description},
+		  {"source", model_info.extra.source}}}};
+}
+
+// Add the models made on the machine to the models of the directory
+void add_local_models(models_info_map_t &models_info_map)
+{
+	std::string content;
+	models_info_map_t local_models;
+	if (read_file(local_models_path(), content) &&
+	    parse_models_directory(content, local_models)) {
+		for (auto &[name, model_info] : local_models) {
+			models_info_map[name] = std::move(model_info);
+		}
+	}
+}
+
+/**
+ * @brief Loads model information from the local copy of the models directory.
+ *
+ * The copy cached from GitHub is used if there is one, else the file bundled with the plugin.
+ *
+ * @param cached_content Set to the content of the cached copy, empty if it is not used.
+ * @return A map where the keys are model friendly names and the values are ModelInfo objects.
+ */
+models_info_map_t load_models_info(std::string &cached_content)
+{
+	models_info_map_t models_info_map;
+
+	const std::filesystem::path cache_path = cached_directory_path();
+	if (read_file(cache_path, cached_content) &&
+	    parse_models_directory(cached_content, models_info_map)) {
+		obs_log(LOG_INFO, "Loaded %zu models from the cached models directory",
+			models_info_map.size());
+		return models_info_map;
+	}
+	cached_content.clear();
+	models_info_map.clear();
+
+	// Fall back to the bundled file
+	char *model_directory_json_file = obs_module_file("models/models_directory.json");
+	if (model_directory_json_file == nullptr) {
+		obs_log(LOG_ERROR, "Cannot find local model directory file");
+		return models_info_map;
+	}
+	obs_log(LOG_INFO, "Local model directory file: %s", model_directory_json_file);
+	std::string model_directory_file_str = std::string(model_directory_json_file);
+	bfree(model_directory_json_file);
+
+	std::string content;
+	if (!read_file(std::filesystem::u8path(model_directory_file_str), content)) {
+		obs_log(LOG_ERROR, "Failed to open local model directory file");
+		return models_info_map;
+	}
+	parse_models_directory(content, models_info_map);
 
 	obs_log(LOG_INFO, "Loaded %zu models", models_info_map.size());
 
 	return models_info_map;
 }
 
+/**
+ * @brief Revalidates the cached models directory with GitHub, in the background.
+ *
+ * A changed directory is saved to the cache with its validators and replaces the current one.
+ */
+void revalidate_models_directory(const std::string &cached_content)
+{
+	const std::filesystem::path cache_path = cached_directory_path();
+	if (cache_path.empty()) {
+		return;
+	}
+	// the validators are only valid for the cached content that was loaded
+	directory_validators validators;
+	if (!cached_content.empty()) {
+		validators = read_validators(cache_path);
+	}
+
+	std::string json_content;
+	bool not_modified = false;
+	if (!download_json_from_github(json_content, validators, not_modified)) {
+		obs_log(LOG_INFO, "Keeping the local models directory");
+		return;
+	}
+	if (not_modified || json_content == cached_content) {
+		obs_log(LOG_INFO, "The cached models directory is up to date");
+		return;
+	}
+
+	auto models_info_map = std::make_unique<models_info_map_t>();
+	if (!parse_models_directory(json_content, *models_info_map)) {
+		return;
+	}
+	add_local_models(*models_info_map);
+	obs_log(LOG_INFO, "Downloaded the models directory from GitHub: %zu models",
+		models_info_map->size());
+
+	std::error_code ec;
+	std::filesystem::create_directories(cache_path.parent_path(), ec);
+	nlohmann::json validators_json;
+	validators_json["etag"] = validators.etag;
+	validators_json["last_modified"] = validators.last_modified;
+	if (!write_file(cache_path, json_content) ||
+	    !write_file(validators_path(cache_path), validators_json.dump())) {
+		obs_log(LOG_WARNING, "Cannot write the cached models directory");
+	}
+
+	std::lock_guard<std::mutex> lock(models_info_mutex);
+	models_info_versions.push_back(std::move(models_info_map));
+	current_models_info = models_info_versions.back().get();
+}
+
 const std::map<std::string, ModelInfo> &models_info()
 {
-	static const std::unique_ptr<const std::map<std::string, ModelInfo>> cached_models_info =
-		std::make_unique<const std::map<std::string, ModelInfo>>(load_models_info());
+	const models_info_map_t *current = current_models_info;
+	if (current != nullptr) {
+		return *current;
+	}
+	std::lock_guard<std::mutex> lock(models_info_mutex);
+	if (current_models_info == nullptr) {
+		// loaded from the local copy, the network is only used in the background
+		std::string cached_content;
+		auto models_info_map = std::make_unique<models_info_map_t>(
+			load_models_info(cached_content));
+		add_local_models(*models_info_map);
+		models_info_versions.push_back(std::move(models_info_map));
+		current_models_info = models_info_versions.back().get();
+		if (!revalidation_stop) {
+			revalidation_thread = std::thread(revalidate_models_directory,
+							  std::move(cached_content));
+		}
+	}
+	return *current_models_info;
+}
+
+void register_local_model(const ModelInfo &model_info)
+{
+	// loads the directory first, the local models are added to it
+	models_info();
+
+	std::lock_guard<std::mutex> lock(models_info_mutex);
+	const std::filesystem::path path = local_models_path();
+	nlohmann::json local_models = nlohmann::json::object();
+	std::string content;
+	if (read_file(path, content)) {
+		local_models = nlohmann::json::parse(content, nullptr, false);
+	}
+	if (!local_models.is_object() || !local_models.contains("models") ||
+	    !local_models["models"].is_array()) {
+		local_models = {{"models", nlohmann::json::array()}};
+	}
+	nlohmann::json &models = local_models["models"];
+	// a model made again replaces the previous one
+	models.erase(std::remove_if(models.begin(), models.end(),
+				    [&model_info](const nlohmann::json &model) {
+					    return model.value("friendly_name", "") ==
+						   model_info.friendly_name;
+				    }),
+		     models.end());
+	models.push_back(model_info_to_json(model_info));
+	std::error_code ec;
+	std::filesystem::create_directories(path.parent_path(), ec);
+	if (path.empty() || !write_file(path, local_models.dump(2))) {
+		obs_log(LOG_WARNING, "Cannot write the local models file");
+	}
+	obs_log(LOG_INFO, "Registered the local model %s", model_info.friendly_name.c_str());
+
+	auto models_info_map = std::make_unique<models_info_map_t>(*current_models_info.load());
+	(*models_info_map)[model_info.friendly_name] = model_info;
+	models_info_versions.push_back(std::move(models_info_map));
+	current_models_info = models_info_versions.back().get();
+}
 
-	return *cached_models_info;
+void shutdown_models_info(void)
+{
+	revalidation_stop = true;
+	std::thread stopping;
+	{
+		std::lock_guard<std::mutex> lock(models_info_mutex);
+		stopping.swap(revalidation_thread);
+	}
+	if (stopping.joinable()) {
+		stopping.join();
+	}
 }
 
 const std::vector<ModelInfo> get_sorted_models_info(std::optional<ModelType> type_filter)
@@ -0,0 +1,274 @@
+#include "model-quantize.h"
+#include "model-downloader.h"
+#include "model-index.h"
+#include "plugin-support.h"
+
+#include <obs-module.h>
+#include <ggml.h>
+
+#include <algorithm>
+#include <cctype>
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// threads quantizing the rows of a tensor
+const unsigned int MAX_QUANTIZE_THREADS = 8;
+
+// the tensors kept in their type, as in the quantize tool of whisper.cpp
+const char *const SKIPPED_TENSORS[] = {"encoder.conv1.bias", "encoder.conv2.bias",
+				       "encoder.positional_embedding",
+				       "decoder.positional_embedding"};
+
+ggml_type quantization_type(int quantization)
+{
+	switch (quantization) {
+	case MODEL_QUANTIZATION_Q8_0:
+		return GGML_TYPE_Q8_0;
+	case MODEL_QUANTIZATION_Q5_K:
+		return GGML_TYPE_Q5_K;
+	default:
+		return GGML_TYPE_F16;
+	}
+}
+
+ggml_ftype quantization_ftype(int quantization)
+{
+	switch (quantization) {
+	case MODEL_QUANTIZATION_Q8_0:
+		return GGML_FTYPE_MOSTLY_Q8_0;
+	case MODEL_QUANTIZATION_Q5_K:
+		return GGML_FTYPE_MOSTLY_Q5_K;
+	default:
+		return GGML_FTYPE_MOSTLY_F16;
+	}
+}
+
+bool copy_bytes(std::ifstream &in, std::ofstream &out, size_t size, std::vector<char> &buffer)
+{
+	buffer.resize(size);
+	return in.read(buffer.data(), (std::streamsize)size) &&
+	       out.write(buffer.data(), (std::streamsize)size);
+}
+
+template<typename T> bool copy_value(std::ifstream &in, std::ofstream &out, T &value)
+{
+	return in.read((char *)&value, sizeof(value)) && out.write((char *)&value, sizeof(value));
+}
+
+// Quantize the rows of a tensor on several threads, returns the size of the quantized data
+size_t quantize_rows(ggml_type type, const std::vector<float> &data, int64_t n_per_row,
+		     std::vector<char> &quantized)
+{
+	const int64_t nrows = (int64_t)data.size() / n_per_row;
+	quantized.resize(ggml_row_size(type, n_per_row) * nrows);
+	const int64_t n_threads = std::max<int64_t>(
+		1, std::min<int64_t>(nrows, std::min(std::thread::hardware_concurrency(),
+						     MAX_QUANTIZE_THREADS)));
+	const int64_t rows_per_thread = (nrows + n_threads - 1) / n_threads;
+	std::vector<std::thread> threads;
+	for (int64_t first_row = 0; first_row < nrows; first_row += rows_per_thread) {
+		const int64_t rows = std::min(rows_per_thread, nrows - first_row);
+		threads.emplace_back([&, first_row, rows]() {
+			// the chunk is written at the offset of its first row
+			ggml_quantize_chunk(type, data.data(), quantized.data(),
+					    first_row * n_per_row, rows, n_per_row, nullptr);
+		});
+	}
+	for (auto &thread : threads) {
+		thread.join();
+	}
+	return quantized.size();
+}
+
+bool quantize_tensors(std::ifstream &in, std::ofstream &out, ggml_type type, uint64_t input_size,
+		      const std::function<void(int)> &progress)
+{
+	std::vector<char> buffer;
+	std::vector<float> data;
+	std::vector<char> quantized;
+	int last_progress = -1;
+	while (true) {
+		int32_t n_dims = 0;
+		int32_t length = 0;
+		int32_t ttype = 0;
+		in.read((char *)&n_dims, sizeof(n_dims));
+		if (in.eof()) {
+			return true;
+		}
+		in.read((char *)&length, sizeof(length));
+		in.read((char *)&ttype, sizeof(ttype));
+		int32_t ne[4] = {1, 1, 1, 1};
+		if (!in || n_dims < 1 || n_dims > 4 || length <= 0) {
+			obs_log(LOG_ERROR, "Invalid tensor in the model file");
+			return false;
+		}
+		in.read((char *)ne, sizeof(int32_t) * n_dims);
+		std::string name(length, '\0');
+		in.read(&name[0], length);
+		if (!in) {
+			return false;
+		}
+		const int64_t nelements = (int64_t)ne[0] * ne[1] * ne[2] * ne[3];
+		const size_t size = ggml_row_size((ggml_type)ttype, ne[0]) * (nelements / ne[0]);
+
+		bool quantize = n_dims == 2 && (ttype == GGML_TYPE_F32 || ttype == GGML_TYPE_F16);
+		for (const char *skipped : SKIPPED_TENSORS) {
+			quantize = quantize && name != skipped;
+		}
+		if (quantize && ne[0] % ggml_blck_size(type) != 0) {
+			obs_log(LOG_ERROR, "Tensor %s has rows of %d values, not a multiple of %s",
+				name.c_str(), ne[0], ggml_type_name(type));
+			return false;
+		}
+		const int32_t output_type = quantize ? (int32_t)type : ttype;
+		out.write((char *)&n_dims, sizeof(n_dims));
+		out.write((char *)&length, sizeof(length));
+		out.write((char *)&output_type, sizeof(output_type));
+		out.write((char *)ne, sizeof(int32_t) * n_dims);
+		out.write(name.data(), length);
+		if (!quantize) {
+			if (!copy_bytes(in, out, size, buffer)) {
+				return false;
+			}
+		} else {
+			data.resize((size_t)nelements);
+			if (ttype == GGML_TYPE_F16) {
+				buffer.resize(size);
+				if (!in.read(buffer.data(), (std::streamsize)size)) {
+					return false;
+				}
+				ggml_fp16_to_fp32_row((const ggml_fp16_t *)buffer.data(),
+						      data.data(), nelements);
+			} else if (!in.read((char *)data.data(), (std::streamsize)size)) {
+				return false;
+			}
+			const size_t quantized_size = quantize_rows(type, data, ne[0], quantized);
+			out.write(quantized.data(), (std::streamsize)quantized_size);
+		}
+		if (!out) {
+			return false;
+		}
+		const int percent =
+			(int)((uint64_t)in.tellg() * 100 / std::max<uint64_t>(input_size, 1));
+		if (percent != last_progress) {
+			last_progress = percent;
+			progress(percent);
+		}
+	}
+}
+
+} // namespace
+
+std::string model_quantization_suffix(int quantization)
+{
+	switch (quantization) {
+	case MODEL_QUANTIZATION_Q8_0:
+		return "q8_0";
+	case MODEL_QUANTIZATION_Q5_K:
+		return "q5_k";
+	default:
+		return "";
+	}
+}
+
+bool model_file_can_be_quantized(const std::string &path, int quantization)
+{
+	if (quantization == MODEL_QUANTIZATION_NONE) {
+		return false;
+	}
+	whisper_model_header header;
+	if (!read_whisper_model_header(path, header)) {
+		return false;
+	}
+	// the weights are rows of n_audio_state or n_text_state values, or of multiples of them
+	const int32_t ftype = header.ftype % GGML_QNT_VERSION_FACTOR;
+	const int64_t block = ggml_blck_size(quantization_type(quantization));
+	return (ftype == GGML_FTYPE_ALL_F32 || ftype == GGML_FTYPE_MOSTLY_F16) &&
+	       header.n_audio_state % block == 0 && header.n_text_state % block == 0;
+}
+
+ModelInfo quantized_model_info(const ModelInfo &model_info, int quantization)
+{
+	const std::string suffix = model_quantization_suffix(quantization);
+	std::string name_suffix = suffix;
+	std::transform(name_suffix.begin(), name_suffix.end(), name_suffix.begin(), ::toupper);
+
+	ModelInfo quantized;
+	quantized.friendly_name = model_info.friendly_name + " (" + name_suffix + ", local)";
+	quantized.local_folder_name = model_info.local_folder_name + "-" + suffix;
+	quantized.type = MODEL_TYPE_TRANSCRIPTION;
+	// the file name of the first model file with the suffix, "ggml-small.bin" is saved as
+	// "ggml-small-q5_k.bin"
+	std::string file_name = "model.bin";
+	if (!model_info.files.empty()) {
+		file_name = get_filename_from_url(model_info.files[0].url);
+	}
+	const size_t extension = file_name.rfind('.');
+	file_name = file_name.substr(0, extension) + "-" + suffix +
+		    (extension != std::string::npos ? file_name.substr(extension) : ".bin");
+	quantized.files.push_back({file_name, ""});
+	quantized.extra.language = model_info.extra.language;
+	return quantized;
+}
+
+bool quantize_whisper_model_file(const std::string &input_path, const std::string &output_path,
+				 int quantization, const std::function<void(int)> &progress)
+{
+	if (!model_file_can_be_quantized(input_path, quantization)) {
+		obs_log(LOG_ERROR, "Model %s cannot be quantized to %s", input_path.c_str(),
+			model_quantization_suffix(quantization).c_str());
+		return false;
+	}
+	const std::filesystem::path input_file = std::filesystem::u8path(input_path);
+	const std::filesystem::path output_file = std::filesystem::u8path(output_path);
+	const std::filesystem::path part_file = output_file.string() + ".part";
+	std::error_code ec;
+	const uint64_t input_size = (uint64_t)std::filesystem::file_size(input_file, ec);
+	std::ifstream in(input_file, std::ios::binary);
+	std::ofstream out(part_file, std::ios::binary | std::ios::trunc);
+	if (ec || !in.is_open() || !out.is_open()) {
+		obs_log(LOG_ERROR, "Cannot open the files to quantize %s", input_path.c_str());
+		return false;
+	}
+
+	uint32_t magic = 0;
+	whisper_model_header header;
+	in.read((char *)&magic, sizeof(magic));
+	in.read((char *)&header, sizeof(header));
+	// the quantization version is kept in the file type, like the quantize tool does
+	const int32_t ftype = quantization_ftype(quantization);
+	header.ftype = GGML_QNT_VERSION * GGML_QNT_VERSION_FACTOR + ftype;
+	out.write((char *)&magic, sizeof(magic));
+	out.write((char *)&header, sizeof(header));
+
+	// mel filters and vocabulary, copied as they are
+	std::vector<char> buffer;
+	int32_t n_mel = 0;
+	int32_t n_fft = 0;
+	int32_t n_vocab = 0;
+	bool ok = copy_value(in, out, n_mel) && copy_value(in, out, n_fft) &&
+		  copy_bytes(in, out, (size_t)n_mel * n_fft * sizeof(float), buffer) &&
+		  copy_value(in, out, n_vocab);
+	for (int32_t i = 0; ok && i < n_vocab; i++) {
+		uint32_t length = 0;
+		ok = copy_value(in, out, length) && copy_bytes(in, out, length, buffer);
+	}
+	ok = ok && quantize_tensors(in, out, quantization_type(quantization), input_size, progress);
+	out.close();
+	if (!ok || out.fail()) {
+		obs_log(LOG_ERROR, "Failed to quantize %s", input_path.c_str());
+		std::filesystem::remove(part_file, ec);
+		return false;
+	}
+	std::filesystem::rename(part_file, output_file, ec);
+	if (ec) {
+		obs_log(LOG_ERROR, "Failed to rename %s: %s", part_file.string().c_str(),
+			ec.message().c_str());
+		return false;
+	}
+	return true;
+}
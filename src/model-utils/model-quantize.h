@@ -0,0 +1,52 @@
+/**
+ * @file model-quantize.h
+ * @brief Quantization of the downloaded f16 whisper models on the machine.
+ *
+ * The models of the directory are pre-quantized files, a large f16 model takes a lot of RAM or
+ * VRAM once loaded. With the "whisper_model_quantization" setting, the downloader converts the
+ * f16 or f32 ggml model to Q8_0 or Q5_K after the download, like the quantize tool of whisper.cpp,
+ * into its own folder next to the model. The result is registered as a local model, listed with
+ * the downloaded ones, with its size and the time the quantization took.
+ */
+#ifndef MODEL_QUANTIZE_H
+#define MODEL_QUANTIZE_H
+
+#include <functional>
+#include <string>
+
+#include "model-downloader-types.h"
+
+enum ModelQuantization {
+	MODEL_QUANTIZATION_NONE = 0,
+	MODEL_QUANTIZATION_Q8_0 = 1,
+	MODEL_QUANTIZATION_Q5_K = 2,
+};
+
+/**
+ * @brief The suffix of the quantized files and folders, e.g. "q5_k", empty for none.
+ */
+std::string model_quantization_suffix(int quantization);
+
+/**
+ * @brief Whether the ggml whisper model file is f16 or f32 and its rows fit in the blocks of
+ * the quantization.
+ */
+bool model_file_can_be_quantized(const std::string &path, int quantization);
+
+/**
+ * @brief The local model made by quantizing the model, with the file it is saved as.
+ */
+ModelInfo quantized_model_info(const ModelInfo &model_info, int quantization);
+
+/**
+ * @brief Quantize a ggml whisper model file, the tensors of the weights only.
+ *
+ * The output is written to a temporary file renamed to output_path once complete.
+ *
+ * @param progress Called with the percentage of the input file done.
+ * @return false if the model cannot be quantized or a file cannot be read or written.
+ */
+bool quantize_whisper_model_file(const std::string &input_path, const std::string &output_path,
+				 int quantization, const std::function<void(int)> &progress);
+
+#endif // MODEL_QUANTIZE_H
@@ -13,6 +13,24 @@
 #include <endian.h>
 #endif
 
+// SHA extensions: SHA-NI on x86, checked at runtime, and the ARMv8 crypto extensions, if the
+// target has them
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define SHA256_X86_SHA 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define SHA256_TARGET_SHA
+#else
+#include <cpuid.h>
+#define SHA256_TARGET_SHA __attribute__((target("sha,sse4.1")))
+#endif
+#elif (defined(__aarch64__) || defined(_M_ARM64)) && \
+	(defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO))
+#define SHA256_ARM_SHA 1
+#include <arm_neon.h>
+#endif
+
 /// same as reset()
 SHA256::SHA256()
 {
@@ -70,8 +88,161 @@ inline uint32_t f2(uint32_t a, uint32_t b, uint32_t c)
 }
 } // namespace
 
+#if defined(SHA256_X86_SHA) || defined(SHA256_ARM_SHA)
+namespace {
+const uint32_t K[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4,
+	0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe,
+	0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f,
+	0x4a7484aa, 0x5cb0a9dc, 0x76f988da, 0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc,
+	0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+	0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070, 0x19a4c116,
+	0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7,
+	0xc67178f2};
+} // namespace
+#endif
+
+#ifdef SHA256_X86_SHA
+namespace {
+bool hasShaExtensions()
+{
+	// SHA (leaf 7, EBX bit 29), SSSE3 and SSE4.1 (leaf 1, ECX bits 9 and 19)
+#ifdef _MSC_VER
+	int info[4];
+	__cpuid(info, 0);
+	if (info[0] < 7)
+		return false;
+	__cpuid(info, 1);
+	const unsigned int ecx = (unsigned int)info[2];
+	__cpuidex(info, 7, 0);
+	const unsigned int ebx = (unsigned int)info[1];
+#else
+	unsigned int eax, ebx, ecx, edx;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+		return false;
+	const unsigned int leaf1_ecx = ecx;
+	if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx))
+		return false;
+	ecx = leaf1_ecx;
+#endif
+	return (ebx & (1u << 29)) && (ecx & (1u << 9)) && (ecx & (1u << 19));
+}
+
+const bool useShaExtensions = hasShaExtensions();
+
+SHA256_TARGET_SHA void processBlocksSha(uint32_t hash[8], const uint8_t *data, size_t numBlocks)
+{
+	// big endian words
+	const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+	// the instructions work on the state as ABEF and CDGH
+	__m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&hash[0]), 0xB1);
+	__m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&hash[4]), 0x1B);
+	__m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+	state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+	for (; numBlocks > 0; numBlocks--, data += 64) {
+		const __m128i abefSave = state0;
+		const __m128i cdghSave = state1;
+		__m128i words[4];
+		for (int i = 0; i < 4; i++)
+			words[i] = _mm_shuffle_epi8(
+				_mm_loadu_si128((const __m128i *)(data + 16 * i)), byteSwap);
+
+		// 4 rounds at a time, the message schedule is extended in place
+		for (int i = 0; i < 16; i++) {
+			__m128i &w = words[i % 4];
+			if (i >= 4) {
+				__m128i next = _mm_sha256msg1_epu32(w, words[(i + 1) % 4]);
+				next = _mm_add_epi32(next, _mm_alignr_epi8(words[(i + 3) % 4],
+									   words[(i + 2) % 4], 4));
+				w = _mm_sha256msg2_epu32(next, words[(i + 3) % 4]);
+			}
+			__m128i msg =
+				_mm_add_epi32(w, _mm_loadu_si128((const __m128i *)&K[4 * i]));
+			state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+			msg = _mm_shuffle_epi32(msg, 0x0E);
+			state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+		}
+
+		state0 = _mm_add_epi32(state0, abefSave);
+		state1 = _mm_add_epi32(state1, cdghSave);
+	}
+
+	// back to ABCD and EFGH
+	tmp = _mm_shuffle_epi32(state0, 0x1B);
+	state1 = _mm_shuffle_epi32(state1, 0xB1);
+	state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+	state1 = _mm_alignr_epi8(state1, tmp, 8);
+	_mm_storeu_si128((__m128i *)&hash[0], state0);
+	_mm_storeu_si128((__m128i *)&hash[4], state1);
+}
+} // namespace
+#endif
+
+#ifdef SHA256_ARM_SHA
+namespace {
+void processBlocksSha(uint32_t hash[8], const uint8_t *data, size_t numBlocks)
+{
+	uint32x4_t state0 = vld1q_u32(&hash[0]);
+	uint32x4_t state1 = vld1q_u32(&hash[4]);
+
+	for (; numBlocks > 0; numBlocks--, data += 64) {
+		const uint32x4_t abcdSave = state0;
+		const uint32x4_t efghSave = state1;
+		uint32x4_t words[4];
+		for (int i = 0; i < 4; i++)
+			words[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16 * i)));
+
+		// 4 rounds at a time, the message schedule is extended in place
+		for (int i = 0; i < 16; i++) {
+			uint32x4_t &w = words[i % 4];
+			if (i >= 4)
+				w = vsha256su1q_u32(vsha256su0q_u32(w, words[(i + 1) % 4]),
+						    words[(i + 2) % 4], words[(i + 3) % 4]);
+			const uint32x4_t msg = vaddq_u32(w, vld1q_u32(&K[4 * i]));
+			const uint32x4_t abcd = state0;
+			state0 = vsha256hq_u32(state0, state1, msg);
+			state1 = vsha256h2q_u32(state1, abcd, msg);
+		}
+
+		state0 = vaddq_u32(state0, abcdSave);
+		state1 = vaddq_u32(state1, efghSave);
+	}
+
+	vst1q_u32(&hash[0], state0);
+	vst1q_u32(&hash[4], state1);
+}
+} // namespace
+#endif
+
 /// process 64 bytes
 void SHA256::processBlock(const void *data)
+{
+	processBlocks(data, 1);
+}
+
+/// process numBlocks blocks of 64 bytes
+void SHA256::processBlocks(const void *data, size_t numBlocks)
+{
+#if defined(SHA256_X86_SHA)
+	if (useShaExtensions) {
+		processBlocksSha(m_hash, (const uint8_t *)data, numBlocks);
+		return;
+	}
+#elif defined(SHA256_ARM_SHA)
+	processBlocksSha(m_hash, (const uint8_t *)data, numBlocks);
+	return;
+#endif
+	for (const uint8_t *block = (const uint8_t *)data; numBlocks > 0;
+	     numBlocks--, block += BlockSize)
+		processBlockGeneric(block);
+}
+
+/// process 64 bytes, portable implementation
+void SHA256::processBlockGeneric(const void *data)
 {
 	// get last hash
 	uint32_t a = m_hash[0];
@@ -458,11 +629,12 @@ void SHA256::add(const void *data, size_t numBytes)
 		return;
 
 	// process full blocks
-	while (numBytes >= BlockSize) {
-		processBlock(current);
-		current += BlockSize;
-		m_numBytes += BlockSize;
-		numBytes -= BlockSize;
+	if (numBytes >= BlockSize) {
+		const size_t numBlocks = numBytes / BlockSize;
+		processBlocks(current, numBlocks);
+		current += numBlocks * BlockSize;
+		m_numBytes += numBlocks * BlockSize;
+		numBytes -= numBlocks * BlockSize;
 	}
 
 	// keep remaining bytes in buffer
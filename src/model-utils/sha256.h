@@ -61,6 +61,10 @@ public:
 private:
 	/// process 64 bytes
 	void processBlock(const void *data);
+	/// process 64 bytes, portable implementation
+	void processBlockGeneric(const void *data);
+	/// process numBlocks blocks of 64 bytes, with the SHA extensions of the CPU if it has them
+	void processBlocks(const void *data, size_t numBlocks);
 	/// process everything left in the internal buffer
 	void processBuffer();
 
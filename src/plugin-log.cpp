@@ -0,0 +1,123 @@
+#include "plugin-log.h"
+
+#include <util/platform.h>
+
+#include <atomic>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+bool obs_verbose()
+{
+	const struct obs_cmdline_args args = obs_get_cmdline_args();
+	for (int i = 1; i < args.argc; i++) {
+		if (args.argv[i] && strcmp(args.argv[i], "--verbose") == 0) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool verbose_log()
+{
+#ifndef NDEBUG
+	return true;
+#else
+	static const bool verbose = getenv("LOCALVOCAL_VERBOSE_LOG") != nullptr || obs_verbose();
+	return verbose;
+#endif
+}
+
+#define RING_LINE_WORDS (DEBUG_RING_LINE_LENGTH / sizeof(uint64_t))
+static_assert(DEBUG_RING_LINE_LENGTH % sizeof(uint64_t) == 0,
+	      "the ring lines are copied by words");
+
+// A line of the ring, seq is the index of the line + 1 once written, 0 while being written.
+// The text is kept in atomic words so the dump can read a line a writer is overwriting, the
+// torn copy is dropped by the seq check.
+struct ring_line {
+	std::atomic<uint64_t> seq{0};
+	std::atomic<uint64_t> ts_ns{0};
+	std::atomic<uint64_t> text[RING_LINE_WORDS] = {};
+};
+
+ring_line ring[DEBUG_RING_LINES];
+std::atomic<uint64_t> ring_head{0};
+std::atomic<int> ring_users{0};
+
+} // namespace
+
+extern "C" bool log_level_enabled(int log_level)
+{
+	return log_level <= LOG_INFO || verbose_log();
+}
+
+extern "C" void debug_ring_retain(void)
+{
+	ring_users.fetch_add(1, std::memory_order_relaxed);
+}
+
+extern "C" void debug_ring_release(void)
+{
+	ring_users.fetch_sub(1, std::memory_order_relaxed);
+}
+
+extern "C" bool debug_ring_enabled(void)
+{
+	return ring_users.load(std::memory_order_relaxed) > 0;
+}
+
+extern "C" void debug_ring_log(const char *format, ...)
+{
+	// writers never wait: each takes the next line, the oldest is overwritten
+	const uint64_t index = ring_head.fetch_add(1, std::memory_order_relaxed);
+	ring_line &line = ring[index % DEBUG_RING_LINES];
+	uint64_t words[RING_LINE_WORDS] = {};
+	va_list args;
+	va_start(args, format);
+	vsnprintf(reinterpret_cast<char *>(words), sizeof(words), format, args);
+	va_end(args);
+	line.seq.store(0, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	line.ts_ns.store(os_gettime_ns(), std::memory_order_relaxed);
+	for (size_t i = 0; i < RING_LINE_WORDS; i++) {
+		line.text[i].store(words[i], std::memory_order_relaxed);
+	}
+	line.seq.store(index + 1, std::memory_order_release);
+}
+
+extern "C" int debug_ring_dump(void)
+{
+	const uint64_t head = ring_head.load(std::memory_order_acquire);
+	const uint64_t first = head > DEBUG_RING_LINES ? head - DEBUG_RING_LINES : 0;
+	obs_log(LOG_INFO, "--- debug ring: lines %llu to %llu ---", (unsigned long long)first,
+		(unsigned long long)head);
+	int dumped = 0;
+	for (uint64_t index = first; index < head; index++) {
+		const ring_line &line = ring[index % DEBUG_RING_LINES];
+		if (line.seq.load(std::memory_order_acquire) != index + 1) {
+			// being written or already overwritten
+			continue;
+		}
+		uint64_t words[RING_LINE_WORDS];
+		for (size_t i = 0; i < RING_LINE_WORDS; i++) {
+			words[i] = line.text[i].load(std::memory_order_relaxed);
+		}
+		const uint64_t ts_ns = line.ts_ns.load(std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (line.seq.load(std::memory_order_relaxed) != index + 1) {
+			continue;
+		}
+		char text[DEBUG_RING_LINE_LENGTH];
+		memcpy(text, words, sizeof(text));
+		text[sizeof(text) - 1] = '\0';
+		obs_log(LOG_INFO, "[ring %.3f] %s", (double)ts_ns / 1e9, text);
+		dumped++;
+	}
+	obs_log(LOG_INFO, "--- debug ring: %d lines ---", dumped);
+	return dumped;
+}
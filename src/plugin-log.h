@@ -0,0 +1,73 @@
+#ifndef PLUGIN_LOG_H
+#define PLUGIN_LOG_H
+
+#include "plugin-support.h"
+
+#include <obs-module.h>
+
+/**
+ * @file plugin-log.h
+ * @brief Logging for the hot paths, the level is checked before the message is formatted.
+ *
+ * obs_log formats every message before libobs hands it to the log handler, which drops the
+ * LOG_DEBUG messages unless OBS runs with --verbose. The pipeline logs most of its messages at
+ * the log level of the filter (LOG_DEBUG by default), some for every VAD window or token.
+ *
+ * - OBS_LOG() only formats the message when its level is logged. LOG_DEBUG is logged in debug
+ *   builds, when OBS runs with --verbose, or when the LOCALVOCAL_VERBOSE_LOG environment variable
+ *   is set. The messages that are not logged go to an in-memory ring of the last
+ *   DEBUG_RING_LINES lines instead, while a filter enables it. The ring is written to the OBS log
+ *   on demand, with debug_ring_dump().
+ * - OBS_LOG_TRACE() is compiled out unless LOCALVOCAL_EXTRA_VERBOSE is defined (debug builds,
+ *   or the LOCALVOCAL_EXTRA_VERBOSE environment variable at configure time).
+ */
+
+#define DEBUG_RING_LINES 2048
+#define DEBUG_RING_LINE_LENGTH 160
+
+#if defined(__GNUC__) || defined(__clang__)
+#define PLUGIN_LOG_PRINTF(format_index, args_index) \
+	__attribute__((format(printf, format_index, args_index)))
+#else
+#define PLUGIN_LOG_PRINTF(format_index, args_index)
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// true if the messages of the level reach the OBS log
+bool log_level_enabled(int log_level);
+
+// the ring records while at least one filter retains it
+void debug_ring_retain(void);
+void debug_ring_release(void);
+bool debug_ring_enabled(void);
+
+void debug_ring_log(const char *format, ...) PLUGIN_LOG_PRINTF(1, 2);
+
+// Write the lines of the ring to the OBS log, oldest first, returns the number of lines
+int debug_ring_dump(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define OBS_LOG(log_level, ...)                            \
+	do {                                               \
+		if (log_level_enabled(log_level)) {        \
+			obs_log((log_level), __VA_ARGS__); \
+		} else if (debug_ring_enabled()) {         \
+			debug_ring_log(__VA_ARGS__);       \
+		}                                          \
+	} while (0)
+
+#ifdef LOCALVOCAL_EXTRA_VERBOSE
+#define OBS_LOG_TRACE(log_level, ...) OBS_LOG(log_level, __VA_ARGS__)
+#else
+#define OBS_LOG_TRACE(log_level, ...) \
+	do {                          \
+	} while (0)
+#endif
+
+#endif // PLUGIN_LOG_H
@@ -29,16 +29,47 @@ MODULE_EXPORT const char *obs_module_description(void)
 
 extern struct obs_source_info transcription_filter_info;
 extern void load_packet_callback_functions();
+extern void init_backend_cache(void);
+extern void init_model_index(void);
+extern void save_translation_cache(void);
+extern void shutdown_cloud_translation_workers(void);
+extern void shutdown_caption_source_updater(void);
+extern void shutdown_transcript_file_writer(void);
+extern void shutdown_audio_archive(void);
+extern void shutdown_recording_retranscription(void);
+extern void shutdown_backend_autotune(void);
+extern void shutdown_models_info(void);
+extern void init_filter_metrics_vendor(void);
+extern void init_metrics_dock(void);
 
 bool obs_module_load(void)
 {
+	// before any filter initializes a GPU backend
+	init_backend_cache();
+	init_model_index();
 	obs_register_source(&transcription_filter_info);
 	load_packet_callback_functions();
 	obs_log(LOG_INFO, "plugin loaded successfully (version %s)", PLUGIN_VERSION);
 	return true;
 }
 
+void obs_module_post_load(void)
+{
+	// obs-websocket and the frontend are loaded by now
+	init_filter_metrics_vendor();
+	init_metrics_dock();
+}
+
 void obs_module_unload(void)
 {
+	// reads the audio archive and writes with the transcript file writer
+	shutdown_recording_retranscription();
+	shutdown_backend_autotune();
+	shutdown_cloud_translation_workers();
+	shutdown_caption_source_updater();
+	shutdown_transcript_file_writer();
+	shutdown_audio_archive();
+	shutdown_models_info();
+	save_translation_cache();
 	obs_log(LOG_INFO, "plugin unloaded");
 }
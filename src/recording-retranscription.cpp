@@ -0,0 +1,328 @@
+#include "recording-retranscription.h"
+#include "audio-archive.h"
+#include "flac-encoder.h"
+#include "plugin-support.h"
+#include "transcript-file-writer.h"
+#include "whisper-utils/whisper-processing.h"
+
+#include <obs-module.h>
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#elif defined(__APPLE__)
+#include <pthread.h>
+#include <pthread/qos.h>
+#elif defined(__linux__)
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// A speech segment of the archive
+struct archived_segment {
+	std::string file;
+	uint64_t start_ms;
+};
+
+// The chunk position where an archived segment starts, and its time in the recording
+struct timeline_span {
+	size_t offset;
+	uint64_t time_ms;
+};
+
+std::mutex job_mutex;
+std::condition_variable job_cv;
+std::thread worker_thread;
+bool worker_stop = false;
+std::deque<retranscription_job> jobs;
+// aborts the running decode on shutdown
+std::atomic<bool> abort_pass{false};
+
+void lower_thread_priority()
+{
+#ifdef _WIN32
+	// the whisper worker threads keep the normal priority
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_IDLE);
+#elif defined(__APPLE__)
+	pthread_set_qos_class_self_np(QOS_CLASS_BACKGROUND, 0);
+#elif defined(__linux__)
+	// the nice value is per thread on Linux, the whisper worker threads inherit it
+	setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 19);
+#endif
+}
+
+bool read_file(const std::filesystem::path &path, std::vector<uint8_t> &data)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open()) {
+		return false;
+	}
+	data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	return !file.bad();
+}
+
+// The speech segments of the archive that start during the recording, in order
+std::vector<archived_segment> read_index(const retranscription_job &job)
+{
+	std::vector<archived_segment> segments;
+	std::ifstream index(std::filesystem::u8path(job.archive_folder) / "index.jsonl");
+	for (std::string line; std::getline(index, line);) {
+		const nlohmann::json entry = nlohmann::json::parse(line, nullptr, false);
+		if (!entry.is_object() || entry.value("vad_state", "") != "speech" ||
+		    !entry.contains("file") || !entry.contains("start_ms")) {
+			continue;
+		}
+		const uint64_t start_ms = entry.value("start_ms", (uint64_t)0);
+		if (start_ms >= job.start_ms && start_ms < job.end_ms) {
+			segments.push_back({entry.value("file", ""), start_ms});
+		}
+	}
+	std::stable_sort(segments.begin(), segments.end(),
+			 [](const archived_segment &a, const archived_segment &b) {
+				 return a.start_ms < b.start_ms;
+			 });
+	return segments;
+}
+
+void append_srt_time(std::ostringstream &out, uint64_t ms)
+{
+	char time[32];
+	snprintf(time, sizeof(time), "%02llu:%02llu:%02llu,%03llu",
+		 (unsigned long long)(ms / 3600000), (unsigned long long)(ms / 60000 % 60),
+		 (unsigned long long)(ms / 1000 % 60), (unsigned long long)(ms % 1000));
+	out << time;
+}
+
+// Decode a chunk of the timeline and append its subtitles. Returns false if the pass is aborted.
+bool decode_chunk(struct whisper_context *ctx, struct whisper_state *state,
+		  const whisper_full_params &params, const std::vector<float> &chunk,
+		  const std::vector<timeline_span> &spans, int &subtitle_number,
+		  std::ostringstream &srt)
+{
+	if (whisper_full_with_state(ctx, state, params, chunk.data(), (int)chunk.size()) != 0) {
+		if (abort_pass) {
+			return false;
+		}
+		obs_log(LOG_WARNING, "Re-transcription of a chunk of %.1f s failed",
+			(double)chunk.size() / WHISPER_SAMPLE_RATE);
+		return true;
+	}
+	// segment timestamps are in 10 ms units in the chunk
+	const auto recording_time = [&spans](int64_t t) {
+		const size_t offset = (size_t)std::max<int64_t>(t, 0) * (WHISPER_SAMPLE_RATE / 100);
+		auto span = std::upper_bound(
+			spans.begin(), spans.end(), offset,
+			[](size_t value, const timeline_span &s) { return value < s.offset; });
+		if (span != spans.begin()) {
+			--span;
+		}
+		const size_t from_span = offset > span->offset ? offset - span->offset : 0;
+		return span->time_ms + from_span * 1000 / WHISPER_SAMPLE_RATE;
+	};
+	const int n_segments = whisper_full_n_segments_from_state(state);
+	for (int i = 0; i < n_segments; i++) {
+		std::string text = whisper_full_get_segment_text_from_state(state, i);
+		text.erase(0, text.find_first_not_of(" \t\n"));
+		text.erase(text.find_last_not_of(" \t\n") + 1);
+		if (text.empty()) {
+			continue;
+		}
+		const uint64_t start =
+			recording_time(whisper_full_get_segment_t0_from_state(state, i));
+		const uint64_t end = std::max(
+			start, recording_time(whisper_full_get_segment_t1_from_state(state, i)));
+		srt << subtitle_number++ << "\n";
+		append_srt_time(srt, start);
+		srt << " --> ";
+		append_srt_time(srt, end);
+		srt << "\n" << text << "\n\n";
+	}
+	return true;
+}
+
+void run_job(const retranscription_job &job)
+{
+	audio_archive_sync();
+	const std::vector<archived_segment> segments = read_index(job);
+	if (segments.empty()) {
+		obs_log(LOG_INFO, "No archived speech to re-transcribe for %s",
+			job.srt_path.c_str());
+		return;
+	}
+	obs_log(LOG_INFO, "Re-transcribing %d archived segments with %s", (int)segments.size(),
+		job.model_path.c_str());
+
+	struct whisper_context_params cparams = whisper_context_default_params();
+	// the GPU stays with the live transcription
+	cparams.use_gpu = false;
+	struct whisper_context *ctx = load_whisper_model_file(job.model_path, cparams);
+	if (ctx == nullptr) {
+		return;
+	}
+	struct whisper_state *state = whisper_init_state(ctx);
+	if (state == nullptr) {
+		obs_log(LOG_ERROR, "Failed to create the re-transcription whisper state");
+		whisper_free(ctx);
+		return;
+	}
+
+	whisper_full_params params = whisper_full_default_params(WHISPER_SAMPLING_BEAM_SEARCH);
+	params.beam_search.beam_size = std::max(1, job.beam_size);
+	params.n_threads = std::max(1, std::min<int>(RETRANSCRIPTION_THREADS,
+						     (int)std::thread::hardware_concurrency()));
+	params.language = job.language.empty() ? "auto" : job.language.c_str();
+	params.print_progress = false;
+	params.print_realtime = false;
+	params.print_special = false;
+	params.print_timestamps = false;
+	// the chunks of a recording follow each other
+	params.no_context = false;
+	params.abort_callback = [](void *) { return abort_pass.load(); };
+	params.abort_callback_user_data = nullptr;
+
+	const std::filesystem::path folder = std::filesystem::u8path(job.archive_folder);
+	const size_t chunk_samples = (size_t)RETRANSCRIPTION_CHUNK_SECONDS * WHISPER_SAMPLE_RATE;
+	std::vector<uint8_t> encoded;
+	std::vector<float> samples;
+	std::vector<float> chunk;
+	std::vector<timeline_span> spans;
+	// wall clock time of the end of the chunk audio
+	uint64_t timeline_end_ms = 0;
+	int subtitle_number = 1;
+	std::ostringstream srt;
+	bool completed = true;
+	for (const archived_segment &segment : segments) {
+		uint32_t sample_rate = 0;
+		if (!read_file(folder / std::filesystem::u8path(segment.file), encoded) ||
+		    !flac_decode_mono16(encoded.data(), encoded.size(), samples, sample_rate) ||
+		    sample_rate != WHISPER_SAMPLE_RATE) {
+			// removed by the rolling size limit in the meantime
+			obs_log(LOG_WARNING, "Cannot read the archived segment %s",
+				segment.file.c_str());
+			continue;
+		}
+		// the segments are padded with silence for whisper
+		size_t begin = 0;
+		size_t end = samples.size();
+		if (end > 2 * SEGMENT_PADDING_SAMPLES) {
+			begin = SEGMENT_PADDING_SAMPLES;
+			end -= SEGMENT_PADDING_SAMPLES;
+		}
+		uint64_t start_ms = segment.start_ms;
+		if (timeline_end_ms > start_ms) {
+			// a segment starts with the end of the previous one
+			begin += (size_t)((timeline_end_ms - start_ms) * WHISPER_SAMPLE_RATE /
+					  1000);
+			start_ms = timeline_end_ms;
+			if (begin >= end) {
+				continue;
+			}
+		} else if (!chunk.empty()) {
+			if (chunk.size() >= chunk_samples) {
+				if (!decode_chunk(ctx, state, params, chunk, spans, subtitle_number,
+						  srt)) {
+					completed = false;
+					break;
+				}
+				chunk.clear();
+				spans.clear();
+			} else {
+				const uint64_t gap_ms = std::min<uint64_t>(
+					start_ms - timeline_end_ms, RETRANSCRIPTION_GAP_MS);
+				chunk.resize(chunk.size() + gap_ms * WHISPER_SAMPLE_RATE / 1000,
+					     0.0f);
+			}
+		}
+		spans.push_back({chunk.size(), start_ms - job.start_ms});
+		chunk.insert(chunk.end(), samples.begin() + begin, samples.begin() + end);
+		timeline_end_ms = start_ms + (end - begin) * 1000 / WHISPER_SAMPLE_RATE;
+	}
+	if (completed && !chunk.empty()) {
+		completed = decode_chunk(ctx, state, params, chunk, spans, subtitle_number, srt);
+	}
+	whisper_free_state(state);
+	whisper_free(ctx);
+
+	if (!completed) {
+		obs_log(LOG_INFO, "Re-transcription of %s aborted", job.srt_path.c_str());
+		return;
+	}
+	transcript_file_write(job.srt_path, srt.str(), true);
+	transcript_file_close(job.srt_path);
+	obs_log(LOG_INFO, "Re-transcription written to %s (%d subtitles)", job.srt_path.c_str(),
+		subtitle_number - 1);
+}
+
+void worker_loop()
+{
+	lower_thread_priority();
+	std::unique_lock<std::mutex> lock(job_mutex);
+	while (true) {
+		job_cv.wait(lock, [] { return worker_stop || !jobs.empty(); });
+		if (worker_stop) {
+			break;
+		}
+		const retranscription_job job = jobs.front();
+		jobs.pop_front();
+		// the last segments of the recording may still be decoded by the live transcription
+		const auto settled = std::chrono::system_clock::time_point(
+			std::chrono::milliseconds(job.end_ms + RETRANSCRIPTION_SETTLE_MS));
+		if (job_cv.wait_until(lock, settled, [] { return worker_stop; })) {
+			break;
+		}
+		lock.unlock();
+		run_job(job);
+		lock.lock();
+	}
+}
+
+} // namespace
+
+void queue_recording_retranscription(const retranscription_job &job)
+{
+	if (job.archive_folder.empty() || job.model_path.empty() || job.srt_path.empty() ||
+	    job.end_ms <= job.start_ms) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(job_mutex);
+		if (!worker_thread.joinable()) {
+			worker_stop = false;
+			abort_pass = false;
+			worker_thread = std::thread(worker_loop);
+		}
+		jobs.push_back(job);
+	}
+	job_cv.notify_all();
+}
+
+void shutdown_recording_retranscription(void)
+{
+	{
+		std::lock_guard<std::mutex> lock(job_mutex);
+		worker_stop = true;
+		jobs.clear();
+	}
+	abort_pass = true;
+	job_cv.notify_all();
+	if (worker_thread.joinable()) {
+		worker_thread.join();
+	}
+}
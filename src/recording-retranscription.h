@@ -0,0 +1,65 @@
+/**
+ * @file recording-retranscription.h
+ * @brief Second transcription pass of a recording, from the audio archive.
+ *
+ * When a recording stops, the speech segments archived during it (see audio-archive.h) are
+ * transcribed again with a larger model and beam search, and the subtitles are written to an
+ * SRT file next to the recording. The segments are joined back into a timeline without the
+ * overlaps of the live segmentation and decoded in chunks of RETRANSCRIPTION_CHUNK_SECONDS, so
+ * whisper has the context of the sentences before. The pass runs on a single background thread
+ * at idle priority, on the CPU with RETRANSCRIPTION_THREADS threads and its own model, so the
+ * live transcription keeps its model, GPU and thread budget. The recordings are transcribed in
+ * the order they stopped.
+ */
+#ifndef RECORDING_RETRANSCRIPTION_H
+#define RECORDING_RETRANSCRIPTION_H
+
+#ifdef __cplusplus
+#include <cstdint>
+#include <string>
+
+// whisper threads of the pass
+#define RETRANSCRIPTION_THREADS 2
+// speech decoded with one whisper_full call
+#define RETRANSCRIPTION_CHUNK_SECONDS 120
+// silence put between two segments that do not follow each other
+#define RETRANSCRIPTION_GAP_MS 300
+// the pass waits this long after the end of the recording for its last segments
+#define RETRANSCRIPTION_SETTLE_MS 5000
+#define RETRANSCRIPTION_DEFAULT_BEAM_SIZE 5
+
+struct retranscription_job {
+	// audio archive of the filter
+	std::string archive_folder;
+	// wall clock times of the recording
+	uint64_t start_ms;
+	uint64_t end_ms;
+	// ggml model file of the pass
+	std::string model_path;
+	// empty for the automatic detection
+	std::string language;
+	int beam_size = RETRANSCRIPTION_DEFAULT_BEAM_SIZE;
+	// SRT file written at the end of the pass, UTF-8
+	std::string srt_path;
+};
+
+/**
+ * @brief Queue a recording for the second pass. Starts the worker thread on first use.
+ */
+void queue_recording_retranscription(const retranscription_job &job);
+
+extern "C" {
+#endif
+
+/**
+ * @brief Abort the running pass, drop the queued ones and stop the worker thread.
+ *
+ * Called on module unload.
+ */
+void shutdown_recording_retranscription(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // RECORDING_RETRANSCRIPTION_H
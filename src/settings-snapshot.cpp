@@ -0,0 +1,92 @@
+#include "settings-snapshot.h"
+
+#include <cstdio>
+
+namespace {
+
+std::string data_value(obs_data_t *data)
+{
+	if (data == nullptr) {
+		return "";
+	}
+	const char *json = obs_data_get_json(data);
+	std::string value = json != nullptr ? json : "";
+	obs_data_release(data);
+	return value;
+}
+
+// The value of a setting as a string, the type first so "1" and 1 differ
+std::string item_value(obs_data_item_t *item)
+{
+	switch (obs_data_item_gettype(item)) {
+	case OBS_DATA_STRING: {
+		const char *str = obs_data_item_get_string(item);
+		return std::string("s") + (str != nullptr ? str : "");
+	}
+	case OBS_DATA_NUMBER:
+		if (obs_data_item_numtype(item) == OBS_DATA_NUM_DOUBLE) {
+			char number[32];
+			snprintf(number, sizeof(number), "%.17g", obs_data_item_get_double(item));
+			return std::string("d") + number;
+		}
+		return "i" + std::to_string(obs_data_item_get_int(item));
+	case OBS_DATA_BOOLEAN:
+		return obs_data_item_get_bool(item) ? "b1" : "b0";
+	case OBS_DATA_OBJECT:
+		return "o" + data_value(obs_data_item_get_obj(item));
+	case OBS_DATA_ARRAY: {
+		obs_data_array_t *array = obs_data_item_get_array(item);
+		std::string value = "a";
+		for (size_t i = 0; array != nullptr && i < obs_data_array_count(array); i++) {
+			value += data_value(obs_data_array_item(array, i)) + "\n";
+		}
+		obs_data_array_release(array);
+		return value;
+	}
+	default:
+		return "";
+	}
+}
+
+} // namespace
+
+void SettingsSnapshot::update(obs_data_t *settings)
+{
+	std::map<std::string, std::string> new_values;
+	for (obs_data_item_t *item = obs_data_first(settings); item != nullptr;
+	     obs_data_item_next(&item)) {
+		const char *name = obs_data_item_get_name(item);
+		if (name != nullptr) {
+			new_values[name] = item_value(item);
+		}
+	}
+	changed_names.clear();
+	for (const auto &entry : new_values) {
+		auto previous = values.find(entry.first);
+		if (previous == values.end() || previous->second != entry.second) {
+			changed_names.insert(entry.first);
+		}
+	}
+	for (const auto &entry : values) {
+		if (new_values.count(entry.first) == 0) {
+			changed_names.insert(entry.first);
+		}
+	}
+	values = std::move(new_values);
+	updates++;
+}
+
+bool SettingsSnapshot::changed(const char *name) const
+{
+	return first() || changed_names.count(name) > 0;
+}
+
+bool SettingsSnapshot::changed_prefix(const char *prefix) const
+{
+	if (first()) {
+		return true;
+	}
+	const std::string p(prefix);
+	auto it = changed_names.lower_bound(p);
+	return it != changed_names.end() && it->compare(0, p.size(), p) == 0;
+}
@@ -0,0 +1,40 @@
+/**
+ * @file settings-snapshot.h
+ * @brief Values of the filter settings at the previous update, to tell which ones changed.
+ *
+ * transcription_filter_update is called with all the settings whenever one of them changes.
+ * The snapshot keeps the value of each setting, defaults included, so the update only restarts
+ * the subsystems (buffered output monitors, WebVTT, word filters, whisper model) whose settings
+ * changed, and a caption setting does not reload the model or clear the captions.
+ */
+#ifndef SETTINGS_SNAPSHOT_H
+#define SETTINGS_SNAPSHOT_H
+
+#include <obs.h>
+
+#include <map>
+#include <set>
+#include <string>
+
+class SettingsSnapshot {
+public:
+	/**
+	 * @brief Take the values of the settings and the names of the ones that changed.
+	 *
+	 * On the first update all the settings are changed.
+	 */
+	void update(obs_data_t *settings);
+
+	bool changed(const char *name) const;
+	// any of the settings whose name starts with the prefix
+	bool changed_prefix(const char *prefix) const;
+	// the first update, all the subsystems are set up
+	bool first() const { return updates <= 1; }
+
+private:
+	std::map<std::string, std::string> values;
+	std::set<std::string> changed_names;
+	unsigned int updates = 0;
+};
+
+#endif // SETTINGS_SNAPSHOT_H
@@ -4,6 +4,11 @@
 
 #include <obs-module.h>
 
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <functional>
 
@@ -124,6 +129,264 @@ read_audio_file(const char *filename, std::function<void(int, int)> initializati
 	return buffer;
 }
 
+// the decoded audio, one vector per channel
+typedef std::vector<std::vector<float>> audio_chunk;
+
+struct AudioFileStream::impl {
+	AVFormatContext *format_context = nullptr;
+	AVCodecContext *codec_context = nullptr;
+	SwrContext *swr_context = nullptr;
+	int stream_index = -1;
+	int sample_rate = 0;
+	int channels = 0;
+
+	std::thread decoder_thread;
+	std::mutex queue_mutex;
+	std::condition_variable queue_cv;
+	std::deque<audio_chunk> queue;
+	bool decoding_finished = false;
+	bool stop = false;
+
+	// only used by the reader
+	audio_chunk chunk;
+	size_t chunk_offset = 0;
+	// a window across two chunks
+	audio_chunk window;
+
+	~impl()
+	{
+		{
+			std::lock_guard<std::mutex> lock(queue_mutex);
+			stop = true;
+		}
+		queue_cv.notify_all();
+		if (decoder_thread.joinable()) {
+			decoder_thread.join();
+		}
+		swr_free(&swr_context);
+		avcodec_free_context(&codec_context);
+		avformat_close_input(&format_context);
+	}
+
+	// Wait for room in the queue. Returns false if the stream is closed.
+	bool push(audio_chunk &&decoded)
+	{
+		std::unique_lock<std::mutex> lock(queue_mutex);
+		queue_cv.wait(lock,
+			      [this] { return stop || queue.size() < AUDIO_STREAM_QUEUE_CHUNKS; });
+		if (stop) {
+			return false;
+		}
+		queue.push_back(std::move(decoded));
+		queue_cv.notify_all();
+		return true;
+	}
+
+	// Convert the frame (nullptr to flush the resampler) to the chunk, push it when it is full
+	bool convert(const AVFrame *frame, audio_chunk &current)
+	{
+		const int in_frames = frame != nullptr ? frame->nb_samples : 0;
+		const int max_frames = swr_get_out_samples(swr_context, in_frames);
+		if (max_frames <= 0) {
+			return true;
+		}
+		const size_t offset = current[0].size();
+		uint8_t *out[AV_NUM_DATA_POINTERS] = {};
+		for (int c = 0; c < channels; c++) {
+			current[c].resize(offset + max_frames);
+			out[c] = (uint8_t *)(current[c].data() + offset);
+		}
+		const uint8_t **in =
+			frame != nullptr ? (const uint8_t **)frame->extended_data : nullptr;
+		const int converted = swr_convert(swr_context, out, max_frames, in, in_frames);
+		for (int c = 0; c < channels; c++) {
+			current[c].resize(offset + std::max(converted, 0));
+		}
+		if (current[0].size() < AUDIO_STREAM_CHUNK_FRAMES) {
+			return true;
+		}
+		audio_chunk full(channels);
+		for (int c = 0; c < channels; c++) {
+			full[c].reserve(AUDIO_STREAM_CHUNK_FRAMES + max_frames);
+		}
+		std::swap(full, current);
+		return push(std::move(full));
+	}
+
+	void decode_loop()
+	{
+		AVFrame *frame = av_frame_alloc();
+		AVPacket packet;
+		audio_chunk current(channels);
+		bool running = true;
+		while (running && av_read_frame(format_context, &packet) >= 0) {
+			if (packet.stream_index == stream_index &&
+			    avcodec_send_packet(codec_context, &packet) == 0) {
+				while (running &&
+				       avcodec_receive_frame(codec_context, frame) == 0) {
+					running = convert(frame, current);
+				}
+			}
+			av_packet_unref(&packet);
+		}
+		if (running) {
+			// the frames held by the decoder and the resampler
+			avcodec_send_packet(codec_context, nullptr);
+			while (running && avcodec_receive_frame(codec_context, frame) == 0) {
+				running = convert(frame, current);
+			}
+			if (running) {
+				running = convert(nullptr, current);
+			}
+			if (running && !current[0].empty()) {
+				push(std::move(current));
+			}
+		}
+		av_frame_free(&frame);
+		std::lock_guard<std::mutex> lock(queue_mutex);
+		decoding_finished = true;
+		queue_cv.notify_all();
+	}
+
+	// Wait for the next chunk. Returns false at the end of the file.
+	bool next_chunk()
+	{
+		std::unique_lock<std::mutex> lock(queue_mutex);
+		queue_cv.wait(lock, [this] { return decoding_finished || !queue.empty(); });
+		if (queue.empty()) {
+			return false;
+		}
+		chunk = std::move(queue.front());
+		queue.pop_front();
+		chunk_offset = 0;
+		queue_cv.notify_all();
+		return true;
+	}
+};
+
+AudioFileStream::AudioFileStream() : d(new impl) {}
+
+AudioFileStream::~AudioFileStream() = default;
+
+bool AudioFileStream::open(const char *filename, int output_sample_rate)
+{
+	av_log_set_level(AV_LOG_QUIET);
+
+	obs_log(LOG_INFO, "Streaming audio file %s", filename);
+
+	int ret = avformat_open_input(&d->format_context, filename, nullptr, nullptr);
+	if (ret != 0) {
+		char errbuf[AV_ERROR_MAX_STRING_SIZE];
+		av_make_error_string(errbuf, AV_ERROR_MAX_STRING_SIZE, ret);
+		obs_log(LOG_ERROR, "Error opening file: %s", errbuf);
+		return false;
+	}
+
+	if (avformat_find_stream_info(d->format_context, nullptr) < 0) {
+		obs_log(LOG_ERROR, "Error finding stream information");
+		return false;
+	}
+
+	d->stream_index =
+		av_find_best_stream(d->format_context, AVMEDIA_TYPE_AUDIO, -1, -1, nullptr, 0);
+	if (d->stream_index < 0) {
+		obs_log(LOG_ERROR, "No audio stream found");
+		return false;
+	}
+
+	AVCodecParameters *codecParams = d->format_context->streams[d->stream_index]->codecpar;
+	const AVCodec *codec = avcodec_find_decoder(codecParams->codec_id);
+	if (!codec) {
+		obs_log(LOG_ERROR, "Decoder not found");
+		return false;
+	}
+
+	d->codec_context = avcodec_alloc_context3(codec);
+	if (!d->codec_context) {
+		obs_log(LOG_ERROR, "Failed to allocate codec context");
+		return false;
+	}
+
+	if (avcodec_parameters_to_context(d->codec_context, codecParams) < 0) {
+		obs_log(LOG_ERROR, "Failed to copy codec parameters to codec context");
+		return false;
+	}
+
+	if (avcodec_open2(d->codec_context, codec, nullptr) < 0) {
+		obs_log(LOG_ERROR, "Failed to open codec");
+		return false;
+	}
+
+	// any sample format to float planar, and to the output rate on the way
+	d->channels = d->codec_context->channels;
+	d->sample_rate = output_sample_rate > 0 ? output_sample_rate
+						: d->codec_context->sample_rate;
+	const int64_t channel_layout = d->codec_context->channel_layout != 0
+					       ? (int64_t)d->codec_context->channel_layout
+					       : av_get_default_channel_layout(d->channels);
+	d->swr_context = swr_alloc_set_opts(nullptr, channel_layout, AV_SAMPLE_FMT_FLTP,
+					    d->sample_rate, channel_layout,
+					    d->codec_context->sample_fmt,
+					    d->codec_context->sample_rate, 0, nullptr);
+	if (d->channels <= 0 || !d->swr_context || swr_init(d->swr_context) < 0) {
+		obs_log(LOG_ERROR, "Failed to set up the resampler");
+		return false;
+	}
+	obs_log(LOG_INFO, "Decoding %d channels at %d Hz to %d Hz", d->channels,
+		d->codec_context->sample_rate, d->sample_rate);
+
+	d->decoder_thread = std::thread(&impl::decode_loop, d.get());
+	return true;
+}
+
+int AudioFileStream::sample_rate() const
+{
+	return d->sample_rate;
+}
+
+int AudioFileStream::channels() const
+{
+	return d->channels;
+}
+
+size_t AudioFileStream::read(size_t frames, const float **channel_data)
+{
+	for (auto &channel : d->window) {
+		channel.clear();
+	}
+	size_t read_frames = 0;
+	while (read_frames < frames) {
+		if (d->chunk.empty() || d->chunk_offset >= d->chunk[0].size()) {
+			if (!d->next_chunk()) {
+				break;
+			}
+			continue;
+		}
+		const size_t n =
+			std::min(frames - read_frames, d->chunk[0].size() - d->chunk_offset);
+		if (read_frames == 0 && n == frames) {
+			// the whole window is in the chunk
+			for (int c = 0; c < d->channels; c++) {
+				channel_data[c] = d->chunk[c].data() + d->chunk_offset;
+			}
+			d->chunk_offset += n;
+			return n;
+		}
+		d->window.resize(d->channels);
+		for (int c = 0; c < d->channels; c++) {
+			d->window[c].insert(d->window[c].end(),
+					    d->chunk[c].begin() + d->chunk_offset,
+					    d->chunk[c].begin() + d->chunk_offset + n);
+		}
+		d->chunk_offset += n;
+		read_frames += n;
+	}
+	for (int c = 0; c < d->channels && read_frames > 0; c++) {
+		channel_data[c] = d->window[c].data();
+	}
+	return read_frames;
+}
+
 void write_audio_wav_file(const std::string &filename, const float *pcm32f_data,
 			  const size_t frames)
 {
@@ -264,6 +527,37 @@ read_audio_file(const char *filename, std::function<void(int, int)> initializati
 	return {};
 }
 
+struct AudioFileStream::impl {};
+
+AudioFileStream::AudioFileStream() : d(new impl) {}
+
+AudioFileStream::~AudioFileStream() = default;
+
+bool AudioFileStream::open(const char *filename, int output_sample_rate)
+{
+	UNUSED_PARAMETER(filename);
+	UNUSED_PARAMETER(output_sample_rate);
+	obs_log(LOG_ERROR, "Reading audio files is not supported on this platform");
+	return false;
+}
+
+int AudioFileStream::sample_rate() const
+{
+	return 0;
+}
+
+int AudioFileStream::channels() const
+{
+	return 0;
+}
+
+size_t AudioFileStream::read(size_t frames, const float **channel_data)
+{
+	UNUSED_PARAMETER(frames);
+	UNUSED_PARAMETER(channel_data);
+	return 0;
+}
+
 void write_audio_wav_file(const std::string &filename, const float *pcm32f_data,
 			  const size_t frames)
 {
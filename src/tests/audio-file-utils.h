@@ -1,6 +1,6 @@
-
 #include <vector>
 #include <functional>
+#include <memory>
 #include <string>
 
 std::vector<std::vector<uint8_t>>
@@ -8,3 +8,31 @@ read_audio_file(const char *filename, std::function<void(int, int)> initializati
 
 void write_audio_wav_file(const std::string &filename, const float *pcm32f_data,
 			  const size_t frames);
+
+// frames of each chunk decoded by AudioFileStream
+#define AUDIO_STREAM_CHUNK_FRAMES 16384
+// chunks decoded ahead of the reader, the decoder thread waits when the queue is full
+#define AUDIO_STREAM_QUEUE_CHUNKS 8
+
+// Decodes an audio file on a thread of its own, to planar float samples of any input format.
+// The decoded chunks go through a bounded queue, so the memory does not grow with the length of
+// the file and the decoding overlaps with the processing of the audio.
+class AudioFileStream {
+public:
+	AudioFileStream();
+	~AudioFileStream();
+
+	// Open the file and start the decoder thread. The audio is resampled to
+	// output_sample_rate, or keeps the rate of the file with 0. Returns false on error.
+	bool open(const char *filename, int output_sample_rate = 0);
+	// sample rate and channels of the decoded audio
+	int sample_rate() const;
+	int channels() const;
+	// The next frames of the file, one pointer per channel in channel_data, valid until the
+	// next call. Returns the number of frames, less than asked at the end of the file only.
+	size_t read(size_t frames, const float **channel_data);
+
+private:
+	struct impl;
+	std::unique_ptr<impl> d;
+};
@@ -0,0 +1,161 @@
+"""Run a matrix of settings through the offline test and compare accuracy with latency.
+
+Every combination of the matrix values is merged into the base configuration and run once in
+the benchmark mode of the offline test, in its own folder. The output of each run is scored
+with evaluate_output.py and recorded with the latency and real-time factor of the run. The
+runs that no other run beats on both the error rate and the latency form the Pareto frontier.
+
+Example matrix file:
+
+    {
+        "vad_mode": [0, 1, 2],
+        "segment_duration": [3000, 7000],
+        "partial_transcription": [true],
+        "partial_latency": [500, 1000],
+        "whisper_model_path": [".../ggml-model-whisper-small.bin", ".../ggml-model-whisper-base.bin"],
+        "whisper_n_threads": [4, 8],
+        "whisper_sampling_method": [0, 1]
+    }
+"""
+import argparse
+import csv
+import itertools
+import json
+import os
+import subprocess
+import sys
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+from evaluate_output import evaluate  # noqa: E402
+
+
+def combinations(matrix):
+    keys = sorted(matrix)
+    for values in itertools.product(*(matrix[key] for key in keys)):
+        yield dict(zip(keys, values))
+
+
+def run_settings(args, base_config, settings, run_dir):
+    os.makedirs(run_dir, exist_ok=True)
+    config = dict(base_config)
+    config.update(settings)
+    config["benchmark_runs"] = 1
+    config["benchmark_output_file"] = "benchmark.json"
+    config_path = os.path.join(run_dir, "config.json")
+    with open(config_path, "w", encoding="utf-8") as file:
+        json.dump(config, file, indent=2)
+    with open(os.path.join(run_dir, "log.txt"), "w", encoding="utf-8") as log:
+        completed = subprocess.run([os.path.abspath(args.test_exe), os.path.abspath(args.audio), "config.json"],
+                                   cwd=run_dir, stdout=log, stderr=subprocess.STDOUT)
+    if completed.returncode != 0:
+        print(f"run failed with status {completed.returncode}, see {run_dir}/log.txt")
+        return None
+    with open(os.path.join(run_dir, "benchmark.json"), encoding="utf-8") as file:
+        run = json.load(file)["runs"][0]
+    wer, cer = evaluate(args.reference, os.path.join(run_dir, "output.txt"),
+                        remove_accents=args.remove_accents, remove_punctuation=args.remove_punctuation)
+    return {
+        "wer": wer,
+        "cer": cer,
+        "real_time_factor": run["real_time_factor"],
+        "latency_p50_ms": run["segment_latency_ms"]["p50"],
+        "latency_p95_ms": run["segment_latency_ms"]["p95"],
+        "latency_p99_ms": run["segment_latency_ms"]["p99"],
+        "peak_rss_bytes": run["peak_rss_bytes"],
+    }
+
+
+def pareto_frontier(results, error_key, latency_key):
+    """The results not dominated by another result on both the error and the latency."""
+    frontier = []
+    for result in results:
+        dominated = any(
+            other[error_key] <= result[error_key] and other[latency_key] <= result[latency_key] and
+            (other[error_key] < result[error_key] or other[latency_key] < result[latency_key])
+            for other in results)
+        if not dominated:
+            frontier.append(result)
+    return sorted(frontier, key=lambda result: result[latency_key])
+
+
+def plot(results, frontier, error_key, latency_key, plot_path):
+    try:
+        import matplotlib
+        matplotlib.use("Agg")
+        import matplotlib.pyplot as plt
+    except ImportError:
+        print("matplotlib is not installed, the plot is skipped")
+        return
+    figure, axes = plt.subplots(figsize=(10, 7))
+    axes.scatter([r[latency_key] for r in results], [r[error_key] for r in results], color="lightgray",
+                 label="runs")
+    axes.plot([r[latency_key] for r in frontier], [r[error_key] for r in frontier], "o-", color="tab:red",
+              label="Pareto frontier")
+    for result in frontier:
+        axes.annotate(result["name"], (result[latency_key], result[error_key]), fontsize=7,
+                      textcoords="offset points", xytext=(4, 4))
+    axes.set_xlabel(latency_key)
+    axes.set_ylabel(error_key.upper())
+    axes.legend()
+    figure.tight_layout()
+    figure.savefig(plot_path)
+    print(f"plot written to {plot_path}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Accuracy and latency of a matrix of settings')
+    parser.add_argument('test_exe', type=str, help='Path to the offline test executable')
+    parser.add_argument('audio', type=str, help='Path to the audio file')
+    parser.add_argument('reference', type=str, help='Path to the reference transcription')
+    parser.add_argument('base_config', type=str, help='Configuration the settings are applied to')
+    parser.add_argument('matrix', type=str, help='JSON object of the setting values to combine')
+    parser.add_argument('--output_dir', type=str, default='matrix-results', help='Folder of the runs and results')
+    parser.add_argument('--error', choices=['wer', 'cer'], default='wer', help='Error rate of the frontier')
+    parser.add_argument('--latency', choices=['latency_p50_ms', 'latency_p95_ms', 'latency_p99_ms',
+                                              'real_time_factor'],
+                        default='latency_p95_ms', help='Latency of the frontier')
+    parser.add_argument('--remove_accents', action='store_true', help='Remove accents from text')
+    parser.add_argument('--remove_punctuation', action='store_true', help='Remove punctuation from text')
+    args = parser.parse_args()
+
+    with open(args.base_config, encoding="utf-8") as file:
+        base_config = json.load(file)
+    with open(args.matrix, encoding="utf-8") as file:
+        matrix = json.load(file)
+
+    results = []
+    for index, settings in enumerate(combinations(matrix)):
+        name = ",".join(f"{key}={os.path.basename(str(value))}" for key, value in settings.items())
+        print(f"[{index + 1}] {name}")
+        metrics = run_settings(args, base_config, settings, os.path.join(args.output_dir, f"run-{index + 1}"))
+        if metrics is None:
+            continue
+        print(f"    WER {metrics['wer']:.3f}, CER {metrics['cer']:.3f}, "
+              f"RTF {metrics['real_time_factor']:.3f}, p95 latency {metrics['latency_p95_ms']:.0f} ms")
+        results.append({"name": name, "run": index + 1, "settings": settings, **metrics})
+    if not results:
+        print("no run succeeded")
+        return 1
+
+    frontier = pareto_frontier(results, args.error, args.latency)
+    with open(os.path.join(args.output_dir, "results.json"), "w", encoding="utf-8") as file:
+        json.dump({"results": results, "pareto_frontier": [r["run"] for r in frontier]}, file, indent=2)
+    metric_keys = ["wer", "cer", "real_time_factor", "latency_p50_ms", "latency_p95_ms", "latency_p99_ms",
+                   "peak_rss_bytes"]
+    with open(os.path.join(args.output_dir, "results.csv"), "w", newline="", encoding="utf-8") as file:
+        writer = csv.writer(file)
+        writer.writerow(["run"] + sorted(matrix) + metric_keys + ["pareto"])
+        for result in results:
+            writer.writerow([result["run"]] + [result["settings"][key] for key in sorted(matrix)] +
+                            [result[key] for key in metric_keys] + [result in frontier])
+
+    print("\nPareto frontier:")
+    for result in frontier:
+        print(f"  {args.error.upper()} {result[args.error]:.3f}, {args.latency} {result[args.latency]:.3f}: "
+              f"{result['name']}")
+    plot(results, frontier, args.error, args.latency, os.path.join(args.output_dir, "pareto.png"))
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
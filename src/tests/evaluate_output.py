@@ -66,14 +66,14 @@ def print_alignment(ref_words, hyp_words):
                 print(f"{ref_token:<10} | {hyp_token:<10} (Substitution)")
                 ref_token = hyp_token = ""
             else:
-                print(f"{"":10} | {hyp_token:<10} (Insertion)")
+                print(f"{'':10} | {hyp_token:<10} (Insertion)")
                 hyp_token = ""
     
     # Print any remaining tokens
     if ref_token:
-        print(f"{ref_token:<10} | {"":10} (Deletion)")
+        print(f"{ref_token:<10} | {'':10} (Deletion)")
     elif hyp_token:
-        print(f"{"":10} | {hyp_token:<10} (Insertion)")
+        print(f"{'':10} | {hyp_token:<10} (Insertion)")
 
 
 def read_text_from_file(file_path, join_sentences=True):
@@ -85,30 +85,41 @@ def read_text_from_file(file_path, join_sentences=True):
         return ' '.join(sentences)
     return sentences
 
-parser = argparse.ArgumentParser(description='Evaluate output')
-parser.add_argument('ref_file_path', type=str, help='Path to the reference file')
-parser.add_argument('hyp_file_path', type=str, help='Path to the hypothesis file')
-parser.add_argument('--remove_accents', action='store_true', help='Remove accents from text')
-parser.add_argument('--remove_punctuation', action='store_true', help='Remove punctuation from text')
-parser.add_argument('--print_alignment', action='store_true', help='Print the alignment to the console')
-parser.add_argument('--write_tokens', action='store_true', help='Write the tokens to a file')
-args = parser.parse_args()
-
-ref_text = read_text_from_file(args.ref_file_path, join_sentences=True)
-hyp_text = read_text_from_file(args.hyp_file_path, join_sentences=True)
-ref_tokens = tokenize(ref_text, should_remove_accents=args.remove_accents, remove_punctuation=args.remove_punctuation)
-hyp_tokens = tokenize(hyp_text, should_remove_accents=args.remove_accents, remove_punctuation=args.remove_punctuation)
-
-if args.print_alignment:
-    print_alignment(ref_tokens, hyp_tokens)
-
-if args.write_tokens:
-    with open("ref_tokens.txt", "w", encoding="utf-8") as file:
-        file.write('\n'.join(ref_tokens))
-    with open("hyp_tokens.txt", "w", encoding="utf-8") as file:
-        file.write('\n'.join(hyp_tokens))
-
-wer = calculate_wer(ref_tokens, hyp_tokens)
-
-print(f"\"{args.ref_file_path}\" WER: \"{wer:.2}\"")
-
+def evaluate(ref_file_path, hyp_file_path, remove_accents=False, remove_punctuation=False):
+    """Return the WER and CER of the hypothesis file against the reference file."""
+    ref_text = read_text_from_file(ref_file_path, join_sentences=True)
+    hyp_text = read_text_from_file(hyp_file_path, join_sentences=True)
+    ref_tokens = tokenize(ref_text, should_remove_accents=remove_accents, remove_punctuation=remove_punctuation)
+    hyp_tokens = tokenize(hyp_text, should_remove_accents=remove_accents, remove_punctuation=remove_punctuation)
+    if not ref_tokens:
+        error = 0.0 if not hyp_tokens else 1.0
+        return error, error
+    return calculate_wer(ref_tokens, hyp_tokens), calculate_cer(ref_tokens, hyp_tokens)
+
+if __name__ == '__main__':
+    parser = argparse.ArgumentParser(description='Evaluate output')
+    parser.add_argument('ref_file_path', type=str, help='Path to the reference file')
+    parser.add_argument('hyp_file_path', type=str, help='Path to the hypothesis file')
+    parser.add_argument('--remove_accents', action='store_true', help='Remove accents from text')
+    parser.add_argument('--remove_punctuation', action='store_true', help='Remove punctuation from text')
+    parser.add_argument('--print_alignment', action='store_true', help='Print the alignment to the console')
+    parser.add_argument('--write_tokens', action='store_true', help='Write the tokens to a file')
+    args = parser.parse_args()
+
+    ref_text = read_text_from_file(args.ref_file_path, join_sentences=True)
+    hyp_text = read_text_from_file(args.hyp_file_path, join_sentences=True)
+    ref_tokens = tokenize(ref_text, should_remove_accents=args.remove_accents, remove_punctuation=args.remove_punctuation)
+    hyp_tokens = tokenize(hyp_text, should_remove_accents=args.remove_accents, remove_punctuation=args.remove_punctuation)
+
+    if args.print_alignment:
+        print_alignment(ref_tokens, hyp_tokens)
+
+    if args.write_tokens:
+        with open("ref_tokens.txt", "w", encoding="utf-8") as file:
+            file.write('\n'.join(ref_tokens))
+        with open("hyp_tokens.txt", "w", encoding="utf-8") as file:
+            file.write('\n'.join(hyp_tokens))
+
+    wer = calculate_wer(ref_tokens, hyp_tokens)
+
+    print(f"\"{args.ref_file_path}\" WER: \"{wer:.2}\"")
@@ -0,0 +1,456 @@
+// Microbenchmarks of the primitives on the audio and caption paths.
+//
+// Each benchmark runs its code on a fixed input, in batches sized to take at least --min-time
+// seconds, and reports the median time per iteration of --repetitions batches. The results can
+// be saved with --output and compared to saved results with --baseline: a benchmark slower than
+// its baseline by more than --threshold (or the "threshold" of its baseline entry) is reported
+// as a regression and makes the tool exit with status 1.
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <regex>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <map>
+#include <memory>
+
+#include <nlohmann/json.hpp>
+
+#include "transcription-filter-data.h"
+#include "transcription-filter-utils.h"
+#include "transcription-utils.h"
+#include "whisper-utils/whisper-utils.h"
+#include "whisper-utils/vad-processing.h"
+#include "whisper-utils/token-buffer-thread.h"
+#include "model-utils/model-downloader-types.h"
+#include "model-utils/sha256.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+
+// the pipeline logs nothing the benchmarks need
+void obs_log(int log_level, const char *format, ...)
+{
+	if (log_level > LOG_WARNING) {
+		return;
+	}
+	va_list args;
+	va_start(args, format);
+	vprintf(format, args);
+	va_end(args);
+	printf("\n");
+}
+
+const std::map<std::string, ModelInfo> &models_info()
+{
+	static const std::map<std::string, ModelInfo> no_models;
+	return no_models;
+}
+
+bool backend_cache_is_warm(const std::string &, int)
+{
+	return true;
+}
+
+void backend_cache_mark_warm(const std::string &, int) {}
+
+std::string backend_cache_file(const std::string &)
+{
+	return "";
+}
+
+// inference on the CPU
+const std::vector<gpu_device_info> &backend_gpu_devices()
+{
+	static const std::vector<gpu_device_info> no_devices;
+	return no_devices;
+}
+
+void set_text_callback(uint64_t, struct transcription_filter_data *, const SharedDetectionResult &)
+{
+}
+
+void audio_chunk_callback(struct transcription_filter_data *, const float *, size_t, int,
+			  const DetectionResultWithText &)
+{
+}
+
+void clear_current_caption(transcription_filter_data *) {}
+
+namespace {
+
+// Fixed inputs, so that the results of two builds are comparable
+namespace corpus {
+
+const char *const ENGLISH =
+	"  So the first thing we want to do, before anything else, is check the levels of the "
+	"microphone... then we'll move on to the scene transitions, the captions, and finally the "
+	"stream settings! Does that sound good to everyone?  ";
+
+const char *const MULTIBYTE = "  다음 영상에서 만나요! 今日はいい天気ですね。 "
+			      "Ça va très bien, merci. Привет, как дела? 你好，世界！  ";
+
+// audio of the stream: a tone with harmonics and a deterministic noise
+std::vector<float> audio(size_t frames, int sample_rate, size_t channel)
+{
+	std::vector<float> samples(frames);
+	uint32_t state = 0x12345678u + (uint32_t)channel;
+	const double pi = 3.14159265358979323846;
+	for (size_t i = 0; i < frames; i++) {
+		state = state * 1664525u + 1013904223u;
+		const double t = (double)i / sample_rate;
+		const double noise = (double)(state >> 8) / (double)(1u << 24) - 0.5;
+		samples[i] = (float)(0.3 * std::sin(2 * pi * 220 * t) +
+				     0.1 * std::sin(2 * pi * 660 * t) + 0.05 * noise);
+	}
+	return samples;
+}
+
+// tokens of two overlapping whisper outputs, the second starting at the middle of the first
+std::vector<whisper_token_data> tokens(size_t count, whisper_token first_id)
+{
+	std::vector<whisper_token_data> sequence(count);
+	for (size_t i = 0; i < count; i++) {
+		sequence[i] = {};
+		sequence[i].id = first_id + (whisper_token)(i * 7 % 1000);
+		sequence[i].p = 0.9f;
+	}
+	return sequence;
+}
+
+} // namespace corpus
+
+// the measured results are added to it so that the code is not optimized away
+volatile uint64_t benchmark_sink = 0;
+
+struct microbenchmark {
+	std::string name;
+	// runs the measured code that many times
+	std::function<void(uint64_t iterations)> run;
+};
+
+struct microbenchmark_result {
+	double ns_per_iteration;
+	uint64_t iterations;
+};
+
+double time_batch(const microbenchmark &benchmark, uint64_t iterations)
+{
+	const auto start = std::chrono::steady_clock::now();
+	benchmark.run(iterations);
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+microbenchmark_result measure(const microbenchmark &benchmark, double min_seconds,
+			      int repetitions)
+{
+	// grow the batch until it takes min_seconds
+	uint64_t iterations = 1;
+	for (;;) {
+		const double seconds = time_batch(benchmark, iterations);
+		if (seconds >= min_seconds || iterations >= (1ull << 32)) {
+			break;
+		}
+		const double scale = seconds > 0 ? 1.4 * min_seconds / seconds : 100.0;
+		iterations = std::max(iterations + 1,
+				      (uint64_t)((double)iterations * std::min(scale, 100.0)));
+	}
+	std::vector<double> ns_per_iteration;
+	for (int i = 0; i < repetitions; i++) {
+		ns_per_iteration.push_back(time_batch(benchmark, iterations) * 1e9 /
+					   (double)iterations);
+	}
+	std::sort(ns_per_iteration.begin(), ns_per_iteration.end());
+	return {ns_per_iteration[ns_per_iteration.size() / 2], iterations};
+}
+
+// A filter context with the input buffer and the resampling of create_context
+transcription_filter_data *create_resample_context(int sample_rate, size_t channels)
+{
+	transcription_filter_data *gf = new transcription_filter_data();
+	gf->log_level = LOG_DEBUG;
+	gf->channels = channels;
+	gf->sample_rate = sample_rate;
+	gf->frames = (size_t)sample_rate * 10;
+	gf->vad_mode = VAD_MODE_ACTIVE;
+	gf->input_buffer.init(gf->channels, (size_t)sample_rate * MAX_MS_INPUT_BUFFER / 1000);
+	deque_init(&gf->resampled_buffer);
+	gf->copy_buffers[0] =
+		static_cast<float *>(calloc(gf->channels * gf->frames, sizeof(float)));
+	for (size_t c = 1; c < gf->channels; c++) {
+		gf->copy_buffers[c] = gf->copy_buffers[0] + c * gf->frames;
+	}
+	struct resample_info src, dst;
+	src.samples_per_sec = sample_rate;
+	src.format = AUDIO_FORMAT_FLOAT_PLANAR;
+	src.speakers = convert_speaker_layout((uint8_t)channels);
+	dst.samples_per_sec = WHISPER_SAMPLE_RATE;
+	dst.format = AUDIO_FORMAT_FLOAT_PLANAR;
+	dst.speakers = convert_speaker_layout((uint8_t)1);
+	gf->resampler_to_whisper = audio_resampler_create(&dst, &src);
+	gf->decimator.init(gf->channels, sample_rate, WHISPER_SAMPLE_RATE, gf->frames);
+	gf->timeline.init(WHISPER_SAMPLE_RATE);
+	return gf;
+}
+
+void release_resample_context(transcription_filter_data *gf)
+{
+	if (gf->resampler_to_whisper) {
+		audio_resampler_destroy(gf->resampler_to_whisper);
+	}
+	free(gf->copy_buffers[0]);
+	gf->input_buffer.release();
+	gf->decimator.release();
+	deque_free(&gf->resampled_buffer);
+	delete gf;
+}
+
+// One OBS audio packet (1024 frames) through get_data_from_buf_and_resample
+microbenchmark resample_benchmark(const std::string &name, int sample_rate, size_t channels)
+{
+	return {name, [sample_rate, channels](uint64_t iterations) {
+			const uint32_t packet_frames = 1024;
+			std::vector<std::vector<float>> audio;
+			const float *data[MAX_PREPROC_CHANNELS];
+			for (size_t c = 0; c < channels; c++) {
+				audio.push_back(corpus::audio(packet_frames, sample_rate, c));
+				data[c] = audio[c].data();
+			}
+			transcription_filter_data *gf =
+				create_resample_context(sample_rate, channels);
+			const uint64_t packet_ns = (uint64_t)packet_frames * 1000000000 /
+						   (uint64_t)sample_rate;
+			for (uint64_t i = 0; i < iterations; i++) {
+				gf->input_buffer.push(data, packet_frames, i * packet_ns);
+				uint64_t start_ns = 0;
+				uint64_t end_ns = 0;
+				get_data_from_buf_and_resample(gf, start_ns, end_ns);
+				benchmark_sink += end_ns;
+				deque_pop_front(&gf->resampled_buffer, nullptr,
+						gf->resampled_buffer.size);
+			}
+			release_resample_context(gf);
+		}};
+}
+
+// One second of 16 kHz audio through the VAD, keeping its state like the pipeline
+microbenchmark vad_benchmark(const std::string &silero_vad_model_file)
+{
+	return {"VadIterator::process/1s", [silero_vad_model_file](uint64_t iterations) {
+			transcription_filter_data *gf = new transcription_filter_data();
+			gf->log_level = LOG_DEBUG;
+			initialize_vad(gf, silero_vad_model_file.c_str());
+			const std::vector<float> audio =
+				corpus::audio(WHISPER_SAMPLE_RATE, WHISPER_SAMPLE_RATE, 0);
+			for (uint64_t i = 0; i < iterations; i++) {
+				gf->vad->process(audio, false);
+				benchmark_sink += gf->vad->get_speech_timestamps().size();
+			}
+			delete gf;
+		}};
+}
+
+// A caption sentence added to the token buffer, in each segmentation mode
+microbenchmark token_buffer_benchmark(const std::string &name,
+				      TokenBufferSegmentation segmentation)
+{
+	return {name, [segmentation](uint64_t iterations) {
+			transcription_filter_data *gf = new transcription_filter_data();
+			gf->log_level = LOG_DEBUG;
+			{
+				TokenBufferThread buffer;
+				buffer.initialize(
+					gf, [](const std::string &caption) {
+						benchmark_sink += caption.size();
+					},
+					2, 30, std::chrono::seconds(10), segmentation);
+				const std::string sentence = corpus::ENGLISH;
+				const auto now = std::chrono::steady_clock::now();
+				for (uint64_t i = 0; i < iterations; i++) {
+					buffer.addSentenceFromStdString(sentence, now, now);
+					buffer.clear();
+				}
+			}
+			delete gf;
+		}};
+}
+
+template<typename F> microbenchmark string_benchmark(const std::string &name, const char *text, F f)
+{
+	return {name, [text, f](uint64_t iterations) {
+			const std::string input = text;
+			for (uint64_t i = 0; i < iterations; i++) {
+				benchmark_sink += f(input).size();
+			}
+		}};
+}
+
+microbenchmark reconstruct_benchmark(const std::string &name, size_t overlap)
+{
+	return {name, [overlap](uint64_t iterations) {
+			const std::vector<whisper_token_data> first = corpus::tokens(64, 100);
+			std::vector<whisper_token_data> second(first.end() - overlap, first.end());
+			const std::vector<whisper_token_data> tail = corpus::tokens(64, 2000);
+			second.insert(second.end(), tail.begin(), tail.end());
+			for (uint64_t i = 0; i < iterations; i++) {
+				benchmark_sink += reconstructSentence(first, second).size();
+			}
+		}};
+}
+
+microbenchmark sha256_benchmark()
+{
+	return {"SHA256/1MiB", [](uint64_t iterations) {
+			std::vector<unsigned char> data(1 << 20);
+			for (size_t i = 0; i < data.size(); i++) {
+				data[i] = (unsigned char)(i * 31 + (i >> 8));
+			}
+			for (uint64_t i = 0; i < iterations; i++) {
+				SHA256 sha256;
+				benchmark_sink += sha256(data.data(), data.size()).size();
+			}
+		}};
+}
+
+std::vector<microbenchmark> all_benchmarks(const std::string &silero_vad_model_file)
+{
+	std::vector<microbenchmark> benchmarks = {
+		resample_benchmark("get_data_from_buf_and_resample/48000Hz_stereo", 48000, 2),
+		resample_benchmark("get_data_from_buf_and_resample/44100Hz_stereo", 44100, 2),
+		token_buffer_benchmark("TokenBufferThread::addSentenceFromStdString/token",
+				       SEGMENTATION_TOKEN),
+		token_buffer_benchmark("TokenBufferThread::addSentenceFromStdString/word",
+				       SEGMENTATION_WORD),
+		token_buffer_benchmark("TokenBufferThread::addSentenceFromStdString/sentence",
+				       SEGMENTATION_SENTENCE),
+		string_benchmark("fix_utf8/english", corpus::ENGLISH,
+				 [](const std::string &s) { return fix_utf8(s); }),
+		string_benchmark("fix_utf8/multibyte", corpus::MULTIBYTE,
+				 [](const std::string &s) { return fix_utf8(s); }),
+		string_benchmark(
+			"remove_leading_trailing_nonalpha/english", corpus::ENGLISH,
+			[](const std::string &s) { return remove_leading_trailing_nonalpha(s); }),
+		string_benchmark(
+			"remove_leading_trailing_nonalpha/multibyte", corpus::MULTIBYTE,
+			[](const std::string &s) { return remove_leading_trailing_nonalpha(s); }),
+		string_benchmark("split_words/english", corpus::ENGLISH,
+				 [](const std::string &s) { return split_words(s); }),
+		string_benchmark("split_words/multibyte", corpus::MULTIBYTE,
+				 [](const std::string &s) { return split_words(s); }),
+		reconstruct_benchmark("reconstructSentence/overlap", 16),
+		reconstruct_benchmark("reconstructSentence/no_overlap", 0),
+		sha256_benchmark(),
+	};
+	// the VAD needs its model
+	if (!silero_vad_model_file.empty()) {
+		benchmarks.push_back(vad_benchmark(silero_vad_model_file));
+	}
+	return benchmarks;
+}
+
+void print_usage()
+{
+	std::cout << "Usage: localvocal-microbench [--filter <regex>] [--min-time <seconds>]"
+		     " [--repetitions <n>] [--silero-vad <silero_vad.onnx>]"
+		     " [--output <results.json>] [--baseline <results.json>]"
+		     " [--threshold <fraction>]"
+		  << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char *argv[])
+{
+	std::string filter = ".*";
+	double min_seconds = 0.2;
+	int repetitions = 5;
+	std::string silero_vad_model_file;
+	std::string output_file_path;
+	std::string baseline_file_path;
+	double threshold = 0.10;
+	for (int i = 1; i < argc; i++) {
+		const std::string arg = argv[i];
+		if (i + 1 >= argc) {
+			print_usage();
+			return 1;
+		}
+		const std::string value = argv[++i];
+		if (arg == "--filter") {
+			filter = value;
+		} else if (arg == "--min-time") {
+			min_seconds = std::stod(value);
+		} else if (arg == "--repetitions") {
+			repetitions = std::max(std::stoi(value), 1);
+		} else if (arg == "--silero-vad") {
+			silero_vad_model_file = value;
+		} else if (arg == "--output") {
+			output_file_path = value;
+		} else if (arg == "--baseline") {
+			baseline_file_path = value;
+		} else if (arg == "--threshold") {
+			threshold = std::stod(value);
+		} else {
+			print_usage();
+			return 1;
+		}
+	}
+
+	nlohmann::json baseline = nlohmann::json::object();
+	if (!baseline_file_path.empty()) {
+		std::ifstream baseline_file(baseline_file_path);
+		if (!baseline_file.is_open()) {
+			std::cout << "Failed to open the baseline " << baseline_file_path
+				  << std::endl;
+			return 1;
+		}
+		baseline = nlohmann::json::parse(baseline_file).value("benchmarks", baseline);
+	}
+
+	const std::regex filter_regex(filter);
+	nlohmann::json results = nlohmann::json::object();
+	int regressions = 0;
+	printf("%-56s %14s %12s %14s %9s\n", "benchmark", "ns/iteration", "iterations",
+	       "baseline", "change");
+	for (const microbenchmark &benchmark : all_benchmarks(silero_vad_model_file)) {
+		if (!std::regex_search(benchmark.name, filter_regex)) {
+			continue;
+		}
+		const microbenchmark_result result = measure(benchmark, min_seconds, repetitions);
+		results[benchmark.name] = {{"ns_per_iteration", result.ns_per_iteration},
+					   {"iterations", result.iterations}};
+		if (!baseline.contains(benchmark.name)) {
+			printf("%-56s %14.1f %12llu\n", benchmark.name.c_str(),
+			       result.ns_per_iteration, (unsigned long long)result.iterations);
+			continue;
+		}
+		const nlohmann::json &entry = baseline[benchmark.name];
+		const double baseline_ns = entry.value("ns_per_iteration", 0.0);
+		const double change = baseline_ns > 0 ? result.ns_per_iteration / baseline_ns - 1
+						      : 0.0;
+		const bool regression = change > entry.value("threshold", threshold);
+		regressions += regression ? 1 : 0;
+		printf("%-56s %14.1f %12llu %14.1f %+8.1f%%%s\n", benchmark.name.c_str(),
+		       result.ns_per_iteration, (unsigned long long)result.iterations, baseline_ns,
+		       change * 100, regression ? " REGRESSION" : "");
+	}
+
+	if (!output_file_path.empty()) {
+		std::ofstream output_file(output_file_path);
+		if (!output_file.is_open()) {
+			std::cout << "Failed to write the results to " << output_file_path
+				  << std::endl;
+			return 1;
+		}
+		output_file << nlohmann::json({{"benchmarks", results}}).dump(2) << std::endl;
+	}
+	if (regressions > 0) {
+		printf("%d benchmarks regressed by more than the threshold\n", regressions);
+		return 1;
+	}
+	return 0;
+}
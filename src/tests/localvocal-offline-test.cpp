@@ -9,6 +9,15 @@
 #include <iomanip>
 #include <regex>
 #include <algorithm>
+#include <cmath>
+#include <map>
+#include <memory>
+#include <functional>
+#include <filesystem>
+#include <deque>
+#include <set>
+#include <condition_variable>
+#include <atomic>
 
 #include <nlohmann/json.hpp>
 
@@ -18,11 +27,14 @@
 #include "transcription-utils.h"
 #include "whisper-utils/whisper-utils.h"
 #include "whisper-utils/vad-processing.h"
+#include "whisper-utils/silero-vad-onnx.h"
 #include "audio-file-utils.h"
 #include "translation/language_codes.h"
 #include "ui/filter-replace-utils.h"
 #include "model-utils/model-downloader-types.h"
 
+#include <ggml-backend.h>
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
@@ -30,6 +42,9 @@
 
 #ifdef _WIN32
 #include <Windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
 #endif
 
 void obs_log(int log_level, const char *format, ...)
@@ -93,10 +108,44 @@ const std::map<std::string, ModelInfo> &models_info()
 	return *cached_models_info;
 }
 
+// the offline test does not set up the backend cache, models are warmed up by the setting only
+bool backend_cache_is_warm(const std::string &, int)
+{
+	return true;
+}
+
+void backend_cache_mark_warm(const std::string &, int) {}
+
+std::string backend_cache_file(const std::string &)
+{
+	return "";
+}
+
+// the devices of the backends linked in, the test does not load the dynamic backends of the plugin
+const std::vector<gpu_device_info> &backend_gpu_devices()
+{
+	static const std::vector<gpu_device_info> devices = [] {
+		std::vector<gpu_device_info> gpu_devices;
+		for (size_t i = 0; i < ggml_backend_dev_count(); i++) {
+			ggml_backend_dev_t dev = ggml_backend_dev_get(i);
+			const enum ggml_backend_dev_type type = ggml_backend_dev_type(dev);
+			if (type == GGML_BACKEND_DEVICE_TYPE_GPU ||
+			    type == GGML_BACKEND_DEVICE_TYPE_IGPU) {
+				gpu_devices.push_back({i, ggml_backend_dev_name(dev),
+						       ggml_backend_dev_description(dev),
+						       type == GGML_BACKEND_DEVICE_TYPE_IGPU});
+			}
+		}
+		return gpu_devices;
+	}();
+	return devices;
+}
+
 transcription_filter_data *
 create_context(int sample_rate, int channels, const std::string &whisper_model_path,
 	       const std::string &silero_vad_model_file, const std::string &ct2ModelFolder,
-	       const whisper_sampling_strategy whisper_sampling_method = WHISPER_SAMPLING_GREEDY)
+	       const whisper_sampling_strategy whisper_sampling_method = WHISPER_SAMPLING_GREEDY,
+	       int gpu_device = -1)
 {
 	struct transcription_filter_data *gf = new transcription_filter_data();
 
@@ -114,13 +163,14 @@ create_context(int sample_rate, int channels, const std::string &whisper_model_p
 	gf->process_while_muted = false;
 	gf->buffered_output = false;
 	gf->fix_utf8 = true;
+	// -1 for the CPU, an index of backend_gpu_devices()
+	gf->gpu_device = gpu_device;
 	gf->input_cv.emplace();
 
-	for (size_t i = 0; i < gf->channels; i++) {
-		deque_init(&gf->input_buffers[i]);
-	}
-	deque_init(&gf->info_buffer);
-	deque_init(&gf->whisper_buffer);
+	gf->input_buffer.init(gf->channels,
+			      (size_t)((float)gf->sample_rate / (1000.0f / MAX_MS_INPUT_BUFFER)));
+	gf->whisper_buffer.init(MAX_MS_WORK_BUFFER * WHISPER_SAMPLE_RATE / 1000,
+				SEGMENT_PADDING_SAMPLES);
 	deque_init(&gf->resampled_buffer);
 
 	// allocate copy buffers
@@ -146,6 +196,11 @@ create_context(int sample_rate, int channels, const std::string &whisper_model_p
 	dst.speakers = convert_speaker_layout((uint8_t)1);
 
 	gf->resampler_to_whisper = audio_resampler_create(&dst, &src);
+	if (gf->decimator.init(gf->channels, (int)gf->sample_rate, WHISPER_SAMPLE_RATE,
+			       gf->frames)) {
+		obs_log(gf->log_level, "using the fused downmix and decimation to 16 kHz");
+	}
+	gf->timeline.init(WHISPER_SAMPLE_RATE);
 
 	gf->whisper_model_file_currently_loaded = "";
 	gf->output_file_path = std::string("output.txt");
@@ -207,6 +262,104 @@ create_context(int sample_rate, int channels, const std::string &whisper_model_p
 	return gf;
 }
 
+// the audio is fed in windows of that duration
+const std::chrono::milliseconds window_size_in_ms(25);
+
+// Measurements of one benchmark run or load test stream, see the benchmark_runs and
+// load_test_streams settings
+struct benchmark_run {
+	stage_timings timings;
+	// guards the feed times and the latencies
+	std::mutex mutex;
+	// timestamp of the first fed sample, in the timestamp domain of the segments (ms)
+	uint64_t stream_start_ms = 0;
+	// when each window of audio was fed
+	std::vector<std::chrono::steady_clock::time_point> window_feed_times;
+	// from the feeding of the end of a segment to its text
+	std::vector<double> segment_latencies_ms;
+	// windows fed more than a window late with the real-time pacing
+	uint64_t late_windows = 0;
+};
+
+// guards the measured contexts
+std::mutex benchmarks_mutex;
+std::map<transcription_filter_data *, benchmark_run *> benchmarks;
+
+benchmark_run *find_benchmark(transcription_filter_data *gf)
+{
+	std::lock_guard<std::mutex> lock(benchmarks_mutex);
+	auto it = benchmarks.find(gf);
+	return it != benchmarks.end() ? it->second : nullptr;
+}
+
+void set_benchmark(transcription_filter_data *gf, benchmark_run *measurements)
+{
+	std::lock_guard<std::mutex> lock(benchmarks_mutex);
+	if (measurements != nullptr) {
+		benchmarks[gf] = measurements;
+		gf->pipeline_timings = &measurements->timings;
+	} else {
+		benchmarks.erase(gf);
+		gf->pipeline_timings = nullptr;
+	}
+}
+
+struct batch_subtitle {
+	// from the start of the recording
+	uint64_t start_ms;
+	uint64_t end_ms;
+	std::string text;
+};
+
+// The subtitles of a piece of a recording of the batch, see run_batch
+struct batch_piece_output {
+	// stream_start_ms of the piece, run.mutex guards the subtitles
+	benchmark_run run;
+	// start of the piece in the recording
+	uint64_t offset_ms = 0;
+	std::vector<batch_subtitle> subtitles;
+};
+
+// guards the contexts transcribing a batch piece
+std::mutex batch_pieces_mutex;
+std::map<transcription_filter_data *, batch_piece_output *> batch_pieces;
+
+batch_piece_output *find_batch_piece(transcription_filter_data *gf)
+{
+	std::lock_guard<std::mutex> lock(batch_pieces_mutex);
+	auto it = batch_pieces.find(gf);
+	return it != batch_pieces.end() ? it->second : nullptr;
+}
+
+void set_batch_piece(transcription_filter_data *gf, batch_piece_output *output)
+{
+	std::lock_guard<std::mutex> lock(batch_pieces_mutex);
+	if (output != nullptr) {
+		batch_pieces[gf] = output;
+	} else {
+		batch_pieces.erase(gf);
+	}
+}
+
+void add_batch_subtitle(batch_piece_output &output, const DetectionResultWithText &result,
+			const std::string &text)
+{
+	if (text.empty()) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(output.run.mutex);
+	const uint64_t stream_start_ms = output.run.stream_start_ms;
+	const uint64_t start_ms = result.start_timestamp_ms > stream_start_ms
+					  ? result.start_timestamp_ms - stream_start_ms
+					  : 0;
+	const uint64_t end_ms =
+		result.end_timestamp_ms > stream_start_ms + start_ms
+			? result.end_timestamp_ms - stream_start_ms
+			: start_ms;
+	output.subtitles.push_back(
+		{output.offset_ms + start_ms, output.offset_ms + end_ms, text});
+}
+
 std::mutex json_segments_input_mutex;
 std::condition_variable json_segments_input_cv;
 std::vector<nlohmann::json> json_segments_input;
@@ -299,16 +452,40 @@ void clear_current_caption(transcription_filter_data *gf_)
 	gf_->last_text_cloud_translation = "";
 	gf_->translation_ctx.last_input_tokens.clear();
 	gf_->translation_ctx.last_translation_tokens.clear();
-	gf_->last_transcription_sentence.clear();
+	gf_->context_prompt.clear();
 	gf_->cleared_last_sub = true;
 }
 
-void set_text_callback(struct transcription_filter_data *gf,
-		       const DetectionResultWithText &resultIn)
+// Record the latency of a segment, from the feeding of its last window
+void record_segment_latency(benchmark_run &measurements, const DetectionResultWithText &result)
+{
+	const auto now = std::chrono::steady_clock::now();
+	std::lock_guard<std::mutex> lock(measurements.mutex);
+	if (result.end_timestamp_ms < measurements.stream_start_ms ||
+	    measurements.window_feed_times.empty()) {
+		return;
+	}
+	const size_t window =
+		std::min((size_t)((result.end_timestamp_ms - measurements.stream_start_ms) /
+				  window_size_in_ms.count()),
+			 measurements.window_feed_times.size() - 1);
+	measurements.segment_latencies_ms.push_back(
+		std::chrono::duration<double, std::milli>(now -
+							  measurements.window_feed_times[window])
+			.count());
+}
+
+void set_text_callback(uint64_t possible_end_ts, struct transcription_filter_data *gf,
+		       const SharedDetectionResult &shared_result)
 {
-	DetectionResultWithText result = resultIn;
+	UNUSED_PARAMETER(possible_end_ts);
+	const DetectionResultWithText &result = *shared_result;
 
 	if (!result.text.empty() && result.result == DETECTION_RESULT_SPEECH) {
+		benchmark_run *measurements = find_benchmark(gf);
+		if (measurements != nullptr) {
+			record_segment_latency(*measurements, result);
+		}
 		std::string str_copy = result.text;
 		if (gf->fix_utf8) {
 			str_copy = fix_utf8(str_copy);
@@ -316,15 +493,10 @@ void set_text_callback(struct transcription_filter_data *gf,
 		str_copy = remove_leading_trailing_nonalpha(str_copy);
 
 		// if suppression is enabled, check if the text is in the suppression list
-		if (!gf->filter_words_replace.empty()) {
+		if (gf->filter_words_compiled && !gf->filter_words_compiled->empty()) {
 			const std::string original_str_copy = str_copy;
-			// check if the text is in the suppression list
-			for (const auto &filter : gf->filter_words_replace) {
-				// if filter exists within str_copy, remove it (replace with "")
-				str_copy = std::regex_replace(str_copy,
-							      std::regex(std::get<0>(filter)),
-							      std::get<1>(filter));
-			}
+			// replace the matches of all filters in one pass
+			str_copy = gf->filter_words_compiled->apply(str_copy);
 			if (original_str_copy != str_copy) {
 				obs_log(LOG_INFO, "Suppression: '%s' -> '%s'",
 					original_str_copy.c_str(), str_copy.c_str());
@@ -332,6 +504,7 @@ void set_text_callback(struct transcription_filter_data *gf,
 		}
 
 		if (gf->translate) {
+			StageTimer timer(gf->pipeline_timings, PIPELINE_STAGE_TRANSLATION);
 			obs_log(gf->log_level, "Translating text to %s", gf->target_lang.c_str());
 			std::string translated_text;
 			if (translate(gf->translation_ctx, str_copy,
@@ -349,6 +522,13 @@ void set_text_callback(struct transcription_filter_data *gf,
 			}
 		}
 
+		batch_piece_output *batch_output = find_batch_piece(gf);
+		if (batch_output != nullptr) {
+			add_batch_subtitle(*batch_output, result, str_copy);
+			return;
+		}
+
+		StageTimer timer(gf->pipeline_timings, PIPELINE_STAGE_OUTPUT);
 		std::ofstream output_file(gf->output_file_path, std::ios::app);
 		output_file << str_copy << std::endl;
 		output_file.close();
@@ -364,19 +544,883 @@ void release_context(transcription_filter_data *gf)
 		audio_resampler_destroy(gf->resampler_to_whisper);
 	}
 
+	free(gf->copy_buffers[0]);
+	gf->copy_buffers[0] = nullptr;
+	gf->input_buffer.release();
+	gf->whisper_buffer.release();
+	gf->decimator.release();
+	deque_free(&gf->resampled_buffer);
+
+	delete gf;
+}
+
+transcription_filter_data *create_configured_context(int sample_rate, int channels,
+						      const nlohmann::json &config,
+						      int gpu_device = -1)
+{
+	const std::string whisperModelPathStr = config["whisper_model_path"];
+	const std::string sileroVadModelFileStr = config["silero_vad_model_file"];
+	const std::string sourceLanguageStr = config["source_language"];
+	const std::string targetLanguageStr = config["target_language"];
+	const std::string ct2ModelFolderStr = config["ct2_model_folder"];
+	const std::string logLevelStr = config["log_level"];
+	const whisper_sampling_strategy whisper_sampling_method = config["whisper_sampling_method"];
+	// the language parameter of whisper points to it
+	static std::string whisperLanguageStr;
+	whisperLanguageStr = config["whisper_language"];
+
+	transcription_filter_data *gf =
+		create_context(sample_rate, channels, whisperModelPathStr, sileroVadModelFileStr,
+			       ct2ModelFolderStr, whisper_sampling_method, gpu_device);
+	if (sourceLanguageStr.empty() || targetLanguageStr.empty() || sourceLanguageStr == "none" ||
+	    targetLanguageStr == "none") {
+		obs_log(LOG_INFO, "Source or target translation language are empty or disabled");
+	} else {
+		obs_log(LOG_INFO, "Setting translation languages");
+		gf->target_lang = targetLanguageStr;
+		build_and_enable_translation(gf, ct2ModelFolderStr.c_str());
+	}
+	gf->whisper_params.language = whisperLanguageStr.c_str();
+	if (config.contains("fix_utf8")) {
+		obs_log(LOG_INFO, "Setting fix_utf8 to %s", config["fix_utf8"] ? "true" : "false");
+		gf->fix_utf8 = config["fix_utf8"];
+	}
+	if (config.contains("enable_audio_chunks_callback")) {
+		obs_log(LOG_INFO, "Setting enable_audio_chunks_callback to %s",
+			config["enable_audio_chunks_callback"] ? "true" : "false");
+		gf->enable_audio_chunks_callback = config["enable_audio_chunks_callback"];
+	}
+	if (config.contains("temperature")) {
+		obs_log(LOG_INFO, "Setting temperture to %f", config["temperature"].get<float>());
+		gf->whisper_params.temperature = config["temperature"].get<float>();
+	}
+	if (config.contains("no_context")) {
+		obs_log(LOG_INFO, "Setting no_context to %s",
+			config["no_context"] ? "true" : "false");
+		gf->whisper_params.no_context = config["no_context"];
+	}
+	if (config.contains("vad_mode")) {
+		// VAD_MODE_ACTIVE, VAD_MODE_HYBRID or VAD_MODE_DISABLED
+		obs_log(LOG_INFO, "Setting vad_mode to %d", config["vad_mode"].get<int>());
+		gf->vad_mode = config["vad_mode"].get<int>();
+	}
+	if (config.contains("input_channel")) {
+		// -1 mixes the channels
+		obs_log(LOG_INFO, "Setting input_channel to %d", config["input_channel"].get<int>());
+		gf->input_channel = config["input_channel"].get<int>();
+	}
+	if (config.contains("vad_pre_gate")) {
+		obs_log(LOG_INFO, "Setting vad_pre_gate to %s",
+			config["vad_pre_gate"] ? "true" : "false");
+		gf->vad_pre_gate = config["vad_pre_gate"].get<bool>();
+		if (gf->vad) {
+			gf->vad->set_pre_gate(gf->vad_pre_gate);
+		}
+	}
+	if (config.contains("segment_duration")) {
+		obs_log(LOG_INFO, "Setting segment_duration to %d",
+			config["segment_duration"].get<int>());
+		gf->segment_duration = config["segment_duration"].get<int>();
+	}
+	if (config.contains("segment_overlap_ms")) {
+		obs_log(LOG_INFO, "Setting segment_overlap_ms to %d",
+			config["segment_overlap_ms"].get<int>());
+		gf->segment_overlap_ms = config["segment_overlap_ms"].get<int>();
+	}
+	if (config.contains("partial_transcription")) {
+		obs_log(LOG_INFO, "Setting partial_transcription to %s",
+			config["partial_transcription"] ? "true" : "false");
+		gf->partial_transcription = config["partial_transcription"];
+	}
+	if (config.contains("partial_latency")) {
+		obs_log(LOG_INFO, "Setting partial_latency to %d",
+			config["partial_latency"].get<int>());
+		gf->partial_latency = config["partial_latency"].get<int>();
+	}
+	if (config.contains("n_context_tokens")) {
+		obs_log(LOG_INFO, "Setting n_context_tokens to %d",
+			config["n_context_tokens"].get<int>());
+		gf->context_prompt.set_max_tokens(config["n_context_tokens"].get<int>());
+	}
+	if (config.contains("sticky_language")) {
+		obs_log(LOG_INFO, "Setting sticky_language to %s",
+			config["sticky_language"] ? "true" : "false");
+		gf->sticky_language.configure(config["sticky_language"],
+					      config.value("sticky_language_detections", 3),
+					      config.value("sticky_language_recheck", 20));
+	}
+	if (config.contains("whisper_n_threads")) {
+		obs_log(LOG_INFO, "Setting whisper_n_threads to %d",
+			config["whisper_n_threads"].get<int>());
+		gf->whisper_params.n_threads = config["whisper_n_threads"].get<int>();
+	}
+	if (config.contains("filter_words_replace")) {
+		obs_log(LOG_INFO, "Setting filter_words_replace to %s",
+			config["filter_words_replace"].dump().c_str());
+		gf->filter_words_replace =
+			deserialize_filter_words_replace(config["filter_words_replace"]);
+		gf->filter_words_compiled =
+			std::make_shared<const WordFilter>(gf->filter_words_replace);
+	}
+	// set log level
+	if (logLevelStr == "debug") {
+		gf->log_level = LOG_DEBUG;
+	} else if (logLevelStr == "info") {
+		gf->log_level = LOG_INFO;
+	} else if (logLevelStr == "warning") {
+		gf->log_level = LOG_WARNING;
+	} else if (logLevelStr == "error") {
+		gf->log_level = LOG_ERROR;
+	}
+	return gf;
+}
+
+// The audio fed by process_audio: points channel_data to the next frames of each channel and
+// returns their number, less than asked at the end of the audio only
+typedef std::function<size_t(size_t frames, const float **channel_data)> audio_window_source;
+
+// The audio decoded in memory by read_audio_file
+audio_window_source memory_audio_source(const std::vector<std::vector<uint8_t>> &audio)
+{
+	size_t frames_count = 0;
+	return [&audio, frames_count](size_t frames, const float **channel_data) mutable {
+		const size_t total_frames = audio[0].size() / sizeof(float);
+		frames = std::min(frames, total_frames - frames_count);
+		for (size_t c = 0; c < audio.size(); c++) {
+			channel_data[c] = (const float *)audio[c].data() + frames_count;
+		}
+		frames_count += frames;
+		return frames;
+	};
+}
+
+// Feed the audio and wait until it is transcribed. The audio is fed as fast as the pipeline takes
+// it, or at the pace of a live source with real_time, dropping what does not fit like in OBS.
+// Returns the number of frames fed.
+size_t process_audio(transcription_filter_data *gf, const audio_window_source &next_window,
+		     benchmark_run *measurements, bool real_time)
+{
+	gf->start_timestamp_ms = now_ms();
+
+	obs_log(LOG_INFO, "Sending samples to whisper buffer");
+	// 25 ms worth of frames
+	const size_t window_frames = gf->sample_rate * window_size_in_ms.count() / 1000;
+	size_t frames_count = 0;
+	int64_t start_time = std::chrono::duration_cast<std::chrono::nanoseconds>(
+				     std::chrono::system_clock::now().time_since_epoch())
+				     .count();
+	if (measurements != nullptr) {
+		std::lock_guard<std::mutex> lock(measurements->mutex);
+		measurements->stream_start_ms = (uint64_t)(start_time / 1000000);
+	}
+	const auto feed_start = std::chrono::steady_clock::now();
+	uint64_t window_number = 0;
+	while (true) {
+		const float *channel_data[MAX_PREPROC_CHANNELS];
+		const size_t frames = next_window(window_frames, channel_data);
+		if (frames == 0) {
+			break;
+		}
+		if (real_time) {
+			const auto due = feed_start + window_number * window_size_in_ms;
+			if (std::chrono::steady_clock::now() > due + window_size_in_ms &&
+			    measurements != nullptr) {
+				std::lock_guard<std::mutex> lock(measurements->mutex);
+				measurements->late_windows++;
+			}
+			std::this_thread::sleep_until(due);
+		}
+		{
+			std::unique_lock<std::mutex> lock(gf->whisper_buf_mutex);
+			// wait for whisper to take the previous window, so the buffer builds up
+			// similar to OBS
+			while (!real_time && gf->input_buffer.frames_available() != 0) {
+				gf->input_cv->wait_for(lock, std::chrono::milliseconds(1), [&] {
+					return gf->input_buffer.frames_available() == 0;
+				});
+			}
+			// push current audio data and packet info to the input ring
+			// make a timestamp from the current position in the audio buffer
+			gf->input_buffer.push(channel_data, (uint32_t)frames,
+					      start_time + (int64_t)(((float)frames_count /
+								      (float)gf->sample_rate) *
+								     1e9));
+		}
+		if (measurements != nullptr) {
+			std::lock_guard<std::mutex> lock(measurements->mutex);
+			measurements->window_feed_times.push_back(std::chrono::steady_clock::now());
+		}
+		notify_new_audio(gf, (uint32_t)frames);
+		frames_count += frames;
+		window_number++;
+		if (frames < window_frames) {
+			break;
+		}
+	}
+	const size_t audio_frames = frames_count;
+	// push two seconds of silence to the input deque
+	const size_t frames = 2 * gf->sample_rate;
+	std::vector<float> silence(frames);
+	const float *silence_data[MAX_PREPROC_CHANNELS];
+	for (size_t c = 0; c < gf->channels; c++) {
+		silence_data[c] = silence.data();
+	}
 	{
-		std::lock_guard<std::mutex> lockbuf(gf->whisper_buf_mutex);
-		free(gf->copy_buffers[0]);
-		gf->copy_buffers[0] = nullptr;
-		for (size_t i = 0; i < gf->channels; i++) {
-			deque_free(&gf->input_buffers[i]);
+		std::lock_guard<std::mutex> lock(gf->whisper_buf_mutex);
+		// make a timestamp from the current frame count
+		gf->input_buffer.push(silence_data, (uint32_t)frames,
+				      start_time + (int64_t)((double)frames_count * 1e9 /
+							     (double)gf->sample_rate));
+	}
+	notify_new_audio(gf, (uint32_t)frames);
+
+	obs_log(LOG_INFO, "Buffer filled with %d frames",
+		(int)gf->input_buffer.frames_available());
+
+	// wait for processing to finish
+	obs_log(LOG_INFO, "Waiting for processing to finish");
+	while (true) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+		// check the input deque has more data
+		const size_t input_buf_size = gf->input_buffer.frames_available();
+
+		// if less than 500ms of audio left in the input buffer, break
+		if (input_buf_size < gf->sample_rate / 2) {
+			break;
 		}
 	}
-	deque_free(&gf->info_buffer);
-	deque_free(&gf->whisper_buffer);
-	deque_free(&gf->resampled_buffer);
+	// wait for the segments already cut to be transcribed
+	{
+		std::unique_lock<std::mutex> lock(gf->inference_queue_mutex);
+		gf->inference_queue_cv.wait(lock, [gf]() {
+			return (gf->inference_queue.empty() && !gf->inference_busy) ||
+			       gf->inference_stop;
+		});
+	}
+	return audio_frames;
+}
 
-	delete gf;
+// Peak resident memory of the process so far, in bytes
+uint64_t peak_rss_bytes()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return (uint64_t)counters.PeakWorkingSetSize;
+	}
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0;
+	}
+#ifdef __APPLE__
+	return (uint64_t)usage.ru_maxrss;
+#else
+	// in kilobytes on Linux
+	return (uint64_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+// CPU time of the process so far, user and system, in seconds
+double process_cpu_seconds()
+{
+#ifdef _WIN32
+	FILETIME creation_time, exit_time, kernel_time, user_time;
+	if (!GetProcessTimes(GetCurrentProcess(), &creation_time, &exit_time, &kernel_time,
+			     &user_time)) {
+		return 0.0;
+	}
+	// in 100 ns units
+	const auto seconds = [](const FILETIME &time) {
+		return (double)(((uint64_t)time.dwHighDateTime << 32) | time.dwLowDateTime) / 1e7;
+	};
+	return seconds(kernel_time) + seconds(user_time);
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0.0;
+	}
+	return (double)usage.ru_utime.tv_sec + (double)usage.ru_utime.tv_usec / 1e6 +
+	       (double)usage.ru_stime.tv_sec + (double)usage.ru_stime.tv_usec / 1e6;
+#endif
+}
+
+// Nearest-rank percentile of sorted values
+double percentile(const std::vector<double> &sorted, double p)
+{
+	if (sorted.empty()) {
+		return 0.0;
+	}
+	const size_t rank = (size_t)std::ceil(p / 100.0 * (double)sorted.size());
+	return sorted[std::min(std::max(rank, (size_t)1), sorted.size()) - 1];
+}
+
+nlohmann::json benchmark_run_to_json(benchmark_run &run, double wall_seconds,
+				     double audio_seconds)
+{
+	static const char *stage_names[PIPELINE_STAGE_COUNT] = {"resample", "vad", "whisper_full",
+								"translation", "output"};
+	nlohmann::json stages = nlohmann::json::object();
+	for (int stage = 0; stage < PIPELINE_STAGE_COUNT; stage++) {
+		const uint64_t total_ns = run.timings.total_ns[stage].load();
+		const uint64_t count = run.timings.count[stage].load();
+		stages[stage_names[stage]] = {
+			{"total_ms", (double)total_ns / 1e6},
+			{"count", count},
+			{"mean_ms", count > 0 ? (double)total_ns / 1e6 / (double)count : 0.0}};
+	}
+	std::lock_guard<std::mutex> lock(run.mutex);
+	std::vector<double> latencies = run.segment_latencies_ms;
+	std::sort(latencies.begin(), latencies.end());
+	return {{"wall_seconds", wall_seconds},
+		{"real_time_factor", audio_seconds > 0 ? wall_seconds / audio_seconds : 0.0},
+		{"stages", stages},
+		{"segments", latencies.size()},
+		{"segment_latency_ms",
+		 {{"p50", percentile(latencies, 50)},
+		  {"p95", percentile(latencies, 95)},
+		  {"p99", percentile(latencies, 99)}}},
+		{"peak_rss_bytes", peak_rss_bytes()}};
+}
+
+struct load_test_input {
+	std::string path;
+	int sample_rate = 0;
+	int channels = 0;
+	std::vector<std::vector<uint8_t>> audio;
+};
+
+// Caption the inputs with that many streams at once, each a context fed at the live pace from
+// its own thread like the audio of an OBS source
+nlohmann::json run_load_test_step(const nlohmann::json &config,
+				  const std::vector<load_test_input> &inputs, int streams)
+{
+	obs_log(LOG_INFO, "Load test with %d streams", streams);
+	std::vector<transcription_filter_data *> contexts;
+	std::vector<std::unique_ptr<benchmark_run>> measurements;
+	for (int i = 0; i < streams; i++) {
+		const load_test_input &input = inputs[i % inputs.size()];
+		transcription_filter_data *gf =
+			create_configured_context(input.sample_rate, input.channels, config);
+		gf->output_file_path = "output-" + std::to_string(i + 1) + ".txt";
+		std::ofstream output_file(gf->output_file_path, std::ios::trunc);
+		output_file.close();
+		measurements.push_back(std::make_unique<benchmark_run>());
+		set_benchmark(gf, measurements.back().get());
+		contexts.push_back(gf);
+	}
+
+	// the models are loaded when the contexts are created, they are not measured
+	const double cpu_start = process_cpu_seconds();
+	const auto start = std::chrono::steady_clock::now();
+	std::vector<std::thread> feeders;
+	for (int i = 0; i < streams; i++) {
+		feeders.emplace_back([&contexts, &inputs, &measurements, i]() {
+			process_audio(contexts[i],
+				      memory_audio_source(inputs[i % inputs.size()].audio),
+				      measurements[i].get(), true);
+		});
+	}
+	for (auto &feeder : feeders) {
+		feeder.join();
+	}
+	const double wall_seconds =
+		std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	const double cpu_seconds = process_cpu_seconds() - cpu_start;
+
+	nlohmann::json stream_results = nlohmann::json::array();
+	double max_p95_latency_ms = 0.0;
+	uint64_t dropped_frames = 0;
+	uint64_t late_windows = 0;
+	for (int i = 0; i < streams; i++) {
+		transcription_filter_data *gf = contexts[i];
+		benchmark_run &run = *measurements[i];
+		const uint64_t stream_dropped_frames = gf->input_buffer.dropped_frames();
+		const double stream_dropped_seconds =
+			(double)stream_dropped_frames / (double)gf->sample_rate;
+		set_benchmark(gf, nullptr);
+		release_context(gf);
+
+		std::lock_guard<std::mutex> lock(run.mutex);
+		std::vector<double> latencies = run.segment_latencies_ms;
+		std::sort(latencies.begin(), latencies.end());
+		max_p95_latency_ms = std::max(max_p95_latency_ms, percentile(latencies, 95));
+		dropped_frames += stream_dropped_frames;
+		late_windows += run.late_windows;
+		stream_results.push_back({{"audio_file", inputs[i % inputs.size()].path},
+					  {"segments", latencies.size()},
+					  {"segment_latency_ms",
+					   {{"p50", percentile(latencies, 50)},
+					    {"p95", percentile(latencies, 95)},
+					    {"p99", percentile(latencies, 99)}}},
+					  {"dropped_frames", stream_dropped_frames},
+					  {"dropped_seconds", stream_dropped_seconds},
+					  {"late_windows", run.late_windows}});
+	}
+	const unsigned int cores = std::max(std::thread::hardware_concurrency(), 1u);
+	return {{"streams", streams},
+		{"wall_seconds", wall_seconds},
+		{"cpu_seconds", cpu_seconds},
+		{"cpu_utilization", wall_seconds > 0 ? cpu_seconds / wall_seconds / cores : 0.0},
+		{"max_p95_latency_ms", max_p95_latency_ms},
+		{"dropped_frames", dropped_frames},
+		{"late_windows", late_windows},
+		{"peak_rss_bytes", peak_rss_bytes()},
+		{"stream_results", stream_results}};
+}
+
+bool write_report(const nlohmann::json &report, const std::string &output_file_path)
+{
+	if (output_file_path.empty()) {
+		std::cout << report.dump(2) << std::endl;
+		return true;
+	}
+	std::ofstream output_file(output_file_path);
+	if (!output_file.is_open()) {
+		std::cout << "Failed to write the report to " << output_file_path << std::endl;
+		return false;
+	}
+	output_file << report.dump(2) << std::endl;
+	return true;
+}
+
+// the recordings of a batch are split in pieces of about that long, see batch_split_seconds
+#define BATCH_SPLIT_SECONDS 600
+// a piece is cut in the first silence of that window after the piece length
+#define BATCH_SPLIT_SEARCH_SECONDS 30
+// shortest silence a piece is cut in
+#define BATCH_SPLIT_MIN_SILENCE_MS 300
+
+// A recording of the batch and the transcribed pieces
+struct batch_file {
+	std::filesystem::path input;
+	std::filesystem::path srt_path;
+	std::filesystem::path jsonl_path;
+	// a line per transcribed piece, to resume an interrupted batch
+	std::filesystem::path progress_path;
+	// pieces transcribed by an earlier run, set before the pieces are queued
+	std::set<int> done_pieces;
+	// guards the members below
+	std::mutex mutex;
+	std::vector<batch_subtitle> subtitles;
+	// known once the recording is split
+	int pieces = -1;
+	int pieces_finished = 0;
+};
+
+struct batch_work {
+	std::shared_ptr<batch_file> file;
+	int piece;
+	uint64_t offset_ms;
+	// mono, 16 kHz
+	std::vector<float> audio;
+};
+
+// The pieces waiting for a worker, bounded so the decoder stays a few pieces ahead
+class batch_queue {
+public:
+	explicit batch_queue(size_t capacity_) : capacity(capacity_) {}
+
+	void push(batch_work work)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		cv.wait(lock, [this] { return queue.size() < capacity; });
+		queue.push_back(std::move(work));
+		cv.notify_all();
+	}
+
+	// false once the queue is closed and empty
+	bool pop(batch_work &work)
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		cv.wait(lock, [this] { return closed || !queue.empty(); });
+		if (queue.empty()) {
+			return false;
+		}
+		work = std::move(queue.front());
+		queue.pop_front();
+		cv.notify_all();
+		return true;
+	}
+
+	void close()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		closed = true;
+		cv.notify_all();
+	}
+
+private:
+	const size_t capacity;
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::deque<batch_work> queue;
+	bool closed = false;
+};
+
+bool is_batch_media_file(const std::filesystem::path &path)
+{
+	static const std::set<std::string> extensions = {".wav", ".mp3", ".flac", ".ogg", ".opus",
+							 ".m4a", ".aac", ".wma", ".mp4", ".mkv",
+							 ".mov", ".webm", ".flv", ".ts"};
+	std::string extension = path.extension().u8string();
+	std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+	return extensions.count(extension) > 0;
+}
+
+// The media files of a folder, or the files matching the * and ? of the file name, in order
+std::vector<std::filesystem::path> list_batch_inputs(const std::string &input)
+{
+	const std::filesystem::path path = std::filesystem::u8path(input);
+	std::vector<std::filesystem::path> files;
+	std::error_code ec;
+	if (std::filesystem::is_directory(path, ec)) {
+		for (const auto &entry : std::filesystem::directory_iterator(path, ec)) {
+			if (entry.is_regular_file(ec) && is_batch_media_file(entry.path())) {
+				files.push_back(entry.path());
+			}
+		}
+	} else {
+		std::string pattern;
+		for (char c : path.filename().u8string()) {
+			if (c == '*') {
+				pattern += ".*";
+			} else if (c == '?') {
+				pattern += '.';
+			} else {
+				if (strchr("\\^$.|+()[]{}", c) != nullptr) {
+					pattern += '\\';
+				}
+				pattern += c;
+			}
+		}
+		const std::regex name_regex(pattern, std::regex::icase);
+		const std::filesystem::path folder =
+			path.has_parent_path() ? path.parent_path() : std::filesystem::path(".");
+		for (const auto &entry : std::filesystem::directory_iterator(folder, ec)) {
+			if (entry.is_regular_file(ec) &&
+			    std::regex_match(entry.path().filename().u8string(), name_regex)) {
+				files.push_back(entry.path());
+			}
+		}
+	}
+	std::sort(files.begin(), files.end());
+	return files;
+}
+
+std::string srt_time(uint64_t ms)
+{
+	char time[32];
+	snprintf(time, sizeof(time), "%02llu:%02llu:%02llu,%03llu",
+		 (unsigned long long)(ms / 3600000), (unsigned long long)(ms / 60000 % 60),
+		 (unsigned long long)(ms / 1000 % 60), (unsigned long long)(ms % 1000));
+	return time;
+}
+
+nlohmann::json batch_subtitle_to_json(const batch_subtitle &subtitle)
+{
+	return {{"start_ms", subtitle.start_ms},
+		{"end_ms", subtitle.end_ms},
+		{"text", subtitle.text}};
+}
+
+// Write the SRT and JSONL files of a recording whose pieces are all transcribed, with its mutex
+void write_batch_outputs(batch_file &file)
+{
+	std::stable_sort(file.subtitles.begin(), file.subtitles.end(),
+			 [](const batch_subtitle &a, const batch_subtitle &b) {
+				 return a.start_ms < b.start_ms;
+			 });
+	std::ofstream jsonl(file.jsonl_path, std::ios::trunc);
+	std::filesystem::path srt_tmp_path = file.srt_path;
+	srt_tmp_path += ".tmp";
+	std::ofstream srt(srt_tmp_path, std::ios::trunc);
+	int number = 1;
+	for (const batch_subtitle &subtitle : file.subtitles) {
+		jsonl << batch_subtitle_to_json(subtitle).dump(
+				 -1, ' ', false, nlohmann::json::error_handler_t::replace)
+		      << "\n";
+		srt << number++ << "\n"
+		    << srt_time(subtitle.start_ms) << " --> " << srt_time(subtitle.end_ms) << "\n"
+		    << subtitle.text << "\n\n";
+	}
+	jsonl.close();
+	srt.close();
+	if (jsonl.fail() || srt.fail()) {
+		obs_log(LOG_ERROR, "Failed to write the subtitles of %s",
+			file.input.u8string().c_str());
+		return;
+	}
+	// the SRT file marks the recording as done, it is renamed in place last
+	std::error_code ec;
+	std::filesystem::rename(srt_tmp_path, file.srt_path, ec);
+	std::filesystem::remove(file.progress_path, ec);
+	obs_log(LOG_INFO, "Wrote %d subtitles of %s to %s", number - 1,
+		file.input.u8string().c_str(), file.srt_path.u8string().c_str());
+}
+
+// The pieces transcribed by an interrupted run of the batch
+void read_batch_progress(batch_file &file)
+{
+	std::ifstream progress(file.progress_path);
+	for (std::string line; std::getline(progress, line);) {
+		const nlohmann::json entry = nlohmann::json::parse(line, nullptr, false);
+		// the last line is cut if the run was interrupted while writing it
+		if (!entry.is_object() || !entry.contains("piece") || !entry.contains("subtitles") ||
+		    !entry["subtitles"].is_array()) {
+			continue;
+		}
+		if (!file.done_pieces.insert(entry.value("piece", -1)).second) {
+			continue;
+		}
+		for (const nlohmann::json &subtitle : entry["subtitles"]) {
+			file.subtitles.push_back({subtitle.value("start_ms", (uint64_t)0),
+						  subtitle.value("end_ms", (uint64_t)0),
+						  subtitle.value("text", "")});
+		}
+	}
+	file.pieces_finished = (int)file.done_pieces.size();
+	if (!file.done_pieces.empty()) {
+		obs_log(LOG_INFO, "Resuming %s, %d pieces transcribed",
+			file.input.u8string().c_str(), file.pieces_finished);
+	}
+}
+
+void finish_batch_piece(batch_file &file, int piece, const std::vector<batch_subtitle> &subtitles)
+{
+	nlohmann::json subtitles_json = nlohmann::json::array();
+	for (const batch_subtitle &subtitle : subtitles) {
+		subtitles_json.push_back(batch_subtitle_to_json(subtitle));
+	}
+	const nlohmann::json entry = {{"piece", piece}, {"subtitles", subtitles_json}};
+
+	std::lock_guard<std::mutex> lock(file.mutex);
+	std::ofstream progress(file.progress_path, std::ios::app);
+	progress << entry.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace)
+		 << std::endl;
+	file.subtitles.insert(file.subtitles.end(), subtitles.begin(), subtitles.end());
+	file.pieces_finished++;
+	if (file.pieces_finished == file.pieces) {
+		write_batch_outputs(file);
+	}
+}
+
+// Where the piece is cut: in the middle of the first silence after split_frames
+size_t find_batch_cut(VadIterator &vad, const std::vector<float> &piece, size_t split_frames)
+{
+	const std::vector<float> search(piece.begin() + split_frames, piece.end());
+	vad.process(search, true);
+	const size_t min_silence = BATCH_SPLIT_MIN_SILENCE_MS * WHISPER_SAMPLE_RATE / 1000;
+	size_t silence_start = 0;
+	for (const timestamp_t &speech : vad.get_speech_timestamps()) {
+		if ((size_t)speech.start >= silence_start + min_silence) {
+			return split_frames + (silence_start + (size_t)speech.start) / 2;
+		}
+		silence_start = std::max(silence_start, (size_t)speech.end);
+	}
+	if (search.size() >= silence_start + min_silence) {
+		return split_frames + (silence_start + search.size()) / 2;
+	}
+	obs_log(LOG_WARNING, "No silence in %d s of speech, the piece is cut in a word",
+		BATCH_SPLIT_SEARCH_SECONDS);
+	return split_frames;
+}
+
+// Decode a recording to 16 kHz mono and queue its pieces, except the ones transcribed by an
+// earlier run. Returns the number of pieces, -1 if the file cannot be read.
+int split_batch_file(const std::shared_ptr<batch_file> &file, VadIterator &vad,
+		     size_t split_frames, batch_queue &queue, double &audio_seconds)
+{
+	AudioFileStream audio;
+	if (!audio.open(file->input.u8string().c_str(), WHISPER_SAMPLE_RATE)) {
+		obs_log(LOG_ERROR, "Failed to read audio file %s", file->input.u8string().c_str());
+		return -1;
+	}
+	const size_t search_frames = (size_t)BATCH_SPLIT_SEARCH_SECONDS * WHISPER_SAMPLE_RATE;
+	std::vector<float> piece;
+	uint64_t offset_frames = 0;
+	int pieces = 0;
+	const auto queue_piece = [&](size_t frames) {
+		if (file->done_pieces.count(pieces) == 0) {
+			batch_work work;
+			work.file = file;
+			work.piece = pieces;
+			work.offset_ms = offset_frames * 1000 / WHISPER_SAMPLE_RATE;
+			work.audio.assign(piece.begin(), piece.begin() + frames);
+			queue.push(std::move(work));
+		}
+		pieces++;
+		piece.erase(piece.begin(), piece.begin() + frames);
+		offset_frames += frames;
+	};
+	while (true) {
+		const float *channel_data[MAX_PREPROC_CHANNELS];
+		const size_t frames = audio.read(WHISPER_SAMPLE_RATE, channel_data);
+		if (frames == 0) {
+			break;
+		}
+		// the channels are mixed like the filter does with the default input channel
+		const size_t begin = piece.size();
+		piece.resize(begin + frames, 0.0f);
+		for (int c = 0; c < audio.channels(); c++) {
+			for (size_t i = 0; i < frames; i++) {
+				piece[begin + i] += channel_data[c][i] / (float)audio.channels();
+			}
+		}
+		if (split_frames > 0 && piece.size() >= split_frames + search_frames) {
+			queue_piece(find_batch_cut(vad, piece, split_frames));
+		}
+	}
+	if (!piece.empty()) {
+		queue_piece(piece.size());
+	}
+	audio_seconds += (double)offset_frames / WHISPER_SAMPLE_RATE;
+	return pieces;
+}
+
+// guards the creation of the worker contexts, create_configured_context is not reentrant
+std::mutex batch_context_mutex;
+
+// Transcribe pieces until the queue is closed, each with a context of its own so the context
+// prompt and the timeline of a piece do not carry over to the next
+void run_batch_worker(const nlohmann::json &config, int gpu_device, batch_queue &queue)
+{
+	transcription_filter_data *gf = nullptr;
+	batch_work work;
+	while (queue.pop(work)) {
+		transcription_filter_data *next_gf;
+		{
+			std::lock_guard<std::mutex> lock(batch_context_mutex);
+			next_gf = create_configured_context(WHISPER_SAMPLE_RATE, 1, config,
+							    gpu_device);
+		}
+		// released after the next context is created, so the model stays loaded
+		if (gf != nullptr) {
+			release_context(gf);
+		}
+		gf = next_gf;
+		obs_log(LOG_INFO, "Transcribing piece %d of %s (%.1f s)", work.piece + 1,
+			work.file->input.u8string().c_str(),
+			(double)work.audio.size() / WHISPER_SAMPLE_RATE);
+
+		batch_piece_output output;
+		output.offset_ms = work.offset_ms;
+		set_batch_piece(gf, &output);
+		size_t position = 0;
+		process_audio(
+			gf,
+			[&work, &position](size_t frames, const float **channel_data) {
+				frames = std::min(frames, work.audio.size() - position);
+				channel_data[0] = work.audio.data() + position;
+				position += frames;
+				return frames;
+			},
+			&output.run, false);
+		set_batch_piece(gf, nullptr);
+		finish_batch_piece(*work.file, work.piece, output.subtitles);
+	}
+	if (gf != nullptr) {
+		release_context(gf);
+	}
+}
+
+// Transcribe the recordings of a folder or wildcard pattern with batch_workers pipelines, written
+// as <name>.srt and <name>.jsonl. A recording with its SRT file is skipped, so an interrupted
+// batch resumes where it stopped.
+int run_batch(const std::string &input, const nlohmann::json &config)
+{
+	const std::vector<std::filesystem::path> inputs = list_batch_inputs(input);
+	if (inputs.empty()) {
+		std::cout << "No recording found for " << input << std::endl;
+		return 1;
+	}
+	const int cores = (int)std::max(std::thread::hardware_concurrency(), 1u);
+	const int workers = std::max(
+		1, config.value("batch_workers",
+				cores / std::max(1, config.value("whisper_n_threads", 4))));
+	// the workers take the devices in turn, the CPU without them
+	const std::vector<int> gpu_devices =
+		config.value("batch_gpu_devices", std::vector<int>());
+	const size_t split_frames =
+		(size_t)std::max(0, config.value("batch_split_seconds", BATCH_SPLIT_SECONDS)) *
+		WHISPER_SAMPLE_RATE;
+	const std::string output_folder = config.value("batch_output_folder", "");
+	if (!output_folder.empty()) {
+		std::error_code ec;
+		std::filesystem::create_directories(std::filesystem::u8path(output_folder), ec);
+	}
+	obs_log(LOG_INFO, "Batch of %d recordings with %d workers", (int)inputs.size(), workers);
+
+	const std::string silero_vad_model_file = config["silero_vad_model_file"];
+#ifdef _WIN32
+	const SileroString silero_vad_model_path =
+		std::wstring_convert<std::codecvt_utf8<wchar_t>>().from_bytes(
+			silero_vad_model_file);
+#else
+	const SileroString silero_vad_model_path = silero_vad_model_file;
+#endif
+	VadIterator vad(silero_vad_model_path, WHISPER_SAMPLE_RATE, VAD_WINDOW_SIZE_MS, 0.5f,
+			BATCH_SPLIT_MIN_SILENCE_MS, 0, 100);
+
+	const auto start = std::chrono::steady_clock::now();
+	batch_queue queue((size_t)workers);
+	std::vector<std::thread> worker_threads;
+	for (int i = 0; i < workers; i++) {
+		const int gpu_device =
+			gpu_devices.empty() ? -1 : gpu_devices[i % gpu_devices.size()];
+		worker_threads.emplace_back(run_batch_worker, std::cref(config), gpu_device,
+					    std::ref(queue));
+	}
+	int skipped = 0;
+	int failed = 0;
+	double audio_seconds = 0.0;
+	for (const std::filesystem::path &path : inputs) {
+		auto file = std::make_shared<batch_file>();
+		file->input = path;
+		const std::filesystem::path output_base =
+			(output_folder.empty() ? path.parent_path()
+					       : std::filesystem::u8path(output_folder)) /
+			path.stem();
+		file->srt_path = output_base;
+		file->srt_path += ".srt";
+		file->jsonl_path = output_base;
+		file->jsonl_path += ".jsonl";
+		file->progress_path = output_base;
+		file->progress_path += ".progress.jsonl";
+		std::error_code ec;
+		if (std::filesystem::exists(file->srt_path, ec)) {
+			obs_log(LOG_INFO, "Skipping %s, already transcribed",
+				path.u8string().c_str());
+			skipped++;
+			continue;
+		}
+		read_batch_progress(*file);
+		const int pieces = split_batch_file(file, vad, split_frames, queue, audio_seconds);
+		if (pieces < 0) {
+			failed++;
+			continue;
+		}
+		std::lock_guard<std::mutex> lock(file->mutex);
+		file->pieces = pieces;
+		if (file->pieces_finished == pieces) {
+			// transcribed by an earlier run, or without audio
+			write_batch_outputs(*file);
+		}
+	}
+	queue.close();
+	for (std::thread &worker : worker_threads) {
+		worker.join();
+	}
+	const double wall_seconds =
+		std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	obs_log(LOG_INFO,
+		"Batch done: %d recordings transcribed, %d skipped, %d failed, %.1f s of audio in"
+		" %.1f s",
+		(int)inputs.size() - skipped - failed, skipped, failed, audio_seconds,
+		wall_seconds);
+	return failed > 0 ? 1 : 0;
 }
 
 int wmain(int argc, wchar_t *argv[])
@@ -384,6 +1428,22 @@ int wmain(int argc, wchar_t *argv[])
 	if (argc < 3) {
 		std::cout << "Usage: localvocal-offline-test <audio-file> <config_json_file>"
 			  << std::endl;
+		std::cout << "Set \"benchmark_runs\" in the configuration to process the file that"
+			     " many times and report the real-time factor, the time of each stage,"
+			     " the segment latencies and the peak memory as JSON, to"
+			     " \"benchmark_output_file\" or the standard output."
+			  << std::endl;
+		std::cout << "Set \"load_test_streams\" to a number of streams, or a list of them,"
+			     " to caption the file and the \"load_test_audio_files\" at once at the"
+			     " live pace and report the latencies, drops and CPU use of each step."
+			  << std::endl;
+		std::cout << "Set \"trace_file\" to write the spans of each segment of the first run"
+			     " as a Chrome trace."
+			  << std::endl;
+		std::cout << "Set \"batch\": true to transcribe the recordings of a folder, or of a"
+			     " pattern like recordings/*.mkv, in place of the audio file, to an SRT"
+			     " and a JSONL file each, with \"batch_workers\" pipelines at once."
+			  << std::endl;
 		return 1;
 	}
 
@@ -408,213 +1468,151 @@ int wmain(int argc, wchar_t *argv[])
 	config_stream >> config;
 	config_stream.close();
 
-	// get the configuration values
-	std::string whisperModelPathStr = config["whisper_model_path"];
-	std::string sileroVadModelFileStr = config["silero_vad_model_file"];
-	std::string sourceLanguageStr = config["source_language"];
-	std::string targetLanguageStr = config["target_language"];
-	std::string whisperLanguageStr = config["whisper_language"];
-	std::string ct2ModelFolderStr = config["ct2_model_folder"];
-	std::string logLevelStr = config["log_level"];
-	whisper_sampling_strategy whisper_sampling_method = config["whisper_sampling_method"];
+	// the benchmark mode processes the file that many times
+	const int benchmark_runs = config.value("benchmark_runs", 0);
+	const std::string benchmark_output_file = config.value("benchmark_output_file", "");
+	const std::string trace_file = config.value("trace_file", "");
 
 	std::cout << "LocalVocal Offline Test" << std::endl;
-	transcription_filter_data *gf = nullptr;
-	std::optional<std::thread> audio_chunk_saver_thread;
-
-	std::vector<std::vector<uint8_t>> audio =
-		read_audio_file(filenameStr.c_str(), [&](int sample_rate, int channels) {
-			gf = create_context(sample_rate, channels, whisperModelPathStr,
-					    sileroVadModelFileStr, ct2ModelFolderStr,
-					    whisper_sampling_method);
-			if (sourceLanguageStr.empty() || targetLanguageStr.empty() ||
-			    sourceLanguageStr == "none" || targetLanguageStr == "none") {
-				obs_log(LOG_INFO,
-					"Source or target translation language are empty or disabled");
-			} else {
-				obs_log(LOG_INFO, "Setting translation languages");
-				gf->target_lang = targetLanguageStr;
-				build_and_enable_translation(gf, ct2ModelFolderStr.c_str());
-			}
-			gf->whisper_params.language = whisperLanguageStr.c_str();
-			if (config.contains("fix_utf8")) {
-				obs_log(LOG_INFO, "Setting fix_utf8 to %s",
-					config["fix_utf8"] ? "true" : "false");
-				gf->fix_utf8 = config["fix_utf8"];
-			}
-			if (config.contains("enable_audio_chunks_callback")) {
-				obs_log(LOG_INFO, "Setting enable_audio_chunks_callback to %s",
-					config["enable_audio_chunks_callback"] ? "true" : "false");
-				gf->enable_audio_chunks_callback =
-					config["enable_audio_chunks_callback"];
-			}
-			if (config.contains("temperature")) {
-				obs_log(LOG_INFO, "Setting temperture to %f",
-					config["temperature"].get<float>());
-				gf->whisper_params.temperature = config["temperature"].get<float>();
-			}
-			if (config.contains("no_context")) {
-				obs_log(LOG_INFO, "Setting no_context to %s",
-					config["no_context"] ? "true" : "false");
-				gf->whisper_params.no_context = config["no_context"];
-			}
-			if (config.contains("filter_words_replace")) {
-				obs_log(LOG_INFO, "Setting filter_words_replace to %s",
-					config["filter_words_replace"]);
-				gf->filter_words_replace = deserialize_filter_words_replace(
-					config["filter_words_replace"]);
-			}
-			// set log level
-			if (logLevelStr == "debug") {
-				gf->log_level = LOG_DEBUG;
-			} else if (logLevelStr == "info") {
-				gf->log_level = LOG_INFO;
-			} else if (logLevelStr == "warning") {
-				gf->log_level = LOG_WARNING;
-			} else if (logLevelStr == "error") {
-				gf->log_level = LOG_ERROR;
-			}
-		});
 
-	if (gf == nullptr) {
-		std::cout << "Failed to create context" << std::endl;
-		return 1;
-	}
-	if (audio.empty()) {
-		std::cout << "Failed to read audio file" << std::endl;
-		return 1;
+	if (config.value("batch", false)) {
+		return run_batch(filenameStr, config);
 	}
 
-	if (gf->enable_audio_chunks_callback) {
-		audio_chunk_saver_thread.emplace(json_segments_saver_thread_function);
+	if (config.contains("load_test_streams")) {
+		// the streams take the inputs in turn, each is decoded in memory once
+		std::vector<load_test_input> inputs(1);
+		inputs[0].path = filenameStr;
+		inputs[0].audio = read_audio_file(filenameStr.c_str(),
+						  [&](int sample_rate_, int channels_) {
+							  inputs[0].sample_rate = sample_rate_;
+							  inputs[0].channels = channels_;
+						  });
+		if (inputs[0].audio.empty() || inputs[0].sample_rate <= 0) {
+			std::cout << "Failed to read audio file" << std::endl;
+			return 1;
+		}
+		const std::vector<std::string> audio_files =
+			config.value("load_test_audio_files", std::vector<std::string>());
+		for (const std::string &path : audio_files) {
+			load_test_input input;
+			input.path = path;
+			input.audio = read_audio_file(path.c_str(),
+						      [&](int sample_rate_, int channels_) {
+							      input.sample_rate = sample_rate_;
+							      input.channels = channels_;
+						      });
+			if (input.audio.empty() || input.sample_rate <= 0) {
+				std::cout << "Failed to read audio file " << path << std::endl;
+				return 1;
+			}
+			inputs.push_back(std::move(input));
+		}
+		std::vector<int> stream_counts;
+		if (config["load_test_streams"].is_array()) {
+			stream_counts = config["load_test_streams"].get<std::vector<int>>();
+		} else {
+			stream_counts.push_back(config["load_test_streams"].get<int>());
+		}
+		nlohmann::json steps = nlohmann::json::array();
+		for (int streams : stream_counts) {
+			if (streams > 0) {
+				steps.push_back(run_load_test_step(config, inputs, streams));
+			}
+		}
+		const nlohmann::json report = {{"cpu_cores", std::thread::hardware_concurrency()},
+					       {"steps", steps}};
+		obs_log(LOG_INFO, "LocalVocal Load Test Done");
+		return write_report(report, benchmark_output_file) ? 0 : 1;
 	}
 
-	// truncate the output file
-	obs_log(LOG_INFO, "Truncating output file");
-	std::ofstream output_file(gf->output_file_path, std::ios::trunc);
-	output_file.close();
+	// the file is decoded while it is transcribed, resampled to 16 kHz by the decoder with
+	// "resample_input"
+	const int decode_sample_rate =
+		config.value("resample_input", false) ? WHISPER_SAMPLE_RATE : 0;
+	double audio_seconds = 0.0;
+	nlohmann::json benchmark_runs_json = nlohmann::json::array();
+	for (int run = 0; run < std::max(benchmark_runs, 1); run++) {
+		AudioFileStream audio;
+		if (!audio.open(filenameStr.c_str(), decode_sample_rate)) {
+			std::cout << "Failed to read audio file" << std::endl;
+			return 1;
+		}
+		transcription_filter_data *gf =
+			create_configured_context(audio.sample_rate(), audio.channels(), config);
+		if (gf == nullptr) {
+			std::cout << "Failed to create context" << std::endl;
+			return 1;
+		}
+		std::optional<benchmark_run> measurements;
+		if (benchmark_runs > 0) {
+			measurements.emplace();
+			set_benchmark(gf, &measurements.value());
+		}
+		if (run == 0 && !trace_file.empty()) {
+			gf->segment_trace.start();
+		}
 
-	// delete the segments.json file if it exists
-	if (std::ifstream("segments.json")) {
-		std::remove("segments.json");
-	}
+		std::optional<std::thread> audio_chunk_saver_thread;
+		if (gf->enable_audio_chunks_callback) {
+			json_segments_input_finished = false;
+			audio_chunk_saver_thread.emplace(json_segments_saver_thread_function);
+		}
 
-	const auto window_size_in_ms = std::chrono::milliseconds(25);
+		// truncate the output file
+		obs_log(LOG_INFO, "Truncating output file");
+		std::ofstream output_file(gf->output_file_path, std::ios::trunc);
+		output_file.close();
 
-	// fill up the whisper buffer
-	{
-		gf->start_timestamp_ms = now_ms();
-
-		obs_log(LOG_INFO, "Sending samples to whisper buffer");
-		// 25 ms worth of frames
-		size_t frames = gf->sample_rate * window_size_in_ms.count() / 1000;
-		const int frame_size_bytes = sizeof(float);
-		size_t frames_size_bytes = frames * frame_size_bytes;
-		size_t frames_count = 0;
-		int64_t start_time = std::chrono::duration_cast<std::chrono::nanoseconds>(
-					     std::chrono::system_clock::now().time_since_epoch())
-					     .count();
-		auto start_time_time = std::chrono::system_clock::now();
-		uint64_t window_number = 0;
-		while (true) {
-			// check if there are enough frames left in the audio buffer
-			if ((frames_count + frames) > (audio[0].size() / frame_size_bytes)) {
-				// only take the remaining frames
-				frames = audio[0].size() / frame_size_bytes - frames_count;
-				frames_size_bytes = frames * frame_size_bytes;
-			}
-			{
-				{
-					auto max_wait = start_time_time +
-							(window_number * window_size_in_ms);
-					std::unique_lock<std::mutex> lock(gf->whisper_buf_mutex);
-					for (;;) {
-						// sleep up to window size in case whisper is processing, so the buffer builds up similar to OBS
-						auto now = std::chrono::system_clock::now();
-						if (false && now > max_wait)
-							break;
-
-						if (gf->input_buffers->size == 0)
-							break;
-
-						gf->input_cv->wait_for(
-							lock, std::chrono::milliseconds(1), [&] {
-								return gf->input_buffers->size == 0;
-							});
-					}
-					// push back current audio data to input deque
-					for (size_t c = 0; c < gf->channels; c++) {
-						deque_push_back(&gf->input_buffers[c],
-								audio[c].data() +
-									frames_count *
-										frame_size_bytes,
-								frames_size_bytes);
-					}
-					// push audio packet info (timestamp/frame count) to info deque
-					struct transcription_filter_audio_info info = {0};
-					info.frames = frames; // number of frames in this packet
-					// make a timestamp from the current position in the audio buffer
-					info.timestamp_offset_ns =
-						start_time + (int64_t)(((float)frames_count /
-									(float)gf->sample_rate) *
-								       1e9);
-					deque_push_back(&gf->info_buffer, &info, sizeof(info));
-				}
-				gf->wshiper_thread_cv.notify_one();
-			}
-			frames_count += frames;
-			window_number += 1;
-			if (frames_count >= audio[0].size() / frame_size_bytes) {
-				break;
-			}
+		// delete the segments.json file if it exists
+		if (std::ifstream("segments.json")) {
+			std::remove("segments.json");
 		}
-		// push a second of silence to the input deque
-		frames = 2 * gf->sample_rate;
-		frames_size_bytes = frames * frame_size_bytes;
-		for (size_t c = 0; c < gf->channels; c++) {
-			deque_push_back(&gf->input_buffers[c],
-					std::vector<uint8_t>(frames_size_bytes).data(),
-					frames_size_bytes);
-		}
-		// push audio packet info (timestamp/frame count) to info deque
-		struct transcription_filter_audio_info info = {0};
-		info.frames = frames; // number of frames in this packet
-		// make a timestamp from the current frame count
-		info.timestamp_offset_ns = frames_count * 1000 / gf->sample_rate;
-		deque_push_back(&gf->info_buffer, &info, sizeof(info));
-	}
 
-	obs_log(LOG_INFO, "Buffer filled with %d frames",
-		(int)gf->input_buffers[0].size / sizeof(float));
-
-	// wait for processing to finish
-	obs_log(LOG_INFO, "Waiting for processing to finish");
-	while (true) {
-		std::this_thread::sleep_for(std::chrono::milliseconds(100));
-		// check the input deque has more data
-		size_t input_buf_size = 0;
-		{
-			std::lock_guard<std::mutex> lock(gf->whisper_buf_mutex);
-			input_buf_size = gf->input_buffers[0].size;
+		// the model is loaded when the context is created, it is not measured
+		const auto start = std::chrono::steady_clock::now();
+		const size_t audio_frames =
+			process_audio(gf,
+				      [&audio](size_t frames, const float **channel_data) {
+					      return audio.read(frames, channel_data);
+				      },
+				      measurements.has_value() ? &measurements.value() : nullptr,
+				      false);
+		audio_seconds = (double)audio_frames / audio.sample_rate();
+		const double wall_seconds =
+			std::chrono::duration<double>(std::chrono::steady_clock::now() - start)
+				.count();
+
+		if (audio_chunk_saver_thread.has_value()) {
+			{
+				auto lock = std::lock_guard(json_segments_input_mutex);
+				json_segments_input_finished = true;
+			}
+			json_segments_input_cv.notify_one();
+			audio_chunk_saver_thread->join();
 		}
 
-		// if less than 500ms of audio left in the input buffer, break
-		if (input_buf_size < gf->sample_rate / 2 * sizeof(float)) {
-			break;
+		gf->segment_trace.stop(trace_file);
+		set_benchmark(gf, nullptr);
+		release_context(gf);
+		if (measurements.has_value()) {
+			benchmark_runs_json.push_back(
+				benchmark_run_to_json(*measurements, wall_seconds, audio_seconds));
+			obs_log(LOG_INFO, "Benchmark run %d: real-time factor %.3f", run + 1,
+				wall_seconds / audio_seconds);
 		}
 	}
 
-	if (audio_chunk_saver_thread.has_value()) {
-		{
-			auto lock = std::lock_guard(json_segments_input_mutex);
-			json_segments_input_finished = true;
+	if (benchmark_runs > 0) {
+		const nlohmann::json report = {{"audio_file", filenameStr},
+					       {"audio_seconds", audio_seconds},
+					       {"runs", benchmark_runs_json},
+					       {"peak_rss_bytes", peak_rss_bytes()}};
+		if (!write_report(report, benchmark_output_file)) {
+			return 1;
 		}
-		json_segments_input_cv.notify_one();
-		audio_chunk_saver_thread->join();
 	}
 
-	release_context(gf);
-
 	obs_log(LOG_INFO, "LocalVocal Offline Test Done");
 	return 0;
 }
@@ -0,0 +1,64 @@
+// Checks of the compiled word filter on fixed sentences. The entries are matched in a single pass
+// over the original text: the longest match wins at a position, and a replacement is not matched
+// again by the other entries, unlike applying the entries one after the other. Exits with
+// status 1 when a case fails.
+#include <cstdarg>
+#include <cstdio>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include "plugin-support.h"
+#include "ui/filter-replace-utils.h"
+
+// the invalid patterns are logged, the cases do not need the messages
+void obs_log(int, const char *, ...) {}
+
+namespace {
+
+struct word_filter_case {
+	const char *name;
+	std::vector<std::tuple<std::string, std::string>> filters;
+	std::string text;
+	std::string expected;
+};
+
+const std::vector<word_filter_case> cases = {
+	{"plain words, case-insensitive", {{"hello", "hi"}}, "Hello hello HELLO", "hi hi hi"},
+	{"plain alternation", {{"(damn|darn)", "****"}}, "damn it, darn", "**** it, ****"},
+	{"regex with a $ reference", {{"(\\d+) ?km", "$1 kilometers"}}, "5km or 7 km",
+	 "5 kilometers or 7 kilometers"},
+	{"longest match at a position", {{"new", "old"}, {"new york", "NYC"}}, "new york is new",
+	 "NYC is old"},
+	{"replacements are not matched again", {{"a", "b"}, {"b", "c"}}, "ab", "bc"},
+	{"backreference", {{"\\b(\\w+) \\1\\b", "$1"}}, "the the cat", "the cat"},
+	// the group of the second pattern is the third one of a combined regex
+	{"backreference after a regex with groups",
+	 {{"(\\d+)(st|nd)", "$1"}, {"\\b(\\w+) \\1\\b", "$1"}, {"cat", "dog"}},
+	 "1st the the cat", "1 the dog"},
+	{"escaped backslash is not a backreference", {{"a\\\\1", "x"}}, "a\\1 a1", "x a1"},
+	{"invalid pattern is skipped", {{"(", "x"}, {"cat", "dog"}}, "cat (", "dog ("},
+	{"empty pattern is skipped", {{"", "x"}, {"cat", "dog"}}, "cat", "dog"},
+};
+
+} // namespace
+
+int main()
+{
+	int failures = 0;
+	for (const word_filter_case &test : cases) {
+		const std::string result = WordFilter(test.filters).apply(test.text);
+		if (result == test.expected) {
+			printf("ok      %s\n", test.name);
+			continue;
+		}
+		printf("FAILED  %s: '%s' gave '%s', expected '%s'\n", test.name, test.text.c_str(),
+		       result.c_str(), test.expected.c_str());
+		failures++;
+	}
+	if (failures > 0) {
+		printf("%d of %d cases failed\n", failures, (int)cases.size());
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,318 @@
+#include "transcript-file-writer.h"
+#include "plugin-support.h"
+
+#include <obs-module.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+typedef std::chrono::steady_clock::time_point file_time;
+
+enum class file_op_type { Write, Truncate, Close };
+
+struct file_op {
+	file_op_type type;
+	std::string path;
+	std::string text;
+	bool replace;
+	uint64_t seq;
+};
+
+// A file kept open by the writer thread
+struct open_file {
+	FILE *file;
+	file_time last_write;
+	// written text not flushed / flushed text not synced, since
+	bool unflushed = false;
+	file_time unflushed_since;
+	bool unsynced = false;
+	file_time unsynced_since;
+};
+
+// guards the queue and the writer state
+std::mutex writer_mutex;
+// wakes the writer on new operations, and transcript_file_close when one is done
+std::condition_variable writer_cv;
+std::thread writer_thread;
+bool writer_stop = false;
+std::deque<file_op> ops;
+uint64_t queued_seq = 0;
+uint64_t done_seq = 0;
+
+// only used by the writer thread
+std::map<std::string, open_file> files;
+
+FILE *open_for_append(const std::string &path)
+{
+#ifdef _WIN32
+	return _wfopen(std::filesystem::u8path(path).wstring().c_str(), L"ab");
+#else
+	return fopen(path.c_str(), "ab");
+#endif
+}
+
+bool sync_file(FILE *file)
+{
+#ifdef _WIN32
+	return _commit(_fileno(file)) == 0;
+#else
+	return fsync(fileno(file)) == 0;
+#endif
+}
+
+bool truncate_file(FILE *file)
+{
+	// the file is opened for append: the next write goes to the new end
+#ifdef _WIN32
+	return _chsize_s(_fileno(file), 0) == 0;
+#else
+	return ftruncate(fileno(file), 0) == 0;
+#endif
+}
+
+void flush_file(const std::string &path, open_file &entry, file_time now)
+{
+	if (entry.unflushed) {
+		if (fflush(entry.file) != 0) {
+			obs_log(LOG_ERROR, "Cannot write transcript file %s", path.c_str());
+		}
+		entry.unflushed = false;
+		if (!entry.unsynced) {
+			entry.unsynced = true;
+			entry.unsynced_since = now;
+		}
+	}
+}
+
+void close_file(std::map<std::string, open_file>::iterator it)
+{
+	flush_file(it->first, it->second, std::chrono::steady_clock::now());
+	if (it->second.unsynced) {
+		sync_file(it->second.file);
+	}
+	fclose(it->second.file);
+	files.erase(it);
+}
+
+// The open file, opened for append if it is not
+open_file *get_file(const std::string &path, file_time now)
+{
+	auto it = files.find(path);
+	if (it != files.end()) {
+		return &it->second;
+	}
+	FILE *file = open_for_append(path);
+	if (file == nullptr) {
+		obs_log(LOG_ERROR, "Cannot open transcript file %s", path.c_str());
+		return nullptr;
+	}
+	// the lines are written to the buffer, which is flushed on the flush deadline
+	setvbuf(file, nullptr, _IOFBF, 64 * 1024);
+	open_file &entry = files[path];
+	entry.file = file;
+	entry.last_write = now;
+	return &entry;
+}
+
+void run_op(const file_op &op)
+{
+	const file_time now = std::chrono::steady_clock::now();
+	auto it = files.find(op.path);
+	switch (op.type) {
+	case file_op_type::Write: {
+		open_file *entry = get_file(op.path, now);
+		if (entry == nullptr) {
+			return;
+		}
+		if (op.replace) {
+			fflush(entry->file);
+			entry->unflushed = false;
+			truncate_file(entry->file);
+		}
+		if (fwrite(op.text.data(), 1, op.text.size(), entry->file) != op.text.size()) {
+			obs_log(LOG_ERROR, "Cannot write transcript file %s", op.path.c_str());
+		}
+		entry->last_write = now;
+		if (!entry->unflushed) {
+			entry->unflushed = true;
+			entry->unflushed_since = now;
+		}
+		if (op.replace) {
+			// the file is read for its current content
+			flush_file(op.path, *entry, now);
+		}
+		break;
+	}
+	case file_op_type::Truncate: {
+		std::error_code ec;
+		if (it == files.end() &&
+		    !std::filesystem::exists(std::filesystem::u8path(op.path), ec)) {
+			return;
+		}
+		open_file *entry = get_file(op.path, now);
+		if (entry != nullptr) {
+			fflush(entry->file);
+			entry->unflushed = false;
+			truncate_file(entry->file);
+		}
+		break;
+	}
+	case file_op_type::Close:
+		if (it != files.end()) {
+			close_file(it);
+		}
+		break;
+	}
+}
+
+// Flush, sync and close the files that are due. Returns false if there is nothing to do later,
+// else the next deadline.
+bool maintain_files(file_time &deadline)
+{
+	const file_time now = std::chrono::steady_clock::now();
+	const auto flush_interval = std::chrono::milliseconds(TRANSCRIPT_FILE_FLUSH_MS);
+	const auto sync_interval = std::chrono::seconds(TRANSCRIPT_FILE_SYNC_SECONDS);
+	const auto idle_interval = std::chrono::seconds(TRANSCRIPT_FILE_IDLE_SECONDS);
+	bool has_deadline = false;
+	const auto add_deadline = [&](file_time time) {
+		deadline = has_deadline ? std::min(deadline, time) : time;
+		has_deadline = true;
+	};
+	for (auto it = files.begin(); it != files.end();) {
+		open_file &entry = it->second;
+		if (now - entry.last_write >= idle_interval) {
+			close_file(it++);
+			continue;
+		}
+		if (entry.unflushed && now - entry.unflushed_since >= flush_interval) {
+			flush_file(it->first, entry, now);
+		}
+		if (entry.unsynced && now - entry.unsynced_since >= sync_interval) {
+			if (!sync_file(entry.file)) {
+				obs_log(LOG_WARNING, "Cannot sync transcript file %s",
+					it->first.c_str());
+			}
+			entry.unsynced = false;
+		}
+		if (entry.unflushed) {
+			add_deadline(entry.unflushed_since + flush_interval);
+		}
+		if (entry.unsynced) {
+			add_deadline(entry.unsynced_since + sync_interval);
+		}
+		add_deadline(entry.last_write + idle_interval);
+		++it;
+	}
+	return has_deadline;
+}
+
+void writer_loop()
+{
+	std::unique_lock<std::mutex> lock(writer_mutex);
+	while (true) {
+		if (!ops.empty()) {
+			const file_op op = std::move(ops.front());
+			ops.pop_front();
+			lock.unlock();
+			run_op(op);
+			lock.lock();
+			done_seq = op.seq;
+			writer_cv.notify_all();
+			continue;
+		}
+		if (writer_stop) {
+			break;
+		}
+		lock.unlock();
+		file_time deadline;
+		const bool has_deadline = maintain_files(deadline);
+		lock.lock();
+		if (!ops.empty() || writer_stop) {
+			continue;
+		}
+		if (has_deadline) {
+			writer_cv.wait_until(lock, deadline);
+		} else {
+			writer_cv.wait(lock);
+		}
+	}
+	lock.unlock();
+	while (!files.empty()) {
+		close_file(files.begin());
+	}
+}
+
+// Returns the sequence number of the operation
+uint64_t queue_op(file_op_type type, const std::string &path, const std::string &text,
+		  bool replace)
+{
+	uint64_t seq;
+	{
+		std::lock_guard<std::mutex> lock(writer_mutex);
+		if (!writer_thread.joinable()) {
+			writer_stop = false;
+			writer_thread = std::thread(writer_loop);
+		}
+		seq = ++queued_seq;
+		ops.push_back({type, path, text, replace, seq});
+	}
+	writer_cv.notify_all();
+	return seq;
+}
+
+} // namespace
+
+void transcript_file_write(const std::string &path, const std::string &text, bool replace)
+{
+	if (path.empty()) {
+		return;
+	}
+	queue_op(file_op_type::Write, path, text, replace);
+}
+
+void transcript_file_truncate(const std::string &path)
+{
+	if (path.empty()) {
+		return;
+	}
+	queue_op(file_op_type::Truncate, path, "", false);
+}
+
+void transcript_file_close(const std::string &path)
+{
+	if (path.empty()) {
+		return;
+	}
+	const uint64_t seq = queue_op(file_op_type::Close, path, "", false);
+	std::unique_lock<std::mutex> lock(writer_mutex);
+	writer_cv.wait(lock, [seq] { return done_seq >= seq; });
+}
+
+void shutdown_transcript_file_writer(void)
+{
+	{
+		std::lock_guard<std::mutex> lock(writer_mutex);
+		writer_stop = true;
+	}
+	writer_cv.notify_all();
+	if (writer_thread.joinable()) {
+		writer_thread.join();
+	}
+}
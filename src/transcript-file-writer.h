@@ -0,0 +1,61 @@
+/**
+ * @file transcript-file-writer.h
+ * @brief Background writer of the transcript files (text, SRT).
+ *
+ * The transcript lines are queued by the whisper and translation threads and written by a
+ * single writer thread, which keeps the files open: the lines are buffered and flushed at most
+ * every TRANSCRIPT_FILE_FLUSH_MS, synced to disk every TRANSCRIPT_FILE_SYNC_SECONDS, and a file
+ * is closed when it was not written for TRANSCRIPT_FILE_IDLE_SECONDS or when it is closed
+ * explicitly, e.g. before it is renamed at the end of a recording. The operations on a file are
+ * done in the order they were queued.
+ */
+#ifndef TRANSCRIPT_FILE_WRITER_H
+#define TRANSCRIPT_FILE_WRITER_H
+
+#ifdef __cplusplus
+#include <string>
+
+// maximal time the written lines stay in the buffer
+#define TRANSCRIPT_FILE_FLUSH_MS 1000
+// maximal time the flushed lines are not synced to disk
+#define TRANSCRIPT_FILE_SYNC_SECONDS 5
+// a file not written for that long is closed
+#define TRANSCRIPT_FILE_IDLE_SECONDS 30
+
+/**
+ * @brief Queue text to write to the file.
+ *
+ * @param path Path of the file, UTF-8.
+ * @param text Text to write.
+ * @param replace Replace the content of the file instead of appending to it. The file is
+ * flushed right away, since it is read for its current content.
+ */
+void transcript_file_write(const std::string &path, const std::string &text, bool replace);
+
+/**
+ * @brief Queue the truncation of the file, if it exists.
+ */
+void transcript_file_truncate(const std::string &path);
+
+/**
+ * @brief Write the queued text of the file, sync and close it.
+ *
+ * Returns once the file is closed, so it can be renamed or removed.
+ */
+void transcript_file_close(const std::string &path);
+
+extern "C" {
+#endif
+
+/**
+ * @brief Write the queued text, close all the files and stop the writer thread.
+ *
+ * Called on module unload.
+ */
+void shutdown_transcript_file_writer(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TRANSCRIPT_FILE_WRITER_H
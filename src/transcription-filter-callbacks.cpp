@@ -7,133 +7,97 @@
 #include <obs-frontend-api.h>
 
 #include <curl/curl.h>
+#include <nlohmann/json.hpp>
 
 #include <fstream>
+#include <sstream>
 #include <iomanip>
 #include <regex>
 #include <string>
 #include <vector>
 #include <filesystem>
+#include <algorithm>
 
 #include "transcription-filter-callbacks.h"
+#include "audio-archive.h"
+#include "caption-server.h"
+#include "caption-source-updater.h"
+#include "recording-retranscription.h"
+#include "plugin-log.h"
+#include "transcript-file-writer.h"
 #include "transcription-utils.h"
 #include "translation/translation.h"
 #include "translation/translation-includes.h"
+#include "whisper-utils/vad-processing.h"
 #include "whisper-utils/whisper-language.h"
 #include "whisper-utils/whisper-utils.h"
 #include "whisper-utils/whisper-model-utils.h"
 #include "translation/language_codes.h"
 #include "translation/cloud-translation/translation-cloud.h"
-
-bool whisper_abort_callback(void *data)
-{
-	// Seems like data is usually a string?
-	obs_log(LOG_DEBUG, "Error in GGML processing - %s", (char *)(data));
-	return false;
-}
+#include "ui/filter-replace-utils.h"
 
 void send_caption_to_source(const std::string &target_source_name, const std::string &caption,
 			    struct transcription_filter_data *gf)
 {
-	if (target_source_name.empty()) {
-		return;
-	}
-	auto target = obs_get_source_by_name(target_source_name.c_str());
-	if (!target) {
-		obs_log(gf->log_level, "text_source target is null");
-		return;
-	}
-	auto text_settings = obs_source_get_settings(target);
-	obs_data_set_string(text_settings, "text", caption.c_str());
-	obs_source_update(target, text_settings);
-	obs_source_release(target);
+	// written by the updater thread, at most once per caption_update_interval_us
+	queue_caption_update(gf, target_source_name, caption);
 }
 
-void audio_chunk_callback(struct transcription_filter_data *gf, const float *pcm32f_data,
-			  size_t frames, int vad_state, const DetectionResultWithText &result)
+// Type of the caption for the caption server
+const char *caption_server_type(TranslationType translation_type)
 {
-	UNUSED_PARAMETER(gf);
-	UNUSED_PARAMETER(pcm32f_data);
-	UNUSED_PARAMETER(frames);
-	UNUSED_PARAMETER(vad_state);
-	UNUSED_PARAMETER(result);
-	// stub
+	switch (translation_type) {
+	case NO_TRANSLATION:
+		return "transcription";
+	case CLOUD_TRANSLATION:
+		return "cloud_translation";
+	default:
+		return "translation";
+	}
 }
 
-std::string send_sentence_to_translation(const std::string &sentence,
-					 struct transcription_filter_data *gf,
-					 const std::string &source_language)
+void send_buffered_caption(struct transcription_filter_data *gf, TranslationType translation_type,
+			   const std::string &caption)
 {
-	const std::string last_text = gf->last_text_for_translation;
-	gf->last_text_for_translation = sentence;
-	if (gf->translate && !sentence.empty()) {
-		obs_log(gf->log_level, "Translating text. %s -> %s", source_language.c_str(),
-			gf->target_lang.c_str());
-		std::string translated_text;
-		if (sentence == last_text) {
-			// do not translate the same sentence twice
-			return gf->last_text_translation;
+	if (!gf->buffered_output) {
+		return;
+	}
+	std::string output_source = gf->text_source_name;
+	std::string language;
+	switch (translation_type) {
+	case LOCAL_TRANSLATION:
+		if (!gf->translation_output.empty() && gf->translation_output != "none") {
+			output_source = gf->translation_output;
 		}
-		if (translate(gf->translation_ctx, sentence,
-			      language_codes_from_whisper[source_language], gf->target_lang,
-			      translated_text) == OBS_POLYGLOT_TRANSLATION_SUCCESS) {
-			if (gf->log_words) {
-				obs_log(LOG_INFO, "Translation: '%s' -> '%s'", sentence.c_str(),
-					translated_text.c_str());
-			}
-			gf->last_text_translation = translated_text;
-			return translated_text;
-		} else {
-			obs_log(gf->log_level, "Failed to translate text");
+		language = gf->target_lang;
+		break;
+	case CLOUD_TRANSLATION:
+		if (!gf->translate_cloud_output.empty() && gf->translate_cloud_output != "none") {
+			output_source = gf->translate_cloud_output;
+		}
+		language = gf->translate_cloud_target_language;
+		break;
+	default:
+		if (gf->whisper_params.language != nullptr) {
+			language = gf->whisper_params.language;
 		}
 	}
-	return "";
+	send_caption_to_source(output_source, caption, gf);
+	caption_server_publish(gf, "buffered", caption_server_type(translation_type), language,
+			       caption, false);
 }
 
-void send_sentence_to_cloud_translation_async(const std::string &sentence,
-					      struct transcription_filter_data *gf,
-					      const std::string &source_language,
-					      std::function<void(const std::string &)> callback)
+void audio_chunk_callback(struct transcription_filter_data *gf, const float *pcm32f_data,
+			  size_t frames, int vad_state, const DetectionResultWithText &result)
 {
-	std::thread([sentence, gf, source_language, callback]() {
-		try {
-			const std::string last_text = gf->last_text_for_cloud_translation;
-			gf->last_text_for_cloud_translation = sentence;
-			if (gf->translate_cloud && !sentence.empty()) {
-				obs_log(gf->log_level,
-					"Translating text with cloud provider %s. %s -> %s",
-					gf->translate_cloud_config.provider.c_str(),
-					source_language.c_str(),
-					gf->translate_cloud_target_language.c_str());
-				std::string translated_text;
-				if (sentence == last_text) {
-					// do not translate the same sentence twice
-					callback(gf->last_text_cloud_translation);
-					return;
-				}
-
-				translated_text = translate_cloud(
-					gf->translate_cloud_config, sentence,
-					gf->translate_cloud_target_language, source_language);
-				if (!translated_text.empty()) {
-					if (gf->log_words) {
-						obs_log(LOG_INFO, "Cloud Translation: '%s' -> '%s'",
-							sentence.c_str(), translated_text.c_str());
-					}
-					gf->last_text_translation = translated_text;
-					callback(translated_text);
-					return;
-				} else {
-					obs_log(gf->log_level, "Failed to translate text");
-				}
-			}
-		} catch (const std::exception &e) {
-			obs_log(LOG_ERROR, "Error translating text with cloud: %s", e.what());
-		} catch (...) {
-			obs_log(LOG_ERROR, "Error translating text with cloud");
-		}
-		callback("");
-	}).detach();
+	// update replaces the settings while the whisper threads run
+	const std::shared_ptr<const audio_archive_settings> settings =
+		std::atomic_load(&gf->audio_archive);
+	if (!settings || (vad_state == VAD_STATE_IS_OFF && !settings->silence)) {
+		return;
+	}
+	audio_archive_queue(gf, *settings, gf->start_timestamp_ms, pcm32f_data, frames, vad_state,
+			    result);
 }
 
 void send_sentence_to_file(struct transcription_filter_data *gf,
@@ -146,37 +110,24 @@ void send_sentence_to_file(struct transcription_filter_data *gf,
 		return;
 	}
 
-	// should the file be truncated?
-	std::ios_base::openmode openmode = std::ios::out;
-	if (gf->truncate_output_file) {
-		openmode |= std::ios::trunc;
-	} else {
-		openmode |= std::ios::app;
-	}
 	if (!gf->save_srt) {
-		obs_log(gf->log_level, "Saving sentence '%s' to file %s", sentence.c_str(),
+		OBS_LOG(gf->log_level, "Saving sentence '%s' to file %s", sentence.c_str(),
 			gf->output_file_path.c_str());
 		// Write raw sentence to text file (non-srt format)
-		try {
-			std::ofstream output_file(file_path, openmode);
-			output_file << sentence << std::endl;
-			output_file.close();
-		} catch (const std::ofstream::failure &e) {
-			obs_log(LOG_ERROR, "Exception opening/writing/closing file: %s", e.what());
-		}
+		transcript_file_write(file_path, sentence + "\n", gf->truncate_output_file);
 	} else {
 		if (result.start_timestamp_ms == 0 && result.end_timestamp_ms == 0) {
 			// No timestamps, do not save the sentence to srt
 			return;
 		}
 
-		obs_log(gf->log_level, "Saving sentence to file %s, sentence #%d",
-			file_path.c_str(), gf->sentence_number);
+		OBS_LOG(gf->log_level, "Saving sentence to file %s, sentence #%d",
+			file_path.c_str(), (int)gf->sentence_number);
 		// Append sentence to file in .srt format
-		std::ofstream output_file(file_path, openmode);
-		output_file << gf->sentence_number << std::endl;
+		std::ostringstream output_stream;
+		output_stream << gf->sentence_number << "\n";
 		// use the start and end timestamps to calculate the start and end time in srt format
-		auto format_ts_for_srt = [](std::ofstream &output_stream, uint64_t ts) {
+		auto format_ts_for_srt = [](std::ostringstream &stream, uint64_t ts) {
 			uint64_t time_s = ts / 1000;
 			uint64_t time_m = time_s / 60;
 			uint64_t time_h = time_m / 60;
@@ -184,19 +135,19 @@ void send_sentence_to_file(struct transcription_filter_data *gf,
 			uint64_t time_s_rem = time_s % 60;
 			uint64_t time_m_rem = time_m % 60;
 			uint64_t time_h_rem = time_h % 60;
-			output_stream << std::setfill('0') << std::setw(2) << time_h_rem << ":"
-				      << std::setfill('0') << std::setw(2) << time_m_rem << ":"
-				      << std::setfill('0') << std::setw(2) << time_s_rem << ","
-				      << std::setfill('0') << std::setw(3) << time_ms_rem;
+			stream << std::setfill('0') << std::setw(2) << time_h_rem << ":"
+			       << std::setfill('0') << std::setw(2) << time_m_rem << ":"
+			       << std::setfill('0') << std::setw(2) << time_s_rem << ","
+			       << std::setfill('0') << std::setw(3) << time_ms_rem;
 		};
-		format_ts_for_srt(output_file, result.start_timestamp_ms);
-		output_file << " --> ";
-		format_ts_for_srt(output_file, result.end_timestamp_ms);
-		output_file << std::endl;
+		format_ts_for_srt(output_stream, result.start_timestamp_ms);
+		output_stream << " --> ";
+		format_ts_for_srt(output_stream, result.end_timestamp_ms);
+		output_stream << "\n";
 
-		output_file << sentence << std::endl;
-		output_file << std::endl;
-		output_file.close();
+		output_stream << sentence << "\n";
+		output_stream << "\n";
+		transcript_file_write(file_path, output_stream.str(), gf->truncate_output_file);
 
 		if (bump_sentence_number) {
 			gf->sentence_number++;
@@ -211,7 +162,7 @@ void send_translated_sentence_to_file(struct transcription_filter_data *gf,
 {
 	// if translation is enabled, save the translated sentence to another file
 	if (translated_sentence.empty()) {
-		obs_log(gf->log_level, "Translation is empty, not saving to file");
+		OBS_LOG(gf->log_level, "Translation is empty, not saving to file");
 	} else {
 		// add a postfix to the file name (without extension) with the translation target language
 		std::string translated_file_path = "";
@@ -227,7 +178,59 @@ void send_translated_sentence_to_file(struct transcription_filter_data *gf,
 	}
 }
 
-void send_caption_to_stream(DetectionResultWithText result, const std::string &str_copy,
+// The JSON lines file next to the output file: same name, .jsonl extension
+std::string jsonl_file_path(const std::string &output_file_path)
+{
+	std::filesystem::path path = std::filesystem::u8path(output_file_path);
+	if (path.extension() == ".jsonl") {
+		return output_file_path + ".jsonl";
+	}
+	return path.replace_extension(".jsonl").u8string();
+}
+
+void send_segment_to_jsonl(struct transcription_filter_data *gf,
+			   const DetectionResultWithText &result, const std::string &text)
+{
+	if (gf->save_only_while_recording && !obs_frontend_recording_active()) {
+		return;
+	}
+	// one segment per line, times in seconds, token times are in 10 ms units in the segment
+	nlohmann::json segment;
+	segment["start"] = (double)result.start_timestamp_ms / 1000.0;
+	segment["end"] = (double)result.end_timestamp_ms / 1000.0;
+	segment["language"] = result.language;
+	if (gf->input_channel >= 0) {
+		// the transcripts of the channels of a source are told apart by it
+		segment["channel"] = gf->input_channel + 1;
+	}
+	segment["partial"] = result.result == DETECTION_RESULT_PARTIAL;
+	segment["text"] = text;
+	nlohmann::json tokens = nlohmann::json::array();
+	for (size_t i = 0; i < result.tokens.size(); i++) {
+		const whisper_token_data &token = result.tokens[i];
+		nlohmann::json token_json;
+		token_json["id"] = token.id;
+		token_json["text"] = i < result.token_texts.size() ? result.token_texts[i] : "";
+		// no timestamps without token_timestamps
+		if (token.t0 >= 0 && token.t1 >= 0) {
+			const double start_s = (double)result.start_timestamp_ms / 1000.0;
+			token_json["t0"] = start_s + (double)token.t0 / 100.0;
+			token_json["t1"] = start_s + (double)token.t1 / 100.0;
+		} else {
+			token_json["t0"] = nullptr;
+			token_json["t1"] = nullptr;
+		}
+		token_json["p"] = token.p;
+		tokens.push_back(std::move(token_json));
+	}
+	segment["tokens"] = std::move(tokens);
+	// invalid UTF-8 of a partial token is replaced, not thrown on
+	const std::string line =
+		segment.dump(-1, ' ', false, nlohmann::json::error_handler_t::replace);
+	transcript_file_write(jsonl_file_path(gf->output_file_path), line + "\n", false);
+}
+
+void send_caption_to_stream(const DetectionResultWithText &result, const std::string &str_copy,
 			    struct transcription_filter_data *gf)
 {
 	obs_output_t *streaming_output = obs_frontend_get_streaming_output();
@@ -237,7 +240,7 @@ void send_caption_to_stream(DetectionResultWithText result, const std::string &s
 			(double)(result.end_timestamp_ms - result.start_timestamp_ms) / 1000.0;
 		// prevent the duration from being too short or too long
 		const double effective_duration = std::min(std::max(2.0, duration), 7.0);
-		obs_log(gf->log_level,
+		OBS_LOG(gf->log_level,
 			"Sending caption to streaming output: %s (raw duration %.3f, effective duration %.3f)",
 			str_copy.c_str(), duration, effective_duration);
 		// TODO: find out why setting short duration does not work
@@ -247,50 +250,135 @@ void send_caption_to_stream(DetectionResultWithText result, const std::string &s
 	}
 }
 
+void send_roll_up_caption_to_stream(struct transcription_filter_data *gf,
+				    const std::string &caption)
+{
+	// the audio time of the tokens added since the previous caption: the captions are
+	// queued by the output, each one is shown for its duration before the next one
+	const uint64_t duration_ms = std::clamp<uint64_t>(gf->stream_caption_pending_ms.exchange(0),
+							  STREAM_CAPTION_MIN_DURATION_MS,
+							  STREAM_CAPTION_MAX_DURATION_MS);
+	obs_output_t *streaming_output = obs_frontend_get_streaming_output();
+	if (streaming_output) {
+		// the lines of the monitor end with a new line
+		const size_t end = caption.find_last_not_of('\n');
+		const std::string text = end == std::string::npos ? "" : caption.substr(0, end + 1);
+		OBS_LOG(gf->log_level, "Sending roll-up caption to streaming output: %s (%llu ms)",
+			text.c_str(), (unsigned long long)duration_ms);
+		obs_output_output_caption_text2(streaming_output, text.c_str(),
+						(double)duration_ms / 1000.0);
+		obs_output_release(streaming_output);
+	}
+}
+
+// Steady clock times at which the tokens of the result were spoken
+std::vector<TokenBufferTimePoint> token_spoken_times(const struct transcription_filter_data *gf,
+						     const DetectionResultWithText &result)
+{
+	// the result timestamps are offsets from start_timestamp_ms, a system clock time
+	const auto steady_now = std::chrono::steady_clock::now();
+	const int64_t segment_start_ms = (int64_t)(gf->start_timestamp_ms +
+						   result.start_timestamp_ms) -
+					 (int64_t)now_ms();
+	std::vector<TokenBufferTimePoint> times;
+	times.reserve(result.tokens.size());
+	int64_t last_cs = 0;
+	for (const auto &token : result.tokens) {
+		// the DTW time when it was computed, else the end of the token, in 10 ms units
+		// from the start of the segment
+		last_cs = std::max(last_cs, token.t_dtw >= 0 ? token.t_dtw : token.t1);
+		times.push_back(steady_now +
+				std::chrono::milliseconds(segment_start_ms + last_cs * 10));
+	}
+	return times;
+}
+
+// Add the transcription to the stream caption monitor, with the audio time of its new tokens
+void queue_roll_up_caption(struct transcription_filter_data *gf,
+			   const DetectionResultWithText &result, const std::string &text)
+{
+	// the partials of a segment share its start: only the audio after the previous result
+	// brings new tokens
+	const uint64_t start_ms = std::max(result.start_timestamp_ms, gf->stream_caption_end_ms);
+	if (result.end_timestamp_ms > start_ms) {
+		gf->stream_caption_pending_ms += result.end_timestamp_ms - start_ms;
+		gf->stream_caption_end_ms = result.end_timestamp_ms;
+	}
+	gf->stream_caption_monitor.addSentenceFromStdString(
+		text, get_time_point_from_ms(result.start_timestamp_ms),
+		get_time_point_from_ms(result.end_timestamp_ms),
+		result.result == DETECTION_RESULT_PARTIAL);
+}
+
 #ifdef ENABLE_WEBVTT
-void send_caption_to_webvtt(uint64_t possible_end_ts_ms, DetectionResultWithText result,
-			    const std::string &str_copy, transcription_filter_data &gf)
+// The cue goes to the track of the language, the result language or the one of a translation
+void send_caption_to_webvtt(uint64_t possible_end_ts_ms, const DetectionResultWithText &result,
+			    const std::string &language, const std::string &str_copy,
+			    transcription_filter_data &gf)
 {
 	auto lock = std::unique_lock(gf.active_outputs_mutex);
 	for (auto &output : gf.active_outputs) {
 		if (!gf.webvtt_caption_to_recording &&
-		    output.output_type == transcription_filter_data::webvtt_output_type::Recording)
+		    output->output_type == transcription_filter_data::webvtt_output_type::Recording)
 			continue;
 		if (!gf.webvtt_caption_to_stream &&
-		    output.output_type == transcription_filter_data::webvtt_output_type::Streaming)
+		    output->output_type == transcription_filter_data::webvtt_output_type::Streaming)
 			continue;
 
-		auto lang_to_track = output.language_to_track.find(result.language);
-		if (lang_to_track == output.language_to_track.end())
+		auto lang_to_track = output->language_to_track.find(language);
+		if (lang_to_track == output->language_to_track.end())
 			continue;
 
-		for (size_t i = 0; i < MAX_OUTPUT_VIDEO_ENCODERS; i++) {
-			auto &muxer = output.webvtt_muxer[i];
-			if (!muxer)
-				continue;
-
-			auto duration = result.end_timestamp_ms - result.start_timestamp_ms;
-			auto segment_start_ts = possible_end_ts_ms - duration;
-			if (segment_start_ts < output.start_timestamp_ms) {
-				duration -= output.start_timestamp_ms - segment_start_ts;
-				segment_start_ts = output.start_timestamp_ms;
-			}
-			webvtt_muxer_add_cue(muxer.get(), lang_to_track->second,
-					     segment_start_ts - output.start_timestamp_ms, duration,
-					     str_copy.c_str());
+		auto duration = result.end_timestamp_ms - result.start_timestamp_ms;
+		auto segment_start_ts = possible_end_ts_ms - duration;
+		if (segment_start_ts < output->start_timestamp_ms) {
+			duration -= output->start_timestamp_ms - segment_start_ts;
+			segment_start_ts = output->start_timestamp_ms;
 		}
+		// added to the muxers by the packet callback of the output
+		output->cues.push(lang_to_track->second,
+				  segment_start_ts - output->start_timestamp_ms, duration,
+				  str_copy);
 	}
 }
 #endif
 
+// Name of the track of the segment in the trace
+static const char *trace_output_name(TranslationType translation_type,
+				     const DetectionResultWithText &result)
+{
+	switch (translation_type) {
+	case LOCAL_TRANSLATION:
+		return "translation";
+	case LOCAL_EXTRA_TRANSLATION:
+		return "extra translation";
+	case CLOUD_TRANSLATION:
+		return "cloud translation";
+	default:
+		return result.result == DETECTION_RESULT_PARTIAL ? "partial caption" : "caption";
+	}
+}
+
 void output_text(struct transcription_filter_data *gf, const DetectionResultWithText &result,
-		 uint64_t possible_end_ts, std::string text, std::string output_source,
-		 TranslationType translation_type)
+		 uint64_t possible_end_ts, const std::string &text,
+		 const std::string &output_source, TranslationType translation_type,
+		 const std::string &target_language)
 {
 	try {
+		StageTimer timer(gf->pipeline_timings, PIPELINE_STAGE_OUTPUT);
+		SegmentTraceScope trace(gf->segment_trace, result.trace_id, "output");
 		obs_log(LOG_DEBUG, "-- outputting text (translation: %d) -- %s", translation_type,
 			text.c_str());
-		if (gf->buffered_output) {
+		if (translation_type == NO_TRANSLATION &&
+		    result.result == DETECTION_RESULT_SPEECH) {
+			// from the end of the audio of the caption to its output
+			const int64_t latency_ms = (int64_t)(now_ms() - gf->start_timestamp_ms) -
+						   (int64_t)result.end_timestamp_ms;
+			if (latency_ms >= 0) {
+				gf->metrics.add_caption_latency((uint64_t)latency_ms);
+			}
+		}
+		if (gf->buffered_output && translation_type != LOCAL_EXTRA_TRANSLATION) {
 			obs_log(LOG_DEBUG, "-- buffered text output -- %s", text.c_str());
 			TokenBufferThread *monitor;
 			switch (translation_type) {
@@ -306,7 +394,15 @@ void output_text(struct transcription_filter_data *gf, const DetectionResultWith
 			default:
 				monitor = nullptr;
 			}
-			if (monitor != nullptr) {
+			gf->segment_trace.instant(result.trace_id, "token_buffer",
+						  SegmentTrace::now_us());
+			if (monitor != nullptr && translation_type == NO_TRANSLATION &&
+			    gf->buffered_output_timed && !result.tokens.empty()) {
+				const bool is_partial = result.result == DETECTION_RESULT_PARTIAL;
+				monitor->addTimedSentence(text, result.token_texts,
+							  token_spoken_times(gf, result),
+							  is_partial);
+			} else if (monitor != nullptr) {
 				monitor->addSentenceFromStdString(
 					text, get_time_point_from_ms(result.start_timestamp_ms),
 					get_time_point_from_ms(result.end_timestamp_ms),
@@ -316,13 +412,30 @@ void output_text(struct transcription_filter_data *gf, const DetectionResultWith
 			// non-buffered output - send the sentence to the selected source
 			obs_log(LOG_DEBUG, "-- text output to source %s -- %s",
 				output_source.c_str(), text.c_str());
+			gf->segment_trace.instant(result.trace_id, "text_source",
+						  SegmentTrace::now_us());
 			send_caption_to_source(output_source, text, gf);
 		}
 
+		std::string caption_language = result.language;
+		if (translation_type == LOCAL_TRANSLATION) {
+			caption_language = gf->target_lang;
+		} else if (translation_type == LOCAL_EXTRA_TRANSLATION) {
+			caption_language = target_language;
+		} else if (translation_type == CLOUD_TRANSLATION) {
+			caption_language = gf->translate_cloud_target_language;
+		}
+		caption_server_publish(gf, "caption", caption_server_type(translation_type),
+				       caption_language, text,
+				       result.result == DETECTION_RESULT_PARTIAL);
+
 		if (gf->caption_to_stream && translation_type == NO_TRANSLATION &&
-		    result.result == DETECTION_RESULT_SPEECH) {
-			// TODO: add support for partial transcriptions
-			if (output_source == gf->text_source_name) {
+		    output_source == gf->text_source_name) {
+			if (gf->stream_caption_mode == STREAM_CAPTION_ROLL_UP) {
+				obs_log(LOG_DEBUG, "-- roll-up stream captions output -- %s",
+					text.c_str());
+				queue_roll_up_caption(gf, result, text);
+			} else if (result.result == DETECTION_RESULT_SPEECH) {
 				obs_log(LOG_DEBUG, "-- stream captions output -- %s", text.c_str());
 				send_caption_to_stream(result, text, gf);
 			}
@@ -331,29 +444,44 @@ void output_text(struct transcription_filter_data *gf, const DetectionResultWith
 		if (gf->save_to_file && gf->output_file_path != "" &&
 		    result.result == DETECTION_RESULT_SPEECH) {
 			obs_log(LOG_DEBUG, "-- file output -- %s", text.c_str());
-			send_sentence_to_file(gf, result, text, gf->output_file_path, true);
+			if (translation_type == LOCAL_EXTRA_TRANSLATION) {
+				send_translated_sentence_to_file(gf, result, text, target_language);
+			} else {
+				send_sentence_to_file(gf, result, text, gf->output_file_path, true);
+			}
 		}
 #ifdef ENABLE_WEBVTT
 		if (result.result == DETECTION_RESULT_SPEECH) {
 			obs_log(LOG_DEBUG, "-- webvtt output -- %s", text.c_str());
+			gf->segment_trace.instant(result.trace_id, "webvtt_cue",
+						  SegmentTrace::now_us());
 			if (translation_type == NO_TRANSLATION) {
-				send_caption_to_webvtt(possible_end_ts, result, text, *gf);
+				send_caption_to_webvtt(possible_end_ts, result, result.language,
+						       text, *gf);
 			} else {
-				auto target_language_code =
-					translation_type == LOCAL_TRANSLATION
-						? gf->target_lang
-						: gf->translate_cloud_target_language;
+				std::string target_language_code =
+					gf->translate_cloud_target_language;
+				if (translation_type == LOCAL_TRANSLATION) {
+					target_language_code = gf->target_lang;
+				} else if (translation_type == LOCAL_EXTRA_TRANSLATION) {
+					target_language_code = target_language;
+				}
 				auto target_lang =
 					language_codes_to_whisper.find(target_language_code);
 				if (target_lang != language_codes_to_whisper.end()) {
-					auto res_copy = result;
-					res_copy.language = target_lang->second;
-					send_caption_to_webvtt(possible_end_ts, res_copy, text,
-							       *gf);
+					send_caption_to_webvtt(possible_end_ts, result,
+							       target_lang->second, text, *gf);
 				}
 			}
 		}
 #endif
+		if (result.trace_id != 0) {
+			// the whole chain of the output, from the first audio of the segment
+			gf->segment_trace.segment_span(
+				result.trace_id, trace_output_name(translation_type, result),
+				(gf->start_timestamp_ms + result.start_timestamp_ms) * 1000,
+				SegmentTrace::now_us());
+		}
 	} catch (const std::exception &e) {
 		obs_log(LOG_ERROR, "Error outputting text: %s", e.what());
 	} catch (...) {
@@ -362,9 +490,10 @@ void output_text(struct transcription_filter_data *gf, const DetectionResultWith
 }
 
 void set_text_callback(uint64_t possible_end_ts, struct transcription_filter_data *gf,
-		       const DetectionResultWithText &resultIn)
+		       const SharedDetectionResult &shared_result)
 {
-	DetectionResultWithText result = resultIn;
+	// the translation workers keep shared_result, the outputs only use it during the call
+	const DetectionResultWithText &result = *shared_result;
 
 	std::string str_copy = result.text;
 
@@ -378,28 +507,31 @@ void set_text_callback(uint64_t possible_end_ts, struct transcription_filter_dat
 	}
 
 	// if suppression is enabled, check if the text is in the suppression list
-	if (!gf->filter_words_replace.empty()) {
+	const std::shared_ptr<const WordFilter> word_filter =
+		std::atomic_load(&gf->filter_words_compiled);
+	if (word_filter && !word_filter->empty()) {
 		const std::string original_str_copy = str_copy;
-		// check if the text is in the suppression list
-		for (const auto &filter_words : gf->filter_words_replace) {
-			// if filter exists within str_copy, replace it with the replacement
-			str_copy = std::regex_replace(str_copy,
-						      std::regex(std::get<0>(filter_words),
-								 std::regex_constants::icase),
-						      std::get<1>(filter_words));
-		}
+		// replace the matches of all filters in one pass
+		str_copy = word_filter->apply(str_copy);
 		// if the text was modified, log the original and modified text
 		if (original_str_copy != str_copy) {
-			obs_log(gf->log_level, "------ Suppressed text: '%s' -> '%s'",
+			OBS_LOG(gf->log_level, "------ Suppressed text: '%s' -> '%s'",
 				original_str_copy.c_str(), str_copy.c_str());
 		}
 	}
 
 #ifdef ENABLE_WEBVTT
 	if (result.result == DETECTION_RESULT_SPEECH)
-		send_caption_to_webvtt(possible_end_ts, result, str_copy, *gf);
+		send_caption_to_webvtt(possible_end_ts, result, result.language, str_copy, *gf);
 #endif
 
+	if (gf->save_to_file && gf->save_jsonl && !gf->output_file_path.empty() &&
+	    !str_copy.empty() &&
+	    (result.result == DETECTION_RESULT_SPEECH ||
+	     result.result == DETECTION_RESULT_PARTIAL)) {
+		send_segment_to_jsonl(gf, result, str_copy);
+	}
+
 	bool should_translate_cloud = (gf->translate_cloud_only_full_sentences
 					       ? result.result == DETECTION_RESULT_SPEECH
 					       : true) &&
@@ -413,42 +545,23 @@ void set_text_callback(uint64_t possible_end_ts, struct transcription_filter_dat
 		should_translate_cloud && (gf->translate_cloud_output == gf->translation_output);
 
 	if (should_translate_cloud) {
-		send_sentence_to_cloud_translation_async(
-			str_copy, gf, result.language,
-			[gf, result,
-			 possible_end_ts](const std::string &translated_sentence_cloud) {
-				if (!translated_sentence_cloud.empty()) {
-					output_text(gf, result, possible_end_ts,
-						    translated_sentence_cloud,
-						    gf->translate_cloud_output.empty()
-							    ? gf->text_source_name
-							    : gf->translate_cloud_output,
-						    CLOUD_TRANSLATION);
-				}
-			});
+		// translated and output by the cloud translation workers
+		queue_sentence_for_cloud_translation(gf, shared_result, possible_end_ts, str_copy);
 	}
 
 	if (should_translate_local) {
 		if (cloud_translation_overrides_local) {
-			obs_log(gf->log_level,
+			OBS_LOG(gf->log_level,
 				"Skipping local translation as cloud translation outputs to same source");
 		} else {
-			// send the sentence to translation (if enabled)
-			std::string translated_sentence_local =
-				should_translate_local
-					? send_sentence_to_translation(str_copy, gf,
-								       result.language)
-					: "";
-
-			output_text(gf, result, possible_end_ts, translated_sentence_local,
-				    gf->translation_output.empty() ? gf->text_source_name
-								   : gf->translation_output,
-				    LOCAL_TRANSLATION);
+			// translated and output by the translation worker
+			queue_sentence_for_translation(gf, shared_result, possible_end_ts,
+						       str_copy);
 		}
 	}
 
-	obs_log(gf->log_level, "gf->translation_output: %s", gf->translation_output.c_str());
-	obs_log(gf->log_level, "gf->text_source_name: %s", gf->text_source_name.c_str());
+	OBS_LOG(gf->log_level, "gf->translation_output: %s", gf->translation_output.c_str());
+	OBS_LOG(gf->log_level, "gf->text_source_name: %s", gf->text_source_name.c_str());
 
 	bool cloud_translate_outputs_to_default_source =
 		gf->translate_cloud_output.empty() ||
@@ -460,10 +573,10 @@ void set_text_callback(uint64_t possible_end_ts, struct transcription_filter_dat
 	bool local_translation_overrides_captions = should_translate_local &&
 						    local_translate_outputs_to_default_source;
 	if (cloud_translation_overrides_captions) {
-		obs_log(gf->log_level,
+		OBS_LOG(gf->log_level,
 			"Skipping caption output as cloud translation outputs to same source");
 	} else if (local_translation_overrides_captions) {
-		obs_log(gf->log_level,
+		OBS_LOG(gf->log_level,
 			"Skipping caption output as local translation outputs to same source");
 	} else {
 		// not translating or translation outputting to separate source
@@ -475,21 +588,52 @@ void set_text_callback(uint64_t possible_end_ts, struct transcription_filter_dat
 				     result.result == DETECTION_RESULT_PARTIAL)) {
 		gf->last_sub_render_time = now_ms();
 		gf->cleared_last_sub = false;
-		if (result.result == DETECTION_RESULT_SPEECH) {
-			obs_log(LOG_DEBUG, "-- store whisper transcription output -- %s",
-				result.text.c_str());
-			// save the last subtitle if it was a full sentence
-			gf->last_transcription_sentence.push_back(result.text);
-			// remove the oldest sentence if the buffer is too long
-			while (gf->last_transcription_sentence.size() >
-			       (size_t)gf->n_context_sentences) {
-				gf->last_transcription_sentence.pop_front();
-			}
-		}
 	}
 };
 
 #ifdef ENABLE_WEBVTT
+void init_webvtt_muxers(obs_output_t *output, transcription_filter_data::webvtt_output &entry)
+{
+	for (size_t i = 0; i < MAX_OUTPUT_VIDEO_ENCODERS; i++) {
+		auto encoder = obs_output_get_video_encoder2(output, i);
+		if (!encoder)
+			continue;
+
+		auto &codec_flavor = entry.codec_flavor[i];
+		if (strcmp(obs_encoder_get_codec(encoder), "h264") == 0) {
+			codec_flavor = H264AnnexB;
+		} else if (strcmp(obs_encoder_get_codec(encoder), "av1") == 0) {
+			codec_flavor = AV1OBUs;
+		} else if (strcmp(obs_encoder_get_codec(encoder), "hevc") == 0) {
+			codec_flavor = H265AnnexB;
+		} else {
+			continue;
+		}
+
+		auto video = obs_encoder_video(encoder);
+		auto voi = video_output_get_info(video);
+
+		auto muxer_builder = webvtt_create_muxer_builder(
+			entry.latency_to_video_in_msecs, entry.send_frequency_hz,
+			util_mul_div64(1000000000ULL, voi->fps_den, voi->fps_num));
+		// the tracks are in the order of language_to_track
+		for (auto &lang : entry.languages) {
+			auto lang_it = whisper_available_lang.find(lang);
+			webvtt_muxer_builder_add_track(muxer_builder, false, false, false,
+						       lang_it->second.c_str(), lang.c_str(),
+						       nullptr, nullptr);
+		}
+		entry.webvtt_muxer[i].reset(webvtt_muxer_builder_create_muxer(muxer_builder));
+	}
+}
+
+/**
+ * @brief Packet callback of a captioned output, on the encoder thread.
+ *
+ * It takes no lock: the entry is only used by this callback, and the cues are taken from the
+ * lock-free queue of the entry. The muxer emits a SEI payload at most send_frequency_hz times
+ * per second; the other packets are left unchanged.
+ */
 void output_packet_added_callback(obs_output_t *output, struct encoder_packet *pkt,
 				  struct encoder_packet_time *pkt_time, void *param)
 {
@@ -500,66 +644,27 @@ void output_packet_added_callback(obs_output_t *output, struct encoder_packet *p
 	if (pkt->track_idx >= MAX_OUTPUT_VIDEO_ENCODERS)
 		return;
 
-	auto &gf = *static_cast<transcription_filter_data *>(param);
-	auto lock = std::unique_lock(gf.active_outputs_mutex);
-	auto it = std::find_if(gf.active_outputs.begin(), gf.active_outputs.end(), [&](auto &val) {
-		return obs_weak_output_references_output(val.output, output);
-	});
-	if (it == gf.active_outputs.end())
-		return;
-
-	if (!it->initialized) {
-		it->initialized = true;
-		auto settings_lock = std::unique_lock(gf.webvtt_settings_mutex);
-		for (size_t i = 0; i < MAX_OUTPUT_VIDEO_ENCODERS; i++) {
-			auto encoder = obs_output_get_video_encoder2(output, i);
-			if (!encoder)
-				continue;
-
-			auto &codec_flavor = it->codec_flavor[i];
-			if (strcmp(obs_encoder_get_codec(encoder), "h264") == 0) {
-				codec_flavor = H264AnnexB;
-			} else if (strcmp(obs_encoder_get_codec(encoder), "av1") == 0) {
-				codec_flavor = AV1OBUs;
-			} else if (strcmp(obs_encoder_get_codec(encoder), "hevc") == 0) {
-				codec_flavor = H265AnnexB;
-			} else {
-				continue;
-			}
-
-			auto video = obs_encoder_video(encoder);
-			auto voi = video_output_get_info(video);
-
-			auto muxer_builder = webvtt_create_muxer_builder(
-				gf.latency_to_video_in_msecs, gf.send_frequency_hz,
-				util_mul_div64(1000000000ULL, voi->fps_den, voi->fps_num));
-			uint8_t track_index = 0;
-			// FIXME: this may be too lazy, i.e. languages should probably be locked in the signal handler instead
-			for (auto &lang : gf.active_languages) {
-				auto lang_it = whisper_available_lang.find(lang);
-				if (lang_it == whisper_available_lang.end()) {
-					obs_log(LOG_WARNING,
-						"requested language '%s' unknown, track not added",
-						lang.c_str());
-					continue;
-				}
+	auto &entry = *static_cast<transcription_filter_data::webvtt_output *>(param);
+	if (!entry.initialized) {
+		entry.initialized = true;
+		init_webvtt_muxers(output, entry);
+	}
 
-				webvtt_muxer_builder_add_track(muxer_builder, false, false, false,
-							       lang_it->second.c_str(),
-							       lang.c_str(), nullptr, nullptr);
-				it->language_to_track[lang] = track_index++;
-			}
-			it->webvtt_muxer[i].reset(webvtt_muxer_builder_create_muxer(muxer_builder));
+	entry.cues.consume([&entry](const webvtt_cue &cue) {
+		for (auto &muxer : entry.webvtt_muxer) {
+			if (muxer)
+				webvtt_muxer_add_cue(muxer.get(), cue.track, cue.start_ms,
+						     cue.duration_ms, cue.text.c_str());
 		}
-	}
+	});
 
-	auto &muxer = it->webvtt_muxer[pkt->track_idx];
+	auto &muxer = entry.webvtt_muxer[pkt->track_idx];
 	if (!muxer)
 		return;
 
 	std::unique_ptr<WebvttBuffer, webvtt_buffer_deleter> buffer{
 		webvtt_muxer_try_mux_into_bytestream(muxer.get(), pkt_time->cts, pkt->keyframe,
-						     it->codec_flavor[pkt->track_idx])};
+						     entry.codec_flavor[pkt->track_idx])};
 
 	if (!buffer)
 		return;
@@ -599,13 +704,30 @@ void add_webvtt_output(transcription_filter_data &gf, obs_output_t *output,
 
 	auto start_ms = now_ms();
 
+	auto entry = std::make_unique<transcription_filter_data::webvtt_output>();
+	entry->output = obs_output_get_weak_output(output);
+	entry->output_type = output_type;
+	entry->start_timestamp_ms = start_ms;
+	{
+		// the settings are fixed for the output, the packet callback does not lock them
+		auto settings_lock = std::unique_lock(gf.webvtt_settings_mutex);
+		entry->latency_to_video_in_msecs = gf.latency_to_video_in_msecs;
+		entry->send_frequency_hz = gf.send_frequency_hz;
+		for (auto &lang : gf.active_languages) {
+			if (whisper_available_lang.find(lang) == whisper_available_lang.end()) {
+				obs_log(LOG_WARNING,
+					"requested language '%s' unknown, track not added",
+					lang.c_str());
+				continue;
+			}
+			entry->language_to_track[lang] = (uint8_t)entry->languages.size();
+			entry->languages.push_back(lang);
+		}
+	}
+
 	auto lock = std::unique_lock(gf.active_outputs_mutex);
-	gf.active_outputs.push_back({});
-	auto &entry = gf.active_outputs.back();
-	entry.output = obs_output_get_weak_output(output);
-	entry.output_type = output_type;
-	entry.start_timestamp_ms = start_ms;
-	obs_output_add_packet_callback_(output, output_packet_added_callback, &gf);
+	obs_output_add_packet_callback_(output, output_packet_added_callback, entry.get());
+	gf.active_outputs.push_back(std::move(entry));
 }
 
 void remove_webvtt_output(transcription_filter_data &gf, obs_output_t *output)
@@ -616,10 +738,12 @@ void remove_webvtt_output(transcription_filter_data &gf, obs_output_t *output)
 	auto lock = std::unique_lock(gf.active_outputs_mutex);
 	for (auto iter = gf.active_outputs.begin(); iter != gf.active_outputs.end(); iter++) {
 		auto &webvtt_output = *iter;
-		if (!obs_weak_output_references_output(webvtt_output.output, output))
+		if (!obs_weak_output_references_output(webvtt_output->output, output))
 			continue;
 
-		obs_output_remove_packet_callback_(output, output_packet_added_callback, &gf);
+		// returns once the callback is not running, the entry can be freed
+		obs_output_remove_packet_callback_(output, output_packet_added_callback,
+						   webvtt_output.get());
 		gf.active_outputs.erase(iter);
 		return;
 	}
@@ -629,15 +753,55 @@ void remove_all_webvtt_outputs(std::unique_lock<std::mutex> & /*active_outputs_l
 			       transcription_filter_data &gf)
 {
 	for (auto &output : gf.active_outputs) {
-		auto obs_output = OBSOutputAutoRelease{obs_weak_output_get_output(output.output)};
+		auto obs_output = OBSOutputAutoRelease{obs_weak_output_get_output(output->output)};
 		if (!obs_output)
 			continue;
 
-		obs_output_remove_packet_callback_(obs_output, output_packet_added_callback, &gf);
+		obs_output_remove_packet_callback_(obs_output, output_packet_added_callback,
+						   output.get());
 	}
 }
 #endif
 
+// Queue the second pass of the recording that stopped, from the audio archive
+static void queue_retranscription(struct transcription_filter_data *gf)
+{
+	const uint64_t start_ms = gf->recording_start_ms;
+	gf->recording_start_ms = 0;
+	const std::shared_ptr<const audio_archive_settings> archive =
+		std::atomic_load(&gf->audio_archive);
+	if (!gf->retranscribe_recordings || !archive || archive->folder.empty() ||
+	    gf->retranscribe_model_path.empty() || start_ms == 0) {
+		return;
+	}
+	char *recording_file_name = obs_frontend_get_last_recording();
+	if (recording_file_name == nullptr) {
+		return;
+	}
+	// next to the recording, like the renamed transcript files
+	const std::filesystem::path recording_path = std::filesystem::u8path(recording_file_name);
+	bfree(recording_file_name);
+	retranscription_job job;
+	job.archive_folder = archive->folder;
+	job.start_ms = start_ms;
+	job.end_ms = now_ms();
+	job.model_path = gf->retranscribe_model_path;
+	{
+		std::lock_guard<std::mutex> lock(gf->whisper_params_mutex);
+		if (gf->whisper_params.language != nullptr &&
+		    strcmp(gf->whisper_params.language, "auto") != 0) {
+			job.language = gf->whisper_params.language;
+		}
+	}
+	job.beam_size = gf->retranscribe_beam_size;
+	job.srt_path = (recording_path.parent_path() /
+			std::filesystem::u8path(recording_path.stem().u8string() + ".refined.srt"))
+			       .u8string();
+	OBS_LOG(gf->log_level, "Recording stopped. Queue its re-transcription to %s",
+		job.srt_path.c_str());
+	queue_recording_retranscription(job);
+}
+
 /**
  * @brief Callback function to handle recording state changes in OBS.
  *
@@ -666,22 +830,23 @@ void recording_state_callback(enum obs_frontend_event event, void *data)
 #endif
 		if (gf_->save_srt && gf_->save_only_while_recording &&
 		    gf_->output_file_path != "") {
-			obs_log(gf_->log_level, "Recording started. Resetting srt file.");
+			OBS_LOG(gf_->log_level, "Recording started. Resetting srt file.");
 			// truncate file if it exists
-			if (std::ifstream(gf_->output_file_path)) {
-				std::ofstream output_file(gf_->output_file_path,
-							  std::ios::out | std::ios::trunc);
-				output_file.close();
+			transcript_file_truncate(gf_->output_file_path);
+			if (gf_->save_jsonl) {
+				transcript_file_truncate(jsonl_file_path(gf_->output_file_path));
 			}
 			gf_->sentence_number = 1;
 			gf_->start_timestamp_ms = now_ms();
 		}
+		gf_->recording_start_ms = now_ms();
 	} else if (event == OBS_FRONTEND_EVENT_RECORDING_STOPPING) {
 #ifdef ENABLE_WEBVTT
 		remove_webvtt_output(*gf_,
 				     OBSOutputAutoRelease{obs_frontend_get_recording_output()});
 #endif
 	} else if (event == OBS_FRONTEND_EVENT_RECORDING_STOPPED) {
+		queue_retranscription(gf_);
 		if (!gf_->save_only_while_recording || !gf_->rename_file_to_match_recording) {
 			return;
 		}
@@ -689,10 +854,16 @@ void recording_state_callback(enum obs_frontend_event event, void *data)
 		namespace fs = std::filesystem;
 
 		fs::path outputPath(gf_->output_file_path);
+		// write the queued lines and release the files before renaming them
+		transcript_file_close(gf_->output_file_path);
+		const fs::path jsonlPath = fs::u8path(jsonl_file_path(gf_->output_file_path));
+		if (gf_->save_jsonl) {
+			transcript_file_close(jsonlPath.u8string());
+		}
 
 		try {
 			if (!std::filesystem::exists(outputPath)) {
-				obs_log(gf_->log_level, "Output file is empty");
+				OBS_LOG(gf_->log_level, "Output file is empty");
 				return;
 			}
 
@@ -704,10 +875,10 @@ void recording_state_callback(enum obs_frontend_event event, void *data)
 			fs::path newPath = recordingPath.stem();
 
 			if (gf_->save_srt) {
-				obs_log(gf_->log_level, "Recording stopped. Rename srt file.");
+				OBS_LOG(gf_->log_level, "Recording stopped. Rename srt file.");
 				newPath.replace_extension(".srt");
 			} else {
-				obs_log(gf_->log_level,
+				OBS_LOG(gf_->log_level,
 					"Recording stopped. Rename transcript file.");
 				std::string newExtension = outputPath.extension().string();
 
@@ -722,6 +893,12 @@ void recording_state_callback(enum obs_frontend_event event, void *data)
 			newPath = recordingPath.parent_path() / newPath.filename();
 
 			fs::rename(outputPath, newPath);
+			if (gf_->save_jsonl && fs::exists(jsonlPath)) {
+				const std::string jsonlName =
+					recordingPath.stem().u8string() + ".jsonl";
+				fs::rename(jsonlPath,
+					   recordingPath.parent_path() / fs::u8path(jsonlName));
+			}
 		} catch (const std::filesystem::filesystem_error &e) {
 			obs_log(LOG_ERROR, "Error renaming output file - %s", e.what());
 		}
@@ -749,29 +926,22 @@ void clear_current_caption(transcription_filter_data *gf_)
 	send_caption_to_source(gf_->translation_output, "", gf_);
 	send_caption_to_source(gf_->translate_cloud_output, "", gf_);
 	// reset translation context
-	gf_->last_text_for_translation = "";
-	gf_->last_text_translation = "";
-	gf_->translation_ctx.last_input_tokens.clear();
-	gf_->translation_ctx.last_translation_tokens.clear();
-	gf_->last_transcription_sentence.clear();
+	{
+		std::lock_guard<std::mutex> lock(gf_->translation_ctx_mutex);
+		gf_->last_text_for_translation = "";
+		gf_->last_text_translation = "";
+		gf_->translation_ctx.last_input_tokens.clear();
+		gf_->translation_ctx.last_translation_tokens.clear();
+	}
+	gf_->context_prompt.clear();
 	gf_->cleared_last_sub = true;
 }
 
 void reset_caption_state(transcription_filter_data *gf_)
 {
 	clear_current_caption(gf_);
-	// flush the buffer
-	{
-		std::lock_guard<std::mutex> lock(gf_->whisper_buf_mutex);
-		for (size_t c = 0; c < gf_->channels; c++) {
-			if (gf_->input_buffers[c].data != nullptr) {
-				deque_free(&gf_->input_buffers[c]);
-			}
-		}
-		if (gf_->info_buffer.data != nullptr) {
-			deque_free(&gf_->info_buffer);
-		}
-	}
+	// flush the buffers, the input ring buffer can only be drained by its consumer so the
+	// whisper thread does it when it sees the flag
 	gf_->clear_buffers = true;
 }
 
@@ -779,7 +949,7 @@ void media_play_callback(void *data_, calldata_t *cd)
 {
 	UNUSED_PARAMETER(cd);
 	transcription_filter_data *gf_ = static_cast<struct transcription_filter_data *>(data_);
-	obs_log(gf_->log_level, "media_play");
+	OBS_LOG(gf_->log_level, "media_play");
 	gf_->active = true;
 }
 
@@ -787,7 +957,7 @@ void media_started_callback(void *data_, calldata_t *cd)
 {
 	UNUSED_PARAMETER(cd);
 	transcription_filter_data *gf_ = static_cast<struct transcription_filter_data *>(data_);
-	obs_log(gf_->log_level, "media_started");
+	OBS_LOG(gf_->log_level, "media_started");
 	gf_->active = true;
 	reset_caption_state(gf_);
 }
@@ -796,7 +966,7 @@ void media_pause_callback(void *data_, calldata_t *cd)
 {
 	UNUSED_PARAMETER(cd);
 	transcription_filter_data *gf_ = static_cast<struct transcription_filter_data *>(data_);
-	obs_log(gf_->log_level, "media_pause");
+	OBS_LOG(gf_->log_level, "media_pause");
 	gf_->active = false;
 }
 
@@ -804,7 +974,7 @@ void media_restart_callback(void *data_, calldata_t *cd)
 {
 	UNUSED_PARAMETER(cd);
 	transcription_filter_data *gf_ = static_cast<struct transcription_filter_data *>(data_);
-	obs_log(gf_->log_level, "media_restart");
+	OBS_LOG(gf_->log_level, "media_restart");
 	gf_->active = true;
 	reset_caption_state(gf_);
 }
@@ -813,7 +983,7 @@ void media_stopped_callback(void *data_, calldata_t *cd)
 {
 	UNUSED_PARAMETER(cd);
 	transcription_filter_data *gf_ = static_cast<struct transcription_filter_data *>(data_);
-	obs_log(gf_->log_level, "media_stopped");
+	OBS_LOG(gf_->log_level, "media_stopped");
 	gf_->active = false;
 	reset_caption_state(gf_);
 }
@@ -823,12 +993,12 @@ void enable_callback(void *data_, calldata_t *cd)
 	transcription_filter_data *gf_ = static_cast<struct transcription_filter_data *>(data_);
 	bool enable = calldata_bool(cd, "enabled");
 	if (enable) {
-		obs_log(gf_->log_level, "enable_callback: enable");
+		OBS_LOG(gf_->log_level, "enable_callback: enable");
 		gf_->active = true;
 		reset_caption_state(gf_);
 		update_whisper_model(gf_);
 	} else {
-		obs_log(gf_->log_level, "enable_callback: disable");
+		OBS_LOG(gf_->log_level, "enable_callback: disable");
 		gf_->active = false;
 		reset_caption_state(gf_);
 		shutdown_whisper_thread(gf_);
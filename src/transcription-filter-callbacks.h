@@ -3,20 +3,36 @@
 
 #include <string>
 
+#include <obs-frontend-api.h>
+
 #include "transcription-filter-data.h"
 #include "whisper-utils/whisper-processing.h"
 
-bool whisper_abort_callback(void *data);
+// CEA-608 roll-up geometry of the stream captions
+#define STREAM_CAPTION_ROLL_UP_LINES 2
+#define STREAM_CAPTION_COLUMNS 32
+// bounds of the display duration of a stream caption
+#define STREAM_CAPTION_MIN_DURATION_MS 100
+#define STREAM_CAPTION_MAX_DURATION_MS 7000
+
 void send_caption_to_source(const std::string &target_source_name, const std::string &str_copy,
 			    struct transcription_filter_data *gf);
-std::string send_sentence_to_translation(const std::string &sentence,
-					 struct transcription_filter_data *gf);
+// Send a line rendered by a buffered output monitor to its text source and to the caption server
+void send_buffered_caption(struct transcription_filter_data *gf, TranslationType translation_type,
+			   const std::string &caption);
+// Send a line rendered by the stream caption monitor to the stream captions
+void send_roll_up_caption_to_stream(struct transcription_filter_data *gf,
+				    const std::string &caption);
+void output_text(struct transcription_filter_data *gf, const DetectionResultWithText &result,
+		 uint64_t possible_end_ts, const std::string &text,
+		 const std::string &output_source, TranslationType translation_type,
+		 const std::string &target_language = "");
 
 void audio_chunk_callback(struct transcription_filter_data *gf, const float *pcm32f_data,
 			  size_t frames, int vad_state, const DetectionResultWithText &result);
 
-void set_text_callback(struct transcription_filter_data *gf,
-		       const DetectionResultWithText &resultIn);
+void set_text_callback(uint64_t possible_end_ts, struct transcription_filter_data *gf,
+		       const SharedDetectionResult &result);
 
 void clear_current_caption(transcription_filter_data *gf_);
 
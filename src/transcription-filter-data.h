@@ -4,6 +4,7 @@
 #ifdef ENABLE_WEBVTT
 #include <obs.hpp>
 #include <webvtt-in-sei.h>
+#include "webvtt-cue-queue.h"
 #endif
 
 #include <util/deque.h>
@@ -13,19 +14,39 @@
 #include <whisper.h>
 
 #include <thread>
+#include <deque>
+#include <atomic>
 #include <memory>
 #include <mutex>
 #include <condition_variable>
 #include <functional>
 #include <string>
 
+#include "filter-metrics.h"
+#include "settings-snapshot.h"
 #include "translation/translation.h"
 #include "translation/translation-includes.h"
+#include "translation/translation-worker.h"
+#include "translation/cloud-translation-worker.h"
+#include "whisper-utils/backend-devices.h"
 #include "whisper-utils/silero-vad-onnx.h"
+#include "whisper-utils/audio-ring-buffer.h"
+#include "whisper-utils/segment-buffer.h"
+#include "whisper-utils/audio-decimator.h"
+#include "whisper-utils/sample-timeline.h"
+#include "whisper-utils/stage-timings.h"
+#include "whisper-utils/segment-trace.h"
+#include "whisper-utils/overload-controller.h"
+#include "whisper-utils/sticky-language.h"
+#include "whisper-utils/context-prompt.h"
+#include "whisper-utils/mel-cache.h"
 #include "whisper-utils/whisper-processing.h"
 #include "whisper-utils/token-buffer-thread.h"
 #include "translation/cloud-translation/translation-cloud.h"
 
+class WordFilter;
+struct audio_archive_settings;
+
 #define MAX_PREPROC_CHANNELS 10
 #define MAX_WEBVTT_TRACKS 5
 
@@ -90,10 +111,12 @@ struct webvtt_buffer_deleter {
 };
 #endif
 
-struct gpu_device_info {
-	size_t device_index;
-	const char *device_name;
-	const char *device_description;
+// How the transcription is sent to the stream as 608/708 captions
+enum StreamCaptionMode {
+	// one caption per sentence, held for its duration
+	STREAM_CAPTION_SENTENCES = 0,
+	// roll-up lines updated as the tokens come, partial transcriptions included
+	STREAM_CAPTION_ROLL_UP,
 };
 
 struct transcription_filter_data {
@@ -116,26 +139,66 @@ struct transcription_filter_data {
 	uint64_t last_sub_render_time;
 	bool cleared_last_sub;
 
-	// GPU device to use, or -1 for CPU only
+	// GPU device to use, -1 for CPU only or GPU_DEVICE_AUTO
 	int gpu_device;
-	std::vector<gpu_device_info> gpu_devices;
+	// GPU device the whisper model was loaded on (gpu_device with GPU_DEVICE_AUTO resolved),
+	// changed by a model swap under whisper_ctx_mutex
+	int whisper_gpu_device;
 	bool enable_flash_attn;
+	// How many streams may decode at once on a model shared between filters
+	int inference_max_parallel = 2;
+	// How long a partial segment waits for a decode slot before it's skipped
+	uint64_t inference_max_wait_ms = 500;
+	// InferencePriorityClass of the filter on the shared models
+	int inference_priority_class = 1;
 
 	/* PCM buffers */
 	float *copy_buffers[MAX_PREPROC_CHANNELS];
-	struct deque info_buffer;
-	struct deque input_buffers[MAX_PREPROC_CHANNELS];
+	// lock-free SPSC ring: OBS audio thread -> whisper thread (samples and packet infos)
+	AudioRingBuffer input_buffer;
+	// last seen input_buffer.dropped_frames(), used to report overflows
+	uint64_t input_buffer_dropped_frames = 0;
 	std::atomic<bool> clear_buffers;
-	struct deque whisper_buffer;
+	// audio of the current segment (16 kHz mono) with room for the silence padding
+	SegmentBuffer whisper_buffer;
+	// whisper thread scratch buffers, they only grow so the steady state doesn't allocate
+	std::vector<float> vad_scratch;
+	std::vector<float> padding_scratch;
+	// number of times a scratch buffer had to grow, should stop increasing after warm-up
+	std::atomic<uint64_t> scratch_buffer_growths = 0;
 
 	/* Resampler */
 	audio_resampler_t *resampler_to_whisper;
+	// used instead of the resampler when the sample rate is a multiple of 16 kHz
+	AudioDecimator decimator;
+	std::vector<float> resample_scratch;
 	struct deque resampled_buffer;
+	// timestamps of the resampled stream, indexed by resampled sample
+	SampleTimeline timeline;
+	// number of resampled samples so far, i.e. the index of the next one
+	uint64_t resampled_samples_total = 0;
+	// index of the first sample in resampled_buffer
+	uint64_t resampled_buffer_start_sample = 0;
 
 	/* whisper */
 	std::string whisper_model_path;
+	// ModelQuantization of the f16 models, see model-quantize.h
+	int whisper_model_quantization = 0;
+	// apply the measured backend configuration of a model on its first use, see
+	// backend-autotune.h
+	bool backend_autotune = false;
+	// the model selection the configuration was applied for
+	std::string backend_autotuned_model;
+	// shared between filters using the same model, see whisper-model-registry.h
 	struct whisper_context *whisper_context;
+	// per-filter decoding state
+	struct whisper_state *whisper_state;
 	whisper_full_params whisper_params;
+	// optional smaller model for partial results, finals still use the main model
+	std::string draft_model_name;
+	std::string draft_model_file;
+	struct whisper_context *draft_whisper_context;
+	struct whisper_state *draft_whisper_state;
 
 	/* Silero VAD */
 	std::unique_ptr<VadIterator> vad;
@@ -145,12 +208,29 @@ struct transcription_filter_data {
 
 	bool do_silence;
 	int vad_mode;
+	// skip the VAD model on the windows below the noise floor
+	std::atomic<bool> vad_pre_gate = true;
+	std::atomic<float> vad_threshold = 0.65f;
+	// the input channel to transcribe, -1 mixes all of them. The filters of the other
+	// channels share the model, see whisper-model-registry.h
+	std::atomic<int> input_channel = -1;
+	// ONNX Runtime session of the VAD: execution provider (VadExecutionProvider), threads and
+	// the optimized model saved in the backend cache. A change recreates the VAD on the
+	// whisper thread, see vad_reload
+	int vad_provider = VAD_PROVIDER_CPU;
+	int vad_intra_threads = 1;
+	int vad_inter_threads = 1;
+	bool vad_optimized_cache = true;
+	std::atomic<bool> vad_reload = false;
 	int log_level = LOG_DEBUG;
 	bool log_words;
 	bool caption_to_stream;
+	StreamCaptionMode stream_caption_mode = STREAM_CAPTION_SENTENCES;
 	bool active = false;
 	bool save_to_file = false;
 	bool save_srt = false;
+	// also save the segments with their tokens as JSON lines
+	bool save_jsonl = false;
 	bool truncate_output_file = false;
 	bool save_only_while_recording = false;
 	bool process_while_muted = false;
@@ -160,15 +240,50 @@ struct transcription_filter_data {
 	std::string translation_output;
 	bool enable_token_ts_dtw = false;
 	std::vector<std::tuple<std::string, std::string>> filter_words_replace;
+	// filter_words_replace compiled on update, swapped with std::atomic_store
+	std::shared_ptr<const WordFilter> filter_words_compiled;
 	bool fix_utf8 = true;
 	bool enable_audio_chunks_callback = false;
+	// archive of the segment audio, see audio-archive.h. Replaced on update with
+	// std::atomic_store, the whisper threads read it with std::atomic_load
+	std::shared_ptr<const audio_archive_settings> audio_archive;
+	// second pass of the recordings from the archive, see recording-retranscription.h
+	bool retranscribe_recordings = false;
+	std::string retranscribe_model_path;
+	int retranscribe_beam_size = 5;
+	// wall clock time the current recording started, 0 when not recording
+	uint64_t recording_start_ms = 0;
+	// the settings of the previous update, only written by transcription_filter_update
+	SettingsSnapshot settings_snapshot;
 	bool source_signals_set = false;
 	bool initial_creation = true;
 	bool partial_transcription = false;
 	int partial_latency = 1000;
+	// Incremental partials: only decode the audio after the tokens that were stable in the
+	// last two partials of the current segment, using those tokens as the decoder prompt
+	bool partial_incremental = false;
+	std::vector<whisper_token_data> partial_last_tokens;
+	std::vector<whisper_token_data> partial_committed_tokens;
+	uint64_t partial_committed_end_ms = 0;
+	// Reuse the mel frames of the previous run on the same (growing) segment
+	bool mel_cache_enabled = false;
+	MelCache mel_cache;
+	// Set audio_ctx per inference from the segment length, with a fallback to the full
+	// window when the result is rejected
+	bool audio_ctx_auto = false;
+	uint64_t audio_ctx_fallbacks = 0;
 	float duration_filter_threshold = 2.25f;
 	// Duration of the target segment buffer in ms
 	int segment_duration = 7000;
+	// without the VAD and with the hybrid VAD, the end of each full segment is decoded again
+	// at the start of the next one (in ms), the tokens decoded twice are dropped
+	int segment_overlap_ms = 0;
+	// the start of whisper_buffer repeats the end of the previous segment for this long
+	uint64_t whisper_buffer_overlap_ms = 0;
+	// tokens of the last final and the size of their vocabulary, for the overlap of the next
+	// segment. Only used by the inference thread
+	std::vector<whisper_token_data> seam_tokens;
+	int seam_n_vocab = 0;
 
 	// Cloud translation options
 	bool translate_cloud = false;
@@ -176,12 +291,20 @@ struct transcription_filter_data {
 	std::string translate_cloud_target_language;
 	std::string translate_cloud_output;
 	bool translate_cloud_only_full_sentences = true;
+	// output the translation of LLM providers while it is generated
+	bool translate_cloud_stream = true;
+	// the last sentence delivered by the cloud translation workers and its translation,
+	// guarded by the mutex of the worker pool
 	std::string last_text_for_cloud_translation;
 	std::string last_text_cloud_translation;
+	// sentences waiting for or being translated by the cloud translation workers, in order,
+	// guarded by the mutex of the worker pool
+	std::deque<std::shared_ptr<cloud_translation_job>> cloud_translation_jobs;
+	int cloud_translation_in_flight = 0;
+	bool cloud_translation_delivering = false;
 
-	// Transcription context sentences
-	int n_context_sentences;
-	std::deque<std::string> last_transcription_sentence;
+	// Tokens of the last final segments, the decoder prompt of the next inference
+	ContextPrompt context_prompt;
 
 	// Text source to output the subtitles
 	std::string text_source_name;
@@ -189,19 +312,122 @@ struct transcription_filter_data {
 	std::function<void(const DetectionResultWithText &result)> setTextCallback;
 	// Output file path to write the subtitles
 	std::string output_file_path;
+	// the model file the whisper threads decode with, set once it is loaded or switched to
 	std::string whisper_model_file_currently_loaded;
+	// the model file of the last switch_whisper_model, on the UI thread, loaded or not
+	std::string whisper_model_file_requested;
 	bool whisper_model_loaded_new;
 
 	// Use std for thread and mutex
 	std::thread whisper_thread;
+	// inference runs on its own thread, so segmentation continues while a segment decodes
+	std::thread inference_thread;
+	std::mutex inference_queue_mutex;
+	std::condition_variable inference_queue_cv;
+	std::deque<inference_job> inference_queue;
+	// audio buffers of finished jobs, reused for the next ones
+	std::vector<std::vector<float>> inference_buffer_pool;
+	bool inference_busy = false;
+	bool inference_stop = false;
+	// a partial is decoding, and a newer segment was queued since: the partial is aborted
+	bool partial_inference_running = false;
+	std::atomic<bool> abort_partial_inference = false;
+	// set by the whisper thread when the buffers are cleared, handled by the inference thread
+	std::atomic<bool> reset_partial_state = false;
+
+	// model hot swap: the next model loads on model_swap_thread while the current one keeps
+	// serving, the inference thread switches to it between two segments
+	std::thread model_swap_thread;
+	std::mutex model_swap_mutex;
+	// model file to load, empty to cancel
+	std::string model_swap_path;
+	bool model_swap_loading = false;
+	struct whisper_context *model_swap_context = nullptr;
+	struct whisper_state *model_swap_state = nullptr;
+	// the file and the GPU device of model_swap_context
+	std::string model_swap_ready_path;
+	int model_swap_gpu_device = -1;
+	std::atomic<bool> model_swap_ready = false;
+	uint64_t model_swap_load_ms = 0;
+
+	// idle suspension: after idle_suspend_s without speech (0: never) the whisper model, the
+	// VAD and the CT2 model are released and the whisper threads stopped on idle_thread. The
+	// audio staying louder than the noise brings them back, it is buffered in input_buffer
+	// meanwhile
+	int idle_suspend_s = 0;
+	std::thread idle_thread;
+	// held to start idle_thread, and to wait for it
+	std::mutex idle_mutex;
+	// idle_thread is suspending or resuming
+	bool idle_transition = false;
+	std::atomic<bool> idle_suspended = false;
+	std::atomic<bool> idle_resuming = false;
+	// noise floor and run of loud audio of a suspended filter, on the audio thread
+	float idle_noise_floor = 0.0f;
+	uint32_t idle_loud_frames = 0;
+	// set by shutdown_whisper_thread, a start of idle_thread waiting for its turn to load is
+	// dropped and a running load is released (see start_whisper_thread_in_background)
+	std::atomic<bool> model_load_cancelled = false;
+	// the model of start_whisper_thread_in_background, loaded by idle_thread after the
+	// running transition. Guarded by idle_mutex
+	std::string idle_start_path;
+	std::string idle_start_vad_model_file;
+	bool idle_start_pending = false;
+	// last time the VAD was in speech
+	std::atomic<uint64_t> last_speech_ms = 0;
+	// the VAD model the threads were started with, to resume them
+	std::string silero_vad_model_file;
+
+	// run an inference on silence right after loading a model, so the first segment does not
+	// pay for the backend initialization
+	bool model_warm_up = false;
+	// startup telemetry of the current model, see record_inference_time
+	uint64_t model_load_ms = 0;
+	uint64_t model_warm_up_ms = 0;
+	uint64_t inference_count = 0;
+	// total time of the inferences after the first one
+	uint64_t inference_steady_total_ms = 0;
+	// live metrics of the filter, see filter-metrics.h
+	filter_metrics metrics;
+	// time spent in each pipeline stage: the live metrics in the plugin, the measurements of
+	// the run in the offline benchmark
+	stage_timings *pipeline_timings = nullptr;
+	// per-segment spans of the pipeline while trace_captions is on, written to trace_file
+	SegmentTrace segment_trace;
+	// steps the transcription down while the inference cannot keep up, see overload_max_level
+	OverloadController overload;
+	// the language detected with "auto", locked after consistent detections
+	StickyLanguage sticky_language;
+	bool trace_captions = false;
+	std::string trace_file;
+	// the filter retains the debug ring of the log messages that are not logged
+	bool debug_ring = false;
 
 	std::mutex whisper_buf_mutex;
+	// held while the whisper contexts and states are used or replaced, e.g. for a decode
 	std::mutex whisper_ctx_mutex;
+	// whisper_context is loaded, for the liveness checks that must not wait for a decode
+	std::atomic<bool> whisper_context_ready = false;
+	// guards whisper_params, each inference takes a copy so settings updates do not wait
+	std::mutex whisper_params_mutex;
+	// wakes the whisper thread, see wake_whisper_thread
+	std::mutex whisper_wakeup_mutex;
 	std::condition_variable wshiper_thread_cv;
+	bool whisper_wakeup_pending = false;
+	// frames pushed by the audio thread since it last woke the whisper thread
+	uint32_t input_frames_since_wakeup = 0;
 	std::optional<std::condition_variable> input_cv;
 
-	// translation context
+	// translation context, used by the translation worker under translation_ctx_mutex
 	struct translation_context translation_ctx;
+	std::mutex translation_ctx_mutex;
+	std::thread translation_thread;
+	std::mutex translation_queue_mutex;
+	std::condition_variable translation_queue_cv;
+	std::deque<translation_job> translation_queue;
+	bool translation_stop = false;
+	// additional target languages, MAX_TRANSLATION_TARGETS - 1 slots
+	std::vector<translation_target> extra_translation_targets;
 	std::string translation_model_index;
 	std::string translation_model_path_external;
 	bool translate_only_full_sentences;
@@ -217,6 +443,16 @@ struct transcription_filter_data {
 	int buffered_output_num_chars = 30;
 	TokenBufferSegmentation buffered_output_output_type =
 		TokenBufferSegmentation::SEGMENTATION_TOKEN;
+	// present the transcription at the token timestamps instead of the presentation pace
+	bool buffered_output_timed = false;
+	// minimal time between two updates of an output text source
+	int64_t caption_update_interval_us = 0;
+	// presents the roll-up stream captions
+	TokenBufferThread stream_caption_monitor;
+	// audio time of the tokens not yet sent to the stream, the duration of the next caption
+	std::atomic<uint64_t> stream_caption_pending_ms{0};
+	// end of the audio already sent to the stream caption monitor, on the whisper thread
+	uint64_t stream_caption_end_ms = 0;
 
 #ifdef ENABLE_WEBVTT
 	enum struct webvtt_output_type {
@@ -224,20 +460,30 @@ struct transcription_filter_data {
 		Recording,
 	};
 
+	// An output with its muxers. The muxers are only used by the packet callback of the
+	// output, the settings are set when the output is added and not changed after.
 	struct webvtt_output {
 		OBSWeakOutputAutoRelease output;
 		webvtt_output_type output_type;
 		uint64_t start_timestamp_ms;
+		uint16_t latency_to_video_in_msecs;
+		uint8_t send_frequency_hz;
+		std::vector<std::string> languages;
+		std::map<std::string, uint8_t> language_to_track;
+
+		// cues not yet added to the muxers
+		WebvttCueQueue cues;
 
 		bool initialized = false;
-		std::map<std::string, uint8_t> language_to_track;
 		std::unique_ptr<WebvttMuxer, webvtt_muxer_deleter>
 			webvtt_muxer[MAX_OUTPUT_VIDEO_ENCODERS];
 		CodecFlavor codec_flavor[MAX_OUTPUT_VIDEO_ENCODERS] = {};
 	};
 
+	// guards the list of the outputs, not taken by the packet callbacks
 	std::mutex active_outputs_mutex;
-	std::vector<webvtt_output> active_outputs;
+	// the entries do not move: each is the parameter of its packet callback
+	std::vector<std::unique_ptr<webvtt_output>> active_outputs;
 
 	std::mutex webvtt_settings_mutex;
 	uint16_t latency_to_video_in_msecs;
@@ -259,22 +505,28 @@ struct transcription_filter_data {
 		resampler_to_whisper = nullptr;
 		whisper_model_path = "";
 		whisper_context = nullptr;
+		whisper_state = nullptr;
+		draft_model_name = "";
+		draft_model_file = "";
+		draft_whisper_context = nullptr;
+		draft_whisper_state = nullptr;
 		output_file_path = "";
 		whisper_model_file_currently_loaded = "";
+		whisper_model_file_requested = "";
 	}
 };
 
-// Audio packet info
-struct transcription_filter_audio_info {
-	uint32_t frames;
-	uint64_t timestamp_offset_ns; // offset (since start of processing) timestamp in ns
+enum TranslationType {
+	NO_TRANSLATION = 0,
+	LOCAL_TRANSLATION = 1,
+	CLOUD_TRANSLATION = 2,
+	// local translation to an additional target language, not buffered
+	LOCAL_EXTRA_TRANSLATION = 3
 };
 
-enum TranslationType { NO_TRANSLATION = 0, LOCAL_TRANSLATION = 1, CLOUD_TRANSLATION = 2 };
-
 // Callback sent when the transcription has a new result
 void set_text_callback(uint64_t possible_end_ts, struct transcription_filter_data *gf,
-		       const DetectionResultWithText &str);
+		       const SharedDetectionResult &result);
 void clear_current_caption(transcription_filter_data *gf_);
 
 // Callback sent when the VAD finds an audio chunk. Sample rate = WHISPER_SAMPLE_RATE, channels = 1
@@ -4,14 +4,22 @@
 #include <obs-frontend-api.h>
 #include <util/dstr.hpp>
 
+#include "audio-archive.h"
+#include "recording-retranscription.h"
 #include "transcription-filter-data.h"
 #include "transcription-filter.h"
 #include "transcription-filter-utils.h"
+#include "plugin-log.h"
 #include "whisper-utils/whisper-language.h"
 #include "whisper-utils/vad-processing.h"
 #include "whisper-utils/whisper-params.h"
+#include "whisper-utils/whisper-model-registry.h"
+#include "whisper-utils/whisper-model-utils.h"
 #include "model-utils/model-downloader-types.h"
+#include "model-utils/model-quantize.h"
 #include "translation/language_codes.h"
+#include "translation/translation-cache.h"
+#include "caption-server.h"
 #include "ui/filter-replace-dialog.h"
 #include "ui/filter-replace-utils.h"
 
@@ -31,12 +39,22 @@ bool translation_options_callback(obs_properties_t *props, obs_property_t *prope
 	     {"translate_target_language", "translate_model", "translate_output"}) {
 		obs_property_set_visible(obs_properties_get(props, prop), translate_enabled);
 	}
+	for (int i = 2; i <= MAX_TRANSLATION_TARGETS; i++) {
+		const std::string index = std::to_string(i);
+		obs_property_set_visible(
+			obs_properties_get(props, ("translate_target_language_" + index).c_str()),
+			translate_enabled);
+		obs_property_set_visible(
+			obs_properties_get(props, ("translate_output_" + index).c_str()),
+			translate_enabled);
+	}
 	for (const auto &prop :
 	     {"translate_add_context", "translate_input_tokenization_style",
 	      "translation_sampling_temperature", "translation_repetition_penalty",
 	      "translation_beam_size", "translation_max_decoding_length",
 	      "translation_no_repeat_ngram_size", "translation_max_input_length",
-	      "translate_only_full_sentences"}) {
+	      "translate_only_full_sentences", "translate_device", "translate_compute_type",
+	      "translate_inter_threads", "translate_intra_threads"}) {
 		obs_property_set_visible(obs_properties_get(props, prop),
 					 translate_enabled && is_advanced);
 	}
@@ -57,6 +75,10 @@ bool translation_cloud_provider_selection_callback(obs_properties_t *props, obs_
 				 strcmp(provider, "api") != 0);
 	obs_property_set_visible(obs_properties_get(props, "translate_cloud_deepl_free"),
 				 strcmp(provider, "deepl") == 0);
+	// streamed responses for the LLM providers only
+	obs_property_set_visible(obs_properties_get(props, "translate_cloud_stream"),
+				 strcmp(provider, "openai") == 0 ||
+					 strcmp(provider, "claude") == 0);
 	// show the secret key input for the papago provider only
 	obs_property_set_visible(obs_properties_get(props, "translate_cloud_secret_key"),
 				 strcmp(provider, "papago") == 0);
@@ -74,6 +96,23 @@ bool translation_cloud_provider_selection_callback(obs_properties_t *props, obs_
 	return true;
 }
 
+bool translation_cloud_hedge_selection_callback(obs_properties_t *props, obs_property_t *p,
+						obs_data_t *s)
+{
+	UNUSED_PARAMETER(p);
+	const char *provider = obs_data_get_string(s, "translate_cloud_hedge_provider");
+	const bool hedged = strcmp(provider, "none") != 0;
+	obs_property_set_visible(obs_properties_get(props, "translate_cloud_hedge_api_key"),
+				 hedged);
+	obs_property_set_visible(obs_properties_get(props, "translate_cloud_hedge_quantile"),
+				 hedged);
+	obs_property_set_visible(obs_properties_get(props, "translate_cloud_hedge_secret_key"),
+				 strcmp(provider, "papago") == 0);
+	obs_property_set_visible(obs_properties_get(props, "translate_cloud_hedge_region"),
+				 strcmp(provider, "azure") == 0);
+	return true;
+}
+
 bool translation_cloud_options_callback(obs_properties_t *props, obs_property_t *property,
 					obs_data_t *settings)
 {
@@ -85,11 +124,15 @@ bool translation_cloud_options_callback(obs_properties_t *props, obs_property_t
 	      "translate_cloud_output", "translate_cloud_api_key",
 	      "translate_cloud_only_full_sentences", "translate_cloud_secret_key",
 	      "translate_cloud_deepl_free", "translate_cloud_region", "translate_cloud_endpoint",
-	      "translate_cloud_body", "translate_cloud_response_json_path"}) {
+	      "translate_cloud_body", "translate_cloud_response_json_path",
+	      "translate_cloud_stream", "translate_cloud_hedge_provider",
+	      "translate_cloud_hedge_api_key", "translate_cloud_hedge_secret_key",
+	      "translate_cloud_hedge_region", "translate_cloud_hedge_quantile"}) {
 		obs_property_set_visible(obs_properties_get(props, prop), translate_enabled);
 	}
 	if (translate_enabled) {
 		translation_cloud_provider_selection_callback(props, NULL, settings);
+		translation_cloud_hedge_selection_callback(props, NULL, settings);
 	}
 	return true;
 }
@@ -102,7 +145,8 @@ bool advanced_settings_callback(obs_properties_t *props, obs_property_t *propert
 	const bool show_hide = obs_data_get_int(settings, "advanced_settings_mode") == 1;
 	for (const std::string &prop_name :
 	     {"whisper_params_group", "buffered_output_group", "log_group", "advanced_group",
-	      "file_output_enable", "partial_group"}) {
+	      "file_output_enable", "partial_group", "caption_server_enable",
+	      "audio_archive_enable"}) {
 		obs_property_set_visible(obs_properties_get(props, prop_name.c_str()), show_hide);
 	}
 	translation_options_callback(props, NULL, settings);
@@ -117,8 +161,9 @@ bool file_output_select_changed(obs_properties_t *props, obs_property_t *propert
 	// Show or hide the output filename selection input
 	const bool show_hide = obs_data_get_bool(settings, "file_output_enable");
 	for (const std::string &prop_name :
-	     {"subtitle_output_filename", "subtitle_save_srt", "truncate_output_file",
-	      "only_while_recording", "rename_file_to_match_recording", "file_output_info"}) {
+	     {"subtitle_output_filename", "subtitle_save_srt", "subtitle_save_jsonl",
+	      "truncate_output_file", "only_while_recording", "rename_file_to_match_recording",
+	      "file_output_info"}) {
 		obs_property_set_visible(obs_properties_get(props, prop_name.c_str()), show_hide);
 	}
 	return true;
@@ -190,6 +235,16 @@ bool translation_external_model_selection(obs_properties_t *props, obs_property_
 	obs_property_set_visible(obs_properties_get(props, "translate_input_tokenization_style"),
 				 !is_whisper && is_advanced);
 	obs_property_set_visible(obs_properties_get(props, "translate_output"), !is_whisper);
+	// whisper can only translate to one language
+	for (int i = 2; i <= MAX_TRANSLATION_TARGETS; i++) {
+		const std::string index = std::to_string(i);
+		obs_property_set_visible(
+			obs_properties_get(props, ("translate_target_language_" + index).c_str()),
+			!is_whisper);
+		obs_property_set_visible(
+			obs_properties_get(props, ("translate_output_" + index).c_str()),
+			!is_whisper);
+	}
 	return true;
 }
 
@@ -220,6 +275,17 @@ void add_transcription_group_properties(obs_properties_t *ppts,
 	// Hide the external model file selection input
 	obs_property_set_visible(obs_properties_get(ppts, "whisper_model_path_external"), false);
 
+	// the f16 models are quantized on the machine after the download
+	obs_property_t *quantization_list = obs_properties_add_list(
+		transcription_group, "whisper_model_quantization",
+		MT_("whisper_model_quantization"), OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(quantization_list, MT_("whisper_model_quantization_none"),
+				  MODEL_QUANTIZATION_NONE);
+	obs_property_list_add_int(quantization_list, "Q8_0", MODEL_QUANTIZATION_Q8_0);
+	obs_property_list_add_int(quantization_list, "Q5_K", MODEL_QUANTIZATION_Q5_K);
+	obs_property_set_long_description(quantization_list,
+					  MT_("whisper_model_quantization_tooltip"));
+
 	// Add a callback to the model list to handle the external model file selection
 	obs_property_set_modified_callback2(whisper_models_list, external_model_file_selection, gf);
 }
@@ -309,6 +375,10 @@ void add_translation_cloud_group_properties(obs_properties_t *ppts)
 	obs_properties_add_bool(translation_cloud_group, "translate_cloud_deepl_free",
 				MT_("translate_cloud_deepl_free"));
 
+	// add boolean option for streamed responses of the LLM providers
+	obs_properties_add_bool(translation_cloud_group, "translate_cloud_stream",
+				MT_("translate_cloud_stream"));
+
 	// add translate_cloud_region for azure
 	obs_properties_add_text(translation_cloud_group, "translate_cloud_region",
 				MT_("translate_cloud_region"), OBS_TEXT_DEFAULT);
@@ -322,6 +392,37 @@ void add_translation_cloud_group_properties(obs_properties_t *ppts)
 	// add input for json response path
 	obs_properties_add_text(translation_cloud_group, "translate_cloud_response_json_path",
 				MT_("translate_cloud_response_json_path"), OBS_TEXT_DEFAULT);
+
+	// add a secondary provider for the requests the primary is slow to answer
+	obs_property_t *prop_hedge_provider = obs_properties_add_list(
+		translation_cloud_group, "translate_cloud_hedge_provider",
+		MT_("translate_cloud_hedge_provider"), OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
+	obs_property_list_add_string(prop_hedge_provider, MT_("translate_cloud_hedge_none"),
+				     "none");
+	for (const auto &hedge_provider : {std::make_pair("Google-Cloud-Translation", "google"),
+					   std::make_pair("Microsoft-Translator", "azure"),
+					   std::make_pair("Papago-Translate", "papago"),
+					   std::make_pair("Deepl-Translate", "deepl"),
+					   std::make_pair("OpenAI-Translate", "openai"),
+					   std::make_pair("Claude-Translate", "claude")}) {
+		obs_property_list_add_string(prop_hedge_provider, MT_(hedge_provider.first),
+					     hedge_provider.second);
+	}
+	obs_property_set_long_description(prop_hedge_provider,
+					  MT_("translate_cloud_hedge_provider_tooltip"));
+	obs_property_set_modified_callback(prop_hedge_provider,
+					   translation_cloud_hedge_selection_callback);
+	obs_properties_add_text(translation_cloud_group, "translate_cloud_hedge_api_key",
+				MT_("translate_cloud_hedge_api_key"), OBS_TEXT_DEFAULT);
+	obs_properties_add_text(translation_cloud_group, "translate_cloud_hedge_secret_key",
+				MT_("translate_cloud_hedge_secret_key"), OBS_TEXT_PASSWORD);
+	obs_properties_add_text(translation_cloud_group, "translate_cloud_hedge_region",
+				MT_("translate_cloud_hedge_region"), OBS_TEXT_DEFAULT);
+	obs_property_t *prop_hedge_quantile = obs_properties_add_int_slider(
+		translation_cloud_group, "translate_cloud_hedge_quantile",
+		MT_("translate_cloud_hedge_quantile"), 50, 99, 1);
+	obs_property_set_long_description(prop_hedge_quantile,
+					  MT_("translate_cloud_hedge_quantile_tooltip"));
 }
 
 void add_translation_group_properties(obs_properties_t *ppts)
@@ -362,6 +463,35 @@ void add_translation_group_properties(obs_properties_t *ppts)
 	// Add a callback to the model list to handle the external model file selection
 	obs_property_set_modified_callback(prop_translate_model,
 					   translation_external_model_selection);
+	// add the translation device selection, CTranslate2 uses CUDA devices only
+	obs_property_t *prop_translate_device =
+		obs_properties_add_list(translation_group, "translate_device",
+					MT_("translate_device"), OBS_COMBO_TYPE_LIST,
+					OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(prop_translate_device, "CPU", -1);
+	for (int i = 0; i < get_translation_gpu_count(); i++) {
+		obs_property_list_add_int(prop_translate_device,
+					  ("CUDA " + std::to_string(i)).c_str(), i);
+	}
+	obs_property_set_long_description(prop_translate_device, MT_("translate_device_tooltip"));
+	// add the CTranslate2 compute type and threads
+	obs_property_t *prop_compute_type =
+		obs_properties_add_list(translation_group, "translate_compute_type",
+					MT_("translate_compute_type"), OBS_COMBO_TYPE_LIST,
+					OBS_COMBO_FORMAT_STRING);
+	for (const auto &compute_type :
+	     {"auto", "int8", "int8_float16", "int8_bfloat16", "float16", "bfloat16", "float32"}) {
+		obs_property_list_add_string(prop_compute_type, compute_type, compute_type);
+	}
+	obs_property_set_long_description(prop_compute_type,
+					  MT_("translate_compute_type_tooltip"));
+	obs_properties_add_int_slider(translation_group, "translate_inter_threads",
+				      MT_("translate_inter_threads"), 1, 8, 1);
+	obs_property_t *prop_intra_threads =
+		obs_properties_add_int_slider(translation_group, "translate_intra_threads",
+					      MT_("translate_intra_threads"), 0, 32, 1);
+	obs_property_set_long_description(prop_intra_threads,
+					  MT_("translate_intra_threads_tooltip"));
 	// add target language selection
 	obs_property_t *prop_tgt = obs_properties_add_list(
 		translation_group, "translate_target_language", MT_("target_language"),
@@ -385,6 +515,27 @@ void add_translation_group_properties(obs_properties_t *ppts)
 							      OBS_COMBO_FORMAT_STRING);
 	obs_property_list_add_string(prop_output, "Write to captions output", "none");
 	obs_enum_sources(add_sources_to_list, prop_output);
+	// additional target languages translated in the same pass, each with its own output
+	for (int i = 2; i <= MAX_TRANSLATION_TARGETS; i++) {
+		const std::string index = std::to_string(i);
+		obs_property_t *prop_extra_tgt = obs_properties_add_list(
+			translation_group, ("translate_target_language_" + index).c_str(),
+			MT_("translate_extra_target_language"), OBS_COMBO_TYPE_LIST,
+			OBS_COMBO_FORMAT_STRING);
+		obs_property_list_add_string(prop_extra_tgt, MT_("translate_extra_target_none"),
+					     "");
+		for (const auto &language : language_codes) {
+			obs_property_list_add_string(prop_extra_tgt, language.second.c_str(),
+						     language.first.c_str());
+		}
+		obs_property_t *prop_extra_output = obs_properties_add_list(
+			translation_group, ("translate_output_" + index).c_str(),
+			MT_("translate_extra_output"), OBS_COMBO_TYPE_LIST,
+			OBS_COMBO_FORMAT_STRING);
+		obs_property_list_add_string(prop_extra_output, MT_("translate_extra_output_none"),
+					     "none");
+		obs_enum_sources(add_sources_to_list, prop_extra_output);
+	}
 
 	// add callback to enable/disable translation group
 	obs_property_set_modified_callback(translation_group_prop, translation_options_callback);
@@ -465,6 +616,7 @@ void add_file_output_group_properties(obs_properties_t *ppts)
 	obs_properties_add_text(file_output_group, "file_output_info", MT_("file_output_info"),
 				OBS_TEXT_INFO);
 	obs_properties_add_bool(file_output_group, "subtitle_save_srt", MT_("save_srt"));
+	obs_properties_add_bool(file_output_group, "subtitle_save_jsonl", MT_("save_jsonl"));
 	obs_properties_add_bool(file_output_group, "truncate_output_file",
 				MT_("truncate_output_file"));
 	obs_properties_add_bool(file_output_group, "only_while_recording",
@@ -474,6 +626,47 @@ void add_file_output_group_properties(obs_properties_t *ppts)
 	obs_property_set_modified_callback(file_output_group_prop, file_output_select_changed);
 }
 
+void add_audio_archive_group_properties(obs_properties_t *ppts)
+{
+	// add a checkbox group for the archive of the segment audio
+	obs_properties_t *audio_archive_group = obs_properties_create();
+	obs_properties_add_group(ppts, "audio_archive_enable", MT_("audio_archive_group"),
+				 OBS_GROUP_CHECKABLE, audio_archive_group);
+	obs_properties_add_path(audio_archive_group, "audio_archive_folder",
+				MT_("audio_archive_folder"), OBS_PATH_DIRECTORY, NULL, NULL);
+	obs_properties_add_bool(audio_archive_group, "audio_archive_silence",
+				MT_("audio_archive_silence"));
+	obs_properties_add_int(audio_archive_group, "audio_archive_max_mb",
+			       MT_("audio_archive_max_mb"), 10, 1024 * 1024, 10);
+	obs_properties_add_bool(audio_archive_group, "retranscribe_recordings",
+				MT_("retranscribe_recordings"));
+	obs_properties_add_path(audio_archive_group, "retranscribe_model_path",
+				MT_("retranscribe_model_path"), OBS_PATH_FILE,
+				"Model (*.bin)", NULL);
+	obs_properties_add_int(audio_archive_group, "retranscribe_beam_size",
+			       MT_("retranscribe_beam_size"), 1, 10, 1);
+	obs_properties_add_text(audio_archive_group, "audio_archive_info",
+				MT_("audio_archive_info"), OBS_TEXT_INFO);
+}
+
+void add_caption_server_group_properties(obs_properties_t *ppts)
+{
+	// add a checkbox group for the local caption server
+	obs_properties_t *caption_server_group = obs_properties_create();
+	obs_properties_add_group(ppts, "caption_server_enable", MT_("caption_server_group"),
+				 OBS_GROUP_CHECKABLE, caption_server_group);
+	obs_properties_add_int(caption_server_group, "caption_server_port",
+			       MT_("caption_server_port"), 1024, 65535, 1);
+	obs_property_t *caption_server_origins =
+		obs_properties_add_text(caption_server_group, "caption_server_origins",
+					MT_("caption_server_origins"), OBS_TEXT_DEFAULT);
+	obs_property_set_long_description(caption_server_origins,
+					  MT_("caption_server_origins_tooltip"));
+	// add info text about connecting to the server
+	obs_properties_add_text(caption_server_group, "caption_server_info",
+				MT_("caption_server_info"), OBS_TEXT_INFO);
+}
+
 void add_buffered_output_group_properties(obs_properties_t *ppts)
 {
 	// add buffered output options group
@@ -518,6 +711,14 @@ void add_buffered_output_group_properties(obs_properties_t *ppts)
 	// add buffer number of characters per line parameter
 	obs_properties_add_int_slider(buffered_output_group, "buffer_num_chars_per_line",
 				      MT_("buffer_num_chars_per_line"), 1, 100, 1);
+	// add the max rate of the text source updates, 0 for the video frame rate
+	obs_properties_add_int_slider(buffered_output_group, "caption_max_update_rate",
+				      MT_("caption_max_update_rate"), 0, 120, 1);
+	// reveal the words when they were spoken, delayed like the video
+	obs_properties_add_bool(buffered_output_group, "buffer_timed_presentation",
+				MT_("buffer_timed_presentation"));
+	obs_properties_add_int_slider(buffered_output_group, "buffer_presentation_delay_ms",
+				      MT_("buffer_presentation_delay_ms"), 0, 10000, 50);
 }
 
 void add_advanced_group_properties(obs_properties_t *ppts, struct transcription_filter_data *gf)
@@ -529,6 +730,13 @@ void add_advanced_group_properties(obs_properties_t *ppts, struct transcription_
 
 	obs_properties_add_bool(advanced_config_group, "caption_to_stream",
 				MT_("caption_to_stream"));
+	obs_property_t *stream_caption_mode = obs_properties_add_list(
+		advanced_config_group, "stream_caption_mode", MT_("stream_caption_mode"),
+		OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(stream_caption_mode, MT_("stream_caption_mode_sentences"),
+				  STREAM_CAPTION_SENTENCES);
+	obs_property_list_add_int(stream_caption_mode, MT_("stream_caption_mode_roll_up"),
+				  STREAM_CAPTION_ROLL_UP);
 
 	obs_properties_add_int_slider(advanced_config_group, "min_sub_duration",
 				      MT_("min_sub_duration"), 1000, 5000, 50);
@@ -540,6 +748,26 @@ void add_advanced_group_properties(obs_properties_t *ppts, struct transcription_
 	obs_properties_add_bool(advanced_config_group, "process_while_muted",
 				MT_("process_while_muted"));
 
+	// translation cache, shared by the local and the cloud translation
+	obs_property_t *translation_cache_size =
+		obs_properties_add_int_slider(advanced_config_group, "translation_cache_size",
+					      MT_("translation_cache_size"), 0, 20000, 256);
+	obs_property_set_long_description(translation_cache_size,
+					  MT_("translation_cache_size_tooltip"));
+	obs_properties_add_bool(advanced_config_group, "translation_cache_persist",
+				MT_("translation_cache_persist"));
+
+	obs_property_t *input_channel_list = obs_properties_add_list(
+		advanced_config_group, "input_channel", MT_("input_channel"), OBS_COMBO_TYPE_LIST,
+		OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(input_channel_list, MT_("input_channel_mix"), -1);
+	for (int i = 0; i < (int)audio_output_get_channels(obs_get_audio()); i++) {
+		const std::string name = std::string(MT_("input_channel_n")) + " " +
+					 std::to_string(i + 1);
+		obs_property_list_add_int(input_channel_list, name.c_str(), i);
+	}
+	obs_property_set_long_description(input_channel_list, MT_("input_channel_tooltip"));
+
 	// add selection for Active VAD vs Hybrid VAD
 	obs_property_t *vad_mode_list =
 		obs_properties_add_list(advanced_config_group, "vad_mode", MT_("vad_mode"),
@@ -550,12 +778,41 @@ void add_advanced_group_properties(obs_properties_t *ppts, struct transcription_
 	// add vad threshold slider
 	obs_properties_add_float_slider(advanced_config_group, "vad_threshold",
 					MT_("vad_threshold"), 0.0, 1.0, 0.05);
+	obs_property_t *vad_pre_gate =
+		obs_properties_add_bool(advanced_config_group, "vad_pre_gate", MT_("vad_pre_gate"));
+	obs_property_set_long_description(vad_pre_gate, MT_("vad_pre_gate_tooltip"));
+	obs_property_t *vad_provider_list =
+		obs_properties_add_list(advanced_config_group, "vad_provider", MT_("vad_provider"),
+					OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(vad_provider_list, "CPU", VAD_PROVIDER_CPU);
+	obs_property_list_add_int(vad_provider_list, "CUDA", VAD_PROVIDER_CUDA);
+#ifdef _WIN32
+	obs_property_list_add_int(vad_provider_list, "DirectML", VAD_PROVIDER_DIRECTML);
+#endif
+#ifdef __APPLE__
+	obs_property_list_add_int(vad_provider_list, "CoreML", VAD_PROVIDER_COREML);
+#endif
+	obs_property_set_long_description(vad_provider_list, MT_("vad_provider_tooltip"));
+	obs_properties_add_int_slider(advanced_config_group, "vad_intra_threads",
+				      MT_("vad_intra_threads"), 1, 8, 1);
+	obs_properties_add_int_slider(advanced_config_group, "vad_inter_threads",
+				      MT_("vad_inter_threads"), 1, 4, 1);
+	obs_property_t *vad_optimized_cache = obs_properties_add_bool(
+		advanced_config_group, "vad_optimized_cache", MT_("vad_optimized_cache"));
+	obs_property_set_long_description(vad_optimized_cache, MT_("vad_optimized_cache_tooltip"));
+	obs_property_t *idle_suspend = obs_properties_add_int_slider(
+		advanced_config_group, "idle_suspend_s", MT_("idle_suspend_s"), 0, 3600, 10);
+	obs_property_set_long_description(idle_suspend, MT_("idle_suspend_s_tooltip"));
 	// add duration filter threshold slider
 	obs_properties_add_float_slider(advanced_config_group, "duration_filter_threshold",
 					MT_("duration_filter_threshold"), 0.1, 3.0, 0.05);
 	// add segment duration slider
 	obs_properties_add_int_slider(advanced_config_group, "segment_duration",
 				      MT_("segment_duration"), 3000, 15000, 100);
+	obs_property_t *segment_overlap =
+		obs_properties_add_int_slider(advanced_config_group, "segment_overlap_ms",
+					      MT_("segment_overlap_ms"), 0, 3000, 100);
+	obs_property_set_long_description(segment_overlap, MT_("segment_overlap_ms_tooltip"));
 
 	// add button to open filter and replace UI dialog
 	obs_properties_add_button2(
@@ -592,6 +849,22 @@ void add_logging_group_properties(obs_properties_t *ppts)
 	obs_property_list_add_int(list, "DEBUG (Won't show)", LOG_DEBUG);
 	obs_property_list_add_int(list, "INFO", LOG_INFO);
 	obs_property_list_add_int(list, "WARNING", LOG_WARNING);
+	obs_properties_add_bool(log_group, "trace_captions", MT_("trace_captions"));
+	obs_properties_add_path(log_group, "trace_file", MT_("trace_file"), OBS_PATH_FILE_SAVE,
+				"Chrome trace (*.json)", NULL);
+	obs_property_t *debug_ring =
+		obs_properties_add_bool(log_group, "log_debug_ring", MT_("log_debug_ring"));
+	obs_property_set_long_description(debug_ring, MT_("log_debug_ring_tooltip"));
+	obs_properties_add_button2(
+		log_group, "dump_debug_ring", MT_("dump_debug_ring"),
+		[](obs_properties_t *props, obs_property_t *property, void *data_) {
+			UNUSED_PARAMETER(props);
+			UNUSED_PARAMETER(property);
+			UNUSED_PARAMETER(data_);
+			debug_ring_dump();
+			return false;
+		},
+		nullptr);
 }
 
 void add_general_group_properties(obs_properties_t *ppts)
@@ -618,6 +891,13 @@ void add_general_group_properties(obs_properties_t *ppts)
 		obs_property_list_add_string(whisper_language_select_list, pair.first.c_str(),
 					     pair.second.c_str());
 	}
+	obs_property_t *sticky_language = obs_properties_add_bool(
+		general_group, "sticky_language", MT_("sticky_language"));
+	obs_property_set_long_description(sticky_language, MT_("sticky_language_tooltip"));
+	obs_properties_add_int(general_group, "sticky_language_detections",
+			       MT_("sticky_language_detections"), 1, 20, 1);
+	obs_properties_add_int(general_group, "sticky_language_recheck",
+			       MT_("sticky_language_recheck"), 1, 1000, 1);
 }
 
 void add_partial_group_properties(obs_properties_t *ppts)
@@ -634,6 +914,24 @@ void add_partial_group_properties(obs_properties_t *ppts)
 	// add slider for partial latecy
 	obs_properties_add_int_slider(partial_group, "partial_latency", MT_("partial_latency"), 500,
 				      3000, 50);
+	obs_property_t *partial_incremental = obs_properties_add_bool(
+		partial_group, "partial_incremental", MT_("partial_incremental"));
+	obs_property_set_long_description(partial_incremental, MT_("partial_incremental_tooltip"));
+	obs_property_t *mel_cache =
+		obs_properties_add_bool(partial_group, "mel_cache", MT_("mel_cache"));
+	obs_property_set_long_description(mel_cache, MT_("mel_cache_tooltip"));
+
+	// optional faster model for partials, the final result of the main model replaces them
+	obs_property_t *draft_models_list = obs_properties_add_list(
+		partial_group, "partial_draft_model", MT_("partial_draft_model"),
+		OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_STRING);
+	obs_property_list_add_string(draft_models_list, MT_("partial_draft_model_none"), "");
+	for (const auto &model_info :
+	     get_sorted_models_info(std::optional<ModelType>{MODEL_TYPE_TRANSCRIPTION})) {
+		obs_property_list_add_string(draft_models_list, model_info.friendly_name.c_str(),
+					     model_info.friendly_name.c_str());
+	}
+	obs_property_set_long_description(draft_models_list, MT_("partial_draft_model_tooltip"));
 }
 
 void add_whisper_backend_group_properties(obs_properties_t *ppts,
@@ -649,9 +947,14 @@ void add_whisper_backend_group_properties(obs_properties_t *ppts,
 					OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
 
 	obs_property_list_add_int(backend_device, "CPU only", -1);
-	for (size_t i = 0; i < gf->gpu_devices.size(); i++) {
-		auto name = gf->gpu_devices.at(i).device_name;
-		auto description = gf->gpu_devices.at(i).device_description;
+	const std::vector<gpu_device_info> &gpu_devices = backend_gpu_devices();
+	if (!gpu_devices.empty()) {
+		obs_property_list_add_int(backend_device, MT_("backend_device_auto"),
+					  GPU_DEVICE_AUTO);
+	}
+	for (size_t i = 0; i < gpu_devices.size(); i++) {
+		auto name = gpu_devices.at(i).device_name;
+		auto description = gpu_devices.at(i).device_description;
 		obs_property_list_add_int(
 			backend_device,
 			std::string("GPU: ").append(name).append(" - ").append(description).c_str(),
@@ -661,6 +964,71 @@ void add_whisper_backend_group_properties(obs_properties_t *ppts,
 	obs_property_t *enable_flash_attn = obs_properties_add_bool(
 		backend_group, "enable_flash_attn", MT_("enable_flash_attn"));
 	obs_property_set_long_description(enable_flash_attn, MT_("enable_flash_attn_tooltip"));
+
+	obs_property_t *backend_autotune =
+		obs_properties_add_bool(backend_group, "backend_autotune", MT_("backend_autotune"));
+	obs_property_set_long_description(backend_autotune, MT_("backend_autotune_tooltip"));
+	obs_properties_add_button2(
+		backend_group, "backend_autotune_run", MT_("backend_autotune_run"),
+		[](obs_properties_t *props, obs_property_t *property, void *data_) {
+			UNUSED_PARAMETER(props);
+			UNUSED_PARAMETER(property);
+			struct transcription_filter_data *gf_ =
+				static_cast<struct transcription_filter_data *>(data_);
+			autotune_whisper_model(gf_, true);
+			return false;
+		},
+		gf);
+
+	obs_property_t *model_warm_up =
+		obs_properties_add_bool(backend_group, "model_warm_up", MT_("model_warm_up"));
+	obs_property_set_long_description(model_warm_up, MT_("model_warm_up_tooltip"));
+
+	obs_property_t *inference_max_parallel =
+		obs_properties_add_int_slider(backend_group, "inference_max_parallel",
+					      MT_("inference_max_parallel"), 1, 8, 1);
+	obs_property_set_long_description(inference_max_parallel,
+					  MT_("inference_max_parallel_tooltip"));
+	obs_properties_add_int_slider(backend_group, "inference_max_wait_ms",
+				      MT_("inference_max_wait_ms"), 50, 3000, 50);
+	obs_property_t *inference_priority_class = obs_properties_add_list(
+		backend_group, "inference_priority_class", MT_("inference_priority_class"),
+		OBS_COMBO_TYPE_LIST, OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(inference_priority_class, MT_("inference_priority_main"),
+				  INFERENCE_PRIORITY_MAIN);
+	obs_property_list_add_int(inference_priority_class, MT_("inference_priority_normal"),
+				  INFERENCE_PRIORITY_NORMAL);
+	obs_property_list_add_int(inference_priority_class, MT_("inference_priority_background"),
+				  INFERENCE_PRIORITY_BACKGROUND);
+	obs_property_set_long_description(inference_priority_class,
+					  MT_("inference_priority_class_tooltip"));
+	obs_property_t *inference_thread_budget =
+		obs_properties_add_int_slider(backend_group, "inference_thread_budget",
+					      MT_("inference_thread_budget"), 0, 64, 1);
+	obs_property_set_long_description(inference_thread_budget,
+					  MT_("inference_thread_budget_tooltip"));
+	obs_property_t *inference_pin_threads = obs_properties_add_bool(
+		backend_group, "inference_pin_threads", MT_("inference_pin_threads"));
+	obs_property_set_long_description(inference_pin_threads,
+					  MT_("inference_pin_threads_tooltip"));
+
+	obs_property_t *overload_max_level =
+		obs_properties_add_list(backend_group, "overload_max_level",
+					MT_("overload_max_level"), OBS_COMBO_TYPE_LIST,
+					OBS_COMBO_FORMAT_INT);
+	obs_property_list_add_int(overload_max_level, MT_("overload_level_none"),
+				  OVERLOAD_LEVEL_NONE);
+	obs_property_list_add_int(overload_max_level, MT_("overload_level_partial_latency"),
+				  OVERLOAD_LEVEL_PARTIAL_LATENCY);
+	obs_property_list_add_int(overload_max_level, MT_("overload_level_no_partials"),
+				  OVERLOAD_LEVEL_NO_PARTIALS);
+	obs_property_list_add_int(overload_max_level, MT_("overload_level_greedy"),
+				  OVERLOAD_LEVEL_GREEDY);
+	obs_property_list_add_int(overload_max_level, MT_("overload_level_audio_ctx"),
+				  OVERLOAD_LEVEL_AUDIO_CTX);
+	obs_property_list_add_int(overload_max_level, MT_("overload_level_fallback_model"),
+				  OVERLOAD_LEVEL_FALLBACK_MODEL);
+	obs_property_set_long_description(overload_max_level, MT_("overload_max_level_tooltip"));
 }
 
 obs_properties_t *transcription_filter_properties(void *data)
@@ -688,7 +1056,9 @@ obs_properties_t *transcription_filter_properties(void *data)
 	add_webvtt_group_properties(ppts);
 #endif
 	add_file_output_group_properties(ppts);
+	add_audio_archive_group_properties(ppts);
 	add_buffered_output_group_properties(ppts);
+	add_caption_server_group_properties(ppts);
 	add_advanced_group_properties(ppts, gf);
 	add_logging_group_properties(ppts);
 	add_partial_group_properties(ppts);
@@ -713,19 +1083,51 @@ void transcription_filter_defaults(obs_data_t *s)
 	obs_data_set_default_int(s, "buffer_num_chars_per_line", 30);
 	obs_data_set_default_int(s, "buffer_output_type",
 				 (int)TokenBufferSegmentation::SEGMENTATION_TOKEN);
+	obs_data_set_default_int(s, "caption_max_update_rate", 0);
+	obs_data_set_default_bool(s, "buffer_timed_presentation", false);
+	obs_data_set_default_int(s, "buffer_presentation_delay_ms", 0);
+	obs_data_set_default_bool(s, "audio_archive_enable", false);
+	obs_data_set_default_string(s, "audio_archive_folder", "");
+	obs_data_set_default_bool(s, "audio_archive_silence", false);
+	obs_data_set_default_int(s, "audio_archive_max_mb", AUDIO_ARCHIVE_DEFAULT_MAX_MB);
+	obs_data_set_default_bool(s, "retranscribe_recordings", false);
+	obs_data_set_default_string(s, "retranscribe_model_path", "");
+	obs_data_set_default_int(s, "retranscribe_beam_size", RETRANSCRIPTION_DEFAULT_BEAM_SIZE);
+	obs_data_set_default_bool(s, "caption_server_enable", false);
+	obs_data_set_default_int(s, "caption_server_port", CAPTION_SERVER_DEFAULT_PORT);
+	obs_data_set_default_string(s, "caption_server_origins", CAPTION_SERVER_DEFAULT_ORIGINS);
 
 	obs_data_set_default_bool(s, "vad_mode", VAD_MODE_ACTIVE);
 	obs_data_set_default_double(s, "vad_threshold", 0.65);
+	obs_data_set_default_bool(s, "vad_pre_gate", true);
+	obs_data_set_default_int(s, "input_channel", -1);
+	obs_data_set_default_int(s, "vad_provider", VAD_PROVIDER_CPU);
+	obs_data_set_default_int(s, "vad_intra_threads", 1);
+	obs_data_set_default_int(s, "vad_inter_threads", 1);
+	obs_data_set_default_bool(s, "vad_optimized_cache", true);
+	obs_data_set_default_int(s, "idle_suspend_s", 0);
 	obs_data_set_default_double(s, "duration_filter_threshold", 2.25);
 	obs_data_set_default_int(s, "segment_duration", 7000);
+	obs_data_set_default_int(s, "segment_overlap_ms", 0);
 	obs_data_set_default_int(s, "log_level", LOG_DEBUG);
 	obs_data_set_default_bool(s, "log_words", false);
+	obs_data_set_default_bool(s, "trace_captions", false);
+	obs_data_set_default_string(s, "trace_file", "");
+	obs_data_set_default_bool(s, "log_debug_ring", false);
 	obs_data_set_default_bool(s, "caption_to_stream", false);
+	obs_data_set_default_int(s, "stream_caption_mode", STREAM_CAPTION_SENTENCES);
 	obs_data_set_default_string(s, "whisper_model_path", "Whisper Tiny English (74Mb)");
+	obs_data_set_default_int(s, "whisper_model_quantization", MODEL_QUANTIZATION_NONE);
 	obs_data_set_default_string(s, "whisper_language_select", "en");
+	obs_data_set_default_bool(s, "sticky_language", true);
+	obs_data_set_default_int(s, "sticky_language_detections", 3);
+	obs_data_set_default_int(s, "sticky_language_recheck", 20);
 	obs_data_set_default_string(s, "subtitle_sources", "none");
 	obs_data_set_default_bool(s, "process_while_muted", false);
+	obs_data_set_default_int(s, "translation_cache_size", TRANSLATION_CACHE_DEFAULT_CAPACITY);
+	obs_data_set_default_bool(s, "translation_cache_persist", false);
 	obs_data_set_default_bool(s, "subtitle_save_srt", false);
+	obs_data_set_default_bool(s, "subtitle_save_jsonl", false);
 	obs_data_set_default_bool(s, "truncate_output_file", false);
 	obs_data_set_default_bool(s, "only_while_recording", false);
 	obs_data_set_default_bool(s, "rename_file_to_match_recording", true);
@@ -735,14 +1137,26 @@ void transcription_filter_defaults(obs_data_t *s)
 	obs_data_set_default_double(s, "sentence_psum_accept_thresh", 0.4);
 	obs_data_set_default_bool(s, "partial_group", true);
 	obs_data_set_default_int(s, "partial_latency", 1100);
+	obs_data_set_default_bool(s, "partial_incremental", false);
+	obs_data_set_default_bool(s, "mel_cache", false);
+	obs_data_set_default_string(s, "partial_draft_model", "");
 
 	// translation options
 	obs_data_set_default_bool(s, "translate", false);
 	obs_data_set_default_string(s, "translate_target_language", "__es__");
+	for (int i = 2; i <= MAX_TRANSLATION_TARGETS; i++) {
+		const std::string index = std::to_string(i);
+		obs_data_set_default_string(s, ("translate_target_language_" + index).c_str(), "");
+		obs_data_set_default_string(s, ("translate_output_" + index).c_str(), "none");
+	}
 	obs_data_set_default_int(s, "translate_add_context", 1);
 	obs_data_set_default_bool(s, "translate_only_full_sentences", true);
 	obs_data_set_default_string(s, "translate_model", "whisper-based-translation");
 	obs_data_set_default_string(s, "translation_model_path_external", "");
+	obs_data_set_default_int(s, "translate_device", get_translation_gpu_count() > 0 ? 0 : -1);
+	obs_data_set_default_string(s, "translate_compute_type", "auto");
+	obs_data_set_default_int(s, "translate_inter_threads", 1);
+	obs_data_set_default_int(s, "translate_intra_threads", 0);
 	obs_data_set_default_int(s, "translate_input_tokenization_style", INPUT_TOKENIZAION_M2M100);
 	obs_data_set_default_double(s, "translation_sampling_temperature", 0.1);
 	obs_data_set_default_double(s, "translation_repetition_penalty", 2.0);
@@ -760,6 +1174,7 @@ void transcription_filter_defaults(obs_data_t *s)
 	obs_data_set_default_string(s, "translate_cloud_api_key", "");
 	obs_data_set_default_string(s, "translate_cloud_secret_key", "");
 	obs_data_set_default_bool(s, "translate_cloud_deepl_free", true);
+	obs_data_set_default_bool(s, "translate_cloud_stream", true);
 	obs_data_set_default_string(s, "translate_cloud_region", "eastus");
 	obs_data_set_default_string(s, "translate_cloud_endpoint",
 				    "http://localhost:5000/translate");
@@ -767,6 +1182,11 @@ void transcription_filter_defaults(obs_data_t *s)
 		s, "translate_cloud_body",
 		"{\n\t\"text\":\"{{sentence}}\",\n\t\"source\":\"{{source_language}}\",\n\t\"target\":\"{{target_language}}\"\n}");
 	obs_data_set_default_string(s, "translate_cloud_response_json_path", "translations.0.text");
+	obs_data_set_default_string(s, "translate_cloud_hedge_provider", "none");
+	obs_data_set_default_string(s, "translate_cloud_hedge_api_key", "");
+	obs_data_set_default_string(s, "translate_cloud_hedge_secret_key", "");
+	obs_data_set_default_string(s, "translate_cloud_hedge_region", "eastus");
+	obs_data_set_default_int(s, "translate_cloud_hedge_quantile", 90);
 
 	// webvtt options
 	obs_data_set_default_int(s, "webvtt_latency_to_video_in_msecs", 10'000);
@@ -775,6 +1195,14 @@ void transcription_filter_defaults(obs_data_t *s)
 	// backend options
 	obs_data_set_default_int(s, "backend_device", -1);
 	obs_data_set_default_bool(s, "enable_flash_attn", false);
+	obs_data_set_default_bool(s, "backend_autotune", false);
+	obs_data_set_default_bool(s, "model_warm_up", true);
+	obs_data_set_default_int(s, "inference_max_parallel", 2);
+	obs_data_set_default_int(s, "inference_max_wait_ms", 500);
+	obs_data_set_default_int(s, "inference_priority_class", INFERENCE_PRIORITY_NORMAL);
+	obs_data_set_default_int(s, "inference_thread_budget", 0);
+	obs_data_set_default_bool(s, "inference_pin_threads", false);
+	obs_data_set_default_int(s, "overload_max_level", OVERLOAD_LEVEL_FALLBACK_MODEL);
 
 	// Whisper parameters
 	apply_whisper_params_defaults_on_settings(s);
@@ -8,7 +8,9 @@
 #include <fstream>
 #include <sstream>
 #include <iomanip>
+#include <new>
 #include <bitset>
+#include <cmath>
 #include <regex>
 #ifdef _WIN32
 #define NOMINMAX
@@ -17,22 +19,31 @@
 
 #include <QString>
 
-#include "plugin-support.h"
+#include "plugin-log.h"
 #include "transcription-filter.h"
 #include "transcription-filter-callbacks.h"
 #include "transcription-filter-data.h"
 #include "transcription-filter-utils.h"
+#include "audio-archive.h"
+#include "caption-server.h"
+#include "filter-metrics.h"
+#include "caption-source-updater.h"
 #include "transcription-utils.h"
 #include "model-utils/model-downloader.h"
 #include "whisper-utils/whisper-processing.h"
 #include "whisper-utils/whisper-language.h"
 #include "whisper-utils/whisper-model-utils.h"
+#include "whisper-utils/whisper-model-registry.h"
+#include "whisper-utils/inference-thread-budget.h"
 #include "whisper-utils/whisper-utils.h"
+#include "whisper-utils/backend-devices.h"
 #include "whisper-utils/whisper-params.h"
+#include "whisper-utils/vad-pre-gate.h"
 #include "translation/language_codes.h"
 #include "translation/translation-utils.h"
 #include "translation/translation.h"
 #include "translation/translation-includes.h"
+#include "translation/translation-cache.h"
 #include "ui/filter-replace-dialog.h"
 #include "ui/filter-replace-utils.h"
 
@@ -58,59 +69,41 @@ void disconnect_source_signals(transcription_filter_data *gf, obs_source_t *pare
 	gf->source_signals_set = false;
 }
 
-void enumerate_gpu_devices(transcription_filter_data *gf)
+// the audio of a suspended filter is this much louder than its noise floor (12 dB), and louder
+// than VAD_PRE_GATE_MAX_RMS, for IDLE_RESUME_MS to load the models again
+#define IDLE_RESUME_MARGIN 4.0f
+#define IDLE_RESUME_MS 150
+// rise of the noise floor per packet towards a louder packet, about 10 s at 1024 frames
+#define IDLE_RESUME_FLOOR_RISE 0.002f
+
+// The first channel of the packets is louder than the noise for long enough to resume the
+// filter. The noise floor follows the quietest packets at once and rises slowly, so a steady
+// noise bed does not resume the filter, whatever its level.
+static bool idle_audio_resumes(struct transcription_filter_data *gf,
+			       const struct obs_audio_data *audio)
 {
-#ifdef WHISPER_DYNAMIC_BACKENDS
-	// Load CPU backends
-	auto path = std::filesystem::path(obs_get_module_binary_path(obs_current_module()))
-			    .parent_path();
-#if !defined(_WIN32) && defined(__linux__)
-	// Linux has modules in a subdirectory, Windows does not
-	path /= "obs-localvocal";
-#elif !defined(_WIN32)
-	// MacOS is just weird
-	path = path.parent_path() / "Frameworks";
-#endif
-
-	obs_log(LOG_INFO, "Loading dynamic backends from %s", path.string().c_str());
-	ggml_backend_load_all_from_path(path.string().c_str());
-#endif
-
-	// Enumerate backend devices to populate list
-	auto backend_count = ggml_backend_dev_count();
-	size_t gpu_count = 0;
-	for (size_t i = 0; i < backend_count; i++) {
-		auto backend_dev = ggml_backend_dev_get(i);
-		auto name = ggml_backend_dev_name(backend_dev);
-		auto desc = ggml_backend_dev_description(backend_dev);
-		auto type = "UNKNOWN";
-		bool add_device_to_config = false;
-		switch (ggml_backend_dev_type(backend_dev)) {
-		case GGML_BACKEND_DEVICE_TYPE_CPU:
-			type = "CPU";
-			break;
-		case GGML_BACKEND_DEVICE_TYPE_GPU:
-			type = "GPU";
-			add_device_to_config = true;
-			break;
-		case GGML_BACKEND_DEVICE_TYPE_ACCEL:
-			type = "ACCEL";
-			break;
-		case GGML_BACKEND_DEVICE_TYPE_IGPU:
-			type = "IGPU";
-			add_device_to_config = true;
-			break;
-		};
-		if (add_device_to_config) {
-			gpu_device_info device;
-			device.device_index = i;
-			device.device_name = name;
-			device.device_description = desc;
-			gf->gpu_devices.push_back(device);
-			gpu_count++;
-		}
-		obs_log(LOG_INFO, "Backend device %d (%s): %s - %s", i, type, name, desc);
-	};
+	const float *samples = reinterpret_cast<const float *>(audio->data[0]);
+	if (samples == nullptr || audio->frames == 0) {
+		return false;
+	}
+	float sum_squares = 0.0f;
+	for (uint32_t i = 0; i < audio->frames; i++) {
+		sum_squares += samples[i] * samples[i];
+	}
+	const float rms = std::sqrt(sum_squares / (float)audio->frames);
+	if (gf->idle_noise_floor <= 0.0f || rms < gf->idle_noise_floor) {
+		gf->idle_noise_floor = std::max(rms, VAD_PRE_GATE_MIN_FLOOR);
+	} else {
+		gf->idle_noise_floor += (rms - gf->idle_noise_floor) * IDLE_RESUME_FLOOR_RISE;
+	}
+	const bool loud = rms > VAD_PRE_GATE_MAX_RMS &&
+			  rms > gf->idle_noise_floor * IDLE_RESUME_MARGIN;
+	gf->idle_loud_frames = loud ? gf->idle_loud_frames + audio->frames : 0;
+	if ((uint64_t)gf->idle_loud_frames * 1000 < (uint64_t)IDLE_RESUME_MS * gf->sample_rate) {
+		return false;
+	}
+	gf->idle_loud_frames = 0;
+	return true;
 }
 
 struct obs_audio_data *transcription_filter_filter_audio(void *data, struct obs_audio_data *audio)
@@ -139,7 +132,7 @@ struct obs_audio_data *transcription_filter_filter_audio(void *data, struct obs_
 		return audio;
 	}
 
-	if (gf->whisper_context == nullptr) {
+	if (gf->whisper_context == nullptr && !gf->idle_suspended) {
 		// Whisper not initialized, just pass through
 		return audio;
 	}
@@ -155,22 +148,22 @@ struct obs_audio_data *transcription_filter_filter_audio(void *data, struct obs_
 		}
 	}
 
-	{
-		std::lock_guard<std::mutex> lock(gf->whisper_buf_mutex); // scoped lock
-		// push back current audio data to input deque
-		for (size_t c = 0; c < gf->channels; c++) {
-			deque_push_back(&gf->input_buffers[c], audio->data[c],
-					audio->frames * sizeof(float));
-		}
-		// push audio packet info (timestamp/frame count) to info deque
-		struct transcription_filter_audio_info info = {0};
-		info.frames = audio->frames; // number of frames in this packet
-		// calculate timestamp offset from the start of the stream
-		info.timestamp_offset_ns = now_ns() - gf->start_timestamp_ms * 1000000;
-		deque_push_back(&gf->info_buffer, &info, sizeof(info));
-		gf->wshiper_thread_cv.notify_one();
+	// the models of an idle filter are loaded again when the audio stays louder than the
+	// noise, the audio is buffered until the whisper thread runs
+	if (gf->idle_suspended && !gf->idle_resuming &&
+	    (!idle_audio_resumes(gf, audio) || !request_idle_resume(gf))) {
+		return audio;
 	}
 
+	// push current audio data and packet info (timestamp/frame count) to the input ring buffer.
+	// this never blocks: if the whisper thread fell behind and the ring is full the packet is
+	// dropped and counted, the whisper thread reports it.
+	// calculate timestamp offset from the start of the stream
+	const uint64_t timestamp_offset_ns = now_ns() - gf->start_timestamp_ms * 1000000;
+	gf->input_buffer.push((const float *const *)audio->data, audio->frames,
+			      timestamp_offset_ns);
+	notify_new_audio(gf, audio->frames);
+
 	return audio;
 }
 
@@ -205,21 +198,28 @@ void transcription_filter_destroy(void *data)
 	signal_handler_disconnect(sh_filter, "enable", enable_callback, gf);
 
 	obs_log(gf->log_level, "filter destroy");
+	filter_metrics_unregister(gf);
 	shutdown_whisper_thread(gf);
+	remove_inference_thread_budget(gf);
+	stop_translation_worker(gf);
+	remove_translation_cache_options(gf);
+	stop_cloud_translation(gf);
+	if (gf->trace_captions) {
+		gf->segment_trace.stop(gf->trace_file);
+	}
+	if (gf->debug_ring) {
+		debug_ring_release();
+	}
 
 	if (gf->resampler_to_whisper) {
 		audio_resampler_destroy(gf->resampler_to_whisper);
 	}
 
-	{
-		std::lock_guard<std::mutex> lockbuf(gf->whisper_buf_mutex);
-		bfree(gf->copy_buffers[0]);
-		gf->copy_buffers[0] = nullptr;
-		for (size_t i = 0; i < gf->channels; i++) {
-			deque_free(&gf->input_buffers[i]);
-		}
-	}
-	deque_free(&gf->info_buffer);
+	bfree(gf->copy_buffers[0]);
+	gf->copy_buffers[0] = nullptr;
+	gf->input_buffer.release();
+	gf->whisper_buffer.release();
+	gf->decimator.release();
 
 	deque_free(&gf->resampled_buffer);
 
@@ -240,8 +240,16 @@ void transcription_filter_destroy(void *data)
 	if (gf->cloud_translation_monitor.isEnabled()) {
 		gf->cloud_translation_monitor.stopThread();
 	}
+	if (gf->stream_caption_monitor.isEnabled()) {
+		gf->stream_caption_monitor.stopThread();
+	}
+	stop_caption_updates(gf);
+	caption_server_unsubscribe(gf);
 
-	bfree(gf);
+	// the threads of the filter are joined above, so none of the std::thread members is still
+	// joinable when the members are destroyed
+	gf->~transcription_filter_data();
+	::operator delete(gf, std::align_val_t(alignof(struct transcription_filter_data)));
 }
 
 void text_output_source_update(const char *new_text_source_name, std::string &text_source,
@@ -262,98 +270,14 @@ void text_output_source_update(const char *new_text_source_name, std::string &te
 	}
 }
 
-void transcription_filter_update(void *data, obs_data_t *s)
+// Enable, disable or reconfigure the buffered output monitors
+static void update_caption_monitors(struct transcription_filter_data *gf, obs_data_t *s)
 {
-	struct transcription_filter_data *gf =
-		static_cast<struct transcription_filter_data *>(data);
-	obs_log(gf->log_level, "LocalVocal filter update");
-
-	gf->log_level = (int)obs_data_get_int(s, "log_level");
-	gf->vad_mode = (int)obs_data_get_int(s, "vad_mode");
-	gf->log_words = obs_data_get_bool(s, "log_words");
-	gf->caption_to_stream = obs_data_get_bool(s, "caption_to_stream");
-#ifdef ENABLE_WEBVTT
-	gf->webvtt_caption_to_stream = obs_data_get_bool(s, "webvtt_caption_to_stream");
-	gf->webvtt_caption_to_recording = obs_data_get_bool(s, "webvtt_caption_to_recording");
-
-	{
-		auto lock = std::unique_lock(gf->webvtt_settings_mutex);
-		gf->latency_to_video_in_msecs = static_cast<uint16_t>(std::max(
-			0ll, std::min(static_cast<long long>(std::numeric_limits<uint16_t>::max()),
-				      obs_data_get_int(s, "webvtt_latency_to_video_in_msecs"))));
-		gf->send_frequency_hz = static_cast<uint8_t>(std::max(
-			1ll, std::min(static_cast<long long>(std::numeric_limits<uint8_t>::max()),
-				      obs_data_get_int(s, "webvtt_send_frequency_hz"))));
-
-		gf->active_languages.clear();
-		DStr name_buffer;
-		for (size_t i = 0; i < MAX_WEBVTT_TRACKS; i++) {
-			dstr_printf(name_buffer, "webvtt_language_%zu", i);
-			if (!obs_data_has_user_value(s, name_buffer->array))
-				continue;
-
-			std::string lang = obs_data_get_string(s, name_buffer->array);
-			if (lang.empty())
-				continue;
-
-			if (std::find(gf->active_languages.begin(), gf->active_languages.end(),
-				      lang) != gf->active_languages.end()) {
-				obs_log(LOG_WARNING, "Not adding duplicate language '%s'",
-					lang.c_str());
-				continue;
-			}
-
-			gf->active_languages.push_back(lang);
-		}
-	}
-#endif
-	gf->save_to_file = obs_data_get_bool(s, "file_output_enable");
-	gf->save_srt = obs_data_get_bool(s, "subtitle_save_srt");
-	gf->truncate_output_file = obs_data_get_bool(s, "truncate_output_file");
-	gf->save_only_while_recording = obs_data_get_bool(s, "only_while_recording");
-	gf->rename_file_to_match_recording = obs_data_get_bool(s, "rename_file_to_match_recording");
-	// Get the current timestamp using the system clock
-	gf->start_timestamp_ms = now_ms();
-	gf->sentence_number = 1;
-	gf->process_while_muted = obs_data_get_bool(s, "process_while_muted");
-	gf->min_sub_duration = (int)obs_data_get_int(s, "min_sub_duration");
-	gf->max_sub_duration = (int)obs_data_get_int(s, "max_sub_duration");
-	gf->last_sub_render_time = now_ms();
-	gf->duration_filter_threshold = (float)obs_data_get_double(s, "duration_filter_threshold");
-	gf->segment_duration = (int)obs_data_get_int(s, "segment_duration");
-	gf->partial_transcription = obs_data_get_bool(s, "partial_group");
-	gf->partial_latency = (int)obs_data_get_int(s, "partial_latency");
 	bool new_buffered_output = obs_data_get_bool(s, "buffered_output");
 	int new_buffer_num_lines = (int)obs_data_get_int(s, "buffer_num_lines");
 	int new_buffer_num_chars_per_line = (int)obs_data_get_int(s, "buffer_num_chars_per_line");
 	TokenBufferSegmentation new_buffer_output_type =
 		(TokenBufferSegmentation)obs_data_get_int(s, "buffer_output_type");
-	const char *filter_words_replace = obs_data_get_string(s, "filter_words_replace");
-	if (filter_words_replace != nullptr && strlen(filter_words_replace) > 0) {
-		obs_log(gf->log_level, "filter_words_replace: %s", filter_words_replace);
-		// deserialize the filter words replace
-		try {
-			gf->filter_words_replace =
-				deserialize_filter_words_replace(filter_words_replace);
-		} catch (const std::exception &e) {
-			obs_log(LOG_ERROR, "Error deserialising filter words: %s", e.what());
-		}
-	} else {
-		// clear the filter words replace
-		gf->filter_words_replace.clear();
-	}
-
-	if (gf->save_to_file) {
-		gf->output_file_path = "";
-		// set the output file path
-		const char *output_file_path = obs_data_get_string(s, "subtitle_output_filename");
-		if (output_file_path != nullptr && strlen(output_file_path) > 0) {
-			gf->output_file_path = output_file_path;
-		} else {
-			obs_log(gf->log_level, "output file path is empty, but selected to save");
-		}
-	}
-
 	if (new_buffered_output) {
 		obs_log(gf->log_level, "buffered_output enable");
 		if (!gf->buffered_output || !gf->captions_monitor.isEnabled()) {
@@ -362,38 +286,23 @@ void transcription_filter_update(void *data, obs_data_t *s)
 			gf->captions_monitor.initialize(
 				gf,
 				[gf](const std::string &text) {
-					if (gf->buffered_output) {
-						send_caption_to_source(gf->text_source_name, text,
-								       gf);
-					}
+					send_buffered_caption(gf, NO_TRANSLATION, text);
 				},
 				new_buffer_num_lines, new_buffer_num_chars_per_line,
 				std::chrono::seconds(3), new_buffer_output_type);
 			gf->translation_monitor.initialize(
 				gf,
 				[gf](const std::string &translated_text) {
-					if (gf->buffered_output) {
-						send_caption_to_source(
-							(gf->translation_output.empty() ||
-							 (gf->translation_output == "none"))
-								? gf->text_source_name
-								: gf->translation_output,
-							translated_text, gf);
-					}
+					send_buffered_caption(gf, LOCAL_TRANSLATION,
+							      translated_text);
 				},
 				new_buffer_num_lines, new_buffer_num_chars_per_line,
 				std::chrono::seconds(3), new_buffer_output_type);
 			gf->cloud_translation_monitor.initialize(
 				gf,
 				[gf](const std::string &translated_text) {
-					if (gf->buffered_output) {
-						send_caption_to_source(
-							(gf->translate_cloud_output.empty() ||
-							 (gf->translate_cloud_output == "none"))
-								? gf->text_source_name
-								: gf->translate_cloud_output,
-							translated_text, gf);
-					}
+					send_buffered_caption(gf, CLOUD_TRANSLATION,
+							      translated_text);
 				},
 				new_buffer_num_lines, new_buffer_num_chars_per_line,
 				std::chrono::seconds(3), new_buffer_output_type);
@@ -410,10 +319,7 @@ void transcription_filter_update(void *data, obs_data_t *s)
 				gf->captions_monitor.setSegmentation(new_buffer_output_type);
 				gf->captions_monitor.setCaptionPresentationCallback(
 					[gf](const std::string &text) {
-						if (gf->buffered_output) {
-							send_caption_to_source(gf->text_source_name,
-									       text, gf);
-						}
+						send_buffered_caption(gf, NO_TRANSLATION, text);
 					});
 
 				gf->translation_monitor.clear();
@@ -423,14 +329,8 @@ void transcription_filter_update(void *data, obs_data_t *s)
 				gf->translation_monitor.setSegmentation(new_buffer_output_type);
 				gf->translation_monitor.setCaptionPresentationCallback(
 					[gf](const std::string &translated_text) {
-						if (gf->buffered_output) {
-							send_caption_to_source(
-								(gf->translation_output.empty() ||
-								 (gf->translation_output == "none"))
-									? gf->text_source_name
-									: gf->translation_output,
-								translated_text, gf);
-						}
+						send_buffered_caption(gf, LOCAL_TRANSLATION,
+								      translated_text);
 					});
 
 				gf->cloud_translation_monitor.clear();
@@ -441,15 +341,8 @@ void transcription_filter_update(void *data, obs_data_t *s)
 					new_buffer_output_type);
 				gf->cloud_translation_monitor.setCaptionPresentationCallback(
 					[gf](const std::string &translated_text) {
-						if (gf->buffered_output) {
-							send_caption_to_source(
-								(gf->translate_cloud_output.empty() ||
-								 (gf->translate_cloud_output ==
-								  "none"))
-									? gf->text_source_name
-									: gf->translate_cloud_output,
-								translated_text, gf);
-						}
+						send_buffered_caption(gf, CLOUD_TRANSLATION,
+								      translated_text);
 					});
 			}
 		}
@@ -471,6 +364,185 @@ void transcription_filter_update(void *data, obs_data_t *s)
 			gf->buffered_output = false;
 		}
 	}
+}
+
+void transcription_filter_update(void *data, obs_data_t *s)
+{
+	struct transcription_filter_data *gf =
+		static_cast<struct transcription_filter_data *>(data);
+	obs_log(gf->log_level, "LocalVocal filter update");
+	// only the subsystems whose settings changed are restarted
+	gf->settings_snapshot.update(s);
+	const SettingsSnapshot &settings = gf->settings_snapshot;
+
+	gf->log_level = (int)obs_data_get_int(s, "log_level");
+	gf->vad_mode = (int)obs_data_get_int(s, "vad_mode");
+	gf->vad_pre_gate = obs_data_get_bool(s, "vad_pre_gate");
+	gf->input_channel = (int)obs_data_get_int(s, "input_channel");
+	gf->idle_suspend_s = (int)obs_data_get_int(s, "idle_suspend_s");
+	gf->log_words = obs_data_get_bool(s, "log_words");
+	gf->trace_file = obs_data_get_string(s, "trace_file");
+	if (gf->trace_file.empty()) {
+		char *config_file = obs_module_config_path("segment-trace.json");
+		gf->trace_file = config_file != nullptr ? config_file : "";
+		bfree(config_file);
+	}
+	const bool trace_captions = obs_data_get_bool(s, "trace_captions");
+	if (trace_captions && !gf->trace_captions) {
+		obs_log(LOG_INFO, "Tracing the caption segments");
+		gf->segment_trace.start();
+	} else if (!trace_captions && gf->trace_captions) {
+		gf->segment_trace.stop(gf->trace_file);
+	}
+	gf->trace_captions = trace_captions;
+	const bool debug_ring = obs_data_get_bool(s, "log_debug_ring");
+	if (debug_ring && !gf->debug_ring) {
+		debug_ring_retain();
+	} else if (!debug_ring && gf->debug_ring) {
+		debug_ring_release();
+	}
+	gf->debug_ring = debug_ring;
+	gf->caption_to_stream = obs_data_get_bool(s, "caption_to_stream");
+	gf->stream_caption_mode = (StreamCaptionMode)obs_data_get_int(s, "stream_caption_mode");
+	if (gf->caption_to_stream && gf->stream_caption_mode == STREAM_CAPTION_ROLL_UP) {
+		if (!gf->stream_caption_monitor.isEnabled()) {
+			gf->stream_caption_pending_ms = 0;
+			// the whole new text at once, the lines roll up as the sentences grow
+			gf->stream_caption_monitor.initialize(
+				gf,
+				[gf](const std::string &caption) {
+					send_roll_up_caption_to_stream(gf, caption);
+				},
+				STREAM_CAPTION_ROLL_UP_LINES, STREAM_CAPTION_COLUMNS,
+				std::chrono::seconds(3), SEGMENTATION_SENTENCE);
+		}
+	} else if (gf->stream_caption_monitor.isEnabled()) {
+		gf->stream_caption_monitor.clear();
+		gf->stream_caption_monitor.stopThread();
+	}
+#ifdef ENABLE_WEBVTT
+	gf->webvtt_caption_to_stream = obs_data_get_bool(s, "webvtt_caption_to_stream");
+	gf->webvtt_caption_to_recording = obs_data_get_bool(s, "webvtt_caption_to_recording");
+
+	if (settings.changed_prefix("webvtt_")) {
+		auto lock = std::unique_lock(gf->webvtt_settings_mutex);
+		gf->latency_to_video_in_msecs = static_cast<uint16_t>(std::max(
+			0ll, std::min(static_cast<long long>(std::numeric_limits<uint16_t>::max()),
+				      obs_data_get_int(s, "webvtt_latency_to_video_in_msecs"))));
+		gf->send_frequency_hz = static_cast<uint8_t>(std::max(
+			1ll, std::min(static_cast<long long>(std::numeric_limits<uint8_t>::max()),
+				      obs_data_get_int(s, "webvtt_send_frequency_hz"))));
+
+		gf->active_languages.clear();
+		DStr name_buffer;
+		for (size_t i = 0; i < MAX_WEBVTT_TRACKS; i++) {
+			dstr_printf(name_buffer, "webvtt_language_%zu", i);
+			if (!obs_data_has_user_value(s, name_buffer->array))
+				continue;
+
+			std::string lang = obs_data_get_string(s, name_buffer->array);
+			if (lang.empty())
+				continue;
+
+			if (std::find(gf->active_languages.begin(), gf->active_languages.end(),
+				      lang) != gf->active_languages.end()) {
+				obs_log(LOG_WARNING, "Not adding duplicate language '%s'",
+					lang.c_str());
+				continue;
+			}
+
+			gf->active_languages.push_back(lang);
+		}
+	}
+#endif
+	gf->save_to_file = obs_data_get_bool(s, "file_output_enable");
+	gf->save_srt = obs_data_get_bool(s, "subtitle_save_srt");
+	gf->save_jsonl = obs_data_get_bool(s, "subtitle_save_jsonl");
+	gf->truncate_output_file = obs_data_get_bool(s, "truncate_output_file");
+	gf->save_only_while_recording = obs_data_get_bool(s, "only_while_recording");
+	gf->rename_file_to_match_recording = obs_data_get_bool(s, "rename_file_to_match_recording");
+	if (settings.changed("file_output_enable") || settings.changed("subtitle_output_filename") ||
+	    settings.changed("subtitle_save_srt") || settings.changed("subtitle_save_jsonl")) {
+		// the output file starts over: get the current timestamp using the system clock
+		gf->start_timestamp_ms = now_ms();
+		gf->sentence_number = 1;
+	}
+	gf->process_while_muted = obs_data_get_bool(s, "process_while_muted");
+	gf->min_sub_duration = (int)obs_data_get_int(s, "min_sub_duration");
+	gf->max_sub_duration = (int)obs_data_get_int(s, "max_sub_duration");
+	gf->last_sub_render_time = now_ms();
+	set_translation_cache_options(gf, (size_t)obs_data_get_int(s, "translation_cache_size"),
+				      obs_data_get_bool(s, "translation_cache_persist"));
+	gf->duration_filter_threshold = (float)obs_data_get_double(s, "duration_filter_threshold");
+	gf->segment_duration = (int)obs_data_get_int(s, "segment_duration");
+	gf->segment_overlap_ms = (int)obs_data_get_int(s, "segment_overlap_ms");
+	gf->partial_transcription = obs_data_get_bool(s, "partial_group");
+	gf->partial_latency = (int)obs_data_get_int(s, "partial_latency");
+	gf->partial_incremental = obs_data_get_bool(s, "partial_incremental");
+	gf->mel_cache_enabled = obs_data_get_bool(s, "mel_cache");
+	gf->caption_update_interval_us =
+		caption_update_interval_us((int)obs_data_get_int(s, "caption_max_update_rate"));
+	auto audio_archive = std::make_shared<audio_archive_settings>();
+	if (obs_data_get_bool(s, "audio_archive_enable")) {
+		audio_archive->folder = obs_data_get_string(s, "audio_archive_folder");
+	}
+	audio_archive->silence = obs_data_get_bool(s, "audio_archive_silence");
+	audio_archive->max_bytes =
+		(uint64_t)obs_data_get_int(s, "audio_archive_max_mb") * 1024 * 1024;
+	gf->enable_audio_chunks_callback = !audio_archive->folder.empty();
+	std::atomic_store(&gf->audio_archive,
+			  std::shared_ptr<const audio_archive_settings>(std::move(audio_archive)));
+	gf->retranscribe_recordings = obs_data_get_bool(s, "retranscribe_recordings");
+	gf->retranscribe_model_path = obs_data_get_string(s, "retranscribe_model_path");
+	gf->retranscribe_beam_size = (int)obs_data_get_int(s, "retranscribe_beam_size");
+	if (obs_data_get_bool(s, "caption_server_enable")) {
+		caption_server_subscribe(gf, (int)obs_data_get_int(s, "caption_server_port"),
+					 obs_data_get_string(s, "caption_server_origins"));
+	} else {
+		caption_server_unsubscribe(gf);
+	}
+	if (settings.changed("filter_words_replace")) {
+		// the regexes are compiled again only when the filters changed
+		const char *filter_words_replace = obs_data_get_string(s, "filter_words_replace");
+		if (filter_words_replace != nullptr && strlen(filter_words_replace) > 0) {
+			obs_log(gf->log_level, "filter_words_replace: %s", filter_words_replace);
+			// deserialize the filter words replace
+			try {
+				gf->filter_words_replace =
+					deserialize_filter_words_replace(filter_words_replace);
+			} catch (const std::exception &e) {
+				obs_log(LOG_ERROR, "Error deserialising filter words: %s", e.what());
+			}
+		} else {
+			// clear the filter words replace
+			gf->filter_words_replace.clear();
+		}
+		std::shared_ptr<const WordFilter> word_filter;
+		if (!gf->filter_words_replace.empty()) {
+			word_filter = std::make_shared<const WordFilter>(gf->filter_words_replace);
+		}
+		std::atomic_store(&gf->filter_words_compiled, word_filter);
+	}
+
+	if (gf->save_to_file) {
+		gf->output_file_path = "";
+		// set the output file path
+		const char *output_file_path = obs_data_get_string(s, "subtitle_output_filename");
+		if (output_file_path != nullptr && strlen(output_file_path) > 0) {
+			gf->output_file_path = output_file_path;
+		} else {
+			obs_log(gf->log_level, "output file path is empty, but selected to save");
+		}
+	}
+
+	if (settings.changed_prefix("buffer")) {
+		// setting the monitors up again clears their captions
+		update_caption_monitors(gf, s);
+	}
+	// the transcription tokens are revealed when they were spoken, plus the delay
+	gf->buffered_output_timed = obs_data_get_bool(s, "buffer_timed_presentation");
+	gf->captions_monitor.setPresentationDelay(
+		std::chrono::milliseconds(obs_data_get_int(s, "buffer_presentation_delay_ms")));
 
 	bool new_translate = obs_data_get_bool(s, "translate");
 	gf->target_lang = obs_data_get_string(s, "translate_target_language");
@@ -480,19 +552,54 @@ void transcription_filter_update(void *data, obs_data_t *s)
 	gf->translate_only_full_sentences = obs_data_get_bool(s, "translate_only_full_sentences");
 	text_output_source_update(obs_data_get_string(s, "translate_output"),
 				  gf->translation_output, gf);
+	{
+		std::lock_guard<std::mutex> lock(gf->translation_ctx_mutex);
+		gf->extra_translation_targets.resize(MAX_TRANSLATION_TARGETS - 1);
+		for (int i = 2; i <= MAX_TRANSLATION_TARGETS; i++) {
+			const std::string index = std::to_string(i);
+			translation_target &target = gf->extra_translation_targets[i - 2];
+			const std::string language = obs_data_get_string(
+				s, ("translate_target_language_" + index).c_str());
+			if (language != target.language) {
+				target.language = language;
+				target.last_text.clear();
+				target.last_translation.clear();
+			}
+			text_output_source_update(
+				obs_data_get_string(s, ("translate_output_" + index).c_str()),
+				target.output, gf);
+		}
+	}
 	std::string new_translate_model_index = obs_data_get_string(s, "translate_model");
 	std::string new_translation_model_path_external =
 		obs_data_get_string(s, "translation_model_path_external");
+	int new_translate_device = (int)obs_data_get_int(s, "translate_device");
+	std::string new_translate_compute_type = obs_data_get_string(s, "translate_compute_type");
+	int new_translate_inter_threads = (int)obs_data_get_int(s, "translate_inter_threads");
+	int new_translate_intra_threads = (int)obs_data_get_int(s, "translate_intra_threads");
 
 	if (new_translate) {
 		if (new_translate != gf->translate ||
 		    new_translate_model_index != gf->translation_model_index ||
-		    new_translation_model_path_external != gf->translation_model_path_external) {
+		    new_translation_model_path_external != gf->translation_model_path_external ||
+		    new_translate_device != gf->translation_ctx.device_index ||
+		    new_translate_compute_type != gf->translation_ctx.compute_type ||
+		    new_translate_inter_threads != gf->translation_ctx.inter_threads ||
+		    new_translate_intra_threads != gf->translation_ctx.intra_threads) {
 			// translation settings changed
+			{
+				std::lock_guard<std::mutex> lock(gf->translation_ctx_mutex);
+				gf->translation_ctx.device_index = new_translate_device;
+				gf->translation_ctx.compute_type = new_translate_compute_type;
+				gf->translation_ctx.inter_threads = new_translate_inter_threads;
+				gf->translation_ctx.intra_threads = new_translate_intra_threads;
+			}
 			gf->translation_model_index = new_translate_model_index;
 			gf->translation_model_path_external = new_translation_model_path_external;
 			if (gf->translation_model_index != "whisper-based-translation") {
-				start_translation(gf);
+				// the filters of a scene collection do not load the CT2 model
+				// before they need it
+				start_translation(gf, gf->initial_creation);
 			} else {
 				// whisper-based translation
 				obs_log(gf->log_level, "Starting whisper-based translation...");
@@ -505,20 +612,22 @@ void transcription_filter_update(void *data, obs_data_t *s)
 
 	// translation options
 	if (gf->translate) {
-		if (gf->translation_ctx.options) {
-			gf->translation_ctx.options->sampling_temperature =
-				(float)obs_data_get_double(s, "translation_sampling_temperature");
-			gf->translation_ctx.options->repetition_penalty =
-				(float)obs_data_get_double(s, "translation_repetition_penalty");
-			gf->translation_ctx.options->beam_size =
-				(int)obs_data_get_int(s, "translation_beam_size");
-			gf->translation_ctx.options->max_decoding_length =
-				(int)obs_data_get_int(s, "translation_max_decoding_length");
-			gf->translation_ctx.options->no_repeat_ngram_size =
-				(int)obs_data_get_int(s, "translation_no_repeat_ngram_size");
-			gf->translation_ctx.options->max_input_length =
-				(int)obs_data_get_int(s, "translation_max_input_length");
+		if (!gf->translation_ctx.options) {
+			// not loaded yet, the model keeps the options
+			gf->translation_ctx.options.reset(new ctranslate2::TranslationOptions);
 		}
+		gf->translation_ctx.options->sampling_temperature =
+			(float)obs_data_get_double(s, "translation_sampling_temperature");
+		gf->translation_ctx.options->repetition_penalty =
+			(float)obs_data_get_double(s, "translation_repetition_penalty");
+		gf->translation_ctx.options->beam_size =
+			(int)obs_data_get_int(s, "translation_beam_size");
+		gf->translation_ctx.options->max_decoding_length =
+			(int)obs_data_get_int(s, "translation_max_decoding_length");
+		gf->translation_ctx.options->no_repeat_ngram_size =
+			(int)obs_data_get_int(s, "translation_no_repeat_ngram_size");
+		gf->translation_ctx.options->max_input_length =
+			(int)obs_data_get_int(s, "translation_max_input_length");
 	}
 
 	gf->translate_cloud = obs_data_get_bool(s, "translate_cloud");
@@ -529,6 +638,7 @@ void transcription_filter_update(void *data, obs_data_t *s)
 				  gf->translate_cloud_output, gf);
 	gf->translate_cloud_only_full_sentences =
 		obs_data_get_bool(s, "translate_cloud_only_full_sentences");
+	gf->translate_cloud_stream = obs_data_get_bool(s, "translate_cloud_stream");
 	gf->translate_cloud_config.access_key = obs_data_get_string(s, "translate_cloud_api_key");
 	gf->translate_cloud_config.secret_key =
 		obs_data_get_string(s, "translate_cloud_secret_key");
@@ -538,13 +648,36 @@ void transcription_filter_update(void *data, obs_data_t *s)
 	gf->translate_cloud_config.body = obs_data_get_string(s, "translate_cloud_body");
 	gf->translate_cloud_config.response_json_path =
 		obs_data_get_string(s, "translate_cloud_response_json_path");
+	gf->translate_cloud_config.hedge.reset();
+	const std::string hedge_provider = obs_data_get_string(s, "translate_cloud_hedge_provider");
+	if (hedge_provider != "none" && !hedge_provider.empty()) {
+		// the other options (DeepL free endpoint, model) are the ones of the primary
+		auto hedge = std::make_shared<CloudTranslatorConfig>(gf->translate_cloud_config);
+		hedge->provider = hedge_provider;
+		hedge->access_key = obs_data_get_string(s, "translate_cloud_hedge_api_key");
+		hedge->secret_key = obs_data_get_string(s, "translate_cloud_hedge_secret_key");
+		hedge->region = obs_data_get_string(s, "translate_cloud_hedge_region");
+		gf->translate_cloud_config.hedge = std::move(hedge);
+	}
+	gf->translate_cloud_config.hedge_quantile =
+		(int)obs_data_get_int(s, "translate_cloud_hedge_quantile");
 
 	int new_backend_device = (int)obs_data_get_int(s, "backend_device");
 	bool enable_flash_attn = obs_data_get_bool(s, "enable_flash_attn");
-	bool whisper_backend_changed = (gf->gpu_device == new_backend_device) ||
+	bool whisper_backend_changed = (gf->gpu_device != new_backend_device) ||
 				       (enable_flash_attn != gf->enable_flash_attn);
 	gf->gpu_device = new_backend_device;
 	gf->enable_flash_attn = enable_flash_attn;
+	gf->backend_autotune = obs_data_get_bool(s, "backend_autotune");
+	gf->inference_max_parallel = (int)obs_data_get_int(s, "inference_max_parallel");
+	gf->inference_max_wait_ms = (uint64_t)obs_data_get_int(s, "inference_max_wait_ms");
+	gf->inference_priority_class = (int)obs_data_get_int(s, "inference_priority_class");
+	gf->overload.set_max_level((int)obs_data_get_int(s, "overload_max_level"));
+	gf->sticky_language.configure(obs_data_get_bool(s, "sticky_language"),
+				      (int)obs_data_get_int(s, "sticky_language_detections"),
+				      (int)obs_data_get_int(s, "sticky_language_recheck"));
+	set_inference_thread_budget(gf, (int)obs_data_get_int(s, "inference_thread_budget"),
+				    obs_data_get_bool(s, "inference_pin_threads"));
 
 	obs_log(gf->log_level, "update text source");
 	// update the text source
@@ -552,20 +685,19 @@ void transcription_filter_update(void *data, obs_data_t *s)
 				  gf);
 
 	obs_log(gf->log_level, "update whisper params");
+	gf->context_prompt.set_max_tokens((int)obs_data_get_int(s, "n_context_tokens"));
+	gf->sentence_psum_accept_thresh =
+		(float)obs_data_get_double(s, "sentence_psum_accept_thresh");
+	gf->audio_ctx_auto = obs_data_get_bool(s, "audio_ctx_auto");
+	gf->model_warm_up = obs_data_get_bool(s, "model_warm_up");
 	{
-		std::lock_guard<std::mutex> lock(gf->whisper_ctx_mutex);
-
-		gf->n_context_sentences = (int)obs_data_get_int(s, "n_context_sentences");
-
-		gf->sentence_psum_accept_thresh =
-			(float)obs_data_get_double(s, "sentence_psum_accept_thresh");
+		// the inferences copy the params, a decode in progress keeps its own
+		std::lock_guard<std::mutex> lock(gf->whisper_params_mutex);
 
+		const std::string previous_language =
+			gf->whisper_params.language != nullptr ? gf->whisper_params.language : "";
 		apply_whisper_params_from_settings(gf->whisper_params, s);
 
-		// if (gf->whisper_params.abort_callback == nullptr) {
-		// 	gf->whisper_params.abort_callback = whisper_abort_callback;
-		// }
-
 		if (!new_translate || gf->translation_model_index != "whisper-based-translation") {
 			const char *whisper_language_select =
 				obs_data_get_string(s, "whisper_language_select");
@@ -585,13 +717,29 @@ void transcription_filter_update(void *data, obs_data_t *s)
 				gf->whisper_params.detect_language = true;
 			}
 		}
-
-		if (gf->vad) {
-			const float vad_threshold = (float)obs_data_get_double(s, "vad_threshold");
-			gf->vad->set_threshold(vad_threshold);
+		if (previous_language != (gf->whisper_params.language != nullptr
+						  ? gf->whisper_params.language
+						  : "")) {
+			gf->sticky_language.reset();
 		}
 	}
 
+	gf->vad_threshold = (float)obs_data_get_double(s, "vad_threshold");
+	const int new_vad_provider = (int)obs_data_get_int(s, "vad_provider");
+	const int new_vad_intra_threads = (int)obs_data_get_int(s, "vad_intra_threads");
+	const int new_vad_inter_threads = (int)obs_data_get_int(s, "vad_inter_threads");
+	const bool new_vad_optimized_cache = obs_data_get_bool(s, "vad_optimized_cache");
+	if (new_vad_provider != gf->vad_provider || new_vad_intra_threads != gf->vad_intra_threads ||
+	    new_vad_inter_threads != gf->vad_inter_threads ||
+	    new_vad_optimized_cache != gf->vad_optimized_cache) {
+		gf->vad_provider = new_vad_provider;
+		gf->vad_intra_threads = new_vad_intra_threads;
+		gf->vad_inter_threads = new_vad_inter_threads;
+		gf->vad_optimized_cache = new_vad_optimized_cache;
+		// the whisper thread recreates the VAD between two segmentation runs
+		gf->vad_reload = gf->vad != nullptr;
+	}
+
 	if (gf->context != nullptr && (obs_source_enabled(gf->context) || gf->initial_creation)) {
 		if (gf->initial_creation) {
 			obs_log(LOG_INFO, "Initial filter creation and source enabled");
@@ -606,12 +754,26 @@ void transcription_filter_update(void *data, obs_data_t *s)
 				obs_data_get_string(s, "whisper_model_path") != nullptr
 					? obs_data_get_string(s, "whisper_model_path")
 					: "Whisper Tiny English (74Mb)";
+			const std::string new_draft_model =
+				obs_data_get_string(s, "partial_draft_model") != nullptr
+					? obs_data_get_string(s, "partial_draft_model")
+					: "";
 			if (gf->whisper_model_path != new_model_path) {
 				obs_log(LOG_INFO, "New model selected: %s", new_model_path.c_str());
 				update_whisper_model(gf);
 			} else if (whisper_backend_changed) {
 				obs_log(LOG_INFO, "Whisper backend changed");
 				update_whisper_model(gf, true);
+			} else if (gf->draft_model_name !=
+				   (new_draft_model == new_model_path ? "" : new_draft_model)) {
+				obs_log(LOG_INFO, "New draft model selected: %s",
+					new_draft_model.c_str());
+				update_whisper_model(gf);
+			} else if (settings.changed("whisper_model_path_external") ||
+				   settings.changed("dtw_token_timestamps") ||
+				   settings.changed("whisper_model_quantization")) {
+				// the external model file, the DTW timestamps or the quantization
+				update_whisper_model(gf);
 			}
 		}
 	} else {
@@ -623,8 +785,11 @@ void *transcription_filter_create(obs_data_t *settings, obs_source_t *filter)
 {
 	obs_log(LOG_INFO, "LocalVocal filter create");
 
-	void *data = bmalloc(sizeof(struct transcription_filter_data));
+	// the ring buffer indices are aligned to cache lines, beyond the alignment of bmalloc
+	void *data = ::operator new(sizeof(struct transcription_filter_data),
+				    std::align_val_t(alignof(struct transcription_filter_data)));
 	struct transcription_filter_data *gf = new (data) transcription_filter_data();
+	gf->pipeline_timings = &gf->metrics.timings;
 
 	// Get the number of channels for the input source
 	gf->channels = audio_output_get_channels(obs_get_audio());
@@ -636,6 +801,7 @@ void *transcription_filter_create(obs_data_t *settings, obs_source_t *filter)
 	gf->last_sub_render_time = now_ms();
 	gf->log_level = (int)obs_data_get_int(settings, "log_level");
 	gf->save_srt = obs_data_get_bool(settings, "subtitle_save_srt");
+	gf->save_jsonl = obs_data_get_bool(settings, "subtitle_save_jsonl");
 	gf->truncate_output_file = obs_data_get_bool(settings, "truncate_output_file");
 	gf->save_only_while_recording = obs_data_get_bool(settings, "only_while_recording");
 	gf->rename_file_to_match_recording =
@@ -644,11 +810,14 @@ void *transcription_filter_create(obs_data_t *settings, obs_source_t *filter)
 	gf->buffered_output = obs_data_get_bool(settings, "buffered_output");
 	gf->initial_creation = true;
 
-	for (size_t i = 0; i < gf->channels; i++) {
-		deque_init(&gf->input_buffers[i]);
+	if (!gf->input_buffer.init(gf->channels, (size_t)((float)gf->sample_rate /
+							  (1000.0f / MAX_MS_INPUT_BUFFER)))) {
+		obs_log(LOG_ERROR, "Failed to allocate input ring buffer");
+		gf->active = false;
+		return nullptr;
 	}
-	deque_init(&gf->info_buffer);
-	deque_init(&gf->whisper_buffer);
+	gf->whisper_buffer.init(MAX_MS_WORK_BUFFER * WHISPER_SAMPLE_RATE / 1000,
+				SEGMENT_PADDING_SAMPLES);
 	deque_init(&gf->resampled_buffer);
 
 	// allocate copy buffers
@@ -680,6 +849,11 @@ void *transcription_filter_create(obs_data_t *settings, obs_source_t *filter)
 	dst.speakers = convert_speaker_layout((uint8_t)1);
 
 	gf->resampler_to_whisper = audio_resampler_create(&dst, &src);
+	if (gf->decimator.init(gf->channels, (int)gf->sample_rate, WHISPER_SAMPLE_RATE,
+			       gf->frames)) {
+		obs_log(gf->log_level, "using the fused downmix and decimation to 16 kHz");
+	}
+	gf->timeline.init(WHISPER_SAMPLE_RATE);
 	if (!gf->resampler_to_whisper) {
 		obs_log(LOG_ERROR, "Failed to create resampler");
 		gf->active = false;
@@ -700,6 +874,7 @@ void *transcription_filter_create(obs_data_t *settings, obs_source_t *filter)
 	create_obs_text_source_if_needed();
 	obs_log(gf->log_level, "clear paths and whisper context");
 	gf->whisper_model_file_currently_loaded = "";
+	gf->whisper_model_file_requested = "";
 	gf->output_file_path = std::string("");
 	gf->whisper_model_path = std::string(""); // The update function will set the model path
 	gf->whisper_context = nullptr;
@@ -713,7 +888,9 @@ void *transcription_filter_create(obs_data_t *settings, obs_source_t *filter)
 
 	signal_handler_connect(sh_filter, "enable", enable_callback, gf);
 
-	enumerate_gpu_devices(gf);
+	// the first filter loads the backends, before its model
+	backend_gpu_devices();
+	start_translation_worker(gf);
 
 	obs_log(gf->log_level, "run update");
 	// get the settings updated on the filter data struct
@@ -723,6 +900,8 @@ void *transcription_filter_create(obs_data_t *settings, obs_source_t *filter)
 	// to match the subtitles with the recording
 	obs_frontend_add_event_callback(recording_state_callback, gf);
 
+	filter_metrics_register(gf);
+
 	obs_log(gf->log_level, "filter created.");
 	return gf;
 }
@@ -733,6 +912,10 @@ void transcription_filter_activate(void *data)
 		static_cast<struct transcription_filter_data *>(data);
 	obs_log(gf->log_level, "filter activated");
 	gf->active = true;
+	if (gf->idle_suspended) {
+		// the audio comes back, load the models before the first words
+		request_idle_resume(gf);
+	}
 }
 
 void transcription_filter_deactivate(void *data)
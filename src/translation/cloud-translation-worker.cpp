@@ -0,0 +1,437 @@
+#include "cloud-translation-worker.h"
+#include "translation-cache.h"
+#include "translation.h"
+#include "language_codes.h"
+#include "plugin-log.h"
+#include "transcription-filter-data.h"
+#include "transcription-filter-callbacks.h"
+
+#include <obs-module.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+// guards the pool and the cloud translation queues of all filters
+std::mutex pool_mutex;
+// wakes the workers on new jobs, and stop_cloud_translation when a request finished
+std::condition_variable pool_cv;
+std::vector<std::thread> workers;
+bool pool_stop = false;
+// filters with queued jobs, in the order the workers serve them
+std::vector<transcription_filter_data *> filters;
+size_t next_filter = 0;
+
+uint64_t elapsed_ns(std::chrono::steady_clock::time_point start)
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		       std::chrono::steady_clock::now() - start)
+		.count();
+}
+
+// whether the two jobs can be translated with the same request
+bool same_request(const cloud_translation_job &a, const cloud_translation_job &b)
+{
+	return !a.repeated && !b.repeated && a.config.provider == b.config.provider &&
+	       a.config.access_key == b.config.access_key && a.config.region == b.config.region &&
+	       a.config.free == b.config.free && a.target_language == b.target_language &&
+	       a.result->language == b.result->language;
+}
+
+// pool_mutex must be held. Takes the next jobs a worker can start: the first waiting job of the
+// next filter, with the waiting jobs after it when the provider translates batches. Returns
+// false if there is none.
+bool take_jobs(transcription_filter_data *&owner,
+	       std::vector<std::shared_ptr<cloud_translation_job>> &taken)
+{
+	taken.clear();
+	for (size_t i = 0; i < filters.size(); i++) {
+		transcription_filter_data *gf = filters[(next_filter + i) % filters.size()];
+		if (gf->cloud_translation_in_flight >= CLOUD_TRANSLATION_MAX_IN_FLIGHT) {
+			continue;
+		}
+		for (auto &job : gf->cloud_translation_jobs) {
+			if (job->started) {
+				continue;
+			}
+			if (!taken.empty() &&
+			    (taken.size() >= CLOUD_TRANSLATION_MAX_BATCH ||
+			     !cloud_provider_supports_batch(job->config.provider) ||
+			     !same_request(*taken.front(), *job))) {
+				break;
+			}
+			job->started = true;
+			taken.push_back(job);
+		}
+		if (!taken.empty()) {
+			gf->cloud_translation_in_flight++;
+			next_filter = (next_filter + i + 1) % filters.size();
+			owner = gf;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Output a streamed translation as a partial, if all the jobs before it were output
+void deliver_partial(transcription_filter_data *gf,
+		     const std::shared_ptr<cloud_translation_job> &job,
+		     const std::string &translation)
+{
+	std::unique_lock<std::mutex> lock(pool_mutex);
+	auto &jobs = gf->cloud_translation_jobs;
+	if (jobs.empty() || jobs.front() != job || gf->cloud_translation_delivering) {
+		return;
+	}
+	gf->cloud_translation_delivering = true;
+	const std::string output = gf->translate_cloud_output.empty() ? gf->text_source_name
+								       : gf->translate_cloud_output;
+	lock.unlock();
+	output_text(gf, *job->partial_result, job->possible_end_ts, translation, output,
+		    CLOUD_TRANSLATION);
+	lock.lock();
+	gf->cloud_translation_delivering = false;
+	pool_cv.notify_all();
+}
+
+std::string cache_provider(const cloud_translation_job &job)
+{
+	return "cloud:" + job.config.provider + ":" + job.config.model + ":" + job.config.endpoint;
+}
+
+// Translate with the local model when no cloud provider is available or a request failed, false
+// if no model is loaded. The sentences stay out of the context window of the local translation.
+// The translations are not cached under the cloud provider.
+bool translate_locally(transcription_filter_data *gf, const std::vector<std::string> &texts,
+		       const std::string &source_lang, const std::string &target_lang,
+		       std::vector<std::string> &translations)
+{
+	std::lock_guard<std::mutex> lock(gf->translation_ctx_mutex);
+	if (!gf->translation_ctx.translator) {
+		OBS_LOG(gf->log_level, "No cloud translation and no local model loaded");
+		return false;
+	}
+	OBS_LOG(gf->log_level, "No cloud translation, translating %d texts locally",
+		(int)texts.size());
+	std::vector<translation_request> requests;
+	for (const std::string &text : texts) {
+		requests.push_back(
+			{text, language_codes_from_whisper[source_lang], target_lang, true, false});
+	}
+	if (translate_batch(gf->translation_ctx, requests, translations) !=
+	    OBS_POLYGLOT_TRANSLATION_SUCCESS) {
+		translations.clear();
+		return false;
+	}
+	return true;
+}
+
+std::string translate_job(transcription_filter_data *gf,
+			  const std::shared_ptr<cloud_translation_job> &job)
+{
+	const std::string provider = cache_provider(*job);
+	std::string translation;
+	if (translation_cache_get(provider, job->result->language, job->target_language, job->text,
+				  translation)) {
+		return translation;
+	}
+	const CloudTranslationRoute route = cloud_translation_route(job->config);
+	if (route == CLOUD_ROUTE_NONE) {
+		std::vector<std::string> translations;
+		translate_locally(gf, {job->text}, job->result->language, job->target_language,
+				  translations);
+		return translations.empty() ? "" : translations[0];
+	}
+	const CloudTranslatorConfig &config =
+		route == CLOUD_ROUTE_SECONDARY ? *job->config.hedge : job->config;
+	std::function<void(const std::string &)> on_partial;
+	if (job->stream) {
+		auto last_output = std::chrono::steady_clock::time_point();
+		on_partial = [gf, job, last_output](const std::string &partial) mutable {
+			const auto now = std::chrono::steady_clock::now();
+			if (now - last_output <
+			    std::chrono::milliseconds(CLOUD_TRANSLATION_STREAM_INTERVAL_MS)) {
+				return;
+			}
+			last_output = now;
+			deliver_partial(gf, job, partial);
+		};
+	}
+	if (gf->segment_trace.enabled()) {
+		gf->segment_trace.set_thread_name("cloud translation");
+	}
+	SegmentTraceScope trace(gf->segment_trace, job->result->trace_id, "cloud_translation");
+	const auto request_start = std::chrono::steady_clock::now();
+	try {
+		translation = translate_cloud(config, job->text, job->target_language,
+					      job->result->language, on_partial);
+	} catch (const std::exception &e) {
+		obs_log(LOG_ERROR, "Error translating text with cloud: %s", e.what());
+	} catch (...) {
+		obs_log(LOG_ERROR, "Error translating text with cloud");
+	}
+	gf->metrics.add_cloud_request(elapsed_ns(request_start), translation.empty());
+	if (translation.empty()) {
+		std::vector<std::string> translations;
+		translate_locally(gf, {job->text}, job->result->language, job->target_language,
+				  translations);
+		return translations.empty() ? "" : translations[0];
+	}
+	translation_cache_put(provider, job->result->language, job->target_language, job->text,
+			      translation);
+	return translation;
+}
+
+// Translate the jobs taken together, with one request for the ones that are not cached
+void translate_jobs(transcription_filter_data *gf,
+		    const std::vector<std::shared_ptr<cloud_translation_job>> &jobs)
+{
+	const cloud_translation_job &first = *jobs.front();
+	OBS_LOG(gf->log_level, "Translating %d texts with cloud provider %s. %s -> %s",
+		(int)jobs.size(), first.config.provider.c_str(), first.result->language.c_str(),
+		first.target_language.c_str());
+	if (jobs.size() == 1) {
+		jobs.front()->translation = translate_job(gf, jobs.front());
+		return;
+	}
+
+	const std::string provider = cache_provider(first);
+	std::vector<std::string> texts;
+	std::vector<size_t> slots;
+	for (size_t i = 0; i < jobs.size(); i++) {
+		if (!translation_cache_get(provider, first.result->language, first.target_language,
+					   jobs[i]->text, jobs[i]->translation)) {
+			texts.push_back(jobs[i]->text);
+			slots.push_back(i);
+		}
+	}
+	if (texts.empty()) {
+		return;
+	}
+	std::vector<std::string> translations;
+	const CloudTranslationRoute route = cloud_translation_route(first.config);
+	if (route == CLOUD_ROUTE_NONE) {
+		translate_locally(gf, texts, first.result->language, first.target_language,
+				  translations);
+		for (size_t i = 0; i < translations.size() && i < slots.size(); i++) {
+			jobs[slots[i]]->translation = translations[i];
+		}
+		return;
+	}
+	if (gf->segment_trace.enabled()) {
+		gf->segment_trace.set_thread_name("cloud translation");
+	}
+	const uint64_t request_start_us = SegmentTrace::now_us();
+	const auto request_start = std::chrono::steady_clock::now();
+	try {
+		translations = translate_cloud_batch(route == CLOUD_ROUTE_SECONDARY
+							     ? *first.config.hedge
+							     : first.config,
+						     texts, first.target_language,
+						     first.result->language);
+	} catch (const std::exception &e) {
+		obs_log(LOG_ERROR, "Error translating text with cloud: %s", e.what());
+	} catch (...) {
+		obs_log(LOG_ERROR, "Error translating text with cloud");
+	}
+	gf->metrics.add_cloud_request(elapsed_ns(request_start), translations.empty());
+	const uint64_t request_end_us = SegmentTrace::now_us();
+	for (const size_t slot : slots) {
+		gf->segment_trace.span(jobs[slot]->result->trace_id, "cloud_translation",
+				       request_start_us, request_end_us);
+	}
+	// the texts of a failed request, or left empty by the provider, are translated locally
+	std::vector<std::string> failed_texts;
+	std::vector<size_t> failed_slots;
+	for (size_t i = 0; i < slots.size(); i++) {
+		if (i >= translations.size() || translations[i].empty()) {
+			failed_texts.push_back(texts[i]);
+			failed_slots.push_back(slots[i]);
+			continue;
+		}
+		jobs[slots[i]]->translation = translations[i];
+		translation_cache_put(provider, first.result->language, first.target_language,
+				      texts[i], translations[i]);
+	}
+	if (failed_texts.empty()) {
+		return;
+	}
+	std::vector<std::string> local_translations;
+	translate_locally(gf, failed_texts, first.result->language, first.target_language,
+			  local_translations);
+	for (size_t i = 0; i < local_translations.size() && i < failed_slots.size(); i++) {
+		jobs[failed_slots[i]]->translation = local_translations[i];
+	}
+}
+
+// Output the finished jobs at the head of the queue of the filter, by one thread at a time so
+// the order is kept. The lock is released while outputting.
+void deliver_jobs(transcription_filter_data *gf, std::unique_lock<std::mutex> &lock)
+{
+	if (gf->cloud_translation_delivering) {
+		return;
+	}
+	gf->cloud_translation_delivering = true;
+	auto &jobs = gf->cloud_translation_jobs;
+	while (!jobs.empty() && jobs.front()->done) {
+		std::shared_ptr<cloud_translation_job> job = jobs.front();
+		jobs.pop_front();
+		// a repeated sentence takes the translation of the sentence delivered before it
+		if (job->repeated && job->text == gf->last_text_for_cloud_translation) {
+			job->translation = gf->last_text_cloud_translation;
+		}
+		gf->last_text_for_cloud_translation = job->text;
+		gf->last_text_cloud_translation = job->translation;
+		if (job->result->result == DETECTION_RESULT_PARTIAL && !jobs.empty() &&
+		    jobs.front()->done) {
+			// superseded by the next sentence
+			continue;
+		}
+		const std::string output = gf->translate_cloud_output.empty()
+						   ? gf->text_source_name
+						   : gf->translate_cloud_output;
+		lock.unlock();
+		if (job->translation.empty()) {
+			OBS_LOG(gf->log_level, "Failed to translate text");
+		} else {
+			if (gf->log_words) {
+				obs_log(LOG_INFO, "Cloud Translation: '%s' -> '%s'",
+					job->text.c_str(), job->translation.c_str());
+			}
+			output_text(gf, *job->result, job->possible_end_ts, job->translation,
+				    output, CLOUD_TRANSLATION);
+		}
+		lock.lock();
+	}
+	gf->cloud_translation_delivering = false;
+	// stop_cloud_translation waits for the delivery too
+	pool_cv.notify_all();
+}
+
+void worker_loop()
+{
+	std::unique_lock<std::mutex> lock(pool_mutex);
+	while (true) {
+		transcription_filter_data *gf = nullptr;
+		std::vector<std::shared_ptr<cloud_translation_job>> jobs;
+		pool_cv.wait(lock, [&] { return pool_stop || take_jobs(gf, jobs); });
+		if (pool_stop) {
+			if (!jobs.empty()) {
+				gf->cloud_translation_in_flight--;
+			}
+			break;
+		}
+
+		if (!jobs.front()->repeated) {
+			lock.unlock();
+			translate_jobs(gf, jobs);
+			lock.lock();
+		}
+		for (auto &job : jobs) {
+			job->done = true;
+		}
+		gf->cloud_translation_in_flight--;
+		// the filter is still registered: stop_cloud_translation waits for the running jobs
+		deliver_jobs(gf, lock);
+		pool_cv.notify_all();
+	}
+}
+
+} // namespace
+
+void queue_sentence_for_cloud_translation(struct transcription_filter_data *gf,
+					  const SharedDetectionResult &result,
+					  uint64_t possible_end_ts, const std::string &text)
+{
+	if (text.empty()) {
+		return;
+	}
+	auto job = std::make_shared<cloud_translation_job>();
+	job->result = result;
+	job->possible_end_ts = possible_end_ts;
+	job->text = text;
+	job->config = gf->translate_cloud_config;
+	job->target_language = gf->translate_cloud_target_language;
+	job->stream = gf->translate_cloud_stream;
+	if (job->stream) {
+		// the outputs of a streamed translation only need the times of the sentence
+		auto partial_result = std::make_shared<DetectionResultWithText>();
+		partial_result->result = DETECTION_RESULT_PARTIAL;
+		partial_result->start_timestamp_ms = result->start_timestamp_ms;
+		partial_result->end_timestamp_ms = result->end_timestamp_ms;
+		partial_result->language = result->language;
+		partial_result->trace_id = result->trace_id;
+		job->partial_result = std::move(partial_result);
+	}
+	{
+		std::lock_guard<std::mutex> lock(pool_mutex);
+		if (workers.empty()) {
+			pool_stop = false;
+			for (int i = 0; i < CLOUD_TRANSLATION_WORKERS; i++) {
+				workers.emplace_back(worker_loop);
+			}
+			obs_log(LOG_INFO, "Started %d cloud translation workers",
+				CLOUD_TRANSLATION_WORKERS);
+		}
+		auto &jobs = gf->cloud_translation_jobs;
+		// waiting partials are superseded by the new sentence. A waiting sentence after a
+		// dropped one is translated, the sentence it repeated is not delivered anymore.
+		bool dropped = false;
+		for (auto it = jobs.begin(); it != jobs.end();) {
+			if (!(*it)->started && (*it)->result->result == DETECTION_RESULT_PARTIAL) {
+				it = jobs.erase(it);
+				dropped = true;
+				continue;
+			}
+			if (dropped && !(*it)->started) {
+				(*it)->repeated = false;
+			}
+			dropped = false;
+			++it;
+		}
+		// the same sentence twice in a row is not translated again, the previous one is
+		// delivered first
+		const std::string &previous_text = jobs.empty() ? gf->last_text_for_cloud_translation
+								: jobs.back()->text;
+		job->repeated = text == previous_text;
+		jobs.push_back(std::move(job));
+		if (std::find(filters.begin(), filters.end(), gf) == filters.end()) {
+			filters.push_back(gf);
+		}
+	}
+	pool_cv.notify_all();
+}
+
+void stop_cloud_translation(struct transcription_filter_data *gf)
+{
+	std::unique_lock<std::mutex> lock(pool_mutex);
+	// the running requests keep their job, their translation is not delivered
+	gf->cloud_translation_jobs.clear();
+	pool_cv.wait(lock, [gf] {
+		return gf->cloud_translation_in_flight == 0 && !gf->cloud_translation_delivering;
+	});
+	filters.erase(std::remove(filters.begin(), filters.end(), gf), filters.end());
+	next_filter = 0;
+}
+
+void shutdown_cloud_translation_workers(void)
+{
+	std::vector<std::thread> stopping;
+	{
+		std::lock_guard<std::mutex> lock(pool_mutex);
+		pool_stop = true;
+		stopping.swap(workers);
+	}
+	pool_cv.notify_all();
+	for (auto &worker : stopping) {
+		worker.join();
+	}
+	shutdown_cloud_hedges();
+}
@@ -0,0 +1,83 @@
+/**
+ * @file cloud-translation-worker.h
+ * @brief Cloud translation on a small pool of worker threads shared by all filters.
+ *
+ * Each filter has its own queue of sentences. The workers take the sentences of the filters in
+ * turn, at most CLOUD_TRANSLATION_MAX_IN_FLIGHT requests of a filter at the same time, and the
+ * sentences waiting when a worker takes one go with it in the same request when the provider
+ * translates batches (DeepL, Google, Azure). The translations are output in the order the
+ * sentences were queued, whichever request finishes first. A partial that is still waiting
+ * when a newer sentence is queued is dropped, and a partial whose successor already finished
+ * is not output, since it would be replaced right away. With streaming enabled, the
+ * translation of the sentence at the head of the queue is output as a partial while the
+ * provider generates it (Claude and OpenAI), at most every CLOUD_TRANSLATION_STREAM_INTERVAL_MS.
+ * The single sentence requests that are not streamed are hedged when a secondary provider is set,
+ * see translate_cloud. While the circuit breakers of the providers are open, and for each request
+ * that fails, the sentences are translated with the local model if one is loaded.
+ */
+#ifndef CLOUD_TRANSLATION_WORKER_H
+#define CLOUD_TRANSLATION_WORKER_H
+
+#include "whisper-utils/whisper-processing.h"
+#include "translation/cloud-translation/translation-cloud.h"
+
+#include <cstdint>
+#include <string>
+
+// worker threads of the pool
+#define CLOUD_TRANSLATION_WORKERS 4
+// requests of one filter running at the same time
+#define CLOUD_TRANSLATION_MAX_IN_FLIGHT 2
+// sentences translated with one request, for the providers that accept arrays of texts
+#define CLOUD_TRANSLATION_MAX_BATCH 8
+// minimal time between two outputs of a streamed translation
+#define CLOUD_TRANSLATION_STREAM_INTERVAL_MS 150
+
+struct transcription_filter_data;
+
+// A transcribed sentence waiting for its cloud translation
+struct cloud_translation_job {
+	// shared with the outputs and the local translation, not copied
+	SharedDetectionResult result;
+	// the result as a partial, without the tokens, for the outputs of a streamed translation
+	SharedDetectionResult partial_result;
+	uint64_t possible_end_ts;
+	// the sentence after the word filters
+	std::string text;
+	// settings when the sentence was queued, the filter can be updated in the meantime
+	CloudTranslatorConfig config;
+	std::string target_language;
+	bool stream = false;
+	// same sentence as the previous one, its translation is reused
+	bool repeated = false;
+	bool started = false;
+	bool done = false;
+	std::string translation;
+};
+
+/**
+ * @brief Queue a sentence for cloud translation.
+ *
+ * The translation is output with output_text as CLOUD_TRANSLATION. Starts the worker pool on
+ * first use.
+ */
+void queue_sentence_for_cloud_translation(struct transcription_filter_data *gf,
+					  const SharedDetectionResult &result,
+					  uint64_t possible_end_ts, const std::string &text);
+
+/**
+ * @brief Drop the queued sentences of the filter and wait for its running requests.
+ *
+ * Called on filter destroy, no translation of the filter is output afterwards.
+ */
+void stop_cloud_translation(struct transcription_filter_data *gf);
+
+extern "C" {
+
+/**
+ * @brief Stop the worker pool, called on module unload.
+ */
+void shutdown_cloud_translation_workers(void);
+}
+
+#endif // CLOUD_TRANSLATION_WORKER_H
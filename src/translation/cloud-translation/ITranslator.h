@@ -1,7 +1,9 @@
 #pragma once
+#include <functional>
 #include <string>
 #include <memory>
 #include <stdexcept>
+#include <vector>
 
 // Custom exception
 class TranslationError : public std::runtime_error {
@@ -9,6 +11,9 @@ public:
 	explicit TranslationError(const std::string &message) : std::runtime_error(message) {}
 };
 
+// Called with the translation received so far while a response streams in
+using TranslationStreamCallback = std::function<void(const std::string &partial_translation)>;
+
 // Abstract translator interface
 class ITranslator {
 public:
@@ -16,6 +21,29 @@ public:
 
 	virtual std::string translate(const std::string &text, const std::string &target_lang,
 				      const std::string &source_lang = "auto") = 0;
+
+	// Translate with a streaming response where the provider supports it, calling on_partial
+	// as the translation is generated. Returns the full translation, like translate.
+	virtual std::string translateStream(const std::string &text, const std::string &target_lang,
+					    const std::string &source_lang,
+					    const TranslationStreamCallback &on_partial)
+	{
+		(void)on_partial;
+		return translate(text, target_lang, source_lang);
+	}
+
+	// Translate several texts with one request where the provider accepts arrays of texts.
+	// Returns one translation per text, in order.
+	virtual std::vector<std::string> translateBatch(const std::vector<std::string> &texts,
+							const std::string &target_lang,
+							const std::string &source_lang)
+	{
+		std::vector<std::string> translations;
+		for (const std::string &text : texts) {
+			translations.push_back(translate(text, target_lang, source_lang));
+		}
+		return translations;
+	}
 };
 
 // Factory function declaration
@@ -80,8 +80,7 @@ std::string AWSTranslator::getSignedHeaders(const std::map<std::string, std::str
 std::string AWSTranslator::translate(const std::string &text, const std::string &target_lang,
 				     const std::string &source_lang)
 {
-	std::unique_ptr<CURL, decltype(&curl_easy_cleanup)> curl(curl_easy_init(),
-								 curl_easy_cleanup);
+	CurlHandle curl = curl_helper_->acquireHandle();
 
 	if (!curl) {
 		throw TranslationError("Failed to initialize CURL session");
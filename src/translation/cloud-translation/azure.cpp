@@ -19,8 +19,14 @@ AzureTranslator::~AzureTranslator() = default;
 std::string AzureTranslator::translate(const std::string &text, const std::string &target_lang,
 				       const std::string &source_lang)
 {
-	std::unique_ptr<CURL, decltype(&curl_easy_cleanup)> curl(curl_easy_init(),
-								 curl_easy_cleanup);
+	return translateBatch({text}, target_lang, source_lang)[0];
+}
+
+std::vector<std::string> AzureTranslator::translateBatch(const std::vector<std::string> &texts,
+							 const std::string &target_lang,
+							 const std::string &source_lang)
+{
+	CurlHandle curl = curl_helper_->acquireHandle();
 
 	if (!curl) {
 		throw TranslationError("Failed to initialize CURL session");
@@ -38,8 +44,11 @@ std::string AzureTranslator::translate(const std::string &text, const std::strin
 			route << "&from=" << sanitize_language_code(source_lang);
 		}
 
-		// Create the request body
-		json body = json::array({{{"Text", text}}});
+		// Create the request body, one element per text
+		json body = json::array();
+		for (const std::string &text : texts) {
+			body.push_back({{"Text", text}});
+		}
 		std::string requestBody = body.dump();
 
 		// Construct full URL
@@ -83,14 +92,15 @@ std::string AzureTranslator::translate(const std::string &text, const std::strin
 					       curl_easy_strerror(res));
 		}
 
-		return parseResponse(response);
+		return parseResponse(response, texts.size());
 
 	} catch (const json::exception &e) {
 		throw TranslationError(std::string("JSON parsing error: ") + e.what());
 	}
 }
 
-std::string AzureTranslator::parseResponse(const std::string &response_str)
+std::vector<std::string> AzureTranslator::parseResponse(const std::string &response_str,
+							size_t count)
 {
 	try {
 		json response = json::parse(response_str);
@@ -102,10 +112,18 @@ std::string AzureTranslator::parseResponse(const std::string &response_str)
 					       error.value("message", "Unknown error"));
 		}
 
-		// Azure returns an array of translations
+		// Azure returns an array of translations, one per text
 		// Each translation can have multiple target languages
-		// We'll take the first translation's first target
-		return response[0]["translations"][0]["text"].get<std::string>();
+		// We'll take the first target of each
+		if (!response.is_array() || response.size() != count) {
+			throw TranslationError(
+				"Azure API Error: Unexpected number of translations");
+		}
+		std::vector<std::string> result;
+		for (const auto &translation : response) {
+			result.push_back(translation["translations"][0]["text"].get<std::string>());
+		}
+		return result;
 
 	} catch (const json::exception &e) {
 		throw TranslationError(std::string("Failed to parse Azure response: ") + e.what());
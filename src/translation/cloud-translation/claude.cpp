@@ -30,6 +30,21 @@ std::string ClaudeTranslator::createSystemPrompt(const std::string &target_lang)
 
 std::string ClaudeTranslator::translate(const std::string &text, const std::string &target_lang,
 					const std::string &source_lang)
+{
+	return request(text, target_lang, source_lang, nullptr);
+}
+
+std::string ClaudeTranslator::translateStream(const std::string &text,
+					      const std::string &target_lang,
+					      const std::string &source_lang,
+					      const TranslationStreamCallback &on_partial)
+{
+	return request(text, target_lang, source_lang, &on_partial);
+}
+
+std::string ClaudeTranslator::request(const std::string &text, const std::string &target_lang,
+				      const std::string &source_lang,
+				      const TranslationStreamCallback *on_partial)
 {
 	if (!isLanguageSupported(target_lang)) {
 		throw TranslationError("Unsupported target language: " + target_lang);
@@ -39,8 +54,7 @@ std::string ClaudeTranslator::translate(const std::string &text, const std::stri
 		throw TranslationError("Unsupported source language: " + source_lang);
 	}
 
-	std::unique_ptr<CURL, decltype(&curl_easy_cleanup)> curl(curl_easy_init(),
-								 curl_easy_cleanup);
+	CurlHandle curl = curl_helper_->acquireHandle();
 
 	if (!curl) {
 		throw TranslationError("Failed to initialize CURL session");
@@ -65,6 +79,25 @@ std::string ClaudeTranslator::translate(const std::string &text, const std::stri
 						 getLanguageName(source_lang) + ".";
 		}
 
+		// each text delta of the streamed message extends the translation
+		std::string translation;
+		SseStream stream;
+		if (on_partial != nullptr) {
+			request_body["stream"] = true;
+			stream.on_data = [&translation, on_partial](const std::string &data) {
+				json event = json::parse(data, nullptr, false);
+				if (event.is_discarded() ||
+				    event.value("type", "") != "content_block_delta") {
+					return;
+				}
+				const json &delta = event["delta"];
+				if (delta.contains("text") && delta["text"].is_string()) {
+					translation += delta["text"].get<std::string>();
+					(*on_partial)(translation);
+				}
+			};
+		}
+
 		std::string payload = request_body.dump();
 
 		// Set up headers
@@ -78,8 +111,15 @@ std::string ClaudeTranslator::translate(const std::string &text, const std::stri
 		curl_easy_setopt(curl.get(), CURLOPT_POST, 1L);
 		curl_easy_setopt(curl.get(), CURLOPT_POSTFIELDS, payload.c_str());
 		curl_easy_setopt(curl.get(), CURLOPT_HTTPHEADER, headers);
-		curl_easy_setopt(curl.get(), CURLOPT_WRITEFUNCTION, CurlHelper::WriteCallback);
-		curl_easy_setopt(curl.get(), CURLOPT_WRITEDATA, &response);
+		if (on_partial != nullptr) {
+			curl_easy_setopt(curl.get(), CURLOPT_WRITEFUNCTION,
+					 CurlHelper::SseWriteCallback);
+			curl_easy_setopt(curl.get(), CURLOPT_WRITEDATA, &stream);
+		} else {
+			curl_easy_setopt(curl.get(), CURLOPT_WRITEFUNCTION,
+					 CurlHelper::WriteCallback);
+			curl_easy_setopt(curl.get(), CURLOPT_WRITEDATA, &response);
+		}
 		curl_easy_setopt(curl.get(), CURLOPT_SSL_VERIFYPEER, 1L);
 		curl_easy_setopt(curl.get(), CURLOPT_SSL_VERIFYHOST, 2L);
 		curl_easy_setopt(curl.get(), CURLOPT_TIMEOUT, 30L);
@@ -99,11 +139,20 @@ std::string ClaudeTranslator::translate(const std::string &text, const std::stri
 		long response_code;
 		curl_easy_getinfo(curl.get(), CURLINFO_RESPONSE_CODE, &response_code);
 
+		if (on_partial != nullptr) {
+			response = stream.body;
+		}
 		if (response_code != 200) {
 			throw TranslationError("HTTP error: " + std::to_string(response_code) +
 					       "\nResponse: " + response);
 		}
 
+		if (on_partial != nullptr) {
+			if (translation.empty()) {
+				throw TranslationError("Empty streamed response: " + response);
+			}
+			return translation;
+		}
 		return parseResponse(response);
 
 	} catch (const json::exception &e) {
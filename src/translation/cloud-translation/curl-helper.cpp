@@ -5,6 +5,34 @@
 bool CurlHelper::is_initialized_ = false;
 std::mutex CurlHelper::curl_mutex_;
 
+namespace {
+
+thread_local const std::atomic<bool> *cancel_flag = nullptr;
+
+int cancel_callback(void *clientp, curl_off_t, curl_off_t, curl_off_t, curl_off_t)
+{
+	// a non-zero value aborts the transfer with CURLE_ABORTED_BY_CALLBACK
+	const auto *cancel = static_cast<const std::atomic<bool> *>(clientp);
+	return cancel->load(std::memory_order_relaxed) ? 1 : 0;
+}
+
+} // namespace
+
+CurlCancelScope::CurlCancelScope(const std::atomic<bool> *cancel) : previous_(cancel_flag)
+{
+	cancel_flag = cancel;
+}
+
+CurlCancelScope::~CurlCancelScope()
+{
+	cancel_flag = previous_;
+}
+
+const std::atomic<bool> *CurlCancelScope::current()
+{
+	return cancel_flag;
+}
+
 CurlHelper::CurlHelper()
 {
 	std::lock_guard<std::mutex> lock(curl_mutex_);
@@ -20,6 +48,55 @@ CurlHelper::~CurlHelper()
 {
 	// Don't call curl_global_cleanup() in destructor
 	// Let it clean up when the program exits
+	std::lock_guard<std::mutex> lock(pool_mutex_);
+	for (CURL *curl : idle_handles_) {
+		curl_easy_cleanup(curl);
+	}
+	idle_handles_.clear();
+}
+
+CurlHandle::~CurlHandle()
+{
+	if (curl_ != nullptr) {
+		helper_->releaseHandle(curl_);
+	}
+}
+
+CurlHandle CurlHelper::acquireHandle()
+{
+	CURL *curl = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(pool_mutex_);
+		if (!idle_handles_.empty()) {
+			curl = idle_handles_.back();
+			idle_handles_.pop_back();
+		}
+	}
+	if (curl == nullptr) {
+		curl = curl_easy_init();
+		if (curl == nullptr) {
+			return CurlHandle(this, nullptr);
+		}
+	}
+	curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+	curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, (long)CURL_HTTP_VERSION_2TLS);
+	// requests run on worker threads, signals can't be used for the timeouts
+	curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+	if (cancel_flag != nullptr) {
+		// the progress callback is called about once a second and on every received chunk
+		curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, cancel_callback);
+		curl_easy_setopt(curl, CURLOPT_XFERINFODATA, (void *)cancel_flag);
+		curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+	}
+	return CurlHandle(this, curl);
+}
+
+void CurlHelper::releaseHandle(CURL *curl)
+{
+	// the options point to the buffers of the finished request, the connection is kept
+	curl_easy_reset(curl);
+	std::lock_guard<std::mutex> lock(pool_mutex_);
+	idle_handles_.push_back(curl);
 }
 
 size_t CurlHelper::WriteCallback(void *contents, size_t size, size_t nmemb, void *userp)
@@ -38,6 +115,43 @@ size_t CurlHelper::WriteCallback(void *contents, size_t size, size_t nmemb, void
 	}
 }
 
+size_t CurlHelper::SseWriteCallback(void *contents, size_t size, size_t nmemb, void *userp)
+{
+	if (!userp) {
+		return 0;
+	}
+
+	size_t realsize = size * nmemb;
+	auto *stream = static_cast<SseStream *>(userp);
+	try {
+		const char *data = static_cast<char *>(contents);
+		stream->body.append(data, realsize);
+		for (size_t i = 0; i < realsize; i++) {
+			if (data[i] != '\n') {
+				stream->line += data[i];
+				continue;
+			}
+			if (!stream->line.empty() && stream->line.back() == '\r') {
+				stream->line.pop_back();
+			}
+			// only the data fields are used, events and comments are skipped
+			if (stream->line.rfind("data:", 0) == 0) {
+				size_t start = 5;
+				if (stream->line.size() > start && stream->line[start] == ' ') {
+					start++;
+				}
+				if (stream->on_data) {
+					stream->on_data(stream->line.substr(start));
+				}
+			}
+			stream->line.clear();
+		}
+		return realsize;
+	} catch (const std::exception &) {
+		return 0; // Return 0 to indicate error to libcurl
+	}
+}
+
 std::string CurlHelper::urlEncode(CURL *curl, const std::string &value)
 {
 	if (!curl) {
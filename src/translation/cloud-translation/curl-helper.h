@@ -1,18 +1,72 @@
 #pragma once
+#include <atomic>
+#include <functional>
 #include <string>
 #include <mutex>
+#include <vector>
 
 #include <curl/curl.h>
 #include "ITranslator.h"
 
+class CurlHelper;
+
+// A server-sent events response, see CurlHelper::SseWriteCallback
+struct SseStream {
+	// called with the value of each data field
+	std::function<void(const std::string &data)> on_data;
+	// the line being received
+	std::string line;
+	// the whole response, for the error messages of non-streamed (error) responses
+	std::string body;
+};
+
+// While in scope, the requests of this thread abort as soon as the flag is set, e.g. the losing
+// request of a hedged translation
+class CurlCancelScope {
+public:
+	explicit CurlCancelScope(const std::atomic<bool> *cancel);
+	~CurlCancelScope();
+	CurlCancelScope(const CurlCancelScope &) = delete;
+	CurlCancelScope &operator=(const CurlCancelScope &) = delete;
+
+	static const std::atomic<bool> *current();
+
+private:
+	const std::atomic<bool> *previous_;
+};
+
+// An easy handle leased from a CurlHelper, given back to its pool when the lease ends
+class CurlHandle {
+public:
+	CurlHandle(CurlHelper *helper, CURL *curl) : helper_(helper), curl_(curl) {}
+	~CurlHandle();
+	CurlHandle(const CurlHandle &) = delete;
+	CurlHandle &operator=(const CurlHandle &) = delete;
+
+	CURL *get() const { return curl_; }
+	explicit operator bool() const { return curl_ != nullptr; }
+
+private:
+	CurlHelper *helper_;
+	CURL *curl_;
+};
+
 class CurlHelper {
 public:
 	CurlHelper();
 	~CurlHelper();
 
+	// Get an easy handle of the pool, nullptr on failure. Handles keep their connections,
+	// DNS and TLS session caches between requests, so requests of a long-lived translator
+	// reuse the connection (HTTP keep-alive, HTTP/2 where the server supports it).
+	CurlHandle acquireHandle();
+
 	// Callback for writing response data
 	static size_t WriteCallback(void *contents, size_t size, size_t nmemb, void *userp);
 
+	// Callback for writing a text/event-stream response, userp is an SseStream
+	static size_t SseWriteCallback(void *contents, size_t size, size_t nmemb, void *userp);
+
 	// URL encode a string
 	static std::string urlEncode(CURL *curl, const std::string &value);
 
@@ -24,6 +78,12 @@ public:
 	static void setSSLVerification(CURL *curl, bool verify = true);
 
 private:
+	friend class CurlHandle;
+	void releaseHandle(CURL *curl);
+
 	static bool is_initialized_;
 	static std::mutex curl_mutex_; // For thread-safe global initialization
+
+	std::mutex pool_mutex_;
+	std::vector<CURL *> idle_handles_;
 };
@@ -41,8 +41,7 @@ std::string CustomApiTranslator::translate(const std::string &text, const std::s
 	std::string body = replacePlaceholders(body_template_, values);
 	std::string response;
 
-	std::unique_ptr<CURL, decltype(&curl_easy_cleanup)> curl(curl_easy_init(),
-								 curl_easy_cleanup);
+	CurlHandle curl = curl_helper_->acquireHandle();
 
 	if (!curl) {
 		throw std::runtime_error("Failed to initialize CURL session");
@@ -17,8 +17,14 @@ DeepLTranslator::~DeepLTranslator() = default;
 std::string DeepLTranslator::translate(const std::string &text, const std::string &target_lang,
 				       const std::string &source_lang)
 {
-	std::unique_ptr<CURL, decltype(&curl_easy_cleanup)> curl(curl_easy_init(),
-								 curl_easy_cleanup);
+	return translateBatch({text}, target_lang, source_lang)[0];
+}
+
+std::vector<std::string> DeepLTranslator::translateBatch(const std::vector<std::string> &texts,
+							 const std::string &target_lang,
+							 const std::string &source_lang)
+{
+	CurlHandle curl = curl_helper_->acquireHandle();
 
 	if (!curl) {
 		throw TranslationError("DeepL Failed to initialize CURL session");
@@ -36,7 +42,7 @@ std::string DeepLTranslator::translate(const std::string &text, const std::strin
 		for (char &c : upperSource)
 			c = (char)std::toupper((int)c);
 
-		json body = {{"text", {text}},
+		json body = {{"text", texts},
 			     {"target_lang", upperTarget},
 			     {"source_lang", upperSource}};
 		const std::string body_str = body.dump();
@@ -74,7 +80,9 @@ std::string DeepLTranslator::translate(const std::string &text, const std::strin
 					       curl_easy_strerror(res));
 		}
 
-		return parseResponse(response);
+		long response_code = 0;
+		curl_easy_getinfo(curl.get(), CURLINFO_RESPONSE_CODE, &response_code);
+		return parseResponse(response, response_code, texts.size());
 
 	} catch (const json::exception &e) {
 		throw TranslationError(std::string("DeepL JSON parsing error: ") + e.what() +
@@ -82,11 +90,10 @@ std::string DeepLTranslator::translate(const std::string &text, const std::strin
 	}
 }
 
-std::string DeepLTranslator::parseResponse(const std::string &response_str)
+std::vector<std::string> DeepLTranslator::parseResponse(const std::string &response_str,
+							long response_code, size_t count)
 {
 	// Handle rate limiting errors
-	long response_code;
-	curl_easy_getinfo(curl_easy_init(), CURLINFO_RESPONSE_CODE, &response_code);
 	if (response_code == 429) {
 		throw TranslationError("DeepL API Error: Rate limit exceeded");
 	}
@@ -113,15 +120,22 @@ std::string DeepLTranslator::parseResponse(const std::string &response_str)
 	}
 
 	try {
-		// DeepL returns translations array with detected language
-		const auto &translation = response["translations"][0];
+		// DeepL returns translations array with detected language, one per text
+		const auto &translations = response.at("translations");
+		if (translations.size() != count) {
+			throw TranslationError("DeepL: Unexpected number of translations");
+		}
 
 		// Optionally, you can access the detected source language
 		// if (translation.contains("detected_source_language")) {
 		//     std::string detected = translation["detected_source_language"];
 		// }
 
-		return translation["text"].get<std::string>();
+		std::vector<std::string> result;
+		for (const auto &translation : translations) {
+			result.push_back(translation.at("text").get<std::string>());
+		}
+		return result;
 	} catch (const json::exception &) {
 		throw TranslationError("DeepL: Unexpected response format from DeepL API");
 	}
@@ -1,6 +1,7 @@
 #pragma once
 #include "ITranslator.h"
 #include <memory>
+#include <vector>
 
 class CurlHelper; // Forward declaration
 
@@ -12,8 +13,13 @@ public:
 	std::string translate(const std::string &text, const std::string &target_lang,
 			      const std::string &source_lang = "auto") override;
 
+	std::vector<std::string> translateBatch(const std::vector<std::string> &texts,
+						const std::string &target_lang,
+						const std::string &source_lang) override;
+
 private:
-	std::string parseResponse(const std::string &response_str);
+	std::vector<std::string> parseResponse(const std::string &response_str,
+					       long response_code, size_t count);
 
 	std::string api_key_;
 	bool free_;
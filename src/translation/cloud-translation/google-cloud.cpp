@@ -16,8 +16,14 @@ GoogleTranslator::~GoogleTranslator() = default;
 std::string GoogleTranslator::translate(const std::string &text, const std::string &target_lang,
 					const std::string &source_lang)
 {
-	std::unique_ptr<CURL, decltype(&curl_easy_cleanup)> curl(curl_easy_init(),
-								 curl_easy_cleanup);
+	return translateBatch({text}, target_lang, source_lang)[0];
+}
+
+std::vector<std::string> GoogleTranslator::translateBatch(const std::vector<std::string> &texts,
+							  const std::string &target_lang,
+							  const std::string &source_lang)
+{
+	CurlHandle curl = curl_helper_->acquireHandle();
 
 	if (!curl) {
 		throw TranslationError("Failed to initialize CURL session");
@@ -26,11 +32,14 @@ std::string GoogleTranslator::translate(const std::string &text, const std::stri
 	std::string response;
 
 	try {
-		// Construct URL with parameters
+		// Construct URL with parameters, one q per text
 		std::stringstream url;
 		url << "https://translation.googleapis.com/language/translate/v2"
-		    << "?key=" << api_key_ << "&q=" << CurlHelper::urlEncode(curl.get(), text)
-		    << "&target=" << sanitize_language_code(target_lang);
+		    << "?key=" << api_key_;
+		for (const std::string &text : texts) {
+			url << "&q=" << CurlHelper::urlEncode(curl.get(), text);
+		}
+		url << "&target=" << sanitize_language_code(target_lang);
 
 		if (source_lang != "auto") {
 			url << "&source=" << sanitize_language_code(source_lang);
@@ -51,14 +60,15 @@ std::string GoogleTranslator::translate(const std::string &text, const std::stri
 					       curl_easy_strerror(res));
 		}
 
-		return parseResponse(response);
+		return parseResponse(response, texts.size());
 
 	} catch (const json::exception &e) {
 		throw TranslationError(std::string("JSON parsing error: ") + e.what());
 	}
 }
 
-std::string GoogleTranslator::parseResponse(const std::string &response_str)
+std::vector<std::string> GoogleTranslator::parseResponse(const std::string &response_str,
+							 size_t count)
 {
 	json response = json::parse(response_str);
 
@@ -75,5 +85,13 @@ std::string GoogleTranslator::parseResponse(const std::string &response_str)
 		throw TranslationError(error_msg.str());
 	}
 
-	return response["data"]["translations"][0]["translatedText"].get<std::string>();
+	const auto &translations = response["data"]["translations"];
+	if (translations.size() != count) {
+		throw TranslationError("Google API Error: Unexpected number of translations");
+	}
+	std::vector<std::string> result;
+	for (const auto &translation : translations) {
+		result.push_back(translation["translatedText"].get<std::string>());
+	}
+	return result;
 }
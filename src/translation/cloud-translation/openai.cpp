@@ -30,6 +30,21 @@ std::string OpenAITranslator::createSystemPrompt(const std::string &target_lang)
 
 std::string OpenAITranslator::translate(const std::string &text, const std::string &target_lang,
 					const std::string &source_lang)
+{
+	return request(text, target_lang, source_lang, nullptr);
+}
+
+std::string OpenAITranslator::translateStream(const std::string &text,
+					      const std::string &target_lang,
+					      const std::string &source_lang,
+					      const TranslationStreamCallback &on_partial)
+{
+	return request(text, target_lang, source_lang, &on_partial);
+}
+
+std::string OpenAITranslator::request(const std::string &text, const std::string &target_lang,
+				      const std::string &source_lang,
+				      const TranslationStreamCallback *on_partial)
 {
 	if (!isLanguageSupported(target_lang)) {
 		throw TranslationError("Unsupported target language: " + target_lang);
@@ -39,8 +54,7 @@ std::string OpenAITranslator::translate(const std::string &text, const std::stri
 		throw TranslationError("Unsupported source language: " + source_lang);
 	}
 
-	std::unique_ptr<CURL, decltype(&curl_easy_cleanup)> curl(curl_easy_init(),
-								 curl_easy_cleanup);
+	CurlHandle curl = curl_helper_->acquireHandle();
 
 	if (!curl) {
 		throw TranslationError("Failed to initialize CURL session");
@@ -75,6 +89,28 @@ std::string OpenAITranslator::translate(const std::string &text, const std::stri
 				      0.3}, // Lower temperature for more consistent translations
 				     {"max_tokens", 4000}};
 
+		// each content delta of the streamed completion extends the translation
+		std::string translation;
+		SseStream stream;
+		if (on_partial != nullptr) {
+			request_body["stream"] = true;
+			stream.on_data = [&translation, on_partial](const std::string &data) {
+				if (data == "[DONE]") {
+					return;
+				}
+				json chunk = json::parse(data, nullptr, false);
+				if (chunk.is_discarded() || !chunk.contains("choices") ||
+				    chunk["choices"].empty()) {
+					return;
+				}
+				const json &delta = chunk["choices"][0]["delta"];
+				if (delta.contains("content") && delta["content"].is_string()) {
+					translation += delta["content"].get<std::string>();
+					(*on_partial)(translation);
+				}
+			};
+		}
+
 		std::string payload = request_body.dump();
 
 		// Set up headers
@@ -87,8 +123,15 @@ std::string OpenAITranslator::translate(const std::string &text, const std::stri
 		curl_easy_setopt(curl.get(), CURLOPT_POST, 1L);
 		curl_easy_setopt(curl.get(), CURLOPT_POSTFIELDS, payload.c_str());
 		curl_easy_setopt(curl.get(), CURLOPT_HTTPHEADER, headers);
-		curl_easy_setopt(curl.get(), CURLOPT_WRITEFUNCTION, CurlHelper::WriteCallback);
-		curl_easy_setopt(curl.get(), CURLOPT_WRITEDATA, &response);
+		if (on_partial != nullptr) {
+			curl_easy_setopt(curl.get(), CURLOPT_WRITEFUNCTION,
+					 CurlHelper::SseWriteCallback);
+			curl_easy_setopt(curl.get(), CURLOPT_WRITEDATA, &stream);
+		} else {
+			curl_easy_setopt(curl.get(), CURLOPT_WRITEFUNCTION,
+					 CurlHelper::WriteCallback);
+			curl_easy_setopt(curl.get(), CURLOPT_WRITEDATA, &response);
+		}
 		curl_easy_setopt(curl.get(), CURLOPT_SSL_VERIFYPEER, 1L);
 		curl_easy_setopt(curl.get(), CURLOPT_SSL_VERIFYHOST, 2L);
 		curl_easy_setopt(curl.get(), CURLOPT_TIMEOUT, 30L);
@@ -108,11 +151,20 @@ std::string OpenAITranslator::translate(const std::string &text, const std::stri
 		long response_code;
 		curl_easy_getinfo(curl.get(), CURLINFO_RESPONSE_CODE, &response_code);
 
+		if (on_partial != nullptr) {
+			response = stream.body;
+		}
 		if (response_code != 200) {
 			throw TranslationError("HTTP error: " + std::to_string(response_code) +
 					       "\nResponse: " + response);
 		}
 
+		if (on_partial != nullptr) {
+			if (translation.empty()) {
+				throw TranslationError("Empty streamed response: " + response);
+			}
+			return translation;
+		}
 		return parseResponse(response);
 
 	} catch (const json::exception &e) {
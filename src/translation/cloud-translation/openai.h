@@ -12,8 +12,15 @@ public:
 
 	std::string translate(const std::string &text, const std::string &target_lang,
 			      const std::string &source_lang = "auto") override;
+	std::string translateStream(const std::string &text, const std::string &target_lang,
+				    const std::string &source_lang,
+				    const TranslationStreamCallback &on_partial) override;
 
 private:
+	// a streamed request when on_partial is set
+	std::string request(const std::string &text, const std::string &target_lang,
+			    const std::string &source_lang,
+			    const TranslationStreamCallback *on_partial);
 	std::string parseResponse(const std::string &response_str);
 	std::string createSystemPrompt(const std::string &target_lang) const;
 
@@ -1,7 +1,19 @@
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include "ITranslator.h"
 #include "google-cloud.h"
@@ -11,6 +23,7 @@
 #include "claude.h"
 #include "openai.h"
 #include "custom-api.h"
+#include "curl-helper.h"
 
 #include "plugin-support.h"
 #include <util/base.h>
@@ -44,17 +57,419 @@ std::unique_ptr<ITranslator> createTranslator(const CloudTranslatorConfig &confi
 	throw TranslationError("Unknown translation provider: " + config.provider);
 }
 
+// translators kept alive with their connections, most recently used last
+#define MAX_CLOUD_TRANSLATORS 8
+
+// latency buckets 25% wide from 10 ms, the last one holds everything above 60 s
+#define LATENCY_BUCKETS 40
+#define LATENCY_FIRST_BUCKET_MS 10.0
+#define LATENCY_BUCKET_RATIO 1.25
+// the counts are halved past this many requests, so the histogram follows the recent ones
+#define LATENCY_MAX_COUNT 1024
+
+namespace {
+
+std::mutex translators_mutex;
+std::vector<std::pair<std::string, std::shared_ptr<ITranslator>>> translators;
+
+std::string config_key(const CloudTranslatorConfig &config)
+{
+	const char sep = '\x1f';
+	return config.provider + sep + config.access_key + sep + config.secret_key + sep +
+	       config.region + sep + config.model + sep + (config.free ? "1" : "0") + sep +
+	       config.endpoint + sep + config.body + sep + config.response_json_path;
+}
+
+// the translator of this configuration, created on first use. Translators only hold their
+// configuration and a thread-safe connection pool, so they are shared between requests.
+std::shared_ptr<ITranslator> get_translator(const CloudTranslatorConfig &config)
+{
+	const std::string key = config_key(config);
+	std::lock_guard<std::mutex> lock(translators_mutex);
+	for (auto it = translators.begin(); it != translators.end(); ++it) {
+		if (it->first == key) {
+			auto entry = std::move(*it);
+			translators.erase(it);
+			translators.push_back(std::move(entry));
+			return translators.back().second;
+		}
+	}
+	std::shared_ptr<ITranslator> translator = createTranslator(config);
+	if (translators.size() >= MAX_CLOUD_TRANSLATORS) {
+		translators.erase(translators.begin());
+	}
+	translators.emplace_back(key, translator);
+	return translator;
+}
+
+// Response times of a provider
+class LatencyHistogram {
+public:
+	void add(uint64_t ms)
+	{
+		buckets[bucket(ms)]++;
+		if (++total >= LATENCY_MAX_COUNT) {
+			total = 0;
+			for (uint64_t &count : buckets) {
+				count /= 2;
+				total += count;
+			}
+		}
+	}
+
+	uint64_t count() const { return total; }
+
+	// upper bound of the bucket holding the quantile
+	uint64_t quantile(int percent) const
+	{
+		const uint64_t rank = (total * (uint64_t)percent + 99) / 100;
+		uint64_t seen = 0;
+		for (size_t b = 0; b < LATENCY_BUCKETS; b++) {
+			seen += buckets[b];
+			if (seen >= rank) {
+				return upper_bound_ms(b);
+			}
+		}
+		return upper_bound_ms(LATENCY_BUCKETS - 1);
+	}
+
+private:
+	static size_t bucket(uint64_t ms)
+	{
+		if ((double)ms <= LATENCY_FIRST_BUCKET_MS) {
+			return 0;
+		}
+		const double b = std::ceil(std::log((double)ms / LATENCY_FIRST_BUCKET_MS) /
+					   std::log(LATENCY_BUCKET_RATIO));
+		return std::min((size_t)b, (size_t)LATENCY_BUCKETS - 1);
+	}
+
+	static uint64_t upper_bound_ms(size_t b)
+	{
+		return (uint64_t)(LATENCY_FIRST_BUCKET_MS *
+				  std::pow(LATENCY_BUCKET_RATIO, (double)b));
+	}
+
+	uint64_t buckets[LATENCY_BUCKETS] = {};
+	uint64_t total = 0;
+};
+
+// Circuit breaker of a provider. It opens after CLOUD_BREAKER_CONSECUTIVE_FAILURES failed
+// requests in a row, or when CLOUD_BREAKER_BAD_PERCENT of the last CLOUD_BREAKER_WINDOW requests
+// failed or were slow. While open, one trial request is let through every open period, which
+// doubles each time the trial fails. The first request that succeeds closes it.
+class CircuitBreaker {
+public:
+	// whether a request may be sent, the first one after the open period is the trial
+	bool allow(std::chrono::steady_clock::time_point now)
+	{
+		if (!open) {
+			return true;
+		}
+		if (now < retry_at) {
+			return false;
+		}
+		// a trial that never reports lets the next one through after another period
+		retry_at = now + std::chrono::milliseconds(open_ms);
+		trial = true;
+		return true;
+	}
+
+	void record(bool bad, std::chrono::steady_clock::time_point now, const std::string &provider)
+	{
+		if (open) {
+			if (!bad) {
+				open = false;
+				trial = false;
+				outcomes.reset();
+				n_outcomes = 0;
+				consecutive_failures = 0;
+				obs_log(LOG_INFO, "Cloud provider %s recovered", provider.c_str());
+			} else if (trial) {
+				trial = false;
+				open_ms = std::min<uint64_t>(open_ms * 2, CLOUD_BREAKER_MAX_OPEN_MS);
+				retry_at = now + std::chrono::milliseconds(open_ms);
+			}
+			return;
+		}
+		outcomes <<= 1;
+		outcomes.set(0, bad);
+		n_outcomes = std::min(n_outcomes + 1, CLOUD_BREAKER_WINDOW);
+		consecutive_failures = bad ? consecutive_failures + 1 : 0;
+		const int bad_percent = (int)(outcomes.count() * 100 / (size_t)n_outcomes);
+		if (consecutive_failures >= CLOUD_BREAKER_CONSECUTIVE_FAILURES ||
+		    (n_outcomes >= CLOUD_BREAKER_MIN_REQUESTS &&
+		     bad_percent >= CLOUD_BREAKER_BAD_PERCENT)) {
+			open = true;
+			open_ms = CLOUD_BREAKER_OPEN_MS;
+			retry_at = now + std::chrono::milliseconds(open_ms);
+			obs_log(LOG_WARNING,
+				"Cloud provider %s is failing (%d%% of the last %d requests), "
+				"pausing it for %d s",
+				provider.c_str(), bad_percent, n_outcomes, (int)(open_ms / 1000));
+		}
+	}
+
+private:
+	bool open = false;
+	bool trial = false;
+	// 1 for the failed or slow requests, the most recent in bit 0
+	std::bitset<CLOUD_BREAKER_WINDOW> outcomes;
+	int n_outcomes = 0;
+	int consecutive_failures = 0;
+	uint64_t open_ms = CLOUD_BREAKER_OPEN_MS;
+	std::chrono::steady_clock::time_point retry_at;
+};
+
+struct provider_stats {
+	LatencyHistogram latency;
+	CircuitBreaker breaker;
+};
+
+std::mutex stats_mutex;
+// key: config_key of the provider
+std::map<std::string, provider_stats> stats;
+
+uint64_t elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+	return (uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+		       std::chrono::steady_clock::now() - start)
+		.count();
+}
+
+void record_latency(const CloudTranslatorConfig &config, uint64_t ms)
+{
+	std::lock_guard<std::mutex> lock(stats_mutex);
+	stats[config_key(config)].latency.add(ms);
+}
+
+// A finished request, ms is only used for the ones that succeeded. The requests cancelled by
+// a hedge are not recorded.
+void record_outcome(const CloudTranslatorConfig &config, bool ok, uint64_t ms)
+{
+	const std::atomic<bool> *cancel = CurlCancelScope::current();
+	if (cancel != nullptr && cancel->load()) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(stats_mutex);
+	provider_stats &provider = stats[config_key(config)];
+	if (ok) {
+		provider.latency.add(ms);
+	}
+	const bool bad = !ok || ms > CLOUD_BREAKER_SLOW_MS;
+	provider.breaker.record(bad, std::chrono::steady_clock::now(), config.provider);
+}
+
+// time the primary provider gets before the request is hedged
+uint64_t hedge_delay_ms(const CloudTranslatorConfig &config)
+{
+	std::lock_guard<std::mutex> lock(stats_mutex);
+	auto it = stats.find(config_key(config));
+	if (it == stats.end() || it->second.latency.count() < CLOUD_HEDGE_MIN_SAMPLES) {
+		return CLOUD_HEDGE_DEFAULT_DELAY_MS;
+	}
+	const int percent = std::clamp(config.hedge_quantile, 1, 99);
+	return std::clamp<uint64_t>(it->second.latency.quantile(percent),
+				    CLOUD_HEDGE_MIN_DELAY_MS, CLOUD_HEDGE_MAX_DELAY_MS);
+}
+
+std::string request_translation(const CloudTranslatorConfig &config, const std::string &text,
+				const std::string &target_lang, const std::string &source_lang,
+				const std::function<void(const std::string &)> &on_partial)
+{
+	auto translator = get_translator(config);
+	obs_log(LOG_INFO, "translate with cloud provider %s. %s -> %s", config.provider.c_str(),
+		source_lang.c_str(), target_lang.c_str());
+	const auto request_start = std::chrono::steady_clock::now();
+	std::string result;
+	try {
+		if (on_partial) {
+			result = translator->translateStream(text, target_lang, source_lang,
+							     on_partial);
+		} else {
+			result = translator->translate(text, target_lang, source_lang);
+		}
+	} catch (...) {
+		record_outcome(config, false, 0);
+		throw;
+	}
+	record_outcome(config, !result.empty(), elapsed_ms(request_start));
+	return result;
+}
+
+// A hedged translation, attempt 0 goes to the primary provider and attempt 1 to the secondary
+struct hedge_race {
+	std::mutex mutex;
+	std::condition_variable cv;
+	int winner = -1;
+	std::string translation;
+	bool finished[2] = {false, false};
+	std::atomic<bool> cancel[2] = {{false}, {false}};
+	std::thread attempts[2];
+};
+
+std::mutex races_mutex;
+// the races that have a winner, until their losing request has been cancelled
+std::vector<std::shared_ptr<hedge_race>> finishing_races;
+
+void run_attempt(std::shared_ptr<hedge_race> race, int attempt, CloudTranslatorConfig config,
+		 std::string text, std::string target_lang, std::string source_lang)
+{
+	std::string translation;
+	std::string error;
+	{
+		// aborts the request once the other attempt won
+		CurlCancelScope cancel_scope(&race->cancel[attempt]);
+		try {
+			translation = request_translation(config, text, target_lang, source_lang,
+							  nullptr);
+		} catch (const std::exception &e) {
+			error = e.what();
+		}
+	}
+	std::lock_guard<std::mutex> lock(race->mutex);
+	if (!translation.empty() && race->winner < 0) {
+		race->winner = attempt;
+		race->translation = translation;
+		race->cancel[1 - attempt] = true;
+	} else if (translation.empty() && !race->cancel[attempt]) {
+		obs_log(LOG_ERROR, "Translation error with %s: %s", config.provider.c_str(),
+			error.c_str());
+	}
+	race->finished[attempt] = true;
+	race->cv.notify_all();
+}
+
+// Join the threads of the races of which both attempts finished, or all of them
+void reap_races(bool all)
+{
+	std::vector<std::shared_ptr<hedge_race>> finished;
+	{
+		std::lock_guard<std::mutex> lock(races_mutex);
+		for (auto it = finishing_races.begin(); it != finishing_races.end();) {
+			bool done = all;
+			if (!done) {
+				std::lock_guard<std::mutex> race_lock((*it)->mutex);
+				done = (*it)->finished[0] &&
+				       ((*it)->finished[1] || !(*it)->attempts[1].joinable());
+			}
+			if (done) {
+				finished.push_back(std::move(*it));
+				it = finishing_races.erase(it);
+			} else {
+				++it;
+			}
+		}
+	}
+	for (auto &race : finished) {
+		race->cancel[0] = true;
+		race->cancel[1] = true;
+		for (std::thread &attempt : race->attempts) {
+			if (attempt.joinable()) {
+				attempt.join();
+			}
+		}
+	}
+}
+
+std::string translate_hedged(const CloudTranslatorConfig &config, const std::string &text,
+			     const std::string &target_lang, const std::string &source_lang)
+{
+	reap_races(false);
+	auto race = std::make_shared<hedge_race>();
+	const auto request_start = std::chrono::steady_clock::now();
+	const uint64_t delay_ms = hedge_delay_ms(config);
+	race->attempts[0] = std::thread(run_attempt, race, 0, config, text, target_lang,
+					source_lang);
+
+	std::unique_lock<std::mutex> lock(race->mutex);
+	// a failed primary is hedged at once
+	race->cv.wait_for(lock, std::chrono::milliseconds(delay_ms),
+			  [&race] { return race->finished[0]; });
+	if (race->winner < 0) {
+		obs_log(LOG_INFO, "Hedging the translation with %s after %d ms",
+			config.hedge->provider.c_str(), (int)elapsed_ms(request_start));
+		race->attempts[1] = std::thread(run_attempt, race, 1, *config.hedge, text,
+						target_lang, source_lang);
+		race->cv.wait(lock, [&race] {
+			return race->winner >= 0 || (race->finished[0] && race->finished[1]);
+		});
+	}
+	if (race->winner == 1) {
+		// the primary took at least this long, in its latencies the hedge delay follows it
+		record_latency(config, elapsed_ms(request_start));
+	}
+	const std::string translation = race->translation;
+	lock.unlock();
+
+	// the loser is joined later, the translation does not wait for its cancellation
+	{
+		std::lock_guard<std::mutex> races_lock(races_mutex);
+		finishing_races.push_back(std::move(race));
+	}
+	reap_races(false);
+	return translation;
+}
+
+} // namespace
+
 std::string translate_cloud(const CloudTranslatorConfig &config, const std::string &text,
-			    const std::string &target_lang, const std::string &source_lang)
+			    const std::string &target_lang, const std::string &source_lang,
+			    const std::function<void(const std::string &)> &on_partial)
 {
 	try {
-		auto translator = createTranslator(config);
-		obs_log(LOG_INFO, "translate with cloud provider %s. %s -> %s",
-			config.provider.c_str(), source_lang.c_str(), target_lang.c_str());
-		std::string result = translator->translate(text, target_lang, source_lang);
-		return result;
+		if (config.hedge && !config.hedge->provider.empty() && !on_partial) {
+			return translate_hedged(config, text, target_lang, source_lang);
+		}
+		return request_translation(config, text, target_lang, source_lang, on_partial);
 	} catch (const TranslationError &e) {
 		obs_log(LOG_ERROR, "Translation error: %s\n", e.what());
 	}
 	return "";
 }
+
+bool cloud_provider_supports_batch(const std::string &provider)
+{
+	return provider == "deepl" || provider == "google" || provider == "azure";
+}
+
+std::vector<std::string> translate_cloud_batch(const CloudTranslatorConfig &config,
+					       const std::vector<std::string> &texts,
+					       const std::string &target_lang,
+					       const std::string &source_lang)
+{
+	const auto request_start = std::chrono::steady_clock::now();
+	try {
+		auto translator = get_translator(config);
+		obs_log(LOG_INFO, "translate %d texts with cloud provider %s. %s -> %s",
+			(int)texts.size(), config.provider.c_str(), source_lang.c_str(),
+			target_lang.c_str());
+		std::vector<std::string> translations =
+			translator->translateBatch(texts, target_lang, source_lang);
+		record_outcome(config, true, elapsed_ms(request_start));
+		return translations;
+	} catch (const TranslationError &e) {
+		obs_log(LOG_ERROR, "Translation error: %s\n", e.what());
+	}
+	record_outcome(config, false, 0);
+	return std::vector<std::string>(texts.size());
+}
+
+CloudTranslationRoute cloud_translation_route(const CloudTranslatorConfig &config)
+{
+	const auto now = std::chrono::steady_clock::now();
+	std::lock_guard<std::mutex> lock(stats_mutex);
+	if (stats[config_key(config)].breaker.allow(now)) {
+		return CLOUD_ROUTE_PRIMARY;
+	}
+	if (config.hedge && !config.hedge->provider.empty() &&
+	    stats[config_key(*config.hedge)].breaker.allow(now)) {
+		return CLOUD_ROUTE_SECONDARY;
+	}
+	return CLOUD_ROUTE_NONE;
+}
+
+void shutdown_cloud_hedges()
+{
+	reap_races(true);
+}
@@ -1,6 +1,26 @@
 #pragma once
 
+#include <functional>
+#include <memory>
 #include <string>
+#include <vector>
+
+// hedge delay before the primary provider has answered CLOUD_HEDGE_MIN_SAMPLES requests
+#define CLOUD_HEDGE_DEFAULT_DELAY_MS 1000
+#define CLOUD_HEDGE_MIN_SAMPLES 20
+#define CLOUD_HEDGE_MIN_DELAY_MS 100
+#define CLOUD_HEDGE_MAX_DELAY_MS 5000
+
+// circuit breaker of each provider: outcomes of the last requests it looks at, the part of them
+// or the failures in a row that open it, and how long it stays open before a trial request
+#define CLOUD_BREAKER_WINDOW 20
+#define CLOUD_BREAKER_MIN_REQUESTS 10
+#define CLOUD_BREAKER_BAD_PERCENT 50
+#define CLOUD_BREAKER_CONSECUTIVE_FAILURES 3
+// a response slower than this counts as a failure
+#define CLOUD_BREAKER_SLOW_MS 5000
+#define CLOUD_BREAKER_OPEN_MS 15000
+#define CLOUD_BREAKER_MAX_OPEN_MS 300000
 
 struct CloudTranslatorConfig {
 	std::string provider;
@@ -12,7 +32,39 @@ struct CloudTranslatorConfig {
 	std::string endpoint;           // For Custom API
 	std::string body;               // For Custom API
 	std::string response_json_path; // For Custom API
+	// Hedging: the secondary provider gets the same request when this one has not answered
+	// within the hedge_quantile (percent) of its latencies, the first response wins
+	std::shared_ptr<const CloudTranslatorConfig> hedge;
+	int hedge_quantile = 90;
 };
 
+// With on_partial set, providers that support streaming call it with the translation received
+// so far while it is generated. Streamed requests are not hedged.
 std::string translate_cloud(const CloudTranslatorConfig &config, const std::string &text,
-			    const std::string &target_lang, const std::string &source_lang);
+			    const std::string &target_lang, const std::string &source_lang,
+			    const std::function<void(const std::string &)> &on_partial = nullptr);
+
+// Whether the provider translates several texts with one request
+bool cloud_provider_supports_batch(const std::string &provider);
+
+// One translation per text, all empty on error
+std::vector<std::string> translate_cloud_batch(const CloudTranslatorConfig &config,
+					       const std::vector<std::string> &texts,
+					       const std::string &target_lang,
+					       const std::string &source_lang);
+
+// Where a request goes according to the circuit breakers of the providers
+enum CloudTranslationRoute {
+	// the primary provider, hedged when a secondary one is set
+	CLOUD_ROUTE_PRIMARY,
+	// the secondary provider alone, while the breaker of the primary is open
+	CLOUD_ROUTE_SECONDARY,
+	// no provider is available, e.g. translate locally
+	CLOUD_ROUTE_NONE,
+};
+
+// Lets the trial request of an open breaker through, call it right before the request
+CloudTranslationRoute cloud_translation_route(const CloudTranslatorConfig &config);
+
+// Cancel and wait for the requests of the hedged translations still running, on module unload
+void shutdown_cloud_hedges();
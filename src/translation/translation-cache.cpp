@@ -0,0 +1,217 @@
+#include "translation-cache.h"
+#include "plugin-support.h"
+#include "model-utils/model-downloader.h"
+
+#include <obs-module.h>
+
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <list>
+#include <map>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+
+namespace {
+
+std::mutex cache_mutex;
+// the capacity and persist settings of each filter
+std::map<const void *, std::pair<size_t, bool>> filter_options;
+size_t cache_capacity = TRANSLATION_CACHE_DEFAULT_CAPACITY;
+bool cache_persist = false;
+bool cache_loaded = false;
+uint64_t cache_hits = 0;
+uint64_t cache_misses = 0;
+// most recently used first, the map points into the list
+std::list<std::pair<std::string, std::string>> cache_entries;
+std::unordered_map<std::string, std::list<std::pair<std::string, std::string>>::iterator>
+	cache_index;
+
+std::string normalize_text(const std::string &text)
+{
+	std::string normalized;
+	normalized.reserve(text.size());
+	bool space = false;
+	for (const char c : text) {
+		if (std::isspace((unsigned char)c)) {
+			space = !normalized.empty();
+			continue;
+		}
+		if (space) {
+			normalized.push_back(' ');
+			space = false;
+		}
+		// ASCII only, UTF-8 sequences are kept as is
+		normalized.push_back((char)std::tolower((unsigned char)c));
+	}
+	return normalized;
+}
+
+std::string cache_key(const std::string &provider, const std::string &source_lang,
+		      const std::string &target_lang, const std::string &text)
+{
+	// the separator does not appear in language codes or provider names
+	return provider + '\x1f' + source_lang + '\x1f' + target_lang + '\x1f' +
+	       normalize_text(text);
+}
+
+std::filesystem::path cache_file_path()
+{
+	char *config_file = obs_module_config_path("translation-cache.json");
+	if (config_file == nullptr) {
+		return {};
+	}
+	return obs_config_stdfs_path(config_file);
+}
+
+// cache_mutex must be held
+void evict_to_capacity()
+{
+	while (cache_entries.size() > cache_capacity) {
+		cache_index.erase(cache_entries.back().first);
+		cache_entries.pop_back();
+	}
+}
+
+// cache_mutex must be held
+void insert_entry(const std::string &key, const std::string &translation)
+{
+	auto it = cache_index.find(key);
+	if (it != cache_index.end()) {
+		it->second->second = translation;
+		cache_entries.splice(cache_entries.begin(), cache_entries, it->second);
+		return;
+	}
+	cache_entries.emplace_front(key, translation);
+	cache_index[key] = cache_entries.begin();
+	evict_to_capacity();
+}
+
+// cache_mutex must be held
+void load_cache_file()
+{
+	cache_loaded = true;
+	const std::filesystem::path path = cache_file_path();
+	std::ifstream file(path);
+	if (path.empty() || !file.is_open()) {
+		return;
+	}
+	try {
+		const nlohmann::json entries = nlohmann::json::parse(file);
+		// saved most recently used first, inserted in reverse to keep the order
+		for (auto it = entries.rbegin(); it != entries.rend(); ++it) {
+			insert_entry((*it).at(0).get<std::string>(),
+				     (*it).at(1).get<std::string>());
+		}
+		obs_log(LOG_INFO, "Loaded %d cached translations", (int)cache_entries.size());
+	} catch (const std::exception &e) {
+		obs_log(LOG_WARNING, "Cannot read the translation cache: %s", e.what());
+	}
+}
+
+// cache_mutex must be held
+void combine_filter_options()
+{
+	// no filter left: keep the last options, for the save on unload
+	if (filter_options.empty()) {
+		return;
+	}
+	size_t capacity = 0;
+	bool persist = false;
+	for (const auto &options : filter_options) {
+		capacity = std::max(capacity, options.second.first);
+		persist = persist || options.second.second;
+	}
+	cache_capacity = capacity;
+	cache_persist = persist;
+	if (cache_persist && !cache_loaded && cache_capacity > 0) {
+		load_cache_file();
+	}
+	evict_to_capacity();
+}
+
+} // namespace
+
+void set_translation_cache_options(const void *filter, size_t capacity, bool persist)
+{
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	filter_options[filter] = {capacity, persist};
+	combine_filter_options();
+}
+
+void remove_translation_cache_options(const void *filter)
+{
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	filter_options.erase(filter);
+	combine_filter_options();
+}
+
+bool translation_cache_get(const std::string &provider, const std::string &source_lang,
+			   const std::string &target_lang, const std::string &text,
+			   std::string &translation)
+{
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	if (cache_capacity == 0) {
+		return false;
+	}
+	auto it = cache_index.find(cache_key(provider, source_lang, target_lang, text));
+	if (it == cache_index.end()) {
+		cache_misses++;
+		return false;
+	}
+	cache_hits++;
+	cache_entries.splice(cache_entries.begin(), cache_entries, it->second);
+	translation = it->second->second;
+	return true;
+}
+
+void translation_cache_put(const std::string &provider, const std::string &source_lang,
+			   const std::string &target_lang, const std::string &text,
+			   const std::string &translation)
+{
+	if (translation.empty()) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	if (cache_capacity == 0) {
+		return;
+	}
+	insert_entry(cache_key(provider, source_lang, target_lang, text), translation);
+}
+
+void translation_cache_stats(uint64_t &hits, uint64_t &misses, size_t &size)
+{
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	hits = cache_hits;
+	misses = cache_misses;
+	size = cache_entries.size();
+}
+
+void save_translation_cache(void)
+{
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	if (cache_hits + cache_misses > 0) {
+		obs_log(LOG_INFO, "Translation cache: %llu hits, %llu misses, %d entries",
+			(unsigned long long)cache_hits, (unsigned long long)cache_misses,
+			(int)cache_entries.size());
+	}
+	if (!cache_persist) {
+		return;
+	}
+	const std::filesystem::path path = cache_file_path();
+	std::error_code ec;
+	std::filesystem::create_directories(path.parent_path(), ec);
+	std::ofstream file(path);
+	if (path.empty() || !file.is_open()) {
+		obs_log(LOG_WARNING, "Cannot write the translation cache");
+		return;
+	}
+	nlohmann::json entries = nlohmann::json::array();
+	for (const auto &entry : cache_entries) {
+		entries.push_back({entry.first, entry.second});
+	}
+	file << entries.dump();
+}
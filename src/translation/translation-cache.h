@@ -0,0 +1,70 @@
+/**
+ * @file translation-cache.h
+ * @brief Process-wide LRU cache of translated sentences.
+ *
+ * Partials and repeated phrases are translated over and over. The cache is shared by the local
+ * (CTranslate2) and the cloud translation and keyed by the normalized sentence (trimmed, single
+ * spaces, lower case), the source and target language and the provider, which names the local
+ * model or the cloud service. It can be saved to the plugin config folder on unload and loaded
+ * back on the next start.
+ *
+ * The size and the persistence are settings of each filter. Each filter sets its values and they
+ * are combined: the cache has the largest size a filter set, so it fits the sentences of that
+ * filter, and it is saved when a filter asks for it.
+ */
+#ifndef TRANSLATION_CACHE_H
+#define TRANSLATION_CACHE_H
+
+#ifdef __cplusplus
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#define TRANSLATION_CACHE_DEFAULT_CAPACITY 2048
+
+/**
+ * @brief Set the cache settings of a filter.
+ *
+ * @param filter The filter the settings are from.
+ * @param capacity Number of cached translations, 0 when the filter does not need the cache. The
+ * cache is disabled when no filter needs it.
+ * @param persist Whether the cache is saved on unload. Enabling it loads the saved cache.
+ */
+void set_translation_cache_options(const void *filter, size_t capacity, bool persist);
+
+/**
+ * @brief Drop the cache settings of a destroyed filter.
+ */
+void remove_translation_cache_options(const void *filter);
+
+/**
+ * @brief Look up a translation, counts a hit or a miss.
+ *
+ * @return Whether the translation was found.
+ */
+bool translation_cache_get(const std::string &provider, const std::string &source_lang,
+			   const std::string &target_lang, const std::string &text,
+			   std::string &translation);
+
+/**
+ * @brief Add a translation, evicting the least recently used one when the cache is full.
+ *
+ * Empty translations are not cached.
+ */
+void translation_cache_put(const std::string &provider, const std::string &source_lang,
+			   const std::string &target_lang, const std::string &text,
+			   const std::string &translation);
+
+void translation_cache_stats(uint64_t &hits, uint64_t &misses, size_t &size);
+
+extern "C" {
+#endif
+
+// Save the cache when persistence is enabled, called on module unload
+void save_translation_cache(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // TRANSLATION_CACHE_H
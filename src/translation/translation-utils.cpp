@@ -6,7 +6,20 @@
 #include "plugin-support.h"
 #include "model-utils/model-downloader.h"
 
-void start_translation(struct transcription_filter_data *gf)
+static void enable_translation(struct transcription_filter_data *gf, const std::string &path,
+			       bool defer_load)
+{
+	if (!defer_load) {
+		build_and_enable_translation(gf, path);
+		return;
+	}
+	obs_log(LOG_INFO, "The CT2 model loads with the first sentence");
+	std::lock_guard<std::mutex> lock(gf->translation_ctx_mutex);
+	gf->translation_ctx.local_model_folder_path = path;
+	gf->translate = true;
+}
+
+void start_translation(struct transcription_filter_data *gf, bool defer_load)
 {
 	obs_log(LOG_INFO, "Starting translation...");
 
@@ -18,7 +31,7 @@ void start_translation(struct transcription_filter_data *gf)
 			return;
 		}
 		std::string model_file_found = gf->translation_model_path_external;
-		build_and_enable_translation(gf, model_file_found);
+		enable_translation(gf, model_file_found, defer_load);
 		return;
 	}
 
@@ -38,6 +51,6 @@ void start_translation(struct transcription_filter_data *gf)
 			});
 	} else {
 		// Model exists, just load it
-		build_and_enable_translation(gf, model_file_found.value().string());
+		enable_translation(gf, model_file_found.value().string(), defer_load);
 	}
 }
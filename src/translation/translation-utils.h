@@ -3,6 +3,8 @@
 
 #include "transcription-filter-data.h"
 
-void start_translation(struct transcription_filter_data *gf);
+// With defer_load, a model found on disk is only loaded by the translation worker with the
+// first sentence to translate
+void start_translation(struct transcription_filter_data *gf, bool defer_load = false);
 
 #endif // TRANSLATION_UTILS_H
@@ -0,0 +1,198 @@
+#include "translation-worker.h"
+#include "translation.h"
+#include "translation-cache.h"
+#include "language_codes.h"
+#include "plugin-log.h"
+#include "transcription-filter-data.h"
+#include "transcription-filter-callbacks.h"
+
+#include <obs-module.h>
+
+#include <vector>
+
+// translation_ctx_mutex must be held. Returns the translations of each job, the main target
+// language first, then one per additional target (empty for unused slots).
+static std::vector<std::vector<std::string>>
+translate_jobs(struct transcription_filter_data *gf, const std::vector<translation_job> &jobs)
+{
+	auto &targets = gf->extra_translation_targets;
+	std::vector<std::vector<std::string>> translations(
+		jobs.size(), std::vector<std::string>(targets.size() + 1));
+	std::vector<translation_request> requests;
+	// job and target (0: main target) of each request
+	std::vector<std::pair<size_t, size_t>> request_slots;
+	const std::string provider = "ct2:" + gf->translation_ctx.local_model_folder_path;
+	// translations of finals depend on the context window, those are not cached
+	auto cacheable = [gf](const translation_request &request) {
+		return request.partial || !request.with_context ||
+		       gf->translation_ctx.add_context == 0;
+	};
+	auto add_request = [&](size_t job, size_t slot, const translation_request &request) {
+		if (cacheable(request) &&
+		    translation_cache_get(provider, request.source_lang, request.target_lang,
+					  request.text, translations[job][slot])) {
+			return;
+		}
+		requests.push_back(request);
+		request_slots.push_back({job, slot});
+	};
+	// the same sentence twice in a row is not translated again
+	std::string last_text = gf->last_text_for_translation;
+	for (size_t i = 0; i < jobs.size(); i++) {
+		const bool repeated = jobs[i].text == last_text;
+		last_text = jobs[i].text;
+		if (jobs[i].text.empty() || repeated) {
+			continue;
+		}
+		const std::string source_lang =
+			language_codes_from_whisper[jobs[i].result->language];
+		const bool partial = jobs[i].result->result == DETECTION_RESULT_PARTIAL;
+		add_request(i, 0, {jobs[i].text, source_lang, gf->target_lang, partial, true});
+		for (size_t t = 0; t < targets.size(); t++) {
+			if (!targets[t].language.empty()) {
+				add_request(i, t + 1,
+					    {jobs[i].text, source_lang, targets[t].language,
+					     partial, false});
+			}
+		}
+	}
+
+	if (!requests.empty() && gf->translate && gf->translation_ctx.translator) {
+		OBS_LOG(gf->log_level, "Translating %d sentences to %s", (int)requests.size(),
+			gf->target_lang.c_str());
+		std::vector<std::string> results;
+		int status;
+		const uint64_t translation_start_us = SegmentTrace::now_us();
+		{
+			StageTimer timer(gf->pipeline_timings, PIPELINE_STAGE_TRANSLATION);
+			timer.set_units(requests.size());
+			status = translate_batch(gf->translation_ctx, requests, results);
+		}
+		const uint64_t translation_end_us = SegmentTrace::now_us();
+		for (const translation_job &job : jobs) {
+			gf->segment_trace.span(job.result->trace_id, "translation",
+					       translation_start_us, translation_end_us);
+		}
+		if (status == OBS_POLYGLOT_TRANSLATION_SUCCESS) {
+			for (size_t i = 0; i < results.size(); i++) {
+				translations[request_slots[i].first][request_slots[i].second] =
+					results[i];
+				if (cacheable(requests[i])) {
+					translation_cache_put(provider, requests[i].source_lang,
+							      requests[i].target_lang,
+							      requests[i].text, results[i]);
+				}
+				if (gf->log_words) {
+					obs_log(LOG_INFO, "Translation (%s): '%s' -> '%s'",
+						requests[i].target_lang.c_str(),
+						requests[i].text.c_str(), results[i].c_str());
+				}
+			}
+		} else {
+			OBS_LOG(gf->log_level, "Failed to translate text");
+		}
+	}
+
+	for (size_t i = 0; i < jobs.size(); i++) {
+		const std::string &text = jobs[i].text;
+		if (!text.empty() && text == gf->last_text_for_translation) {
+			translations[i][0] = gf->last_text_translation;
+		}
+		gf->last_text_for_translation = text;
+		gf->last_text_translation = translations[i][0];
+		for (size_t t = 0; t < targets.size(); t++) {
+			if (!text.empty() && text == targets[t].last_text) {
+				translations[i][t + 1] = targets[t].last_translation;
+			}
+			targets[t].last_text = text;
+			targets[t].last_translation = translations[i][t + 1];
+		}
+	}
+	return translations;
+}
+
+static void translation_loop(struct transcription_filter_data *gf)
+{
+	OBS_LOG(gf->log_level, "Starting translation worker");
+	gf->segment_trace.set_thread_name("translation");
+	std::vector<translation_job> jobs;
+	while (true) {
+		jobs.clear();
+		{
+			std::unique_lock<std::mutex> lock(gf->translation_queue_mutex);
+			gf->translation_queue_cv.wait(lock, [gf] {
+				return gf->translation_stop || !gf->translation_queue.empty();
+			});
+			if (gf->translation_stop) {
+				break;
+			}
+			while (!gf->translation_queue.empty() &&
+			       jobs.size() < TRANSLATION_MAX_BATCH) {
+				translation_job job = std::move(gf->translation_queue.front());
+				gf->translation_queue.pop_front();
+				if (job.result->result == DETECTION_RESULT_PARTIAL &&
+				    !gf->translation_queue.empty()) {
+					// superseded by the next sentence
+					continue;
+				}
+				jobs.push_back(std::move(job));
+			}
+		}
+		// the CT2 model of a new filter is loaded with its first sentence
+		resume_translation(gf);
+		std::vector<std::vector<std::string>> translations;
+		std::vector<translation_target> targets;
+		{
+			std::lock_guard<std::mutex> lock(gf->translation_ctx_mutex);
+			translations = translate_jobs(gf, jobs);
+			targets = gf->extra_translation_targets;
+		}
+		for (size_t i = 0; i < jobs.size(); i++) {
+			output_text(gf, *jobs[i].result, jobs[i].possible_end_ts, translations[i][0],
+				    gf->translation_output.empty() ? gf->text_source_name
+								   : gf->translation_output,
+				    LOCAL_TRANSLATION);
+			for (size_t t = 0; t < targets.size(); t++) {
+				if (!targets[t].language.empty()) {
+					output_text(gf, *jobs[i].result, jobs[i].possible_end_ts,
+						    translations[i][t + 1], targets[t].output,
+						    LOCAL_EXTRA_TRANSLATION, targets[t].language);
+				}
+			}
+		}
+	}
+	OBS_LOG(gf->log_level, "Translation worker stopped");
+}
+
+void start_translation_worker(struct transcription_filter_data *gf)
+{
+	{
+		std::lock_guard<std::mutex> lock(gf->translation_queue_mutex);
+		gf->translation_stop = false;
+	}
+	gf->translation_thread = std::thread(translation_loop, gf);
+}
+
+void stop_translation_worker(struct transcription_filter_data *gf)
+{
+	{
+		std::lock_guard<std::mutex> lock(gf->translation_queue_mutex);
+		gf->translation_stop = true;
+		gf->translation_queue.clear();
+	}
+	gf->translation_queue_cv.notify_all();
+	if (gf->translation_thread.joinable()) {
+		gf->translation_thread.join();
+	}
+}
+
+void queue_sentence_for_translation(struct transcription_filter_data *gf,
+				    const SharedDetectionResult &result, uint64_t possible_end_ts,
+				    const std::string &text)
+{
+	{
+		std::lock_guard<std::mutex> lock(gf->translation_queue_mutex);
+		gf->translation_queue.push_back({result, possible_end_ts, text});
+	}
+	gf->translation_queue_cv.notify_one();
+}
@@ -0,0 +1,59 @@
+/**
+ * @file translation-worker.h
+ * @brief Local (CTranslate2) translation on a thread of its own.
+ *
+ * Transcribed sentences are queued by set_text_callback and translated by the worker thread, so
+ * translation does not delay the next transcription. The sentences waiting when the worker
+ * wakes up are translated with one CTranslate2 batch, and a partial with a newer sentence behind
+ * it is dropped since its translation would be replaced right away. Every sentence is translated
+ * to the main target language and to the additional ones in the same batch.
+ */
+#ifndef TRANSLATION_WORKER_H
+#define TRANSLATION_WORKER_H
+
+#include "whisper-utils/whisper-processing.h"
+
+#include <cstdint>
+#include <string>
+
+// maximal number of sentences translated with one batch
+#define TRANSLATION_MAX_BATCH 8
+// number of target languages of a filter, the main one and the additional ones
+#define MAX_TRANSLATION_TARGETS 3
+
+struct transcription_filter_data;
+
+// A transcribed sentence waiting for the translation worker
+struct translation_job {
+	// shared with the outputs and the cloud translation, not copied
+	SharedDetectionResult result;
+	uint64_t possible_end_ts;
+	// the sentence after the word filters
+	std::string text;
+};
+
+// An additional target language of the local translation
+struct translation_target {
+	// language code, empty when the slot is not used
+	std::string language;
+	// text source of the translation, empty for none
+	std::string output;
+	// source and translation of the last sentence, repeated sentences are not translated again
+	std::string last_text;
+	std::string last_translation;
+};
+
+void start_translation_worker(struct transcription_filter_data *gf);
+void stop_translation_worker(struct transcription_filter_data *gf);
+
+/**
+ * @brief Queue a sentence for local translation.
+ *
+ * The translation is output with output_text as LOCAL_TRANSLATION, in the order the sentences
+ * were queued.
+ */
+void queue_sentence_for_translation(struct transcription_filter_data *gf,
+				    const SharedDetectionResult &result, uint64_t possible_end_ts,
+				    const std::string &text);
+
+#endif // TRANSLATION_WORKER_H
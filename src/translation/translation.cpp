@@ -6,14 +6,16 @@
 #include "translation-language-utils.h"
 
 #include <ctranslate2/translator.h>
+#include <ctranslate2/devices.h>
 #include <sentencepiece_processor.h>
 #include <obs-module.h>
-#include <regex>
+#include <algorithm>
+#include <chrono>
 
 void build_and_enable_translation(struct transcription_filter_data *gf,
 				  const std::string &model_file_path)
 {
-	std::lock_guard<std::mutex> lock(gf->whisper_ctx_mutex);
+	std::lock_guard<std::mutex> lock(gf->translation_ctx_mutex);
 
 	gf->translation_ctx.local_model_folder_path = model_file_path;
 	if (build_translation_context(gf->translation_ctx) ==
@@ -26,6 +28,51 @@ void build_and_enable_translation(struct transcription_filter_data *gf,
 	}
 }
 
+void suspend_translation(struct transcription_filter_data *gf)
+{
+	std::lock_guard<std::mutex> lock(gf->translation_ctx_mutex);
+	if (gf->translation_ctx.translator) {
+		obs_log(gf->log_level, "Releasing the CT2 model");
+		gf->translation_ctx.translator.reset();
+	}
+}
+
+void resume_translation(struct transcription_filter_data *gf)
+{
+	std::lock_guard<std::mutex> lock(gf->translation_ctx_mutex);
+	if (!gf->translate || gf->translation_ctx.translator ||
+	    gf->translation_ctx.local_model_folder_path.empty()) {
+		return;
+	}
+	if (build_translation_context(gf->translation_ctx) !=
+	    OBS_POLYGLOT_TRANSLATION_INIT_SUCCESS) {
+		obs_log(LOG_ERROR, "Failed to load the CT2 model");
+		gf->translate = false;
+	}
+}
+
+int get_translation_gpu_count()
+{
+#ifdef POLYGLOT_WITH_CUDA
+	try {
+		return ctranslate2::get_device_count(ctranslate2::Device::CUDA);
+	} catch (std::exception &e) {
+		obs_log(LOG_WARNING, "Cannot get the CUDA device count: %s", e.what());
+	}
+#endif
+	return 0;
+}
+
+// "<unk>" -> "UNK", in place
+static void replace_unknown_tokens(std::string &text)
+{
+	size_t pos = 0;
+	while ((pos = text.find("<unk>", pos)) != std::string::npos) {
+		text.replace(pos, 5, "UNK");
+		pos += 3;
+	}
+}
+
 int build_translation_context(struct translation_context &translation_ctx)
 {
 	std::string local_model_path = translation_ctx.local_model_folder_path;
@@ -61,10 +108,9 @@ int build_translation_context(struct translation_context &translation_ctx)
 			translation_ctx.target_processor.release();
 		}
 
-		translation_ctx.tokenizer = [&translation_ctx](const std::string &text) {
-			std::vector<std::string> tokens;
+		translation_ctx.tokenizer = [&translation_ctx](const std::string &text,
+							       std::vector<std::string> &tokens) {
 			translation_ctx.processor->Encode(text, &tokens);
-			return tokens;
 		};
 		translation_ctx.detokenizer =
 			[&translation_ctx](const std::vector<std::string> &tokens) {
@@ -74,30 +120,60 @@ int build_translation_context(struct translation_context &translation_ctx)
 				} else {
 					translation_ctx.processor->Decode(tokens, &text);
 				}
-				return std::regex_replace(text, std::regex("<unk>"), "UNK");
+				replace_unknown_tokens(text);
+				return text;
 			};
 
 		obs_log(LOG_INFO, "Loading CT2 model from %s", local_model_path.c_str());
 
-#ifdef POLYGLOT_WITH_CUDA
-		ctranslate2::Device device = ctranslate2::Device::CUDA;
-		obs_log(LOG_INFO, "CT2 Using CUDA");
-#else
 		ctranslate2::Device device = ctranslate2::Device::CPU;
-		obs_log(LOG_INFO, "CT2 Using CPU");
-#endif
+		int device_index = 0;
+		if (translation_ctx.device_index >= 0 &&
+		    translation_ctx.device_index < get_translation_gpu_count()) {
+			device = ctranslate2::Device::CUDA;
+			device_index = translation_ctx.device_index;
+			obs_log(LOG_INFO, "CT2 Using CUDA device %d", device_index);
+		} else {
+			obs_log(LOG_INFO, "CT2 Using CPU");
+		}
 
-		translation_ctx.translator.reset(new ctranslate2::Translator(
-			local_model_path, device, ctranslate2::ComputeType::AUTO));
-		obs_log(LOG_INFO, "CT2 Model loaded");
-
-		translation_ctx.options.reset(new ctranslate2::TranslationOptions);
-		translation_ctx.options->beam_size = 1;
-		translation_ctx.options->max_decoding_length = 64;
-		translation_ctx.options->repetition_penalty = 2.0f;
-		translation_ctx.options->no_repeat_ngram_size = 1;
-		translation_ctx.options->max_input_length = 64;
-		translation_ctx.options->sampling_temperature = 0.1f;
+		// one replica per inter thread, all on the same device
+		const std::vector<int> device_indices(std::max(1, translation_ctx.inter_threads),
+						      device_index);
+		ctranslate2::ReplicaPoolConfig pool_config;
+		pool_config.num_threads_per_replica =
+			(size_t)std::max(0, translation_ctx.intra_threads);
+		try {
+			translation_ctx.translator.reset(new ctranslate2::Translator(
+				local_model_path, device,
+				ctranslate2::str_to_compute_type(translation_ctx.compute_type),
+				device_indices, false, pool_config));
+		} catch (std::exception &e) {
+			if (translation_ctx.compute_type == "auto") {
+				throw;
+			}
+			obs_log(LOG_WARNING, "CT2 compute type %s not available (%s), using auto",
+				translation_ctx.compute_type.c_str(), e.what());
+			translation_ctx.translator.reset(new ctranslate2::Translator(
+				local_model_path, device, ctranslate2::ComputeType::AUTO,
+				device_indices, false, pool_config));
+		}
+		translation_ctx.translated_tokens = 0;
+		translation_ctx.translation_time_ms = 0;
+		obs_log(LOG_INFO, "CT2 Model loaded, compute type %s, %d x %d threads",
+			translation_ctx.compute_type.c_str(), (int)device_indices.size(),
+			translation_ctx.intra_threads);
+
+		if (!translation_ctx.options) {
+			// the options of the settings stay when the model is loaded again
+			translation_ctx.options.reset(new ctranslate2::TranslationOptions);
+			translation_ctx.options->beam_size = 1;
+			translation_ctx.options->max_decoding_length = 64;
+			translation_ctx.options->repetition_penalty = 2.0f;
+			translation_ctx.options->no_repeat_ngram_size = 1;
+			translation_ctx.options->max_input_length = 64;
+			translation_ctx.options->sampling_temperature = 0.1f;
+		}
 	} catch (std::exception &e) {
 		obs_log(LOG_ERROR, "Failed to load CT2 model: %s", e.what());
 		return OBS_POLYGLOT_TRANSLATION_INIT_FAIL;
@@ -105,107 +181,188 @@ int build_translation_context(struct translation_context &translation_ctx)
 	return OBS_POLYGLOT_TRANSLATION_INIT_SUCCESS;
 }
 
+static std::string tokens_to_string(const std::vector<std::string> &tokens)
+{
+	size_t length = 0;
+	for (const auto &token : tokens) {
+		length += token.size() + 2;
+	}
+	std::string tokens_str;
+	tokens_str.reserve(length);
+	for (const auto &token : tokens) {
+		tokens_str.append(token).append(", ");
+	}
+	return tokens_str;
+}
+
 int translate(struct translation_context &translation_ctx, const std::string &text,
 	      const std::string &source_lang, const std::string &target_lang, std::string &result)
 {
+	std::vector<std::string> results;
+	const translation_request request = {text, source_lang, target_lang, false, true};
+	if (translate_batch(translation_ctx, {request}, results) !=
+	    OBS_POLYGLOT_TRANSLATION_SUCCESS) {
+		return OBS_POLYGLOT_TRANSLATION_FAIL;
+	}
+	result = results[0];
+	return OBS_POLYGLOT_TRANSLATION_SUCCESS;
+}
+
+int translate_batch(struct translation_context &translation_ctx,
+		    const std::vector<translation_request> &requests,
+		    std::vector<std::string> &results)
+{
+	results.clear();
+	if (requests.empty()) {
+		return OBS_POLYGLOT_TRANSLATION_SUCCESS;
+	}
 	try {
-		std::vector<ctranslate2::TranslationResult> results;
-		std::vector<std::string> target_prefix;
-
-		if (translation_ctx.input_tokenization_style == INPUT_TOKENIZAION_M2M100) {
-			// set input tokens
-			std::vector<std::string> input_tokens = {source_lang, "<s>"};
-			if (translation_ctx.add_context > 0 &&
-			    translation_ctx.last_input_tokens.size() > 0) {
-				// add the last input tokens sentences to the input tokens
-				for (const auto &tokens : translation_ctx.last_input_tokens) {
-					input_tokens.insert(input_tokens.end(), tokens.begin(),
-							    tokens.end());
-				}
+		std::vector<std::vector<std::string>> batch;
+		std::vector<std::vector<std::string>> target_prefix_batch;
+		std::vector<std::vector<std::string>> new_input_tokens_batch;
+		batch.reserve(requests.size());
+		target_prefix_batch.reserve(requests.size());
+		new_input_tokens_batch.reserve(requests.size());
+
+		// all sentences of the batch get the context from before the batch, flattened once
+		std::vector<std::string> &context_input = translation_ctx.context_input_tokens;
+		std::vector<std::string> &context_translation =
+			translation_ctx.context_translation_tokens;
+		context_input.clear();
+		context_translation.clear();
+		if (translation_ctx.input_tokenization_style == INPUT_TOKENIZAION_M2M100 &&
+		    translation_ctx.add_context > 0) {
+			for (const auto &tokens : translation_ctx.last_input_tokens) {
+				context_input.insert(context_input.end(), tokens.begin(),
+						     tokens.end());
 			}
-			std::vector<std::string> new_input_tokens = translation_ctx.tokenizer(text);
-			input_tokens.insert(input_tokens.end(), new_input_tokens.begin(),
-					    new_input_tokens.end());
-			input_tokens.push_back("</s>");
-
-			// log the input tokens
-			std::string input_tokens_str;
-			for (const auto &token : input_tokens) {
-				input_tokens_str += token + ", ";
+			for (const auto &tokens : translation_ctx.last_translation_tokens) {
+				context_translation.insert(context_translation.end(),
+							   tokens.begin(), tokens.end());
 			}
-			obs_log(LOG_INFO, "Input tokens: %s", input_tokens_str.c_str());
+		}
 
-			translation_ctx.last_input_tokens.push_back(new_input_tokens);
-			// remove the oldest input tokens
-			while (translation_ctx.last_input_tokens.size() >
-			       (size_t)translation_ctx.add_context) {
-				translation_ctx.last_input_tokens.pop_front();
-			}
+		for (const auto &request : requests) {
+			if (translation_ctx.input_tokenization_style == INPUT_TOKENIZAION_M2M100) {
+				const bool with_context =
+					request.with_context && translation_ctx.add_context > 0;
+				std::vector<std::string> new_input_tokens;
+				translation_ctx.tokenizer(request.text, new_input_tokens);
 
-			const std::vector<std::vector<std::string>> batch = {input_tokens};
+				// set input tokens: language, context, sentence
+				std::vector<std::string> input_tokens;
+				input_tokens.reserve(3 + new_input_tokens.size() +
+						     (with_context ? context_input.size() : 0));
+				input_tokens.push_back(request.source_lang);
+				input_tokens.push_back("<s>");
+				if (with_context) {
+					input_tokens.insert(input_tokens.end(),
+							    context_input.begin(),
+							    context_input.end());
+				}
+				input_tokens.insert(input_tokens.end(), new_input_tokens.begin(),
+						    new_input_tokens.end());
+				input_tokens.push_back("</s>");
+				obs_log(LOG_INFO, "Input tokens: %s",
+					tokens_to_string(input_tokens).c_str());
 
-			// get target prefix
-			target_prefix = {target_lang};
-			// add the last translation tokens to the target prefix
-			if (translation_ctx.add_context > 0 &&
-			    translation_ctx.last_translation_tokens.size() > 0) {
-				for (const auto &tokens : translation_ctx.last_translation_tokens) {
-					target_prefix.insert(target_prefix.end(), tokens.begin(),
-							     tokens.end());
+				// get target prefix: language, translation of the context
+				std::vector<std::string> target_prefix;
+				target_prefix.reserve(1 + (with_context ? context_translation.size()
+									: 0));
+				target_prefix.push_back(request.target_lang);
+				if (with_context) {
+					target_prefix.insert(target_prefix.end(),
+							     context_translation.begin(),
+							     context_translation.end());
 				}
-			}
+				obs_log(LOG_INFO, "Target prefix: %s",
+					tokens_to_string(target_prefix).c_str());
 
-			// log the target prefix
-			std::string target_prefix_str;
-			for (const auto &token : target_prefix) {
-				target_prefix_str += token + ",";
+				batch.push_back(std::move(input_tokens));
+				target_prefix_batch.push_back(std::move(target_prefix));
+				new_input_tokens_batch.push_back(std::move(new_input_tokens));
+			} else {
+				// set input tokens
+				const std::string &target_lang =
+					language_codes_to_whisper[request.target_lang];
+				batch.emplace_back();
+				translation_ctx.tokenizer("<2" + target_lang + "> " + request.text,
+							  batch.back());
+				target_prefix_batch.emplace_back();
+				new_input_tokens_batch.emplace_back();
 			}
-			obs_log(LOG_INFO, "Target prefix: %s", target_prefix_str.c_str());
+		}
 
-			const std::vector<std::vector<std::string>> target_prefix_batch = {
-				target_prefix};
-			results = translation_ctx.translator->translate_batch(
-				batch, target_prefix_batch, *translation_ctx.options);
-		} else {
-			// set input tokens
-			std::vector<std::string> input_tokens = {};
-			std::vector<std::string> new_input_tokens = translation_ctx.tokenizer(
-				"<2" + language_codes_to_whisper[target_lang] + "> " + text);
-			input_tokens.insert(input_tokens.end(), new_input_tokens.begin(),
-					    new_input_tokens.end());
-			const std::vector<std::vector<std::string>> batch = {input_tokens};
-
-			results = translation_ctx.translator->translate_batch(
-				batch, {}, *translation_ctx.options);
+		// split the batch between the replicas
+		const size_t replicas = (size_t)std::max(1, translation_ctx.inter_threads);
+		const size_t max_batch_size =
+			replicas > 1 ? (batch.size() + replicas - 1) / replicas : 0;
+		const auto start_time = std::chrono::steady_clock::now();
+		const std::vector<ctranslate2::TranslationResult> translation_results =
+			translation_ctx.input_tokenization_style == INPUT_TOKENIZAION_M2M100
+				? translation_ctx.translator->translate_batch(
+					  batch, target_prefix_batch, *translation_ctx.options,
+					  max_batch_size)
+				: translation_ctx.translator->translate_batch(
+					  batch, {}, *translation_ctx.options, max_batch_size);
+		const uint64_t elapsed_ms =
+			(uint64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+				std::chrono::steady_clock::now() - start_time)
+				.count();
+		size_t output_tokens = 0;
+		for (size_t i = 0; i < translation_results.size(); i++) {
+			output_tokens += translation_results[i].output().size() -
+					 target_prefix_batch[i].size();
 		}
+		translation_ctx.translated_tokens += output_tokens;
+		translation_ctx.translation_time_ms += elapsed_ms;
+		obs_log(LOG_INFO,
+			"CT2 translated %d tokens in %d ms (%.1f tokens/s, average %.1f tokens/s, "
+			"compute type %s)",
+			(int)output_tokens, (int)elapsed_ms,
+			(double)output_tokens * 1000.0 / (double)std::max<uint64_t>(1, elapsed_ms),
+			(double)translation_ctx.translated_tokens * 1000.0 /
+				(double)std::max<uint64_t>(1, translation_ctx.translation_time_ms),
+			translation_ctx.compute_type.c_str());
 
-		const auto &tokens_result = results[0].output();
-		// take the tokens from the target_prefix length to the end
-		std::vector<std::string> translation_tokens(
-			tokens_result.begin() + target_prefix.size(), tokens_result.end());
+		for (size_t i = 0; i < requests.size(); i++) {
+			const auto &tokens_result = translation_results[i].output();
+			// take the tokens from the target_prefix length to the end
+			std::vector<std::string> translation_tokens(
+				tokens_result.begin() + target_prefix_batch[i].size(),
+				tokens_result.end());
+			obs_log(LOG_INFO, "Translation tokens: %s",
+				tokens_to_string(translation_tokens).c_str());
 
-		// log the translation tokens
-		std::string translation_tokens_str;
-		for (const auto &token : translation_tokens) {
-			translation_tokens_str += token + ", ";
-		}
-		obs_log(LOG_INFO, "Translation tokens: %s", translation_tokens_str.c_str());
+			// detokenize
+			const std::string result_ = translation_ctx.detokenizer(translation_tokens);
+			results.push_back(remove_start_punctuation(result_));
 
-		// save the translation tokens
-		translation_ctx.last_translation_tokens.push_back(translation_tokens);
-		// remove the oldest translation tokens
+			if (requests[i].partial || !requests[i].with_context ||
+			    translation_ctx.input_tokenization_style != INPUT_TOKENIZAION_M2M100) {
+				continue;
+			}
+			// save the input and translation tokens, partials are not context
+			translation_ctx.last_input_tokens.push_back(
+				std::move(new_input_tokens_batch[i]));
+			translation_ctx.last_translation_tokens.push_back(
+				std::move(translation_tokens));
+		}
+		// remove the oldest tokens
+		while (translation_ctx.last_input_tokens.size() >
+		       (size_t)translation_ctx.add_context) {
+			translation_ctx.last_input_tokens.pop_front();
+		}
 		while (translation_ctx.last_translation_tokens.size() >
 		       (size_t)translation_ctx.add_context) {
 			translation_ctx.last_translation_tokens.pop_front();
 		}
 		obs_log(LOG_INFO, "Last translation tokens deque size: %d",
 			(int)translation_ctx.last_translation_tokens.size());
-
-		// detokenize
-		const std::string result_ = translation_ctx.detokenizer(translation_tokens);
-		result = remove_start_punctuation(result_);
 	} catch (std::exception &e) {
 		obs_log(LOG_ERROR, "Error: %s", e.what());
+		results.clear();
 		return OBS_POLYGLOT_TRANSLATION_FAIL;
 	}
 	return OBS_POLYGLOT_TRANSLATION_SUCCESS;
@@ -1,6 +1,7 @@
 #ifndef TRANSLATION_H
 #define TRANSLATION_H
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <deque>
@@ -24,22 +25,61 @@ struct translation_context {
 	std::unique_ptr<sentencepiece::SentencePieceProcessor> target_processor;
 	std::unique_ptr<ctranslate2::Translator> translator;
 	std::unique_ptr<ctranslate2::TranslationOptions> options;
-	std::function<std::vector<std::string>(const std::string &)> tokenizer;
+	// tokenize into the vector, which is cleared first
+	std::function<void(const std::string &, std::vector<std::string> &)> tokenizer;
 	std::function<std::string(const std::vector<std::string> &)> detokenizer;
 	std::deque<std::vector<std::string>> last_input_tokens;
 	std::deque<std::vector<std::string>> last_translation_tokens;
+	// the context window flattened for the current batch, the buffers are kept between batches
+	std::vector<std::string> context_input_tokens;
+	std::vector<std::string> context_translation_tokens;
 	// How many sentences to use as context for the next translation
 	int add_context;
 	InputTokenizationStyle input_tokenization_style;
+	// CUDA device of the translator, -1 for CPU. CPU is also used when the device is missing
+	int device_index = 0;
+	// CTranslate2 compute type ("auto", "int8", "int8_float16", "float16", ...), auto is
+	// used when the device does not support it
+	std::string compute_type = "auto";
+	// model replicas translating in parallel, and threads of each replica (0: automatic)
+	int inter_threads = 1;
+	int intra_threads = 0;
+	// throughput since the model was loaded
+	uint64_t translated_tokens = 0;
+	uint64_t translation_time_ms = 0;
 };
 
+// number of CUDA devices CTranslate2 can use, 0 in builds without CUDA
+int get_translation_gpu_count();
+
 int build_translation_context(struct translation_context &translation_ctx);
 void build_and_enable_translation(struct transcription_filter_data *gf,
 				  const std::string &model_file_path);
 
+// Free the CT2 model of an idle filter, the context keeps what is needed to load it again
+void suspend_translation(struct transcription_filter_data *gf);
+// Load the CT2 model if the translation is enabled and the model is not loaded: released by
+// suspend_translation, or not loaded yet (see start_translation)
+void resume_translation(struct transcription_filter_data *gf);
+
 int translate(struct translation_context &translation_ctx, const std::string &text,
 	      const std::string &source_lang, const std::string &target_lang, std::string &result);
 
+struct translation_request {
+	std::string text;
+	std::string source_lang;
+	std::string target_lang;
+	// partial sentences are not used as context for the next translations
+	bool partial;
+	// the context window holds the sentences of the main target language only
+	bool with_context;
+};
+
+// translate all requests with one CTranslate2 batch, results are in the order of the requests
+int translate_batch(struct translation_context &translation_ctx,
+		    const std::vector<translation_request> &requests,
+		    std::vector<std::string> &results);
+
 #define OBS_POLYGLOT_TRANSLATION_INIT_FAIL -1
 #define OBS_POLYGLOT_TRANSLATION_INIT_SUCCESS 0
 #define OBS_POLYGLOT_TRANSLATION_SUCCESS 0
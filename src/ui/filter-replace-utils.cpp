@@ -1,6 +1,12 @@
 #include "filter-replace-utils.h"
+#include "plugin-support.h"
 
 #include <nlohmann/json.hpp>
+#include <obs-module.h>
+
+#include <algorithm>
+#include <cstring>
+#include <queue>
 
 std::string serialize_filter_words_replace(
 	const std::vector<std::tuple<std::string, std::string>> &filter_words_replace)
@@ -30,3 +36,245 @@ deserialize_filter_words_replace(const std::string &filter_words_replace_str)
 	}
 	return filter_words_replace;
 }
+
+static unsigned char fold_case(unsigned char c)
+{
+	return c >= 'A' && c <= 'Z' ? (unsigned char)(c - 'A' + 'a') : c;
+}
+
+// The words of a pattern made of plain words only: "word" or "(word|other word)". Returns
+// false for patterns that need the regex engine.
+static bool split_plain_words(const std::string &pattern, std::vector<std::string> &words)
+{
+	std::string body = pattern;
+	if (body.size() >= 2 && body.front() == '(' && body.back() == ')') {
+		body = body.substr(1, body.size() - 2);
+	}
+	if (body.empty() || body.find_first_of("\\^$.?*+()[]{}") != std::string::npos) {
+		return false;
+	}
+	words.clear();
+	size_t start = 0;
+	while (true) {
+		const size_t end = body.find('|', start);
+		const std::string word = body.substr(start, end - start);
+		if (word.empty()) {
+			return false;
+		}
+		words.push_back(word);
+		if (end == std::string::npos) {
+			return true;
+		}
+		start = end + 1;
+	}
+}
+
+// Whether the pattern refers back to one of its groups, with \1 to \9
+static bool has_backreference(const std::string &pattern)
+{
+	for (size_t i = 0; i + 1 < pattern.size(); i++) {
+		if (pattern[i] != '\\') {
+			continue;
+		}
+		if (pattern[i + 1] >= '1' && pattern[i + 1] <= '9') {
+			return true;
+		}
+		// skip the escaped character, "\\1" is a backslash and a 1
+		i++;
+	}
+	return false;
+}
+
+WordFilter::WordFilter(const std::vector<std::tuple<std::string, std::string>> &filters)
+	: nodes(1)
+{
+	std::string combined_pattern;
+	size_t group = 1;
+	std::vector<std::string> words;
+	for (const auto &filter : filters) {
+		const std::string &pattern = std::get<0>(filter);
+		const std::string &replacement = std::get<1>(filter);
+		if (pattern.empty()) {
+			continue;
+		}
+		const int entry = (int)replacements.size();
+		// replacements with $ references need the match of the regex
+		if (replacement.find('$') == std::string::npos &&
+		    split_plain_words(pattern, words)) {
+			replacements.push_back(replacement);
+			for (const auto &word : words) {
+				add_word(word, entry);
+			}
+			continue;
+		}
+		std::regex regex;
+		try {
+			regex = std::regex(pattern, std::regex_constants::icase);
+		} catch (const std::regex_error &e) {
+			obs_log(LOG_WARNING, "Skipping invalid filter pattern '%s': %s",
+				pattern.c_str(), e.what());
+			continue;
+		}
+		replacements.push_back(replacement);
+		regex_entries.push_back(entry);
+		if (has_backreference(pattern)) {
+			// its group numbers would change in the combined regex
+			regex_groups.push_back(0);
+			regexes.push_back(std::move(regex));
+			continue;
+		}
+		if (!combined_pattern.empty()) {
+			combined_pattern += "|";
+		}
+		combined_pattern += "(" + pattern + ")";
+		regex_groups.push_back(group);
+		group += 1 + regex.mark_count();
+		regexes.push_back(std::move(regex));
+	}
+	build_links();
+	if (!combined_pattern.empty()) {
+		combined = std::regex(combined_pattern, std::regex_constants::icase);
+		combined_used = true;
+	}
+}
+
+void WordFilter::add_word(const std::string &word, int entry)
+{
+	int node = 0;
+	for (const char c : word) {
+		const unsigned char key = fold_case((unsigned char)c);
+		auto it = nodes[node].next.find(key);
+		if (it == nodes[node].next.end()) {
+			nodes.emplace_back();
+			nodes.back().depth = nodes[node].depth + 1;
+			it = nodes[node].next.emplace(key, (int)nodes.size() - 1).first;
+		}
+		node = it->second;
+	}
+	// the first entry of a word wins
+	if (nodes[node].entry < 0) {
+		nodes[node].entry = entry;
+	}
+}
+
+void WordFilter::build_links()
+{
+	// breadth first, so the fail node of a node is done before it
+	std::queue<int> queue;
+	for (const auto &child : nodes[0].next) {
+		queue.push(child.second);
+	}
+	while (!queue.empty()) {
+		const int node = queue.front();
+		queue.pop();
+		for (const auto &child : nodes[node].next) {
+			int fail = nodes[node].fail;
+			while (fail != 0 && nodes[fail].next.count(child.first) == 0) {
+				fail = nodes[fail].fail;
+			}
+			auto it = nodes[fail].next.find(child.first);
+			const int child_fail = it != nodes[fail].next.end() ? it->second : 0;
+			nodes[child.second].fail = child_fail;
+			nodes[child.second].output = nodes[child_fail].entry >= 0
+							     ? child_fail
+							     : nodes[child_fail].output;
+			queue.push(child.second);
+		}
+	}
+}
+
+std::string WordFilter::apply(const std::string &text) const
+{
+	struct Match {
+		size_t start;
+		size_t end;
+		int entry;
+		// index in regexes, -1 for a word
+		int regex;
+	};
+	std::vector<Match> matches;
+
+	int state = 0;
+	for (size_t i = 0; i < text.size(); i++) {
+		const unsigned char key = fold_case((unsigned char)text[i]);
+		while (state != 0 && nodes[state].next.count(key) == 0) {
+			state = nodes[state].fail;
+		}
+		auto it = nodes[state].next.find(key);
+		state = it != nodes[state].next.end() ? it->second : 0;
+		for (int node = nodes[state].entry >= 0 ? state : nodes[state].output; node != 0;
+		     node = nodes[node].output) {
+			const size_t start = i + 1 - nodes[node].depth;
+			matches.push_back({start, i + 1, nodes[node].entry, -1});
+		}
+	}
+
+	if (combined_used) {
+		for (auto it = std::sregex_iterator(text.begin(), text.end(), combined);
+		     it != std::sregex_iterator(); ++it) {
+			const std::smatch &match = *it;
+			if (match.length() == 0) {
+				continue;
+			}
+			for (size_t k = 0; k < regexes.size(); k++) {
+				if (regex_groups[k] != 0 && match[regex_groups[k]].matched) {
+					const size_t start = (size_t)match.position();
+					matches.push_back({start, start + (size_t)match.length(),
+							   regex_entries[k], (int)k});
+					break;
+				}
+			}
+		}
+	}
+	for (size_t k = 0; k < regexes.size(); k++) {
+		if (regex_groups[k] != 0) {
+			continue;
+		}
+		for (auto it = std::sregex_iterator(text.begin(), text.end(), regexes[k]);
+		     it != std::sregex_iterator(); ++it) {
+			const std::smatch &match = *it;
+			if (match.length() == 0) {
+				continue;
+			}
+			const size_t start = (size_t)match.position();
+			matches.push_back(
+				{start, start + (size_t)match.length(), regex_entries[k], (int)k});
+		}
+	}
+
+	if (matches.empty()) {
+		return text;
+	}
+	std::sort(matches.begin(), matches.end(), [](const Match &a, const Match &b) {
+		if (a.start != b.start) {
+			return a.start < b.start;
+		}
+		if (a.end != b.end) {
+			return a.end > b.end;
+		}
+		return a.entry < b.entry;
+	});
+
+	std::string result;
+	result.reserve(text.size());
+	size_t copied = 0;
+	for (const Match &match : matches) {
+		if (match.start < copied) {
+			// overlaps the previous match
+			continue;
+		}
+		result.append(text, copied, match.start - copied);
+		if (match.regex < 0) {
+			result += replacements[match.entry];
+		} else {
+			const std::string matched =
+				text.substr(match.start, match.end - match.start);
+			result += std::regex_replace(matched, regexes[match.regex],
+						     replacements[match.entry],
+						     std::regex_constants::format_first_only);
+		}
+		copied = match.end;
+	}
+	result.append(text, copied, std::string::npos);
+	return result;
+}
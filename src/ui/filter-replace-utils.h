@@ -1,7 +1,10 @@
 #ifndef FILTER_REPLACE_UTILS_H
 #define FILTER_REPLACE_UTILS_H
 
+#include <regex>
 #include <string>
+#include <tuple>
+#include <unordered_map>
 #include <vector>
 
 std::string serialize_filter_words_replace(
@@ -9,4 +12,48 @@ std::string serialize_filter_words_replace(
 std::vector<std::tuple<std::string, std::string>>
 deserialize_filter_words_replace(const std::string &filter_words_replace_str);
 
+/**
+ * @brief The filter words list compiled to be applied with a single pass over a sentence.
+ *
+ * Entries that are a plain word, or an alternation of plain words like "(word|other word)",
+ * are matched together by an Aho-Corasick automaton (ASCII case-insensitive). The other
+ * entries are combined into one case-insensitive regex, except the ones with backreferences
+ * (\1 to \9), whose groups would be renumbered there: they are matched with their own regex.
+ * The matches of all of them are applied from left to right, the longest one first when
+ * matches start at the same position, and the replacements are not matched again.
+ */
+class WordFilter {
+public:
+	explicit WordFilter(const std::vector<std::tuple<std::string, std::string>> &filters);
+
+	bool empty() const { return nodes.size() == 1 && regexes.empty(); }
+	std::string apply(const std::string &text) const;
+
+private:
+	struct Node {
+		std::unordered_map<unsigned char, int> next;
+		int fail = 0;
+		// nearest node on the fail chain that ends a word, 0 for none
+		int output = 0;
+		// entry of the word ending here, -1 for none
+		int entry = -1;
+		size_t depth = 0;
+	};
+
+	void add_word(const std::string &word, int entry);
+	void build_links();
+
+	// the automaton, node 0 is the root
+	std::vector<Node> nodes;
+	// the replacement of each entry
+	std::vector<std::string> replacements;
+	std::regex combined;
+	bool combined_used = false;
+	// each regex entry alone, its entry and its group in the combined regex, 0 for the entries
+	// matched alone
+	std::vector<std::regex> regexes;
+	std::vector<int> regex_entries;
+	std::vector<size_t> regex_groups;
+};
+
 #endif /* FILTER_REPLACE_UTILS_H */
@@ -0,0 +1,93 @@
+#include "metrics-dock.h"
+#include "filter-metrics.h"
+#include "plugin-support.h"
+
+#include <obs-module.h>
+#include <obs-frontend-api.h>
+
+#include <QHeaderView>
+#include <QStringList>
+#include <QVBoxLayout>
+
+namespace {
+
+const char *const columns[] = {"Filter",           "Buffer (ms)",  "Dropped (ms)",
+			       "Segments",         "VAD (ms/win)", "VAD gated (%)",
+			       "Whisper (ms)",     "Whisper RTF",  "Translation (ms)",
+			       "Cloud (ms)",       "Cloud errors", "Latency (ms)",
+			       "Max latency (ms)"};
+const int column_count = (int)(sizeof(columns) / sizeof(columns[0]));
+
+QString number(double value, int precision = 1)
+{
+	return QString::number(value, 'f', precision);
+}
+
+} // namespace
+
+MetricsDock::MetricsDock(QWidget *parent)
+	: QWidget(parent),
+	  table(new QTableWidget(0, column_count, this)),
+	  timer(new QTimer(this))
+{
+	QStringList headers;
+	for (const char *column : columns) {
+		headers << QString(column);
+	}
+	table->setHorizontalHeaderLabels(headers);
+	table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+	table->setSelectionMode(QAbstractItemView::NoSelection);
+	table->verticalHeader()->setVisible(false);
+	table->horizontalHeader()->setSectionResizeMode(QHeaderView::ResizeToContents);
+
+	QVBoxLayout *layout = new QVBoxLayout(this);
+	layout->setContentsMargins(0, 0, 0, 0);
+	layout->addWidget(table);
+
+	connect(timer, &QTimer::timeout, this, &MetricsDock::refresh);
+	timer->start(1000);
+}
+
+void MetricsDock::refresh()
+{
+	if (!isVisible()) {
+		return;
+	}
+	const nlohmann::json filters = filter_metrics_snapshot()["filters"];
+	table->setRowCount((int)filters.size());
+	for (int row = 0; row < (int)filters.size(); row++) {
+		const nlohmann::json &filter = filters[row];
+		const QString cells[] = {
+			QString::fromStdString(filter["filter"].get<std::string>()),
+			number(filter["input_buffer_ms"].get<double>(), 0),
+			number(filter["dropped_ms"].get<double>(), 0),
+			QString::number(filter["segment_queue_length"].get<uint64_t>()),
+			number(filter["vad"]["ms_per_window"].get<double>(), 3),
+			number(filter["vad"]["gated_ratio"].get<double>() * 100.0, 0),
+			number(filter["whisper_full"]["last_ms"].get<double>(), 0),
+			number(filter["whisper_rtf"].get<double>(), 3),
+			number(filter["translation"]["last_ms"].get<double>(), 0),
+			number(filter["cloud_request"]["last_ms"].get<double>(), 0),
+			QString::number(filter["cloud_errors"].get<uint64_t>()),
+			QString::number(filter["caption_latency"]["last_ms"].get<uint64_t>()),
+			QString::number(filter["caption_latency"]["max_ms"].get<uint64_t>())};
+		for (int column = 0; column < column_count; column++) {
+			QTableWidgetItem *item = table->item(row, column);
+			if (item == nullptr) {
+				item = new QTableWidgetItem();
+				table->setItem(row, column, item);
+			}
+			item->setText(cells[column]);
+		}
+	}
+}
+
+extern "C" void init_metrics_dock(void)
+{
+	MetricsDock *dock = new MetricsDock((QWidget *)obs_frontend_get_main_window());
+	if (!obs_frontend_add_dock_by_id("localvocal-metrics", obs_module_text("LocalVocalMetrics"),
+					 dock)) {
+		obs_log(LOG_WARNING, "Cannot add the LocalVocal metrics dock");
+		delete dock;
+	}
+}
@@ -0,0 +1,23 @@
+#ifndef METRICSDOCK_H
+#define METRICSDOCK_H
+
+#include <QTableWidget>
+#include <QTimer>
+#include <QWidget>
+
+// Table of the live metrics of the filters, one row per filter, refreshed every second
+class MetricsDock : public QWidget {
+	Q_OBJECT
+
+public:
+	explicit MetricsDock(QWidget *parent = nullptr);
+
+private:
+	QTableWidget *table;
+	QTimer *timer;
+
+private slots:
+	void refresh();
+};
+
+#endif // METRICSDOCK_H
@@ -0,0 +1,89 @@
+/**
+ * @file webvtt-cue-queue.h
+ * @brief Lock-free handoff of the WebVTT cues to the encoder packet callback.
+ *
+ * The cues are produced by the whisper and translation threads and consumed by the packet
+ * callback of the output, which runs on the encoder thread and must not wait for them. The
+ * producers push to a lock-free stack; the consumer takes the whole stack with one exchange. The
+ * consumed cues are handed back through a second stack and freed by the next producer, so the
+ * consumer neither locks nor allocates nor frees.
+ */
+#ifndef WEBVTT_CUE_QUEUE_H
+#define WEBVTT_CUE_QUEUE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+struct webvtt_cue {
+	uint8_t track;
+	// relative to the start of the output
+	uint64_t start_ms;
+	uint64_t duration_ms;
+	std::string text;
+	webvtt_cue *next = nullptr;
+};
+
+class WebvttCueQueue {
+public:
+	WebvttCueQueue() = default;
+	WebvttCueQueue(const WebvttCueQueue &) = delete;
+	WebvttCueQueue &operator=(const WebvttCueQueue &) = delete;
+	~WebvttCueQueue()
+	{
+		free_list(pending.exchange(nullptr));
+		free_list(consumed.exchange(nullptr));
+	}
+
+	// Queue a cue, from any thread
+	void push(uint8_t track, uint64_t start_ms, uint64_t duration_ms, const std::string &text)
+	{
+		free_list(consumed.exchange(nullptr, std::memory_order_acquire));
+		webvtt_cue *cue = new webvtt_cue{track, start_ms, duration_ms, text};
+		cue->next = pending.load(std::memory_order_relaxed);
+		while (!pending.compare_exchange_weak(cue->next, cue, std::memory_order_release,
+						      std::memory_order_relaxed)) {
+		}
+	}
+
+	// Call f on each queued cue in the order they were pushed, from the consumer thread only
+	template<typename F> void consume(F &&f)
+	{
+		webvtt_cue *head = pending.exchange(nullptr, std::memory_order_acquire);
+		if (head == nullptr) {
+			return;
+		}
+		// the stack is in the reverse order of the pushes
+		webvtt_cue *ordered = nullptr;
+		webvtt_cue *tail = head;
+		while (head != nullptr) {
+			webvtt_cue *next = head->next;
+			head->next = ordered;
+			ordered = head;
+			head = next;
+		}
+		for (webvtt_cue *cue = ordered; cue != nullptr; cue = cue->next) {
+			f(*cue);
+		}
+		tail->next = consumed.load(std::memory_order_relaxed);
+		while (!consumed.compare_exchange_weak(tail->next, ordered,
+						       std::memory_order_release,
+						       std::memory_order_relaxed)) {
+		}
+	}
+
+private:
+	static void free_list(webvtt_cue *cue)
+	{
+		while (cue != nullptr) {
+			webvtt_cue *next = cue->next;
+			delete cue;
+			cue = next;
+		}
+	}
+
+	std::atomic<webvtt_cue *> pending{nullptr};
+	std::atomic<webvtt_cue *> consumed{nullptr};
+};
+
+#endif // WEBVTT_CUE_QUEUE_H
@@ -0,0 +1,176 @@
+#include "audio-decimator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AUDIO_DECIMATOR_SSE2
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define AUDIO_DECIMATOR_NEON
+#include <arm_neon.h>
+#endif
+
+// SIMD width in floats, the tap count is padded to a multiple of it
+#define AUDIO_DECIMATOR_LANES 4
+// filter length per unit of decimation ratio, with Blackman 32 gives about 75 dB of attenuation
+// above the output rate minus the cutoff, the band that aliases into the kept one
+#define AUDIO_DECIMATOR_TAPS_PER_RATIO 32
+// low-pass cutoff as a fraction of the output Nyquist frequency
+#define AUDIO_DECIMATOR_CUTOFF 0.9
+#define AUDIO_DECIMATOR_MAX_RATIO 12
+
+static void downmix(const float *const *input, size_t channels, size_t frames, float *output)
+{
+	const float gain = 1.0f / (float)channels;
+	size_t i = 0;
+#if defined(AUDIO_DECIMATOR_SSE2)
+	const __m128 gain4 = _mm_set1_ps(gain);
+	for (; i + 4 <= frames; i += 4) {
+		__m128 sum = _mm_loadu_ps(input[0] + i);
+		for (size_t c = 1; c < channels; c++) {
+			sum = _mm_add_ps(sum, _mm_loadu_ps(input[c] + i));
+		}
+		_mm_storeu_ps(output + i, _mm_mul_ps(sum, gain4));
+	}
+#elif defined(AUDIO_DECIMATOR_NEON)
+	for (; i + 4 <= frames; i += 4) {
+		float32x4_t sum = vld1q_f32(input[0] + i);
+		for (size_t c = 1; c < channels; c++) {
+			sum = vaddq_f32(sum, vld1q_f32(input[c] + i));
+		}
+		vst1q_f32(output + i, vmulq_n_f32(sum, gain));
+	}
+#endif
+	for (; i < frames; i++) {
+		float sum = input[0][i];
+		for (size_t c = 1; c < channels; c++) {
+			sum += input[c][i];
+		}
+		output[i] = sum * gain;
+	}
+}
+
+// n is a multiple of AUDIO_DECIMATOR_LANES
+static float dot(const float *a, const float *b, size_t n)
+{
+#if defined(AUDIO_DECIMATOR_SSE2)
+	__m128 acc = _mm_setzero_ps();
+	for (size_t i = 0; i < n; i += 4) {
+		acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+	}
+	// horizontal sum
+	__m128 shuf = _mm_shuffle_ps(acc, acc, _MM_SHUFFLE(2, 3, 0, 1));
+	__m128 sums = _mm_add_ps(acc, shuf);
+	shuf = _mm_movehl_ps(shuf, sums);
+	sums = _mm_add_ss(sums, shuf);
+	return _mm_cvtss_f32(sums);
+#elif defined(AUDIO_DECIMATOR_NEON)
+	float32x4_t acc = vdupq_n_f32(0.0f);
+	for (size_t i = 0; i < n; i += 4) {
+		acc = vmlaq_f32(acc, vld1q_f32(a + i), vld1q_f32(b + i));
+	}
+	return vaddvq_f32(acc);
+#else
+	float acc[AUDIO_DECIMATOR_LANES] = {0};
+	for (size_t i = 0; i < n; i += AUDIO_DECIMATOR_LANES) {
+		for (size_t l = 0; l < AUDIO_DECIMATOR_LANES; l++) {
+			acc[l] += a[i + l] * b[i + l];
+		}
+	}
+	return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+#endif
+}
+
+bool AudioDecimator::init(size_t channels_, int input_rate, int output_rate,
+			  size_t max_input_frames)
+{
+	release();
+
+	if (channels_ == 0 || input_rate <= 0 || output_rate <= 0 ||
+	    input_rate % output_rate != 0 ||
+	    input_rate / output_rate > AUDIO_DECIMATOR_MAX_RATIO) {
+		return false;
+	}
+
+	channels = channels_;
+	ratio = (size_t)(input_rate / output_rate);
+	taps = ratio == 1 ? 1 : AUDIO_DECIMATOR_TAPS_PER_RATIO * ratio + 1;
+	padded_taps = (taps + AUDIO_DECIMATOR_LANES - 1) / AUDIO_DECIMATOR_LANES *
+		      AUDIO_DECIMATOR_LANES;
+
+	// Blackman windowed sinc low-pass, normalized to unity gain at DC
+	std::vector<double> h(taps, 1.0);
+	if (taps > 1) {
+		const double pi = 3.14159265358979323846;
+		const double fc = AUDIO_DECIMATOR_CUTOFF * 0.5 / (double)ratio;
+		const double center = (double)(taps - 1) / 2.0;
+		double sum = 0.0;
+		for (size_t k = 0; k < taps; k++) {
+			const double x = (double)k - center;
+			const double sinc = x == 0.0 ? 2.0 * fc
+						     : std::sin(2.0 * pi * fc * x) / (pi * x);
+			const double w = 0.42 -
+					 0.5 * std::cos(2.0 * pi * (double)k / (double)(taps - 1)) +
+					 0.08 * std::cos(4.0 * pi * (double)k / (double)(taps - 1));
+			h[k] = sinc * w;
+			sum += h[k];
+		}
+		for (size_t k = 0; k < taps; k++) {
+			h[k] /= sum;
+		}
+	}
+	// reversed, so an output is the dot product with the samples in time order
+	coefficients.assign(padded_taps, 0.0f);
+	for (size_t k = 0; k < taps; k++) {
+		coefficients[padded_taps - 1 - k] = (float)h[k];
+	}
+
+	line.assign(padded_taps - 1 + max_input_frames, 0.0f);
+	next_output = padded_taps - 1;
+	return true;
+}
+
+void AudioDecimator::release()
+{
+	channels = ratio = taps = padded_taps = 0;
+	std::vector<float>().swap(coefficients);
+	std::vector<float>().swap(line);
+	next_output = 0;
+}
+
+void AudioDecimator::reset()
+{
+	if (!active()) {
+		return;
+	}
+	std::fill(line.begin(), line.begin() + (padded_taps - 1), 0.0f);
+	next_output = padded_taps - 1;
+}
+
+size_t AudioDecimator::process(const float *const *input, size_t frames, float *output)
+{
+	if (!active() || frames == 0) {
+		return 0;
+	}
+
+	const size_t history = padded_taps - 1;
+	if (line.size() < history + frames) {
+		// larger block than announced in init()
+		line.resize(history + frames);
+	}
+	downmix(input, channels, frames, line.data() + history);
+
+	const size_t total = history + frames;
+	size_t n_out = 0;
+	for (; next_output < total; next_output += ratio) {
+		output[n_out++] =
+			dot(coefficients.data(), line.data() + next_output - history, padded_taps);
+	}
+
+	// keep the last samples as history for the next block
+	memmove(line.data(), line.data() + frames, history * sizeof(float));
+	next_output -= frames;
+	return n_out;
+}
@@ -0,0 +1,88 @@
+#ifndef AUDIO_DECIMATOR_H
+#define AUDIO_DECIMATOR_H
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * @file audio-decimator.h
+ * @brief Fused downmix and integer-ratio decimation to the whisper sample rate.
+ *
+ * Used instead of the libobs resampler when the input rate is an integer multiple of the
+ * output rate (48 kHz, 32 kHz, 96 kHz... to 16 kHz). The planar input channels are averaged
+ * to mono and low-pass filtered with a windowed-sinc FIR that is only evaluated at the kept
+ * output positions (polyphase decimation). The inner loops use SSE2 on x86-64 and NEON on
+ * ARM64, with a scalar fallback.
+ */
+
+class AudioDecimator {
+public:
+	AudioDecimator() = default;
+
+	/**
+	 * @brief Set up the decimator.
+	 *
+	 * @param channels Number of planar input channels.
+	 * @param input_rate Input sample rate.
+	 * @param output_rate Output sample rate, input_rate must be a multiple of it.
+	 * @param max_input_frames Largest block passed to process(), to allocate upfront.
+	 * @return true if the rates are supported, false otherwise (use the regular resampler).
+	 */
+	bool init(size_t channels, int input_rate, int output_rate, size_t max_input_frames);
+
+	/**
+	 * @brief Free the buffers, the decimator is inactive afterwards.
+	 */
+	void release();
+
+	/**
+	 * @brief Whether init() succeeded.
+	 */
+	bool active() const { return ratio > 0; }
+
+	/**
+	 * @brief Maximal number of output frames process() produces for a block.
+	 */
+	size_t max_output_frames(size_t input_frames) const { return input_frames / ratio + 1; }
+
+	/**
+	 * @brief Filter delay in input frames.
+	 */
+	size_t delay_frames() const { return (taps - 1) / 2; }
+
+	/**
+	 * @brief Position, in the next block, of the input frame aligned with the next output.
+	 *
+	 * The output represents the input delay_frames() before that position.
+	 */
+	size_t next_output_offset() const { return next_output - (padded_taps - 1); }
+
+	/**
+	 * @brief Downmix and decimate one block. The filter state carries over between blocks.
+	 *
+	 * @param input Planar input channels.
+	 * @param frames Number of input frames.
+	 * @param output Destination with room for max_output_frames(frames) samples.
+	 * @return Number of output frames written.
+	 */
+	size_t process(const float *const *input, size_t frames, float *output);
+
+	/**
+	 * @brief Forget the filter state, e.g. after the input was cleared.
+	 */
+	void reset();
+
+private:
+	size_t channels = 0;
+	size_t ratio = 0;
+	size_t taps = 0;
+	// taps rounded up to the SIMD width, coefficients in reverse order, zeros first
+	size_t padded_taps = 0;
+	std::vector<float> coefficients;
+	// downmixed samples: the last padded_taps - 1 samples of the previous block, then the block
+	std::vector<float> line;
+	// position in line of the next output sample
+	size_t next_output = 0;
+};
+
+#endif // AUDIO_DECIMATOR_H
@@ -0,0 +1,191 @@
+#include "audio-ring-buffer.h"
+
+#include <util/bmem.h>
+
+#include <algorithm>
+#include <cstring>
+
+// minimal number of frames per info slot, OBS packets are typically 480-1024 frames
+#define AUDIO_RING_BUFFER_FRAMES_PER_INFO 256
+#define AUDIO_RING_BUFFER_MIN_INFOS 256
+
+static size_t next_power_of_two(size_t v)
+{
+	size_t p = 1;
+	while (p < v) {
+		p <<= 1;
+	}
+	return p;
+}
+
+AudioRingBuffer::AudioRingBuffer() noexcept
+	: storage(nullptr),
+	  channels(0),
+	  frame_capacity(0),
+	  frame_mask(0),
+	  infos(nullptr),
+	  info_capacity(0),
+	  info_mask(0),
+	  frame_write_pos(0),
+	  info_write_pos(0),
+	  dropped_frames_(0),
+	  frame_read_pos(0),
+	  info_read_pos(0)
+{
+	for (size_t c = 0; c < AUDIO_RING_BUFFER_MAX_CHANNELS; c++) {
+		planes[c] = nullptr;
+	}
+}
+
+AudioRingBuffer::~AudioRingBuffer()
+{
+	release();
+}
+
+bool AudioRingBuffer::init(size_t channels_, size_t capacity_frames)
+{
+	release();
+
+	if (channels_ == 0 || channels_ > AUDIO_RING_BUFFER_MAX_CHANNELS || capacity_frames == 0) {
+		return false;
+	}
+
+	// a power of two capacity (>= 16 floats) keeps each plane a multiple of the cache line
+	frame_capacity = next_power_of_two(
+		std::max<size_t>(capacity_frames, AUDIO_RING_BUFFER_CACHE_LINE / sizeof(float)));
+	frame_mask = frame_capacity - 1;
+	info_capacity = next_power_of_two(std::max<size_t>(
+		frame_capacity / AUDIO_RING_BUFFER_FRAMES_PER_INFO, AUDIO_RING_BUFFER_MIN_INFOS));
+	info_mask = info_capacity - 1;
+
+	const size_t planes_size = channels_ * frame_capacity * sizeof(float);
+	const size_t infos_size = info_capacity * sizeof(transcription_filter_audio_info);
+	storage = bzalloc(planes_size + infos_size + AUDIO_RING_BUFFER_CACHE_LINE);
+	if (storage == nullptr) {
+		frame_capacity = frame_mask = info_capacity = info_mask = 0;
+		return false;
+	}
+
+	// align the first plane to a cache line, the rest follow at cache line multiples
+	uintptr_t aligned = (reinterpret_cast<uintptr_t>(storage) + AUDIO_RING_BUFFER_CACHE_LINE -
+			     1) &
+			    ~(uintptr_t)(AUDIO_RING_BUFFER_CACHE_LINE - 1);
+	float *base = reinterpret_cast<float *>(aligned);
+	for (size_t c = 0; c < channels_; c++) {
+		planes[c] = base + c * frame_capacity;
+	}
+	infos = reinterpret_cast<transcription_filter_audio_info *>(base +
+								     channels_ * frame_capacity);
+	channels = channels_;
+
+	frame_write_pos.store(0, std::memory_order_relaxed);
+	info_write_pos.store(0, std::memory_order_relaxed);
+	frame_read_pos.store(0, std::memory_order_relaxed);
+	info_read_pos.store(0, std::memory_order_relaxed);
+	dropped_frames_.store(0, std::memory_order_relaxed);
+	return true;
+}
+
+void AudioRingBuffer::release()
+{
+	if (storage != nullptr) {
+		bfree(storage);
+		storage = nullptr;
+	}
+	for (size_t c = 0; c < AUDIO_RING_BUFFER_MAX_CHANNELS; c++) {
+		planes[c] = nullptr;
+	}
+	infos = nullptr;
+	channels = 0;
+	frame_capacity = frame_mask = info_capacity = info_mask = 0;
+	frame_write_pos.store(0, std::memory_order_relaxed);
+	info_write_pos.store(0, std::memory_order_relaxed);
+	frame_read_pos.store(0, std::memory_order_relaxed);
+	info_read_pos.store(0, std::memory_order_relaxed);
+}
+
+bool AudioRingBuffer::push(const float *const *data, uint32_t frames,
+			   uint64_t timestamp_offset_ns)
+{
+	if (storage == nullptr || frames == 0) {
+		return false;
+	}
+
+	const size_t w = frame_write_pos.load(std::memory_order_relaxed);
+	const size_t r = frame_read_pos.load(std::memory_order_acquire);
+	const size_t iw = info_write_pos.load(std::memory_order_relaxed);
+	const size_t ir = info_read_pos.load(std::memory_order_acquire);
+
+	if (frames > frame_capacity - (w - r) || iw - ir >= info_capacity) {
+		// overflow: drop the incoming packet, keep what the consumer already has
+		dropped_frames_.fetch_add(frames, std::memory_order_relaxed);
+		return false;
+	}
+
+	const size_t start = w & frame_mask;
+	const size_t first = std::min<size_t>(frames, frame_capacity - start);
+	for (size_t c = 0; c < channels; c++) {
+		memcpy(planes[c] + start, data[c], first * sizeof(float));
+		if (first < frames) {
+			memcpy(planes[c], data[c] + first, (frames - first) * sizeof(float));
+		}
+	}
+	infos[iw & info_mask] = {frames, timestamp_offset_ns};
+
+	// publish the samples before the info, the consumer is driven by the info index
+	frame_write_pos.store(w + frames, std::memory_order_release);
+	info_write_pos.store(iw + 1, std::memory_order_release);
+	return true;
+}
+
+size_t AudioRingBuffer::frames_available() const
+{
+	return frame_write_pos.load(std::memory_order_acquire) -
+	       frame_read_pos.load(std::memory_order_relaxed);
+}
+
+bool AudioRingBuffer::peek_info(transcription_filter_audio_info &info) const
+{
+	const size_t ir = info_read_pos.load(std::memory_order_relaxed);
+	if (ir == info_write_pos.load(std::memory_order_acquire)) {
+		return false;
+	}
+	info = infos[ir & info_mask];
+	return true;
+}
+
+void AudioRingBuffer::copy_out(float **dst, size_t dst_offset, size_t read_pos, size_t frames)
+{
+	const size_t start = read_pos & frame_mask;
+	const size_t first = std::min<size_t>(frames, frame_capacity - start);
+	for (size_t c = 0; c < channels; c++) {
+		memcpy(dst[c] + dst_offset, planes[c] + start, first * sizeof(float));
+		if (first < frames) {
+			memcpy(dst[c] + dst_offset + first, planes[c],
+			       (frames - first) * sizeof(float));
+		}
+	}
+}
+
+uint32_t AudioRingBuffer::pop_packet(float **dst, size_t dst_offset)
+{
+	const size_t ir = info_read_pos.load(std::memory_order_relaxed);
+	if (ir == info_write_pos.load(std::memory_order_acquire)) {
+		return 0;
+	}
+	const transcription_filter_audio_info info = infos[ir & info_mask];
+	const size_t r = frame_read_pos.load(std::memory_order_relaxed);
+	if (dst != nullptr) {
+		copy_out(dst, dst_offset, r, info.frames);
+	}
+	// free the samples before the info slot, mirroring the producer publish order
+	frame_read_pos.store(r + info.frames, std::memory_order_release);
+	info_read_pos.store(ir + 1, std::memory_order_release);
+	return info.frames;
+}
+
+void AudioRingBuffer::clear()
+{
+	while (pop_packet(nullptr, 0) > 0) {
+	}
+}
@@ -0,0 +1,130 @@
+#ifndef AUDIO_RING_BUFFER_H
+#define AUDIO_RING_BUFFER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @file audio-ring-buffer.h
+ * @brief Wait-free single-producer/single-consumer ring buffer for incoming audio.
+ *
+ * The producer is the OBS audio thread (filter_audio), the consumer is the whisper thread.
+ * Neither side takes a lock, so the OBS audio callback never blocks on transcription.
+ */
+
+#define AUDIO_RING_BUFFER_CACHE_LINE 64
+#define AUDIO_RING_BUFFER_MAX_CHANNELS 10
+
+// Audio packet info
+struct transcription_filter_audio_info {
+	uint32_t frames;
+	uint64_t timestamp_offset_ns; // offset (since start of processing) timestamp in ns
+};
+
+/**
+ * @class AudioRingBuffer
+ * @brief Bounded planar float ring buffer with a parallel ring of packet infos.
+ *
+ * Capacities are rounded up to a power of two. Each channel plane starts on a cache line and
+ * the producer and consumer indices live on separate cache lines to avoid false sharing.
+ *
+ * Overflow policy: when a packet does not fit (either samples or info slots), the whole packet
+ * is dropped and counted in dropped_frames(). Already buffered audio is never overwritten, so
+ * the data the consumer is reading stays consistent and the producer stays wait-free.
+ */
+class AudioRingBuffer {
+public:
+	AudioRingBuffer() noexcept;
+	~AudioRingBuffer();
+
+	AudioRingBuffer(const AudioRingBuffer &) = delete;
+	AudioRingBuffer &operator=(const AudioRingBuffer &) = delete;
+
+	/**
+	 * @brief Allocate the buffer. Not thread safe, call before producer and consumer start.
+	 *
+	 * @param channels Number of planar channels.
+	 * @param capacity_frames Minimal number of frames (per channel) the buffer can hold.
+	 * @return true on success, false if the allocation failed.
+	 */
+	bool init(size_t channels, size_t capacity_frames);
+
+	/**
+	 * @brief Release the buffer memory. Not thread safe, call after both sides stopped.
+	 */
+	void release();
+
+	// Producer side
+
+	/**
+	 * @brief Push one audio packet. Wait-free, never blocks.
+	 *
+	 * @param data Planar channel pointers, one per channel passed to init().
+	 * @param frames Number of frames in the packet.
+	 * @param timestamp_offset_ns Packet timestamp offset in ns.
+	 * @return true if the packet was stored, false if it was dropped due to overflow.
+	 */
+	bool push(const float *const *data, uint32_t frames, uint64_t timestamp_offset_ns);
+
+	// Consumer side
+
+	/**
+	 * @brief Number of frames currently readable by the consumer.
+	 */
+	size_t frames_available() const;
+
+	/**
+	 * @brief Look at the oldest packet info without removing it.
+	 *
+	 * @return true if an info was available.
+	 */
+	bool peek_info(transcription_filter_audio_info &info) const;
+
+	/**
+	 * @brief Remove the oldest packet info and copy its frames to the planar destination.
+	 *
+	 * @param dst Planar destination buffers, one per channel, each large enough for the
+	 * packet frames. Can be nullptr to discard the packet.
+	 * @param dst_offset Frame offset inside the destination buffers.
+	 * @return Number of frames popped, 0 if no packet was available.
+	 */
+	uint32_t pop_packet(float **dst, size_t dst_offset);
+
+	/**
+	 * @brief Discard everything currently in the buffer. Must be called by the consumer.
+	 */
+	void clear();
+
+	/**
+	 * @brief Total number of frames dropped because the buffer was full.
+	 */
+	uint64_t dropped_frames() const { return dropped_frames_.load(std::memory_order_relaxed); }
+
+	size_t capacity_frames() const { return frame_capacity; }
+	size_t num_channels() const { return channels; }
+
+private:
+	void copy_out(float **dst, size_t dst_offset, size_t read_pos, size_t frames);
+
+	// immutable after init()
+	float *planes[AUDIO_RING_BUFFER_MAX_CHANNELS];
+	void *storage;
+	size_t channels;
+	size_t frame_capacity;
+	size_t frame_mask;
+	transcription_filter_audio_info *infos;
+	size_t info_capacity;
+	size_t info_mask;
+
+	// producer owned, each group on its own cache line
+	alignas(AUDIO_RING_BUFFER_CACHE_LINE) std::atomic<size_t> frame_write_pos;
+	std::atomic<size_t> info_write_pos;
+	std::atomic<uint64_t> dropped_frames_;
+
+	// consumer owned
+	alignas(AUDIO_RING_BUFFER_CACHE_LINE) std::atomic<size_t> frame_read_pos;
+	std::atomic<size_t> info_read_pos;
+};
+
+#endif // AUDIO_RING_BUFFER_H
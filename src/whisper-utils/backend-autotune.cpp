@@ -0,0 +1,567 @@
+#include "backend-autotune.h"
+#include "backend-devices.h"
+#include "whisper-processing.h"
+#include "plugin-support.h"
+#include "transcription-filter-data.h"
+#include "transcription-utils.h"
+#include "model-utils/model-downloader.h"
+#include "model-utils/model-quantize.h"
+
+#include <obs-module.h>
+#include <nlohmann/json.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+const double PI = 3.14159265358979323846;
+
+struct autotune_candidate {
+	int quantization;
+	std::string model_file;
+	// -1 for the CPU
+	int backend_device;
+	bool flash_attn;
+	int n_threads;
+};
+
+struct autotune_measure {
+	bool ok = false;
+	double rtf = 0.0;
+	int64_t first_token_ms = 0;
+};
+
+struct autotune_job {
+	obs_weak_source_t *filter;
+	autotune_request request;
+};
+
+// settings of a filter changed by a result, applied on the UI thread
+struct autotune_update {
+	obs_weak_source_t *filter;
+	obs_data_t *changes;
+};
+
+// the filter of an automatic job, it is measured while the filter has no speech
+enum filter_activity { FILTER_GONE, FILTER_SPEECH, FILTER_IDLE };
+
+// time of the first decoded token of a run
+struct first_token_probe {
+	std::chrono::steady_clock::time_point start;
+	int64_t first_token_ms;
+};
+
+std::mutex job_mutex;
+std::condition_variable job_cv;
+std::thread worker_thread;
+bool worker_stop = false;
+std::deque<autotune_job> jobs;
+// aborts the running decode on shutdown
+std::atomic<bool> abort_run{false};
+
+int64_t elapsed_ms(std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration_cast<std::chrono::milliseconds>(
+		       std::chrono::steady_clock::now() - start)
+		.count();
+}
+
+// The results are only valid for the backends, the cores and the GPUs they were measured with
+std::string machine_signature()
+{
+	std::string signature = std::string(PLUGIN_VERSION) +
+				"|cores=" + std::to_string(std::thread::hardware_concurrency());
+	for (const gpu_device_info &device : backend_gpu_devices()) {
+		signature.append("|").append(device.device_name).append(" - ");
+		signature.append(device.device_description);
+	}
+	return signature;
+}
+
+std::filesystem::path cache_path()
+{
+	char *config_file = obs_module_config_path("autotune.json");
+	if (config_file == nullptr) {
+		return {};
+	}
+	return obs_config_stdfs_path(config_file);
+}
+
+// The cached results of the models, empty if they were measured on another machine
+nlohmann::json read_cache()
+{
+	std::ifstream file(cache_path());
+	nlohmann::json cache = nlohmann::json::parse(file, nullptr, false);
+	if (!cache.is_object() || cache.value("machine", "") != machine_signature() ||
+	    !cache.contains("models") || !cache["models"].is_object()) {
+		return nlohmann::json::object();
+	}
+	return cache["models"];
+}
+
+void write_cache(const nlohmann::json &models)
+{
+	const std::filesystem::path path = cache_path();
+	if (path.empty()) {
+		return;
+	}
+	const std::filesystem::path tmp_path = path.string() + ".tmp";
+	std::error_code ec;
+	std::filesystem::create_directories(path.parent_path(), ec);
+	{
+		const nlohmann::json cache = {{"machine", machine_signature()}, {"models", models}};
+		std::ofstream file(tmp_path, std::ios::trunc);
+		file << cache.dump(1);
+		if (!file) {
+			obs_log(LOG_WARNING, "Autotune: cannot write %s",
+				tmp_path.string().c_str());
+			return;
+		}
+	}
+	std::filesystem::rename(tmp_path, path, ec);
+	if (ec) {
+		obs_log(LOG_WARNING, "Autotune: cannot write %s: %s", path.string().c_str(),
+			ec.message().c_str());
+	}
+}
+
+// A speech-like clip: a voiced source with a moving pitch, shaped by the formants of a vowel
+// that changes at the syllable rate, with a pause every two seconds. Silence or a tone would
+// let the decoder stop after the first token.
+std::vector<float> benchmark_clip()
+{
+	// first two formants of a, e, i, o, u
+	const double formants[5][2] = {
+		{730, 1090}, {530, 1840}, {270, 2290}, {570, 840}, {300, 870}};
+	const double syllable_rate = 4.0;
+	std::vector<float> clip((size_t)AUTOTUNE_CLIP_SECONDS * WHISPER_SAMPLE_RATE);
+	double phase = 0.0;
+	float peak = 0.0f;
+	for (size_t i = 0; i < clip.size(); i++) {
+		const double t = (double)i / WHISPER_SAMPLE_RATE;
+		const int syllable = (int)(t * syllable_rate);
+		const double in_syllable = t * syllable_rate - syllable;
+		const double f0 = 110.0 + 20.0 * sin(PI * t) + 15.0 * in_syllable;
+		phase += 2.0 * PI * f0 / WHISPER_SAMPLE_RATE;
+		const double *formant = formants[syllable % 5];
+		double sample = 0.0;
+		for (int h = 1; h * f0 < 4000.0; h++) {
+			double gain = 0.0;
+			for (int k = 0; k < 2; k++) {
+				const double distance = (h * f0 - formant[k]) / 100.0;
+				gain += 1.0 / (1.0 + distance * distance);
+			}
+			sample += gain / h * sin(h * phase);
+		}
+		const bool pause = fmod(t, 2.0) >= 1.5;
+		clip[i] = pause ? 0.0f : (float)(sin(PI * in_syllable) * sample);
+		peak = std::max(peak, std::fabs(clip[i]));
+	}
+	for (float &sample : clip) {
+		sample *= 0.5f / std::max(peak, 1e-6f);
+	}
+	return clip;
+}
+
+std::vector<autotune_candidate> list_candidates(const autotune_request &request)
+{
+	const int cores = std::max(1, (int)std::thread::hardware_concurrency());
+	std::vector<int> cpu_threads;
+	for (int threads : {2, 4, 8}) {
+		if (threads <= cores) {
+			cpu_threads.push_back(threads);
+		}
+	}
+	if (cpu_threads.empty()) {
+		cpu_threads.push_back(cores);
+	}
+	// the GPU backends only use the CPU threads for the few operations they don't have
+	const int gpu_threads = std::min(4, cores);
+
+	std::vector<autotune_candidate> candidates;
+	for (const auto &model_file : request.model_files) {
+		for (int threads : cpu_threads) {
+			candidates.push_back(
+				{model_file.first, model_file.second, -1, false, threads});
+		}
+		for (size_t i = 0; i < backend_gpu_devices().size(); i++) {
+			for (bool flash_attn : {false, true}) {
+				candidates.push_back({model_file.first, model_file.second, (int)i,
+						      flash_attn, gpu_threads});
+			}
+		}
+	}
+	return candidates;
+}
+
+std::string describe(const autotune_candidate &candidate)
+{
+	std::string description =
+		candidate.backend_device < 0
+			? "CPU"
+			: std::string("GPU ") +
+				  backend_gpu_devices().at(candidate.backend_device).device_name;
+	description += ", " + std::to_string(candidate.n_threads) + " threads";
+	if (candidate.flash_attn) {
+		description += ", flash attention";
+	}
+	if (candidate.quantization != MODEL_QUANTIZATION_NONE) {
+		description += ", " + model_quantization_suffix(candidate.quantization);
+	}
+	return description;
+}
+
+autotune_measure measure_candidate(const autotune_candidate &candidate,
+				   const std::vector<float> &clip)
+{
+	autotune_measure measure;
+	struct whisper_context_params cparams = whisper_context_default_params();
+	cparams.use_gpu = candidate.backend_device >= 0;
+	cparams.gpu_device = std::max(candidate.backend_device, 0);
+	cparams.flash_attn = candidate.flash_attn;
+	struct whisper_context *ctx = load_whisper_model_file(candidate.model_file, cparams);
+	if (ctx == nullptr) {
+		return measure;
+	}
+	struct whisper_state *state = whisper_init_state(ctx);
+	if (state == nullptr) {
+		obs_log(LOG_ERROR, "Autotune: failed to create the whisper state");
+		whisper_free(ctx);
+		return measure;
+	}
+
+	first_token_probe probe;
+	whisper_full_params params = whisper_full_default_params(WHISPER_SAMPLING_GREEDY);
+	params.n_threads = candidate.n_threads;
+	// the language detection would add a decode of its own
+	params.language = "en";
+	params.detect_language = false;
+	params.no_context = true;
+	params.single_segment = true;
+	params.max_tokens = AUTOTUNE_MAX_TOKENS;
+	params.print_progress = false;
+	params.print_realtime = false;
+	params.print_special = false;
+	params.print_timestamps = false;
+	params.logits_filter_callback = [](struct whisper_context *, struct whisper_state *,
+					   const whisper_token_data *, int, float *,
+					   void *user_data) {
+		first_token_probe *first_token = static_cast<first_token_probe *>(user_data);
+		if (first_token->first_token_ms < 0) {
+			first_token->first_token_ms = elapsed_ms(first_token->start);
+		}
+	};
+	params.logits_filter_callback_user_data = &probe;
+	params.abort_callback = [](void *) { return abort_run.load(); };
+	params.abort_callback_user_data = nullptr;
+
+	measure.ok = true;
+	measure.rtf = std::numeric_limits<double>::max();
+	measure.first_token_ms = std::numeric_limits<int64_t>::max();
+	// the first run compiles the kernels and allocates the buffers, it is not measured
+	for (int run = 0; measure.ok && run <= AUTOTUNE_RUNS; run++) {
+		probe.start = std::chrono::steady_clock::now();
+		probe.first_token_ms = -1;
+		try {
+			measure.ok = whisper_full_with_state(ctx, state, params, clip.data(),
+							     (int)clip.size()) == 0;
+		} catch (const std::exception &e) {
+			obs_log(LOG_WARNING, "Autotune: exception during the benchmark: %s",
+				e.what());
+			measure.ok = false;
+		}
+		const int64_t duration_ms = elapsed_ms(probe.start);
+		const int64_t first_token_ms =
+			probe.first_token_ms < 0 ? duration_ms : probe.first_token_ms;
+		if (measure.ok && run > 0) {
+			const double rtf = (double)duration_ms / (AUTOTUNE_CLIP_SECONDS * 1000.0);
+			measure.rtf = std::min(measure.rtf, rtf);
+			measure.first_token_ms = std::min(measure.first_token_ms, first_token_ms);
+		}
+	}
+	whisper_free_state(state);
+	whisper_free(ctx);
+	return measure;
+}
+
+// The least quantized model meeting the real-time target with its fastest configuration, or
+// the fastest configuration when none meets it
+int choose_candidate(const std::vector<autotune_candidate> &candidates,
+		     const std::vector<autotune_measure> &measures)
+{
+	int chosen = -1;
+	for (int i = 0; i < (int)candidates.size(); i++) {
+		if (!measures[i].ok) {
+			continue;
+		}
+		if (chosen < 0) {
+			chosen = i;
+			continue;
+		}
+		const bool realtime = measures[i].rtf <= AUTOTUNE_RTF_TARGET;
+		const bool chosen_realtime = measures[chosen].rtf <= AUTOTUNE_RTF_TARGET;
+		if (realtime != chosen_realtime) {
+			chosen = realtime ? i : chosen;
+		} else if (realtime &&
+			   candidates[i].quantization != candidates[chosen].quantization) {
+			chosen = candidates[i].quantization < candidates[chosen].quantization
+					 ? i
+					 : chosen;
+		} else if (measures[i].rtf < measures[chosen].rtf) {
+			chosen = i;
+		}
+	}
+	return chosen;
+}
+
+// Whether the filter had no speech for AUTOTUNE_IDLE_SECONDS, with the time of its last speech
+filter_activity get_filter_activity(obs_weak_source_t *filter, uint64_t &last_speech_ms)
+{
+	obs_source_t *source = obs_weak_source_get_source(filter);
+	if (source == nullptr) {
+		return FILTER_GONE;
+	}
+	const transcription_filter_data *gf =
+		static_cast<const transcription_filter_data *>(obs_obj_get_data(source));
+	filter_activity activity = FILTER_GONE;
+	if (gf != nullptr) {
+		last_speech_ms = gf->last_speech_ms;
+		// a suspended filter has released its model
+		const bool idle = gf->idle_suspended ||
+				  now_ms() - last_speech_ms >= AUTOTUNE_IDLE_SECONDS * 1000;
+		activity = idle ? FILTER_IDLE : FILTER_SPEECH;
+	}
+	obs_source_release(source);
+	return activity;
+}
+
+// Wait until the filter is idle, false when it is gone or on shutdown
+bool wait_for_idle_filter(obs_weak_source_t *filter, uint64_t &last_speech_ms)
+{
+	while (!abort_run) {
+		const filter_activity activity = get_filter_activity(filter, last_speech_ms);
+		if (activity != FILTER_SPEECH) {
+			return activity == FILTER_IDLE;
+		}
+		std::unique_lock<std::mutex> lock(job_mutex);
+		job_cv.wait_for(lock, std::chrono::seconds(1), [] { return worker_stop; });
+	}
+	return false;
+}
+
+// Measure the configurations of the request, returns the result to cache or null
+nlohmann::json run_benchmark(const autotune_job &job)
+{
+	const autotune_request &request = job.request;
+	const std::vector<autotune_candidate> candidates = list_candidates(request);
+	obs_log(LOG_INFO, "Autotune: measuring %d configurations of %s", (int)candidates.size(),
+		request.model_key.c_str());
+	const std::vector<float> clip = benchmark_clip();
+	std::vector<autotune_measure> measures;
+	nlohmann::json measured = nlohmann::json::array();
+	for (const autotune_candidate &candidate : candidates) {
+		if (abort_run) {
+			return nullptr;
+		}
+		autotune_measure measure;
+		if (request.force) {
+			measure = measure_candidate(candidate, clip);
+		} else {
+			// the automatic runs share the device with the filter: each configuration is
+			// measured again when speech came during its runs, AUTOTUNE_IDLE_TRIES times
+			for (int attempt = 0; attempt < AUTOTUNE_IDLE_TRIES; attempt++) {
+				uint64_t idle_since_ms = 0;
+				if (!wait_for_idle_filter(job.filter, idle_since_ms)) {
+					return nullptr;
+				}
+				measure = measure_candidate(candidate, clip);
+				uint64_t last_speech_ms = 0;
+				if (get_filter_activity(job.filter, last_speech_ms) == FILTER_GONE) {
+					return nullptr;
+				}
+				if (last_speech_ms == idle_since_ms) {
+					break;
+				}
+				measure.ok = false;
+			}
+		}
+		measures.push_back(measure);
+		if (!measure.ok) {
+			obs_log(LOG_WARNING, "Autotune: %s failed", describe(candidate).c_str());
+			continue;
+		}
+		obs_log(LOG_INFO, "Autotune: %s: RTF %.3f, first token %lld ms",
+			describe(candidate).c_str(), measure.rtf,
+			(long long)measure.first_token_ms);
+		measured.push_back({{"config", describe(candidate)},
+				    {"rtf", measure.rtf},
+				    {"first_token_ms", measure.first_token_ms}});
+	}
+	if (abort_run) {
+		return nullptr;
+	}
+	const int chosen = choose_candidate(candidates, measures);
+	if (chosen < 0) {
+		obs_log(LOG_ERROR, "Autotune: no configuration of %s could be measured",
+			request.model_key.c_str());
+		return nullptr;
+	}
+	const autotune_candidate &candidate = candidates[chosen];
+	const autotune_measure &measure = measures[chosen];
+	const bool realtime = measure.rtf <= AUTOTUNE_RTF_TARGET;
+	obs_log(realtime ? LOG_INFO : LOG_WARNING, "Autotune: %s: %s, RTF %.3f%s",
+		request.model_key.c_str(), describe(candidate).c_str(), measure.rtf,
+		realtime ? "" : ", slower than the real-time target");
+	return {{"backend_device", candidate.backend_device},
+		{"enable_flash_attn", candidate.flash_attn},
+		{"n_threads", candidate.n_threads},
+		{"whisper_model_quantization", candidate.quantization},
+		{"rtf", measure.rtf},
+		{"first_token_ms", measure.first_token_ms},
+		{"realtime", realtime},
+		{"measured", measured}};
+}
+
+void apply_update_task(void *param)
+{
+	autotune_update *update = static_cast<autotune_update *>(param);
+	obs_source_t *source = obs_weak_source_get_source(update->filter);
+	if (source != nullptr) {
+		obs_log(LOG_INFO, "Autotune: applying the configuration to %s",
+			obs_source_get_name(source));
+		obs_source_update(source, update->changes);
+		obs_source_release(source);
+	}
+	obs_data_release(update->changes);
+	obs_weak_source_release(update->filter);
+	delete update;
+}
+
+// Update the settings of the filter that differ from the result, on the UI thread as the
+// changes of the properties
+void apply_result(obs_weak_source_t *filter, const nlohmann::json &result,
+		  bool set_quantization)
+{
+	obs_source_t *source = obs_weak_source_get_source(filter);
+	if (source == nullptr) {
+		return;
+	}
+	obs_data_t *settings = obs_source_get_settings(source);
+	obs_data_t *changes = obs_data_create();
+	bool changed = false;
+	const auto set_int = [&](const char *key) {
+		const long long value = result.value(key, (long long)0);
+		if (obs_data_get_int(settings, key) != value) {
+			obs_data_set_int(changes, key, value);
+			changed = true;
+		}
+	};
+	set_int("backend_device");
+	set_int("n_threads");
+	if (set_quantization) {
+		set_int("whisper_model_quantization");
+	}
+	const bool flash_attn = result.value("enable_flash_attn", false);
+	if (obs_data_get_bool(settings, "enable_flash_attn") != flash_attn) {
+		obs_data_set_bool(changes, "enable_flash_attn", flash_attn);
+		changed = true;
+	}
+	obs_data_release(settings);
+	obs_source_release(source);
+	if (!changed) {
+		obs_data_release(changes);
+		return;
+	}
+	obs_weak_source_addref(filter);
+	obs_queue_task(OBS_TASK_UI, apply_update_task, new autotune_update{filter, changes},
+		       false);
+}
+
+void run_job(const autotune_job &job)
+{
+	nlohmann::json models = read_cache();
+	const std::string &key = job.request.model_key;
+	if (job.request.force || !models.contains(key) || !models[key].is_object()) {
+		nlohmann::json result = run_benchmark(job);
+		if (result.is_null()) {
+			return;
+		}
+		// the cache may have changed while measuring, only this model is replaced
+		models = read_cache();
+		models[key] = result;
+		write_cache(models);
+	}
+	apply_result(job.filter, models[key], job.request.set_quantization);
+}
+
+void worker_loop()
+{
+	std::unique_lock<std::mutex> lock(job_mutex);
+	while (true) {
+		job_cv.wait(lock, [] { return worker_stop || !jobs.empty(); });
+		if (worker_stop) {
+			break;
+		}
+		const autotune_job job = jobs.front();
+		jobs.pop_front();
+		lock.unlock();
+		run_job(job);
+		obs_weak_source_release(job.filter);
+		lock.lock();
+	}
+}
+
+} // namespace
+
+void queue_backend_autotune(obs_source_t *filter, const autotune_request &request)
+{
+	if (filter == nullptr || request.model_key.empty() || request.model_files.empty()) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(job_mutex);
+		if (!worker_thread.joinable()) {
+			worker_stop = false;
+			abort_run = false;
+			worker_thread = std::thread(worker_loop);
+		}
+		for (auto it = jobs.begin(); it != jobs.end();) {
+			if (obs_weak_source_references_source(it->filter, filter)) {
+				obs_weak_source_release(it->filter);
+				it = jobs.erase(it);
+			} else {
+				++it;
+			}
+		}
+		jobs.push_back({obs_source_get_weak_source(filter), request});
+	}
+	job_cv.notify_all();
+}
+
+void shutdown_backend_autotune(void)
+{
+	{
+		std::lock_guard<std::mutex> lock(job_mutex);
+		worker_stop = true;
+		for (const autotune_job &job : jobs) {
+			obs_weak_source_release(job.filter);
+		}
+		jobs.clear();
+	}
+	abort_run = true;
+	job_cv.notify_all();
+	if (worker_thread.joinable()) {
+		worker_thread.join();
+	}
+}
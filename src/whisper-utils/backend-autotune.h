@@ -0,0 +1,81 @@
+/**
+ * @file backend-autotune.h
+ * @brief Benchmark of the backend configurations of a model, cached per machine and model.
+ *
+ * The autotune decodes a built-in speech-like clip of AUTOTUNE_CLIP_SECONDS with each
+ * configuration that applies on the machine: the CPU with 2, 4 or 8 threads, each GPU device of
+ * the backends with and without flash attention, and the quantized local copies of the model.
+ * Each configuration loads its own model and is measured after a first run, which compiles the
+ * kernels, by its real-time factor (decode time / clip duration) and the latency of its first
+ * token. The least quantized model meeting AUTOTUNE_RTF_TARGET is applied with its fastest
+ * configuration, or the fastest configuration of all when none meets the target.
+ *
+ * The results are kept in autotune.json in the plugin config folder, by model. They are dropped
+ * when the plugin version, the core count or the GPU devices change. With CoreML the encoder
+ * model is used by every configuration when it is next to the model, it is not a configuration
+ * of its own. The benchmarks run one at a time on a background thread.
+ *
+ * The automatic run after a model load shares the devices with the live decoding: each
+ * configuration is only measured once the filter had no speech for AUTOTUNE_IDLE_SECONDS, and
+ * measured again when speech came during its runs. The run from the properties button measures
+ * right away. The result is applied to the filter settings on the UI thread.
+ */
+#ifndef BACKEND_AUTOTUNE_H
+#define BACKEND_AUTOTUNE_H
+
+#ifdef __cplusplus
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <obs.h>
+
+// duration of the benchmark clip
+#define AUTOTUNE_CLIP_SECONDS 10
+// real-time factor a configuration must reach, the live segments leave room for the partials
+#define AUTOTUNE_RTF_TARGET 0.5
+// measured runs of a configuration, after the first one
+#define AUTOTUNE_RUNS 2
+// tokens decoded from the clip in a run
+#define AUTOTUNE_MAX_TOKENS 32
+// silence of the filter before an automatic run measures a configuration
+#define AUTOTUNE_IDLE_SECONDS 10
+// measures of a configuration of an automatic run, until one has no speech during its runs
+#define AUTOTUNE_IDLE_TRIES 3
+
+struct autotune_request {
+	// the model selection the result is cached for, the model name or the external file
+	std::string model_key;
+	// the model files to compare, with their ModelQuantization
+	std::vector<std::pair<int, std::string>> model_files;
+	// whether the quantization setting is applied, false for an external model
+	bool set_quantization = false;
+	// measure again when there is a cached result, right away without waiting for the filter
+	// to be idle
+	bool force = false;
+};
+
+/**
+ * @brief Apply the cached result of the model to the filter, or measure the configurations
+ * first. Starts the worker thread on first use.
+ *
+ * A request replaces the one of the filter still waiting. The filter settings are updated on
+ * the UI thread, if the filter still exists.
+ */
+void queue_backend_autotune(obs_source_t *filter, const autotune_request &request);
+
+extern "C" {
+#endif
+
+/**
+ * @brief Abort the running benchmark, drop the queued ones and stop the worker thread.
+ *
+ * Called on module unload.
+ */
+void shutdown_backend_autotune(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BACKEND_AUTOTUNE_H
@@ -0,0 +1,108 @@
+#include "backend-cache.h"
+#include "plugin-support.h"
+#include "model-utils/model-downloader.h"
+#include "model-utils/model-index.h"
+#include "model-utils/sha256.h"
+
+#include <obs-module.h>
+
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <system_error>
+
+namespace {
+
+std::mutex cache_mutex;
+// folder of the current backend version, empty if the cache could not be set up
+std::filesystem::path cache_root;
+
+// sha256 of a downloaded or known model, a hash of the path, size and modification time of
+// other files
+std::string model_cache_key(const std::string &model_file, int gpu_device)
+{
+	const std::filesystem::path path = std::filesystem::u8path(model_file);
+	const std::string file_name = path.filename().u8string();
+	std::string hash = model_index_get_sha256(path.string());
+	for (const auto &model_info : models_info()) {
+		for (const auto &file : model_info.second.files) {
+			if (hash.empty() && !file.sha256.empty() &&
+			    get_filename_from_url(file.url) == file_name) {
+				hash = file.sha256;
+			}
+		}
+	}
+	if (hash.empty()) {
+		std::error_code ec;
+		const auto size = std::filesystem::file_size(path, ec);
+		const auto mtime = std::filesystem::last_write_time(path, ec);
+		hash = SHA256()(model_file + "|" + std::to_string(size) + "|" +
+				std::to_string(mtime.time_since_epoch().count()));
+	}
+	return hash.substr(0, 16) + "-" +
+	       (gpu_device < 0 ? std::string("cpu") : "gpu" + std::to_string(gpu_device));
+}
+
+} // namespace
+
+void init_backend_cache(void)
+{
+	char *config_folder = obs_module_config_path("backend-cache");
+	if (config_folder == nullptr) {
+		obs_log(LOG_WARNING, "Backend cache: config folder not set");
+		return;
+	}
+	const std::filesystem::path base = obs_config_stdfs_path(config_folder);
+	// the backends ship with the plugin, so its version is the backend version
+	const std::filesystem::path root = base / PLUGIN_VERSION;
+
+	std::error_code ec;
+	std::filesystem::create_directories(root / "models", ec);
+	if (ec) {
+		obs_log(LOG_WARNING, "Backend cache: cannot create the cache folder: %s",
+			ec.message().c_str());
+		return;
+	}
+	// caches of other versions are stale
+	for (const auto &entry : std::filesystem::directory_iterator(base, ec)) {
+		if (entry.is_directory() && entry.path().filename() != root.filename()) {
+			obs_log(LOG_INFO, "Backend cache: removing stale cache %s",
+				entry.path().filename().u8string().c_str());
+			std::filesystem::remove_all(entry.path(), ec);
+		}
+	}
+
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	cache_root = root;
+	obs_log(LOG_INFO, "Backend cache: %s", root.u8string().c_str());
+}
+
+bool backend_cache_is_warm(const std::string &model_file, int gpu_device)
+{
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	if (cache_root.empty()) {
+		return false;
+	}
+	std::error_code ec;
+	return std::filesystem::exists(
+		cache_root / "models" / model_cache_key(model_file, gpu_device), ec);
+}
+
+std::string backend_cache_file(const std::string &name)
+{
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	if (cache_root.empty()) {
+		return "";
+	}
+	return (cache_root / name).u8string();
+}
+
+void backend_cache_mark_warm(const std::string &model_file, int gpu_device)
+{
+	std::lock_guard<std::mutex> lock(cache_mutex);
+	if (cache_root.empty()) {
+		return;
+	}
+	std::ofstream stamp(cache_root / "models" / model_cache_key(model_file, gpu_device));
+	stamp << model_file << "\n";
+}
@@ -0,0 +1,53 @@
+/**
+ * @file backend-cache.h
+ * @brief On-disk cache of the whisper backends: the warm-up records and the optimized models.
+ *
+ * The cache is a LocalVocal owned folder in the plugin config folder, one per plugin (and so
+ * backend) version, so a new version starts from a clean cache and old versions are removed. It
+ * records which model (by sha256) was initialized on which device: the first load of a model on
+ * a device compiles the kernels the drivers cache, and is always followed by a warm-up inference
+ * so their cache is complete for the next start. The driver caches themselves (CUDA JIT, Vulkan
+ * and OpenGL shaders) stay where the drivers and the user put them: they are shared with the
+ * other applications of the process, OBS included.
+ */
+#ifndef BACKEND_CACHE_H
+#define BACKEND_CACHE_H
+
+#ifdef __cplusplus
+#include <string>
+
+/**
+ * @brief Whether the model was already initialized on the device with this backend version.
+ *
+ * @param model_file Path to the model file.
+ * @param gpu_device GPU device index, -1 for CPU.
+ */
+bool backend_cache_is_warm(const std::string &model_file, int gpu_device);
+
+/**
+ * @brief Record that the model was initialized (and warmed up) on the device.
+ */
+void backend_cache_mark_warm(const std::string &model_file, int gpu_device);
+
+/**
+ * @brief Path of a file in the cache folder, e.g. an optimized model.
+ *
+ * @return The UTF-8 path, empty if the cache is not set up.
+ */
+std::string backend_cache_file(const std::string &name);
+
+extern "C" {
+#endif
+
+/**
+ * @brief Set up the cache folder.
+ *
+ * Must be called on module load, before any backend is initialized.
+ */
+void init_backend_cache(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BACKEND_CACHE_H
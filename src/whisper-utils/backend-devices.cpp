@@ -0,0 +1,75 @@
+#include "backend-devices.h"
+#include "plugin-support.h"
+
+#include <obs-module.h>
+#include <ggml-backend.h>
+
+#include <filesystem>
+
+namespace {
+
+std::vector<gpu_device_info> load_backend_devices()
+{
+#ifdef WHISPER_DYNAMIC_BACKENDS
+	// Load CPU backends
+	auto path = std::filesystem::path(obs_get_module_binary_path(obs_current_module()))
+			    .parent_path();
+#if !defined(_WIN32) && defined(__linux__)
+	// Linux has modules in a subdirectory, Windows does not
+	path /= "obs-localvocal";
+#elif !defined(_WIN32)
+	// MacOS is just weird
+	path = path.parent_path() / "Frameworks";
+#endif
+
+	obs_log(LOG_INFO, "Loading dynamic backends from %s", path.string().c_str());
+	ggml_backend_load_all_from_path(path.string().c_str());
+#endif
+
+	// Enumerate backend devices to populate list
+	std::vector<gpu_device_info> devices;
+	auto backend_count = ggml_backend_dev_count();
+	for (size_t i = 0; i < backend_count; i++) {
+		auto backend_dev = ggml_backend_dev_get(i);
+		auto name = ggml_backend_dev_name(backend_dev);
+		auto desc = ggml_backend_dev_description(backend_dev);
+		auto type = "UNKNOWN";
+		bool add_device_to_config = false;
+		switch (ggml_backend_dev_type(backend_dev)) {
+		case GGML_BACKEND_DEVICE_TYPE_CPU:
+			type = "CPU";
+			break;
+		case GGML_BACKEND_DEVICE_TYPE_GPU:
+			type = "GPU";
+			add_device_to_config = true;
+			break;
+		case GGML_BACKEND_DEVICE_TYPE_ACCEL:
+			type = "ACCEL";
+			break;
+		case GGML_BACKEND_DEVICE_TYPE_IGPU:
+			type = "IGPU";
+			add_device_to_config = true;
+			break;
+		};
+		if (add_device_to_config) {
+			gpu_device_info device;
+			device.device_index = i;
+			device.device_name = name;
+			device.device_description = desc;
+			device.integrated = ggml_backend_dev_type(backend_dev) ==
+					    GGML_BACKEND_DEVICE_TYPE_IGPU;
+			devices.push_back(device);
+		}
+		obs_log(LOG_INFO, "Backend device %d (%s): %s - %s", (int)i, type, name, desc);
+	};
+	return devices;
+}
+
+} // namespace
+
+const std::vector<gpu_device_info> &backend_gpu_devices()
+{
+	// the names and descriptions belong to the backends, which stay loaded
+	static const std::vector<gpu_device_info> devices = load_backend_devices();
+	return devices;
+}
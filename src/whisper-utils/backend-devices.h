@@ -0,0 +1,34 @@
+/**
+ * @file backend-devices.h
+ * @brief Process-wide table of the GPU devices of the ggml backends.
+ *
+ * The dynamic backends (WHISPER_DYNAMIC_BACKENDS) are loaded and the backend devices enumerated
+ * once per OBS session, on first use, so a scene collection with many filters does not load the
+ * backends again for each of them. The table does not change afterwards, the filters and the
+ * properties read it without locking.
+ */
+#ifndef BACKEND_DEVICES_H
+#define BACKEND_DEVICES_H
+
+#include <cstddef>
+#include <vector>
+
+struct gpu_device_info {
+	size_t device_index;
+	const char *device_name;
+	const char *device_description;
+	// integrated GPUs report the shared system memory as free memory
+	bool integrated;
+};
+
+// gpu_device value: place the model on the GPU with the most free memory when it's loaded
+#define GPU_DEVICE_AUTO -2
+
+/**
+ * @brief The GPU devices of the backends, the index in the table is the whisper gpu_device.
+ *
+ * The first call loads the backends, it must happen before the first whisper model is loaded.
+ */
+const std::vector<gpu_device_info> &backend_gpu_devices();
+
+#endif // BACKEND_DEVICES_H
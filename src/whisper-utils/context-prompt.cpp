@@ -0,0 +1,50 @@
+#include "context-prompt.h"
+
+#include <algorithm>
+
+void ContextPrompt::set_max_tokens(int max_tokens)
+{
+	max_tokens_.store(std::clamp(max_tokens, 0, WHISPER_MAX_PROMPT_TOKENS),
+			  std::memory_order_relaxed);
+}
+
+void ContextPrompt::apply_clear()
+{
+	if (clear_requested.exchange(false, std::memory_order_relaxed)) {
+		prompt.clear();
+	}
+}
+
+void ContextPrompt::push(const std::vector<whisper_token_data> &segment_tokens, int n_vocab)
+{
+	apply_clear();
+	const size_t max_tokens = (size_t)max_tokens_.load(std::memory_order_relaxed);
+	if (max_tokens == 0) {
+		prompt.clear();
+		return;
+	}
+	if (n_vocab != prompt_n_vocab) {
+		prompt.clear();
+		prompt_n_vocab = n_vocab;
+	}
+	for (const whisper_token_data &token : segment_tokens) {
+		prompt.push_back(token.id);
+	}
+	if (prompt.size() > max_tokens) {
+		prompt.erase(prompt.begin(), prompt.end() - max_tokens);
+	}
+}
+
+const std::vector<whisper_token> &ContextPrompt::tokens(int n_vocab)
+{
+	apply_clear();
+	const size_t max_tokens = (size_t)max_tokens_.load(std::memory_order_relaxed);
+	if (n_vocab != prompt_n_vocab || max_tokens == 0) {
+		return no_tokens;
+	}
+	if (prompt.size() > max_tokens) {
+		// the setting was lowered
+		prompt.erase(prompt.begin(), prompt.end() - max_tokens);
+	}
+	return prompt;
+}
@@ -0,0 +1,62 @@
+#ifndef CONTEXT_PROMPT_H
+#define CONTEXT_PROMPT_H
+
+#include <whisper.h>
+
+#include <atomic>
+#include <vector>
+
+/**
+ * @file context-prompt.h
+ * @brief Rolling decoder prompt made of the tokens of the last final segments.
+ *
+ * The tokens whisper decoded for each final segment are appended as they are, so the prompt of
+ * the next inference is passed as prompt_tokens and never tokenized again. The oldest tokens are
+ * dropped past a number of tokens, which bounds the length of the prompt and the cost of the
+ * decoder. The token ids belong to the vocabulary of the model that decoded them: the prompt is
+ * started over when a model with another vocabulary appends to it, and is not given to one.
+ *
+ * Only the inference thread calls push() and tokens(), set_max_tokens() and clear() can be
+ * called from any thread.
+ */
+
+// whisper keeps at most half of its text context (448 tokens) of the prompt
+#define WHISPER_MAX_PROMPT_TOKENS 224
+
+class ContextPrompt {
+public:
+	/**
+	 * @brief Longest prompt in tokens, 0 disables it, clamped to WHISPER_MAX_PROMPT_TOKENS.
+	 */
+	void set_max_tokens(int max_tokens);
+
+	/**
+	 * @brief Drop the tokens, e.g. when the captions are cleared.
+	 */
+	void clear() { clear_requested.store(true, std::memory_order_relaxed); }
+
+	/**
+	 * @brief Append the tokens of a final segment.
+	 *
+	 * @param segment_tokens Text tokens of the segment, without the special ones.
+	 * @param n_vocab Size of the vocabulary of the model that decoded them.
+	 */
+	void push(const std::vector<whisper_token_data> &segment_tokens, int n_vocab);
+
+	/**
+	 * @brief Prompt for a decode by a model with a vocabulary of n_vocab, may be empty.
+	 */
+	const std::vector<whisper_token> &tokens(int n_vocab);
+
+private:
+	void apply_clear();
+
+	std::atomic<int> max_tokens_{0};
+	std::atomic<bool> clear_requested{false};
+	// the fields below are only used by the inference thread
+	std::vector<whisper_token> prompt;
+	int prompt_n_vocab = 0;
+	const std::vector<whisper_token> no_tokens;
+};
+
+#endif // CONTEXT_PROMPT_H
@@ -0,0 +1,157 @@
+#include "inference-thread-budget.h"
+#include "plugin-support.h"
+
+#include <obs-module.h>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <Windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+
+std::mutex budget_mutex;
+// the max_threads and pin_threads settings of each filter
+std::map<const void *, std::pair<int, bool>> filter_settings;
+// 0: automatic
+int budget_max_threads = 0;
+int threads_in_use = 0;
+int active_decodes = 0;
+// incremented when the pinning setting changes, so threads know to update their affinity
+std::atomic<int> pin_generation{0};
+std::atomic<bool> pin_enabled{false};
+
+int hardware_threads()
+{
+	return std::max(1, (int)std::thread::hardware_concurrency());
+}
+
+// budget_mutex must be held
+int effective_budget()
+{
+	if (budget_max_threads > 0) {
+		return budget_max_threads;
+	}
+	return std::max(1, hardware_threads() - INFERENCE_RESERVED_CORES);
+}
+
+bool set_current_thread_affinity(bool pin)
+{
+	const int n_cores = hardware_threads();
+	if (n_cores <= INFERENCE_RESERVED_CORES) {
+		// nothing left to pin to
+		return false;
+	}
+#ifdef _WIN32
+	DWORD_PTR process_mask = 0;
+	DWORD_PTR system_mask = 0;
+	if (!GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask)) {
+		return false;
+	}
+	DWORD_PTR mask = process_mask;
+	if (pin) {
+		for (int i = 0; i < INFERENCE_RESERVED_CORES; i++) {
+			mask &= ~((DWORD_PTR)1 << i);
+		}
+	}
+	return mask != 0 && SetThreadAffinityMask(GetCurrentThread(), mask) != 0;
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (int i = pin ? INFERENCE_RESERVED_CORES : 0; i < n_cores && i < CPU_SETSIZE; i++) {
+		CPU_SET(i, &set);
+	}
+	return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+	UNUSED_PARAMETER(pin);
+	return false;
+#endif
+}
+
+// budget_mutex must be held
+void combine_filter_settings()
+{
+	// every limit a filter set is kept, the smallest one
+	int max_threads = 0;
+	bool pin = false;
+	for (const auto &setting : filter_settings) {
+		if (setting.second.first > 0 &&
+		    (max_threads == 0 || setting.second.first < max_threads)) {
+			max_threads = setting.second.first;
+		}
+		pin = pin || setting.second.second;
+	}
+	budget_max_threads = max_threads;
+	if (pin_enabled.exchange(pin) != pin) {
+		pin_generation++;
+	}
+}
+
+} // namespace
+
+void set_inference_thread_budget(const void *filter, int max_threads, bool pin_threads)
+{
+	std::lock_guard<std::mutex> lock(budget_mutex);
+	filter_settings[filter] = {std::max(0, max_threads), pin_threads};
+	combine_filter_settings();
+}
+
+void remove_inference_thread_budget(const void *filter)
+{
+	std::lock_guard<std::mutex> lock(budget_mutex);
+	filter_settings.erase(filter);
+	combine_filter_settings();
+}
+
+int acquire_inference_threads(int requested)
+{
+	std::lock_guard<std::mutex> lock(budget_mutex);
+	const int budget = effective_budget();
+	active_decodes++;
+	// an equal share for each running decode, within what the others left
+	const int share = std::max(1, budget / active_decodes);
+	const int available = std::max(1, budget - threads_in_use);
+	const int granted = std::max(1, std::min({std::max(1, requested), share, available}));
+	threads_in_use += granted;
+	return granted;
+}
+
+void release_inference_threads(int granted)
+{
+	std::lock_guard<std::mutex> lock(budget_mutex);
+	threads_in_use = std::max(0, threads_in_use - granted);
+	active_decodes = std::max(0, active_decodes - 1);
+}
+
+void update_inference_thread_affinity()
+{
+	// -1: not applied yet on this thread
+	thread_local int applied_generation = -1;
+	const int generation = pin_generation.load();
+	if (generation == applied_generation) {
+		return;
+	}
+	applied_generation = generation;
+
+	const bool pin = pin_enabled.load();
+	if (!pin && generation == 0) {
+		// never pinned, keep the inherited affinity
+		return;
+	}
+	if (set_current_thread_affinity(pin)) {
+		obs_log(LOG_INFO, "Inference thread %s", pin ? "pinned away from the first cores"
+							     : "unpinned");
+	} else if (pin) {
+		obs_log(LOG_WARNING, "Could not pin the inference thread");
+	}
+}
@@ -0,0 +1,60 @@
+/**
+ * @file inference-thread-budget.h
+ * @brief Process-wide budget of CPU threads for whisper inference.
+ *
+ * Every filter has its own n_threads setting, so several filters decoding at the same time can
+ * ask for more threads than there are cores. The budget hands out threads to the running
+ * decodes: each one gets at most its n_threads, at most its share of the budget, and never more
+ * than what is left. Inference threads can optionally be pinned to the cores after the first
+ * INFERENCE_RESERVED_CORES, leaving those to the OBS video, audio and encoder threads.
+ *
+ * The budget and the pinning are settings of each filter but apply to the whole process. Each
+ * filter sets its values and they are combined: the smallest budget a filter set is used, or the
+ * automatic one when no filter set one, and the threads are pinned when a filter asks for it.
+ */
+#ifndef INFERENCE_THREAD_BUDGET_H
+#define INFERENCE_THREAD_BUDGET_H
+
+// cores left to OBS by the automatic budget and by the pinning
+#define INFERENCE_RESERVED_CORES 2
+
+/**
+ * @brief Set the budget settings of a filter.
+ *
+ * @param filter The filter the settings are from.
+ * @param max_threads Total number of inference threads, 0 for the number of cores minus
+ * INFERENCE_RESERVED_CORES.
+ * @param pin_threads Whether inference threads are pinned away from the reserved cores.
+ */
+void set_inference_thread_budget(const void *filter, int max_threads, bool pin_threads);
+
+/**
+ * @brief Drop the budget settings of a destroyed filter.
+ */
+void remove_inference_thread_budget(const void *filter);
+
+/**
+ * @brief Get threads for a decode that is about to start.
+ *
+ * @param requested The n_threads setting of the filter.
+ * @return Number of threads to use, at least 1. Must be returned with release_inference_threads.
+ */
+int acquire_inference_threads(int requested);
+
+/**
+ * @brief Return the threads of a finished decode.
+ *
+ * @param granted The value returned by acquire_inference_threads.
+ */
+void release_inference_threads(int granted);
+
+/**
+ * @brief Apply the pinning setting to the calling thread, when it changed since the last call.
+ *
+ * Called by the inference thread before each decode. On Linux the whisper worker threads
+ * started from it inherit the affinity, on Windows only the calling thread is pinned and on
+ * macOS pinning is not supported.
+ */
+void update_inference_thread_affinity();
+
+#endif // INFERENCE_THREAD_BUDGET_H
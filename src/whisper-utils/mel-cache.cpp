@@ -0,0 +1,207 @@
+#include "mel-cache.h"
+
+#include <whisper.h>
+
+#include <algorithm>
+#include <cmath>
+
+// number of bins of the FFT of a frame
+#define MEL_N_BINS (WHISPER_N_FFT / 2 + 1)
+// reflection padding before the audio (the frames are centered)
+#define MEL_PAD (WHISPER_N_FFT / 2)
+// log10 of the power floor, the value of the frames of silence
+#define MEL_LOG_FLOOR -10.0f
+
+static const double mel_pi = 3.14159265358979323846;
+
+// Slaney mel scale, as librosa (and the whisper filter bank) uses it
+static double hz_to_mel(double hz)
+{
+	const double logstep = std::log(6.4) / 27.0;
+	return hz < 1000.0 ? hz * 3.0 / 200.0 : 15.0 + std::log(hz / 1000.0) / logstep;
+}
+
+static double mel_to_hz(double mel)
+{
+	const double logstep = std::log(6.4) / 27.0;
+	return mel < 15.0 ? mel * 200.0 / 3.0 : 1000.0 * std::exp(logstep * (mel - 15.0));
+}
+
+void MelCache::init(int n_mel)
+{
+	n_mel_ = n_mel;
+
+	hann.resize(WHISPER_N_FFT);
+	sin_vals.resize(WHISPER_N_FFT);
+	cos_vals.resize(WHISPER_N_FFT);
+	for (int i = 0; i < WHISPER_N_FFT; i++) {
+		const double theta = 2.0 * mel_pi * i / WHISPER_N_FFT;
+		hann[i] = (float)(0.5 * (1.0 - std::cos(theta)));
+		sin_vals[i] = (float)std::sin(theta);
+		cos_vals[i] = (float)std::cos(theta);
+	}
+
+	// triangular filters between n_mel + 2 points evenly spaced on the mel scale up to the
+	// Nyquist frequency, with the Slaney area normalization
+	std::vector<double> points(n_mel + 2);
+	const double mel_max = hz_to_mel(WHISPER_SAMPLE_RATE / 2.0);
+	for (int i = 0; i < n_mel + 2; i++) {
+		points[i] = mel_to_hz(mel_max * i / (n_mel + 1));
+	}
+	filters.assign((size_t)n_mel * MEL_N_BINS, 0.0f);
+	for (int m = 0; m < n_mel; m++) {
+		const double norm = 2.0 / (points[m + 2] - points[m]);
+		for (int k = 0; k < MEL_N_BINS; k++) {
+			const double hz = (double)k * WHISPER_SAMPLE_RATE / WHISPER_N_FFT;
+			const double lower = (hz - points[m]) / (points[m + 1] - points[m]);
+			const double upper = (points[m + 2] - hz) / (points[m + 2] - points[m + 1]);
+			filters[(size_t)m * MEL_N_BINS + k] =
+				(float)(std::max(0.0, std::min(lower, upper)) * norm);
+		}
+	}
+
+	// the recursive FFT stores the even / odd halves after the input and output
+	fft_in.resize(2 * WHISPER_N_FFT);
+	fft_out.resize(8 * WHISPER_N_FFT);
+	power.resize(MEL_N_BINS);
+	clear();
+}
+
+void MelCache::clear()
+{
+	frames.clear();
+	stable_frames = 0;
+	cached_key = 0;
+}
+
+// radix-2 FFT down to odd sizes, which use a DFT. n divides WHISPER_N_FFT.
+void MelCache::fft(float *in, size_t n, float *out)
+{
+	if (n == 1) {
+		out[0] = in[0];
+		out[1] = 0.0f;
+		return;
+	}
+
+	const size_t step = WHISPER_N_FFT / n;
+	if (n % 2 == 1) {
+		for (size_t k = 0; k < n; k++) {
+			float re = 0.0f;
+			float im = 0.0f;
+			for (size_t i = 0; i < n; i++) {
+				const size_t idx = (k * i * step) % WHISPER_N_FFT;
+				re += in[i] * cos_vals[idx];
+				im -= in[i] * sin_vals[idx];
+			}
+			out[2 * k] = re;
+			out[2 * k + 1] = im;
+		}
+		return;
+	}
+
+	const size_t half = n / 2;
+	float *half_in = in + n;
+	float *even_fft = out + 2 * n;
+	float *odd_fft = even_fft + n;
+	for (size_t i = 0; i < half; i++) {
+		half_in[i] = in[2 * i];
+	}
+	fft(half_in, half, even_fft);
+	for (size_t i = 0; i < half; i++) {
+		half_in[i] = in[2 * i + 1];
+	}
+	fft(half_in, half, odd_fft);
+
+	for (size_t k = 0; k < half; k++) {
+		const float re = cos_vals[k * step];
+		const float im = -sin_vals[k * step];
+		const float re_odd = odd_fft[2 * k];
+		const float im_odd = odd_fft[2 * k + 1];
+		out[2 * k] = even_fft[2 * k] + re * re_odd - im * im_odd;
+		out[2 * k + 1] = even_fft[2 * k + 1] + re * im_odd + im * re_odd;
+		out[2 * (k + half)] = even_fft[2 * k] - re * re_odd + im * im_odd;
+		out[2 * (k + half) + 1] = even_fft[2 * k + 1] - re * im_odd - im * re_odd;
+	}
+}
+
+void MelCache::compute_frame(const float *padded_samples, size_t n_padded, size_t frame,
+			     float *out)
+{
+	const size_t offset = frame * WHISPER_HOP_LENGTH;
+	for (size_t j = 0; j < WHISPER_N_FFT; j++) {
+		fft_in[j] = offset + j < n_padded ? hann[j] * padded_samples[offset + j] : 0.0f;
+	}
+	fft(fft_in.data(), WHISPER_N_FFT, fft_out.data());
+	for (size_t k = 0; k < MEL_N_BINS; k++) {
+		const float re = fft_out[2 * k];
+		const float im = fft_out[2 * k + 1];
+		power[k] = re * re + im * im;
+	}
+	for (int m = 0; m < n_mel_; m++) {
+		const float *filter = filters.data() + (size_t)m * MEL_N_BINS;
+		double sum = 0.0;
+		for (size_t k = 0; k < MEL_N_BINS; k++) {
+			sum += filter[k] * power[k];
+		}
+		out[m] = (float)std::log10(std::max(sum, 1e-10));
+	}
+}
+
+size_t MelCache::compute(const float *samples, size_t n_samples, size_t stable_samples,
+			 uint64_t key)
+{
+	if (n_mel_ == 0 || samples == nullptr || n_samples == 0) {
+		n_len_ = 0;
+		mel.clear();
+		return 0;
+	}
+
+	// same framing as whisper_pcm_to_mel: 200 samples of reflection before the audio,
+	// 30 s of silence after it
+	n_len_ = (int)((n_samples + WHISPER_SAMPLE_RATE * WHISPER_CHUNK_SIZE) / WHISPER_HOP_LENGTH);
+	const size_t n_padded = n_samples + 2 * MEL_PAD;
+	padded.resize(n_padded);
+	for (size_t j = 0; j < MEL_PAD; j++) {
+		const size_t src = MEL_PAD - j;
+		padded[j] = src < n_samples ? samples[src] : 0.0f;
+	}
+	std::copy(samples, samples + n_samples, padded.begin() + MEL_PAD);
+	std::fill(padded.begin() + MEL_PAD + n_samples, padded.end(), 0.0f);
+
+	// frames past these only see silence
+	const size_t n_frames = std::min((n_samples + MEL_PAD + WHISPER_HOP_LENGTH - 1) /
+						 WHISPER_HOP_LENGTH,
+					 (size_t)n_len_);
+
+	size_t reused = 0;
+	if (key == cached_key) {
+		reused = std::min(stable_frames, n_frames);
+	}
+	frames.resize(n_frames * n_mel_);
+	for (size_t i = reused; i < n_frames; i++) {
+		compute_frame(padded.data(), n_padded, i, frames.data() + i * n_mel_);
+	}
+
+	// a frame can be reused if its window (and the reflection padding) only covers samples
+	// the next call starts with
+	cached_key = key;
+	stable_frames = stable_samples >= WHISPER_N_FFT
+				? (stable_samples - MEL_PAD) / WHISPER_HOP_LENGTH + 1
+				: 0;
+
+	// normalize like whisper.cpp: clamp to 8 (log10) below the maximum, then scale
+	float mmax = n_frames < (size_t)n_len_ ? MEL_LOG_FLOOR : -1e20f;
+	for (const float v : frames) {
+		mmax = std::max(mmax, v);
+	}
+	const float floor_value = (std::max(MEL_LOG_FLOOR, mmax - 8.0f) + 4.0f) / 4.0f;
+	mel.resize((size_t)n_mel_ * n_len_);
+	for (int m = 0; m < n_mel_; m++) {
+		float *row = mel.data() + (size_t)m * n_len_;
+		for (size_t i = 0; i < n_frames; i++) {
+			row[i] = (std::max(frames[i * n_mel_ + m], mmax - 8.0f) + 4.0f) / 4.0f;
+		}
+		std::fill(row + n_frames, row + n_len_, floor_value);
+	}
+	return reused;
+}
@@ -0,0 +1,79 @@
+#ifndef MEL_CACHE_H
+#define MEL_CACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * @file mel-cache.h
+ * @brief Log mel spectrogram for whisper, reusing the frames of a previous run on the same audio.
+ *
+ * Partial runs decode a buffer that only grows at the back, so all mel frames whose window lies
+ * in the audio of the previous run are the same. The cache keeps the log mel frames before the
+ * per-spectrogram normalization and only computes the frames of the new audio. The output is
+ * the spectrogram whisper_pcm_to_mel computes for the same samples (including the 30 s of
+ * silence padding), ready for whisper_set_mel_with_state.
+ */
+
+class MelCache {
+public:
+	MelCache() = default;
+
+	/**
+	 * @brief Set up the FFT and mel filter bank, clears the cache.
+	 *
+	 * @param n_mel Number of mel bins of the model (80, or 128 for large-v3).
+	 */
+	void init(int n_mel);
+
+	/**
+	 * @brief Forget the cached frames.
+	 */
+	void clear();
+
+	/**
+	 * @brief Compute the spectrogram of the samples.
+	 *
+	 * @param samples 16 kHz mono audio.
+	 * @param n_samples Number of samples.
+	 * @param stable_samples Number of leading samples the next call with the same key will
+	 *        start with, e.g. the samples without the trailing silence.
+	 * @param key Identifies the audio: calls with the same key must have the same samples at
+	 *        the start, up to the stable_samples of the previous call.
+	 * @return Number of frames reused from the previous call.
+	 */
+	size_t compute(const float *samples, size_t n_samples, size_t stable_samples, uint64_t key);
+
+	/**
+	 * @brief The normalized spectrogram of the last compute(), n_mel() x n_len(), bin major.
+	 */
+	const float *data() const { return mel.data(); }
+	int n_len() const { return n_len_; }
+	int n_mel() const { return n_mel_; }
+
+private:
+	void fft(float *in, size_t n, float *out);
+	void compute_frame(const float *padded, size_t n_padded, size_t frame, float *out);
+
+	int n_mel_ = 0;
+	int n_len_ = 0;
+	std::vector<float> hann;
+	std::vector<float> sin_vals;
+	std::vector<float> cos_vals;
+	// n_mel x (WHISPER_N_FFT / 2 + 1)
+	std::vector<float> filters;
+	std::vector<float> fft_in;
+	std::vector<float> fft_out;
+	std::vector<float> power;
+	// audio with the reflection padding, as whisper.cpp pads it
+	std::vector<float> padded;
+	// log mel frames before normalization, frame major
+	std::vector<float> frames;
+	// frames at the start of frames that can be reused for the key
+	size_t stable_frames = 0;
+	uint64_t cached_key = 0;
+	std::vector<float> mel;
+};
+
+#endif // MEL_CACHE_H
@@ -0,0 +1,76 @@
+#include "overload-controller.h"
+
+#include <algorithm>
+
+void OverloadController::set_max_level(int max_level)
+{
+	max_level_.store(std::clamp(max_level, 0, OVERLOAD_LEVEL_COUNT - 1),
+			 std::memory_order_relaxed);
+}
+
+int OverloadController::update(uint64_t now_ms, uint64_t inference_ms, uint64_t audio_ms,
+			       uint64_t backlog_ms)
+{
+	if (audio_ms > 0) {
+		const double run_rtf = (double)inference_ms / (double)audio_ms;
+		const double last_rtf = rtf();
+		rtf_.store(last_rtf == 0.0 ? run_rtf
+					   : last_rtf + OVERLOAD_RTF_ALPHA * (run_rtf - last_rtf),
+			   std::memory_order_relaxed);
+	}
+	const bool backlog_growing = backlog_ms > OVERLOAD_BACKLOG_MS && backlog_ms >= last_backlog_ms;
+	last_backlog_ms = backlog_ms;
+
+	const int current = level();
+	const int max_level = max_level_.load(std::memory_order_relaxed);
+	int next = current;
+	if (current > max_level) {
+		// the setting was lowered
+		next = max_level;
+	} else if ((rtf() > 1.0 || backlog_growing) && current < max_level) {
+		headroom_since_ms = 0;
+		if (now_ms - last_change_ms >= OVERLOAD_STEP_DOWN_HOLD_MS) {
+			next = current + 1;
+		}
+	} else if (rtf() < OVERLOAD_HEADROOM_RTF && backlog_ms < OVERLOAD_HEADROOM_BACKLOG_MS) {
+		if (headroom_since_ms == 0) {
+			headroom_since_ms = now_ms;
+		}
+		if (current > OVERLOAD_LEVEL_NONE &&
+		    now_ms - headroom_since_ms >= OVERLOAD_STEP_UP_HOLD_MS &&
+		    now_ms - last_change_ms >= OVERLOAD_STEP_UP_HOLD_MS) {
+			next = current - 1;
+			// the next level up waits for its own stretch of headroom
+			headroom_since_ms = now_ms;
+		}
+	} else {
+		headroom_since_ms = 0;
+	}
+
+	if (next == current) {
+		return -1;
+	}
+	last_change_ms = now_ms;
+	level_.store(next, std::memory_order_relaxed);
+	return current;
+}
+
+const char *OverloadController::level_name(int level)
+{
+	switch (level) {
+	case OVERLOAD_LEVEL_NONE:
+		return "none";
+	case OVERLOAD_LEVEL_PARTIAL_LATENCY:
+		return "longer partial latency";
+	case OVERLOAD_LEVEL_NO_PARTIALS:
+		return "no partials";
+	case OVERLOAD_LEVEL_GREEDY:
+		return "greedy decoding";
+	case OVERLOAD_LEVEL_AUDIO_CTX:
+		return "automatic audio context";
+	case OVERLOAD_LEVEL_FALLBACK_MODEL:
+		return "fallback model";
+	default:
+		return "unknown";
+	}
+}
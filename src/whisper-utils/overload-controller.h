@@ -0,0 +1,96 @@
+#ifndef OVERLOAD_CONTROLLER_H
+#define OVERLOAD_CONTROLLER_H
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * @file overload-controller.h
+ * @brief Degrades the transcription step by step while the inference cannot keep up.
+ *
+ * The inference thread reports every run: its time, the duration of its audio and the backlog
+ * of audio waiting for the pipeline (the input buffer and the queued segments). The controller
+ * keeps a moving average of the real-time factor (inference time per audio time). While the
+ * filter is overloaded, i.e. the real-time factor is above 1 or the backlog keeps growing past
+ * a bound, it steps down one level at a time, each level adding to the previous ones:
+ *
+ *  1. the partials are decoded half as often (twice the partial latency)
+ *  2. no partials
+ *  3. greedy decoding instead of beam search
+ *  4. the automatic audio context, the encoder only covers the audio
+ *  5. the final segments are decoded by the draft (smaller) model, if one is loaded
+ *
+ * It steps back up one level when there is headroom again for a while. The pipeline reads
+ * level() where each of the settings is used, the settings of the filter are not changed.
+ */
+
+enum OverloadLevel {
+	OVERLOAD_LEVEL_NONE = 0,
+	OVERLOAD_LEVEL_PARTIAL_LATENCY,
+	OVERLOAD_LEVEL_NO_PARTIALS,
+	OVERLOAD_LEVEL_GREEDY,
+	OVERLOAD_LEVEL_AUDIO_CTX,
+	OVERLOAD_LEVEL_FALLBACK_MODEL,
+	OVERLOAD_LEVEL_COUNT
+};
+
+// backlog of audio over which the filter is behind, even with a real-time factor below 1
+#define OVERLOAD_BACKLOG_MS 3000
+// headroom: real-time factor and backlog under which a level is restored
+#define OVERLOAD_HEADROOM_RTF 0.5
+#define OVERLOAD_HEADROOM_BACKLOG_MS 500
+// time between two steps down, for the last step to take effect
+#define OVERLOAD_STEP_DOWN_HOLD_MS 2000
+// time with headroom before a step up
+#define OVERLOAD_STEP_UP_HOLD_MS 15000
+// weight of the last run in the moving average of the real-time factor
+#define OVERLOAD_RTF_ALPHA 0.2
+#define OVERLOAD_PARTIAL_LATENCY_FACTOR 2
+
+class OverloadController {
+public:
+	/**
+	 * @brief Deepest level the controller may step down to, 0 disables it.
+	 */
+	void set_max_level(int max_level);
+
+	/**
+	 * @brief Account for an inference run and step the level.
+	 *
+	 * @param now_ms Current time.
+	 * @param inference_ms Time of the run.
+	 * @param audio_ms Duration of the audio of the run.
+	 * @param backlog_ms Audio waiting for the pipeline after the run.
+	 * @return The level before the run, when it changed (the new one is level()), or -1.
+	 */
+	int update(uint64_t now_ms, uint64_t inference_ms, uint64_t audio_ms, uint64_t backlog_ms);
+
+	int level() const { return level_.load(std::memory_order_relaxed); }
+	double rtf() const { return rtf_.load(std::memory_order_relaxed); }
+
+	static const char *level_name(int level);
+
+	// The settings at the current level
+	bool partials_enabled(bool partial_transcription) const
+	{
+		return partial_transcription && level() < OVERLOAD_LEVEL_NO_PARTIALS;
+	}
+	int partial_latency_ms(int partial_latency) const
+	{
+		return level() >= OVERLOAD_LEVEL_PARTIAL_LATENCY
+			       ? partial_latency * OVERLOAD_PARTIAL_LATENCY_FACTOR
+			       : partial_latency;
+	}
+
+private:
+	std::atomic<int> level_{OVERLOAD_LEVEL_NONE};
+	std::atomic<double> rtf_{0.0};
+	std::atomic<int> max_level_{OVERLOAD_LEVEL_COUNT - 1};
+	// the fields below are only used by the inference thread
+	uint64_t last_change_ms = 0;
+	// start of the current stretch with headroom, 0 without headroom
+	uint64_t headroom_since_ms = 0;
+	uint64_t last_backlog_ms = 0;
+};
+
+#endif // OVERLOAD_CONTROLLER_H
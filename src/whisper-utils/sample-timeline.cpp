@@ -0,0 +1,54 @@
+#include "sample-timeline.h"
+
+void SampleTimeline::init(uint32_t sample_rate_)
+{
+	sample_rate = sample_rate_;
+	clear();
+}
+
+void SampleTimeline::clear()
+{
+	first = 0;
+	count = 0;
+}
+
+void SampleTimeline::add_anchor(uint64_t sample_index, uint64_t timestamp_ns)
+{
+	if (count > 0 && sample_index <= at(count - 1).sample_index) {
+		// same position as the last anchor (e.g. an empty block), the newer timestamp wins
+		anchors[(first + count - 1) % SAMPLE_TIMELINE_CAPACITY].timestamp_ns = timestamp_ns;
+		return;
+	}
+	if (count == SAMPLE_TIMELINE_CAPACITY) {
+		first = (first + 1) % SAMPLE_TIMELINE_CAPACITY;
+		count--;
+	}
+	anchors[(first + count) % SAMPLE_TIMELINE_CAPACITY] = {sample_index, timestamp_ns};
+	count++;
+}
+
+uint64_t SampleTimeline::timestamp_ns(uint64_t sample_index) const
+{
+	if (count == 0) {
+		return 0;
+	}
+
+	// last anchor at or before the sample, or the first anchor for older samples
+	size_t lo = 0;
+	size_t hi = count;
+	while (hi - lo > 1) {
+		const size_t mid = (lo + hi) / 2;
+		if (at(mid).sample_index <= sample_index) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+	const anchor &a = at(lo);
+	if (sample_index >= a.sample_index) {
+		return a.timestamp_ns +
+		       (sample_index - a.sample_index) * 1000000000ull / sample_rate;
+	}
+	const uint64_t before_ns = (a.sample_index - sample_index) * 1000000000ull / sample_rate;
+	return a.timestamp_ns > before_ns ? a.timestamp_ns - before_ns : 0;
+}
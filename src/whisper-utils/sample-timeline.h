@@ -0,0 +1,65 @@
+#ifndef SAMPLE_TIMELINE_H
+#define SAMPLE_TIMELINE_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @file sample-timeline.h
+ * @brief Maps positions in the resampled (16 kHz) stream to source audio timestamps.
+ *
+ * Every resampled sample has a global index, counted from the start of processing. Each block
+ * coming out of the resampler adds an anchor (index of its first sample, timestamp of that
+ * sample with the resampler delay removed). Timestamps of other samples are interpolated from
+ * the closest anchor before them, so segment boundaries found anywhere in the buffers convert
+ * to source time without accumulating rounding errors, and timestamp jumps in the source only
+ * affect the samples after them.
+ */
+
+#define SAMPLE_TIMELINE_CAPACITY 1024
+
+class SampleTimeline {
+public:
+	SampleTimeline() = default;
+
+	/**
+	 * @param sample_rate_ Sample rate of the indexed stream.
+	 */
+	void init(uint32_t sample_rate_);
+
+	/**
+	 * @brief Forget all anchors, the sample indices keep counting.
+	 */
+	void clear();
+
+	/**
+	 * @brief Register the timestamp of a sample. Indices must be increasing.
+	 *
+	 * The oldest anchor is dropped when the timeline is full.
+	 */
+	void add_anchor(uint64_t sample_index, uint64_t timestamp_ns);
+
+	/**
+	 * @brief Timestamp of a sample in ns, 0 if there is no anchor yet.
+	 */
+	uint64_t timestamp_ns(uint64_t sample_index) const;
+	uint64_t timestamp_ms(uint64_t sample_index) const
+	{
+		return timestamp_ns(sample_index) / 1000000;
+	}
+
+private:
+	struct anchor {
+		uint64_t sample_index;
+		uint64_t timestamp_ns;
+	};
+
+	const anchor &at(size_t i) const { return anchors[(first + i) % SAMPLE_TIMELINE_CAPACITY]; }
+
+	anchor anchors[SAMPLE_TIMELINE_CAPACITY];
+	size_t first = 0;
+	size_t count = 0;
+	uint32_t sample_rate = 16000;
+};
+
+#endif // SAMPLE_TIMELINE_H
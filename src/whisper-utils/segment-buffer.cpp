@@ -0,0 +1,135 @@
+#include "segment-buffer.h"
+
+#include <util/bmem.h>
+
+#include <algorithm>
+#include <cstring>
+
+SegmentBuffer::SegmentBuffer() noexcept
+	: storage(nullptr),
+	  capacity(0),
+	  padding(0),
+	  begin(0),
+	  end(0),
+	  growths_(0),
+	  generation_(0)
+{
+}
+
+SegmentBuffer::~SegmentBuffer()
+{
+	release();
+}
+
+bool SegmentBuffer::init(size_t capacity_samples, size_t padding_samples)
+{
+	release();
+
+	capacity = capacity_samples + 2 * padding_samples;
+	storage = (float *)bzalloc(capacity * sizeof(float));
+	if (storage == nullptr) {
+		capacity = 0;
+		return false;
+	}
+	padding = padding_samples;
+	begin = end = padding;
+	growths_ = 0;
+	generation_++;
+	return true;
+}
+
+void SegmentBuffer::release()
+{
+	if (storage != nullptr) {
+		bfree(storage);
+		storage = nullptr;
+	}
+	capacity = padding = begin = end = 0;
+}
+
+bool SegmentBuffer::ensure_capacity(size_t num_samples)
+{
+	if (end + num_samples + padding <= capacity) {
+		return true;
+	}
+
+	// move the samples back to the beginning before growing
+	if (begin > padding) {
+		const size_t n = size();
+		memmove(storage + padding, storage + begin, n * sizeof(float));
+		begin = padding;
+		end = padding + n;
+		if (end + num_samples + padding <= capacity) {
+			return true;
+		}
+	}
+
+	const size_t new_capacity = std::max(capacity * 2, end + num_samples + padding);
+	float *new_storage = (float *)brealloc(storage, new_capacity * sizeof(float));
+	if (new_storage == nullptr) {
+		return false;
+	}
+	storage = new_storage;
+	capacity = new_capacity;
+	growths_++;
+	return true;
+}
+
+float *SegmentBuffer::reserve_back(size_t num_samples)
+{
+	if (storage == nullptr || !ensure_capacity(num_samples)) {
+		return nullptr;
+	}
+	return storage + end;
+}
+
+void SegmentBuffer::commit_back(size_t num_samples)
+{
+	end = std::min(end + num_samples, capacity - padding);
+}
+
+bool SegmentBuffer::push_back(const float *samples, size_t num_samples)
+{
+	float *dst = reserve_back(num_samples);
+	if (dst == nullptr) {
+		return false;
+	}
+	memcpy(dst, samples, num_samples * sizeof(float));
+	commit_back(num_samples);
+	return true;
+}
+
+void SegmentBuffer::pop_front(size_t num_samples)
+{
+	if (num_samples == 0) {
+		return;
+	}
+	generation_++;
+	begin += std::min(num_samples, size());
+	if (begin == end) {
+		begin = end = padding;
+	} else if (begin - padding > size()) {
+		// more popped space than samples left, moving them back is cheap
+		const size_t n = size();
+		memmove(storage + padding, storage + begin, n * sizeof(float));
+		begin = padding;
+		end = padding + n;
+	}
+}
+
+void SegmentBuffer::clear()
+{
+	generation_++;
+	begin = end = padding;
+}
+
+const float *SegmentBuffer::padded_data()
+{
+	if (storage == nullptr) {
+		return nullptr;
+	}
+	// the tail padding is always available, see ensure_capacity
+	memset(storage + begin - padding, 0, padding * sizeof(float));
+	memset(storage + end, 0, padding * sizeof(float));
+	return storage + begin - padding;
+}
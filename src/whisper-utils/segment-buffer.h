@@ -0,0 +1,126 @@
+#ifndef SEGMENT_BUFFER_H
+#define SEGMENT_BUFFER_H
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @file segment-buffer.h
+ * @brief Contiguous mono buffer holding the audio of the current whisper segment.
+ *
+ * The samples are kept in one contiguous block with room for silence padding before and after,
+ * so the whole padded segment can be given to whisper_full without copying it first.
+ * Only used by the whisper thread.
+ */
+
+/**
+ * @class SegmentBuffer
+ * @brief Growable float buffer with reserved head/tail padding.
+ *
+ * Layout: [padding][samples][padding][free space]. Popping from the front only moves the start
+ * index; the samples are moved back to the beginning when the buffer is emptied or when the
+ * popped space gets larger than the samples left. The storage only grows, so after warm-up
+ * pushing and popping does not allocate.
+ */
+class SegmentBuffer {
+public:
+	SegmentBuffer() noexcept;
+	~SegmentBuffer();
+
+	SegmentBuffer(const SegmentBuffer &) = delete;
+	SegmentBuffer &operator=(const SegmentBuffer &) = delete;
+
+	/**
+	 * @brief Allocate the buffer.
+	 *
+	 * @param capacity_samples Initial number of samples the buffer can hold without growing.
+	 * @param padding_samples Number of silence samples kept available before and after the
+	 * samples, see padded_data().
+	 * @return true on success, false if the allocation failed.
+	 */
+	bool init(size_t capacity_samples, size_t padding_samples);
+
+	/**
+	 * @brief Release the buffer memory.
+	 */
+	void release();
+
+	/**
+	 * @brief Get space for num_samples more samples at the end of the buffer.
+	 *
+	 * The samples must be written to the returned pointer and then committed with
+	 * commit_back(). Growing the buffer invalidates the pointers returned before.
+	 *
+	 * @return Pointer to write to, or nullptr if the buffer could not grow.
+	 */
+	float *reserve_back(size_t num_samples);
+
+	/**
+	 * @brief Append samples written to the pointer returned by reserve_back().
+	 */
+	void commit_back(size_t num_samples);
+
+	/**
+	 * @brief Append a copy of the samples.
+	 *
+	 * @return true on success, false if the buffer could not grow.
+	 */
+	bool push_back(const float *samples, size_t num_samples);
+
+	/**
+	 * @brief Remove samples from the front (all samples if num_samples is larger than size()).
+	 */
+	void pop_front(size_t num_samples);
+
+	/**
+	 * @brief Remove all samples.
+	 */
+	void clear();
+
+	/**
+	 * @brief The samples, without padding.
+	 */
+	const float *data() const { return storage + begin; }
+
+	/**
+	 * @brief The samples with padding_samples of silence before and after.
+	 *
+	 * The padding is zeroed on each call. The pointer stays valid until the buffer is
+	 * modified.
+	 *
+	 * @return Pointer to the padded samples, padded_size() samples long.
+	 */
+	const float *padded_data();
+	size_t padded_size() const { return size() + 2 * padding; }
+
+	/**
+	 * @brief Number of samples, without padding.
+	 */
+	size_t size() const { return end - begin; }
+	size_t size_bytes() const { return size() * sizeof(float); }
+
+	/**
+	 * @brief Number of times the storage had to grow.
+	 */
+	size_t growths() const { return growths_; }
+
+	/**
+	 * @brief Changes whenever samples are removed, i.e. while it stays the same the buffer
+	 * only grew at the back and earlier copies are a prefix of the current samples.
+	 */
+	uint64_t generation() const { return generation_; }
+
+private:
+	bool ensure_capacity(size_t num_samples);
+
+	float *storage;
+	size_t capacity;
+	size_t padding;
+	// samples are in [begin, end), begin >= padding
+	size_t begin;
+	size_t end;
+	size_t growths_;
+	uint64_t generation_;
+};
+
+#endif // SEGMENT_BUFFER_H
@@ -0,0 +1,145 @@
+#include "segment-trace.h"
+#include "plugin-support.h"
+
+#include <obs-module.h>
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <thread>
+
+void SegmentTrace::start()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	events.clear();
+	dropped = 0;
+	vad_on_us_.store(0, std::memory_order_relaxed);
+	enabled_.store(true, std::memory_order_relaxed);
+}
+
+uint64_t SegmentTrace::new_segment()
+{
+	if (!enabled()) {
+		return 0;
+	}
+	return next_segment.fetch_add(1, std::memory_order_relaxed);
+}
+
+uint64_t SegmentTrace::now_us()
+{
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+		       std::chrono::system_clock::now().time_since_epoch())
+		.count();
+}
+
+void SegmentTrace::mark_vad_on()
+{
+	if (enabled()) {
+		vad_on_us_.store(now_us(), std::memory_order_relaxed);
+	}
+}
+
+uint32_t SegmentTrace::thread_id()
+{
+	return (uint32_t)std::hash<std::thread::id>()(std::this_thread::get_id());
+}
+
+void SegmentTrace::set_thread_name(const char *name)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	thread_names[thread_id()] = name;
+}
+
+void SegmentTrace::add(const event &e)
+{
+	if (e.segment == 0 || !enabled()) {
+		return;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	if (events.size() >= SEGMENT_TRACE_MAX_EVENTS) {
+		dropped++;
+		return;
+	}
+	events.push_back(e);
+}
+
+void SegmentTrace::span(uint64_t segment, const char *name, uint64_t start_us, uint64_t end_us)
+{
+	add({name, 'X', segment, start_us, end_us > start_us ? end_us - start_us : 0,
+	     thread_id()});
+}
+
+void SegmentTrace::instant(uint64_t segment, const char *name, uint64_t ts_us)
+{
+	add({name, 'i', segment, ts_us, 0, thread_id()});
+}
+
+void SegmentTrace::segment_span(uint64_t segment, const char *name, uint64_t start_us,
+				uint64_t end_us)
+{
+	add({name, 'b', segment, start_us, end_us > start_us ? end_us - start_us : 0, 0});
+}
+
+bool SegmentTrace::stop(const std::string &path)
+{
+	if (!enabled_.exchange(false)) {
+		return false;
+	}
+	std::lock_guard<std::mutex> lock(mutex);
+	const std::filesystem::path folder = std::filesystem::u8path(path).parent_path();
+	std::error_code ec;
+	if (!folder.empty()) {
+		std::filesystem::create_directories(folder, ec);
+	}
+	std::ofstream file(std::filesystem::u8path(path));
+	if (!file.is_open()) {
+		obs_log(LOG_ERROR, "Cannot write the segment trace to %s", path.c_str());
+		return false;
+	}
+	// the timestamps start at the first event, the trace viewers show them from 0
+	uint64_t origin_us = UINT64_MAX;
+	for (const event &e : events) {
+		origin_us = std::min(origin_us, e.ts_us);
+	}
+
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	bool first = true;
+	auto separator = [&file, &first]() {
+		file << (first ? "\n" : ",\n");
+		first = false;
+	};
+	for (const auto &thread : thread_names) {
+		separator();
+		file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread.first
+		     << ",\"args\":{\"name\":\"" << thread.second << "\"}}";
+	}
+	for (const event &e : events) {
+		const uint64_t ts = e.ts_us - origin_us;
+		separator();
+		if (e.phase == 'b') {
+			// async begin and end with the segment as id, one track per segment
+			file << "{\"name\":\"" << e.name << "\",\"cat\":\"segment\",\"ph\":\"b\""
+			     << ",\"id\":" << e.segment << ",\"pid\":1,\"ts\":" << ts
+			     << ",\"args\":{\"segment\":" << e.segment << "}},\n";
+			file << "{\"name\":\"" << e.name << "\",\"cat\":\"segment\",\"ph\":\"e\""
+			     << ",\"id\":" << e.segment << ",\"pid\":1,\"ts\":" << ts + e.dur_us
+			     << "}";
+			continue;
+		}
+		file << "{\"name\":\"" << e.name << "\",\"cat\":\"pipeline\",\"ph\":\"" << e.phase
+		     << "\",\"pid\":1,\"tid\":" << e.tid << ",\"ts\":" << ts;
+		if (e.phase == 'X') {
+			file << ",\"dur\":" << e.dur_us;
+		} else {
+			file << ",\"s\":\"t\"";
+		}
+		file << ",\"args\":{\"segment\":" << e.segment << "}}";
+	}
+	file << "\n]}\n";
+	obs_log(LOG_INFO, "Wrote %d segment trace events to %s (%llu dropped)", (int)events.size(),
+		path.c_str(), (unsigned long long)dropped);
+	events.clear();
+	return file.good();
+}
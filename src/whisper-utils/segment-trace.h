@@ -0,0 +1,131 @@
+#ifndef SEGMENT_TRACE_H
+#define SEGMENT_TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * @file segment-trace.h
+ * @brief Per-segment spans of the caption pipeline, exported as a Chrome trace.
+ *
+ * While tracing, every segment queued for inference gets an id, and each stage records what it
+ * did for that id: the audio ingress of the segment, the VAD decisions, the wait in the
+ * inference queue, the inference, the translations and the outputs to the text source, the
+ * token buffer and the WebVTT cues. The result carries the id through set_text_callback and
+ * the translation queues. The trace is written as Chrome trace JSON (chrome://tracing, Perfetto
+ * UI): the stages are spans on the tracks of the threads that ran them, and each output is an
+ * async span of its segment from the start of the audio to the output, so the gaps show where
+ * the caption latency goes.
+ *
+ * The id of a segment is 0 when tracing is off, all the recording functions return at once
+ * for it.
+ */
+
+// bound of the memory of a trace, about 100 bytes per event
+#define SEGMENT_TRACE_MAX_EVENTS 1000000
+
+class SegmentTrace {
+public:
+	SegmentTrace() = default;
+
+	/**
+	 * @brief Drop the recorded events and start tracing the new segments.
+	 */
+	void start();
+
+	/**
+	 * @brief Stop tracing and write the events of the trace.
+	 *
+	 * @return false if tracing was off or the file cannot be written.
+	 */
+	bool stop(const std::string &path);
+
+	bool enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+	/**
+	 * @brief Id of a new segment, 0 when tracing is off.
+	 */
+	uint64_t new_segment();
+
+	/**
+	 * @brief Current time on the clock of the trace, in microseconds since the epoch.
+	 */
+	static uint64_t now_us();
+
+	/**
+	 * @brief Record the time the VAD detected the start of speech, the next segment reports it.
+	 */
+	void mark_vad_on();
+
+	/**
+	 * @brief Time of the last mark_vad_on(), 0 if none.
+	 */
+	uint64_t vad_on_us() const { return vad_on_us_.load(std::memory_order_relaxed); }
+
+	/**
+	 * @brief Name the track of the calling thread in the trace.
+	 */
+	void set_thread_name(const char *name);
+
+	// Stage of the segment, on the track of the calling thread. name must be a literal.
+	void span(uint64_t segment, const char *name, uint64_t start_us, uint64_t end_us);
+	// Point in time of the segment, on the track of the calling thread
+	void instant(uint64_t segment, const char *name, uint64_t ts_us);
+	// Span on the track of the segment
+	void segment_span(uint64_t segment, const char *name, uint64_t start_us, uint64_t end_us);
+
+private:
+	struct event {
+		const char *name;
+		// Chrome trace phase: 'X' span, 'i' instant, 'b' segment span
+		char phase;
+		uint64_t segment;
+		uint64_t ts_us;
+		uint64_t dur_us;
+		uint32_t tid;
+	};
+
+	void add(const event &e);
+	static uint32_t thread_id();
+
+	std::atomic<bool> enabled_{false};
+	std::atomic<uint64_t> next_segment{1};
+	std::atomic<uint64_t> vad_on_us_{0};
+	// guards events, dropped and thread_names
+	std::mutex mutex;
+	std::vector<event> events;
+	uint64_t dropped = 0;
+	std::unordered_map<uint32_t, std::string> thread_names;
+};
+
+// Records the time of the enclosing scope as a span of the segment
+class SegmentTraceScope {
+public:
+	SegmentTraceScope(SegmentTrace &trace_, uint64_t segment_, const char *name_)
+		: trace(trace_),
+		  segment(segment_),
+		  name(name_),
+		  start(segment_ != 0 ? SegmentTrace::now_us() : 0)
+	{
+	}
+	SegmentTraceScope(const SegmentTraceScope &) = delete;
+	SegmentTraceScope &operator=(const SegmentTraceScope &) = delete;
+	~SegmentTraceScope()
+	{
+		if (segment != 0) {
+			trace.span(segment, name, start, SegmentTrace::now_us());
+		}
+	}
+
+private:
+	SegmentTrace &trace;
+	uint64_t segment;
+	const char *name;
+	uint64_t start;
+};
+
+#endif // SEGMENT_TRACE_H
@@ -9,6 +9,11 @@
 #include <iostream>
 #include <cstdio>
 #include <cstdarg>
+#include <algorithm>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <tuple>
 
 #include <obs.h>
 #include "plugin-support.h"
@@ -108,7 +113,58 @@ const char* ort_error_code_str(OrtErrorCode code)
   }
 }
 
-void VadIterator::init_engine_threads(int inter_threads, int intra_threads)
+namespace {
+
+Ort::Env &silero_env()
+{
+	// one Env for the process, the sessions are created in it
+	static Ort::Env env(ORT_LOGGING_LEVEL_WARNING, "silero_vad");
+	return env;
+}
+
+// model path, provider, intra threads, inter threads, optimized model path
+typedef std::tuple<SileroString, int, int, int, SileroString> session_key;
+
+std::mutex sessions_mutex;
+std::map<session_key, std::weak_ptr<SileroSession>> sessions;
+
+} // namespace
+
+std::shared_ptr<SileroSession> SileroSession::acquire(const SileroString &model_path,
+						      const VadEngineConfig &engine)
+{
+	const session_key key(model_path, engine.provider, engine.intra_threads,
+			      engine.inter_threads, engine.optimized_model_path);
+	// loading under the lock makes a second stream wait for the first load of the model
+	std::lock_guard<std::mutex> lock(sessions_mutex);
+	auto it = sessions.find(key);
+	if (it != sessions.end()) {
+		std::shared_ptr<SileroSession> shared = it->second.lock();
+		if (shared) {
+			return shared;
+		}
+	}
+	// drop the sessions whose last stream is gone
+	for (auto expired = sessions.begin(); expired != sessions.end();) {
+		expired = expired->second.expired() ? sessions.erase(expired) : std::next(expired);
+	}
+	std::shared_ptr<SileroSession> shared = std::make_shared<SileroSession>(model_path, engine);
+	sessions[key] = shared;
+	return shared;
+}
+
+SileroSession::SileroSession(const SileroString &model_path, const VadEngineConfig &engine)
+{
+	init_onnx_model(model_path, engine);
+}
+
+void SileroSession::run(const Ort::Value *inputs, Ort::Value *outputs)
+{
+	session->Run(Ort::RunOptions{nullptr}, input_node_names, inputs, 3, output_node_names,
+		     outputs, 2);
+}
+
+void SileroSession::init_engine_threads(int inter_threads, int intra_threads)
 {
 	// The method should be called in each thread/proc in multi-thread/proc work
 	session_options.SetIntraOpNumThreads(intra_threads);
@@ -116,12 +172,80 @@ void VadIterator::init_engine_threads(int inter_threads, int intra_threads)
 	session_options.SetGraphOptimizationLevel(GraphOptimizationLevel::ORT_ENABLE_ALL);
 };
 
-void VadIterator::init_onnx_model(const SileroString &model_path)
+bool SileroSession::append_execution_provider(int provider)
+{
+	// the providers missing from the ONNX Runtime build throw
+	try {
+		switch (provider) {
+		case VAD_PROVIDER_CUDA: {
+			OrtCUDAProviderOptions cuda_options{};
+			session_options.AppendExecutionProvider_CUDA(cuda_options);
+			break;
+		}
+		case VAD_PROVIDER_DIRECTML:
+			// DirectML does not support the memory patterns nor parallel execution
+			session_options.DisableMemPattern();
+			session_options.SetExecutionMode(ExecutionMode::ORT_SEQUENTIAL);
+			session_options.AppendExecutionProvider("DML");
+			break;
+		case VAD_PROVIDER_COREML:
+			session_options.AppendExecutionProvider("CoreML");
+			break;
+		default:
+			break;
+		}
+	} catch (const Ort::Exception &e) {
+		obs_log(LOG_WARNING,
+			"VAD execution provider %d is not available (%s), using the CPU", provider,
+			e.what());
+		return false;
+	}
+	return true;
+}
+
+void SileroSession::init_onnx_model(const SileroString &model_path, const VadEngineConfig &engine)
 {
-	// Init threads = 1 for
-	init_engine_threads(1, 1);
-	// Load model
-	session = std::make_shared<Ort::Session>(env, model_path.c_str(), session_options);
+	init_engine_threads(std::max(engine.inter_threads, 1), std::max(engine.intra_threads, 1));
+	const bool provider_set = engine.provider == VAD_PROVIDER_CPU ||
+				  append_execution_provider(engine.provider);
+
+	// an optimized model saved by a previous load skips the graph optimizations
+	std::error_code ec;
+	if (provider_set && !engine.optimized_model_path.empty() &&
+	    std::filesystem::exists(engine.optimized_model_path, ec)) {
+		try {
+			Ort::SessionOptions cached_options = session_options.Clone();
+			cached_options.SetGraphOptimizationLevel(
+				GraphOptimizationLevel::ORT_DISABLE_ALL);
+			session = std::make_unique<Ort::Session>(
+				silero_env(), engine.optimized_model_path.c_str(), cached_options);
+			return;
+		} catch (const Ort::Exception &e) {
+			obs_log(LOG_WARNING,
+				"Cannot load the optimized VAD model (%s), optimizing again",
+				e.what());
+			std::filesystem::remove(engine.optimized_model_path, ec);
+		}
+	}
+	if (provider_set && !engine.optimized_model_path.empty()) {
+		session_options.SetOptimizedModelFilePath(engine.optimized_model_path.c_str());
+	}
+	try {
+		session = std::make_unique<Ort::Session>(silero_env(), model_path.c_str(),
+							 session_options);
+	} catch (const Ort::Exception &e) {
+		if (engine.provider == VAD_PROVIDER_CPU) {
+			throw;
+		}
+		obs_log(LOG_WARNING,
+			"Cannot create the VAD session on provider %d (%s), using the CPU",
+			engine.provider, e.what());
+		session_options = Ort::SessionOptions();
+		init_engine_threads(std::max(engine.inter_threads, 1),
+				    std::max(engine.intra_threads, 1));
+		session = std::make_unique<Ort::Session>(silero_env(), model_path.c_str(),
+							 session_options);
+	}
 };
 
 void VadIterator::reset_states(bool reset_state)
@@ -129,8 +253,10 @@ void VadIterator::reset_states(bool reset_state)
 	if (reset_state) {
 		// Call reset before each audio start
 		std::memset(_state.data(), 0.0f, _state.size() * sizeof(float));
+		state_stale = false;
 		triggered = false;
 	}
+	gated_windows = 0;
 	temp_end = 0;
 	current_sample = 0;
 
@@ -140,41 +266,66 @@ void VadIterator::reset_states(bool reset_state)
 	current_speech = timestamp_t();
 };
 
-float VadIterator::predict_one(const std::vector<float> &data)
+void VadIterator::init_tensors()
 {
-	// Infer
-	// Create ort tensors
-	input.assign(data.begin(), data.end());
-	Ort::Value input_ort = Ort::Value::CreateTensor<float>(memory_info, input.data(),
-							       input.size(), input_node_dims, 2);
-	Ort::Value state_ort = Ort::Value::CreateTensor<float>(
-		memory_info, _state.data(), _state.size(), state_node_dims, 3);
-	Ort::Value sr_ort = Ort::Value::CreateTensor<int64_t>(memory_info, sr.data(), sr.size(),
-							      sr_node_dims, 1);
-
-	// Clear and add inputs
+	// Create ort tensors over the preallocated buffers
 	ort_inputs.clear();
-	ort_inputs.emplace_back(std::move(input_ort));
-	ort_inputs.emplace_back(std::move(state_ort));
-	ort_inputs.emplace_back(std::move(sr_ort));
+	ort_inputs.emplace_back(Ort::Value::CreateTensor<float>(memory_info, input.data(),
+								input.size(), input_node_dims, 2));
+	ort_inputs.emplace_back(Ort::Value::CreateTensor<float>(
+		memory_info, _state.data(), _state.size(), state_node_dims, 3));
+	ort_inputs.emplace_back(Ort::Value::CreateTensor<int64_t>(memory_info, sr.data(),
+								  sr.size(), sr_node_dims, 1));
+
+	ort_outputs.clear();
+	ort_outputs.emplace_back(Ort::Value::CreateTensor<float>(
+		memory_info, output.data(), output.size(), output_node_dims, 2));
+	ort_outputs.emplace_back(Ort::Value::CreateTensor<float>(
+		memory_info, _stateN.data(), _stateN.size(), state_node_dims, 3));
+}
 
+float VadIterator::predict_one(const float *data)
+{
 	// Infer
-	ort_outputs = session->Run(Ort::RunOptions{nullptr}, input_node_names.data(),
-				  ort_inputs.data(), ort_inputs.size(), output_node_names.data(),
-				  output_node_names.size());
+	// The input tensor is bound to the input buffer
+	std::memcpy(input.data(), data, window_size_samples * sizeof(float));
+
+	// Infer into the preallocated output tensors
+	session->run(ort_inputs.data(), ort_outputs.data());
 
 	// Output probability & update h,c recursively
-	float speech_prob = ort_outputs[0].GetTensorMutableData<float>()[0];
-	float *stateN = ort_outputs[1].GetTensorMutableData<float>();
-	std::memcpy(_state.data(), stateN, size_state * sizeof(float));
+	float speech_prob = output[0];
+	std::memcpy(_state.data(), _stateN.data(), size_state * sizeof(float));
 
 	return speech_prob;
 }
 
-void VadIterator::predict(const std::vector<float> &data)
+bool VadIterator::gate(const float *data)
 {
-	const float speech_prob = predict_one(data);
+	// the pre-gate measures every window for its noise floor, it only skips the model outside
+	// of speech
+	bool gated = false;
+	if (pre_gate_enabled) {
+		gated = pre_gate.is_noise(data, (size_t)window_size_samples) && !triggered;
+	}
+	if (gated) {
+		gated_windows++;
+		state_stale = true;
+	} else if (state_stale) {
+		// start from the state of the start of a stream, as after a reset
+		std::memset(_state.data(), 0, _state.size() * sizeof(float));
+		state_stale = false;
+	}
+	return gated;
+}
+
+void VadIterator::predict(const float *data)
+{
+	advance(gate(data) ? 0.0f : predict_one(data));
+}
 
+void VadIterator::advance(float speech_prob)
+{
 	// Push forward sample index
 	current_sample += (unsigned int)window_size_samples;
 
@@ -301,19 +452,10 @@ void VadIterator::process(const std::vector<float> &input_wav, bool reset_state)
 	  for (int j = 0; j < audio_length_samples; j += (int)window_size_samples) {
 		  if (j + (int)window_size_samples > audio_length_samples)
 			  break;
-		  std::vector<float> r{&input_wav[0] + j, &input_wav[0] + j + window_size_samples};
-		  predict(r);
+		  predict(input_wav.data() + j);
 	  }
 
-	  if (current_speech.start >= 0) {
-		  current_speech.end = audio_length_samples;
-		  speeches.push_back(current_speech);
-		  current_speech = timestamp_t();
-		  prev_end = 0;
-		  next_start = 0;
-		  temp_end = 0;
-		  triggered = false;
-	  }
+	  finish_process();
 	}
 	catch (const Ort::Exception &e) {
 	  obs_log(LOG_ERROR, "Caught exception when running VAD prediction. Error code: %s, message: %s",
@@ -321,6 +463,19 @@ void VadIterator::process(const std::vector<float> &input_wav, bool reset_state)
 	}
 };
 
+void VadIterator::finish_process()
+{
+	if (current_speech.start >= 0) {
+		current_speech.end = audio_length_samples;
+		speeches.push_back(current_speech);
+		current_speech = timestamp_t();
+		prev_end = 0;
+		next_start = 0;
+		temp_end = 0;
+		triggered = false;
+	}
+}
+
 void VadIterator::process(const std::vector<float> &input_wav, std::vector<float> &output_wav)
 {
 	try {
@@ -369,9 +524,10 @@ void VadIterator::drop_chunks(const std::vector<float> &input_wav, std::vector<f
 
 VadIterator::VadIterator(const SileroString &ModelPath, int Sample_rate, int windows_frame_size,
 			 float Threshold, int min_silence_duration_ms, int speech_pad_ms,
-			 int min_speech_duration_ms, float max_speech_duration_s)
+			 int min_speech_duration_ms, float max_speech_duration_s,
+			 const VadEngineConfig &engine)
 {
-	init_onnx_model(ModelPath);
+	session = SileroSession::acquire(ModelPath, engine);
 	threshold = Threshold;
 	sample_rate = Sample_rate;
 	sr_per_ms = sample_rate / 1000;
@@ -394,4 +550,8 @@ VadIterator::VadIterator(const SileroString &ModelPath, int Sample_rate, int win
 	_state.resize(size_state);
 	sr.resize(1);
 	sr[0] = sample_rate;
+
+	output.resize(1);
+	_stateN.resize(size_state);
+	init_tensors();
 };
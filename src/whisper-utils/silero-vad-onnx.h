@@ -5,6 +5,9 @@
 #include <vector>
 #include <string>
 #include <limits>
+#include <memory>
+
+#include "vad-pre-gate.h"
 
 #ifdef _WIN32
 typedef std::wstring SileroString;
@@ -12,6 +15,58 @@ typedef std::wstring SileroString;
 typedef std::string SileroString;
 #endif
 
+// ONNX Runtime execution provider of the model, the CPU is used when it is not available
+enum VadExecutionProvider {
+	VAD_PROVIDER_CPU = 0,
+	VAD_PROVIDER_CUDA = 1,
+	VAD_PROVIDER_DIRECTML = 2,
+	VAD_PROVIDER_COREML = 3,
+};
+
+struct VadEngineConfig {
+	int provider = VAD_PROVIDER_CPU;
+	int intra_threads = 1;
+	int inter_threads = 1;
+	// the optimized model is saved to this file and loaded from it next time, empty to
+	// optimize the model on each load
+	SileroString optimized_model_path;
+};
+
+/**
+ * @brief Silero model loaded once per process for each model file and engine config.
+ *
+ * The session holds no state of a stream: the recurrent state of the model is an input and an
+ * output of each run, kept by the VadIterator of each stream with its tensors. All the filters
+ * share one copy of the graph and one set of ONNX Runtime thread pools, and Run() may be called
+ * from several threads at once.
+ */
+class SileroSession {
+public:
+	/**
+	 * @brief Get the session of the model, loading it if no stream uses it yet.
+	 *
+	 * @throws Ort::Exception if the model cannot be loaded.
+	 */
+	static std::shared_ptr<SileroSession> acquire(const SileroString &model_path,
+						      const VadEngineConfig &engine);
+
+	SileroSession(const SileroString &model_path, const VadEngineConfig &engine);
+
+	// inputs: input, state, sr; outputs: output, stateN
+	void run(const Ort::Value *inputs, Ort::Value *outputs);
+
+	static constexpr const char *input_node_names[3] = {"input", "state", "sr"};
+	static constexpr const char *output_node_names[2] = {"output", "stateN"};
+
+private:
+	void init_engine_threads(int inter_threads, int intra_threads);
+	bool append_execution_provider(int provider);
+	void init_onnx_model(const SileroString &model_path, const VadEngineConfig &engine);
+
+	Ort::SessionOptions session_options;
+	std::unique_ptr<Ort::Session> session;
+};
+
 class timestamp_t {
 public:
 	int start;
@@ -33,19 +88,19 @@ private:
 
 class VadIterator {
 private:
-	// OnnxRuntime resources
-	Ort::Env env;
-	Ort::SessionOptions session_options;
-	std::shared_ptr<Ort::Session> session = nullptr;
-	Ort::AllocatorWithDefaultOptions allocator;
+	// OnnxRuntime resources, the session is shared by the streams of the same model
+	std::shared_ptr<SileroSession> session = nullptr;
 	Ort::MemoryInfo memory_info = Ort::MemoryInfo::CreateCpu(OrtArenaAllocator, OrtMemTypeCPU);
 
 private:
-	void init_engine_threads(int inter_threads, int intra_threads);
-	void init_onnx_model(const SileroString &model_path);
 	void reset_states(bool reset_state);
-	float predict_one(const std::vector<float> &data);
-	void predict(const std::vector<float> &data);
+	void init_tensors();
+	float predict_one(const float *data);
+	// true if the pre-gate skips the model on the window
+	bool gate(const float *data);
+	void advance(float speech_prob);
+	void predict(const float *data);
+	void finish_process();
 
 public:
 	void process(const std::vector<float> &input_wav, bool reset_state = true);
@@ -54,6 +109,10 @@ public:
 	const std::vector<timestamp_t> get_speech_timestamps() const;
 	void drop_chunks(const std::vector<float> &input_wav, std::vector<float> &output_wav);
 	void set_threshold(float threshold_) { this->threshold = threshold_; }
+	// skip the model on the windows the energy pre-gate finds to be noise, see vad-pre-gate.h
+	void set_pre_gate(bool enabled) { pre_gate_enabled = enabled; }
+	// windows of the last process() the pre-gate skipped
+	int get_gated_windows() const { return gated_windows; }
 
 	int64_t get_window_size_samples() const { return window_size_samples; }
 
@@ -78,15 +137,22 @@ private:
 	int prev_end;
 	int next_start = 0;
 
+	VadPreGate pre_gate;
+	bool pre_gate_enabled = false;
+	int gated_windows = 0;
+	// the model skipped windows since its last run, its state no longer follows the audio
+	bool state_stale = false;
+
 	//Output timestamp
 	std::vector<timestamp_t> speeches;
 	timestamp_t current_speech;
 
 	// Onnx model
+	// The input and output tensors are created once over the buffers below and reused for
+	// every window, so the streaming inference does not allocate
 	// Inputs
 	std::vector<Ort::Value> ort_inputs;
 
-	std::vector<const char *> input_node_names = {"input", "state", "sr"};
 	std::vector<float> input;
 	unsigned int size_state = 2 * 1 * 128; // It's FIXED.
 	std::vector<float> _state;
@@ -98,7 +164,9 @@ private:
 
 	// Outputs
 	std::vector<Ort::Value> ort_outputs;
-	std::vector<const char *> output_node_names = {"output", "stateN"};
+	std::vector<float> output;
+	std::vector<float> _stateN;
+	const int64_t output_node_dims[2] = {1, 1};
 
 public:
 	// Construction
@@ -106,7 +174,8 @@ public:
 		    int windows_frame_size = 32, float Threshold = 0.5,
 		    int min_silence_duration_ms = 0, int speech_pad_ms = 32,
 		    int min_speech_duration_ms = 32,
-		    float max_speech_duration_s = std::numeric_limits<float>::infinity());
+		    float max_speech_duration_s = std::numeric_limits<float>::infinity(),
+		    const VadEngineConfig &engine = VadEngineConfig());
 
 	// Default constructor
 	VadIterator() = default;
@@ -0,0 +1,75 @@
+/**
+ * @file stage-timings.h
+ * @brief Time spent in each stage of the transcription pipeline.
+ *
+ * The pipeline records the stages it runs in gf->pipeline_timings when it is set: the live
+ * metrics of the filter in the plugin, the measurements of a run in the offline benchmark. Each
+ * stage also counts units of work, to report the time per unit: VAD windows for the VAD,
+ * milliseconds of audio for whisper.
+ */
+#ifndef STAGE_TIMINGS_H
+#define STAGE_TIMINGS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+enum PipelineStage {
+	PIPELINE_STAGE_RESAMPLE = 0,
+	PIPELINE_STAGE_VAD,
+	PIPELINE_STAGE_WHISPER,
+	PIPELINE_STAGE_TRANSLATION,
+	PIPELINE_STAGE_OUTPUT,
+	PIPELINE_STAGE_COUNT
+};
+
+struct stage_timings {
+	// updated by the whisper and inference threads, read once they are done
+	std::atomic<uint64_t> total_ns[PIPELINE_STAGE_COUNT] = {};
+	std::atomic<uint64_t> count[PIPELINE_STAGE_COUNT] = {};
+	std::atomic<uint64_t> units[PIPELINE_STAGE_COUNT] = {};
+	// duration of the last run of the stage
+	std::atomic<uint64_t> last_ns[PIPELINE_STAGE_COUNT] = {};
+
+	void add(PipelineStage stage, uint64_t ns, uint64_t units_ = 1)
+	{
+		total_ns[stage].fetch_add(ns, std::memory_order_relaxed);
+		count[stage].fetch_add(1, std::memory_order_relaxed);
+		units[stage].fetch_add(units_, std::memory_order_relaxed);
+		last_ns[stage].store(ns, std::memory_order_relaxed);
+	}
+};
+
+// Records the time of the enclosing scope to the stage, if timings is not null
+class StageTimer {
+public:
+	StageTimer(stage_timings *timings_, PipelineStage stage_) : timings(timings_), stage(stage_)
+	{
+		if (timings != nullptr) {
+			start = std::chrono::steady_clock::now();
+		}
+	}
+	StageTimer(const StageTimer &) = delete;
+	StageTimer &operator=(const StageTimer &) = delete;
+	~StageTimer()
+	{
+		if (timings != nullptr) {
+			timings->add(stage,
+				     (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+					     std::chrono::steady_clock::now() - start)
+					     .count(),
+				     units);
+		}
+	}
+
+	// Units of work of the timed run, 1 by default
+	void set_units(uint64_t units_) { units = units_; }
+
+private:
+	stage_timings *timings;
+	PipelineStage stage;
+	uint64_t units = 1;
+	std::chrono::steady_clock::time_point start;
+};
+
+#endif // STAGE_TIMINGS_H
@@ -0,0 +1,66 @@
+#include "sticky-language.h"
+#include "plugin-support.h"
+
+#include <obs-module.h>
+
+#include <algorithm>
+
+void StickyLanguage::configure(bool enabled, int detections, int recheck_segments)
+{
+	enabled_.store(enabled, std::memory_order_relaxed);
+	detections_.store(std::max(detections, 1), std::memory_order_relaxed);
+	recheck_segments_.store(std::max(recheck_segments, 1), std::memory_order_relaxed);
+}
+
+const char *StickyLanguage::language(bool partial)
+{
+	if (reset_requested.exchange(false, std::memory_order_relaxed)) {
+		locked.clear();
+		candidate.clear();
+		candidate_count = 0;
+		segments_since_check = 0;
+		check_next = false;
+	}
+	if (!enabled_.load(std::memory_order_relaxed) || locked.empty() ||
+	    (check_next && !partial)) {
+		return nullptr;
+	}
+	return locked.c_str();
+}
+
+void StickyLanguage::update(const std::string &language, bool detected, float confidence)
+{
+	if (!enabled_.load(std::memory_order_relaxed) || language.empty()) {
+		return;
+	}
+	if (!detected) {
+		segments_since_check++;
+		if (confidence < STICKY_LANGUAGE_RECHECK_P ||
+		    segments_since_check >= recheck_segments_.load(std::memory_order_relaxed)) {
+			check_next = true;
+		}
+		return;
+	}
+
+	check_next = false;
+	segments_since_check = 0;
+	if (language == candidate) {
+		candidate_count++;
+	} else {
+		candidate = language;
+		candidate_count = 1;
+	}
+	if (!locked.empty()) {
+		if (language != locked) {
+			obs_log(LOG_INFO, "Detected language %s instead of %s, unlocking it",
+				language.c_str(), locked.c_str());
+			locked.clear();
+		}
+		return;
+	}
+	if (candidate_count >= detections_.load(std::memory_order_relaxed)) {
+		locked = candidate;
+		obs_log(LOG_INFO, "Locked the detected language %s after %d detections",
+			locked.c_str(), candidate_count);
+	}
+}
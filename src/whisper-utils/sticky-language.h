@@ -0,0 +1,74 @@
+#ifndef STICKY_LANGUAGE_H
+#define STICKY_LANGUAGE_H
+
+#include <atomic>
+#include <string>
+
+/**
+ * @file sticky-language.h
+ * @brief Locks the automatically detected language after a few consistent detections.
+ *
+ * With the language set to "auto", whisper_full runs a language detection pass (an encoder run
+ * and a decoder step) before each decode. The inference reports the language whisper_full
+ * settled on for every final segment. Once the same language was detected for the configured
+ * number of segments in a row, it is locked: the following segments are decoded with it and
+ * skip the detection. It is checked again (one segment decoded with the detection) when a
+ * segment decoded with the locked language has a low confidence, and after the configured
+ * number of segments. A check that detects another language unlocks it.
+ *
+ * Only the inference thread calls language() and update(), configure() and reset() can be
+ * called from any thread.
+ */
+
+// mean token probability under which a segment decoded with the locked language triggers a check
+#define STICKY_LANGUAGE_RECHECK_P 0.5f
+
+class StickyLanguage {
+public:
+	/**
+	 * @brief Set the settings.
+	 *
+	 * @param enabled Lock the detected language at all.
+	 * @param detections Consistent detections before the language is locked.
+	 * @param recheck_segments Segments decoded with the locked language between two checks.
+	 */
+	void configure(bool enabled, int detections, int recheck_segments);
+
+	/**
+	 * @brief Forget the detections, e.g. when the language setting or the model changed.
+	 */
+	void reset() { reset_requested.store(true, std::memory_order_relaxed); }
+
+	/**
+	 * @brief Language to decode the next segment with, nullptr to detect it.
+	 *
+	 * The pointer is valid until the next update().
+	 *
+	 * @param partial The segment is a partial, partials never run the check.
+	 */
+	const char *language(bool partial);
+
+	/**
+	 * @brief Account for a decoded final segment.
+	 *
+	 * @param language Language of the result.
+	 * @param detected The segment was decoded with the detection, not the locked language.
+	 * @param confidence Mean token probability of the result.
+	 */
+	void update(const std::string &language, bool detected, float confidence);
+
+private:
+	std::atomic<bool> enabled_{false};
+	std::atomic<int> detections_{3};
+	std::atomic<int> recheck_segments_{20};
+	std::atomic<bool> reset_requested{false};
+	// the fields below are only used by the inference thread
+	// empty while not locked
+	std::string locked;
+	std::string candidate;
+	int candidate_count = 0;
+	int segments_since_check = 0;
+	bool check_next = false;
+};
+
+#endif // STICKY_LANGUAGE_H
@@ -3,16 +3,16 @@
 #include <sentencepiece_processor.h>
 
 #include "token-buffer-thread.h"
+#include "plugin-log.h"
 #include "whisper-utils.h"
 #include "transcription-utils.h"
 
 #include <iostream>
-#include <sstream>
+#include <memory>
 #include <string_view>
 
-#include <unicode/schriter.h>
-#include <unicode/unistr.h>
-#include <unicode/uchar.h>
+#include <unicode/brkiter.h>
+#include <unicode/utext.h>
 
 #include <obs-module.h>
 
@@ -25,14 +25,118 @@
 #define NEWLINE "\n"
 #endif
 
+namespace {
+
+// time without new sentences before the added ones are output to the log
+const auto CONTRIBUTION_DEBOUNCE = std::chrono::milliseconds(500);
+// the consumed part of the input text is dropped once it is that long
+const size_t INPUT_COMPACT_THRESHOLD = 4096;
+
+std::string to_utf8(const TokenBufferString &text)
+{
+#ifdef _WIN32
+	int count = WideCharToMultiByte(CP_UTF8, 0, text.c_str(), (int)text.length(), NULL, 0,
+					NULL, NULL);
+	std::string out(count, 0);
+	WideCharToMultiByte(CP_UTF8, 0, text.c_str(), (int)text.length(), &out[0], count, NULL,
+			    NULL);
+	return out;
+#else
+	return text;
+#endif
+}
+
+// whether the code unit continues a code point
+bool is_continuation(TokenBufferChar c)
+{
+#ifdef _WIN32
+	return c >= 0xDC00 && c < 0xE000;
+#else
+	return ((unsigned char)c & 0xC0) == 0x80;
+#endif
+}
+
+bool is_whitespace(TokenBufferChar c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// Split the text into code points, the fallback when ICU cannot be used
+void split_code_points(const TokenBufferString &text, bool is_partial,
+		       std::vector<TokenBufferSpan> &spans)
+{
+	size_t i = 0;
+	while (i < text.length()) {
+		size_t length = 1;
+		// the continuation bytes (low surrogate) of the code point
+		while (i + length < text.length() && is_continuation(text[i + length])) {
+			length++;
+		}
+		spans.push_back({i, length, is_partial});
+		i += length;
+	}
+}
+
+// Split the text into grapheme clusters (user perceived characters)
+void split_graphemes(const TokenBufferString &text, bool is_partial,
+		     std::vector<TokenBufferSpan> &spans)
+{
+	bool ascii = true;
+	for (const TokenBufferChar c : text) {
+		if ((unsigned)c >= 0x80) {
+			ascii = false;
+			break;
+		}
+	}
+	if (ascii) {
+		// one character per byte
+		for (size_t i = 0; i < text.length(); i++) {
+			spans.push_back({i, 1, is_partial});
+		}
+		return;
+	}
+
+	// the iterator is created once per thread, it is expensive to create and not thread safe
+	thread_local std::unique_ptr<icu::BreakIterator> graphemes;
+	UErrorCode status = U_ZERO_ERROR;
+	if (!graphemes) {
+		graphemes.reset(icu::BreakIterator::createCharacterInstance(icu::Locale::getRoot(),
+									    status));
+		if (U_FAILURE(status)) {
+			graphemes.reset();
+		}
+	}
+	// the boundaries are offsets in the text, without converting it
+#ifdef _WIN32
+	UText *utext = utext_openUChars(nullptr, (const UChar *)text.data(),
+					(int64_t)text.length(), &status);
+#else
+	UText *utext = utext_openUTF8(nullptr, text.data(), (int64_t)text.length(), &status);
+#endif
+	if (graphemes && U_SUCCESS(status)) {
+		graphemes->setText(utext, status);
+	}
+	if (!graphemes || U_FAILURE(status)) {
+		utext_close(utext);
+		split_code_points(text, is_partial, spans);
+		return;
+	}
+	int32_t start = graphemes->first();
+	for (int32_t end = graphemes->next(); end != icu::BreakIterator::DONE;
+	     start = end, end = graphemes->next()) {
+		spans.push_back({(size_t)start, (size_t)(end - start), is_partial});
+	}
+	utext_close(utext);
+}
+
+} // namespace
+
 TokenBufferThread::TokenBufferThread() noexcept
 	: gf(nullptr),
 	  numSentences(2),
 	  numPerSentence(30),
 	  maxTime(0),
 	  stop(true),
-	  presentationQueueMutex(),
-	  inputQueueMutex(),
 	  segmentation(SEGMENTATION_TOKEN)
 {
 }
@@ -55,16 +159,16 @@ void TokenBufferThread::initialize(
 	this->segmentation = segmentation_;
 	this->maxTime = maxTime_;
 	this->stop = false;
-	this->workerThread = std::thread(&TokenBufferThread::monitor, this);
 	this->lastContributionTime = std::chrono::steady_clock::now();
 	this->lastCaptionTime = std::chrono::steady_clock::now();
+	this->workerThread = std::thread(&TokenBufferThread::monitor, this);
 }
 
 void TokenBufferThread::stopThread()
 {
 	try {
 		{
-			std::lock_guard<std::mutex> lock(presentationQueueMutex);
+			std::lock_guard<std::mutex> lock(mutex);
 			stop = true;
 		}
 		cv.notify_all();
@@ -93,7 +197,30 @@ void TokenBufferThread::addSentenceFromStdString(const std::string &sentence,
 						 TokenBufferTimePoint start_time,
 						 TokenBufferTimePoint end_time, bool is_partial)
 {
+	// the sentences are presented when they are added, their audio time is not used
+	UNUSED_PARAMETER(start_time);
+	UNUSED_PARAMETER(end_time);
 	obs_log(LOG_DEBUG, "TokenBufferThread::addSentenceFromStdString: '%s'", sentence.c_str());
+	addSentenceSpans(sentence, is_partial, nullptr, nullptr);
+}
+
+void TokenBufferThread::addTimedSentence(const std::string &sentence,
+					 const std::vector<std::string> &token_texts,
+					 const std::vector<TokenBufferTimePoint> &token_times,
+					 bool is_partial)
+{
+	obs_log(LOG_DEBUG, "TokenBufferThread::addTimedSentence: '%s'", sentence.c_str());
+	if (token_texts.empty() || token_texts.size() != token_times.size()) {
+		addSentenceSpans(sentence, is_partial, nullptr, nullptr);
+		return;
+	}
+	addSentenceSpans(sentence, is_partial, &token_texts, &token_times);
+}
+
+void TokenBufferThread::addSentenceSpans(const std::string &sentence, bool is_partial,
+					 const std::vector<std::string> *token_texts,
+					 const std::vector<TokenBufferTimePoint> *token_times)
+{
 	try {
 		if (sentence.empty()) {
 			return;
@@ -109,57 +236,88 @@ void TokenBufferThread::addSentenceFromStdString(const std::string &sentence,
 		TokenBufferString sentence_ws = sentence;
 #endif
 
-		TokenBufferSentence sentence_for_add;
-		sentence_for_add.start_time = start_time;
-		sentence_for_add.end_time = end_time;
-
-		if (this->segmentation == SEGMENTATION_WORD) {
-			// split the sentence to words
-			std::vector<TokenBufferString> words;
-			std::basic_istringstream<TokenBufferString::value_type> iss(sentence_ws);
-			TokenBufferString word_token;
-			while (iss >> word_token) {
-				words.push_back(word_token);
+		// the end offsets of the tokens in their concatenation
+		thread_local std::vector<size_t> token_ends;
+		std::chrono::milliseconds delay{0};
+		if (token_texts != nullptr) {
+			token_ends.clear();
+			size_t end = 0;
+			for (const auto &token : *token_texts) {
+				end += token.length();
+				token_ends.push_back(end);
 			}
-			// add the words to a sentence
-			for (const auto &word : words) {
-				sentence_for_add.tokens.push_back({word, is_partial});
-				sentence_for_add.tokens.push_back({SPACE, is_partial});
+			std::lock_guard<std::mutex> lock(this->mutex);
+			delay = this->presentationDelay;
+		}
+		// the time the text up to the offset was spoken: the offset in the text is mapped
+		// to the same relative offset in the tokens, interpolated in the token
+		const auto set_reveal_time = [&](TokenBufferSpan &span, size_t source_end) {
+			if (token_texts == nullptr || token_ends.back() == 0) {
+				return;
+			}
+			const double position = (double)token_ends.back() * (double)source_end /
+						(double)sentence_ws.length();
+			size_t i = 0;
+			while (i + 1 < token_ends.size() && (double)token_ends[i] < position) {
+				i++;
+			}
+			const size_t start = i > 0 ? token_ends[i - 1] : 0;
+			const TokenBufferTimePoint from = (*token_times)[i > 0 ? i - 1 : 0];
+			const TokenBufferTimePoint to = (*token_times)[i];
+			const double length = (double)(token_ends[i] - start);
+			const double into = position - (double)start;
+			const double fraction = length > 0 ? std::min(1.0, into / length) : 1.0;
+			span.timed = true;
+			span.reveal_time =
+				from +
+				std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+					(to - from) * fraction) +
+				delay;
+		};
+
+		// the tokens as ranges of the text, the scratch is reused by the calling thread
+		thread_local std::vector<TokenBufferSpan> spans;
+		spans.clear();
+		spans.reserve(sentence_ws.length() + 1);
+		if (this->segmentation == SEGMENTATION_WORD) {
+			// split the sentence to words, separated by one space
+			TokenBufferString text;
+			text.reserve(sentence_ws.length() + 1);
+			size_t i = 0;
+			while (i < sentence_ws.length()) {
+				if (is_whitespace(sentence_ws[i])) {
+					i++;
+					continue;
+				}
+				const size_t start = i;
+				while (i < sentence_ws.length() && !is_whitespace(sentence_ws[i])) {
+					i++;
+				}
+				spans.push_back({text.size(), i - start, is_partial});
+				set_reveal_time(spans.back(), i);
+				text.append(sentence_ws, start, i - start);
+				spans.push_back({text.size(), 1, is_partial});
+				set_reveal_time(spans.back(), i);
+				text += SPACE;
 			}
+			addTokens(text, spans);
 		} else if (this->segmentation == SEGMENTATION_TOKEN) {
 			// split to characters
-			std::vector<TokenBufferString> characters;
-#ifdef _WIN32
-			icu::UnicodeString ustr = sentence_ws.c_str();
-			std::wstring_view char_str;
-#else
-			icu::UnicodeString ustr = icu::UnicodeString::fromUTF8(sentence_ws);
-			std::string char_str;
-#endif
-			icu::StringCharacterIterator it{ustr};
-			for (auto c = it.firstPostInc(); c != icu::StringCharacterIterator::DONE;
-			     c = it.nextPostInc()) {
-				icu::UnicodeString chr = c;
-#ifdef _WIN32
-				char_str = chr;
-#else
-				chr.toUTF8String(char_str);
-#endif
-				characters.push_back(TokenBufferString(char_str));
-			}
-			// add the characters to a sentece
-			for (const auto &character : characters) {
-				sentence_for_add.tokens.push_back({character, is_partial});
+			split_graphemes(sentence_ws, is_partial, spans);
+			for (auto &span : spans) {
+				set_reveal_time(span, span.offset + span.length);
 			}
+			addTokens(sentence_ws, spans);
 		} else {
 			// add the whole sentence as a single token
-			sentence_for_add.tokens.push_back({sentence_ws, is_partial});
-			sentence_for_add.tokens.push_back({SPACE, is_partial});
+			spans.push_back({0, sentence_ws.length(), is_partial});
+			set_reveal_time(spans.back(), sentence_ws.length());
+			spans.push_back({sentence_ws.length(), 1, is_partial});
+			set_reveal_time(spans.back(), sentence_ws.length());
+			addTokens(sentence_ws + SPACE, spans);
 		}
-		addSentence(sentence_for_add);
 	} catch (const std::exception &e) {
-		obs_log(LOG_ERROR, "TokenBufferThread::addSentenceFromStdString: error - %s",
-			e.what());
+		obs_log(LOG_ERROR, "TokenBufferThread::addSentenceSpans: error - %s", e.what());
 	}
 }
 
@@ -167,280 +325,337 @@ void TokenBufferThread::addSentence(const TokenBufferSentence &sentence)
 {
 	obs_log(LOG_DEBUG, "TokenBufferThread::addSentence");
 	try {
-		std::lock_guard<std::mutex> lock(this->inputQueueMutex);
+		TokenBufferString text;
+		std::vector<TokenBufferSpan> spans;
+		spans.reserve(sentence.tokens.size());
+		for (const auto &token : sentence.tokens) {
+			spans.push_back({text.size(), token.token.length(), token.is_partial});
+			text += token.token;
+		}
+		addTokens(text, spans);
+	} catch (const std::exception &e) {
+		obs_log(LOG_ERROR, "TokenBufferThread::addSentence: error - %s", e.what());
+	}
+}
 
-		// add the tokens to the inputQueue
-		for (const auto &character : sentence.tokens) {
-			inputQueue.push_back(character);
+void TokenBufferThread::addTokens(const TokenBufferString &text,
+				  const std::vector<TokenBufferSpan> &spans)
+{
+	if (spans.empty()) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(this->mutex);
+
+		// partial tokens still waiting are superseded by the new sentence
+		while (!inputTokens.empty() && inputTokens.back().is_partial) {
+			inputTokens.pop_back();
+		}
+		if (inputTokens.empty()) {
+			inputText.clear();
+		} else {
+			inputText.resize(inputTokens.back().offset + inputTokens.back().length);
 		}
-		inputQueue.push_back({SPACE, sentence.tokens.back().is_partial});
+		replacePartial = true;
 
-		// add to the contribution queue as well
-		for (const auto &character : sentence.tokens) {
-			contributionQueue.push_back(character);
+		// add the tokens to the input
+		const size_t base = inputText.size();
+		for (const auto &span : spans) {
+			inputTokens.push_back(span);
+			inputTokens.back().offset += base;
 		}
-		contributionQueue.push_back({SPACE, sentence.tokens.back().is_partial});
+		inputText += text;
+		// the separator, presented with the last token
+		inputTokens.push_back(spans.back());
+		inputTokens.back().offset = inputText.size();
+		inputTokens.back().length = 1;
+		inputText += SPACE;
+		contribution += text;
+		contribution += SPACE;
 		this->lastContributionTime = std::chrono::steady_clock::now();
-	} catch (const std::exception &e) {
-		obs_log(LOG_ERROR, "TokenBufferThread::addSentence: error - %s", e.what());
+		newDataAvailable = true;
 	}
+	cv.notify_all();
 }
 
 void TokenBufferThread::clear()
 {
 	try {
+		std::function<void(std::string)> callback;
 		{
-			std::lock_guard<std::mutex> lock(inputQueueMutex);
-			inputQueue.clear();
+			std::lock_guard<std::mutex> lock(mutex);
+			inputTokens.clear();
+			inputText.clear();
+			clearPresentation();
+			this->lastCaption = "";
+			this->lastCaptionTime = std::chrono::steady_clock::now();
+			newDataAvailable = true;
+			callback = this->captionPresentationCallback;
 		}
-		{
-			std::lock_guard<std::mutex> lock(presentationQueueMutex);
-			presentationQueue.clear();
-		}
-		this->lastCaption = "";
-		this->lastCaptionTime = std::chrono::steady_clock::now();
-		this->captionPresentationCallback("");
+		cv.notify_all();
+		callback("");
 	} catch (const std::exception &e) {
 		obs_log(LOG_ERROR, "TokenBufferThread::clear: error - %s", e.what());
 	}
 }
 
-void TokenBufferThread::monitor()
+void TokenBufferThread::clearPresentation()
 {
-	obs_log(LOG_INFO, "TokenBufferThread::monitor");
+	lines.clear();
+	partialTokens.clear();
+	partialText.clear();
+	replacePartial = false;
+	captionChanged = false;
+}
 
-	try {
-		this->captionPresentationCallback("");
+bool TokenBufferThread::isSpace(const TokenBufferSpan &span) const
+{
+	return span.length == 1 && inputText[span.offset] == SPACE[0];
+}
+
+void TokenBufferThread::popInput()
+{
+	inputTokens.pop_front();
+	if (inputTokens.empty()) {
+		inputText.clear();
+		return;
+	}
+	const size_t consumed = inputTokens.front().offset;
+	if (consumed > INPUT_COMPACT_THRESHOLD && consumed > inputText.size() / 2) {
+		inputText.erase(0, consumed);
+		for (auto &span : inputTokens) {
+			span.offset -= consumed;
+		}
+	}
+}
+
+void TokenBufferThread::presentToken(const TokenBufferSpan &span)
+{
+	if (replacePartial) {
+		// the presented partial sentence is replaced by the new one
+		partialTokens.clear();
+		partialText.clear();
+		replacePartial = false;
+	}
+	const TokenBufferChar *token = inputText.data() + span.offset;
+	if (span.is_partial) {
+		partialTokens.push_back({partialText.size(), span.length, true});
+		partialText.append(token, span.length);
+	} else {
+		appendToken(lines, token, span.length);
+	}
+	captionChanged = true;
+}
 
-		while (true) {
-			std::string caption_out;
+void TokenBufferThread::presentNext()
+{
+	if (this->segmentation == SEGMENTATION_SENTENCE) {
+		// present all the input
+		while (!inputTokens.empty()) {
+			presentToken(inputTokens.front());
+			popInput();
+		}
+	} else if (this->segmentation == SEGMENTATION_TOKEN) {
+		// present one token
+		presentToken(inputTokens.front());
+		popInput();
+	} else {
+		// SEGMENTATION_WORD
+		// skip spaces in the beginning of the input
+		while (!inputTokens.empty() && isSpace(inputTokens.front())) {
+			popInput();
+		}
+		// present one word
+		if (!inputTokens.empty()) {
+			presentToken(inputTokens.front());
+			popInput();
+		}
+	}
+}
 
-			{
-				std::lock_guard<std::mutex> lockPresentation(
-					presentationQueueMutex);
-				if (stop) {
+void TokenBufferThread::appendToken(std::deque<TokenBufferLine> &target,
+				    const TokenBufferChar *token, size_t length) const
+{
+	if (target.empty()) {
+		target.emplace_back();
+	}
+	if (this->segmentation == SEGMENTATION_WORD) {
+		// numPerSentence words per line
+		if (this->numPerSentence > 0 && target.back().words >= this->numPerSentence) {
+			target.emplace_back();
+		}
+		target.back().text.append(token, length);
+		target.back().text += SPACE;
+		target.back().words++;
+	} else {
+		// skip spaces in the beginning of a line
+		if (length == 1 && token[0] == SPACE[0] && target.back().text.empty()) {
+			return;
+		}
+		target.back().text.append(token, length);
+		// numPerSentence characters per line: a broken word is moved to the next line
+		while (this->numPerSentence > 0 &&
+		       target.back().text.length() >= this->numPerSentence) {
+			TokenBufferString &line = target.back().text;
+			size_t cut = line.find_last_of(SPACE, this->numPerSentence);
+			size_t skip = 1;
+			if (cut == TokenBufferString::npos) {
+				// no space: break the word at the width, between two characters
+				cut = this->numPerSentence;
+				skip = 0;
+				while (cut > 0 && is_continuation(line[cut])) {
+					cut--;
+				}
+				if (cut == 0) {
 					break;
 				}
+			}
+			TokenBufferString next = line.substr(cut + skip);
+			line.resize(cut);
+			target.push_back({std::move(next), 0});
+		}
+	}
+	// only the last numSentences lines are shown
+	while (target.size() > std::max<size_t>(this->numSentences, 1)) {
+		target.pop_front();
+	}
+}
 
-				// condition presentation queue
-				if (presentationQueue.size() ==
-				    this->numSentences * this->numPerSentence) {
-					// pop a whole sentence from the presentation queue front
-					for (size_t i = 0; i < this->numPerSentence; i++) {
-						presentationQueue.pop_front();
-					}
-					if (this->segmentation == SEGMENTATION_TOKEN) {
-						// pop tokens until a space is found
-						while (!presentationQueue.empty() &&
-						       presentationQueue.front().token != SPACE) {
-							presentationQueue.pop_front();
-						}
-					}
-				}
+void TokenBufferThread::renderCaption(std::string &caption_out)
+{
+	caption_out.clear();
+	if (lines.empty() && partialTokens.empty()) {
+		return;
+	}
+	const std::deque<TokenBufferLine> *shown = &lines;
+	if (!partialTokens.empty()) {
+		// at most numSentences lines are copied, whatever was presented before
+		renderLines = lines;
+		for (const auto &span : partialTokens) {
+			appendToken(renderLines, partialText.data() + span.offset, span.length);
+		}
+		shown = &renderLines;
+	}
 
-				{
-					std::lock_guard<std::mutex> lock(inputQueueMutex);
-
-					if (!inputQueue.empty()) {
-						// if the input on the inputQueue is partial - first remove all partials
-						// from the end of the presentation queue
-						while (!presentationQueue.empty() &&
-						       presentationQueue.back().is_partial) {
-							presentationQueue.pop_back();
-						}
-
-						// if there are token on the input queue
-						// then add to the presentation queue based on the segmentation
-						if (this->segmentation == SEGMENTATION_SENTENCE) {
-							// add all the tokens from the input queue to the presentation queue
-							for (const auto &token : inputQueue) {
-								presentationQueue.push_back(token);
-							}
-							inputQueue.clear();
-						} else if (this->segmentation ==
-							   SEGMENTATION_TOKEN) {
-							// add one token to the presentation queue
-							presentationQueue.push_back(
-								inputQueue.front());
-							inputQueue.pop_front();
-						} else {
-							// SEGMENTATION_WORD
-							// skip spaces in the beginning of the input queue
-							while (!inputQueue.empty() &&
-							       inputQueue.front().token == SPACE) {
-								inputQueue.pop_front();
-							}
-							// add one word to the presentation queue
-							TokenBufferToken word;
-							while (!inputQueue.empty() &&
-							       inputQueue.front().token != SPACE) {
-								word = inputQueue.front();
-								inputQueue.pop_front();
-							}
-							presentationQueue.push_back(word);
-						}
-					}
-				}
+	caption.clear();
+	for (const auto &line : *shown) {
+		if (!line.text.empty()) {
+			caption += trim<TokenBufferString>(line.text);
+		}
+		caption += NEWLINE;
+	}
+	// if there are less lines than numSentences - add empty lines
+	for (size_t i = shown->size(); i < this->numSentences; i++) {
+		caption += NEWLINE;
+	}
+	caption_out = to_utf8(caption);
+}
 
-				if (presentationQueue.size() > 0) {
-					// build a caption from the presentation queue in sentences
-					// with a maximum of numPerSentence tokens/words per sentence
-					// and a newline between sentences
-					std::vector<TokenBufferString> sentences(1);
-
-					if (this->segmentation == SEGMENTATION_WORD) {
-						// add words from the presentation queue to the sentences
-						// if a sentence is full - start a new one
-						size_t wordsInSentence = 0;
-						for (size_t i = 0; i < presentationQueue.size();
-						     i++) {
-							const auto &word = presentationQueue[i];
-							sentences.back() += word.token + SPACE;
-							wordsInSentence++;
-							if (wordsInSentence ==
-							    this->numPerSentence) {
-								sentences.push_back(
-									TokenBufferString());
-							}
-						}
-					} else {
-						// iterate through the presentation queue tokens and build a caption
-						for (size_t i = 0; i < presentationQueue.size();
-						     i++) {
-							const auto &token = presentationQueue[i];
-							// skip spaces in the beginning of a sentence (tokensInSentence == 0)
-							if (token.token == SPACE &&
-							    sentences.back().length() == 0) {
-								continue;
-							}
-
-							sentences.back() += token.token;
-							if (sentences.back().length() ==
-							    this->numPerSentence) {
-								// if the next character is not a space - this is a broken word
-								// roll back to the last space, replace it with a newline
-								size_t lastSpace =
-									sentences.back()
-										.find_last_of(
-											SPACE);
-								sentences.push_back(
-									sentences.back().substr(
-										lastSpace + 1));
-								sentences[sentences.size() - 2] =
-									sentences[sentences.size() -
-										  2]
-										.substr(0,
-											lastSpace);
-							}
-						}
-					}
+void TokenBufferThread::monitor()
+{
+	obs_log(LOG_INFO, "TokenBufferThread::monitor");
 
-					TokenBufferString caption;
-					// if there are more sentences than numSentences - remove the oldest ones
-					while (sentences.size() > this->numSentences) {
-						sentences.erase(sentences.begin());
-					}
-					// if there are less sentences than numSentences - add empty sentences
-					while (sentences.size() < this->numSentences) {
-						sentences.push_back(TokenBufferString());
-					}
-					// build the caption from the sentences
-					for (const auto &sentence : sentences) {
-						if (!sentence.empty()) {
-							caption +=
-								trim<TokenBufferString>(sentence);
-						}
-						caption += NEWLINE;
+	try {
+		std::unique_lock<std::mutex> lock(mutex);
+		std::function<void(std::string)> callback = this->captionPresentationCallback;
+		lock.unlock();
+		callback("");
+		lock.lock();
+
+		TokenBufferTimePoint nextTokenTime = std::chrono::steady_clock::now();
+		std::string caption_out;
+		while (!stop) {
+			auto now = std::chrono::steady_clock::now();
+
+			if (!inputTokens.empty() && inputTokens.front().timed) {
+				// present all the timed tokens that are due
+				while (!inputTokens.empty() && inputTokens.front().timed &&
+				       inputTokens.front().reveal_time <= now) {
+					if (this->segmentation != SEGMENTATION_WORD ||
+					    !isSpace(inputTokens.front())) {
+						presentToken(inputTokens.front());
 					}
-
-#ifdef _WIN32
-					// convert caption to multibyte for obs
-					int count = WideCharToMultiByte(CP_UTF8, 0, caption.c_str(),
-									(int)caption.length(), NULL,
-									0, NULL, NULL);
-					caption_out = std::string(count, 0);
-					WideCharToMultiByte(CP_UTF8, 0, caption.c_str(),
-							    (int)caption.length(), &caption_out[0],
-							    count, NULL, NULL);
-#else
-					caption_out = std::string(caption.begin(), caption.end());
-#endif
+					popInput();
 				}
+				nextTokenTime = now;
+			} else if (!inputTokens.empty() && now >= nextTokenTime) {
+				presentNext();
+				// check the input size, if it's big - present faster
+				nextTokenTime = now + std::chrono::milliseconds(
+							      inputTokens.size() > 30
+								      ? getWaitTime(SPEED_FAST)
+							      : inputTokens.size() > 15
+								      ? getWaitTime(SPEED_NORMAL)
+								      : getWaitTime(SPEED_SLOW));
 			}
 
-			if (this->stop) {
-				break;
+			bool emit = false;
+			if (captionChanged) {
+				captionChanged = false;
+				renderCaption(caption_out);
+				if (caption_out.empty()) {
+					this->lastCaption = "";
+					this->lastCaptionTime = now;
+				} else if (caption_out != this->lastCaption) {
+					this->lastCaption = caption_out;
+					this->lastCaptionTime = now;
+					emit = true;
+				}
+			} else if (!this->lastCaption.empty() && this->maxTime.count() > 0 &&
+				   now - this->lastCaptionTime >= this->maxTime) {
+				// no new caption for max_time - clear the presentation, the timed
+				// tokens still to come are kept
+				if (inputTokens.empty() || !inputTokens.front().timed) {
+					inputTokens.clear();
+					inputText.clear();
+				}
+				clearPresentation();
+				this->lastCaption = "";
+				this->lastCaptionTime = now;
+				caption_out.clear();
+				emit = true;
 			}
 
-			const auto now = std::chrono::steady_clock::now();
-
-			// check if enough time passed since last contribution (debounce)
-			const auto durationSinceLastContribution =
-				std::chrono::duration_cast<std::chrono::seconds>(
-					now - this->lastContributionTime);
-			if (durationSinceLastContribution > std::chrono::milliseconds(500)) {
-				if (!lastContributionIsSent) {
-					// take the contribution queue and send it to the output
-					TokenBufferString contribution;
-					for (const auto &token : contributionQueue) {
-						contribution += token.token;
-					}
-					contributionQueue.clear();
-#ifdef _WIN32
-					// convert caption to multibyte for obs
-					int count = WideCharToMultiByte(CP_UTF8, 0,
-									contribution.c_str(),
-									(int)contribution.length(),
-									NULL, 0, NULL, NULL);
-					std::string contribution_out = std::string(count, 0);
-					WideCharToMultiByte(CP_UTF8, 0, contribution.c_str(),
-							    (int)contribution.length(),
-							    &contribution_out[0], count, NULL,
-							    NULL);
-#else
-					std::string contribution_out(contribution.begin(),
-								     contribution.end());
-#endif
-
-					obs_log(gf->log_level,
-						"TokenBufferThread::monitor: output '%s'",
-						contribution_out.c_str());
-					lastContributionIsSent = true;
-				}
-			} else {
-				lastContributionIsSent = false;
+			// output the added sentences once no new one came for a while (debounce)
+			if (!contribution.empty() &&
+			    now - this->lastContributionTime >= CONTRIBUTION_DEBOUNCE) {
+				OBS_LOG(gf->log_level, "TokenBufferThread::monitor: output '%s'",
+					to_utf8(contribution).c_str());
+				contribution.clear();
 			}
 
-			if (caption_out.empty()) {
-				// if no caption was built, sleep for a while
-				this->lastCaption = "";
-				this->lastCaptionTime = now;
-				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+			if (emit) {
+				callback = this->captionPresentationCallback;
+				lock.unlock();
+				callback(caption_out);
+				lock.lock();
 				continue;
 			}
 
-			if (caption_out == lastCaption) {
-				// if it has been max_time since the last caption - clear the presentation queue
-				const auto duration =
-					std::chrono::duration_cast<std::chrono::seconds>(
-						now - this->lastCaptionTime);
-				if (this->maxTime.count() > 0) {
-					if (duration > this->maxTime) {
-						this->clear();
-					}
-				}
+			// sleep until the next token, the caption expiry or the contribution output
+			bool hasDeadline = false;
+			TokenBufferTimePoint deadline;
+			const auto addDeadline = [&](TokenBufferTimePoint time) {
+				deadline = hasDeadline ? std::min(deadline, time) : time;
+				hasDeadline = true;
+			};
+			if (!inputTokens.empty()) {
+				const TokenBufferSpan &next = inputTokens.front();
+				addDeadline(next.timed ? next.reveal_time : nextTokenTime);
+			}
+			if (!this->lastCaption.empty() && this->maxTime.count() > 0) {
+				addDeadline(this->lastCaptionTime + this->maxTime);
+			}
+			if (!contribution.empty()) {
+				addDeadline(this->lastContributionTime + CONTRIBUTION_DEBOUNCE);
+			}
+			const auto woken = [this] { return stop || newDataAvailable; };
+			if (hasDeadline) {
+				cv.wait_until(lock, deadline, woken);
 			} else {
-				// emit the caption
-				this->captionPresentationCallback(caption_out);
-				this->lastCaption = caption_out;
-				this->lastCaptionTime = now;
+				cv.wait(lock, woken);
 			}
-
-			// check the input queue size (iqs), if it's big - sleep less
-			std::this_thread::sleep_for(std::chrono::milliseconds(
-				inputQueue.size() > 30   ? getWaitTime(SPEED_FAST)
-				: inputQueue.size() > 15 ? getWaitTime(SPEED_NORMAL)
-							 : getWaitTime(SPEED_SLOW)));
+			newDataAvailable = false;
 		}
 	} catch (const std::exception &e) {
 		obs_log(LOG_ERROR, "TokenBufferThread::monitor: error - %s", e.what());
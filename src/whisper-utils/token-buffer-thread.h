@@ -1,7 +1,8 @@
 #ifndef TOKEN_BUFFER_THREAD_H
 #define TOKEN_BUFFER_THREAD_H
 
-#include <queue>
+#include <atomic>
+#include <deque>
 #include <vector>
 #include <chrono>
 #include <thread>
@@ -39,12 +40,33 @@ struct TokenBufferToken {
 	bool is_partial;
 };
 
+// A token of the input: a range of the input text
+struct TokenBufferSpan {
+	size_t offset;
+	size_t length;
+	bool is_partial;
+	// timed tokens are presented at their reveal time, the others at the presentation pace
+	bool timed = false;
+	TokenBufferTimePoint reveal_time{};
+};
+
+// A rendered line of the caption
+struct TokenBufferLine {
+	TokenBufferString text;
+	// words on the line, for SEGMENTATION_WORD
+	size_t words = 0;
+};
+
 struct TokenBufferSentence {
 	std::vector<TokenBufferToken> tokens;
 	TokenBufferTimePoint start_time;
 	TokenBufferTimePoint end_time;
 };
 
+// Presents the added sentences token by token (or word by word, or whole sentences) on
+// numSentences lines of numPerSentence characters (words), and clears them after maxTime
+// without a new caption. The monitor thread sleeps until the next token is due, new input
+// arrives or the caption expires.
 class TokenBufferThread {
 public:
 	// default constructor
@@ -59,22 +81,49 @@ public:
 
 	void addSentenceFromStdString(const std::string &sentence, TokenBufferTimePoint start_time,
 				      TokenBufferTimePoint end_time, bool is_partial = false);
+	// Add a sentence presented in time with the audio: each token is revealed at the time
+	// its text was spoken plus the presentation delay. The times are steady clock times of
+	// the tokens of token_texts; the text may differ from their concatenation (filters), it
+	// is mapped to them by position.
+	void addTimedSentence(const std::string &sentence,
+			      const std::vector<std::string> &token_texts,
+			      const std::vector<TokenBufferTimePoint> &token_times,
+			      bool is_partial = false);
 	void addSentence(const TokenBufferSentence &sentence);
 	void clear();
 	void stopThread();
 
 	bool isEnabled() const { return !stop; }
 
-	void setNumSentences(size_t numSentences_) { numSentences = numSentences_; }
-	void setNumPerSentence(size_t numPerSentence_) { numPerSentence = numPerSentence_; }
-	void setMaxTime(std::chrono::seconds maxTime_) { maxTime = maxTime_; }
+	void setNumSentences(size_t numSentences_)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		numSentences = numSentences_;
+	}
+	void setNumPerSentence(size_t numPerSentence_)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		numPerSentence = numPerSentence_;
+	}
+	void setMaxTime(std::chrono::seconds maxTime_)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		maxTime = maxTime_;
+	}
+	void setPresentationDelay(std::chrono::milliseconds presentationDelay_)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		presentationDelay = presentationDelay_;
+	}
 	void setSegmentation(TokenBufferSegmentation segmentation_)
 	{
+		std::lock_guard<std::mutex> lock(mutex);
 		segmentation = segmentation_;
 	}
 	void setCaptionPresentationCallback(
 		std::function<void(const std::string &)> captionPresentationCallback_)
 	{
+		std::lock_guard<std::mutex> lock(mutex);
 		this->captionPresentationCallback = captionPresentationCallback_;
 	}
 
@@ -82,16 +131,46 @@ private:
 	void monitor();
 	void log_token_vector(const std::vector<std::string> &tokens);
 	int getWaitTime(TokenBufferSpeed speed) const;
+	void addSentenceSpans(const std::string &sentence, bool is_partial,
+			      const std::vector<std::string> *token_texts,
+			      const std::vector<TokenBufferTimePoint> *token_times);
+	void addTokens(const TokenBufferString &text, const std::vector<TokenBufferSpan> &spans);
+	// the methods below are called with the mutex held
+	bool isSpace(const TokenBufferSpan &span) const;
+	void popInput();
+	void presentToken(const TokenBufferSpan &span);
+	void presentNext();
+	void appendToken(std::deque<TokenBufferLine> &target, const TokenBufferChar *token,
+			 size_t length) const;
+	void renderCaption(std::string &caption_out);
+	void clearPresentation();
+
 	struct transcription_filter_data *gf;
-	std::deque<TokenBufferToken> inputQueue;
-	std::deque<TokenBufferToken> presentationQueue;
-	std::deque<TokenBufferToken> contributionQueue;
+	// tokens waiting to be presented, as ranges of inputText
+	std::deque<TokenBufferSpan> inputTokens;
+	TokenBufferString inputText;
+	// the presented tokens: the last numSentences lines of the final ones, and the partial
+	// tokens after them as ranges of partialText
+	std::deque<TokenBufferLine> lines;
+	std::vector<TokenBufferSpan> partialTokens;
+	TokenBufferString partialText;
+	// a new sentence was added: the presented partial tokens are replaced by its tokens
+	bool replacePartial = false;
+	bool captionChanged = false;
+	// scratch buffers of renderCaption
+	std::deque<TokenBufferLine> renderLines;
+	TokenBufferString caption;
+	// the added sentences since the last output to the log
+	TokenBufferString contribution;
 	std::thread workerThread;
-	std::mutex inputQueueMutex;
-	std::mutex presentationQueueMutex;
+	// guards all the state, the callback is called without it
+	std::mutex mutex;
 	std::function<void(std::string)> captionPresentationCallback;
+	// wakes the monitor on new input and on stop
 	std::condition_variable cv;
 	std::chrono::seconds maxTime;
+	// added to the reveal time of the timed tokens
+	std::chrono::milliseconds presentationDelay{0};
 	std::atomic<bool> stop;
 	bool newDataAvailable = false;
 	size_t numSentences;
@@ -101,7 +180,6 @@ private:
 	TokenBufferTimePoint lastCaptionTime;
 	// timestamp of the last contribution
 	TokenBufferTimePoint lastContributionTime;
-	bool lastContributionIsSent = false;
 	std::string lastCaption;
 };
 
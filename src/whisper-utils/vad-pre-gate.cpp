@@ -0,0 +1,95 @@
+#include "vad-pre-gate.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define VAD_PRE_GATE_SSE2
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define VAD_PRE_GATE_NEON
+#include <arm_neon.h>
+#endif
+
+// Sum of the squares and number of sign changes of the samples
+static void measure(const float *x, size_t n, float &sum_squares, size_t &crossings)
+{
+	sum_squares = 0.0f;
+	crossings = 0;
+	if (n == 0) {
+		return;
+	}
+	size_t i = 0;
+#if defined(VAD_PRE_GATE_SSE2)
+	__m128 acc = _mm_setzero_ps();
+	__m128i count = _mm_setzero_si128();
+	const __m128 zero = _mm_setzero_ps();
+	for (; i + 4 <= n; i += 4) {
+		const __m128 v = _mm_loadu_ps(x + i);
+		acc = _mm_add_ps(acc, _mm_mul_ps(v, v));
+		if (i > 0) {
+			// a sign change makes the product with the previous sample negative
+			const __m128 prev = _mm_loadu_ps(x + i - 1);
+			const __m128 crossed = _mm_cmplt_ps(_mm_mul_ps(v, prev), zero);
+			// the mask lanes are -1
+			count = _mm_sub_epi32(count, _mm_castps_si128(crossed));
+		}
+	}
+	float sums[4];
+	_mm_storeu_ps(sums, acc);
+	sum_squares = (sums[0] + sums[1]) + (sums[2] + sums[3]);
+	int counts[4];
+	_mm_storeu_si128((__m128i *)counts, count);
+	crossings = (size_t)(counts[0] + counts[1] + counts[2] + counts[3]);
+#elif defined(VAD_PRE_GATE_NEON)
+	float32x4_t acc = vdupq_n_f32(0.0f);
+	uint32x4_t count = vdupq_n_u32(0);
+	for (; i + 4 <= n; i += 4) {
+		const float32x4_t v = vld1q_f32(x + i);
+		acc = vmlaq_f32(acc, v, v);
+		if (i > 0) {
+			const float32x4_t prev = vld1q_f32(x + i - 1);
+			const uint32x4_t crossed = vcltq_f32(vmulq_f32(v, prev), vdupq_n_f32(0.0f));
+			count = vsubq_u32(count, crossed);
+		}
+	}
+	sum_squares = vaddvq_f32(acc);
+	crossings = (size_t)vaddvq_u32(count);
+#endif
+	// the first group was skipped for the crossings, it has no previous sample
+	for (size_t j = 1; j < std::min<size_t>(i, 4); j++) {
+		crossings += (x[j] * x[j - 1] < 0.0f) ? 1 : 0;
+	}
+	for (; i < n; i++) {
+		sum_squares += x[i] * x[i];
+		if (i > 0) {
+			crossings += (x[i] * x[i - 1] < 0.0f) ? 1 : 0;
+		}
+	}
+}
+
+bool VadPreGate::is_noise(const float *window, size_t n_samples)
+{
+	if (n_samples == 0) {
+		return false;
+	}
+	float sum_squares = 0.0f;
+	size_t crossings = 0;
+	measure(window, n_samples, sum_squares, crossings);
+	const float rms = std::sqrt(sum_squares / (float)n_samples);
+	const float zcr = (float)crossings / (float)n_samples;
+
+	// against the floor of the windows before this one
+	const float margin = zcr >= VAD_PRE_GATE_FRICATIVE_ZCR ? VAD_PRE_GATE_FRICATIVE_MARGIN
+							       : VAD_PRE_GATE_MARGIN;
+	const bool noise = noise_floor > 0.0f && rms < VAD_PRE_GATE_MAX_RMS &&
+			   rms < noise_floor * margin;
+
+	const float level = std::max(rms, VAD_PRE_GATE_MIN_FLOOR);
+	if (noise_floor == 0.0f || level < noise_floor) {
+		noise_floor = level;
+	} else {
+		noise_floor += VAD_PRE_GATE_FLOOR_RISE * (level - noise_floor);
+	}
+	return noise;
+}
@@ -0,0 +1,57 @@
+#ifndef VAD_PRE_GATE_H
+#define VAD_PRE_GATE_H
+
+#include <cstddef>
+
+/**
+ * @file vad-pre-gate.h
+ * @brief Energy and zero-crossing gate in front of the Silero VAD.
+ *
+ * Most windows of an idle source (a muted co-host, a quiet room) are far below speech. Each
+ * VAD window first goes through this gate, which measures its RMS and zero-crossing rate in
+ * one pass (SSE2 on x86-64, NEON on ARM64, scalar otherwise). The windows that are clearly
+ * noise are reported as silence without running the model:
+ *
+ *  - the RMS is below VAD_PRE_GATE_MAX_RMS, so no window louder than that is ever gated, and
+ *  - the RMS is below the noise floor times VAD_PRE_GATE_MARGIN, or times the smaller
+ *    VAD_PRE_GATE_FRICATIVE_MARGIN when the zero-crossing rate is that of unvoiced speech
+ *    ("s", "f"), which starts quieter than the voiced sounds.
+ *
+ * The noise floor follows the quietest windows at once and rises slowly, so it adapts to the
+ * background of the source. The VAD only asks the gate while it is not in speech.
+ */
+
+// the windows louder than this (-40 dBFS) always go to the VAD
+#define VAD_PRE_GATE_MAX_RMS 0.01f
+// factor of the noise floor under which a window is gated (about 8 dB)
+#define VAD_PRE_GATE_MARGIN 2.5f
+#define VAD_PRE_GATE_FRICATIVE_MARGIN 1.4f
+// crossings per sample from which a window sounds like unvoiced speech
+#define VAD_PRE_GATE_FRICATIVE_ZCR 0.25f
+// rise of the noise floor per window towards a louder window, about 30 s at 32 ms windows
+#define VAD_PRE_GATE_FLOOR_RISE 0.001f
+// lowest noise floor, digital silence
+#define VAD_PRE_GATE_MIN_FLOOR 1e-5f
+
+class VadPreGate {
+public:
+	/**
+	 * @brief Measure the window, update the noise floor.
+	 *
+	 * @return true if the window is noise, the VAD can skip it.
+	 */
+	bool is_noise(const float *window, size_t n_samples);
+
+	/**
+	 * @brief Forget the noise floor, e.g. for another source.
+	 */
+	void reset() { noise_floor = 0.0f; }
+
+	float get_noise_floor() const { return noise_floor; }
+
+private:
+	// 0 until the first window
+	float noise_floor = 0.0f;
+};
+
+#endif // VAD_PRE_GATE_H
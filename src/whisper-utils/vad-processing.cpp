@@ -1,9 +1,13 @@
 
 #include <util/profiler.hpp>
 
+#include <algorithm>
+
+#include "plugin-log.h"
 #include "transcription-filter-data.h"
 
 #include "vad-processing.h"
+#include "backend-cache.h"
 
 #ifdef _WIN32
 #define NOMINMAX
@@ -14,7 +18,10 @@
  * @brief Extracts audio data from the buffer, resamples it, and updates timestamp offsets.
  *
  * This function extracts audio data from the input buffer, resamples it to 16kHz, and updates
- * gf->resampled_buffer with the resampled data.
+ * gf->resampled_buffer with the resampled data. Without active VAD the resampled data does not
+ * need to be split into VAD windows and is written to gf->whisper_buffer directly instead.
+ * The timestamp of the block is added to gf->timeline, the returned timestamps are the ones of
+ * the first resampled sample and the sample after the last one.
  *
  * @param gf Pointer to the transcription filter data structure.
  * @param start_timestamp_offset_ns Reference to the start timestamp offset in nanoseconds.
@@ -27,101 +34,128 @@ int get_data_from_buf_and_resample(transcription_filter_data *gf,
 {
 	uint32_t num_frames_from_infos = 0;
 
-	{
-		// scoped lock the buffer mutex
-		std::lock_guard<std::mutex> lock(gf->whisper_buf_mutex);
-
-		if (gf->input_buffers[0].size == 0) {
-			return 1;
-		}
+	// the input ring buffer is lock-free, only this (consumer) thread pops from it
+	if (gf->input_buffer.frames_available() == 0) {
+		return 1;
+	}
 
-#ifdef LOCALVOCAL_EXTRA_VERBOSE
-		obs_log(gf->log_level,
-			"segmentation: currently %lu bytes in the audio input buffer",
-			gf->input_buffers[0].size);
-#endif
+	OBS_LOG_TRACE(gf->log_level,
+		      "segmentation: currently %lu frames in the audio input buffer",
+		      gf->input_buffer.frames_available());
 
-		// max number of frames is 10 seconds worth of audio
-		const size_t max_num_frames = gf->sample_rate * 10;
-
-		// pop all infos from the info buffer and mark the beginning timestamp from the first
-		// info as the beginning timestamp of the segment
-		struct transcription_filter_audio_info info_from_buf = {0};
-		const size_t size_of_audio_info = sizeof(transcription_filter_audio_info);
-		while (gf->info_buffer.size >= size_of_audio_info) {
-			deque_pop_front(&gf->info_buffer, &info_from_buf, size_of_audio_info);
-			num_frames_from_infos += info_from_buf.frames;
-			if (start_timestamp_offset_ns == 0) {
-				start_timestamp_offset_ns = info_from_buf.timestamp_offset_ns;
-			}
-			// Check if we're within the needed segment length
-			if (num_frames_from_infos > max_num_frames) {
-				// too big, push the last info into the buffer's front where it was
-				num_frames_from_infos -= info_from_buf.frames;
-				deque_push_front(&gf->info_buffer, &info_from_buf,
-						 size_of_audio_info);
-				break;
-			}
-		}
-		// calculate the end timestamp from the info plus the number of frames in the packet
-		end_timestamp_offset_ns = info_from_buf.timestamp_offset_ns +
-					  info_from_buf.frames * 1000000000 / gf->sample_rate;
-
-		if (start_timestamp_offset_ns > end_timestamp_offset_ns) {
-			// this may happen when the incoming media has a timestamp reset
-			// in this case, we should figure out the start timestamp from the end timestamp
-			// and the number of frames
-			start_timestamp_offset_ns =
-				end_timestamp_offset_ns -
-				num_frames_from_infos * 1000000000 / gf->sample_rate;
-		}
+	const uint64_t dropped_frames = gf->input_buffer.dropped_frames();
+	if (dropped_frames != gf->input_buffer_dropped_frames) {
+		obs_log(LOG_WARNING, "input buffer overflow, dropped %llu frames (%llu total)",
+			(unsigned long long)(dropped_frames - gf->input_buffer_dropped_frames),
+			(unsigned long long)dropped_frames);
+		gf->input_buffer_dropped_frames = dropped_frames;
+	}
 
-		for (size_t c = 0; c < gf->channels; c++) {
-			// zero the rest of copy_buffers
-			memset(gf->copy_buffers[c], 0, gf->frames * sizeof(float));
+	// max number of frames is 10 seconds worth of audio
+	const size_t max_num_frames = gf->sample_rate * 10;
+
+	// pop all packets from the ring buffer and mark the beginning timestamp from the first
+	// info as the beginning timestamp of the segment
+	uint64_t first_packet_timestamp_ns = 0;
+	struct transcription_filter_audio_info next_info = {0};
+	while (gf->input_buffer.peek_info(next_info)) {
+		// Check if we're within the needed segment length, otherwise leave it for next time
+		if (num_frames_from_infos > 0 &&
+		    num_frames_from_infos + next_info.frames > max_num_frames) {
+			break;
 		}
-
-		/* Pop from input deque */
-		for (size_t c = 0; c < gf->channels; c++) {
-			// Push the new data to copy_buffers[c]
-			deque_pop_front(&gf->input_buffers[c], gf->copy_buffers[c],
-					num_frames_from_infos * sizeof(float));
+		if (num_frames_from_infos == 0) {
+			first_packet_timestamp_ns = next_info.timestamp_offset_ns;
 		}
+		// Pop the packet samples into copy_buffers
+		num_frames_from_infos +=
+			gf->input_buffer.pop_packet(gf->copy_buffers, num_frames_from_infos);
+	}
+	if (num_frames_from_infos == 0) {
+		// samples were published but not yet their info, try again next iteration
+		return 1;
 	}
 
-#ifdef LOCALVOCAL_EXTRA_VERBOSE
-	obs_log(gf->log_level, "found %d frames from info buffer.", num_frames_from_infos);
-#endif
+	OBS_LOG_TRACE(gf->log_level, "found %d frames from info buffer.", num_frames_from_infos);
 	gf->last_num_frames = num_frames_from_infos;
 
+	// the channels to downmix: all of them, or the selected one in place of each
+	const int input_channel = gf->input_channel;
+	const bool one_channel = input_channel >= 0 && (size_t)input_channel < gf->channels;
+	float *input_channels[MAX_PREPROC_CHANNELS];
+	for (size_t c = 0; c < gf->channels; c++) {
+		input_channels[c] = gf->copy_buffers[one_channel ? (size_t)input_channel : c];
+	}
+
 	{
 		// resample to 16kHz
 		float *resampled_16khz[MAX_PREPROC_CHANNELS];
 		uint32_t resampled_16khz_frames;
 		uint64_t ts_offset;
-		{
+		// timestamp of the first resampled sample, without the resampler delay
+		int64_t first_sample_timestamp_ns = (int64_t)first_packet_timestamp_ns;
+		if (gf->decimator.active()) {
+			// integer ratio: downmix and decimate in one pass
+			ProfileScope("decimate");
+			StageTimer timer(gf->pipeline_timings, PIPELINE_STAGE_RESAMPLE);
+			first_sample_timestamp_ns += ((int64_t)gf->decimator.next_output_offset() -
+						      (int64_t)gf->decimator.delay_frames()) *
+						     1000000000 / (int64_t)gf->sample_rate;
+			resampled_16khz[0] = get_scratch_buffer(
+				gf, gf->resample_scratch,
+				gf->decimator.max_output_frames(num_frames_from_infos));
+			resampled_16khz_frames = (uint32_t)gf->decimator.process(
+				input_channels, num_frames_from_infos, resampled_16khz[0]);
+		} else {
 			ProfileScope("resample");
+			StageTimer timer(gf->pipeline_timings, PIPELINE_STAGE_RESAMPLE);
 			audio_resampler_resample(gf->resampler_to_whisper,
 						 (uint8_t **)resampled_16khz,
 						 &resampled_16khz_frames, &ts_offset,
-						 (const uint8_t **)gf->copy_buffers,
+						 (const uint8_t **)input_channels,
 						 (uint32_t)num_frames_from_infos);
+			first_sample_timestamp_ns -= (int64_t)ts_offset;
 		}
 
-		deque_push_back(&gf->resampled_buffer, resampled_16khz[0],
-				resampled_16khz_frames * sizeof(float));
-#ifdef LOCALVOCAL_EXTRA_VERBOSE
-		obs_log(gf->log_level,
-			"resampled: %d channels, %d frames, %f ms, current size: %lu bytes",
-			(int)gf->channels, (int)resampled_16khz_frames,
-			(float)resampled_16khz_frames / WHISPER_SAMPLE_RATE * 1000.0f,
-			gf->resampled_buffer.size);
-#endif
+		gf->timeline.add_anchor(gf->resampled_samples_total,
+					(uint64_t)std::max<int64_t>(first_sample_timestamp_ns, 0));
+		start_timestamp_offset_ns = gf->timeline.timestamp_ns(gf->resampled_samples_total);
+		gf->resampled_samples_total += resampled_16khz_frames;
+		end_timestamp_offset_ns = gf->timeline.timestamp_ns(gf->resampled_samples_total);
+
+		if (gf->vad_mode == VAD_MODE_ACTIVE) {
+			deque_push_back(&gf->resampled_buffer, resampled_16khz[0],
+					resampled_16khz_frames * sizeof(float));
+		} else {
+			gf->whisper_buffer.push_back(resampled_16khz[0], resampled_16khz_frames);
+		}
+		OBS_LOG_TRACE(gf->log_level,
+			      "resampled: %d channels, %d frames, %f ms, current size: %lu bytes",
+			      (int)gf->channels, (int)resampled_16khz_frames,
+			      (float)resampled_16khz_frames / WHISPER_SAMPLE_RATE * 1000.0f,
+			      gf->resampled_buffer.size + gf->whisper_buffer.size_bytes());
 	}
 
 	return 0;
 }
 
+// The partial transcription settings, relaxed while the filter is overloaded
+static bool partials_enabled(const transcription_filter_data *gf)
+{
+	return gf->overload.partials_enabled(gf->partial_transcription);
+}
+
+static uint64_t partial_latency_ms(const transcription_filter_data *gf)
+{
+	return (uint64_t)gf->overload.partial_latency_ms(gf->partial_latency);
+}
+
+// Audio of a full segment kept for the start of the next one, at most half a segment
+static uint64_t segment_overlap_ms(const transcription_filter_data *gf)
+{
+	return (uint64_t)std::clamp(gf->segment_overlap_ms, 0, gf->segment_duration / 2);
+}
+
 vad_state vad_disabled_segmentation(transcription_filter_data *gf, vad_state last_vad_state)
 {
 	// get data from buffer and resample
@@ -132,32 +166,26 @@ vad_state vad_disabled_segmentation(transcription_filter_data *gf, vad_state las
 						       end_timestamp_offset_ns);
 	if (ret != 0) {
 		// if there's data on the whisper buffer - run inference as "final" segment
-		if (gf->whisper_buffer.size > 0) {
-			obs_log(gf->log_level,
+		if (gf->whisper_buffer.size() > 0) {
+			OBS_LOG(gf->log_level,
 				"VAD disabled: no new input but whisper buffer has %lu bytes, run inference",
-				gf->whisper_buffer.size);
-			run_inference_and_callbacks(gf, last_vad_state.start_ts_offest_ms,
+				gf->whisper_buffer.size_bytes());
+			queue_segment_for_inference(gf, last_vad_state.start_ts_offest_ms,
 						    last_vad_state.end_ts_offset_ms,
 						    VAD_STATE_WAS_OFF);
 		}
 		return last_vad_state;
 	}
 
-	// push the data into gf-whisper_buffer
-	deque_push_back(&gf->whisper_buffer, gf->resampled_buffer.data, gf->resampled_buffer.size);
-	// clear the resampled buffer
-	deque_pop_front(&gf->resampled_buffer, nullptr, gf->resampled_buffer.size);
-
-	const uint64_t whisper_buf_samples = gf->whisper_buffer.size / sizeof(float);
+	// the resampled data was written to gf->whisper_buffer directly
+	const uint64_t whisper_buf_samples = gf->whisper_buffer.size();
 	const bool is_partial_segment =
 		whisper_buf_samples < (uint64_t)(gf->segment_duration * WHISPER_SAMPLE_RATE / 1000);
 
-#ifdef LOCALVOCAL_EXTRA_VERBOSE
-	obs_log(gf->log_level,
-		"VAD disabled: total %d frames (%lu bytes) in whisper buffer, state was %s new state is %s",
-		whisper_buf_samples, gf->whisper_buffer.size, last_vad_state.vad_on ? "ON" : "OFF",
-		is_partial_segment ? "PARTIAL" : "OFF");
-#endif
+	OBS_LOG_TRACE(gf->log_level,
+		      "VAD disabled: total %d frames (%lu bytes) in whisper buffer, state was %s new state is %s",
+		      whisper_buf_samples, gf->whisper_buffer.size_bytes(),
+		      last_vad_state.vad_on ? "ON" : "OFF", is_partial_segment ? "PARTIAL" : "OFF");
 
 	const uint64_t end_ts_offset_ms = end_timestamp_offset_ns / 1000000;
 
@@ -166,17 +194,17 @@ vad_state vad_disabled_segmentation(transcription_filter_data *gf, vad_state las
 		// the last partial segment end timestamp
 		const uint64_t unprocessed_length_ms =
 			end_ts_offset_ms - last_vad_state.last_partial_segment_end_ts;
-		if (unprocessed_length_ms > (uint64_t)gf->partial_latency) {
-			if (gf->partial_transcription) {
-				obs_log(gf->log_level,
+		if (unprocessed_length_ms > partial_latency_ms(gf)) {
+			if (partials_enabled(gf)) {
+				OBS_LOG(gf->log_level,
 					"VAD disabled: partial segment with %lu ms unprocessed audio. start %lu, end %lu",
 					unprocessed_length_ms, last_vad_state.start_ts_offest_ms,
 					end_ts_offset_ms);
 				// Send to inference
-				run_inference_and_callbacks(gf, last_vad_state.start_ts_offest_ms,
+				queue_segment_for_inference(gf, last_vad_state.start_ts_offest_ms,
 							    end_ts_offset_ms, VAD_STATE_PARTIAL);
 			} else {
-				obs_log(gf->log_level,
+				OBS_LOG(gf->log_level,
 					"VAD disabled: partial segment with %lu ms unprocessed audio. start %lu, end %lu. Skipping.",
 					unprocessed_length_ms, last_vad_state.start_ts_offest_ms,
 					end_ts_offset_ms);
@@ -188,13 +216,14 @@ vad_state vad_disabled_segmentation(transcription_filter_data *gf, vad_state las
 		return {false, last_vad_state.start_ts_offest_ms, end_ts_offset_ms,
 			last_vad_state.last_partial_segment_end_ts};
 	} else {
-		obs_log(gf->log_level,
+		OBS_LOG(gf->log_level,
 			"VAD disabled: full segment end -> send to inference. start %lu, end %lu",
 			last_vad_state.start_ts_offest_ms, end_ts_offset_ms);
-		// send the entire buffer to inference
-		run_inference_and_callbacks(gf, last_vad_state.start_ts_offest_ms, end_ts_offset_ms,
-					    VAD_STATE_WAS_OFF);
-		return {false, end_ts_offset_ms, end_ts_offset_ms, end_ts_offset_ms};
+		// send the entire buffer to inference, the next segment starts with the overlap
+		queue_segment_for_inference(gf, last_vad_state.start_ts_offest_ms, end_ts_offset_ms,
+					    VAD_STATE_WAS_OFF, segment_overlap_ms(gf));
+		return {false, end_ts_offset_ms - gf->whisper_buffer_overlap_ms, end_ts_offset_ms,
+			end_ts_offset_ms};
 	}
 }
 
@@ -217,33 +246,39 @@ vad_state vad_based_segmentation(transcription_filter_data *gf, vad_state last_v
 
 	size_t vad_num_windows = gf->resampled_buffer.size / vad_window_size_samples;
 
-	std::vector<float> vad_input;
-	vad_input.resize(vad_num_windows * gf->vad->get_window_size_samples());
+	std::vector<float> &vad_input = gf->vad_scratch;
+	get_scratch_buffer(gf, vad_input, vad_num_windows * gf->vad->get_window_size_samples());
 	deque_pop_front(&gf->resampled_buffer, vad_input.data(), vad_input.size() * sizeof(float));
+	// position of the VAD input in the resampled stream, for the timestamps
+	const uint64_t vad_input_start_sample = gf->resampled_buffer_start_sample;
+	gf->resampled_buffer_start_sample += vad_input.size();
 
-#ifdef LOCALVOCAL_EXTRA_VERBOSE
-	obs_log(gf->log_level, "sending %d frames to vad, %d windows, reset state? %s",
-		vad_input.size(), vad_num_windows, (!last_vad_state.vad_on) ? "yes" : "no");
-#endif
+	OBS_LOG_TRACE(gf->log_level, "sending %d frames to vad, %d windows, reset state? %s",
+		      vad_input.size(), vad_num_windows, (!last_vad_state.vad_on) ? "yes" : "no");
 	{
 		ProfileScope("vad->process");
+		StageTimer timer(gf->pipeline_timings, PIPELINE_STAGE_VAD);
+		timer.set_units(vad_num_windows);
 		gf->vad->process(vad_input, !last_vad_state.vad_on);
 	}
+	gf->metrics.vad_windows_gated.fetch_add((uint64_t)gf->vad->get_gated_windows(),
+						std::memory_order_relaxed);
 
-	const uint64_t start_ts_offset_ms = start_timestamp_offset_ns / 1000000;
-	const uint64_t end_ts_offset_ms = end_timestamp_offset_ns / 1000000;
+	// the VAD input may start with samples of earlier blocks, left in the resampled buffer
+	const uint64_t start_ts_offset_ms = gf->timeline.timestamp_ms(vad_input_start_sample);
+	const uint64_t end_ts_offset_ms =
+		gf->timeline.timestamp_ms(vad_input_start_sample + vad_input.size());
 
 	vad_state current_vad_state = {false, start_ts_offset_ms, end_ts_offset_ms,
 				       last_vad_state.last_partial_segment_end_ts};
 
 	std::vector<timestamp_t> stamps = gf->vad->get_speech_timestamps();
 	if (stamps.size() == 0) {
-#ifdef LOCALVOCAL_EXTRA_VERBOSE
-		obs_log(gf->log_level, "VAD detected no speech in %u frames", vad_input.size());
-#endif
+		OBS_LOG_TRACE(gf->log_level, "VAD detected no speech in %u frames",
+			      vad_input.size());
 		if (last_vad_state.vad_on) {
-			obs_log(gf->log_level, "Last VAD was ON: segment end -> send to inference");
-			run_inference_and_callbacks(gf, last_vad_state.start_ts_offest_ms,
+			OBS_LOG(gf->log_level, "Last VAD was ON: segment end -> send to inference");
+			queue_segment_for_inference(gf, last_vad_state.start_ts_offest_ms,
 						    last_vad_state.end_ts_offset_ms,
 						    VAD_STATE_WAS_ON);
 			current_vad_state.last_partial_segment_end_ts = 0;
@@ -264,6 +299,10 @@ vad_state vad_based_segmentation(transcription_filter_data *gf, vad_state last_v
 
 	// process vad segments
 	for (size_t i = 0; i < stamps.size(); i++) {
+		if (!last_vad_state.vad_on) {
+			// start of speech, for the trace of the segment
+			gf->segment_trace.mark_vad_on();
+		}
 		int start_frame = stamps[i].start;
 		if (i > 0) {
 			// if this is not the first segment, start from the end of the previous segment
@@ -283,24 +322,23 @@ vad_state vad_based_segmentation(transcription_filter_data *gf, vad_state last_v
 		const int number_of_frames = end_frame - start_frame;
 
 		// push the data into gf-whisper_buffer
-		deque_push_back(&gf->whisper_buffer, vad_input.data() + start_frame,
-				number_of_frames * sizeof(float));
+		gf->whisper_buffer.push_back(vad_input.data() + start_frame, number_of_frames);
 
-		obs_log(gf->log_level,
-			"VAD segment %d/%d. pushed %d to %d (%d frames / %lu ms). current size: %lu bytes / %lu frames / %lu ms",
-			i, (stamps.size() - 1), start_frame, end_frame, number_of_frames,
-			number_of_frames * 1000 / WHISPER_SAMPLE_RATE, gf->whisper_buffer.size,
-			gf->whisper_buffer.size / sizeof(float),
-			gf->whisper_buffer.size / sizeof(float) * 1000 / WHISPER_SAMPLE_RATE);
+		OBS_LOG(gf->log_level,
+			"VAD segment %d/%d. pushed %d to %d (%d frames / %d ms). current size: %lu bytes / %lu frames / %lu ms",
+			(int)i, (int)(stamps.size() - 1), start_frame, end_frame, number_of_frames,
+			number_of_frames * 1000 / WHISPER_SAMPLE_RATE,
+			gf->whisper_buffer.size_bytes(), gf->whisper_buffer.size(),
+			gf->whisper_buffer.size() * 1000 / WHISPER_SAMPLE_RATE);
 
 		// segment "end" is in the middle of the buffer, send it to inference
 		if (stamps[i].end < (int)vad_input.size()) {
 			// new "ending" segment (not up to the end of the buffer)
-			obs_log(gf->log_level, "VAD segment end -> send to inference");
+			OBS_LOG(gf->log_level, "VAD segment end -> send to inference");
 			// find the end timestamp of the segment
 			const uint64_t segment_end_ts =
-				start_ts_offset_ms + end_frame * 1000 / WHISPER_SAMPLE_RATE;
-			run_inference_and_callbacks(
+				gf->timeline.timestamp_ms(vad_input_start_sample + end_frame);
+			queue_segment_for_inference(
 				gf, last_vad_state.start_ts_offest_ms, segment_end_ts,
 				last_vad_state.vad_on ? VAD_STATE_WAS_ON : VAD_STATE_WAS_OFF);
 			current_vad_state.vad_on = false;
@@ -314,28 +352,31 @@ vad_state vad_based_segmentation(transcription_filter_data *gf, vad_state last_v
 		// end not reached - speech is ongoing
 		current_vad_state.vad_on = true;
 		if (last_vad_state.vad_on) {
-			obs_log(gf->log_level,
+			OBS_LOG(gf->log_level,
 				"last vad state was: ON, start ts: %llu, end ts: %llu",
-				last_vad_state.start_ts_offest_ms, last_vad_state.end_ts_offset_ms);
+				(unsigned long long)last_vad_state.start_ts_offest_ms,
+				(unsigned long long)last_vad_state.end_ts_offset_ms);
 			current_vad_state.start_ts_offest_ms = last_vad_state.start_ts_offest_ms;
 		} else {
-			obs_log(gf->log_level,
+			OBS_LOG(gf->log_level,
 				"last vad state was: OFF, start ts: %llu, end ts: %llu. start_ts_offset_ms: %llu, start_frame: %d",
-				last_vad_state.start_ts_offest_ms, last_vad_state.end_ts_offset_ms,
-				start_ts_offset_ms, start_frame);
+				(unsigned long long)last_vad_state.start_ts_offest_ms,
+				(unsigned long long)last_vad_state.end_ts_offset_ms,
+				(unsigned long long)start_ts_offset_ms, start_frame);
 			current_vad_state.start_ts_offest_ms =
-				start_ts_offset_ms + start_frame * 1000 / WHISPER_SAMPLE_RATE;
+				gf->timeline.timestamp_ms(vad_input_start_sample + start_frame);
 		}
 		current_vad_state.end_ts_offset_ms =
-			start_ts_offset_ms + end_frame * 1000 / WHISPER_SAMPLE_RATE;
-		obs_log(gf->log_level,
+			gf->timeline.timestamp_ms(vad_input_start_sample + end_frame);
+		OBS_LOG(gf->log_level,
 			"end not reached. vad state: ON, start ts: %llu, end ts: %llu",
-			current_vad_state.start_ts_offest_ms, current_vad_state.end_ts_offset_ms);
+			(unsigned long long)current_vad_state.start_ts_offest_ms,
+			(unsigned long long)current_vad_state.end_ts_offset_ms);
 
 		last_vad_state = current_vad_state;
 
 		// if partial transcription is enabled, check if we should send a partial segment
-		if (!gf->partial_transcription) {
+		if (!partials_enabled(gf)) {
 			continue;
 		}
 
@@ -347,15 +388,15 @@ vad_state vad_based_segmentation(transcription_filter_data *gf, vad_state last_v
 			(current_vad_state.last_partial_segment_end_ts > 0
 				 ? current_vad_state.last_partial_segment_end_ts
 				 : current_vad_state.start_ts_offest_ms);
-		obs_log(gf->log_level, "current buffer length after last partial (%lu): %lu ms",
+		OBS_LOG(gf->log_level, "current buffer length after last partial (%lu): %lu ms",
 			current_vad_state.last_partial_segment_end_ts, current_length_ms);
 
-		if (current_length_ms > (uint64_t)gf->partial_latency) {
+		if (current_length_ms > partial_latency_ms(gf)) {
 			current_vad_state.last_partial_segment_end_ts =
 				current_vad_state.end_ts_offset_ms;
 			// send partial segment to inference
-			obs_log(gf->log_level, "Partial segment -> send to inference");
-			run_inference_and_callbacks(gf, current_vad_state.start_ts_offest_ms,
+			OBS_LOG(gf->log_level, "Partial segment -> send to inference");
+			queue_segment_for_inference(gf, current_vad_state.start_ts_offest_ms,
 						    current_vad_state.end_ts_offset_ms,
 						    VAD_STATE_PARTIAL);
 		}
@@ -377,30 +418,25 @@ vad_state hybrid_vad_segmentation(transcription_filter_data *gf, vad_state last_
 
 	last_vad_state.end_ts_offset_ms = end_timestamp_offset_ns / 1000000;
 
-	// extract the data from the resampled buffer with deque_pop_front into a temp buffer
-	// and then push it into the whisper buffer
-	const size_t resampled_buffer_size = gf->resampled_buffer.size;
-	std::vector<uint8_t> temp_buffer;
-	temp_buffer.resize(resampled_buffer_size);
-	deque_pop_front(&gf->resampled_buffer, temp_buffer.data(), resampled_buffer_size);
-	deque_push_back(&gf->whisper_buffer, temp_buffer.data(), resampled_buffer_size);
-
-	obs_log(gf->log_level, "whisper buffer size: %lu bytes", gf->whisper_buffer.size);
+	// the resampled data was written to gf->whisper_buffer directly
+	OBS_LOG(gf->log_level, "whisper buffer size: %lu bytes", gf->whisper_buffer.size_bytes());
 
 	// use last_vad_state timestamps to calculate the duration of the current segment
 	if (last_vad_state.end_ts_offset_ms - last_vad_state.start_ts_offest_ms >=
 	    (uint64_t)gf->segment_duration) {
-		obs_log(gf->log_level, "%d seconds worth of audio -> send to inference",
+		OBS_LOG(gf->log_level, "%d seconds worth of audio -> send to inference",
 			gf->segment_duration);
-		run_inference_and_callbacks(gf, last_vad_state.start_ts_offest_ms,
-					    last_vad_state.end_ts_offset_ms, VAD_STATE_WAS_ON);
-		last_vad_state.start_ts_offest_ms = end_timestamp_offset_ns / 1000000;
+		queue_segment_for_inference(gf, last_vad_state.start_ts_offest_ms,
+					    last_vad_state.end_ts_offset_ms, VAD_STATE_WAS_ON,
+					    segment_overlap_ms(gf));
+		last_vad_state.start_ts_offest_ms =
+			end_timestamp_offset_ns / 1000000 - gf->whisper_buffer_overlap_ms;
 		last_vad_state.last_partial_segment_end_ts = 0;
 		return last_vad_state;
 	}
 
 	// if partial transcription is enabled, check if we should send a partial segment
-	if (gf->partial_transcription) {
+	if (partials_enabled(gf)) {
 		// current length of audio in buffer
 		const uint64_t current_length_ms =
 			(last_vad_state.end_ts_offset_ms > 0 ? last_vad_state.end_ts_offset_ms
@@ -408,42 +444,48 @@ vad_state hybrid_vad_segmentation(transcription_filter_data *gf, vad_state last_
 			(last_vad_state.last_partial_segment_end_ts > 0
 				 ? last_vad_state.last_partial_segment_end_ts
 				 : last_vad_state.start_ts_offest_ms);
-		obs_log(gf->log_level, "current buffer length after last partial (%lu): %lu ms",
+		OBS_LOG(gf->log_level, "current buffer length after last partial (%lu): %lu ms",
 			last_vad_state.last_partial_segment_end_ts, current_length_ms);
 
-		if (current_length_ms > (uint64_t)gf->partial_latency) {
+		if (current_length_ms > partial_latency_ms(gf)) {
 			// send partial segment to inference
-			obs_log(gf->log_level, "Partial segment -> send to inference");
+			OBS_LOG(gf->log_level, "Partial segment -> send to inference");
 			last_vad_state.last_partial_segment_end_ts =
 				last_vad_state.end_ts_offset_ms;
 
 			// run vad on the current buffer
-			std::vector<float> vad_input;
-			vad_input.resize(gf->whisper_buffer.size / sizeof(float));
-			deque_peek_front(&gf->whisper_buffer, vad_input.data(),
-					 vad_input.size() * sizeof(float));
+			std::vector<float> &vad_input = gf->vad_scratch;
+			memcpy(get_scratch_buffer(gf, vad_input, gf->whisper_buffer.size()),
+			       gf->whisper_buffer.data(), gf->whisper_buffer.size_bytes());
 
-			obs_log(gf->log_level, "sending %d frames to vad, %.1f ms",
-				vad_input.size(),
+			OBS_LOG(gf->log_level, "sending %d frames to vad, %.1f ms",
+				(int)vad_input.size(),
 				(float)vad_input.size() * 1000.0f / (float)WHISPER_SAMPLE_RATE);
 			{
 				ProfileScope("vad->process");
+				StageTimer timer(gf->pipeline_timings, PIPELINE_STAGE_VAD);
+				timer.set_units(vad_input.size() /
+						gf->vad->get_window_size_samples());
 				gf->vad->process(vad_input, true);
 			}
+			gf->metrics.vad_windows_gated.fetch_add(
+				(uint64_t)gf->vad->get_gated_windows(), std::memory_order_relaxed);
 
 			if (gf->vad->get_speech_timestamps().size() > 0) {
 				// VAD detected speech in the partial segment
-				run_inference_and_callbacks(gf, last_vad_state.start_ts_offest_ms,
+				queue_segment_for_inference(gf, last_vad_state.start_ts_offest_ms,
 							    last_vad_state.end_ts_offset_ms,
 							    VAD_STATE_PARTIAL);
 			} else {
 				// VAD detected silence in the partial segment
-				obs_log(gf->log_level, "VAD detected silence in partial segment");
+				OBS_LOG(gf->log_level, "VAD detected silence in partial segment");
 				// pop the partial segment from the whisper buffer, save some audio for the next segment
-				const size_t num_bytes_to_keep =
-					(WHISPER_SAMPLE_RATE / 4) * sizeof(float);
-				deque_pop_front(&gf->whisper_buffer, nullptr,
-						gf->whisper_buffer.size - num_bytes_to_keep);
+				const size_t num_samples_to_keep = WHISPER_SAMPLE_RATE / 4;
+				if (gf->whisper_buffer.size() > num_samples_to_keep) {
+					gf->whisper_buffer.pop_front(gf->whisper_buffer.size() -
+								     num_samples_to_keep);
+					gf->whisper_buffer_overlap_ms = 0;
+				}
 			}
 		}
 	}
@@ -451,23 +493,56 @@ vad_state hybrid_vad_segmentation(transcription_filter_data *gf, vad_state last_
 	return last_vad_state;
 }
 
-void initialize_vad(transcription_filter_data *gf, const char *silero_vad_model_file)
+static SileroString to_silero_string(const std::string &path)
 {
-	// initialize Silero VAD
 #ifdef _WIN32
 	// convert mbstring to wstring
-	int count = MultiByteToWideChar(CP_UTF8, 0, silero_vad_model_file,
-					strlen(silero_vad_model_file), NULL, 0);
-	std::wstring silero_vad_model_path(count, 0);
-	MultiByteToWideChar(CP_UTF8, 0, silero_vad_model_file, strlen(silero_vad_model_file),
-			    &silero_vad_model_path[0], count);
-	obs_log(gf->log_level, "Create silero VAD: %S", silero_vad_model_path.c_str());
+	int count = MultiByteToWideChar(CP_UTF8, 0, path.c_str(), (int)path.size(), NULL, 0);
+	std::wstring wide_path(count, 0);
+	MultiByteToWideChar(CP_UTF8, 0, path.c_str(), (int)path.size(), &wide_path[0], count);
+	return wide_path;
 #else
-	std::string silero_vad_model_path = silero_vad_model_file;
-	obs_log(gf->log_level, "Create silero VAD: %s", silero_vad_model_path.c_str());
+	return path;
 #endif
+}
+
+static const char *vad_provider_name(int provider)
+{
+	switch (provider) {
+	case VAD_PROVIDER_CUDA:
+		return "cuda";
+	case VAD_PROVIDER_DIRECTML:
+		return "directml";
+	case VAD_PROVIDER_COREML:
+		return "coreml";
+	default:
+		return "cpu";
+	}
+}
+
+void initialize_vad(transcription_filter_data *gf, const char *silero_vad_model_file)
+{
+	// initialize Silero VAD
+	const SileroString silero_vad_model_path = to_silero_string(silero_vad_model_file);
+	VadEngineConfig engine;
+	engine.provider = gf->vad_provider;
+	engine.intra_threads = gf->vad_intra_threads;
+	engine.inter_threads = gf->vad_inter_threads;
+	if (gf->vad_optimized_cache) {
+		// the optimized graph depends on the provider
+		const std::string optimized_model_file = backend_cache_file(
+			std::string("silero_vad.") + vad_provider_name(gf->vad_provider) + ".onnx");
+		if (!optimized_model_file.empty()) {
+			engine.optimized_model_path = to_silero_string(optimized_model_file);
+		}
+	}
+	OBS_LOG(gf->log_level, "Create silero VAD: %s, provider %s, %d/%d threads",
+		silero_vad_model_file, vad_provider_name(gf->vad_provider), gf->vad_intra_threads,
+		gf->vad_inter_threads);
 	// roughly following https://github.com/SYSTRAN/faster-whisper/blob/master/faster_whisper/vad.py
 	// for silero vad parameters
-	gf->vad.reset(new VadIterator(silero_vad_model_path, WHISPER_SAMPLE_RATE, 32, 0.5f, 100,
-				      100, 100));
+	gf->vad.reset(new VadIterator(silero_vad_model_path, WHISPER_SAMPLE_RATE, VAD_WINDOW_SIZE_MS,
+				      gf->vad_threshold, 100, 100, 100,
+				      std::numeric_limits<float>::infinity(), engine));
+	gf->vad->set_pre_gate(gf->vad_pre_gate);
 }
@@ -9,6 +9,9 @@
  * VAD processing in the transcription filter.
  */
 
+// Silero VAD window duration
+#define VAD_WINDOW_SIZE_MS 32
+
 /**
  * @enum VadState
  * @brief Enumeration of possible VAD states.
@@ -50,6 +53,10 @@ struct vad_state {
 	uint64_t last_partial_segment_end_ts;
 };
 
+// Pop the buffered input audio and resample it to 16 kHz, 0 on success, 1 if there is none
+int get_data_from_buf_and_resample(transcription_filter_data *gf,
+				   uint64_t &start_timestamp_offset_ns,
+				   uint64_t &end_timestamp_offset_ns);
 vad_state vad_disabled_segmentation(transcription_filter_data *gf, vad_state last_vad_state);
 vad_state vad_based_segmentation(transcription_filter_data *gf, vad_state last_vad_state);
 vad_state hybrid_vad_segmentation(transcription_filter_data *gf, vad_state last_vad_state);
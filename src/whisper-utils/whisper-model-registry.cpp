@@ -0,0 +1,259 @@
+#include "whisper-model-registry.h"
+#include "whisper-processing.h"
+#include "transcription-filter-data.h"
+#include "plugin-support.h"
+
+#include <obs-module.h>
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace {
+
+struct inference_waiter {
+	uint64_t ticket;
+	int priority;
+};
+
+struct inference_decode {
+	std::thread::id thread;
+	int priority;
+	// nullptr if the decode cannot be preempted
+	std::atomic<bool> *preempt;
+	bool preempted = false;
+};
+
+struct shared_whisper_model {
+	// nullptr while the first filter loads it
+	struct whisper_context *ctx = nullptr;
+	int ref_count = 0;
+
+	// inference scheduling
+	std::mutex inference_mutex;
+	std::condition_variable inference_cv;
+	int max_parallel = 1;
+	int active = 0;
+	// streams waiting for a slot, served by priority then ticket
+	std::vector<inference_waiter> waiting;
+	std::vector<inference_decode> running;
+	uint64_t next_ticket = 0;
+};
+
+// inference_mutex must be held. The ticket of the waiter served next.
+uint64_t next_waiter(const shared_whisper_model *model)
+{
+	const inference_waiter *next = &model->waiting.front();
+	for (const inference_waiter &waiter : model->waiting) {
+		if (waiter.priority > next->priority ||
+		    (waiter.priority == next->priority && waiter.ticket < next->ticket)) {
+			next = &waiter;
+		}
+	}
+	return next->ticket;
+}
+
+// inference_mutex must be held. Abort the running decode of the lowest priority below this one,
+// if it can be preempted.
+void preempt_decode(shared_whisper_model *model, int priority)
+{
+	inference_decode *victim = nullptr;
+	for (inference_decode &decode : model->running) {
+		if (decode.preempt == nullptr || decode.preempted || decode.priority >= priority) {
+			continue;
+		}
+		if (victim == nullptr || decode.priority < victim->priority) {
+			victim = &decode;
+		}
+	}
+	if (victim != nullptr) {
+		victim->preempted = true;
+		victim->preempt->store(true, std::memory_order_relaxed);
+	}
+}
+
+std::mutex registry_mutex;
+// wakes the filters waiting for a model another filter is loading
+std::condition_variable registry_cv;
+// key: model path + context parameters
+std::map<std::string, std::unique_ptr<shared_whisper_model>> registry;
+
+std::string registry_key(const std::string &model_path, const transcription_filter_data *gf,
+			 int gpu_device)
+{
+	return model_path + "|gpu=" + std::to_string(gpu_device) +
+	       "|fa=" + std::to_string((int)gf->enable_flash_attn) +
+	       "|dtw=" + std::to_string((int)gf->enable_token_ts_dtw);
+}
+
+// registry_mutex must be held
+shared_whisper_model *find_model(struct whisper_context *ctx)
+{
+	if (ctx == nullptr) {
+		// not the models being loaded
+		return nullptr;
+	}
+	for (auto &it : registry) {
+		if (it.second->ctx == ctx) {
+			return it.second.get();
+		}
+	}
+	return nullptr;
+}
+
+shared_whisper_model *find_model_locked(struct whisper_context *ctx)
+{
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	return find_model(ctx);
+}
+
+} // namespace
+
+struct whisper_context *acquire_shared_whisper_context(const std::string &model_path,
+						       struct transcription_filter_data *gf,
+						       int gpu_device)
+{
+	const std::string key = registry_key(model_path, gf, gpu_device);
+
+	std::unique_lock<std::mutex> lock(registry_mutex);
+	while (true) {
+		auto it = registry.find(key);
+		if (it == registry.end()) {
+			break;
+		}
+		if (it->second->ctx != nullptr) {
+			it->second->ref_count++;
+			obs_log(LOG_INFO, "Sharing loaded whisper model %s (%d users)",
+				model_path.c_str(), it->second->ref_count);
+			return it->second->ctx;
+		}
+		// a second filter waits for the first load instead of loading the same model
+		// twice, and loads it itself if the first load fails
+		registry_cv.wait(lock);
+	}
+
+	// the other models load concurrently, outside of the lock
+	registry[key] = std::make_unique<shared_whisper_model>();
+	lock.unlock();
+	struct whisper_context *ctx = init_whisper_context(model_path, gf, gpu_device);
+	lock.lock();
+	auto it = registry.find(key);
+	if (ctx == nullptr) {
+		registry.erase(it);
+	} else {
+		it->second->ctx = ctx;
+		it->second->ref_count = 1;
+		it->second->max_parallel = std::max(1, gf->inference_max_parallel);
+	}
+	registry_cv.notify_all();
+	return ctx;
+}
+
+void release_shared_whisper_context(struct whisper_context *ctx)
+{
+	if (ctx == nullptr) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(registry_mutex);
+	for (auto it = registry.begin(); it != registry.end(); ++it) {
+		if (it->second->ctx != ctx) {
+			continue;
+		}
+		if (--it->second->ref_count == 0) {
+			obs_log(LOG_INFO, "Freeing whisper model, no more users");
+			whisper_free(ctx);
+			registry.erase(it);
+		}
+		return;
+	}
+	obs_log(LOG_WARNING, "Releasing a whisper context that is not in the registry");
+	whisper_free(ctx);
+}
+
+void set_shared_inference_limit(struct whisper_context *ctx, int max_parallel)
+{
+	shared_whisper_model *model = find_model_locked(ctx);
+	if (model == nullptr) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(model->inference_mutex);
+		model->max_parallel = std::max(1, max_parallel);
+	}
+	model->inference_cv.notify_all();
+}
+
+bool begin_shared_inference(struct whisper_context *ctx, uint64_t max_wait_ms, bool can_skip,
+			    int priority, std::atomic<bool> *preempt)
+{
+	// the model stays registered while the caller holds a reference to it
+	shared_whisper_model *model = find_model_locked(ctx);
+	if (model == nullptr) {
+		// not a shared model, nothing to schedule
+		return true;
+	}
+
+	std::unique_lock<std::mutex> lock(model->inference_mutex);
+	const uint64_t ticket = model->next_ticket++;
+	model->waiting.push_back({ticket, priority});
+	if (model->active >= model->max_parallel) {
+		preempt_decode(model, priority);
+	}
+	auto ready = [model, ticket]() {
+		return model->active < model->max_parallel && next_waiter(model) == ticket;
+	};
+	auto leave_line = [model, ticket]() {
+		model->waiting.erase(std::find_if(model->waiting.begin(), model->waiting.end(),
+						  [ticket](const inference_waiter &waiter) {
+							  return waiter.ticket == ticket;
+						  }));
+	};
+
+	if (can_skip) {
+		if (!model->inference_cv.wait_for(lock, std::chrono::milliseconds(max_wait_ms),
+						  ready)) {
+			// deadline passed, give up the place in line
+			leave_line();
+			lock.unlock();
+			model->inference_cv.notify_all();
+			return false;
+		}
+	} else {
+		model->inference_cv.wait(lock, ready);
+	}
+
+	leave_line();
+	model->active++;
+	model->running.push_back({std::this_thread::get_id(), priority, preempt});
+	lock.unlock();
+	// the next stream in line may also fit in a free slot
+	model->inference_cv.notify_all();
+	return true;
+}
+
+void end_shared_inference(struct whisper_context *ctx)
+{
+	shared_whisper_model *model = find_model_locked(ctx);
+	if (model == nullptr) {
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(model->inference_mutex);
+		model->active--;
+		const std::thread::id thread = std::this_thread::get_id();
+		auto decode = std::find_if(model->running.begin(), model->running.end(),
+					   [thread](const inference_decode &running) {
+						   return running.thread == thread;
+					   });
+		if (decode != model->running.end()) {
+			model->running.erase(decode);
+		}
+	}
+	model->inference_cv.notify_all();
+}
@@ -0,0 +1,99 @@
+/**
+ * @file whisper-model-registry.h
+ * @brief Process-wide, reference counted registry of loaded whisper models.
+ *
+ * Filter instances that use the same model file with the same context parameters (GPU device,
+ * flash attention, DTW timestamps) share a single whisper_context holding the model weights.
+ * Each filter keeps its own whisper_state for decoding, so streams do not interfere with each
+ * other and the model is only loaded once into RAM/VRAM. Different models load concurrently, a
+ * filter that needs a model another filter is loading waits for that load.
+ *
+ * The registry also schedules inference on each shared model: a bounded number of streams may
+ * decode concurrently, and partial segments that cannot get a slot within their deadline are
+ * skipped so latency stays bounded. The waiting streams are served by priority, then in arrival
+ * order: the final segments before the partials, and within each, the filters of the higher
+ * priority class first. A final segment that finds all the slots busy preempts a running
+ * partial of a lower priority, which is aborted like a partial superseded by a newer segment.
+ * Each stream coalesces its own partials to the newest before they get here.
+ */
+#ifndef WHISPER_MODEL_REGISTRY_H
+#define WHISPER_MODEL_REGISTRY_H
+
+#include <whisper.h>
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// priority class of a filter on the shared models, the higher ones are served first
+enum InferencePriorityClass {
+	INFERENCE_PRIORITY_BACKGROUND = 0,
+	INFERENCE_PRIORITY_NORMAL = 1,
+	INFERENCE_PRIORITY_MAIN = 2,
+};
+
+// priority of a decode: the finals of all classes before the partials
+inline int inference_priority(int priority_class, bool final_segment)
+{
+	return (final_segment ? INFERENCE_PRIORITY_MAIN + 1 : 0) + priority_class;
+}
+
+struct transcription_filter_data;
+
+/**
+ * @brief Get a shared whisper context for the model, loading it if it's not loaded yet.
+ *
+ * The context is created without a default state, callers must use a whisper_state of their
+ * own (see whisper_init_state) for inference.
+ *
+ * @param model_path Path to the model file or folder.
+ * @param gf Filter data, used for the context parameters (flash attention, DTW).
+ * @param gpu_device GPU device to load the model on, -1 for the CPU.
+ * @return The shared whisper context or nullptr on failure. Must be released with
+ * release_shared_whisper_context.
+ */
+struct whisper_context *acquire_shared_whisper_context(const std::string &model_path,
+						       struct transcription_filter_data *gf,
+						       int gpu_device);
+
+/**
+ * @brief Release a context obtained with acquire_shared_whisper_context.
+ *
+ * The model is freed when the last filter using it releases it.
+ *
+ * @param ctx The shared whisper context.
+ */
+void release_shared_whisper_context(struct whisper_context *ctx);
+
+/**
+ * @brief Set how many streams may run inference concurrently on a shared model.
+ *
+ * @param ctx The shared whisper context.
+ * @param max_parallel Maximal number of concurrent decodes, at least 1.
+ */
+void set_shared_inference_limit(struct whisper_context *ctx, int max_parallel);
+
+/**
+ * @brief Wait for an inference slot on a shared model.
+ *
+ * @param ctx The shared whisper context.
+ * @param max_wait_ms Maximal time to wait for a slot when the segment can be skipped.
+ * @param can_skip Whether the segment can be skipped (e.g. a partial) when the deadline passes.
+ * Segments that cannot be skipped wait until a slot is available.
+ * @param priority See inference_priority, the higher priorities are served first.
+ * @param preempt Set by a decode of a higher priority that waits for the slot, nullptr if the
+ * decode cannot be aborted. Must be checked by the abort callback of the decode.
+ * @return true if a slot was acquired and end_shared_inference must be called, false if the
+ * segment should be skipped.
+ */
+bool begin_shared_inference(struct whisper_context *ctx, uint64_t max_wait_ms, bool can_skip,
+			    int priority = 0, std::atomic<bool> *preempt = nullptr);
+
+/**
+ * @brief Release an inference slot acquired with begin_shared_inference, on the same thread.
+ *
+ * @param ctx The shared whisper context.
+ */
+void end_shared_inference(struct whisper_context *ctx);
+
+#endif // WHISPER_MODEL_REGISTRY_H
@@ -5,9 +5,12 @@
 #include <obs-module.h>
 
 #include "whisper-utils.h"
+#include "whisper-model-utils.h"
 #include "whisper-processing.h"
+#include "backend-autotune.h"
 #include "plugin-support.h"
 #include "model-utils/model-downloader.h"
+#include "model-utils/model-quantize.h"
 
 void update_whisper_model(struct transcription_filter_data *gf, bool force_whisper_restart)
 {
@@ -31,8 +34,46 @@ void update_whisper_model(struct transcription_filter_data *gf, bool force_whisp
 			? obs_data_get_string(s, "whisper_model_path_external")
 			: "";
 	const bool new_dtw_timestamps = obs_data_get_bool(s, "dtw_token_timestamps");
+	const int new_quantization = (int)obs_data_get_int(s, "whisper_model_quantization");
+	std::string new_draft_model = obs_data_get_string(s, "partial_draft_model") != nullptr
+					      ? obs_data_get_string(s, "partial_draft_model")
+					      : "";
 	obs_data_release(s);
 
+	// update the draft model for partials, the same model as the main one is not a draft
+	if (new_draft_model == new_model_path) {
+		new_draft_model = "";
+	}
+	if (new_draft_model != gf->draft_model_name) {
+		obs_log(gf->log_level, "draft model changed from '%s' to '%s'",
+			gf->draft_model_name.c_str(), new_draft_model.c_str());
+		gf->draft_model_name = new_draft_model;
+		if (new_draft_model.empty() || models_info().count(new_draft_model) == 0) {
+			update_draft_whisper_model(gf, "");
+		} else {
+			const ModelInfo &draft_model_info = models_info().at(new_draft_model);
+			std::string draft_model_file = find_model_bin_file(draft_model_info);
+			if (draft_model_file == "") {
+				obs_log(LOG_WARNING, "Draft whisper model does not exist");
+				update_draft_whisper_model(gf, "");
+				download_model_with_ui_dialog(
+					draft_model_info, [gf](int download_status,
+							       const std::string &path) {
+						if (download_status == 0) {
+							obs_log(LOG_INFO,
+								"Draft model download complete");
+							update_draft_whisper_model(gf, path);
+						} else {
+							obs_log(LOG_ERROR,
+								"Draft model download failed");
+						}
+					});
+			} else {
+				update_draft_whisper_model(gf, draft_model_file);
+			}
+		}
+	}
+
 	// update the whisper model path
 
 	const bool is_external_model = new_model_path.find("!!!external!!!") != std::string::npos;
@@ -56,7 +97,7 @@ void update_whisper_model(struct transcription_filter_data *gf, bool force_whisp
 	bfree(silero_vad_model_file);
 
 	if (gf->whisper_model_path.empty() || gf->whisper_model_path != new_model_path ||
-	    is_external_model) {
+	    gf->whisper_model_quantization != new_quantization || is_external_model) {
 
 		if (gf->whisper_model_path != new_model_path) {
 			// model path changed
@@ -69,9 +110,8 @@ void update_whisper_model(struct transcription_filter_data *gf, bool force_whisp
 
 		// check if the new model is external file
 		if (!is_external_model) {
-			// new model is not external file
-			shutdown_whisper_thread(gf);
-
+			// new model is not external file. the current model keeps running until
+			// the new one is loaded (or downloaded)
 			if (models_info().count(new_model_path) == 0) {
 				obs_log(LOG_WARNING, "Model '%s' does not exist",
 					new_model_path.c_str());
@@ -79,9 +119,20 @@ void update_whisper_model(struct transcription_filter_data *gf, bool force_whisp
 			}
 
 			const ModelInfo &model_info = models_info().at(new_model_path);
+			gf->whisper_model_quantization = new_quantization;
 
 			// check if the model exists, if not, download it
 			std::string model_file_found = find_model_bin_file(model_info);
+			int quantization = MODEL_QUANTIZATION_NONE;
+			if (new_quantization != MODEL_QUANTIZATION_NONE &&
+			    model_info.type == MODEL_TYPE_TRANSCRIPTION &&
+			    (model_file_found.empty() ||
+			     model_file_can_be_quantized(model_file_found, new_quantization))) {
+				// the quantized copy, made by the downloader after the download
+				model_file_found = find_model_bin_file(
+					quantized_model_info(model_info, new_quantization));
+				quantization = new_quantization;
+			}
 			if (model_file_found == "") {
 				obs_log(LOG_WARNING, "Whisper model does not exist");
 				download_model_with_ui_dialog(model_info, [gf, new_model_path,
@@ -93,10 +144,11 @@ void update_whisper_model(struct transcription_filter_data *gf, bool force_whisp
 					if (download_status == 0) {
 						obs_log(LOG_INFO, "Model download complete");
 						gf->whisper_model_path = new_model_path;
+						autotune_whisper_model(gf, false);
 						download_coreml_encoder_model_if_available(
 							model_info,
 							[gf, path, silero_vad_model_file_str]() {
-								start_whisper_thread_with_path(
+								switch_whisper_model(
 									gf, path,
 									silero_vad_model_file_str
 										.c_str());
@@ -104,15 +156,16 @@ void update_whisper_model(struct transcription_filter_data *gf, bool force_whisp
 					} else {
 						obs_log(LOG_ERROR, "Model download failed");
 					}
-				});
+				}, quantization);
 			} else {
 				// Model exists, just load it
 				gf->whisper_model_path = new_model_path;
+				autotune_whisper_model(gf, false);
 
 				download_coreml_encoder_model_if_available(
 					model_info,
 					[gf, model_file_found, silero_vad_model_file_str]() {
-						start_whisper_thread_with_path(
+						switch_whisper_model(
 							gf, model_file_found,
 							silero_vad_model_file_str.c_str());
 					});
@@ -123,17 +176,16 @@ void update_whisper_model(struct transcription_filter_data *gf, bool force_whisp
 			if (external_model_file_path.empty()) {
 				obs_log(LOG_WARNING, "External model file path is empty");
 			} else {
-				// check if the external model file is not currently loaded
-				if (gf->whisper_model_file_currently_loaded ==
+				// check if the external model file is not loaded or loading already
+				if (gf->whisper_model_file_requested ==
 				    external_model_file_path) {
 					obs_log(LOG_INFO, "External model file is already loaded");
 					return;
 				} else {
-					shutdown_whisper_thread(gf);
 					gf->whisper_model_path = new_model_path;
-					start_whisper_thread_with_path(
-						gf, external_model_file_path,
-						silero_vad_model_file_str.c_str());
+					switch_whisper_model(gf, external_model_file_path,
+							     silero_vad_model_file_str.c_str());
+					autotune_whisper_model(gf, false);
 				}
 			}
 		}
@@ -147,16 +199,67 @@ void update_whisper_model(struct transcription_filter_data *gf, bool force_whisp
 			obs_log(gf->log_level, "dtw_token_timestamps changed from %d to %d",
 				gf->enable_token_ts_dtw, new_dtw_timestamps);
 			gf->enable_token_ts_dtw = new_dtw_timestamps;
-			shutdown_whisper_thread(gf, false);
-			start_whisper_thread_with_path(gf, gf->whisper_model_file_currently_loaded,
-						       silero_vad_model_file_str.c_str());
+			switch_whisper_model(gf, gf->whisper_model_file_requested,
+					     silero_vad_model_file_str.c_str());
 		}
 
 		if (force_whisper_restart) {
-			obs_log(gf->log_level, "Restarting whisper due to force restart flag");
-			shutdown_whisper_thread(gf, false);
-			start_whisper_thread_with_path(gf, gf->whisper_model_file_currently_loaded,
-						       silero_vad_model_file_str.c_str());
+			obs_log(gf->log_level, "Reloading whisper due to force restart flag");
+			switch_whisper_model(gf, gf->whisper_model_file_requested,
+					     silero_vad_model_file_str.c_str());
+		}
+	}
+}
+
+void autotune_whisper_model(struct transcription_filter_data *gf, bool force)
+{
+	if (gf == nullptr || gf->context == nullptr) {
+		return;
+	}
+	obs_data_t *s = obs_source_get_settings(gf->context);
+	const std::string model_path = obs_data_get_string(s, "whisper_model_path") != nullptr
+					       ? obs_data_get_string(s, "whisper_model_path")
+					       : "";
+	const std::string external_model_file_path =
+		obs_data_get_string(s, "whisper_model_path_external") != nullptr
+			? obs_data_get_string(s, "whisper_model_path_external")
+			: "";
+	obs_data_release(s);
+
+	autotune_request request;
+	request.force = force;
+	if (model_path.find("!!!external!!!") != std::string::npos) {
+		request.model_key = external_model_file_path;
+		if (!external_model_file_path.empty()) {
+			request.model_files.push_back(
+				{MODEL_QUANTIZATION_NONE, external_model_file_path});
 		}
+	} else if (models_info().count(model_path) > 0) {
+		const ModelInfo &model_info = models_info().at(model_path);
+		request.model_key = model_path;
+		request.set_quantization = model_info.type == MODEL_TYPE_TRANSCRIPTION;
+		const std::string model_file = find_model_bin_file(model_info);
+		if (!model_file.empty()) {
+			request.model_files.push_back({MODEL_QUANTIZATION_NONE, model_file});
+		}
+		// the quantized copies the downloader made, nothing is quantized for the autotune
+		for (int quantization : {MODEL_QUANTIZATION_Q8_0, MODEL_QUANTIZATION_Q5_K}) {
+			const std::string quantized_file = find_model_bin_file(
+				quantized_model_info(model_info, quantization));
+			if (request.set_quantization && !quantized_file.empty()) {
+				request.model_files.push_back({quantization, quantized_file});
+			}
+		}
+	}
+	if (!force && (!gf->backend_autotune || gf->backend_autotuned_model == request.model_key)) {
+		// applied once per model, a backend changed by hand afterwards is kept
+		return;
+	}
+	if (request.model_files.empty()) {
+		obs_log(LOG_WARNING, "Autotune: the model '%s' is not downloaded",
+			request.model_key.c_str());
+		return;
 	}
+	gf->backend_autotuned_model = request.model_key;
+	queue_backend_autotune(gf->context, request);
 }
@@ -6,5 +6,8 @@
 #include "transcription-filter-data.h"
 
 void update_whisper_model(struct transcription_filter_data *gf, bool force_whisper_restart = false);
+// Queue the backend autotune of the selected model, see backend-autotune.h. Without force, only
+// on the first load of the model with the "backend_autotune" setting.
+void autotune_whisper_model(struct transcription_filter_data *gf, bool force);
 
 #endif // WHISPER_MODEL_UTILS_H
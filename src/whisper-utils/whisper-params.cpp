@@ -1,4 +1,5 @@
 #include "whisper-params.h"
+#include "context-prompt.h"
 
 #include <obs-module.h>
 
@@ -77,9 +78,11 @@ void apply_whisper_params_defaults_on_settings(obs_data_t *s)
 	obs_data_set_default_int(s, "max_tokens", whisper_params_tmp.max_tokens);
 	obs_data_set_default_bool(s, "debug_mode", whisper_params_tmp.debug_mode);
 	obs_data_set_default_int(s, "audio_ctx", whisper_params_tmp.audio_ctx);
+	obs_data_set_default_bool(s, "audio_ctx_auto", false);
 	obs_data_set_default_bool(s, "tdrz_enable", whisper_params_tmp.tdrz_enable);
 	obs_data_set_default_string(s, "suppress_regex", whisper_params_tmp.suppress_regex);
 	obs_data_set_default_string(s, "initial_prompt", whisper_params_tmp.initial_prompt);
+	obs_data_set_default_int(s, "n_context_tokens", 0);
 	// obs_data_set_default_string(s, "language", whisper_params_tmp.language);
 	obs_data_set_default_bool(s, "detect_language", whisper_params_tmp.detect_language);
 	obs_data_set_default_bool(s, "suppress_blank", false);
@@ -169,9 +172,15 @@ void add_whisper_params_group_properties(obs_properties_t *ppts)
 	obs_properties_add_int(g, "max_tokens", MT_("max_tokens"), 0, 1000, 1);
 	obs_properties_add_bool(g, "debug_mode", MT_("debug_mode"));
 	obs_properties_add_int(g, "audio_ctx", MT_("audio_ctx"), 0, 10, 1);
+	obs_property_t *audio_ctx_auto =
+		obs_properties_add_bool(g, "audio_ctx_auto", MT_("audio_ctx_auto"));
+	obs_property_set_long_description(audio_ctx_auto, MT_("audio_ctx_auto_tooltip"));
 	obs_properties_add_bool(g, "tdrz_enable", MT_("tdrz_enable"));
 	obs_properties_add_text(g, "suppress_regex", MT_("suppress_regex"), OBS_TEXT_DEFAULT);
 	obs_properties_add_text(g, "initial_prompt", MT_("initial_prompt"), OBS_TEXT_DEFAULT);
+	obs_property_t *n_context_tokens = obs_properties_add_int(
+		g, "n_context_tokens", MT_("n_context_tokens"), 0, WHISPER_MAX_PROMPT_TOKENS, 8);
+	obs_property_set_long_description(n_context_tokens, MT_("n_context_tokens_tooltip"));
 	// obs_properties_add_text(g, "language", MT_("language"), OBS_TEXT_DEFAULT);
 	obs_properties_add_bool(g, "detect_language", MT_("detect_language"));
 	obs_properties_add_bool(g, "suppress_blank", MT_("suppress_blank"));
@@ -4,10 +4,14 @@
 
 #include <util/profiler.hpp>
 
-#include "plugin-support.h"
+#include "plugin-log.h"
 #include "transcription-filter-data.h"
 #include "whisper-processing.h"
 #include "whisper-utils.h"
+#include "whisper-model-registry.h"
+#include "inference-thread-budget.h"
+#include "backend-cache.h"
+#include "backend-devices.h"
 #include "transcription-utils.h"
 
 #ifdef _WIN32
@@ -17,14 +21,198 @@
 #endif
 
 #include "model-utils/model-find-utils.h"
+#include "model-utils/model-index.h"
 #include "vad-processing.h"
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cstdint>
 #include <regex>
 
+static std::atomic<int> whisper_log_level{LOG_DEBUG};
+
+#ifdef _WIN32
+// Load the model from a read-only mapping of the file. whisper copies the tensors from the
+// mapped pages, so the file is never read into an intermediate buffer and a warm start reads
+// it from the file cache. Returns nullptr with mapped = false if the file could not be mapped.
+static struct whisper_context *
+init_whisper_context_from_mapping(const std::wstring &path, struct whisper_context_params cparams,
+				  bool &mapped)
+{
+	mapped = false;
+	HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL,
+				  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN,
+				  NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		obs_log(LOG_WARNING, "Failed to open whisper model file, error %lu",
+			GetLastError());
+		return nullptr;
+	}
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+		CloseHandle(file);
+		return nullptr;
+	}
+	// the mapping and the view keep the file open
+	HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file);
+	if (mapping == NULL) {
+		obs_log(LOG_WARNING, "Failed to map whisper model file, error %lu",
+			GetLastError());
+		return nullptr;
+	}
+	void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	CloseHandle(mapping);
+	if (view == nullptr) {
+		obs_log(LOG_WARNING, "Failed to map whisper model file, error %lu",
+			GetLastError());
+		return nullptr;
+	}
+	mapped = true;
+
+	struct whisper_context *ctx = nullptr;
+	try {
+		// Initialize whisper, without a default state: each filter uses its own state
+		ctx = whisper_init_from_buffer_with_params_no_state(
+			view, (size_t)file_size.QuadPart, cparams);
+	} catch (...) {
+		UnmapViewOfFile(view);
+		throw;
+	}
+	// whisper does not keep references to the buffer
+	UnmapViewOfFile(view);
+	return ctx;
+}
+#endif
+
+int resolve_whisper_gpu_device(const struct transcription_filter_data *gf)
+{
+	if (gf->gpu_device != GPU_DEVICE_AUTO) {
+		return gf->gpu_device;
+	}
+
+	// discrete GPUs first, then the most free memory, which counts the models already loaded
+	int best_device = -1;
+	bool best_integrated = true;
+	size_t best_free = 0;
+	const std::vector<gpu_device_info> &gpu_devices = backend_gpu_devices();
+	for (size_t i = 0; i < gpu_devices.size(); i++) {
+		const gpu_device_info &device = gpu_devices[i];
+		size_t free_memory = 0;
+		size_t total_memory = 0;
+		ggml_backend_dev_memory(ggml_backend_dev_get(device.device_index), &free_memory,
+					&total_memory);
+		obs_log(LOG_INFO, "GPU device %d (%s): %zu of %zu MB free", (int)i,
+			device.device_name, free_memory >> 20, total_memory >> 20);
+		if (best_device < 0 || (best_integrated && !device.integrated) ||
+		    (best_integrated == device.integrated && free_memory > best_free)) {
+			best_device = (int)i;
+			best_integrated = device.integrated;
+			best_free = free_memory;
+		}
+	}
+	if (best_device < 0) {
+		obs_log(LOG_INFO, "No GPU device found for automatic placement");
+	}
+	return best_device;
+}
+
+// The DTW alignment heads of the model, from the dimensions in its file. The quantized models
+// keep the dimensions of the model they come from. The models without a preset (distilled,
+// unknown) use the heads of their n_top last decoder layers.
+static enum whisper_alignment_heads_preset dtw_aheads_preset_for_model(const std::string &path,
+									int &n_top)
+{
+	whisper_model_header header;
+	if (!read_whisper_model_header(path, header) || header.n_text_layer <= 0) {
+		obs_log(LOG_WARNING, "Cannot read the whisper model header");
+		return WHISPER_AHEADS_NONE;
+	}
+	n_top = std::max(1, header.n_text_layer / 2);
+	// the English-only models have one token less than the multilingual ones
+	const bool english = header.n_vocab == 51864;
+	if (header.n_audio_layer == 32 && header.n_text_layer == 4) {
+		return WHISPER_AHEADS_LARGE_V3_TURBO;
+	}
+	if (header.n_text_layer == header.n_audio_layer) {
+		switch (header.n_audio_layer) {
+		case 4:
+			return english ? WHISPER_AHEADS_TINY_EN : WHISPER_AHEADS_TINY;
+		case 6:
+			return english ? WHISPER_AHEADS_BASE_EN : WHISPER_AHEADS_BASE;
+		case 12:
+			return english ? WHISPER_AHEADS_SMALL_EN : WHISPER_AHEADS_SMALL;
+		case 24:
+			return english ? WHISPER_AHEADS_MEDIUM_EN : WHISPER_AHEADS_MEDIUM;
+		case 32: {
+			if (header.n_mels == 128) {
+				return WHISPER_AHEADS_LARGE_V3;
+			}
+			// v1 and v2 have the same dimensions
+			const std::string file_name =
+				std::filesystem::u8path(path).filename().u8string();
+			return file_name.find("v1") != std::string::npos ? WHISPER_AHEADS_LARGE_V1
+									 : WHISPER_AHEADS_LARGE_V2;
+		}
+		}
+	}
+	obs_log(LOG_INFO, "No DTW alignment heads preset for the model, using the top %d layers",
+		n_top);
+	return WHISPER_AHEADS_N_TOP_MOST;
+}
+
+struct whisper_context *load_whisper_model_file(const std::string &model_path,
+						struct whisper_context_params cparams)
+{
+	struct whisper_context *ctx = nullptr;
+	try {
+#ifdef _WIN32
+		// convert model path UTF8 to wstring (wchar_t) for whisper
+		int count = MultiByteToWideChar(CP_UTF8, 0, model_path.c_str(),
+						(int)model_path.length(), NULL, 0);
+		std::wstring model_path_ws(count, 0);
+		MultiByteToWideChar(CP_UTF8, 0, model_path.c_str(), (int)model_path.length(),
+				    &model_path_ws[0], count);
+
+		bool mapped = false;
+		ctx = init_whisper_context_from_mapping(model_path_ws, cparams, mapped);
+		if (!mapped) {
+			// fall back to reading the model into a buffer
+			std::ifstream modelFile(model_path_ws, std::ios::binary);
+			if (!modelFile.is_open()) {
+				obs_log(LOG_ERROR, "Failed to open whisper model file %s",
+					model_path.c_str());
+				return nullptr;
+			}
+			modelFile.seekg(0, std::ios::end);
+			const size_t modelFileSize = modelFile.tellg();
+			modelFile.seekg(0, std::ios::beg);
+			std::vector<char> modelBuffer(modelFileSize);
+			modelFile.read(modelBuffer.data(), modelFileSize);
+			modelFile.close();
+
+			// Initialize whisper, without a default state: each filter uses its own
+			// state
+			ctx = whisper_init_from_buffer_with_params_no_state(
+				modelBuffer.data(), modelFileSize, cparams);
+		}
+#else
+		ctx = whisper_init_from_file_with_params_no_state(model_path.c_str(), cparams);
+#endif
+	} catch (const std::exception &e) {
+		obs_log(LOG_ERROR, "Exception while loading whisper model: %s", e.what());
+		return nullptr;
+	}
+	if (ctx == nullptr) {
+		obs_log(LOG_ERROR, "Failed to load whisper model");
+		return nullptr;
+	}
+	return ctx;
+}
+
 struct whisper_context *init_whisper_context(const std::string &model_path_in,
-					     struct transcription_filter_data *gf)
+					     struct transcription_filter_data *gf, int gpu_device)
 {
 	std::string model_path = model_path_in;
 
@@ -43,37 +231,39 @@ struct whisper_context *init_whisper_context(const std::string &model_path_in,
 		model_path = model_bin_file;
 	}
 
+	// the whisper log callback is process-wide and the model may outlive this filter, so
+	// don't pass the filter data as user data
+	whisper_log_level = gf->log_level;
 	whisper_log_set(
 		[](enum ggml_log_level level, const char *text, void *user_data) {
 			UNUSED_PARAMETER(level);
-			struct transcription_filter_data *ctx =
-				static_cast<struct transcription_filter_data *>(user_data);
+			UNUSED_PARAMETER(user_data);
 			// remove trailing newline
 			char *text_copy = bstrdup(text);
 			text_copy[strcspn(text_copy, "\n")] = 0;
-			obs_log(ctx->log_level, "Whisper: %s", text_copy);
+			obs_log(whisper_log_level, "Whisper: %s", text_copy);
 			bfree(text_copy);
 		},
-		gf);
+		nullptr);
 
 	struct whisper_context_params cparams = whisper_context_default_params();
 
-	if (gf->gpu_device < 0) {
+	if (gpu_device < 0) {
 		cparams.use_gpu = false;
 		obs_log(LOG_INFO, "Using CPU for inference");
 	} else {
 		try {
-			if (gf->gpu_device >= (int)gf->gpu_devices.size()) {
+			if (gpu_device >= (int)backend_gpu_devices().size()) {
 				obs_log(LOG_WARNING,
 					"Invalid GPU device selected: %d. Using CPU for inference",
 					cparams.gpu_device);
 				cparams.use_gpu = false;
 			} else {
 				cparams.use_gpu = true;
-				cparams.gpu_device = gf->gpu_device;
+				cparams.gpu_device = gpu_device;
 				obs_log(LOG_INFO, "Using GPU device %d (%s) for inference",
 					cparams.gpu_device,
-					gf->gpu_devices.at(cparams.gpu_device).device_name);
+					backend_gpu_devices().at(cparams.gpu_device).device_name);
 			}
 		} catch (const std::exception &e) {
 			obs_log(LOG_WARNING,
@@ -86,50 +276,19 @@ struct whisper_context *init_whisper_context(const std::string &model_path_in,
 
 	cparams.dtw_token_timestamps = gf->enable_token_ts_dtw;
 	if (gf->enable_token_ts_dtw) {
-		obs_log(LOG_INFO, "DTW token timestamps enabled");
-		cparams.dtw_aheads_preset = WHISPER_AHEADS_TINY_EN;
-		// cparams.dtw_n_top = 4;
+		cparams.dtw_aheads_preset =
+			dtw_aheads_preset_for_model(model_path, cparams.dtw_n_top);
+		// without the alignment heads the token timestamps come from the segments
+		cparams.dtw_token_timestamps = cparams.dtw_aheads_preset != WHISPER_AHEADS_NONE;
+		obs_log(LOG_INFO, "DTW token timestamps enabled (alignment heads preset %d)",
+			(int)cparams.dtw_aheads_preset);
 	} else {
 		obs_log(LOG_INFO, "DTW token timestamps disabled");
 		cparams.dtw_aheads_preset = WHISPER_AHEADS_NONE;
 	}
 
-	struct whisper_context *ctx = nullptr;
-	try {
-#ifdef _WIN32
-		// convert model path UTF8 to wstring (wchar_t) for whisper
-		int count = MultiByteToWideChar(CP_UTF8, 0, model_path.c_str(),
-						(int)model_path.length(), NULL, 0);
-		std::wstring model_path_ws(count, 0);
-		MultiByteToWideChar(CP_UTF8, 0, model_path.c_str(), (int)model_path.length(),
-				    &model_path_ws[0], count);
-
-		// Read model into buffer
-		std::ifstream modelFile(model_path_ws, std::ios::binary);
-		if (!modelFile.is_open()) {
-			obs_log(LOG_ERROR, "Failed to open whisper model file %s",
-				model_path.c_str());
-			return nullptr;
-		}
-		modelFile.seekg(0, std::ios::end);
-		const size_t modelFileSize = modelFile.tellg();
-		modelFile.seekg(0, std::ios::beg);
-		std::vector<char> modelBuffer(modelFileSize);
-		modelFile.read(modelBuffer.data(), modelFileSize);
-		modelFile.close();
-
-		// Initialize whisper
-		ctx = whisper_init_from_buffer_with_params(modelBuffer.data(), modelFileSize,
-							   cparams);
-#else
-		ctx = whisper_init_from_file_with_params(model_path.c_str(), cparams);
-#endif
-	} catch (const std::exception &e) {
-		obs_log(LOG_ERROR, "Exception while loading whisper model: %s", e.what());
-		return nullptr;
-	}
+	struct whisper_context *ctx = load_whisper_model_file(model_path, cparams);
 	if (ctx == nullptr) {
-		obs_log(LOG_ERROR, "Failed to load whisper model");
 		return nullptr;
 	}
 
@@ -137,12 +296,130 @@ struct whisper_context *init_whisper_context(const std::string &model_path_in,
 	return ctx;
 }
 
-struct DetectionResultWithText run_whisper_inference(struct transcription_filter_data *gf,
-						     const float *pcm32f_data_,
-						     size_t pcm32f_num_samples, uint64_t t0 = 0,
-						     uint64_t t1 = 0,
-						     int vad_state = VAD_STATE_WAS_OFF)
+float *get_scratch_buffer(struct transcription_filter_data *gf, std::vector<float> &buffer,
+			  size_t num_samples)
+{
+	const size_t capacity = buffer.capacity();
+	buffer.resize(num_samples);
+	if (buffer.capacity() != capacity) {
+		gf->scratch_buffer_growths++;
+		OBS_LOG(gf->log_level, "scratch buffer grown to %lu samples (%llu growths)",
+			(unsigned long)buffer.capacity(),
+			(unsigned long long)gf->scratch_buffer_growths);
+	}
+	return buffer.data();
+}
+
+// Log the startup and steady-state inference times of the current model
+static void record_inference_time(struct transcription_filter_data *gf, uint64_t duration_ms)
+{
+	if (gf->inference_count++ == 0) {
+		obs_log(LOG_INFO,
+			"First inference: %llu ms (model load %llu ms, warm-up %llu ms)",
+			(unsigned long long)duration_ms, (unsigned long long)gf->model_load_ms,
+			(unsigned long long)gf->model_warm_up_ms);
+		return;
+	}
+	gf->inference_steady_total_ms += duration_ms;
+	const uint64_t n_steady = gf->inference_count - 1;
+	if (n_steady % INFERENCE_TIMING_LOG_INTERVAL == 0) {
+		obs_log(LOG_INFO, "Steady-state inference: %llu ms on average over %llu inferences",
+			(unsigned long long)(gf->inference_steady_total_ms / n_steady),
+			(unsigned long long)n_steady);
+	}
+}
+
+uint64_t warm_up_whisper_model(struct transcription_filter_data *gf, struct whisper_context *ctx,
+			       struct whisper_state *state)
+{
+	if (ctx == nullptr || state == nullptr) {
+		return 0;
+	}
+	// a busy shared model is already warm
+	if (!begin_shared_inference(ctx, 0, true)) {
+		OBS_LOG(gf->log_level, "Model is in use, skipping the warm-up");
+		return 0;
+	}
+
+	// one second of silence, decoded without context so it leaves no trace in the prompt
+	std::vector<float> silence(WHISPER_SAMPLE_RATE, 0.0f);
+	whisper_full_params params;
+	{
+		std::lock_guard<std::mutex> params_lock(gf->whisper_params_mutex);
+		params = gf->whisper_params;
+	}
+	params.no_context = true;
+	params.single_segment = true;
+	params.max_tokens = 1;
+	params.initial_prompt = nullptr;
+	params.prompt_tokens = nullptr;
+	params.prompt_n_tokens = 0;
+	params.n_threads = acquire_inference_threads(params.n_threads);
+
+	const uint64_t start_ms = now_ms();
+	int result = -1;
+	try {
+		result = whisper_full_with_state(ctx, state, params, silence.data(),
+						 (int)silence.size());
+	} catch (const std::exception &e) {
+		obs_log(LOG_WARNING, "Exception during the whisper warm-up: %s", e.what());
+	}
+	release_inference_threads(params.n_threads);
+	end_shared_inference(ctx);
+	const uint64_t duration_ms = now_ms() - start_ms;
+	obs_log(LOG_INFO, "Whisper warm-up: %llu ms%s", (unsigned long long)duration_ms,
+		result == 0 ? "" : " (failed)");
+	return duration_ms;
+}
+
+// A newer segment was queued while a partial decodes, the partial is obsolete
+static bool partial_abort_callback(void *data)
 {
+	return static_cast<transcription_filter_data *>(data)->abort_partial_inference.load(
+		std::memory_order_relaxed);
+}
+
+// Returning false cancels the run before the encoder
+static bool partial_encoder_begin_callback(struct whisper_context *, struct whisper_state *,
+					   void *data)
+{
+	return !partial_abort_callback(data);
+}
+
+// The last tokens are the same n-gram AUDIO_CTX_REPEAT_COUNT times in a row
+static bool tokens_repeat(const std::vector<whisper_token_data> &tokens)
+{
+	for (size_t n = 1; n <= AUDIO_CTX_REPEAT_MAX_NGRAM; n++) {
+		const size_t span = n * AUDIO_CTX_REPEAT_COUNT;
+		if (tokens.size() < span) {
+			break;
+		}
+		if (span < AUDIO_CTX_REPEAT_MIN_TOKENS) {
+			continue;
+		}
+		bool repeats = true;
+		for (size_t i = tokens.size() - span; repeats && i + n < tokens.size(); i++) {
+			repeats = tokens[i].id == tokens[i + n].id;
+		}
+		if (repeats) {
+			return true;
+		}
+	}
+	return false;
+}
+
+// audio_ctx > 0 overrides the audio_ctx setting. quality_failed is set when the decoding failed,
+// or the tokens of a reduced audio_ctx loop (see AUDIO_CTX_REPEAT_COUNT). The rejections of
+// silence, of the time token ratio and of the probability checks are results, not failures.
+// Returns DETECTION_RESULT_NO_INFERENCE when a partial was aborted by a newer segment.
+static struct DetectionResultWithText
+run_whisper_inference_with_ctx(struct transcription_filter_data *gf, const float *pcm32f_data_,
+			       size_t pcm32f_num_samples, uint64_t t0, uint64_t t1, int vad_state,
+			       uint64_t buffer_generation, uint64_t overlap_ms, int audio_ctx,
+			       bool &quality_failed)
+{
+	quality_failed = false;
+
 	if (gf == nullptr) {
 		obs_log(LOG_ERROR, "run_whisper_inference: gf is null");
 		return {DETECTION_RESULT_UNKNOWN, "", t0, t1, {}, ""};
@@ -155,16 +432,24 @@ struct DetectionResultWithText run_whisper_inference(struct transcription_filter
 
 	// if the time difference between t0 and t1 is less than 50 ms - skip
 	if (t1 - t0 < 50) {
-		obs_log(gf->log_level,
+		OBS_LOG(gf->log_level,
 			"Time difference between t0 and t1 is less than 50 ms, skipping");
 		return {DETECTION_RESULT_UNKNOWN, "", t0, t1, {}, ""};
 	}
 
-	obs_log(gf->log_level, "%s: processing %d samples, %.3f sec, %d threads", __func__,
+	// the settings of this run, the filter settings can change while it decodes
+	whisper_full_params params;
+	{
+		std::lock_guard<std::mutex> params_lock(gf->whisper_params_mutex);
+		params = gf->whisper_params;
+	}
+	const int settings_n_threads = params.n_threads;
+
+	OBS_LOG(gf->log_level, "%s: processing %d samples, %.3f sec, %d threads", __func__,
 		int(pcm32f_num_samples), float(pcm32f_num_samples) / WHISPER_SAMPLE_RATE,
-		gf->whisper_params.n_threads);
+		settings_n_threads);
 
-	bool should_free_buffer = false;
+	bool is_padded = false;
 	float *pcm32f_data = (float *)pcm32f_data_;
 	size_t pcm32f_size = pcm32f_num_samples;
 
@@ -173,11 +458,11 @@ struct DetectionResultWithText run_whisper_inference(struct transcription_filter
 		(uint64_t)(pcm32f_num_samples * 1000 / WHISPER_SAMPLE_RATE);
 
 	if (pcm32f_num_samples < WHISPER_SAMPLE_RATE) {
-		obs_log(gf->log_level,
+		OBS_LOG(gf->log_level,
 			"Speech segment is less than 1 second, padding with white noise to 1 second");
 		const size_t new_size = (size_t)(1.01f * (float)(WHISPER_SAMPLE_RATE));
-		// create a new buffer and copy the data to it in the middle
-		pcm32f_data = (float *)bzalloc(new_size * sizeof(float));
+		// copy the data to the middle of the padding buffer
+		pcm32f_data = get_scratch_buffer(gf, gf->padding_scratch, new_size);
 
 		// add low volume white noise
 		const float noise_level = 0.01f;
@@ -189,34 +474,140 @@ struct DetectionResultWithText run_whisper_inference(struct transcription_filter
 		memcpy(pcm32f_data + (new_size - pcm32f_num_samples) / 2, pcm32f_data_,
 		       pcm32f_num_samples * sizeof(float));
 		pcm32f_size = new_size;
-		should_free_buffer = true;
+		is_padded = true;
 	}
 
 	// duration in ms
 	const uint64_t whisper_duration_ms = (uint64_t)(pcm32f_size * 1000 / WHISPER_SAMPLE_RATE);
 
 	std::lock_guard<std::mutex> lock(gf->whisper_ctx_mutex);
-	if (gf->whisper_context == nullptr) {
+	if (gf->whisper_context == nullptr || gf->whisper_state == nullptr) {
 		obs_log(LOG_WARNING, "whisper context is null");
 		return {DETECTION_RESULT_UNKNOWN, "", t0, t1, {}, ""};
 	}
 
-	if (gf->n_context_sentences > 0 && !gf->last_transcription_sentence.empty()) {
-		// set the initial prompt to the last transcription sentences (concatenated)
-		std::string initial_prompt = gf->last_transcription_sentence[0];
-		for (size_t i = 1; i < gf->last_transcription_sentence.size(); ++i) {
-			initial_prompt += " " + gf->last_transcription_sentence[i];
+	// partials are decoded by the draft model when there is one, finals by the main model
+	// unless the filter is overloaded
+	const bool use_draft =
+		(vad_state == VAD_STATE_PARTIAL ||
+		 gf->overload.level() >= OVERLOAD_LEVEL_FALLBACK_MODEL) &&
+		gf->draft_whisper_context != nullptr && gf->draft_whisper_state != nullptr;
+	struct whisper_context *ctx = use_draft ? gf->draft_whisper_context : gf->whisper_context;
+	struct whisper_state *state = use_draft ? gf->draft_whisper_state : gf->whisper_state;
+
+	// the tokens of the last final segments, already tokenized
+	const int n_vocab = whisper_n_vocab(ctx);
+	std::vector<whisper_token> prompt_tokens = gf->context_prompt.tokens(n_vocab);
+
+	// incremental partial: decode only the audio after the committed (stable) tokens of the
+	// previous partials, with the committed tokens as the decoder prompt.
+	// not possible when the buffer was padded, since the audio positions moved.
+	const bool incremental_partial = vad_state == VAD_STATE_PARTIAL &&
+					 gf->partial_incremental && !is_padded;
+	if (vad_state != VAD_STATE_PARTIAL || !incremental_partial) {
+		// a final segment (or non-incremental partial) starts over
+		gf->partial_last_tokens.clear();
+		gf->partial_committed_tokens.clear();
+		gf->partial_committed_end_ms = 0;
+	}
+	// with "auto", the language is locked once it was detected consistently
+	const bool auto_language = params.language == nullptr || strlen(params.language) == 0 ||
+				   strcmp(params.language, "auto") == 0;
+	const char *sticky_language =
+		auto_language ? gf->sticky_language.language(vad_state == VAD_STATE_PARTIAL)
+			      : nullptr;
+	if (sticky_language != nullptr) {
+		params.language = sticky_language;
+		params.detect_language = false;
+	}
+	if (audio_ctx > 0) {
+		params.audio_ctx = audio_ctx;
+	}
+	if (gf->overload.level() >= OVERLOAD_LEVEL_GREEDY) {
+		params.strategy = WHISPER_SAMPLING_GREEDY;
+	}
+	if (vad_state == VAD_STATE_PARTIAL) {
+		// stop the partial as soon as a newer segment is queued, its result would be
+		// replaced right away
+		params.encoder_begin_callback = partial_encoder_begin_callback;
+		params.encoder_begin_callback_user_data = gf;
+		params.abort_callback = partial_abort_callback;
+		params.abort_callback_user_data = gf;
+	}
+	if (incremental_partial) {
+		// token timestamps are needed to know where the committed tokens end
+		params.token_timestamps = true;
+		if (gf->partial_committed_end_ms + 200 < whisper_duration_ms) {
+			params.offset_ms = (int)gf->partial_committed_end_ms;
+		}
+		// the committed tokens follow the context
+		for (const auto &token : gf->partial_committed_tokens) {
+			prompt_tokens.push_back(token.id);
+		}
+		OBS_LOG(gf->log_level, "Incremental partial: %d committed tokens, offset %d ms",
+			(int)gf->partial_committed_tokens.size(), params.offset_ms);
+	}
+	if (!prompt_tokens.empty()) {
+		params.prompt_tokens = prompt_tokens.data();
+		params.prompt_n_tokens = (int)prompt_tokens.size();
+		// whisper_full would replace the prompt tokens with the tokenized initial prompt
+		params.initial_prompt = nullptr;
+		OBS_LOG(gf->log_level, "Prompt: %d tokens", params.prompt_n_tokens);
+	}
+
+	OBS_LOG(gf->log_level, "Running whisper inference. single segment? %s",
+		params.single_segment ? "yes" : "no");
+
+	// with the mel cache the spectrogram is set on the state upfront, whisper_full then
+	// skips its own mel computation. the frames of the audio a previous run of the same
+	// segment already covered are reused.
+	bool mel_is_set = false;
+	if (gf->mel_cache_enabled) {
+		ProfileScope("mel_cache");
+		const int n_mel = whisper_model_n_mels(ctx);
+		if (gf->mel_cache.n_mel() != n_mel) {
+			gf->mel_cache.init(n_mel);
+		}
+		if (is_padded) {
+			// the audio moved to the middle of the noise, nothing to reuse
+			gf->mel_cache.clear();
 		}
-		gf->whisper_params.initial_prompt = initial_prompt.c_str();
-		obs_log(gf->log_level, "Initial prompt: %s", gf->whisper_params.initial_prompt);
+		const size_t stable_samples = is_padded ? 0 : pcm32f_size - SEGMENT_PADDING_SAMPLES;
+		const size_t reused = gf->mel_cache.compute(pcm32f_data, pcm32f_size,
+							    stable_samples, buffer_generation);
+		mel_is_set = whisper_set_mel_with_state(ctx, state, gf->mel_cache.data(),
+							gf->mel_cache.n_len(), n_mel) == 0;
+		OBS_LOG(gf->log_level, "Mel cache: %d frames, %d reused", gf->mel_cache.n_len(),
+			(int)reused);
+	}
+
+	// wait for a decode slot on the (possibly shared) model. partials are skipped if they can't
+	// get one in time, the next partial or the final segment will cover the same audio. a
+	// running partial is aborted when the final of another filter needs its slot
+	const bool is_partial = vad_state == VAD_STATE_PARTIAL;
+	if (!begin_shared_inference(ctx, gf->inference_max_wait_ms, is_partial,
+				    inference_priority(gf->inference_priority_class, !is_partial),
+				    is_partial ? &gf->abort_partial_inference : nullptr)) {
+		OBS_LOG(gf->log_level, "No inference slot within %llu ms, skipping partial segment",
+			(unsigned long long)gf->inference_max_wait_ms);
+		return {DETECTION_RESULT_UNKNOWN, "", t0, t1, {}, ""};
+	}
+	if (vad_state == VAD_STATE_PARTIAL && partial_abort_callback(gf)) {
+		// superseded while waiting for the slot
+		end_shared_inference(ctx);
+		gf->metrics.partials_aborted.fetch_add(1, std::memory_order_relaxed);
+		return {DETECTION_RESULT_NO_INFERENCE, "", t0, t1, {}, ""};
 	}
 
-	obs_log(gf->log_level, "Running whisper inference. single segment? %s",
-		gf->whisper_params.single_segment ? "yes" : "no");
+	// threads from the process-wide budget, shared with the other filters decoding now
+	params.n_threads = acquire_inference_threads(settings_n_threads);
+	OBS_LOG(gf->log_level, "Using %d of %d inference threads", params.n_threads,
+		settings_n_threads);
 
 	// run the inference
 	int whisper_full_result = -1;
-	gf->whisper_params.duration_ms = (int)(whisper_duration_ms);
+	const uint64_t whisper_full_start_ms = now_ms();
+	params.duration_ms = (int)whisper_duration_ms - params.offset_ms;
 	try {
 		// whisper_full_params whisper_params_tmp = whisper_full_default_params(whisper_sampling_strategy::WHISPER_SAMPLING_BEAM_SEARCH);
 		// whisper_params_tmp.language = gf->whisper_params.language;
@@ -228,47 +619,81 @@ struct DetectionResultWithText run_whisper_inference(struct transcription_filter
 		// whisper_params_tmp.suppress_blank = false;
 		// whisper_params_pretty_print(gf->whisper_params);
 		// whisper_params_pretty_print(whisper_params_tmp);
-		whisper_full_result = whisper_full(gf->whisper_context, gf->whisper_params,
-						   pcm32f_data, (int)pcm32f_size);
+		StageTimer timer(gf->pipeline_timings, PIPELINE_STAGE_WHISPER);
+		// milliseconds of audio, for the real-time factor
+		timer.set_units((uint64_t)std::max(params.duration_ms, 0));
+		if (mel_is_set) {
+			whisper_full_result =
+				whisper_full_with_state(ctx, state, params, nullptr, 0);
+		} else {
+			whisper_full_result = whisper_full_with_state(ctx, state, params,
+								      pcm32f_data,
+								      (int)pcm32f_size);
+		}
 	} catch (const std::exception &e) {
+		release_inference_threads(params.n_threads);
+		end_shared_inference(ctx);
 		obs_log(LOG_ERROR, "Whisper exception: %s. Filter restart is required", e.what());
-		whisper_free(gf->whisper_context);
-		gf->whisper_context = nullptr;
-		if (should_free_buffer) {
-			bfree(pcm32f_data);
+		if (use_draft) {
+			// drop the draft model, partials fall back to the main model
+			whisper_free_state(gf->draft_whisper_state);
+			gf->draft_whisper_state = nullptr;
+			release_shared_whisper_context(gf->draft_whisper_context);
+			gf->draft_whisper_context = nullptr;
+		} else {
+			gf->whisper_context_ready = false;
+			whisper_free_state(gf->whisper_state);
+			gf->whisper_state = nullptr;
+			release_shared_whisper_context(gf->whisper_context);
+			gf->whisper_context = nullptr;
 		}
 		return {DETECTION_RESULT_UNKNOWN, "", t0, t1, {}, ""};
 	}
-	if (should_free_buffer) {
-		bfree(pcm32f_data);
+	release_inference_threads(params.n_threads);
+	end_shared_inference(ctx);
+	if (whisper_full_result != 0 && vad_state == VAD_STATE_PARTIAL &&
+	    partial_abort_callback(gf)) {
+		OBS_LOG(gf->log_level,
+			"Partial inference aborted by a newer segment or preempted after %llu ms",
+			(unsigned long long)(now_ms() - whisper_full_start_ms));
+		gf->metrics.partials_aborted.fetch_add(1, std::memory_order_relaxed);
+		return {DETECTION_RESULT_NO_INFERENCE, "", t0, t1, {}, ""};
+	}
+	if (!use_draft) {
+		record_inference_time(gf, now_ms() - whisper_full_start_ms);
 	}
 
-	std::string language = gf->whisper_params.language;
-	if (gf->whisper_params.language == nullptr || strlen(gf->whisper_params.language) == 0 ||
-	    strcmp(gf->whisper_params.language, "auto") == 0) {
-		int lang_id = whisper_lang_auto_detect(gf->whisper_context, 0, 1, nullptr);
+	// the language whisper_full detected, no separate detection pass
+	std::string language = params.language != nullptr ? params.language : "";
+	const bool language_detected = auto_language && sticky_language == nullptr;
+	if (language_detected) {
+		int lang_id = whisper_full_lang_id_from_state(state);
 		language = whisper_lang_str(lang_id);
-		obs_log(gf->log_level, "Detected language: %s", language.c_str());
+		OBS_LOG(gf->log_level, "Detected language: %s", language.c_str());
 	}
 
 	if (whisper_full_result != 0) {
 		obs_log(LOG_WARNING, "failed to process audio, error %d", whisper_full_result);
+		quality_failed = true;
 		return {DETECTION_RESULT_UNKNOWN, "", t0, t1, {}, ""};
 	}
+	// only the finals of the main model count for the sticky language
+	const bool update_sticky_language = auto_language && vad_state != VAD_STATE_PARTIAL &&
+					    !use_draft;
 
 	float sentence_p = 0.0f;
 	std::string text = "";
 	std::string tokenIds = "";
 	std::vector<whisper_token_data> tokens;
-	for (int n_segment = 0; n_segment < whisper_full_n_segments(gf->whisper_context);
-	     ++n_segment) {
-		const int n_tokens = whisper_full_n_tokens(gf->whisper_context, n_segment);
+	std::vector<std::string> token_texts;
+	const int n_segments = whisper_full_n_segments_from_state(state);
+	for (int n_segment = 0; n_segment < n_segments; ++n_segment) {
+		const int n_tokens = whisper_full_n_tokens_from_state(state, n_segment);
 		for (int j = 0; j < n_tokens; ++j) {
 			// get token
 			whisper_token_data token =
-				whisper_full_get_token_data(gf->whisper_context, n_segment, j);
-			const std::string token_str =
-				whisper_token_to_str(gf->whisper_context, token.id);
+				whisper_full_get_token_data_from_state(state, n_segment, j);
+			const std::string token_str = whisper_token_to_str(ctx, token.id);
 			bool keep = true;
 			// if the token starts with '[' and ends with ']', don't keep it
 			if (token_str[0] == '[' && token_str[token_str.size() - 1] == ']') {
@@ -287,14 +712,18 @@ struct DetectionResultWithText run_whisper_inference(struct transcription_filter
 				const float time = ((float)token.id - 50365.0f) * 0.02f;
 				const float duration_s = (float)incoming_duration_ms / 1000.0f;
 				const float ratio = time / duration_s;
-				obs_log(gf->log_level,
+				OBS_LOG(gf->log_level,
 					"Time token found %d -> %.3f. Duration: %.3f. Ratio: %.3f. Threshold %.2f",
 					token.id, time, duration_s, ratio,
 					gf->duration_filter_threshold);
 				if (ratio > gf->duration_filter_threshold) {
 					// ratio is too high, skip this detection
-					obs_log(gf->log_level,
+					OBS_LOG(gf->log_level,
 						"Time token ratio too high, skipping");
+					if (update_sticky_language && !language_detected) {
+						// likely a hallucination, check the language
+						gf->sticky_language.update(language, false, 0.0f);
+					}
 					return {DETECTION_RESULT_SILENCE, "", t0, t1, {}, language};
 				}
 				keep = false;
@@ -304,19 +733,94 @@ struct DetectionResultWithText run_whisper_inference(struct transcription_filter
 				sentence_p += token.p;
 				text += token_str;
 				tokens.push_back(token);
+				token_texts.push_back(token_str);
 			}
-			obs_log(gf->log_level, "S %d, T %2d: %5d\t%s\tp: %.3f [keep: %d]",
+			OBS_LOG(gf->log_level, "S %d, T %2d: %5d\t%s\tp: %.3f [keep: %d]",
 				n_segment, j, token.id, token_str.c_str(), token.p, keep);
 		}
 	}
 	sentence_p /= (float)tokens.size();
+	if (update_sticky_language && !tokens.empty()) {
+		gf->sticky_language.update(language, language_detected, sentence_p);
+	}
 	if (sentence_p < gf->sentence_psum_accept_thresh) {
-		obs_log(gf->log_level, "Sentence psum %.3f below threshold %.3f, skipping",
+		OBS_LOG(gf->log_level, "Sentence psum %.3f below threshold %.3f, skipping",
 			sentence_p, gf->sentence_psum_accept_thresh);
 		return {DETECTION_RESULT_SILENCE, "", t0, t1, {}, language};
 	}
+	if (audio_ctx > 0 && tokens_repeat(tokens)) {
+		OBS_LOG(gf->log_level, "Repeated tokens with audio context %d", audio_ctx);
+		quality_failed = true;
+		return {DETECTION_RESULT_SILENCE, "", t0, t1, {}, language};
+	}
 
-	obs_log(gf->log_level, "Decoded sentence: '%s'", text.c_str());
+	if (incremental_partial) {
+		// merge the newly decoded tail onto the committed tokens
+		tokens = reconstructSentence(gf->partial_committed_tokens, tokens);
+		text.clear();
+		token_texts.clear();
+		for (const auto &token : tokens) {
+			token_texts.push_back(whisper_token_to_str(ctx, token.id));
+			text += token_texts.back();
+		}
+		// commit the prefix that is the same as in the previous partial (local agreement)
+		size_t n_stable = 0;
+		while (n_stable < tokens.size() && n_stable < gf->partial_last_tokens.size() &&
+		       tokens[n_stable].id == gf->partial_last_tokens[n_stable].id) {
+			n_stable++;
+		}
+		if (n_stable > gf->partial_committed_tokens.size() && tokens[n_stable - 1].t1 > 0) {
+			gf->partial_committed_tokens.assign(tokens.begin(),
+							    tokens.begin() + n_stable);
+			// token timestamps are in 10 ms units
+			gf->partial_committed_end_ms = (uint64_t)tokens[n_stable - 1].t1 * 10;
+		}
+		gf->partial_last_tokens = tokens;
+	}
+
+	// the tokens of a final as decoded, the overlap of the next segment is matched to them
+	std::vector<whisper_token_data> decoded_tokens;
+	if (vad_state != VAD_STATE_PARTIAL) {
+		decoded_tokens = tokens;
+	}
+	if (overlap_ms > 0 && !gf->seam_tokens.empty() && gf->seam_n_vocab == n_vocab) {
+		// the audio starts with the end of the previous final: align the two token
+		// streams and keep what follows the previous final
+		const size_t n_seam = gf->seam_tokens.size();
+		const std::pair<int, int> overlap = findStartOfOverlap(gf->seam_tokens, tokens);
+		size_t n_dropped = 0;
+		if (overlap.first >= 0 && overlap.second >= 0) {
+			// seam_tokens[first] is tokens[second], the previous final ends after the
+			// n_seam - first tokens from there
+			n_dropped = std::min(tokens.size(),
+					     (size_t)overlap.second + n_seam - (size_t)overlap.first);
+		} else {
+			// no overlap of the tokens, drop the ones that start in the overlap
+			// (token timestamps are in 10 ms units)
+			while (n_dropped < tokens.size() && tokens[n_dropped].t1 > 0 &&
+			       (uint64_t)tokens[n_dropped].t0 * 10 < overlap_ms) {
+				n_dropped++;
+			}
+		}
+		tokens.erase(tokens.begin(), tokens.begin() + n_dropped);
+		if (n_dropped > 0) {
+			OBS_LOG(gf->log_level,
+				"Overlap with the previous segment: %d tokens dropped",
+				(int)n_dropped);
+			text.clear();
+			token_texts.clear();
+			for (const auto &token : tokens) {
+				token_texts.push_back(whisper_token_to_str(ctx, token.id));
+				text += token_texts.back();
+			}
+		}
+	}
+	if (vad_state != VAD_STATE_PARTIAL) {
+		gf->seam_tokens = std::move(decoded_tokens);
+		gf->seam_n_vocab = n_vocab;
+	}
+
+	OBS_LOG(gf->log_level, "Decoded sentence: '%s'", text.c_str());
 
 	if (gf->log_words) {
 		obs_log(LOG_INFO, "[%s --> %s]%s(%.3f) %s", to_timestamp(t0).c_str(),
@@ -328,47 +832,370 @@ struct DetectionResultWithText run_whisper_inference(struct transcription_filter
 		return {DETECTION_RESULT_SILENCE, "", t0, t1, {}, language};
 	}
 
+	if (vad_state != VAD_STATE_PARTIAL) {
+		gf->context_prompt.push(tokens, n_vocab);
+	}
+
 	return {vad_state == VAD_STATE_PARTIAL ? DETECTION_RESULT_PARTIAL : DETECTION_RESULT_SPEECH,
 		text,
 		t0,
 		t1,
 		tokens,
-		language};
+		language,
+		token_texts};
 }
 
-void run_inference_and_callbacks(transcription_filter_data *gf, uint64_t start_offset_ms,
-				 uint64_t end_offset_ms, int vad_state)
+// Encoder positions for the audio plus a margin, rounded up to a bucket. 0 (the full 30 s window)
+// when that is not smaller.
+static int auto_audio_ctx(size_t num_samples)
 {
-	// get the data from the entire whisper buffer
-	// add 50ms of silence to the beginning and end of the buffer
-	const size_t pcm32f_size = gf->whisper_buffer.size / sizeof(float);
-	const size_t pcm32f_size_with_silence = pcm32f_size + 2 * WHISPER_SAMPLE_RATE / 100;
-	// allocate a new buffer and copy the data to it
-	float *pcm32f_data = (float *)bzalloc(pcm32f_size_with_silence * sizeof(float));
-	if (vad_state == VAD_STATE_PARTIAL) {
-		// peek instead of pop, since this is a partial run that keeps the data in the buffer
-		deque_peek_front(&gf->whisper_buffer, pcm32f_data + WHISPER_SAMPLE_RATE / 100,
-				 pcm32f_size * sizeof(float));
-	} else {
-		deque_pop_front(&gf->whisper_buffer, pcm32f_data + WHISPER_SAMPLE_RATE / 100,
-				pcm32f_size * sizeof(float));
+	// short segments are padded to 1 s before the inference
+	num_samples = std::max(num_samples, (size_t)(1.01f * (float)WHISPER_SAMPLE_RATE));
+	const size_t positions = (num_samples + AUDIO_CTX_SAMPLES_PER_POSITION - 1) /
+					 AUDIO_CTX_SAMPLES_PER_POSITION +
+				 AUDIO_CTX_MARGIN;
+	const size_t bucketed = (positions + AUDIO_CTX_BUCKET - 1) / AUDIO_CTX_BUCKET *
+				AUDIO_CTX_BUCKET;
+	return bucketed < AUDIO_CTX_FULL ? (int)bucketed : 0;
+}
+
+struct DetectionResultWithText run_whisper_inference(struct transcription_filter_data *gf,
+						     const float *pcm32f_data_,
+						     size_t pcm32f_num_samples, uint64_t t0 = 0,
+						     uint64_t t1 = 0,
+						     int vad_state = VAD_STATE_WAS_OFF,
+						     uint64_t buffer_generation = 0,
+						     uint64_t overlap_ms = 0)
+{
+	// automatic audio_ctx: encode only the part of the 30 s window that has audio. the DTW
+	// token timestamps need the full window, and a fixed audio_ctx setting takes precedence.
+	int fixed_audio_ctx;
+	{
+		// the settings update rewrites whisper_params
+		std::lock_guard<std::mutex> params_lock(gf->whisper_params_mutex);
+		fixed_audio_ctx = gf->whisper_params.audio_ctx;
+	}
+	const bool use_auto_ctx =
+		(gf->audio_ctx_auto || gf->overload.level() >= OVERLOAD_LEVEL_AUDIO_CTX) &&
+		!gf->enable_token_ts_dtw && fixed_audio_ctx == 0;
+	const int audio_ctx = use_auto_ctx ? auto_audio_ctx(pcm32f_num_samples) : 0;
+	if (audio_ctx > 0) {
+		OBS_LOG(gf->log_level, "Automatic audio context: %d", audio_ctx);
+	}
+
+	bool quality_failed = false;
+	struct DetectionResultWithText result = run_whisper_inference_with_ctx(
+		gf, pcm32f_data_, pcm32f_num_samples, t0, t1, vad_state, buffer_generation,
+		overlap_ms, audio_ctx, quality_failed);
+	if (audio_ctx > 0 && quality_failed && gf->overload.level() == OVERLOAD_LEVEL_NONE) {
+		// the reduced context may be the cause, decode again with the full window. Not
+		// while overloaded: the second decode would add to the backlog
+		gf->audio_ctx_fallbacks++;
+		OBS_LOG(gf->log_level,
+			"Result rejected with audio context %d, retrying with the full context (%llu fallbacks)",
+			audio_ctx, (unsigned long long)gf->audio_ctx_fallbacks);
+		result = run_whisper_inference_with_ctx(gf, pcm32f_data_, pcm32f_num_samples, t0,
+							t1, vad_state, buffer_generation, overlap_ms,
+							0, quality_failed);
+	}
+	return result;
+}
+
+void queue_segment_for_inference(transcription_filter_data *gf, uint64_t start_offset_ms,
+				 uint64_t end_offset_ms, int vad_state, uint64_t keep_ms)
+{
+	// the whisper buffer already has room for 10ms of silence at the beginning and end
+	const float *pcm32f_data = gf->whisper_buffer.padded_data();
+	const size_t pcm32f_size_with_silence = gf->whisper_buffer.padded_size();
+	if (pcm32f_data == nullptr) {
+		return;
 	}
 
+	{
+		std::unique_lock<std::mutex> lock(gf->inference_queue_mutex);
+		// a newer segment makes the queued partials obsolete: a partial covers the same
+		// audio as the queued partial plus the new audio, a final covers all of it.
+		// the same goes for the partial being decoded, it is aborted.
+		if (gf->partial_inference_running) {
+			gf->abort_partial_inference = true;
+		}
+		for (auto it = gf->inference_queue.begin(); it != gf->inference_queue.end();) {
+			if (it->vad_state == VAD_STATE_PARTIAL) {
+				gf->inference_buffer_pool.push_back(std::move(it->audio));
+				it = gf->inference_queue.erase(it);
+			} else {
+				++it;
+			}
+		}
+		if (vad_state != VAD_STATE_PARTIAL) {
+			// wait for the inference thread if too many final segments are waiting
+			gf->inference_queue_cv.wait(lock, [gf]() {
+				return gf->inference_queue.size() < MAX_QUEUED_SEGMENTS ||
+				       gf->inference_stop;
+			});
+		}
+		if (gf->inference_stop) {
+			return;
+		}
+
+		inference_job job;
+		if (!gf->inference_buffer_pool.empty()) {
+			job.audio = std::move(gf->inference_buffer_pool.back());
+			gf->inference_buffer_pool.pop_back();
+		}
+		memcpy(get_scratch_buffer(gf, job.audio, pcm32f_size_with_silence), pcm32f_data,
+		       pcm32f_size_with_silence * sizeof(float));
+		job.start_offset_ms = start_offset_ms;
+		job.end_offset_ms = end_offset_ms;
+		job.vad_state = vad_state;
+		job.buffer_generation = gf->whisper_buffer.generation();
+		job.overlap_ms = gf->whisper_buffer_overlap_ms;
+		job.trace_id = gf->segment_trace.new_segment();
+		if (job.trace_id != 0) {
+			// the offsets are the ingress times of the audio in filter_audio
+			const uint64_t now_us = SegmentTrace::now_us();
+			job.queued_us = now_us;
+			gf->segment_trace.span(job.trace_id, "audio_ingress",
+					       (gf->start_timestamp_ms + start_offset_ms) * 1000,
+					       (gf->start_timestamp_ms + end_offset_ms) * 1000);
+			if (gf->segment_trace.vad_on_us() != 0) {
+				gf->segment_trace.instant(job.trace_id, "vad_start",
+							  gf->segment_trace.vad_on_us());
+			}
+			gf->segment_trace.instant(job.trace_id,
+						  vad_state == VAD_STATE_PARTIAL ? "vad_partial"
+										 : "vad_end",
+						  now_us);
+		}
+		gf->inference_queue.push_back(std::move(job));
+	}
+	gf->inference_queue_cv.notify_all();
+
+	if (vad_state != VAD_STATE_PARTIAL) {
+		// a partial run keeps the data in the buffer, a final run consumes it but the
+		// overlap with the next segment
+		const size_t keep_samples = std::min<size_t>(
+			(size_t)(keep_ms * WHISPER_SAMPLE_RATE / 1000), gf->whisper_buffer.size());
+		if (keep_samples > 0) {
+			gf->whisper_buffer.pop_front(gf->whisper_buffer.size() - keep_samples);
+		} else {
+			gf->whisper_buffer.clear();
+		}
+		gf->whisper_buffer_overlap_ms = keep_samples * 1000 / WHISPER_SAMPLE_RATE;
+	}
+}
+
+void clear_inference_queue(transcription_filter_data *gf)
+{
+	{
+		std::lock_guard<std::mutex> lock(gf->inference_queue_mutex);
+		for (auto &job : gf->inference_queue) {
+			gf->inference_buffer_pool.push_back(std::move(job.audio));
+		}
+		gf->inference_queue.clear();
+	}
+	gf->inference_queue_cv.notify_all();
+}
+
+// Let the overload controller react to the time of the run and the audio that waits
+static void update_overload_level(transcription_filter_data *gf, const inference_job &job,
+				  uint64_t inference_ms)
+{
+	uint64_t backlog_samples = 0;
+	{
+		std::lock_guard<std::mutex> lock(gf->inference_queue_mutex);
+		for (const inference_job &queued : gf->inference_queue) {
+			backlog_samples += queued.audio.size();
+		}
+	}
+	const uint64_t backlog_ms =
+		backlog_samples * 1000 / WHISPER_SAMPLE_RATE +
+		(uint64_t)gf->input_buffer.frames_available() * 1000 /
+			std::max<uint64_t>(gf->sample_rate, 1);
+	const int previous = gf->overload.update(
+		now_ms(), inference_ms, job.audio.size() * 1000 / WHISPER_SAMPLE_RATE, backlog_ms);
+	if (previous >= 0) {
+		obs_log(LOG_INFO,
+			"Overload level %d (%s) -> %d (%s): real-time factor %.2f, backlog %llu ms",
+			previous, OverloadController::level_name(previous), gf->overload.level(),
+			OverloadController::level_name(gf->overload.level()), gf->overload.rtf(),
+			(unsigned long long)backlog_ms);
+	}
+}
+
+static void run_inference_and_callbacks(transcription_filter_data *gf, const inference_job &job)
+{
 	auto inference_start_ts = now_ms();
 
-	struct DetectionResultWithText inference_result =
-		run_whisper_inference(gf, pcm32f_data, pcm32f_size_with_silence, start_offset_ms,
-				      end_offset_ms, vad_state);
+	struct DetectionResultWithText inference_result;
+	{
+		if (job.trace_id != 0) {
+			gf->segment_trace.span(job.trace_id, "inference_queue", job.queued_us,
+					       SegmentTrace::now_us());
+		}
+		SegmentTraceScope trace(gf->segment_trace, job.trace_id, "inference");
+		inference_result = run_whisper_inference(gf, job.audio.data(), job.audio.size(),
+							 job.start_offset_ms, job.end_offset_ms,
+							 job.vad_state, job.buffer_generation,
+							 job.overlap_ms);
+	}
+	inference_result.trace_id = job.trace_id;
+	if (inference_result.result == DETECTION_RESULT_NO_INFERENCE) {
+		// an aborted partial, the newer segment is next in the queue
+		return;
+	}
+	// published once, the outputs and the translation workers share it
+	const SharedDetectionResult result =
+		std::make_shared<const DetectionResultWithText>(std::move(inference_result));
 	// output inference result to a text source
-	set_text_callback(inference_start_ts, gf, inference_result);
+	set_text_callback(inference_start_ts, gf, result);
 
-	if (gf->enable_audio_chunks_callback && vad_state != VAD_STATE_PARTIAL) {
-		audio_chunk_callback(gf, pcm32f_data, pcm32f_size_with_silence, vad_state,
-				     inference_result);
+	if (gf->enable_audio_chunks_callback && job.vad_state != VAD_STATE_PARTIAL) {
+		audio_chunk_callback(gf, job.audio.data(), job.audio.size(), job.vad_state,
+				     *result);
 	}
+}
 
-	// free the buffer
-	bfree(pcm32f_data);
+void inference_loop(void *data)
+{
+	if (data == nullptr) {
+		obs_log(LOG_ERROR, "inference_loop: data is null");
+		return;
+	}
+
+	struct transcription_filter_data *gf =
+		static_cast<struct transcription_filter_data *>(data);
+
+	OBS_LOG(gf->log_level, "Starting inference thread");
+	gf->segment_trace.set_thread_name("inference");
+
+	{
+		// the first load of a model on a device is always warmed up, so the drivers cache
+		// all the kernels for the next start
+		std::lock_guard<std::mutex> lock(gf->whisper_ctx_mutex);
+		const std::string model_file = gf->whisper_model_file_currently_loaded;
+		const bool cache_warm = backend_cache_is_warm(model_file, gf->whisper_gpu_device);
+		if (gf->model_warm_up || !cache_warm) {
+			gf->model_warm_up_ms = warm_up_whisper_model(gf, gf->whisper_context,
+								     gf->whisper_state);
+			if (!cache_warm && gf->whisper_context != nullptr) {
+				backend_cache_mark_warm(model_file, gf->whisper_gpu_device);
+			}
+		}
+	}
+
+	int applied_max_parallel = 0;
+	while (true) {
+		// a model loaded in the background takes over between two segments
+		apply_pending_whisper_model_swap(gf);
+		if (!gf->whisper_context_ready) {
+			obs_log(LOG_WARNING, "Whisper context is null, exiting thread");
+			break;
+		}
+		if (gf->inference_max_parallel != applied_max_parallel) {
+			// set here, the settings update does not wait for a decode
+			applied_max_parallel = gf->inference_max_parallel;
+			std::lock_guard<std::mutex> lock(gf->whisper_ctx_mutex);
+			if (gf->whisper_context != nullptr) {
+				set_shared_inference_limit(gf->whisper_context,
+							   applied_max_parallel);
+			}
+		}
+
+		update_inference_thread_affinity();
+
+		inference_job job;
+		bool has_job = false;
+		{
+			std::unique_lock<std::mutex> lock(gf->inference_queue_mutex);
+			auto ready = [gf]() {
+				return !gf->inference_queue.empty() || gf->inference_stop ||
+				       gf->model_swap_ready;
+			};
+			if (!gf->cleared_last_sub) {
+				// wake up periodically to clear the current caption on time
+				gf->inference_queue_cv.wait_for(lock, std::chrono::milliseconds(250),
+								ready);
+			} else {
+				gf->inference_queue_cv.wait(lock, ready);
+			}
+			if (gf->inference_stop) {
+				break;
+			}
+			if (!gf->inference_queue.empty()) {
+				job = std::move(gf->inference_queue.front());
+				gf->inference_queue.pop_front();
+				gf->inference_busy = true;
+				gf->partial_inference_running = job.vad_state == VAD_STATE_PARTIAL;
+				gf->abort_partial_inference = false;
+				has_job = true;
+			}
+		}
+
+		if (gf->reset_partial_state.exchange(false)) {
+			gf->partial_last_tokens.clear();
+			gf->partial_committed_tokens.clear();
+			gf->partial_committed_end_ms = 0;
+			gf->seam_tokens.clear();
+		}
+
+		if (has_job) {
+			const uint64_t job_start_ms = now_ms();
+			run_inference_and_callbacks(gf, job);
+			update_overload_level(gf, job, now_ms() - job_start_ms);
+			{
+				std::lock_guard<std::mutex> lock(gf->inference_queue_mutex);
+				gf->inference_buffer_pool.push_back(std::move(job.audio));
+				gf->inference_busy = false;
+				gf->partial_inference_running = false;
+			}
+			// a slot in the queue is free, wake up the segmentation if it waits
+			gf->inference_queue_cv.notify_all();
+		}
+
+		if (!gf->cleared_last_sub) {
+			// check if we should clear the current sub depending on the minimum subtitle duration
+			uint64_t now = now_ms();
+			if ((now - gf->last_sub_render_time) > gf->max_sub_duration) {
+				// clear the current sub, call the callback with an empty string
+				OBS_LOG(gf->log_level,
+					"Clearing current subtitle. now: %lu ms, last: %lu ms", now,
+					gf->last_sub_render_time);
+				clear_current_caption(gf);
+			}
+		}
+	}
+
+	{
+		// stop the segmentation too, nothing would consume its segments
+		std::lock_guard<std::mutex> lock(gf->inference_queue_mutex);
+		gf->inference_stop = true;
+	}
+	gf->inference_queue_cv.notify_all();
+	wake_whisper_thread(gf);
+
+	OBS_LOG(gf->log_level, "Exiting inference thread");
+}
+
+void wake_whisper_thread(struct transcription_filter_data *gf)
+{
+	{
+		// the lock is only held to set the flag, so the waiting thread can't miss it
+		std::lock_guard<std::mutex> lock(gf->whisper_wakeup_mutex);
+		gf->whisper_wakeup_pending = true;
+	}
+	gf->wshiper_thread_cv.notify_one();
+}
+
+void notify_new_audio(struct transcription_filter_data *gf, uint32_t frames)
+{
+	// segmentation works in VAD windows, waking up for less audio than one window is useless
+	const uint32_t wakeup_frames = gf->sample_rate * VAD_WINDOW_SIZE_MS / 1000;
+	gf->input_frames_since_wakeup += frames;
+	if (gf->input_frames_since_wakeup >= wakeup_frames) {
+		gf->input_frames_since_wakeup = 0;
+		wake_whisper_thread(gf);
+	}
 }
 
 void whisper_loop(void *data)
@@ -381,7 +1208,8 @@ void whisper_loop(void *data)
 	struct transcription_filter_data *gf =
 		static_cast<struct transcription_filter_data *>(data);
 
-	obs_log(gf->log_level, "Starting whisper thread");
+	OBS_LOG(gf->log_level, "Starting whisper thread");
+	gf->segment_trace.set_thread_name("segmentation");
 
 	vad_state current_vad_state = {false, 0, 0, 0};
 
@@ -391,23 +1219,43 @@ void whisper_loop(void *data)
 	// Thread main loop
 	while (true) {
 		ProfileScope(whisper_loop_name);
+		bool inference_pending;
 		{
-			ProfileScope("lock whisper ctx");
-			std::lock_guard<std::mutex> lock(gf->whisper_ctx_mutex);
-			ProfileScope("locked whisper ctx");
-			if (gf->whisper_context == nullptr) {
-				obs_log(LOG_WARNING, "Whisper context is null, exiting thread");
+			// the inference thread holds whisper_ctx_mutex while decoding, segmentation
+			// only needs to know whether inference is still running
+			std::lock_guard<std::mutex> lock(gf->inference_queue_mutex);
+			if (gf->inference_stop) {
+				OBS_LOG(gf->log_level, "Inference stopped, exiting thread");
 				break;
 			}
+			inference_pending = gf->inference_busy || !gf->inference_queue.empty();
 		}
 
 		if (gf->clear_buffers) {
-			deque_pop_front(&gf->resampled_buffer, nullptr, 0);
-			deque_pop_front(&gf->whisper_buffer, nullptr, 0);
+			gf->input_buffer.clear();
+			deque_pop_front(&gf->resampled_buffer, nullptr, gf->resampled_buffer.size);
+			gf->resampled_buffer_start_sample = gf->resampled_samples_total;
+			gf->whisper_buffer.clear();
+			gf->whisper_buffer_overlap_ms = 0;
+			gf->decimator.reset();
 			current_vad_state = {false, now_ms(), 0, 0};
+			clear_inference_queue(gf);
+			gf->reset_partial_state = true;
 			gf->clear_buffers = false;
 		}
 
+		if (gf->vad_reload.exchange(false)) {
+			// the session settings of the VAD changed, the speech in progress goes on
+			// with the state of a new stream
+			initialize_vad(gf, gf->silero_vad_model_file.c_str());
+		}
+		if (gf->vad) {
+			// update only sets the values: the VAD is replaced on this thread and on
+			// idle_thread, while this thread is stopped
+			gf->vad->set_threshold(gf->vad_threshold);
+			gf->vad->set_pre_gate(gf->vad_pre_gate);
+		}
+
 		if (gf->vad_mode == VAD_MODE_HYBRID) {
 			current_vad_state = hybrid_vad_segmentation(gf, current_vad_state);
 		} else if (gf->vad_mode == VAD_MODE_ACTIVE) {
@@ -416,29 +1264,44 @@ void whisper_loop(void *data)
 			current_vad_state = vad_disabled_segmentation(gf, current_vad_state);
 		}
 
-		if (!gf->cleared_last_sub) {
-			// check if we should clear the current sub depending on the minimum subtitle duration
-			uint64_t now = now_ms();
-			if ((now - gf->last_sub_render_time) > gf->max_sub_duration) {
-				// clear the current sub, call the callback with an empty string
-				obs_log(gf->log_level,
-					"Clearing current subtitle. now: %lu ms, last: %lu ms", now,
-					gf->last_sub_render_time);
-				clear_current_caption(gf);
-			}
-		}
-
 		if (gf->input_cv.has_value())
 			gf->input_cv->notify_one();
 
-		// Sleep using the condition variable wshiper_thread_cv
-		// This will wake up the thread if there is new data in the input buffer
-		// or if the whisper context is null
-		std::unique_lock<std::mutex> lock(gf->whisper_ctx_mutex);
-		if (gf->input_buffers->size == 0) {
-			gf->wshiper_thread_cv.wait_for(lock, std::chrono::milliseconds(250));
+		// without the VAD all the audio counts as speech
+		if (current_vad_state.vad_on ||
+		    (gf->vad_mode == VAD_MODE_DISABLED && gf->whisper_buffer.size() > 0)) {
+			gf->last_speech_ms = now_ms();
+		}
+		uint64_t idle_wait_ms = 0;
+		if (gf->idle_suspend_s > 0) {
+			const uint64_t idle_ms = now_ms() - gf->last_speech_ms;
+			const uint64_t idle_suspend_ms = (uint64_t)gf->idle_suspend_s * 1000;
+			if (idle_ms >= idle_suspend_ms && !inference_pending) {
+				request_idle_suspend(gf);
+			}
+			// check again when it is due, or in a second while the last segment decodes
+			idle_wait_ms = idle_ms < idle_suspend_ms ? idle_suspend_ms - idle_ms : 1000;
+		}
+
+		// Sleep until the audio thread signals a VAD window of new data or the whisper
+		// context is released (see wake_whisper_thread). Only wake up periodically while
+		// there is work that doesn't need new audio, an idle filter sleeps until then (or
+		// until it is due for suspension)
+		const bool has_pending_work =
+			gf->input_buffer.frames_available() > 0 ||
+			(gf->vad_mode == VAD_MODE_DISABLED && gf->whisper_buffer.size() > 0);
+		std::unique_lock<std::mutex> lock(gf->whisper_wakeup_mutex);
+		auto woken = [gf]() { return gf->whisper_wakeup_pending; };
+		if (has_pending_work) {
+			gf->wshiper_thread_cv.wait_for(lock, std::chrono::milliseconds(250), woken);
+		} else if (idle_wait_ms > 0) {
+			gf->wshiper_thread_cv.wait_for(lock, std::chrono::milliseconds(idle_wait_ms),
+						       woken);
+		} else {
+			gf->wshiper_thread_cv.wait(lock, woken);
 		}
+		gf->whisper_wakeup_pending = false;
 	}
 
-	obs_log(gf->log_level, "Exiting whisper thread");
+	OBS_LOG(gf->log_level, "Exiting whisper thread");
 }
@@ -3,6 +3,10 @@
 
 #include <whisper.h>
 
+#include <memory>
+#include <string>
+#include <vector>
+
 // buffer size in msec
 #define DEFAULT_BUFFER_SIZE_MSEC 3000
 // overlap in msec
@@ -10,6 +14,26 @@
 #define MAX_OVERLAP_SIZE_MSEC 1000
 #define MIN_OVERLAP_SIZE_MSEC 125
 #define MAX_MS_WORK_BUFFER 11000
+// capacity of the input ring buffer in msec, audio arriving beyond this is dropped
+#define MAX_MS_INPUT_BUFFER 30000
+// maximal number of final segments waiting for inference before segmentation waits
+#define MAX_QUEUED_SEGMENTS 4
+// silence added before and after each segment given to whisper, in samples (10 ms)
+#define SEGMENT_PADDING_SAMPLES (WHISPER_SAMPLE_RATE / 100)
+// automatic audio_ctx: encoder positions of 20 ms, rounded up to buckets of 128 (2.56 s) with
+// at least 64 (1.28 s) of margin after the audio. the full window has 1500 positions (30 s)
+#define AUDIO_CTX_SAMPLES_PER_POSITION (WHISPER_SAMPLE_RATE / 50)
+#define AUDIO_CTX_MARGIN 64
+#define AUDIO_CTX_BUCKET 128
+#define AUDIO_CTX_FULL 1500
+// a result with a reduced audio_ctx is decoded again with the full window when its last tokens
+// repeat an n-gram of up to AUDIO_CTX_REPEAT_MAX_NGRAM tokens AUDIO_CTX_REPEAT_COUNT times,
+// over at least AUDIO_CTX_REPEAT_MIN_TOKENS tokens: the decoding loop of a cut context
+#define AUDIO_CTX_REPEAT_MAX_NGRAM 8
+#define AUDIO_CTX_REPEAT_COUNT 3
+#define AUDIO_CTX_REPEAT_MIN_TOKENS 6
+// the steady-state inference time is logged every this many inferences
+#define INFERENCE_TIMING_LOG_INTERVAL 100
 
 enum DetectionResult {
 	DETECTION_RESULT_UNKNOWN = 0,
@@ -27,12 +51,49 @@ struct DetectionResultWithText {
 	uint64_t end_timestamp_ms;
 	std::vector<whisper_token_data> tokens;
 	std::string language;
+	// text of each of the tokens
+	std::vector<std::string> token_texts;
+	// segment of the trace, 0 when not traced
+	uint64_t trace_id = 0;
+};
+
+// A result as published by set_text_callback: the translation workers and the outputs hold it
+// instead of copying its tokens, it is not modified once published
+typedef std::shared_ptr<const DetectionResultWithText> SharedDetectionResult;
+
+// A segment cut by the segmentation (whisper) thread, waiting for the inference thread
+struct inference_job {
+	std::vector<float> audio; // 16 kHz mono, padded with silence
+	uint64_t start_offset_ms;
+	uint64_t end_offset_ms;
+	int vad_state;
+	// whisper_buffer generation, jobs with the same one share the same audio prefix
+	uint64_t buffer_generation;
+	// the start of the audio repeats the end of the previous segment for this long
+	uint64_t overlap_ms = 0;
+	// segment of the trace and the time it was queued, 0 when not traced
+	uint64_t trace_id = 0;
+	uint64_t queued_us = 0;
 };
 
 void whisper_loop(void *data);
+void inference_loop(void *data);
+void wake_whisper_thread(struct transcription_filter_data *gf);
+void notify_new_audio(struct transcription_filter_data *gf, uint32_t frames);
+float *get_scratch_buffer(struct transcription_filter_data *gf, std::vector<float> &buffer,
+			  size_t num_samples);
+int resolve_whisper_gpu_device(const struct transcription_filter_data *gf);
 struct whisper_context *init_whisper_context(const std::string &model_path,
-					     struct transcription_filter_data *gf);
-void run_inference_and_callbacks(transcription_filter_data *gf, uint64_t start_offset_ms,
-				 uint64_t end_offset_ms, int vad_state);
+					     struct transcription_filter_data *gf, int gpu_device);
+// load a model file without a default state, nullptr on failure
+struct whisper_context *load_whisper_model_file(const std::string &model_path,
+						struct whisper_context_params cparams);
+// a final keeps the last keep_ms of the audio in whisper_buffer, for the overlap with the next
+// segment
+void queue_segment_for_inference(transcription_filter_data *gf, uint64_t start_offset_ms,
+				 uint64_t end_offset_ms, int vad_state, uint64_t keep_ms = 0);
+void clear_inference_queue(transcription_filter_data *gf);
+uint64_t warm_up_whisper_model(struct transcription_filter_data *gf, struct whisper_context *ctx,
+			       struct whisper_state *state);
 
 #endif // WHISPER_PROCESSING_H
@@ -2,25 +2,396 @@
 #include "plugin-support.h"
 #include "model-utils/model-downloader.h"
 #include "whisper-processing.h"
+#include "whisper-model-registry.h"
 #include "vad-processing.h"
+#include "transcription-utils.h"
+#include "backend-cache.h"
+#include "translation/translation.h"
 
 #include <obs-module.h>
 
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// whisper_ctx_mutex must be held
+static void release_draft_whisper_model(struct transcription_filter_data *gf)
+{
+	if (gf->draft_whisper_state != nullptr) {
+		whisper_free_state(gf->draft_whisper_state);
+		gf->draft_whisper_state = nullptr;
+	}
+	if (gf->draft_whisper_context != nullptr) {
+		release_shared_whisper_context(gf->draft_whisper_context);
+		gf->draft_whisper_context = nullptr;
+	}
+}
+
+// whisper_ctx_mutex must be held
+static void load_draft_whisper_model(struct transcription_filter_data *gf,
+				     const std::string &path)
+{
+	release_draft_whisper_model(gf);
+	if (path.empty()) {
+		return;
+	}
+	obs_log(gf->log_level, "Create draft whisper context: %s", path.c_str());
+	gf->draft_whisper_context = acquire_shared_whisper_context(path, gf, gf->whisper_gpu_device);
+	if (gf->draft_whisper_context == nullptr) {
+		obs_log(LOG_ERROR, "Failed to initialize draft whisper context, partials will use "
+				   "the main model");
+		return;
+	}
+	gf->draft_whisper_state = whisper_init_state(gf->draft_whisper_context);
+	if (gf->draft_whisper_state == nullptr) {
+		obs_log(LOG_ERROR, "Failed to initialize draft whisper state");
+		release_draft_whisper_model(gf);
+	}
+}
+
+void update_draft_whisper_model(struct transcription_filter_data *gf, const std::string &path)
+{
+	std::lock_guard<std::mutex> lock(gf->whisper_ctx_mutex);
+	gf->draft_model_file = path;
+	if (gf->whisper_context == nullptr) {
+		// loaded with the main model in start_whisper_thread_with_path
+		return;
+	}
+	load_draft_whisper_model(gf, path);
+}
+
+// model_swap_mutex must be held
+static void release_swap_whisper_model(struct transcription_filter_data *gf)
+{
+	if (gf->model_swap_state != nullptr) {
+		whisper_free_state(gf->model_swap_state);
+		gf->model_swap_state = nullptr;
+	}
+	if (gf->model_swap_context != nullptr) {
+		release_shared_whisper_context(gf->model_swap_context);
+		gf->model_swap_context = nullptr;
+	}
+	gf->model_swap_ready = false;
+}
+
+// runs on gf->model_swap_thread until the requested model is loaded
+static void model_swap_loop(struct transcription_filter_data *gf)
+{
+	while (true) {
+		std::string path;
+		{
+			std::lock_guard<std::mutex> lock(gf->model_swap_mutex);
+			path = gf->model_swap_path;
+			if (path.empty()) {
+				gf->model_swap_loading = false;
+				return;
+			}
+		}
+
+		obs_log(gf->log_level, "Loading whisper model %s in the background", path.c_str());
+		const uint64_t load_start_ms = now_ms();
+		// the inference thread reads whisper_gpu_device while the current model serves, the
+		// new device is published with the swap
+		const int gpu_device = resolve_whisper_gpu_device(gf);
+		struct whisper_context *ctx = acquire_shared_whisper_context(path, gf, gpu_device);
+		struct whisper_state *state = ctx != nullptr ? whisper_init_state(ctx) : nullptr;
+		if (ctx != nullptr && state == nullptr) {
+			release_shared_whisper_context(ctx);
+			ctx = nullptr;
+		}
+		const uint64_t load_ms = now_ms() - load_start_ms;
+		obs_log(LOG_INFO, "Whisper model load: %llu ms", (unsigned long long)load_ms);
+		// warm up the new state before it takes over, the current model keeps serving
+		const bool cache_warm = backend_cache_is_warm(path, gpu_device);
+		const uint64_t warm_up_ms = ctx != nullptr && (gf->model_warm_up || !cache_warm)
+						    ? warm_up_whisper_model(gf, ctx, state)
+						    : 0;
+		if (ctx != nullptr && !cache_warm) {
+			backend_cache_mark_warm(path, gpu_device);
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(gf->model_swap_mutex);
+			if (gf->model_swap_path != path) {
+				// another model was requested meanwhile
+				if (ctx != nullptr) {
+					whisper_free_state(state);
+					release_shared_whisper_context(ctx);
+				}
+				continue;
+			}
+			gf->model_swap_loading = false;
+			if (ctx == nullptr) {
+				obs_log(LOG_ERROR,
+					"Failed to load whisper model %s, keeping the current model",
+					path.c_str());
+				return;
+			}
+			release_swap_whisper_model(gf);
+			gf->model_swap_context = ctx;
+			gf->model_swap_state = state;
+			gf->model_swap_ready_path = path;
+			gf->model_swap_gpu_device = gpu_device;
+			gf->model_swap_load_ms = load_ms;
+			gf->model_warm_up_ms = warm_up_ms;
+			gf->model_swap_ready = true;
+		}
+		// wake up the inference thread if it's idle
+		gf->inference_queue_cv.notify_all();
+		return;
+	}
+}
+
+// stop a background model load and drop a loaded model that was not switched to yet
+static void cancel_whisper_model_swap(struct transcription_filter_data *gf)
+{
+	{
+		std::lock_guard<std::mutex> lock(gf->model_swap_mutex);
+		gf->model_swap_path = "";
+	}
+	if (gf->model_swap_thread.joinable()) {
+		gf->model_swap_thread.join();
+	}
+	std::lock_guard<std::mutex> lock(gf->model_swap_mutex);
+	release_swap_whisper_model(gf);
+}
+
+void switch_whisper_model(struct transcription_filter_data *gf, const std::string &path,
+			  const char *silero_vad_model_file)
+{
+	gf->whisper_model_file_requested = path;
+	const bool running = gf->whisper_thread.joinable() && gf->inference_thread.joinable() &&
+			     gf->whisper_context_ready;
+	if (!running) {
+		// the audio passes through until the model is loaded, OBS does not wait for it. The
+		// threads that are left are stopped on idle_thread
+		start_whisper_thread_in_background(gf, path, silero_vad_model_file);
+		return;
+	}
+
+	obs_log(gf->log_level, "Switching to whisper model %s", path.c_str());
+	std::lock_guard<std::mutex> lock(gf->model_swap_mutex);
+	gf->model_swap_path = path;
+	if (gf->model_swap_loading) {
+		// the loader picks up the new path when it is done with the current one
+		return;
+	}
+	if (gf->model_swap_thread.joinable()) {
+		// finished, it does not need the mutex anymore
+		gf->model_swap_thread.join();
+	}
+	gf->model_swap_loading = true;
+	gf->model_swap_thread = std::thread(model_swap_loop, gf);
+}
+
+void apply_pending_whisper_model_swap(struct transcription_filter_data *gf)
+{
+	if (!gf->model_swap_ready) {
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(gf->whisper_ctx_mutex);
+	std::lock_guard<std::mutex> swap_lock(gf->model_swap_mutex);
+	if (gf->model_swap_context == nullptr || gf->whisper_context == nullptr) {
+		return;
+	}
+	if (gf->whisper_state != nullptr) {
+		whisper_free_state(gf->whisper_state);
+	}
+	release_shared_whisper_context(gf->whisper_context);
+	gf->whisper_context = gf->model_swap_context;
+	gf->whisper_state = gf->model_swap_state;
+	gf->model_swap_context = nullptr;
+	gf->model_swap_state = nullptr;
+	gf->model_swap_ready = false;
+	// the swapped model is the loaded one from now on, not when it was requested
+	gf->whisper_model_file_currently_loaded = gf->model_swap_ready_path;
+	const bool device_changed = gf->whisper_gpu_device != gf->model_swap_gpu_device;
+	gf->whisper_gpu_device = gf->model_swap_gpu_device;
+	if (device_changed && !gf->draft_model_file.empty()) {
+		// the draft model follows the main model to its device
+		load_draft_whisper_model(gf, gf->draft_model_file);
+	}
+	set_shared_inference_limit(gf->whisper_context, gf->inference_max_parallel);
+	gf->model_load_ms = gf->model_swap_load_ms;
+	gf->inference_count = 0;
+	gf->inference_steady_total_ms = 0;
+
+	// the partial state refers to the tokens of the previous model
+	gf->partial_last_tokens.clear();
+	gf->partial_committed_tokens.clear();
+	gf->partial_committed_end_ms = 0;
+	gf->mel_cache.clear();
+	gf->sticky_language.reset();
+	obs_log(gf->log_level, "Switched to the new whisper model");
+}
+
+// the background loads of all the filters, bounded by MODEL_LOAD_MAX_PARALLEL
+static std::mutex model_load_mutex;
+static std::condition_variable model_load_cv;
+static int model_loads_running = 0;
+
+// Wait for a background load slot. Returns false if the load was cancelled meanwhile.
+static bool begin_model_load(struct transcription_filter_data *gf)
+{
+	std::unique_lock<std::mutex> lock(model_load_mutex);
+	model_load_cv.wait(lock, [gf]() {
+		return gf->model_load_cancelled || model_loads_running < MODEL_LOAD_MAX_PARALLEL;
+	});
+	if (gf->model_load_cancelled) {
+		return false;
+	}
+	model_loads_running++;
+	return true;
+}
+
+static void end_model_load()
+{
+	{
+		std::lock_guard<std::mutex> lock(model_load_mutex);
+		model_loads_running--;
+	}
+	model_load_cv.notify_all();
+}
+
+// runs on gf->idle_thread
+static void idle_transition_loop(struct transcription_filter_data *gf, bool suspend)
+{
+	if (suspend) {
+		obs_log(LOG_INFO, "No speech for %d s, releasing the models", gf->idle_suspend_s);
+		shutdown_whisper_thread(gf, false);
+		gf->vad.reset();
+		suspend_translation(gf);
+		gf->idle_suspended = true;
+	}
+	// a resume loads the model the filter had, then the starts requested meanwhile load theirs
+	std::unique_lock<std::mutex> lock(gf->idle_mutex);
+	bool resume = !suspend && !gf->idle_start_pending;
+	while ((resume || gf->idle_start_pending) && !gf->model_load_cancelled) {
+		std::string path = gf->whisper_model_file_currently_loaded;
+		std::string vad_model_file = gf->silero_vad_model_file;
+		if (!resume) {
+			path = gf->idle_start_path;
+			vad_model_file = gf->idle_start_vad_model_file;
+			gf->idle_start_pending = false;
+		}
+		resume = false;
+		lock.unlock();
+		obs_log(LOG_INFO, "%s, loading the models",
+			gf->idle_suspended ? "Audio is back" : "Filter starting");
+		// the threads of the previous model, if any
+		shutdown_whisper_thread(gf, false);
+		if (begin_model_load(gf)) {
+			start_whisper_thread_with_path(gf, path, vad_model_file.c_str());
+			end_model_load();
+		}
+		// a model that failed to load is not retried for each packet
+		gf->idle_suspended = false;
+		gf->idle_resuming = false;
+		lock.lock();
+	}
+	gf->idle_transition = false;
+}
+
+// idle_mutex must be held, and no transition running: a finished idle_thread does not need the
+// mutex anymore
+static void start_idle_transition(struct transcription_filter_data *gf, bool suspend)
+{
+	if (gf->idle_thread.joinable()) {
+		gf->idle_thread.join();
+	}
+	gf->model_load_cancelled = false;
+	gf->idle_transition = true;
+	gf->idle_thread = std::thread(idle_transition_loop, gf, suspend);
+}
+
+void start_whisper_thread_in_background(struct transcription_filter_data *gf,
+					const std::string &path, const char *silero_vad_model_file)
+{
+	std::lock_guard<std::mutex> lock(gf->idle_mutex);
+	gf->idle_start_path = path;
+	gf->idle_start_vad_model_file = silero_vad_model_file;
+	gf->idle_start_pending = true;
+	if (gf->idle_transition) {
+		// the running suspension or load starts it when done, it is not waited for here
+		return;
+	}
+	start_idle_transition(gf, false);
+}
+
+void request_idle_suspend(struct transcription_filter_data *gf)
+{
+	std::unique_lock<std::mutex> lock(gf->idle_mutex, std::try_to_lock);
+	if (!lock.owns_lock() || gf->idle_transition || !gf->whisper_context_ready) {
+		return;
+	}
+	start_idle_transition(gf, true);
+}
+
+bool request_idle_resume(struct transcription_filter_data *gf)
+{
+	std::unique_lock<std::mutex> lock(gf->idle_mutex, std::try_to_lock);
+	if (!lock.owns_lock() || gf->idle_transition || !gf->idle_suspended) {
+		return false;
+	}
+	gf->idle_resuming = true;
+	start_idle_transition(gf, false);
+	return true;
+}
+
 void shutdown_whisper_thread(struct transcription_filter_data *gf, bool clear_model_path)
 {
 	obs_log(gf->log_level, "shutdown_whisper_thread");
+	std::thread idle_thread;
+	{
+		std::lock_guard<std::mutex> lock(gf->idle_mutex);
+		if (std::this_thread::get_id() != gf->idle_thread.get_id()) {
+			// wait for a suspension or resume in progress, no suspension starts once
+			// the context is not ready
+			idle_thread = std::move(gf->idle_thread);
+			gf->idle_start_pending = false;
+			// a load waiting for its turn does not start, a running one stops after
+			// reading the model file
+			std::lock_guard<std::mutex> load_lock(model_load_mutex);
+			gf->model_load_cancelled = true;
+		}
+		// the inference thread exits after its current segment
+		gf->whisper_context_ready = false;
+	}
+	model_load_cv.notify_all();
+	if (idle_thread.joinable()) {
+		idle_thread.join();
+	}
+	cancel_whisper_model_swap(gf);
 	if (gf->whisper_context != nullptr) {
 		// acquire the mutex before freeing the context
 		std::lock_guard<std::mutex> lock(gf->whisper_ctx_mutex);
-		whisper_free(gf->whisper_context);
+		release_draft_whisper_model(gf);
+		if (gf->whisper_state != nullptr) {
+			whisper_free_state(gf->whisper_state);
+			gf->whisper_state = nullptr;
+		}
+		// the model itself is freed when no other filter uses it
+		release_shared_whisper_context(gf->whisper_context);
 		gf->whisper_context = nullptr;
-		gf->wshiper_thread_cv.notify_all();
 	}
+	// wake up the threads so they see the null context and exit
+	wake_whisper_thread(gf);
+	{
+		std::lock_guard<std::mutex> lock(gf->inference_queue_mutex);
+		gf->inference_stop = true;
+	}
+	gf->inference_queue_cv.notify_all();
 	if (gf->whisper_thread.joinable()) {
 		gf->whisper_thread.join();
 	}
+	if (gf->inference_thread.joinable()) {
+		gf->inference_thread.join();
+	}
+	clear_inference_queue(gf);
 	if (clear_model_path && !gf->whisper_model_path.empty()) {
 		gf->whisper_model_path = "";
+		gf->whisper_model_file_requested = "";
 	}
 }
 
@@ -30,24 +401,71 @@ void start_whisper_thread_with_path(struct transcription_filter_data *gf,
 {
 	obs_log(gf->log_level, "start_whisper_thread_with_path: %s, silero model path: %s",
 		whisper_model_path.c_str(), silero_vad_model_file);
-	std::lock_guard<std::mutex> lock(gf->whisper_ctx_mutex);
-	if (gf->whisper_context != nullptr) {
-		obs_log(LOG_ERROR, "cannot init whisper: whisper_context is not null");
-		return;
+	if (gf->idle_suspended) {
+		// the CT2 model was released with the whisper model
+		resume_translation(gf);
 	}
+	{
+		std::lock_guard<std::mutex> lock(gf->whisper_ctx_mutex);
+		if (gf->whisper_context != nullptr) {
+			obs_log(LOG_ERROR, "cannot init whisper: whisper_context is not null");
+			return;
+		}
+	}
+	gf->silero_vad_model_file = silero_vad_model_file;
 
-	// initialize Silero VAD
-	initialize_vad(gf, silero_vad_model_file);
+	// the Silero VAD session and the whisper model are independent, they load concurrently
+	std::thread vad_thread(
+		[gf]() { initialize_vad(gf, gf->silero_vad_model_file.c_str()); });
 
 	obs_log(gf->log_level, "Create whisper context");
-	gf->whisper_context = init_whisper_context(whisper_model_path, gf);
-	if (gf->whisper_context == nullptr) {
+	const uint64_t load_start_ms = now_ms();
+	// the draft model goes on the same device
+	gf->whisper_gpu_device = resolve_whisper_gpu_device(gf);
+	// loaded without whisper_ctx_mutex, nothing uses the context before the threads start
+	struct whisper_context *ctx =
+		acquire_shared_whisper_context(whisper_model_path, gf, gf->whisper_gpu_device);
+	struct whisper_state *state = ctx != nullptr ? whisper_init_state(ctx) : nullptr;
+	vad_thread.join();
+	if (ctx != nullptr && gf->model_load_cancelled) {
+		obs_log(gf->log_level, "The whisper model load was cancelled");
+		if (state != nullptr) {
+			whisper_free_state(state);
+		}
+		release_shared_whisper_context(ctx);
+		return;
+	}
+	if (ctx == nullptr) {
 		obs_log(LOG_ERROR, "Failed to initialize whisper context");
 		return;
 	}
+	if (state == nullptr) {
+		obs_log(LOG_ERROR, "Failed to initialize whisper state");
+		release_shared_whisper_context(ctx);
+		return;
+	}
+	std::lock_guard<std::mutex> lock(gf->whisper_ctx_mutex);
+	gf->whisper_context = ctx;
+	gf->whisper_state = state;
+	gf->model_load_ms = now_ms() - load_start_ms;
+	gf->model_warm_up_ms = 0;
+	gf->inference_count = 0;
+	gf->inference_steady_total_ms = 0;
+	obs_log(LOG_INFO, "Whisper model load: %llu ms", (unsigned long long)gf->model_load_ms);
+	load_draft_whisper_model(gf, gf->draft_model_file);
 	gf->whisper_model_file_currently_loaded = whisper_model_path;
+	gf->last_speech_ms = now_ms();
+	gf->whisper_context_ready = true;
+	gf->idle_suspended = false;
+	gf->idle_resuming = false;
+	{
+		std::lock_guard<std::mutex> queue_lock(gf->inference_queue_mutex);
+		gf->inference_stop = false;
+	}
 	std::thread new_whisper_thread(whisper_loop, gf);
 	gf->whisper_thread.swap(new_whisper_thread);
+	std::thread new_inference_thread(inference_loop, gf);
+	gf->inference_thread.swap(new_inference_thread);
 }
 
 // Finds start of 2-token overlap between two sequences of tokens
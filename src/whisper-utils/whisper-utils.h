@@ -18,6 +18,9 @@
 #include <string>
 #include <vector>
 
+// models of the filters loaded at the same time, the next filters wait for their turn
+#define MODEL_LOAD_MAX_PARALLEL 3
+
 /**
  * @brief Shuts down the whisper thread.
  *
@@ -42,6 +45,80 @@ void shutdown_whisper_thread(struct transcription_filter_data *gf, bool clear_mo
 void start_whisper_thread_with_path(struct transcription_filter_data *gf, const std::string &path,
 				    const char *silero_vad_model_file);
 
+/**
+ * @brief Starts the whisper thread with a model file on idle_thread, without waiting for it.
+ *
+ * The audio passes through the filter until the model is loaded. At most
+ * MODEL_LOAD_MAX_PARALLEL filters load their models at the same time, so the scene collection
+ * load does not start all the loads at once, and shutdown_whisper_thread drops a load that is
+ * still waiting for its turn. A running load is released by shutdown_whisper_thread once the
+ * model file is read. The call never waits for idle_thread: during a suspension or another
+ * load, idle_thread loads the model when it is done. The whisper threads of the previous model
+ * are stopped on idle_thread.
+ *
+ * @param gf Pointer to the transcription filter data structure.
+ * @param path Path to the model file.
+ * @param silero_vad_model_file Silero VAD model file.
+ */
+void start_whisper_thread_in_background(struct transcription_filter_data *gf,
+					const std::string &path, const char *silero_vad_model_file);
+
+/**
+ * @brief Switches to another model file (or the same file with new context parameters).
+ *
+ * While the whisper threads are running the new model loads in the background, the current
+ * model keeps transcribing and the inference thread switches to the new one between two
+ * segments, so no audio is dropped. Otherwise the threads are (re)started with the model in the
+ * background, see start_whisper_thread_in_background.
+ *
+ * @param gf Pointer to the transcription filter data structure.
+ * @param path Path to the model file.
+ * @param silero_vad_model_file Silero VAD model file, used when the threads are started.
+ */
+void switch_whisper_model(struct transcription_filter_data *gf, const std::string &path,
+			  const char *silero_vad_model_file);
+
+/**
+ * @brief Switches to the model loaded by switch_whisper_model, if it is ready.
+ *
+ * Called by the inference thread between segments.
+ *
+ * @param gf Pointer to the transcription filter data structure.
+ */
+void apply_pending_whisper_model_swap(struct transcription_filter_data *gf);
+
+/**
+ * @brief Releases the models of an idle filter in the background, see idle_suspend_s.
+ *
+ * Called by the whisper thread, which exits when the whisper threads are stopped. Does nothing
+ * while a suspension or a resume is running.
+ *
+ * @param gf Pointer to the transcription filter data structure.
+ */
+void request_idle_suspend(struct transcription_filter_data *gf);
+
+/**
+ * @brief Loads the models of a suspended filter again in the background.
+ *
+ * Never blocks, the audio thread calls it when the audio comes back. The audio pushed to the
+ * input buffer meanwhile is transcribed once the whisper threads run.
+ *
+ * @param gf Pointer to the transcription filter data structure.
+ * @return true if the filter is resuming.
+ */
+bool request_idle_resume(struct transcription_filter_data *gf);
+
+/**
+ * @brief Loads (or unloads) the draft model used for partial results.
+ *
+ * The draft model is a smaller and faster model that decodes the partial results, while the
+ * final results are still decoded by the main model and replace the partials.
+ *
+ * @param gf Pointer to the transcription filter data structure.
+ * @param path Path to the draft model file, empty to unload the draft model.
+ */
+void update_draft_whisper_model(struct transcription_filter_data *gf, const std::string &path);
+
 /**
  * @brief Finds the start of overlap between two sequences.
  *